@@ -0,0 +1,439 @@
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <fstream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "blue_noise.h"
+#include "profiling.h"
+#include "scene_cache.h"
+#include "sdkmesh.h"
+
+namespace {
+
+const char* PrimitiveTypeName(uint32_t primitive_type) {
+  switch (primitive_type) {
+  case sdkmesh::kTriangleList: return "triangle list";
+  case sdkmesh::kTriangleStrip: return "triangle strip";
+  case sdkmesh::kLineList: return "line list";
+  case sdkmesh::kLineStrip: return "line strip";
+  case sdkmesh::kPointList: return "point list";
+  default: return "other";
+  }
+}
+
+int RunInfo(const char* path) {
+  sdkmesh::Mesh mesh(path);
+
+  const sdkmesh::Header& header = mesh.header();
+  std::printf("%s: version %u, %zu bytes\n", path, header.version, mesh.file_size());
+
+  for (uint32_t i = 0; i < mesh.num_vertex_buffers(); ++i) {
+    const sdkmesh::VertexBufferHeader& vb = mesh.vertex_buffer(i);
+    std::printf("  vertex buffer %u: %llu vertices, stride %llu, %llu bytes\n", i,
+                static_cast<unsigned long long>(vb.num_vertices),
+                static_cast<unsigned long long>(vb.stride_bytes),
+                static_cast<unsigned long long>(vb.size_bytes));
+  }
+
+  for (uint32_t i = 0; i < mesh.num_index_buffers(); ++i) {
+    const sdkmesh::IndexBufferHeader& ib = mesh.index_buffer(i);
+    std::printf("  index buffer %u: %llu indices, %u-bit, %llu bytes\n", i,
+                static_cast<unsigned long long>(ib.num_indices),
+                sdkmesh::IndexSizeInBytes(ib.index_type) * 8,
+                static_cast<unsigned long long>(ib.size_bytes));
+  }
+
+  for (uint32_t i = 0; i < mesh.num_materials(); ++i) {
+    sdkmesh::MaterialInfo info = mesh.material_info(i);
+    std::printf("  material %u '%.*s': ambient (%.3f %.3f %.3f) diffuse (%.3f %.3f %.3f) "
+                "alpha %.2f\n", i, sdkmesh::kMaxNameLength, mesh.material(i).name,
+                info.ambient_color.x, info.ambient_color.y, info.ambient_color.z,
+                info.diffuse_color.x, info.diffuse_color.y, info.diffuse_color.z, info.alpha);
+  }
+
+  uint64_t num_triangles = 0;
+
+  for (const sdkmesh::MeshPart& part : mesh.parts()) {
+    std::printf("  part: mesh %u, %s, indices [%u, +%u), vertex offset %d, material %u%s\n",
+                part.mesh_index, PrimitiveTypeName(part.primitive_type), part.start_index,
+                part.index_count, part.vertex_offset, part.material_index,
+                part.is_alpha ? ", alpha" : "");
+
+    if (part.primitive_type == sdkmesh::kTriangleList)
+      num_triangles += part.index_count / 3;
+  }
+
+  std::printf("  %zu parts, %llu triangles\n", mesh.parts().size(),
+              static_cast<unsigned long long>(num_triangles));
+
+  return 0;
+}
+
+// Reads every byte of the vertex and index buffers, which is the work an upload to the GPU does.
+uint64_t Checksum(const uint8_t* data, uint64_t size) {
+  uint64_t sum = 0;
+  for (uint64_t i = 0; i < size; ++i)
+    sum += data[i];
+  return sum;
+}
+
+// Mirrors what DirectX::Model::CreateFromSDKMESH does on the CPU: read the whole file into a heap
+// buffer, copy each vertex and index buffer into its own allocation and create a heap object per
+// mesh part.
+struct CopiedPart {
+  uint32_t start_index;
+  uint32_t index_count;
+  int32_t vertex_offset;
+  uint32_t material_index;
+  std::shared_ptr<std::vector<uint8_t>> vertex_buffer;
+  std::shared_ptr<std::vector<uint8_t>> index_buffer;
+};
+
+uint64_t LoadByCopy(const char* path, std::vector<std::unique_ptr<CopiedPart>>* parts) {
+  std::ifstream file(path, std::ios::in | std::ios::binary | std::ios::ate);
+  if (!file)
+    throw std::runtime_error(std::string("cannot open ") + path);
+
+  std::vector<uint8_t> blob(static_cast<size_t>(file.tellg()));
+  file.seekg(0, std::ios::beg);
+  file.read(reinterpret_cast<char*>(blob.data()), blob.size());
+
+  // Validation is shared with the mapped path; only the data movement differs.
+  sdkmesh::Mesh mesh(path);
+
+  std::vector<std::shared_ptr<std::vector<uint8_t>>> vertex_buffers;
+  for (uint32_t i = 0; i < mesh.num_vertex_buffers(); ++i) {
+    const sdkmesh::VertexBufferHeader& vb = mesh.vertex_buffer(i);
+    const uint8_t* src = blob.data() + vb.data_offset;
+    vertex_buffers.push_back(std::make_shared<std::vector<uint8_t>>(src, src + vb.size_bytes));
+  }
+
+  std::vector<std::shared_ptr<std::vector<uint8_t>>> index_buffers;
+  for (uint32_t i = 0; i < mesh.num_index_buffers(); ++i) {
+    const sdkmesh::IndexBufferHeader& ib = mesh.index_buffer(i);
+    const uint8_t* src = blob.data() + ib.data_offset;
+    index_buffers.push_back(std::make_shared<std::vector<uint8_t>>(src, src + ib.size_bytes));
+  }
+
+  uint64_t checksum = 0;
+  for (const auto& buffer : vertex_buffers)
+    checksum += Checksum(buffer->data(), buffer->size());
+  for (const auto& buffer : index_buffers)
+    checksum += Checksum(buffer->data(), buffer->size());
+
+  for (const sdkmesh::MeshPart& mesh_part : mesh.parts()) {
+    std::unique_ptr<CopiedPart> part = std::make_unique<CopiedPart>();
+    part->start_index = mesh_part.start_index;
+    part->index_count = mesh_part.index_count;
+    part->vertex_offset = mesh_part.vertex_offset;
+    part->material_index = mesh_part.material_index;
+    part->vertex_buffer = vertex_buffers[mesh_part.vertex_buffer];
+    part->index_buffer = index_buffers[mesh_part.index_buffer];
+    parts->push_back(std::move(part));
+  }
+
+  return checksum;
+}
+
+uint64_t LoadByMapping(const char* path, std::unique_ptr<sdkmesh::Mesh>* mesh) {
+  *mesh = std::make_unique<sdkmesh::Mesh>(path);
+
+  uint64_t checksum = 0;
+  for (uint32_t i = 0; i < (*mesh)->num_vertex_buffers(); ++i)
+    checksum += Checksum((*mesh)->vertex_data(i), (*mesh)->vertex_buffer(i).size_bytes);
+  for (uint32_t i = 0; i < (*mesh)->num_index_buffers(); ++i)
+    checksum += Checksum((*mesh)->index_data(i), (*mesh)->index_buffer(i).size_bytes);
+
+  return checksum;
+}
+
+// Peak RSS is per process, so compare the two paths by running the command once with and once
+// without --copy.
+int RunBenchLoad(const char* path, bool copy, int iterations) {
+  double total_ms = 0.0;
+  double min_ms = 0.0;
+  uint64_t checksum = 0;
+
+  for (int i = 0; i < iterations; ++i) {
+    Stopwatch stopwatch;
+
+    if (copy) {
+      std::vector<std::unique_ptr<CopiedPart>> parts;
+      checksum = LoadByCopy(path, &parts);
+    } else {
+      std::unique_ptr<sdkmesh::Mesh> mesh;
+      checksum = LoadByMapping(path, &mesh);
+    }
+
+    double ms = stopwatch.ElapsedMilliseconds();
+    total_ms += ms;
+    if (i == 0 || ms < min_ms)
+      min_ms = ms;
+  }
+
+  std::printf("%s load of %s: %d iterations, min %.3f ms, mean %.3f ms, peak RSS %.2f MiB "
+              "(checksum %llu)\n", copy ? "copy" : "mapped", path, iterations, min_ms,
+              total_ms / iterations, GetPeakResidentBytes() / (1024.0 * 1024.0),
+              static_cast<unsigned long long>(checksum));
+
+  return 0;
+}
+
+int RunBake(const char* sdkmesh_path, const char* scene_path,
+            const scene_cache::BakeOptions& options) {
+  Stopwatch stopwatch;
+
+  sdkmesh::Mesh mesh(sdkmesh_path);
+  std::vector<uint8_t> data = scene_cache::Bake(mesh, options);
+  scene_cache::WriteFile(scene_path, data);
+
+  // Load it back so a bad bake fails here rather than in the apps.
+  scene_cache::Scene scene(scene_path);
+
+  std::printf("%s -> %s: %zu bytes (source %zu bytes), %u vertex buffers, %u index buffers, "
+              "%u draw ranges, %u materials, %u geometries, %.3f ms\n", sdkmesh_path, scene_path,
+              scene.size(), mesh.file_size(), scene.num_vertex_buffers(),
+              scene.num_index_buffers(), scene.num_draw_ranges(), scene.num_materials(),
+              scene.num_geometries(), stopwatch.ElapsedMilliseconds());
+
+  return 0;
+}
+
+// Per-draw state the apps build from a scene before recording any GPU work.
+struct StartupDrawCall {
+  uint32_t primitive_type;
+  uint32_t start_index;
+  uint32_t index_count;
+  int32_t vertex_offset;
+  uint32_t material_index;
+};
+
+// Does the CPU side of the apps' startup: load the scene through the same call the apps use,
+// decode vertices if needed, read every byte that would be uploaded and build the draw and
+// material lists.
+uint64_t RunStartup(const char* scene_path, const char* sdkmesh_path) {
+  std::unique_ptr<scene_cache::Scene> scene = scene_cache::LoadOrBake(scene_path, sdkmesh_path);
+
+  uint64_t checksum = 0;
+
+  std::vector<scene_cache::Vertex> vertices;
+  for (uint32_t i = 0; i < scene->num_vertex_buffers(); ++i) {
+    const scene_cache::VertexBufferDesc& desc = scene->vertex_buffer(i);
+    if (desc.format == scene_cache::kVertexFormatFloat) {
+      checksum += Checksum(scene->vertex_data(i), desc.size_bytes);
+    } else {
+      vertices.resize(desc.num_vertices);
+      scene_cache::DecodeVertices(desc, scene->vertex_data(i), vertices.data());
+      checksum += Checksum(reinterpret_cast<const uint8_t*>(vertices.data()),
+                           vertices.size() * sizeof(scene_cache::Vertex));
+    }
+  }
+  for (uint32_t i = 0; i < scene->num_index_buffers(); ++i)
+    checksum += Checksum(scene->index_data(i), scene->index_buffer(i).size_bytes);
+
+  std::vector<StartupDrawCall> draw_calls;
+  for (uint32_t i = 0; i < scene->num_draw_ranges(); ++i) {
+    const scene_cache::DrawRange& range = scene->draw_range(i);
+    if (range.flags & scene_cache::kDrawRangeAlpha)
+      continue;
+
+    draw_calls.push_back({sdkmesh::ToD3DPrimitiveTopology(range.primitive_type), range.start_index,
+                          range.index_count, range.vertex_offset, range.material_index});
+  }
+
+  std::vector<scene_cache::MaterialDesc> materials(scene->num_materials());
+  for (uint32_t i = 0; i < scene->num_materials(); ++i)
+    materials[i] = scene->material(i);
+
+  return checksum + draw_calls.size() + materials.size();
+}
+
+struct StartupTiming {
+  double min_ms;
+  double mean_ms;
+  uint64_t checksum;
+};
+
+StartupTiming TimeStartup(const char* scene_path, const char* sdkmesh_path, bool cold,
+                          int iterations) {
+  StartupTiming timing{};
+  double total_ms = 0.0;
+
+  for (int i = 0; i < iterations; ++i) {
+    if (cold) {
+      EvictFileFromCache(sdkmesh_path);
+      EvictFileFromCache(scene_path);
+    }
+
+    Stopwatch stopwatch;
+    timing.checksum = RunStartup(scene_path, sdkmesh_path);
+    double ms = stopwatch.ElapsedMilliseconds();
+
+    total_ms += ms;
+    if (i == 0 || ms < timing.min_ms)
+      timing.min_ms = ms;
+  }
+
+  timing.mean_ms = total_ms / iterations;
+  return timing;
+}
+
+// Compares the apps' startup with and without the baked scene. Passing a scene path that does not
+// exist measures the fallback, which bakes the .sdkmesh in memory on every launch.
+int RunBenchStartup(const char* sdkmesh_path, const char* scene_path, bool cold, int iterations) {
+  if (cold && !EvictFileFromCache(sdkmesh_path)) {
+    std::fprintf(stderr, "warning: this platform cannot evict files from the page cache, cold "
+                         "numbers will be warm\n");
+  }
+
+  const char* missing_scene = "";
+
+  StartupTiming from_sdkmesh = TimeStartup(missing_scene, sdkmesh_path, cold, iterations);
+  StartupTiming from_scene = TimeStartup(scene_path, sdkmesh_path, cold, iterations);
+
+  const char* cache_state = cold ? "cold" : "warm";
+  std::printf("%s startup, %d iterations\n", cache_state, iterations);
+  std::printf("  %-40s min %8.3f ms, mean %8.3f ms (checksum %llu)\n", sdkmesh_path,
+              from_sdkmesh.min_ms, from_sdkmesh.mean_ms,
+              static_cast<unsigned long long>(from_sdkmesh.checksum));
+  std::printf("  %-40s min %8.3f ms, mean %8.3f ms (checksum %llu)\n", scene_path,
+              from_scene.min_ms, from_scene.mean_ms,
+              static_cast<unsigned long long>(from_scene.checksum));
+
+  return 0;
+}
+
+// Writes blue-noise tiles for the shaders to upload as an R16_UNORM Texture2DArray.
+int RunBlueNoise(const char* path, int size, int num_slices, uint32_t seed) {
+  Stopwatch stopwatch;
+  const BlueNoiseTiles tiles = GenerateBlueNoise(size, num_slices, seed);
+  const double seconds = stopwatch.ElapsedSeconds();
+
+  SaveBlueNoise(path, tiles);
+  std::printf("%s: %d slices of %dx%d, %zu bytes, generated in %.1f ms\n", path, num_slices, size,
+              size, sizeof(BlueNoiseFileHeader) + tiles.values.size() * sizeof(uint16_t),
+              seconds * 1000.0);
+
+  return 0;
+}
+
+bool ParseIterations(int argc, char** argv, int* i, int* iterations) {
+  if (std::strcmp(argv[*i], "--iterations") != 0 || *i + 1 >= argc)
+    return false;
+  *iterations = std::max(1, std::atoi(argv[++*i]));
+  return true;
+}
+
+void PrintUsage() {
+  std::fprintf(stderr,
+               "usage:\n"
+               "  AssetTool info <file.sdkmesh>\n"
+               "  AssetTool bench-load <file.sdkmesh> [--copy] [--iterations N]\n"
+               "  AssetTool bake <file.sdkmesh> <file.scene> [--quantize] [--wide-indices]\n"
+               "                 [--no-geometries]\n"
+               "  AssetTool bench-startup <file.sdkmesh> <file.scene> [--cold] [--iterations N]\n"
+               "  AssetTool bluenoise <file.bluenoise> [--size N] [--slices N] [--seed N]\n");
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  if (argc < 3) {
+    PrintUsage();
+    return 1;
+  }
+
+  const std::string command = argv[1];
+  const char* path = argv[2];
+
+  try {
+    if (command == "info")
+      return RunInfo(path);
+
+    if (command == "bench-load") {
+      bool copy = false;
+      int iterations = 10;
+
+      for (int i = 3; i < argc; ++i) {
+        if (std::strcmp(argv[i], "--copy") == 0) {
+          copy = true;
+        } else if (!ParseIterations(argc, argv, &i, &iterations)) {
+          PrintUsage();
+          return 1;
+        }
+      }
+
+      return RunBenchLoad(path, copy, iterations);
+    }
+
+    if (command == "bake" && argc >= 4) {
+      scene_cache::BakeOptions options;
+
+      for (int i = 4; i < argc; ++i) {
+        if (std::strcmp(argv[i], "--quantize") == 0) {
+          options.quantize_vertices = true;
+        } else if (std::strcmp(argv[i], "--wide-indices") == 0) {
+          options.narrow_indices = false;
+        } else if (std::strcmp(argv[i], "--no-geometries") == 0) {
+          options.include_geometries = false;
+        } else {
+          PrintUsage();
+          return 1;
+        }
+      }
+
+      return RunBake(path, argv[3], options);
+    }
+
+    if (command == "bench-startup" && argc >= 4) {
+      bool cold = false;
+      int iterations = 10;
+
+      for (int i = 4; i < argc; ++i) {
+        if (std::strcmp(argv[i], "--cold") == 0) {
+          cold = true;
+        } else if (!ParseIterations(argc, argv, &i, &iterations)) {
+          PrintUsage();
+          return 1;
+        }
+      }
+
+      return RunBenchStartup(path, argv[3], cold, iterations);
+    }
+
+    if (command == "bluenoise") {
+      int size = 64;
+      int num_slices = 8;
+      uint32_t seed = 0;
+
+      for (int i = 3; i < argc; ++i) {
+        const bool has_value = i + 1 < argc;
+        if (std::strcmp(argv[i], "--size") == 0 && has_value) {
+          size = std::atoi(argv[++i]);
+        } else if (std::strcmp(argv[i], "--slices") == 0 && has_value) {
+          num_slices = std::atoi(argv[++i]);
+        } else if (std::strcmp(argv[i], "--seed") == 0 && has_value) {
+          seed = static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 10));
+        } else {
+          PrintUsage();
+          return 1;
+        }
+      }
+
+      return RunBlueNoise(path, size, num_slices, seed);
+    }
+  } catch (const std::exception& e) {
+    std::fprintf(stderr, "error: %s\n", e.what());
+    return 1;
+  }
+
+  PrintUsage();
+  return 1;
+}
\ No newline at end of file
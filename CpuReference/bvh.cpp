@@ -0,0 +1,607 @@
+#include "bvh.h"
+
+#include <algorithm>
+#include <limits>
+
+#include "profiling.h"
+
+namespace {
+
+constexpr int kNumBins = 16;
+
+// Relative costs of visiting a node and testing a triangle.
+constexpr float kTraversalCost = 1.f;
+constexpr float kIntersectionCost = 1.f;
+
+// Ranges at least this large are binned by all pool threads during the serial top-level phase.
+constexpr uint32_t kParallelBinningThreshold = 1 << 16;
+// Ranges smaller than this are not worth handing to the pool on their own.
+constexpr uint32_t kMinSubtreeSize = 1024;
+constexpr int kSubtreesPerThread = 8;
+
+// Below this depth the builder switches from SAH to median splits, which keeps the tree shallow
+// enough for the fixed traversal stack even for pathological inputs.
+constexpr uint32_t kMaxSahDepth = 48;
+constexpr int kTraversalStackSize = 96;
+
+constexpr float kInfinity = std::numeric_limits<float>::infinity();
+
+struct Bin {
+  Aabb bounds = Aabb::Empty();
+  Aabb centroid_bounds = Aabb::Empty();
+  uint32_t count = 0;
+};
+
+struct BinSet {
+  Bin bins[3][kNumBins];
+
+  void Merge(const BinSet& other) {
+    for (int axis = 0; axis < 3; ++axis) {
+      for (int i = 0; i < kNumBins; ++i) {
+        bins[axis][i].bounds.Grow(other.bins[axis][i].bounds);
+        bins[axis][i].centroid_bounds.Grow(other.bins[axis][i].centroid_bounds);
+        bins[axis][i].count += other.bins[axis][i].count;
+      }
+    }
+  }
+};
+
+// A contiguous slice of the primitive index array that becomes one node.
+struct BuildRange {
+  uint32_t begin;
+  uint32_t end;
+  Aabb bounds;
+  Aabb centroid_bounds;
+  uint32_t depth;
+
+  uint32_t count() const { return end - begin; }
+};
+
+struct Subtree {
+  BuildRange range;
+  uint32_t node;
+};
+
+class BvhBuilder {
+public:
+  BvhBuilder(const Scene& scene, std::vector<uint32_t>* indices, ThreadPool* pool);
+
+  BuildRange RootRange() const;
+
+  // Splits |range| in two and partitions its indices accordingly. Returns false if it should be
+  // a leaf instead. With |parallel|, large ranges are binned on all pool threads.
+  bool Split(const BuildRange& range, bool parallel, BuildRange* left, BuildRange* right);
+
+  // Recursively builds |range| below the already allocated (*nodes)[node].
+  void BuildSubtree(const BuildRange& range, uint32_t node, std::vector<BvhNode>* nodes);
+
+private:
+  int BinIndex(const BuildRange& range, int axis, float centroid) const;
+  void BinRange(const BuildRange& range, uint32_t begin, uint32_t end, BinSet* bins) const;
+  BuildRange MakeRange(uint32_t begin, uint32_t end, uint32_t depth) const;
+  bool MedianSplit(const BuildRange& range, BuildRange* left, BuildRange* right);
+
+  std::vector<Aabb> primitive_bounds_;
+  std::vector<Vec3> centroids_;
+  std::vector<uint32_t>& indices_;
+  ThreadPool* pool_;
+};
+
+BvhBuilder::BvhBuilder(const Scene& scene, std::vector<uint32_t>* indices, ThreadPool* pool)
+    : primitive_bounds_(scene.num_triangles()), centroids_(scene.num_triangles()),
+      indices_(*indices), pool_(pool) {
+  const uint32_t num_triangles = scene.num_triangles();
+  const int num_chunks = pool_->num_threads() * 4;
+
+  pool_->ParallelFor(num_chunks, [&](int chunk, int) {
+    uint32_t begin = static_cast<uint32_t>(static_cast<uint64_t>(num_triangles) * chunk /
+                                           num_chunks);
+    uint32_t end = static_cast<uint32_t>(static_cast<uint64_t>(num_triangles) * (chunk + 1) /
+                                         num_chunks);
+
+    for (uint32_t i = begin; i < end; ++i) {
+      Aabb bounds = Aabb::Empty();
+      bounds.Grow(scene.position(i, 0));
+      bounds.Grow(scene.position(i, 1));
+      bounds.Grow(scene.position(i, 2));
+
+      primitive_bounds_[i] = bounds;
+      centroids_[i] = bounds.Center();
+    }
+  });
+
+  indices_.resize(num_triangles);
+  for (uint32_t i = 0; i < num_triangles; ++i)
+    indices_[i] = i;
+}
+
+BuildRange BvhBuilder::RootRange() const {
+  return MakeRange(0, static_cast<uint32_t>(indices_.size()), 0);
+}
+
+BuildRange BvhBuilder::MakeRange(uint32_t begin, uint32_t end, uint32_t depth) const {
+  BuildRange range{begin, end, Aabb::Empty(), Aabb::Empty(), depth};
+  for (uint32_t i = begin; i < end; ++i) {
+    range.bounds.Grow(primitive_bounds_[indices_[i]]);
+    range.centroid_bounds.Grow(centroids_[indices_[i]]);
+  }
+  return range;
+}
+
+int BvhBuilder::BinIndex(const BuildRange& range, int axis, float centroid) const {
+  const float min = range.centroid_bounds.min[axis];
+  const float extent = range.centroid_bounds.max[axis] - min;
+  int bin = static_cast<int>((centroid - min) * (kNumBins / extent));
+  return std::min(std::max(bin, 0), kNumBins - 1);
+}
+
+void BvhBuilder::BinRange(const BuildRange& range, uint32_t begin, uint32_t end,
+                          BinSet* bins) const {
+  // Axes where all centroids coincide cannot be split and are left empty.
+  bool active[3];
+  for (int axis = 0; axis < 3; ++axis)
+    active[axis] = range.centroid_bounds.max[axis] > range.centroid_bounds.min[axis];
+
+  for (uint32_t i = begin; i < end; ++i) {
+    const uint32_t primitive = indices_[i];
+    const Aabb& bounds = primitive_bounds_[primitive];
+    const Vec3& centroid = centroids_[primitive];
+
+    for (int axis = 0; axis < 3; ++axis) {
+      if (!active[axis])
+        continue;
+
+      Bin& bin = bins->bins[axis][BinIndex(range, axis, centroid[axis])];
+      bin.bounds.Grow(bounds);
+      bin.centroid_bounds.Grow(centroid);
+      ++bin.count;
+    }
+  }
+}
+
+bool BvhBuilder::Split(const BuildRange& range, bool parallel, BuildRange* left,
+                       BuildRange* right) {
+  const uint32_t count = range.count();
+  if (count <= 1)
+    return false;
+
+  if (range.depth >= kMaxSahDepth) {
+    if (count <= kBvhMaxLeafSize)
+      return false;
+    return MedianSplit(range, left, right);
+  }
+
+  BinSet bins;
+
+  if (parallel && count >= kParallelBinningThreshold && pool_->num_threads() > 1) {
+    const int num_chunks = pool_->num_threads();
+    std::vector<BinSet> chunk_bins(num_chunks);
+
+    pool_->ParallelFor(num_chunks, [&](int chunk, int) {
+      uint32_t begin = range.begin + static_cast<uint32_t>(static_cast<uint64_t>(count) * chunk /
+                                                           num_chunks);
+      uint32_t end = range.begin + static_cast<uint32_t>(
+          static_cast<uint64_t>(count) * (chunk + 1) / num_chunks);
+      BinRange(range, begin, end, &chunk_bins[chunk]);
+    });
+
+    for (const BinSet& chunk : chunk_bins)
+      bins.Merge(chunk);
+  } else {
+    BinRange(range, range.begin, range.end, &bins);
+  }
+
+  // Sweep each axis from both sides to find the cheapest boundary between two bins.
+  float best_cost = kInfinity;
+  int best_axis = -1;
+  int best_bin = 0;
+
+  for (int axis = 0; axis < 3; ++axis) {
+    if (range.centroid_bounds.max[axis] <= range.centroid_bounds.min[axis])
+      continue;
+
+    float right_costs[kNumBins];
+    Aabb right_bounds = Aabb::Empty();
+    uint32_t right_count = 0;
+
+    for (int i = kNumBins - 1; i > 0; --i) {
+      right_bounds.Grow(bins.bins[axis][i].bounds);
+      right_count += bins.bins[axis][i].count;
+      right_costs[i] = right_count > 0 ? right_bounds.SurfaceArea() * right_count : 0.f;
+    }
+
+    Aabb left_bounds = Aabb::Empty();
+    uint32_t left_count = 0;
+
+    for (int i = 0; i < kNumBins - 1; ++i) {
+      left_bounds.Grow(bins.bins[axis][i].bounds);
+      left_count += bins.bins[axis][i].count;
+
+      if (left_count == 0 || left_count == count)
+        continue;
+
+      float cost = left_bounds.SurfaceArea() * left_count + right_costs[i + 1];
+      if (cost < best_cost) {
+        best_cost = cost;
+        best_axis = axis;
+        best_bin = i;
+      }
+    }
+  }
+
+  if (best_axis < 0) {
+    // All centroids fall into one bin.
+    if (count <= kBvhMaxLeafSize)
+      return false;
+    return MedianSplit(range, left, right);
+  }
+
+  const float split_cost =
+      kTraversalCost + kIntersectionCost * best_cost / range.bounds.SurfaceArea();
+  const float leaf_cost = kIntersectionCost * count;
+
+  if (count <= kBvhMaxLeafSize && leaf_cost <= split_cost)
+    return false;
+
+  uint32_t* first = indices_.data() + range.begin;
+  uint32_t* middle = std::partition(first, indices_.data() + range.end, [&](uint32_t primitive) {
+    return BinIndex(range, best_axis, centroids_[primitive][best_axis]) <= best_bin;
+  });
+
+  const uint32_t mid = range.begin + static_cast<uint32_t>(middle - first);
+
+  *left = {range.begin, mid, Aabb::Empty(), Aabb::Empty(), range.depth + 1};
+  *right = {mid, range.end, Aabb::Empty(), Aabb::Empty(), range.depth + 1};
+
+  for (int i = 0; i < kNumBins; ++i) {
+    BuildRange* side = i <= best_bin ? left : right;
+    side->bounds.Grow(bins.bins[best_axis][i].bounds);
+    side->centroid_bounds.Grow(bins.bins[best_axis][i].centroid_bounds);
+  }
+
+  return true;
+}
+
+bool BvhBuilder::MedianSplit(const BuildRange& range, BuildRange* left, BuildRange* right) {
+  const Vec3 extent = range.centroid_bounds.max - range.centroid_bounds.min;
+  int axis = 0;
+  if (extent.y > extent[axis])
+    axis = 1;
+  if (extent.z > extent[axis])
+    axis = 2;
+
+  const uint32_t mid = range.begin + range.count() / 2;
+
+  std::nth_element(indices_.data() + range.begin, indices_.data() + mid,
+                   indices_.data() + range.end, [&](uint32_t a, uint32_t b) {
+                     return centroids_[a][axis] < centroids_[b][axis];
+                   });
+
+  *left = MakeRange(range.begin, mid, range.depth + 1);
+  *right = MakeRange(mid, range.end, range.depth + 1);
+  return true;
+}
+
+void BvhBuilder::BuildSubtree(const BuildRange& range, uint32_t node,
+                              std::vector<BvhNode>* nodes) {
+  (*nodes)[node].bounds_min = range.bounds.min;
+  (*nodes)[node].bounds_max = range.bounds.max;
+
+  BuildRange left, right;
+  if (!Split(range, false, &left, &right)) {
+    (*nodes)[node].first = range.begin;
+    (*nodes)[node].count = range.count();
+    return;
+  }
+
+  const uint32_t first_child = static_cast<uint32_t>(nodes->size());
+  nodes->resize(nodes->size() + 2);
+
+  (*nodes)[node].first = first_child;
+  (*nodes)[node].count = 0;
+
+  BuildSubtree(left, first_child, nodes);
+  BuildSubtree(right, first_child + 1, nodes);
+}
+
+// Slab test. Returns the entry distance, or infinity if the box is missed within [t_min, t_max].
+// 1 + 2 * gamma(3) from "Robust BVH Ray Traversal" (Ize 2013): enough to cover the rounding of
+// the slab distances.
+constexpr float kSlabExitScale = 1.0000004f;
+
+inline float IntersectAabb(const Vec3& origin, const Vec3& inv_direction, const Vec3& bounds_min,
+                           const Vec3& bounds_max, float t_min, float t_max) {
+  for (int axis = 0; axis < 3; ++axis) {
+    float t0 = (bounds_min[axis] - origin[axis]) * inv_direction[axis];
+    float t1 = (bounds_max[axis] - origin[axis]) * inv_direction[axis];
+    if (t0 > t1)
+      std::swap(t0, t1);
+
+    // Rounding can put the exit just before a hit on the box's face, which would cull a triangle
+    // lying in that face.
+    t1 *= kSlabExitScale;
+
+    // Written so that a NaN from 0 * infinity leaves the interval unchanged.
+    t_min = t0 > t_min ? t0 : t_min;
+    t_max = t1 < t_max ? t1 : t_max;
+  }
+  return t_min <= t_max ? t_min : kInfinity;
+}
+
+}  // namespace
+
+Aabb Aabb::Empty() {
+  return {{kInfinity, kInfinity, kInfinity}, {-kInfinity, -kInfinity, -kInfinity}};
+}
+
+void Aabb::Grow(const Vec3& point) {
+  min = Min(min, point);
+  max = Max(max, point);
+}
+
+void Aabb::Grow(const Aabb& other) {
+  min = Min(min, other.min);
+  max = Max(max, other.max);
+}
+
+float Aabb::SurfaceArea() const {
+  const Vec3 extent = max - min;
+  if (extent.x < 0.f)
+    return 0.f;
+  return 2.f * (extent.x * extent.y + extent.y * extent.z + extent.z * extent.x);
+}
+
+Bvh::Bvh(const Scene& scene, ThreadPool* pool) : scene_(scene) {
+  Stopwatch stopwatch;
+
+  if (scene.num_triangles() == 0) {
+    nodes_.push_back({{0.f, 0.f, 0.f}, 0, {0.f, 0.f, 0.f}, 0});
+    ComputeStats();
+    return;
+  }
+
+  BvhBuilder builder(scene, &primitive_indices_, pool);
+
+  nodes_.reserve(static_cast<size_t>(scene.num_triangles()) * 2 / 3 + 1);
+  nodes_.resize(1);
+
+  // Top-level phase: keep splitting the largest pending range until there is enough
+  // independent work for the pool.
+  const size_t target_subtrees = static_cast<size_t>(pool->num_threads()) * kSubtreesPerThread;
+
+  std::vector<Subtree> pending = {{builder.RootRange(), 0}};
+  std::vector<Subtree> subtrees;
+
+  while (!pending.empty() && pending.size() + subtrees.size() < target_subtrees) {
+    auto largest = std::max_element(pending.begin(), pending.end(),
+                                    [](const Subtree& a, const Subtree& b) {
+                                      return a.range.count() < b.range.count();
+                                    });
+    if (largest->range.count() < kMinSubtreeSize && pool->num_threads() > 1)
+      break;
+
+    Subtree subtree = *largest;
+    pending.erase(largest);
+
+    BvhNode& node = nodes_[subtree.node];
+    node.bounds_min = subtree.range.bounds.min;
+    node.bounds_max = subtree.range.bounds.max;
+
+    BuildRange left, right;
+    if (!builder.Split(subtree.range, true, &left, &right)) {
+      node.first = subtree.range.begin;
+      node.count = subtree.range.count();
+      continue;
+    }
+
+    const uint32_t first_child = static_cast<uint32_t>(nodes_.size());
+    node.first = first_child;
+    node.count = 0;
+    nodes_.resize(nodes_.size() + 2);
+
+    pending.push_back({left, first_child});
+    pending.push_back({right, first_child + 1});
+  }
+
+  subtrees.insert(subtrees.end(), pending.begin(), pending.end());
+
+  // Each subtree is built into its own array with its root at index 0, then appended.
+  std::vector<std::vector<BvhNode>> subtree_nodes(subtrees.size());
+
+  pool->ParallelFor(static_cast<int>(subtrees.size()), [&](int i, int) {
+    std::vector<BvhNode>& local = subtree_nodes[i];
+    local.reserve(subtrees[i].range.count() * 2 / 3 + 1);
+    local.resize(1);
+    builder.BuildSubtree(subtrees[i].range, 0, &local);
+  });
+
+  for (size_t i = 0; i < subtrees.size(); ++i) {
+    const std::vector<BvhNode>& local = subtree_nodes[i];
+
+    // Local index j >= 1 lands at base + j - 1.
+    const uint32_t base = static_cast<uint32_t>(nodes_.size());
+    auto relocate = [base](BvhNode node) {
+      if (!node.is_leaf())
+        node.first = base + node.first - 1;
+      return node;
+    };
+
+    nodes_[subtrees[i].node] = relocate(local[0]);
+    for (size_t j = 1; j < local.size(); ++j)
+      nodes_.push_back(relocate(local[j]));
+  }
+
+  stats_.build_seconds = stopwatch.ElapsedSeconds();
+  ComputeStats();
+}
+
+void Bvh::ComputeStats() {
+  stats_.memory_bytes = nodes_.size() * sizeof(BvhNode) +
+                        primitive_indices_.size() * sizeof(uint32_t);
+
+  // An empty scene has a single node that is neither a leaf nor a parent.
+  if (primitive_indices_.empty()) {
+    stats_.num_nodes = 1;
+    return;
+  }
+
+  const float root_area = Aabb{nodes_[0].bounds_min, nodes_[0].bounds_max}.SurfaceArea();
+
+  stats_.num_nodes = static_cast<uint32_t>(nodes_.size());
+  stats_.num_leaves = 0;
+  stats_.max_depth = 0;
+  stats_.min_leaf_size = 0xffffffff;
+  stats_.max_leaf_size = 0;
+  stats_.sah_cost = 0.0;
+
+  uint64_t total_leaf_size = 0;
+
+  struct Entry {
+    uint32_t node;
+    uint32_t depth;
+  };
+  std::vector<Entry> stack = {{0, 0}};
+
+  while (!stack.empty()) {
+    Entry entry = stack.back();
+    stack.pop_back();
+
+    const BvhNode& node = nodes_[entry.node];
+    const double relative_area = root_area > 0.f
+        ? Aabb{node.bounds_min, node.bounds_max}.SurfaceArea() / root_area
+        : 1.0;
+
+    stats_.max_depth = std::max(stats_.max_depth, entry.depth);
+
+    if (node.is_leaf()) {
+      ++stats_.num_leaves;
+      stats_.min_leaf_size = std::min(stats_.min_leaf_size, node.count);
+      stats_.max_leaf_size = std::max(stats_.max_leaf_size, node.count);
+      total_leaf_size += node.count;
+      stats_.sah_cost += relative_area * node.count * kIntersectionCost;
+    } else {
+      stats_.sah_cost += relative_area * kTraversalCost;
+      stack.push_back({node.first, entry.depth + 1});
+      stack.push_back({node.first + 1, entry.depth + 1});
+    }
+  }
+
+  if (stats_.num_leaves == 0 || total_leaf_size == 0)
+    stats_.min_leaf_size = 0;
+  stats_.average_leaf_size =
+      stats_.num_leaves > 0 ? static_cast<double>(total_leaf_size) / stats_.num_leaves : 0.0;
+}
+
+bool Bvh::Intersect(const Ray& ray, Hit* hit) const {
+  hit->t = ray.t_max;
+  hit->triangle = kInvalidTriangle;
+
+  if (primitive_indices_.empty())
+    return false;
+
+  return IntersectSubtree(0, ray, hit);
+}
+
+bool Bvh::IntersectSubtree(uint32_t root, const Ray& ray, Hit* hit) const {
+  const Vec3 inv_direction = {1.f / ray.direction.x, 1.f / ray.direction.y,
+                              1.f / ray.direction.z};
+
+  uint32_t stack[kTraversalStackSize];
+  int stack_size = 0;
+  uint32_t node_index = root;
+
+  if (IntersectAabb(ray.origin, inv_direction, nodes_[root].bounds_min, nodes_[root].bounds_max,
+                    ray.t_min, hit->t) == kInfinity) {
+    return hit->triangle != kInvalidTriangle;
+  }
+
+  for (;;) {
+    const BvhNode& node = nodes_[node_index];
+
+    if (node.is_leaf()) {
+      for (uint32_t i = node.first; i < node.first + node.count; ++i) {
+        const uint32_t triangle = primitive_indices_[i];
+        float t, u, v;
+        if (IntersectTriangle(ray, scene_.position(triangle, 0), scene_.position(triangle, 1),
+                              scene_.position(triangle, 2), true, hit->t, &t, &u, &v) &&
+            IsCloser(t, triangle, *hit)) {
+          hit->t = t;
+          hit->u = u;
+          hit->v = v;
+          hit->triangle = triangle;
+        }
+      }
+    } else {
+      const BvhNode& left = nodes_[node.first];
+      const BvhNode& right = nodes_[node.first + 1];
+
+      float t_left = IntersectAabb(ray.origin, inv_direction, left.bounds_min, left.bounds_max,
+                                   ray.t_min, hit->t);
+      float t_right = IntersectAabb(ray.origin, inv_direction, right.bounds_min,
+                                    right.bounds_max, ray.t_min, hit->t);
+
+      if (t_left != kInfinity && t_right != kInfinity) {
+        // Visit the nearer child first so the farther one is more likely to be culled.
+        uint32_t near_child = t_left <= t_right ? node.first : node.first + 1;
+        stack[stack_size++] = near_child == node.first ? node.first + 1 : node.first;
+        node_index = near_child;
+        continue;
+      }
+      if (t_left != kInfinity) {
+        node_index = node.first;
+        continue;
+      }
+      if (t_right != kInfinity) {
+        node_index = node.first + 1;
+        continue;
+      }
+    }
+
+    if (stack_size == 0)
+      break;
+    node_index = stack[--stack_size];
+  }
+
+  return hit->triangle != kInvalidTriangle;
+}
+
+bool Bvh::Occluded(const Ray& ray) const {
+  if (primitive_indices_.empty())
+    return false;
+
+  return OccludedSubtree(0, ray);
+}
+
+bool Bvh::OccludedSubtree(uint32_t root, const Ray& ray) const {
+  const Vec3 inv_direction = {1.f / ray.direction.x, 1.f / ray.direction.y,
+                              1.f / ray.direction.z};
+
+  uint32_t stack[kTraversalStackSize];
+  int stack_size = 0;
+  stack[stack_size++] = root;
+
+  while (stack_size > 0) {
+    const BvhNode& node = nodes_[stack[--stack_size]];
+
+    if (IntersectAabb(ray.origin, inv_direction, node.bounds_min, node.bounds_max, ray.t_min,
+                      ray.t_max) == kInfinity) {
+      continue;
+    }
+
+    if (node.is_leaf()) {
+      for (uint32_t i = node.first; i < node.first + node.count; ++i) {
+        const uint32_t triangle = primitive_indices_[i];
+        float t, u, v;
+        if (IntersectTriangle(ray, scene_.position(triangle, 0), scene_.position(triangle, 1),
+                              scene_.position(triangle, 2), true, ray.t_max, &t, &u, &v)) {
+          return true;
+        }
+      }
+    } else {
+      stack[stack_size++] = node.first + 1;
+      stack[stack_size++] = node.first;
+    }
+  }
+
+  return false;
+}
\ No newline at end of file
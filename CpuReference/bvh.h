@@ -0,0 +1,91 @@
+#ifndef BVH_H_
+#define BVH_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "ray.h"
+#include "scene.h"
+#include "thread_pool.h"
+#include "vec_math.h"
+
+struct Aabb {
+  Vec3 min;
+  Vec3 max;
+
+  static Aabb Empty();
+
+  void Grow(const Vec3& point);
+  void Grow(const Aabb& other);
+
+  Vec3 Center() const { return (min + max) * 0.5f; }
+  float SurfaceArea() const;
+};
+
+// Leaves hold at most this many triangles.
+constexpr uint32_t kBvhMaxLeafSize = 8;
+
+// Binary BVH node, 32 bytes so two siblings share a cache line. Siblings are always stored next
+// to each other, so an interior node only needs the index of its first child.
+struct BvhNode {
+  Vec3 bounds_min;
+  // Interior nodes: index of the first child. Leaves: index of the first entry in
+  // Bvh::primitive_indices().
+  uint32_t first;
+  Vec3 bounds_max;
+  // Number of triangles in a leaf, 0 for interior nodes.
+  uint32_t count;
+
+  bool is_leaf() const { return count != 0; }
+};
+
+static_assert(sizeof(BvhNode) == 32, "BvhNode size mismatch");
+
+struct BvhStats {
+  double build_seconds = 0.0;
+  // Expected cost of a random ray, in units of one triangle test, with the costs the builder
+  // optimizes for.
+  double sah_cost = 0.0;
+  uint32_t num_nodes = 0;
+  uint32_t num_leaves = 0;
+  uint32_t max_depth = 0;
+  uint32_t min_leaf_size = 0;
+  uint32_t max_leaf_size = 0;
+  double average_leaf_size = 0.0;
+  size_t memory_bytes = 0;
+};
+
+// Bounding volume hierarchy over a Scene's triangles, built with a binned surface area heuristic.
+// The top of the tree is split on the calling thread (binning large ranges in parallel) until
+// there are enough independent subtrees to keep every pool thread busy; those are then built in
+// parallel and stitched into one node array.
+class Bvh : public RayIntersector {
+public:
+  Bvh(const Scene& scene, ThreadPool* pool);
+
+  const std::vector<BvhNode>& nodes() const { return nodes_; }
+  const std::vector<uint32_t>& primitive_indices() const { return primitive_indices_; }
+  const BvhStats& stats() const { return stats_; }
+
+  // Both tests skip back faces, matching the ray flags in raytracing.hlsl.
+  bool Intersect(const Ray& ray, Hit* hit) const override;
+  bool Occluded(const Ray& ray) const override;
+
+  // The same tests limited to the subtree under |root|. IntersectSubtree only reports hits
+  // closer than the one already in |hit|, so a packet traversal can hand its rays over midway.
+  bool IntersectSubtree(uint32_t root, const Ray& ray, Hit* hit) const;
+  bool OccludedSubtree(uint32_t root, const Ray& ray) const;
+
+private:
+  void ComputeStats();
+
+  const Scene& scene_;
+
+  std::vector<BvhNode> nodes_;
+  std::vector<uint32_t> primitive_indices_;
+
+  BvhStats stats_;
+};
+
+#endif  // BVH_H_
\ No newline at end of file
@@ -0,0 +1,483 @@
+#include "bvh8.h"
+
+#include <immintrin.h>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#include "profiling.h"
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+namespace {
+
+constexpr int kMaxChildren = 8;
+constexpr uint32_t kMaxLeafTriangles = 8;
+
+static_assert(kBvhMaxLeafSize <= kMaxLeafTriangles, "binary leaves must fit in one block");
+
+// Each level pushes at most seven entries besides the one it continues with, and the binary
+// builder keeps its trees below 80 levels.
+constexpr int kTraversalStackSize = 7 * 80 + 1;
+
+// Same padding of the slab exit as the binary traversal.
+constexpr float kSlabExitScale = 1.0000004f;
+
+// Direction components are clamped away from zero so the slab distances stay finite.
+constexpr float kMinDirection = 1e-30f;
+
+constexpr float kInfinity = std::numeric_limits<float>::infinity();
+
+inline int LowestSetBit(int mask) {
+#if defined(_MSC_VER)
+  unsigned long index;
+  _BitScanForward(&index, static_cast<unsigned long>(mask));
+  return static_cast<int>(index);
+#else
+  return __builtin_ctz(static_cast<unsigned>(mask));
+#endif
+}
+
+// Per-ray values shared by every node and leaf test.
+struct RayData {
+  __m256 origin[3];
+  __m256 inv_direction[3];
+  // Whether the near slab on each axis is the box's max plane.
+  bool near_is_max[3];
+  __m256 t_min;
+
+  // Watertight test: kz is the dominant axis of the direction, and kx and ky are swapped when it
+  // is negative to keep the winding. The shear maps the direction to +z.
+  int kx;
+  int ky;
+  int kz;
+  __m256 shear_x;
+  __m256 shear_y;
+  __m256 shear_z;
+};
+
+struct StackEntry {
+  uint32_t child;
+  float t;
+};
+
+RayData PrepareRay(const Ray& ray) {
+  RayData data;
+
+  for (int axis = 0; axis < 3; ++axis) {
+    float direction = ray.direction[axis];
+    if (std::fabs(direction) < kMinDirection)
+      direction = std::copysign(kMinDirection, direction);
+
+    const float inv_direction = 1.f / direction;
+    data.origin[axis] = _mm256_set1_ps(ray.origin[axis]);
+    data.inv_direction[axis] = _mm256_set1_ps(inv_direction);
+    data.near_is_max[axis] = inv_direction < 0.f;
+  }
+  data.t_min = _mm256_set1_ps(ray.t_min);
+
+  const Vec3 abs_direction = {std::fabs(ray.direction.x), std::fabs(ray.direction.y),
+                              std::fabs(ray.direction.z)};
+  data.kz = 0;
+  if (abs_direction.y > abs_direction[data.kz])
+    data.kz = 1;
+  if (abs_direction.z > abs_direction[data.kz])
+    data.kz = 2;
+  data.kx = (data.kz + 1) % 3;
+  data.ky = (data.kx + 1) % 3;
+  if (ray.direction[data.kz] < 0.f)
+    std::swap(data.kx, data.ky);
+
+  const float inv_kz = 1.f / ray.direction[data.kz];
+  data.shear_x = _mm256_set1_ps(ray.direction[data.kx] * inv_kz);
+  data.shear_y = _mm256_set1_ps(ray.direction[data.ky] * inv_kz);
+  data.shear_z = _mm256_set1_ps(inv_kz);
+
+  return data;
+}
+
+// Slab test against all eight children. Returns the mask of boxes overlapping
+// [t_min, t_max] and their entry distances in |t_near|.
+inline int IntersectChildren(const Bvh8Node& node, const RayData& ray, float t_max,
+                             __m256* t_near) {
+  __m256 near = ray.t_min;
+  __m256 far = _mm256_set1_ps(t_max);
+
+  for (int axis = 0; axis < 3; ++axis) {
+    const float* near_plane = ray.near_is_max[axis] ? node.bounds_max[axis]
+                                                    : node.bounds_min[axis];
+    const float* far_plane = ray.near_is_max[axis] ? node.bounds_min[axis]
+                                                   : node.bounds_max[axis];
+
+    const __m256 t0 = _mm256_mul_ps(_mm256_sub_ps(_mm256_load_ps(near_plane), ray.origin[axis]),
+                                    ray.inv_direction[axis]);
+    const __m256 t1 = _mm256_mul_ps(_mm256_sub_ps(_mm256_load_ps(far_plane), ray.origin[axis]),
+                                    ray.inv_direction[axis]);
+
+    near = _mm256_max_ps(near, t0);
+    far = _mm256_min_ps(far, t1);
+  }
+
+  far = _mm256_mul_ps(far, _mm256_set1_ps(kSlabExitScale));
+
+  *t_near = near;
+  return _mm256_movemask_ps(_mm256_cmp_ps(near, far, _CMP_LE_OQ));
+}
+
+// Watertight test against the eight triangles of |block|. Returns the mask of front-facing hits
+// with t in [t_min, t_max], and their distances and barycentrics.
+inline int IntersectBlock(const TriangleBlock8& block, const RayData& ray, float t_max,
+                          __m256* t, __m256* u, __m256* v) {
+  const int kx = ray.kx;
+  const int ky = ray.ky;
+  const int kz = ray.kz;
+
+  // Corners relative to the ray origin, in the ray's permuted axes.
+  __m256 x[3], y[3], z[3];
+  for (int corner = 0; corner < 3; ++corner) {
+    const __m256 px = _mm256_sub_ps(_mm256_load_ps(block.vertices[corner][kx]), ray.origin[kx]);
+    const __m256 py = _mm256_sub_ps(_mm256_load_ps(block.vertices[corner][ky]), ray.origin[ky]);
+    const __m256 pz = _mm256_sub_ps(_mm256_load_ps(block.vertices[corner][kz]), ray.origin[kz]);
+
+    // Shear so the ray runs along +z through the origin.
+    x[corner] = _mm256_sub_ps(px, _mm256_mul_ps(ray.shear_x, pz));
+    y[corner] = _mm256_sub_ps(py, _mm256_mul_ps(ray.shear_y, pz));
+    z[corner] = _mm256_mul_ps(ray.shear_z, pz);
+  }
+
+  // Edge functions. U, V and W weight the first, second and third corner.
+  __m256 edge_u = _mm256_sub_ps(_mm256_mul_ps(x[2], y[1]), _mm256_mul_ps(y[2], x[1]));
+  __m256 edge_v = _mm256_sub_ps(_mm256_mul_ps(x[0], y[2]), _mm256_mul_ps(y[0], x[2]));
+  __m256 edge_w = _mm256_sub_ps(_mm256_mul_ps(x[1], y[0]), _mm256_mul_ps(y[1], x[0]));
+
+  const __m256 invalid = _mm256_castsi256_ps(
+      _mm256_cmpeq_epi32(_mm256_load_si256(reinterpret_cast<const __m256i*>(block.triangles)),
+                         _mm256_set1_epi32(static_cast<int>(kInvalidTriangle))));
+  const int valid_mask = ~_mm256_movemask_ps(invalid) & 0xff;
+
+  // An edge function of exactly zero may have lost its sign to rounding; redo those lanes in
+  // double precision, as the paper does.
+  const __m256 zero = _mm256_setzero_ps();
+  int zero_mask = _mm256_movemask_ps(_mm256_or_ps(
+      _mm256_or_ps(_mm256_cmp_ps(edge_u, zero, _CMP_EQ_OQ),
+                   _mm256_cmp_ps(edge_v, zero, _CMP_EQ_OQ)),
+      _mm256_cmp_ps(edge_w, zero, _CMP_EQ_OQ))) & valid_mask;
+
+  if (zero_mask != 0) {
+    alignas(32) float xs[3][8], ys[3][8], us[8], vs[8], ws[8];
+    for (int corner = 0; corner < 3; ++corner) {
+      _mm256_store_ps(xs[corner], x[corner]);
+      _mm256_store_ps(ys[corner], y[corner]);
+    }
+    _mm256_store_ps(us, edge_u);
+    _mm256_store_ps(vs, edge_v);
+    _mm256_store_ps(ws, edge_w);
+
+    while (zero_mask != 0) {
+      const int i = LowestSetBit(zero_mask);
+      zero_mask &= zero_mask - 1;
+
+      us[i] = static_cast<float>(static_cast<double>(xs[2][i]) * ys[1][i] -
+                                 static_cast<double>(ys[2][i]) * xs[1][i]);
+      vs[i] = static_cast<float>(static_cast<double>(xs[0][i]) * ys[2][i] -
+                                 static_cast<double>(ys[0][i]) * xs[2][i]);
+      ws[i] = static_cast<float>(static_cast<double>(xs[1][i]) * ys[0][i] -
+                                 static_cast<double>(ys[1][i]) * xs[0][i]);
+    }
+
+    edge_u = _mm256_load_ps(us);
+    edge_v = _mm256_load_ps(vs);
+    edge_w = _mm256_load_ps(ws);
+  }
+
+  // Front faces, under D3D's clockwise rule, have all three edge functions non-negative; back
+  // faces are culled like RAY_FLAG_CULL_BACK_FACING_TRIANGLES.
+  __m256 hit = _mm256_and_ps(_mm256_cmp_ps(edge_u, zero, _CMP_GE_OQ),
+                             _mm256_cmp_ps(edge_v, zero, _CMP_GE_OQ));
+  hit = _mm256_and_ps(hit, _mm256_cmp_ps(edge_w, zero, _CMP_GE_OQ));
+
+  const __m256 det = _mm256_add_ps(_mm256_add_ps(edge_u, edge_v), edge_w);
+  hit = _mm256_and_ps(hit, _mm256_cmp_ps(det, zero, _CMP_GT_OQ));
+
+  // Scaled distance, compared against the range scaled by det to avoid the division.
+  const __m256 scaled_t = _mm256_add_ps(
+      _mm256_add_ps(_mm256_mul_ps(edge_u, z[0]), _mm256_mul_ps(edge_v, z[1])),
+      _mm256_mul_ps(edge_w, z[2]));
+  hit = _mm256_and_ps(hit, _mm256_cmp_ps(scaled_t, _mm256_mul_ps(det, ray.t_min), _CMP_GE_OQ));
+  hit = _mm256_and_ps(hit, _mm256_cmp_ps(scaled_t, _mm256_mul_ps(det, _mm256_set1_ps(t_max)),
+                                         _CMP_LE_OQ));
+
+  const int mask = _mm256_movemask_ps(hit) & valid_mask;
+  if (mask == 0)
+    return 0;
+
+  const __m256 inv_det = _mm256_div_ps(_mm256_set1_ps(1.f), det);
+  *t = _mm256_mul_ps(scaled_t, inv_det);
+  *u = _mm256_mul_ps(edge_v, inv_det);
+  *v = _mm256_mul_ps(edge_w, inv_det);
+  return mask;
+}
+
+// Appends every triangle below |node| to |triangles|.
+void CollectTriangles(const Bvh& bvh, uint32_t node, std::vector<uint32_t>* triangles) {
+  const BvhNode& binary = bvh.nodes()[node];
+  if (binary.is_leaf()) {
+    for (uint32_t i = binary.first; i < binary.first + binary.count; ++i)
+      triangles->push_back(bvh.primitive_indices()[i]);
+    return;
+  }
+  CollectTriangles(bvh, binary.first, triangles);
+  CollectTriangles(bvh, binary.first + 1, triangles);
+}
+
+}  // namespace
+
+Bvh8::Bvh8(const Scene& scene, const Bvh& bvh) {
+  Stopwatch stopwatch;
+
+  const std::vector<BvhNode>& binary = bvh.nodes();
+
+  if (bvh.primitive_indices().empty()) {
+    // A root whose slots are all empty, so every ray misses.
+    Bvh8Node root;
+    std::fill_n(&root.bounds_min[0][0], 3 * 8, kInfinity);
+    std::fill_n(&root.bounds_max[0][0], 3 * 8, -kInfinity);
+    std::fill_n(root.children, 8, kBvh8EmptyChild);
+    nodes_.push_back(root);
+  } else {
+    // Triangle counts of every binary subtree. Children are always stored after their parent,
+    // so one backwards pass sees them first.
+    std::vector<uint32_t> sizes(binary.size());
+    for (size_t i = binary.size(); i-- > 0;) {
+      const BvhNode& node = binary[i];
+      sizes[i] = node.is_leaf() ? node.count : sizes[node.first] + sizes[node.first + 1];
+    }
+
+    nodes_.reserve(binary.size() / 4 + 1);
+    triangle_blocks_.reserve(binary.size() / 4 + 1);
+
+    BuildNode(scene, bvh, sizes, 0, 0);
+  }
+
+  uint64_t used_children = 0;
+  for (const Bvh8Node& node : nodes_) {
+    for (uint32_t child : node.children)
+      used_children += child != kBvh8EmptyChild;
+  }
+
+  uint64_t used_lanes = 0;
+  for (const TriangleBlock8& block : triangle_blocks_) {
+    for (uint32_t triangle : block.triangles)
+      used_lanes += triangle != kInvalidTriangle;
+  }
+
+  stats_.num_nodes = static_cast<uint32_t>(nodes_.size());
+  stats_.num_leaves = static_cast<uint32_t>(triangle_blocks_.size());
+  stats_.average_children = static_cast<double>(used_children) / nodes_.size();
+  stats_.average_leaf_triangles = triangle_blocks_.empty()
+      ? 0.0
+      : static_cast<double>(used_lanes) / triangle_blocks_.size();
+  stats_.memory_bytes = nodes_.size() * sizeof(Bvh8Node) +
+                        triangle_blocks_.size() * sizeof(TriangleBlock8);
+  stats_.build_seconds = stopwatch.ElapsedSeconds();
+}
+
+uint32_t Bvh8::BuildNode(const Scene& scene, const Bvh& bvh, const std::vector<uint32_t>& sizes,
+                         uint32_t binary_node, uint32_t depth) {
+  const std::vector<BvhNode>& binary = bvh.nodes();
+
+  // Slots start with the binary node's children, or the node itself when the whole scene fits in
+  // one leaf.
+  uint32_t slots[kMaxChildren];
+  int num_slots = 0;
+
+  if (binary[binary_node].is_leaf() || sizes[binary_node] <= kMaxLeafTriangles) {
+    slots[num_slots++] = binary_node;
+  } else {
+    slots[num_slots++] = binary[binary_node].first;
+    slots[num_slots++] = binary[binary_node].first + 1;
+  }
+
+  // Open the largest child that cannot become a leaf until the slots are full.
+  while (num_slots < kMaxChildren) {
+    int best_slot = -1;
+    float best_area = -1.f;
+
+    for (int i = 0; i < num_slots; ++i) {
+      const BvhNode& node = binary[slots[i]];
+      if (node.is_leaf() || sizes[slots[i]] <= kMaxLeafTriangles)
+        continue;
+
+      const float area = Aabb{node.bounds_min, node.bounds_max}.SurfaceArea();
+      if (area > best_area) {
+        best_area = area;
+        best_slot = i;
+      }
+    }
+
+    if (best_slot < 0)
+      break;
+
+    const uint32_t first_child = binary[slots[best_slot]].first;
+    slots[best_slot] = first_child;
+    slots[num_slots++] = first_child + 1;
+  }
+
+  const uint32_t index = static_cast<uint32_t>(nodes_.size());
+  nodes_.emplace_back();
+
+  stats_.max_depth = std::max(stats_.max_depth, depth);
+
+  // Children are built first; |nodes_| may reallocate while they are.
+  uint32_t children[kMaxChildren];
+  for (int i = 0; i < num_slots; ++i) {
+    children[i] = sizes[slots[i]] <= kMaxLeafTriangles
+        ? BuildLeaf(scene, bvh, slots[i]) | kBvh8LeafBit
+        : BuildNode(scene, bvh, sizes, slots[i], depth + 1);
+  }
+
+  Bvh8Node& node = nodes_[index];
+  for (int i = 0; i < kMaxChildren; ++i) {
+    if (i < num_slots) {
+      const BvhNode& child = binary[slots[i]];
+      for (int axis = 0; axis < 3; ++axis) {
+        node.bounds_min[axis][i] = child.bounds_min[axis];
+        node.bounds_max[axis][i] = child.bounds_max[axis];
+      }
+      node.children[i] = children[i];
+    } else {
+      for (int axis = 0; axis < 3; ++axis) {
+        node.bounds_min[axis][i] = kInfinity;
+        node.bounds_max[axis][i] = -kInfinity;
+      }
+      node.children[i] = kBvh8EmptyChild;
+    }
+  }
+
+  return index;
+}
+
+uint32_t Bvh8::BuildLeaf(const Scene& scene, const Bvh& bvh, uint32_t binary_node) {
+  std::vector<uint32_t> triangles;
+  CollectTriangles(bvh, binary_node, &triangles);
+
+  TriangleBlock8 block;
+  for (uint32_t lane = 0; lane < kMaxLeafTriangles; ++lane) {
+    // Unused lanes repeat the first triangle so they hold finite values.
+    const uint32_t triangle = triangles[lane < triangles.size() ? lane : 0];
+    for (int corner = 0; corner < 3; ++corner) {
+      const Vec3& position = scene.position(triangle, corner);
+      for (int axis = 0; axis < 3; ++axis)
+        block.vertices[corner][axis][lane] = position[axis];
+    }
+    block.triangles[lane] = lane < triangles.size() ? triangle : kInvalidTriangle;
+  }
+
+  triangle_blocks_.push_back(block);
+  return static_cast<uint32_t>(triangle_blocks_.size() - 1);
+}
+
+bool Bvh8::Intersect(const Ray& ray, Hit* hit) const {
+  hit->t = ray.t_max;
+  hit->triangle = kInvalidTriangle;
+
+  const RayData data = PrepareRay(ray);
+
+  StackEntry stack[kTraversalStackSize];
+  int stack_size = 0;
+  stack[stack_size++] = {0, ray.t_min};
+
+  while (stack_size > 0) {
+    const StackEntry entry = stack[--stack_size];
+
+    // Skip subtrees that start beyond the closest hit found since they were pushed.
+    if (entry.t > hit->t * kSlabExitScale)
+      continue;
+
+    if (entry.child & kBvh8LeafBit) {
+      const TriangleBlock8& block = triangle_blocks_[entry.child & ~kBvh8LeafBit];
+
+      __m256 t, u, v;
+      int mask = IntersectBlock(block, data, hit->t, &t, &u, &v);
+      if (mask == 0)
+        continue;
+
+      alignas(32) float ts[8], us[8], vs[8];
+      _mm256_store_ps(ts, t);
+      _mm256_store_ps(us, u);
+      _mm256_store_ps(vs, v);
+
+      while (mask != 0) {
+        const int i = LowestSetBit(mask);
+        mask &= mask - 1;
+
+        if (IsCloser(ts[i], block.triangles[i], *hit)) {
+          hit->t = ts[i];
+          hit->u = us[i];
+          hit->v = vs[i];
+          hit->triangle = block.triangles[i];
+        }
+      }
+      continue;
+    }
+
+    const Bvh8Node& node = nodes_[entry.child];
+
+    __m256 t_near;
+    int mask = IntersectChildren(node, data, hit->t, &t_near);
+    if (mask == 0)
+      continue;
+
+    alignas(32) float near[8];
+    _mm256_store_ps(near, t_near);
+
+    // Insert the hit children farthest first, so the nearest one is popped next.
+    const int first = stack_size;
+    while (mask != 0) {
+      const int i = LowestSetBit(mask);
+      mask &= mask - 1;
+
+      const StackEntry child = {node.children[i], near[i]};
+      int j = stack_size++;
+      for (; j > first && stack[j - 1].t < child.t; --j)
+        stack[j] = stack[j - 1];
+      stack[j] = child;
+    }
+  }
+
+  return hit->triangle != kInvalidTriangle;
+}
+
+bool Bvh8::Occluded(const Ray& ray) const {
+  const RayData data = PrepareRay(ray);
+
+  uint32_t stack[kTraversalStackSize];
+  int stack_size = 0;
+  stack[stack_size++] = 0;
+
+  while (stack_size > 0) {
+    const uint32_t child = stack[--stack_size];
+
+    if (child & kBvh8LeafBit) {
+      __m256 t, u, v;
+      if (IntersectBlock(triangle_blocks_[child & ~kBvh8LeafBit], data, ray.t_max, &t, &u, &v))
+        return true;
+      continue;
+    }
+
+    const Bvh8Node& node = nodes_[child];
+
+    __m256 t_near;
+    int mask = IntersectChildren(node, data, ray.t_max, &t_near);
+    while (mask != 0) {
+      const int i = LowestSetBit(mask);
+      mask &= mask - 1;
+      stack[stack_size++] = node.children[i];
+    }
+  }
+
+  return false;
+}
\ No newline at end of file
@@ -0,0 +1,79 @@
+#ifndef BVH8_H_
+#define BVH8_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "aligned_allocator.h"
+#include "bvh.h"
+#include "ray.h"
+#include "scene.h"
+
+// Unused child slot.
+constexpr uint32_t kBvh8EmptyChild = 0xffffffff;
+// Set on leaf children, whose remaining bits index the triangle blocks.
+constexpr uint32_t kBvh8LeafBit = 0x80000000;
+
+// Eight-wide node holding its children's boxes as structure of arrays, indexed [axis][child], so
+// one AVX2 instruction covers the same slab of all eight. Unused slots have inverted bounds.
+struct alignas(32) Bvh8Node {
+  float bounds_min[3][8];
+  float bounds_max[3][8];
+  uint32_t children[8];
+};
+
+static_assert(sizeof(Bvh8Node) == 224, "Bvh8Node size mismatch");
+
+// Up to eight triangles with their corners as structure of arrays, indexed [corner][axis][lane].
+// Unused lanes have triangle index kInvalidTriangle.
+struct alignas(32) TriangleBlock8 {
+  float vertices[3][3][8];
+  uint32_t triangles[8];
+};
+
+static_assert(sizeof(TriangleBlock8) == 320, "TriangleBlock8 size mismatch");
+
+struct Bvh8Stats {
+  double build_seconds = 0.0;
+  uint32_t num_nodes = 0;
+  uint32_t num_leaves = 0;
+  uint32_t max_depth = 0;
+  // Used child slots per node and used lanes per leaf, both out of 8.
+  double average_children = 0.0;
+  double average_leaf_triangles = 0.0;
+  size_t memory_bytes = 0;
+};
+
+// BVH8 collapsed from a binary Bvh. Each node keeps opening the child with the largest surface
+// area until its eight slots are full, and any subtree of at most eight triangles becomes a
+// single leaf block. Traversal tests all eight child boxes at once, and leaves use an eight-wide
+// version of the watertight test from "Watertight Ray/Triangle Intersection" (Woop et al. 2013)
+// so rays cannot slip through the edge shared by two triangles.
+//
+// bvh8.cpp is compiled for AVX2, so only construct this when CpuSupportsAvx2() returns true.
+class Bvh8 : public RayIntersector {
+public:
+  Bvh8(const Scene& scene, const Bvh& bvh);
+
+  const Bvh8Stats& stats() const { return stats_; }
+
+  // Both tests skip back faces, matching the ray flags in raytracing.hlsl.
+  bool Intersect(const Ray& ray, Hit* hit) const override;
+  bool Occluded(const Ray& ray) const override;
+
+private:
+  // Builds the node covering the children of |binary_node| and returns its index.
+  uint32_t BuildNode(const Scene& scene, const Bvh& bvh, const std::vector<uint32_t>& sizes,
+                     uint32_t binary_node, uint32_t depth);
+
+  // Packs every triangle below |binary_node| into one block and returns its index.
+  uint32_t BuildLeaf(const Scene& scene, const Bvh& bvh, uint32_t binary_node);
+
+  std::vector<Bvh8Node, AlignedAllocator<Bvh8Node, 32>> nodes_;
+  std::vector<TriangleBlock8, AlignedAllocator<TriangleBlock8, 32>> triangle_blocks_;
+
+  Bvh8Stats stats_;
+};
+
+#endif  // BVH8_H_
\ No newline at end of file
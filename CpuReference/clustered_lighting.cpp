@@ -0,0 +1,108 @@
+#include "clustered_lighting.h"
+
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+
+namespace {
+
+// Whether the rasterizer covered |pixel|: it clears the normal's w to 1 and writes 0.
+bool IsCovered(const Gbuffer& gbuffer, size_t pixel) { return gbuffer.normal[pixel].w == 0.f; }
+
+// Cluster of |pixel| in row |y|, at its center as SV_Position gives it.
+uint32_t PixelCluster(const Gbuffer& gbuffer, const ClusterConstants& constants, int x, int y,
+                      size_t pixel) {
+  return ClusterOfPixel(constants, x + 0.5f, y + 0.5f, gbuffer.position[pixel].z);
+}
+
+// Squared distance from |view_pos| to |light|.
+float DistanceSquared(const PointLight& light, const Vec3& view_pos) {
+  const Vec3 to_light = Vec3{light.view_pos[0], light.view_pos[1], light.view_pos[2]} - view_pos;
+  return Dot(to_light, to_light);
+}
+
+// The diffuse light |light| sends to a point at |view_pos| with unit normal |normal|, falling off
+// as (1 - d^2 / r^2)^2 to zero at its radius, as lighting_pass_ps.hlsl computes it.
+Vec3 PointLightDiffuse(const PointLight& light, const Vec3& view_pos, const Vec3& normal) {
+  const Vec3 to_light = Vec3{light.view_pos[0], light.view_pos[1], light.view_pos[2]} - view_pos;
+  const float distance_squared = Dot(to_light, to_light);
+  const float falloff = Saturate(1.f - distance_squared / (light.radius * light.radius));
+  if (falloff == 0.f)
+    return {0.f, 0.f, 0.f};
+  const float diffuse_coeff = Saturate(Dot(normal, to_light / std::sqrt(distance_squared)));
+  return Vec3{light.color[0], light.color[1], light.color[2]} *
+         (diffuse_coeff * falloff * falloff);
+}
+
+}  // namespace
+
+void BuildLightClusters(const ClusterConstants& constants, const std::vector<PointLight>& lights,
+                        ThreadPool* pool, LightClusterGrid* grid) {
+  grid->Resize();
+  uint32_t overflowed[kClusterGridZ] = {};
+  pool->ParallelFor(kClusterGridZ, [&](int z, int) {
+    overflowed[z] = BuildClusterSlice(constants, lights.data(), z, grid);
+  });
+  grid->overflowed = std::accumulate(overflowed, overflowed + kClusterGridZ, 0u);
+}
+
+uint64_t ShadePointLights(const Gbuffer& gbuffer, const ClusterConstants& constants,
+                          const std::vector<PointLight>& lights, const LightClusterGrid* grid,
+                          ThreadPool* pool, std::vector<Vec3>* output) {
+  output->assign(static_cast<size_t>(gbuffer.width) * gbuffer.height, Vec3{0.f, 0.f, 0.f});
+  std::vector<uint64_t> row_visits(gbuffer.height);
+
+  pool->ParallelFor(gbuffer.height, [&](int y, int) {
+    for (int x = 0; x < gbuffer.width; ++x) {
+      const size_t pixel = static_cast<size_t>(y) * gbuffer.width + x;
+      if (!IsCovered(gbuffer, pixel))
+        continue;
+
+      const uint32_t* indices = nullptr;
+      uint32_t count = constants.num_lights;
+      if (grid) {
+        const uint32_t cluster = PixelCluster(gbuffer, constants, x, y, pixel);
+        indices = &grid->indices[static_cast<size_t>(cluster) * kMaxLightsPerCluster];
+        count = grid->counts[cluster];
+      }
+
+      const Vec3 view_pos = gbuffer.position[pixel].xyz();
+      const Vec3 normal = Normalize(gbuffer.normal[pixel].xyz());
+      Vec3 light = {0.f, 0.f, 0.f};
+      for (uint32_t i = 0; i < count; ++i)
+        light = light + PointLightDiffuse(lights[indices ? indices[i] : i], view_pos, normal);
+      row_visits[y] += count;
+
+      const uint32_t diffuse = gbuffer.diffuse[pixel];
+      for (int channel = 0; channel < 3; ++channel)
+        (*output)[pixel][channel] =
+            light[channel] * (static_cast<float>((diffuse >> (channel * 8)) & 0xff) / 255.f);
+    }
+  });
+  return std::accumulate(row_visits.begin(), row_visits.end(), uint64_t{0});
+}
+
+uint64_t CountMissedLights(const Gbuffer& gbuffer, const ClusterConstants& constants,
+                           const std::vector<PointLight>& lights, const LightClusterGrid& grid,
+                           ThreadPool* pool) {
+  std::vector<uint64_t> row_misses(gbuffer.height);
+  pool->ParallelFor(gbuffer.height, [&](int y, int) {
+    for (int x = 0; x < gbuffer.width; ++x) {
+      const size_t pixel = static_cast<size_t>(y) * gbuffer.width + x;
+      if (!IsCovered(gbuffer, pixel))
+        continue;
+
+      const uint32_t cluster = PixelCluster(gbuffer, constants, x, y, pixel);
+      const uint32_t* first = &grid.indices[static_cast<size_t>(cluster) * kMaxLightsPerCluster];
+      const uint32_t* last = first + grid.counts[cluster];
+      const Vec3 view_pos = gbuffer.position[pixel].xyz();
+      for (uint32_t i = 0; i < constants.num_lights; ++i) {
+        const float radius = lights[i].radius;
+        if (DistanceSquared(lights[i], view_pos) <= radius * radius &&
+            !std::binary_search(first, last, i))
+          ++row_misses[y];
+      }
+    }
+  });
+  return std::accumulate(row_misses.begin(), row_misses.end(), uint64_t{0});
+}
\ No newline at end of file
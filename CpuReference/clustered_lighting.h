@@ -0,0 +1,31 @@
+#ifndef CLUSTERED_LIGHTING_H_
+#define CLUSTERED_LIGHTING_H_
+
+#include <cstdint>
+#include <vector>
+
+#include "light_clusters.h"
+#include "rasterizer.h"
+#include "thread_pool.h"
+#include "vec_math.h"
+
+// Builds every slice of |grid| with BuildClusterSlice, one slice per task, and sets its overflow
+// count.
+void BuildLightClusters(const ClusterConstants& constants, const std::vector<PointLight>& lights,
+                        ThreadPool* pool, LightClusterGrid* grid);
+
+// The point lights' diffuse light at every pixel of |gbuffer|, as lighting_pass_ps.hlsl adds it
+// to the shadowed light, into |output|. With |grid|, each pixel loops over its cluster's list;
+// without, over every light. Lights are added in index order either way, and a light that does
+// not reach a pixel adds exactly zero, so the two give identical results when the lists hold
+// every light that reaches the pixels. Returns the light evaluations made.
+uint64_t ShadePointLights(const Gbuffer& gbuffer, const ClusterConstants& constants,
+                          const std::vector<PointLight>& lights, const LightClusterGrid* grid,
+                          ThreadPool* pool, std::vector<Vec3>* output);
+
+// Lights that reach a covered pixel of |gbuffer| but are missing from its cluster's list.
+uint64_t CountMissedLights(const Gbuffer& gbuffer, const ClusterConstants& constants,
+                           const std::vector<PointLight>& lights, const LightClusterGrid& grid,
+                           ThreadPool* pool);
+
+#endif  // CLUSTERED_LIGHTING_H_
\ No newline at end of file
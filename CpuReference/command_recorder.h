@@ -0,0 +1,73 @@
+#ifndef COMMAND_RECORDER_H_
+#define COMMAND_RECORDER_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "render_graph.h"
+
+// App::DrawCallArgs with GPU addresses standing in for the buffer views.
+struct SubmittedDraw {
+  uint64_t vertex_buffer_address;
+  uint32_t vertex_buffer_size;
+  uint64_t index_buffer_address;
+  uint32_t index_buffer_size;
+  uint32_t index_count;
+  uint32_t start_index;
+  int32_t vertex_offset;
+  uint32_t material_index;
+};
+
+// Records the calls of GeometryPass::RenderFrame()'s draw loop, and the barriers between passes,
+// as words in a buffer, which is about what a driver does with them before the command list is
+// closed: what each draw costs the CPU apart from the driver's own work.
+class CommandRecorder {
+public:
+  void Reset() { words_.clear(); }
+
+  void SetRoot32BitConstants(uint32_t root_index, uint32_t count, const void* values) {
+    Write(1, root_index);
+    words_.push_back(count);
+    const uint32_t* words = static_cast<const uint32_t*>(values);
+    words_.insert(words_.end(), words, words + count);
+  }
+
+  void SetRootConstantBufferView(uint32_t root_index, uint64_t address) {
+    Write(2, root_index);
+    Write(static_cast<uint32_t>(address), static_cast<uint32_t>(address >> 32));
+  }
+
+  void Draw(const SubmittedDraw& draw) {
+    Write(3, static_cast<uint32_t>(draw.vertex_buffer_address));
+    Write(static_cast<uint32_t>(draw.vertex_buffer_address >> 32), draw.vertex_buffer_size);
+    Write(4, static_cast<uint32_t>(draw.index_buffer_address));
+    Write(static_cast<uint32_t>(draw.index_buffer_address >> 32), draw.index_buffer_size);
+    Write(5, draw.index_count);
+    Write(draw.start_index, static_cast<uint32_t>(draw.vertex_offset));
+  }
+
+  void DrawInstanced(const SubmittedDraw& draw, uint32_t instance_count) {
+    Draw(draw);
+    Write(7, instance_count);
+  }
+
+  void ResourceBarrier(const RenderGraph::Barrier& barrier) {
+    Write(6, static_cast<uint32_t>(barrier.type));
+    Write(static_cast<uint32_t>(barrier.split), static_cast<uint32_t>(barrier.resource));
+    Write(barrier.before, barrier.after);
+  }
+
+  size_t size() const { return words_.size() * sizeof(uint32_t); }
+  const std::vector<uint32_t>& words() const { return words_; }
+
+private:
+  void Write(uint32_t a, uint32_t b) {
+    words_.push_back(a);
+    words_.push_back(b);
+  }
+
+  std::vector<uint32_t> words_;
+};
+
+#endif  // COMMAND_RECORDER_H_
\ No newline at end of file
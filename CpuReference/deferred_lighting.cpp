@@ -0,0 +1,341 @@
+#include "deferred_lighting.h"
+
+#include <emmintrin.h>
+
+#include <cmath>
+#include <stdexcept>
+
+namespace {
+
+constexpr int kSseWidth = 4;
+
+// HLSL's max() and clamp(), evaluated like maxps and minps: the second operand wins unless the
+// comparison holds, so NaN clamps to the upper bound.
+float Max(float a, float b) { return a > b ? a : b; }
+
+float Clamp01(float value) {
+  const float upper = value < 1.f ? value : 1.f;
+  return upper > 0.f ? upper : 0.f;
+}
+
+float UnpackChannel(uint32_t texel, int channel) {
+  return static_cast<float>((texel >> (channel * 8)) & 0xff) / 255.f;
+}
+
+uint32_t PackChannel(float value, int channel) {
+  return static_cast<uint32_t>(Clamp01(value) * 255.f + 0.5f) << (channel * 8);
+}
+
+// shadow_cubemap_tex.Sample() along |direction|: picks the face of the major axis and filters
+// bilinearly, clamping at the face's edges.
+float SampleShadow(const ShadowCubemap& shadow, float x, float y, float z) {
+  const float abs_x = std::fabs(x);
+  const float abs_y = std::fabs(y);
+  const float abs_z = std::fabs(z);
+
+  // D3D's face coordinates, with z winning ties over y and y over x.
+  int face;
+  float major, s, t;
+  if (abs_z >= abs_x && abs_z >= abs_y) {
+    face = z < 0.f ? 5 : 4;
+    major = abs_z;
+    s = z < 0.f ? -x : x;
+    t = -y;
+  } else if (abs_y >= abs_x) {
+    face = y < 0.f ? 3 : 2;
+    major = abs_y;
+    s = x;
+    t = y < 0.f ? -z : z;
+  } else {
+    face = x < 0.f ? 1 : 0;
+    major = abs_x;
+    s = x < 0.f ? z : -z;
+    t = -y;
+  }
+
+  // Texel coordinates plus one, so truncation floors them, clamped below the far edge (which
+  // also catches NaN).
+  const float size = static_cast<float>(shadow.size);
+  float texel_x = ((s / major + 1.f) * 0.5f) * size + 0.5f;
+  float texel_y = ((t / major + 1.f) * 0.5f) * size + 0.5f;
+  texel_x = Max(texel_x < size ? texel_x : size, 0.f);
+  texel_y = Max(texel_y < size ? texel_y : size, 0.f);
+
+  const int column = static_cast<int>(texel_x);
+  const int row = static_cast<int>(texel_y);
+  const float weight_x = texel_x - static_cast<float>(column);
+  const float weight_y = texel_y - static_cast<float>(row);
+  const int x0 = column > 0 ? column - 1 : 0;
+  const int y0 = row > 0 ? row - 1 : 0;
+  const int x1 = column < shadow.size ? column : shadow.size - 1;
+  const int y1 = row < shadow.size ? row : shadow.size - 1;
+
+  const float* texels = shadow.face(face);
+  const float t00 = texels[y0 * shadow.size + x0];
+  const float t10 = texels[y0 * shadow.size + x1];
+  const float t01 = texels[y1 * shadow.size + x0];
+  const float t11 = texels[y1 * shadow.size + x1];
+  const float top = t00 + (t10 - t00) * weight_x;
+  const float bottom = t01 + (t11 - t01) * weight_x;
+  return top + (bottom - top) * weight_y;
+}
+
+uint32_t ShadePixel(const LightingInputs& inputs, size_t pixel) {
+  const Vec4& view_pos = inputs.gbuffer->position[pixel];
+  const Vec4& normal_texel = inputs.gbuffer->normal[pixel];
+  const Vec3& light = inputs.light_view_pos;
+
+  const float light_x = light.x - view_pos.x;
+  const float light_y = light.y - view_pos.y;
+  const float light_z = light.z - view_pos.z;
+
+  const float normal_length =
+      std::sqrt(normal_texel.x * normal_texel.x + normal_texel.y * normal_texel.y +
+                normal_texel.z * normal_texel.z);
+  const float normal_x = normal_texel.x / normal_length;
+  const float normal_y = normal_texel.y / normal_length;
+  const float normal_z = normal_texel.z / normal_length;
+
+  const float light_length = std::sqrt(light_x * light_x + light_y * light_y + light_z * light_z);
+  const float diffuse_coeff =
+      Clamp01((light_x / light_length) * normal_x + (light_y / light_length) * normal_y +
+              (light_z / light_length) * normal_z);
+
+  const float max_component =
+      Max(Max(std::fabs(light_x), std::fabs(light_y)), std::fabs(light_z));
+  float depth = Clamp01(kShadowDepthScale - kShadowDepthOffset / max_component);
+  const float depth_bias = (1.f - depth) * (0.1f + (1.f - max_component) * 0.1f);
+  depth = Clamp01(depth - depth_bias);
+
+  const float coord_x = view_pos.x - light.x;
+  const float coord_y = view_pos.y - light.y;
+  const float coord_z = view_pos.z - light.z;
+  const float coord_length = std::sqrt(coord_x * coord_x + coord_y * coord_y + coord_z * coord_z);
+  const float shadow_depth = SampleShadow(*inputs.shadow, coord_x / coord_length,
+                                          coord_y / coord_length, coord_z / coord_length);
+
+  // clamp(sign(shadow_depth - depth), 0, 1).
+  const float illuminated = shadow_depth > depth ? 1.f : 0.f;
+  const float diffuse_scale = illuminated * diffuse_coeff;
+
+  const uint32_t ambient = inputs.gbuffer->ambient[pixel];
+  const uint32_t diffuse = inputs.gbuffer->diffuse[pixel];
+  uint32_t result = 0xff000000;
+  for (int channel = 0; channel < 3; ++channel) {
+    result |= PackChannel(0.3f * UnpackChannel(ambient, channel) +
+                              diffuse_scale * UnpackChannel(diffuse, channel),
+                          channel);
+  }
+  return result;
+}
+
+__m128 Clamp01(__m128 value) {
+  return _mm_max_ps(_mm_min_ps(value, _mm_set1_ps(1.f)), _mm_setzero_ps());
+}
+
+__m128 Abs(__m128 value) { return _mm_andnot_ps(_mm_set1_ps(-0.f), value); }
+
+__m128 Select(__m128 mask, __m128 a, __m128 b) {
+  return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+}
+
+__m128 Negate(__m128 value) { return _mm_xor_ps(value, _mm_set1_ps(-0.f)); }
+
+__m128 UnpackChannel(__m128i texels, int channel) {
+  const __m128i bytes = _mm_and_si128(_mm_srli_epi32(texels, channel * 8), _mm_set1_epi32(0xff));
+  return _mm_div_ps(_mm_cvtepi32_ps(bytes), _mm_set1_ps(255.f));
+}
+
+__m128i PackChannel(__m128 value, int channel) {
+  const __m128 scaled = _mm_add_ps(_mm_mul_ps(Clamp01(value), _mm_set1_ps(255.f)),
+                                   _mm_set1_ps(0.5f));
+  return _mm_slli_epi32(_mm_cvttps_epi32(scaled), channel * 8);
+}
+
+// Four lanes of SampleShadow(). SSE2 has no gathers, so the texels are read one lane at a time.
+__m128 SampleShadow(const ShadowCubemap& shadow, __m128 x, __m128 y, __m128 z) {
+  const __m128 zero = _mm_setzero_ps();
+  const __m128 abs_x = Abs(x);
+  const __m128 abs_y = Abs(y);
+  const __m128 abs_z = Abs(z);
+
+  const __m128 use_z = _mm_and_ps(_mm_cmpge_ps(abs_z, abs_x), _mm_cmpge_ps(abs_z, abs_y));
+  const __m128 use_y = _mm_andnot_ps(use_z, _mm_cmpge_ps(abs_y, abs_x));
+  const __m128 negative_x = _mm_cmplt_ps(x, zero);
+  const __m128 negative_y = _mm_cmplt_ps(y, zero);
+  const __m128 negative_z = _mm_cmplt_ps(z, zero);
+
+  const __m128i face = _mm_castps_si128(
+      Select(use_z, Select(negative_z, _mm_castsi128_ps(_mm_set1_epi32(5)),
+                           _mm_castsi128_ps(_mm_set1_epi32(4))),
+             Select(use_y,
+                    Select(negative_y, _mm_castsi128_ps(_mm_set1_epi32(3)),
+                           _mm_castsi128_ps(_mm_set1_epi32(2))),
+                    Select(negative_x, _mm_castsi128_ps(_mm_set1_epi32(1)),
+                           _mm_castsi128_ps(_mm_set1_epi32(0))))));
+  const __m128 major = Select(use_z, abs_z, Select(use_y, abs_y, abs_x));
+  const __m128 s = Select(use_z, Select(negative_z, Negate(x), x),
+                          Select(use_y, x, Select(negative_x, z, Negate(z))));
+  const __m128 t = Select(use_z, Negate(y), Select(use_y, Select(negative_y, Negate(z), z),
+                                                   Negate(y)));
+
+  const __m128 half = _mm_set1_ps(0.5f);
+  const __m128 one = _mm_set1_ps(1.f);
+  const __m128 size = _mm_set1_ps(static_cast<float>(shadow.size));
+  __m128 texel_x = _mm_add_ps(
+      _mm_mul_ps(_mm_mul_ps(_mm_add_ps(_mm_div_ps(s, major), one), half), size), half);
+  __m128 texel_y = _mm_add_ps(
+      _mm_mul_ps(_mm_mul_ps(_mm_add_ps(_mm_div_ps(t, major), one), half), size), half);
+  texel_x = _mm_max_ps(_mm_min_ps(texel_x, size), zero);
+  texel_y = _mm_max_ps(_mm_min_ps(texel_y, size), zero);
+
+  const __m128i column = _mm_cvttps_epi32(texel_x);
+  const __m128i row = _mm_cvttps_epi32(texel_y);
+  const __m128 weight_x = _mm_sub_ps(texel_x, _mm_cvtepi32_ps(column));
+  const __m128 weight_y = _mm_sub_ps(texel_y, _mm_cvtepi32_ps(row));
+
+  alignas(16) int faces[kSseWidth];
+  alignas(16) int columns[kSseWidth];
+  alignas(16) int rows[kSseWidth];
+  _mm_store_si128(reinterpret_cast<__m128i*>(faces), face);
+  _mm_store_si128(reinterpret_cast<__m128i*>(columns), column);
+  _mm_store_si128(reinterpret_cast<__m128i*>(rows), row);
+
+  alignas(16) float texels[4][kSseWidth];
+  for (int lane = 0; lane < kSseWidth; ++lane) {
+    const int x0 = columns[lane] > 0 ? columns[lane] - 1 : 0;
+    const int y0 = rows[lane] > 0 ? rows[lane] - 1 : 0;
+    const int x1 = columns[lane] < shadow.size ? columns[lane] : shadow.size - 1;
+    const int y1 = rows[lane] < shadow.size ? rows[lane] : shadow.size - 1;
+
+    const float* face_texels = shadow.face(faces[lane]);
+    texels[0][lane] = face_texels[y0 * shadow.size + x0];
+    texels[1][lane] = face_texels[y0 * shadow.size + x1];
+    texels[2][lane] = face_texels[y1 * shadow.size + x0];
+    texels[3][lane] = face_texels[y1 * shadow.size + x1];
+  }
+
+  const __m128 t00 = _mm_load_ps(texels[0]);
+  const __m128 t10 = _mm_load_ps(texels[1]);
+  const __m128 t01 = _mm_load_ps(texels[2]);
+  const __m128 t11 = _mm_load_ps(texels[3]);
+  const __m128 top = _mm_add_ps(t00, _mm_mul_ps(_mm_sub_ps(t10, t00), weight_x));
+  const __m128 bottom = _mm_add_ps(t01, _mm_mul_ps(_mm_sub_ps(t11, t01), weight_x));
+  return _mm_add_ps(top, _mm_mul_ps(_mm_sub_ps(bottom, top), weight_y));
+}
+
+}  // namespace
+
+void ShadowCubemap::Resize(int new_size) {
+  size = new_size;
+  depth.assign(static_cast<size_t>(6) * size * size, 1.f);
+}
+
+void ShadeLightingScalar(const LightingInputs& inputs, size_t first, size_t count,
+                         uint32_t* output) {
+  for (size_t i = 0; i < count; ++i)
+    output[i] = ShadePixel(inputs, first + i);
+}
+
+void ShadeLightingSse2(const LightingInputs& inputs, size_t first, size_t count,
+                       uint32_t* output) {
+  const Gbuffer& gbuffer = *inputs.gbuffer;
+  const __m128 light_x = _mm_set1_ps(inputs.light_view_pos.x);
+  const __m128 light_y = _mm_set1_ps(inputs.light_view_pos.y);
+  const __m128 light_z = _mm_set1_ps(inputs.light_view_pos.z);
+  const __m128 one = _mm_set1_ps(1.f);
+
+  size_t i = 0;
+  for (; i + kSseWidth <= count; i += kSseWidth) {
+    const size_t pixel = first + i;
+
+    // Four pixels of each float target, transposed to x, y, z and w registers.
+    __m128 pos_x = _mm_loadu_ps(&gbuffer.position[pixel].x);
+    __m128 pos_y = _mm_loadu_ps(&gbuffer.position[pixel + 1].x);
+    __m128 pos_z = _mm_loadu_ps(&gbuffer.position[pixel + 2].x);
+    __m128 pos_w = _mm_loadu_ps(&gbuffer.position[pixel + 3].x);
+    _MM_TRANSPOSE4_PS(pos_x, pos_y, pos_z, pos_w);
+
+    __m128 normal_x = _mm_loadu_ps(&gbuffer.normal[pixel].x);
+    __m128 normal_y = _mm_loadu_ps(&gbuffer.normal[pixel + 1].x);
+    __m128 normal_z = _mm_loadu_ps(&gbuffer.normal[pixel + 2].x);
+    __m128 normal_w = _mm_loadu_ps(&gbuffer.normal[pixel + 3].x);
+    _MM_TRANSPOSE4_PS(normal_x, normal_y, normal_z, normal_w);
+
+    const __m128 vec_x = _mm_sub_ps(light_x, pos_x);
+    const __m128 vec_y = _mm_sub_ps(light_y, pos_y);
+    const __m128 vec_z = _mm_sub_ps(light_z, pos_z);
+
+    const __m128 normal_length = _mm_sqrt_ps(
+        _mm_add_ps(_mm_add_ps(_mm_mul_ps(normal_x, normal_x), _mm_mul_ps(normal_y, normal_y)),
+                   _mm_mul_ps(normal_z, normal_z)));
+    normal_x = _mm_div_ps(normal_x, normal_length);
+    normal_y = _mm_div_ps(normal_y, normal_length);
+    normal_z = _mm_div_ps(normal_z, normal_length);
+
+    const __m128 vec_length = _mm_sqrt_ps(_mm_add_ps(
+        _mm_add_ps(_mm_mul_ps(vec_x, vec_x), _mm_mul_ps(vec_y, vec_y)), _mm_mul_ps(vec_z, vec_z)));
+    const __m128 diffuse_coeff = Clamp01(_mm_add_ps(
+        _mm_add_ps(_mm_mul_ps(_mm_div_ps(vec_x, vec_length), normal_x),
+                   _mm_mul_ps(_mm_div_ps(vec_y, vec_length), normal_y)),
+        _mm_mul_ps(_mm_div_ps(vec_z, vec_length), normal_z)));
+
+    const __m128 max_component = _mm_max_ps(_mm_max_ps(Abs(vec_x), Abs(vec_y)), Abs(vec_z));
+    __m128 depth = Clamp01(_mm_sub_ps(_mm_set1_ps(kShadowDepthScale),
+                                      _mm_div_ps(_mm_set1_ps(kShadowDepthOffset), max_component)));
+    const __m128 depth_bias = _mm_mul_ps(
+        _mm_sub_ps(one, depth),
+        _mm_add_ps(_mm_set1_ps(0.1f),
+                   _mm_mul_ps(_mm_sub_ps(one, max_component), _mm_set1_ps(0.1f))));
+    depth = Clamp01(_mm_sub_ps(depth, depth_bias));
+
+    const __m128 coord_x = _mm_sub_ps(pos_x, light_x);
+    const __m128 coord_y = _mm_sub_ps(pos_y, light_y);
+    const __m128 coord_z = _mm_sub_ps(pos_z, light_z);
+    const __m128 coord_length = _mm_sqrt_ps(
+        _mm_add_ps(_mm_add_ps(_mm_mul_ps(coord_x, coord_x), _mm_mul_ps(coord_y, coord_y)),
+                   _mm_mul_ps(coord_z, coord_z)));
+    const __m128 shadow_depth =
+        SampleShadow(*inputs.shadow, _mm_div_ps(coord_x, coord_length),
+                     _mm_div_ps(coord_y, coord_length), _mm_div_ps(coord_z, coord_length));
+
+    const __m128 illuminated = _mm_and_ps(_mm_cmpgt_ps(shadow_depth, depth), one);
+    const __m128 diffuse_scale = _mm_mul_ps(illuminated, diffuse_coeff);
+
+    const __m128i ambient =
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(&gbuffer.ambient[pixel]));
+    const __m128i diffuse =
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(&gbuffer.diffuse[pixel]));
+    __m128i result = _mm_set1_epi32(static_cast<int>(0xff000000));
+    for (int channel = 0; channel < 3; ++channel) {
+      const __m128 color =
+          _mm_add_ps(_mm_mul_ps(_mm_set1_ps(0.3f), UnpackChannel(ambient, channel)),
+                     _mm_mul_ps(diffuse_scale, UnpackChannel(diffuse, channel)));
+      result = _mm_or_si128(result, PackChannel(color, channel));
+    }
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(output + i), result);
+  }
+
+  ShadeLightingScalar(inputs, first + i, count - i, output + i);
+}
+
+void ShadeLighting(const Gbuffer& gbuffer, const ShadowCubemap& shadow,
+                   const Vec4& light_view_pos, LightingKernel kernel, ThreadPool* pool,
+                   std::vector<uint32_t>* output) {
+  if (shadow.size <= 0)
+    throw std::runtime_error("the shadow cubemap is empty");
+
+  output->resize(static_cast<size_t>(gbuffer.width) * gbuffer.height);
+
+  void (*shade)(const LightingInputs&, size_t, size_t, uint32_t*) = ShadeLightingScalar;
+  if (kernel == LightingKernel::kSse2)
+    shade = ShadeLightingSse2;
+  else if (kernel == LightingKernel::kAvx2)
+    shade = ShadeLightingAvx2;
+
+  const LightingInputs inputs = {&gbuffer, &shadow, light_view_pos.xyz()};
+  pool->ParallelFor(gbuffer.height, [&](int y, int) {
+    const size_t first = static_cast<size_t>(y) * gbuffer.width;
+    shade(inputs, first, gbuffer.width, output->data() + first);
+  });
+}
\ No newline at end of file
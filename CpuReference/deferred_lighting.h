@@ -0,0 +1,69 @@
+#ifndef DEFERRED_LIGHTING_H_
+#define DEFERRED_LIGHTING_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "deferred_scene.h"
+#include "rasterizer.h"
+#include "thread_pool.h"
+#include "vec_math.h"
+
+// The shadow pass's depth cubemap: six |size| x |size| D32_FLOAT faces in D3D face order (+x, -x,
+// +y, -y, +z, -z), each row-major from the top-left.
+struct ShadowCubemap {
+  int size = 0;
+  std::vector<float> depth;
+
+  // Resizes and clears to the far plane, as the shadow pass does before drawing.
+  void Resize(int new_size);
+
+  float* face(int index) { return &depth[static_cast<size_t>(index) * size * size]; }
+  const float* face(int index) const { return &depth[static_cast<size_t>(index) * size * size]; }
+};
+
+// lighting_pass_ps.hlsl reconstructs the shadow-map depth of a point from its distance to the
+// light along the major axis as kShadowDepthScale - kShadowDepthOffset / distance.
+constexpr float kShadowDepthScale = kShadowFarZ / (kShadowFarZ - kShadowNearZ);
+constexpr float kShadowDepthOffset = kShadowFarZ * kShadowNearZ / (kShadowFarZ - kShadowNearZ);
+
+// What every lighting kernel reads.
+struct LightingInputs {
+  const Gbuffer* gbuffer;
+  const ShadowCubemap* shadow;
+  Vec3 light_view_pos;
+};
+
+// CPU versions of lighting_pass_ps.hlsl. Each writes pixels [first, first + count) of the
+// G-buffer to |output| as packed R8G8B8A8_UNORM, like the back buffer.
+//
+// They follow the shader operation for operation, in the same order, with correctly rounded
+// division and square roots, so all three give identical bytes. Like the shader's clamp(), their
+// clamps turn NaN into the upper bound, which keeps the empty pixels, whose normal is zero, black.
+// The shadow lookup filters like shadow_cubemap_sampler but within one face, where hardware blends
+// across cube edges and rounds the filter weights to a few bits, so shadow edges can differ from
+// the GPU's by a texel.
+//
+// The SIMD versions load blocks of four or eight pixels, transpose them to one register per
+// channel and finish the row with the scalar one. ShadeLightingAvx2 is compiled for AVX2, so only
+// call it when CpuSupportsAvx2() returns true.
+void ShadeLightingScalar(const LightingInputs& inputs, size_t first, size_t count,
+                         uint32_t* output);
+void ShadeLightingSse2(const LightingInputs& inputs, size_t first, size_t count,
+                       uint32_t* output);
+void ShadeLightingAvx2(const LightingInputs& inputs, size_t first, size_t count,
+                       uint32_t* output);
+
+enum class LightingKernel {
+  kScalar,
+  kSse2,
+  kAvx2,
+};
+
+// Lights every pixel of |gbuffer| into |output|, resized to match, one row per task.
+void ShadeLighting(const Gbuffer& gbuffer, const ShadowCubemap& shadow,
+                   const Vec4& light_view_pos, LightingKernel kernel, ThreadPool* pool,
+                   std::vector<uint32_t>* output);
+
+#endif  // DEFERRED_LIGHTING_H_
\ No newline at end of file
@@ -0,0 +1,202 @@
+#include "deferred_lighting.h"
+
+#include <immintrin.h>
+
+namespace {
+
+constexpr int kAvxWidth = 8;
+
+__m256 Clamp01(__m256 value) {
+  return _mm256_max_ps(_mm256_min_ps(value, _mm256_set1_ps(1.f)), _mm256_setzero_ps());
+}
+
+__m256 Abs(__m256 value) { return _mm256_andnot_ps(_mm256_set1_ps(-0.f), value); }
+
+__m256 Negate(__m256 value) { return _mm256_xor_ps(value, _mm256_set1_ps(-0.f)); }
+
+__m256 Dot(__m256 ax, __m256 ay, __m256 az, __m256 bx, __m256 by, __m256 bz) {
+  return _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(ax, bx), _mm256_mul_ps(ay, by)),
+                       _mm256_mul_ps(az, bz));
+}
+
+// Eight Vec4s, transposed to one register per component. w is dropped.
+void LoadTransposed(const Vec4* values, __m256* x, __m256* y, __m256* z) {
+  const __m256 pixels01 = _mm256_loadu_ps(&values[0].x);
+  const __m256 pixels23 = _mm256_loadu_ps(&values[2].x);
+  const __m256 pixels45 = _mm256_loadu_ps(&values[4].x);
+  const __m256 pixels67 = _mm256_loadu_ps(&values[6].x);
+
+  // Pixels k and k + 4 in the low and high halves, then a 4x4 transpose within each half.
+  const __m256 pixels04 = _mm256_permute2f128_ps(pixels01, pixels45, 0x20);
+  const __m256 pixels15 = _mm256_permute2f128_ps(pixels01, pixels45, 0x31);
+  const __m256 pixels26 = _mm256_permute2f128_ps(pixels23, pixels67, 0x20);
+  const __m256 pixels37 = _mm256_permute2f128_ps(pixels23, pixels67, 0x31);
+
+  const __m256 xy01 = _mm256_unpacklo_ps(pixels04, pixels15);
+  const __m256 xy23 = _mm256_unpacklo_ps(pixels26, pixels37);
+  const __m256 zw01 = _mm256_unpackhi_ps(pixels04, pixels15);
+  const __m256 zw23 = _mm256_unpackhi_ps(pixels26, pixels37);
+
+  *x = _mm256_shuffle_ps(xy01, xy23, _MM_SHUFFLE(1, 0, 1, 0));
+  *y = _mm256_shuffle_ps(xy01, xy23, _MM_SHUFFLE(3, 2, 3, 2));
+  *z = _mm256_shuffle_ps(zw01, zw23, _MM_SHUFFLE(1, 0, 1, 0));
+}
+
+__m256 UnpackChannel(__m256i texels, int channel) {
+  const __m256i bytes =
+      _mm256_and_si256(_mm256_srli_epi32(texels, channel * 8), _mm256_set1_epi32(0xff));
+  return _mm256_div_ps(_mm256_cvtepi32_ps(bytes), _mm256_set1_ps(255.f));
+}
+
+__m256i PackChannel(__m256 value, int channel) {
+  const __m256 scaled = _mm256_add_ps(_mm256_mul_ps(Clamp01(value), _mm256_set1_ps(255.f)),
+                                      _mm256_set1_ps(0.5f));
+  return _mm256_slli_epi32(_mm256_cvttps_epi32(scaled), channel * 8);
+}
+
+// Eight lanes of the scalar SampleShadow(), with the four texels gathered.
+__m256 SampleShadow(const ShadowCubemap& shadow, __m256 x, __m256 y, __m256 z) {
+  const __m256 zero = _mm256_setzero_ps();
+  const __m256 abs_x = Abs(x);
+  const __m256 abs_y = Abs(y);
+  const __m256 abs_z = Abs(z);
+
+  const __m256 use_z = _mm256_and_ps(_mm256_cmp_ps(abs_z, abs_x, _CMP_GE_OQ),
+                                     _mm256_cmp_ps(abs_z, abs_y, _CMP_GE_OQ));
+  const __m256 use_y = _mm256_andnot_ps(use_z, _mm256_cmp_ps(abs_y, abs_x, _CMP_GE_OQ));
+  const __m256 negative_x = _mm256_cmp_ps(x, zero, _CMP_LT_OQ);
+  const __m256 negative_y = _mm256_cmp_ps(y, zero, _CMP_LT_OQ);
+  const __m256 negative_z = _mm256_cmp_ps(z, zero, _CMP_LT_OQ);
+
+  // Faces are 2 * axis + 1 for the negative direction.
+  const __m256i axis = _mm256_sub_epi32(_mm256_setzero_si256(),
+                                        _mm256_add_epi32(_mm256_castps_si256(use_z),
+                                                         _mm256_castps_si256(_mm256_or_ps(
+                                                             use_z, use_y))));
+  const __m256 negative = _mm256_blendv_ps(_mm256_blendv_ps(negative_x, negative_y, use_y),
+                                           negative_z, use_z);
+  const __m256i face = _mm256_sub_epi32(_mm256_add_epi32(axis, axis),
+                                        _mm256_castps_si256(negative));
+
+  const __m256 major = _mm256_blendv_ps(_mm256_blendv_ps(abs_x, abs_y, use_y), abs_z, use_z);
+  const __m256 s = _mm256_blendv_ps(
+      _mm256_blendv_ps(_mm256_blendv_ps(Negate(z), z, negative_x), x, use_y),
+      _mm256_blendv_ps(x, Negate(x), negative_z), use_z);
+  const __m256 t = _mm256_blendv_ps(
+      _mm256_blendv_ps(Negate(y), _mm256_blendv_ps(z, Negate(z), negative_y), use_y), Negate(y),
+      use_z);
+
+  const __m256 half = _mm256_set1_ps(0.5f);
+  const __m256 one = _mm256_set1_ps(1.f);
+  const __m256 size = _mm256_set1_ps(static_cast<float>(shadow.size));
+  __m256 texel_x = _mm256_add_ps(
+      _mm256_mul_ps(_mm256_mul_ps(_mm256_add_ps(_mm256_div_ps(s, major), one), half), size), half);
+  __m256 texel_y = _mm256_add_ps(
+      _mm256_mul_ps(_mm256_mul_ps(_mm256_add_ps(_mm256_div_ps(t, major), one), half), size), half);
+  texel_x = _mm256_max_ps(_mm256_min_ps(texel_x, size), zero);
+  texel_y = _mm256_max_ps(_mm256_min_ps(texel_y, size), zero);
+
+  const __m256i column = _mm256_cvttps_epi32(texel_x);
+  const __m256i row = _mm256_cvttps_epi32(texel_y);
+  const __m256 weight_x = _mm256_sub_ps(texel_x, _mm256_cvtepi32_ps(column));
+  const __m256 weight_y = _mm256_sub_ps(texel_y, _mm256_cvtepi32_ps(row));
+
+  const __m256i zero_i = _mm256_setzero_si256();
+  const __m256i last = _mm256_set1_epi32(shadow.size - 1);
+  const __m256i one_i = _mm256_set1_epi32(1);
+  const __m256i x0 = _mm256_max_epi32(_mm256_sub_epi32(column, one_i), zero_i);
+  const __m256i y0 = _mm256_max_epi32(_mm256_sub_epi32(row, one_i), zero_i);
+  const __m256i x1 = _mm256_min_epi32(column, last);
+  const __m256i y1 = _mm256_min_epi32(row, last);
+
+  const __m256i size_i = _mm256_set1_epi32(shadow.size);
+  const __m256i face_base = _mm256_mullo_epi32(face, _mm256_mullo_epi32(size_i, size_i));
+  const __m256i row0 = _mm256_add_epi32(face_base, _mm256_mullo_epi32(y0, size_i));
+  const __m256i row1 = _mm256_add_epi32(face_base, _mm256_mullo_epi32(y1, size_i));
+
+  const float* texels = shadow.depth.data();
+  const __m256 t00 = _mm256_i32gather_ps(texels, _mm256_add_epi32(row0, x0), 4);
+  const __m256 t10 = _mm256_i32gather_ps(texels, _mm256_add_epi32(row0, x1), 4);
+  const __m256 t01 = _mm256_i32gather_ps(texels, _mm256_add_epi32(row1, x0), 4);
+  const __m256 t11 = _mm256_i32gather_ps(texels, _mm256_add_epi32(row1, x1), 4);
+
+  const __m256 top = _mm256_add_ps(t00, _mm256_mul_ps(_mm256_sub_ps(t10, t00), weight_x));
+  const __m256 bottom = _mm256_add_ps(t01, _mm256_mul_ps(_mm256_sub_ps(t11, t01), weight_x));
+  return _mm256_add_ps(top, _mm256_mul_ps(_mm256_sub_ps(bottom, top), weight_y));
+}
+
+}  // namespace
+
+// Same steps as ShadeLightingSse2, eight pixels at a time.
+void ShadeLightingAvx2(const LightingInputs& inputs, size_t first, size_t count,
+                       uint32_t* output) {
+  const Gbuffer& gbuffer = *inputs.gbuffer;
+  const __m256 light_x = _mm256_set1_ps(inputs.light_view_pos.x);
+  const __m256 light_y = _mm256_set1_ps(inputs.light_view_pos.y);
+  const __m256 light_z = _mm256_set1_ps(inputs.light_view_pos.z);
+  const __m256 one = _mm256_set1_ps(1.f);
+
+  size_t i = 0;
+  for (; i + kAvxWidth <= count; i += kAvxWidth) {
+    const size_t pixel = first + i;
+
+    __m256 pos_x, pos_y, pos_z;
+    LoadTransposed(&gbuffer.position[pixel], &pos_x, &pos_y, &pos_z);
+    __m256 normal_x, normal_y, normal_z;
+    LoadTransposed(&gbuffer.normal[pixel], &normal_x, &normal_y, &normal_z);
+
+    const __m256 vec_x = _mm256_sub_ps(light_x, pos_x);
+    const __m256 vec_y = _mm256_sub_ps(light_y, pos_y);
+    const __m256 vec_z = _mm256_sub_ps(light_z, pos_z);
+
+    const __m256 normal_length =
+        _mm256_sqrt_ps(Dot(normal_x, normal_y, normal_z, normal_x, normal_y, normal_z));
+    normal_x = _mm256_div_ps(normal_x, normal_length);
+    normal_y = _mm256_div_ps(normal_y, normal_length);
+    normal_z = _mm256_div_ps(normal_z, normal_length);
+
+    const __m256 vec_length = _mm256_sqrt_ps(Dot(vec_x, vec_y, vec_z, vec_x, vec_y, vec_z));
+    const __m256 diffuse_coeff = Clamp01(
+        Dot(_mm256_div_ps(vec_x, vec_length), _mm256_div_ps(vec_y, vec_length),
+            _mm256_div_ps(vec_z, vec_length), normal_x, normal_y, normal_z));
+
+    const __m256 max_component =
+        _mm256_max_ps(_mm256_max_ps(Abs(vec_x), Abs(vec_y)), Abs(vec_z));
+    __m256 depth = Clamp01(_mm256_sub_ps(
+        _mm256_set1_ps(kShadowDepthScale),
+        _mm256_div_ps(_mm256_set1_ps(kShadowDepthOffset), max_component)));
+    const __m256 depth_bias = _mm256_mul_ps(
+        _mm256_sub_ps(one, depth),
+        _mm256_add_ps(_mm256_set1_ps(0.1f),
+                      _mm256_mul_ps(_mm256_sub_ps(one, max_component), _mm256_set1_ps(0.1f))));
+    depth = Clamp01(_mm256_sub_ps(depth, depth_bias));
+
+    const __m256 coord_x = _mm256_sub_ps(pos_x, light_x);
+    const __m256 coord_y = _mm256_sub_ps(pos_y, light_y);
+    const __m256 coord_z = _mm256_sub_ps(pos_z, light_z);
+    const __m256 coord_length =
+        _mm256_sqrt_ps(Dot(coord_x, coord_y, coord_z, coord_x, coord_y, coord_z));
+    const __m256 shadow_depth = SampleShadow(
+        *inputs.shadow, _mm256_div_ps(coord_x, coord_length),
+        _mm256_div_ps(coord_y, coord_length), _mm256_div_ps(coord_z, coord_length));
+
+    const __m256 illuminated =
+        _mm256_and_ps(_mm256_cmp_ps(shadow_depth, depth, _CMP_GT_OQ), one);
+    const __m256 diffuse_scale = _mm256_mul_ps(illuminated, diffuse_coeff);
+
+    const __m256i ambient =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i*>(&gbuffer.ambient[pixel]));
+    const __m256i diffuse =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i*>(&gbuffer.diffuse[pixel]));
+    __m256i result = _mm256_set1_epi32(static_cast<int>(0xff000000));
+    for (int channel = 0; channel < 3; ++channel) {
+      const __m256 color =
+          _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(0.3f), UnpackChannel(ambient, channel)),
+                        _mm256_mul_ps(diffuse_scale, UnpackChannel(diffuse, channel)));
+      result = _mm256_or_si256(result, PackChannel(color, channel));
+    }
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(output + i), result);
+  }
+
+  ShadeLightingScalar(inputs, first + i, count - i, output + i);
+}
\ No newline at end of file
@@ -0,0 +1,184 @@
+#include "deferred_scene.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <random>
+#include <string>
+
+#include "sdkmesh.h"
+
+namespace {
+
+constexpr float kPi = 3.14159265358979f;
+constexpr float kInfinity = std::numeric_limits<float>::infinity();
+
+bool EndsWith(const std::string& str, const char* suffix) {
+  size_t length = std::strlen(suffix);
+  return str.size() >= length && str.compare(str.size() - length, length, suffix) == 0;
+}
+
+Vec4 ToVec4(const sdkmesh::Float4& value) { return {value.x, value.y, value.z, 0.f}; }
+
+// Triangles per draw of a synthetic scene, so 16-bit indices would do as in the asset.
+constexpr uint32_t kSyntheticTrianglesPerDraw = 65536 / 3;
+
+}  // namespace
+
+DeferredConstants MakeDeferredConstants(int width, int height) {
+  const float camera_yaw = kPi;
+  const float camera_pitch = 0.f;
+  const float camera_roll = 0.f;
+
+  const Mat4 camera_view_mat =
+      MatrixRotationY(-camera_yaw) * MatrixRotationX(-camera_pitch) * MatrixRotationZ(-camera_roll);
+
+  const Mat4 world_mat = MatrixIdentity();
+  const Mat4 view_mat = MatrixTranslation(0.f, -1.f, -4.f) * camera_view_mat;
+  const Mat4 proj_mat = MatrixPerspectiveFovLH(
+      kCameraFovY, static_cast<float>(width) / static_cast<float>(height), kCameraNearZ,
+      kCameraFarZ);
+
+  DeferredConstants constants;
+  constants.world_view_mat = Transpose(world_mat * view_mat);
+  constants.world_view_proj_mat = Transpose(world_mat * view_mat * proj_mat);
+
+  constants.light_pos = {0.f, 1.9f, 0.f, 1.f};
+  constants.light_view_pos = Transform(constants.light_pos, view_mat);
+
+  const Mat4 light_view_pos_inverse_mat = MatrixTranslation(
+      -constants.light_view_pos.x, -constants.light_view_pos.y, -constants.light_view_pos.z);
+  const Mat4 shadow_proj_mat = MatrixPerspectiveFovLH(kPi / 2.f, 1.f, kShadowNearZ, kShadowFarZ);
+
+  const Mat4 face_rotations[6] = {
+      MatrixRotationY(-kPi / 2.f),  // Right (+x)
+      MatrixRotationY(kPi / 2.f),   // Left (-x)
+      MatrixRotationX(kPi / 2.f),   // Top (+y)
+      MatrixRotationX(-kPi / 2.f),  // Bottom (-y)
+      MatrixIdentity(),             // Front (+z)
+      MatrixRotationY(kPi),         // Back (-z)
+  };
+  for (int face = 0; face < 6; ++face) {
+    constants.shadow_mats[face] =
+        Transpose(light_view_pos_inverse_mat * face_rotations[face] * shadow_proj_mat);
+  }
+
+  return constants;
+}
+
+DeferredScene::DeferredScene(const char* path) {
+  if (EndsWith(path, ".scene")) {
+    scene_ = std::make_unique<scene_cache::Scene>(path);
+  } else {
+    sdkmesh::Mesh mesh(path);
+    scene_ = std::make_unique<scene_cache::Scene>(
+        scene_cache::Bake(mesh, scene_cache::BakeOptions()));
+  }
+
+  std::vector<const scene_cache::Vertex*> vertex_buffers;
+  for (uint32_t i = 0; i < scene_->num_vertex_buffers(); ++i) {
+    const scene_cache::VertexBufferDesc& vb = scene_->vertex_buffer(i);
+
+    // The input layout only takes float vertices.
+    if (vb.format != scene_cache::kVertexFormatFloat) {
+      owned_vertices_.emplace_back(vb.num_vertices);
+      scene_cache::DecodeVertices(vb, scene_->vertex_data(i), owned_vertices_.back().data());
+      vertex_buffers.push_back(owned_vertices_.back().data());
+    } else {
+      vertex_buffers.push_back(
+          reinterpret_cast<const scene_cache::Vertex*>(scene_->vertex_data(i)));
+    }
+  }
+
+  for (uint32_t i = 0; i < scene_->num_draw_ranges(); ++i) {
+    const scene_cache::DrawRange& range = scene_->draw_range(i);
+
+    // Only opaque triangle lists are drawn.
+    if ((range.flags & scene_cache::kDrawRangeAlpha) ||
+        range.primitive_type != sdkmesh::kTriangleList) {
+      continue;
+    }
+
+    const scene_cache::IndexBufferDesc& ib = scene_->index_buffer(range.index_buffer);
+
+    DrawCallArgs args{};
+    args.vertices = vertex_buffers[range.vertex_buffer];
+    args.indices = scene_->index_data(range.index_buffer);
+    args.index_size = ib.index_type == sdkmesh::kIndexType32Bit ? 4 : 2;
+    args.index_count = range.index_count;
+    args.start_index = range.start_index;
+    args.vertex_offset = range.vertex_offset;
+    args.material_index = range.material_index;
+    AddDraw(args);
+  }
+
+  for (uint32_t i = 0; i < scene_->num_materials(); ++i) {
+    const scene_cache::MaterialDesc& desc = scene_->material(i);
+    materials_.push_back({ToVec4(desc.ambient_color), ToVec4(desc.diffuse_color)});
+  }
+}
+
+DeferredScene::DeferredScene(uint32_t num_triangles, uint32_t seed) {
+  std::mt19937 rng(seed);
+  std::uniform_real_distribution<float> unit(-1.f, 1.f);
+
+  // Sized so the triangles roughly tile the volume without all overlapping, like
+  // Scene's synthetic soup.
+  const float triangle_size = 1.5f / std::cbrt(static_cast<float>(std::max(num_triangles, 1u)));
+
+  for (uint32_t first = 0; first < num_triangles; first += kSyntheticTrianglesPerDraw) {
+    const uint32_t count = std::min(kSyntheticTrianglesPerDraw, num_triangles - first);
+
+    owned_vertices_.emplace_back();
+    owned_indices_.emplace_back();
+    std::vector<scene_cache::Vertex>& vertices = owned_vertices_.back();
+    std::vector<uint32_t>& indices = owned_indices_.back();
+
+    for (uint32_t i = 0; i < count; ++i) {
+      const Vec3 center = {unit(rng), 1.f + unit(rng), unit(rng)};
+
+      Vec3 corners[3];
+      for (Vec3& corner : corners)
+        corner = center + Vec3{unit(rng), unit(rng), unit(rng)} * triangle_size;
+
+      Vec3 normal = Cross(corners[1] - corners[0], corners[2] - corners[0]);
+      const float length = Length(normal);
+      normal = length > 0.f ? normal / length : Vec3{0.f, 1.f, 0.f};
+
+      for (const Vec3& corner : corners) {
+        indices.push_back(static_cast<uint32_t>(vertices.size()));
+        vertices.push_back({{corner.x, corner.y, corner.z}, {normal.x, normal.y, normal.z}});
+      }
+    }
+
+    DrawCallArgs args{};
+    args.vertices = vertices.data();
+    args.indices = indices.data();
+    args.index_size = 4;
+    args.index_count = count * 3;
+    AddDraw(args);
+  }
+
+  materials_.push_back({{0.725f, 0.71f, 0.68f, 0.f}, {0.725f, 0.71f, 0.68f, 0.f}});
+}
+
+void DeferredScene::AddDraw(const DrawCallArgs& args) {
+  draw_call_args_.push_back(args);
+
+  DrawCallArgs& added = draw_call_args_.back();
+  added.vertex_count = 0;
+  added.bounds_min = {kInfinity, kInfinity, kInfinity};
+  added.bounds_max = {-kInfinity, -kInfinity, -kInfinity};
+  for (uint32_t i = 0; i < added.index_count; ++i) {
+    const uint32_t index = added.index(i);
+    added.vertex_count = std::max(added.vertex_count, index + 1);
+
+    const sdkmesh::Float3& position = added.vertices[added.vertex_offset + index].position;
+    const Vec3 point = {position.x, position.y, position.z};
+    added.bounds_min = Min(added.bounds_min, point);
+    added.bounds_max = Max(added.bounds_max, point);
+  }
+
+  num_triangles_ += args.index_count / 3;
+}
\ No newline at end of file
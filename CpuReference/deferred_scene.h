@@ -0,0 +1,103 @@
+#ifndef DEFERRED_SCENE_H_
+#define DEFERRED_SCENE_H_
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "scene_cache.h"
+#include "vec_math.h"
+
+// DeferredShading's frames in flight (kNumFrames).
+constexpr int kAppFramesInFlight = 3;
+
+// The DeferredShading app's material constants: colors with w = 0, as in geometry_pass_ps.hlsl.
+struct DeferredMaterial {
+  Vec4 ambient_color;
+  Vec4 diffuse_color;
+};
+
+// App::DrawCallArgs with the buffer views replaced by pointers to the data they view. Only
+// triangle lists are drawn, so there is no topology.
+struct DrawCallArgs {
+  const scene_cache::Vertex* vertices;
+  // 16- or 32-bit indices, by index_size.
+  const void* indices;
+  uint32_t index_size;
+
+  uint32_t index_count;
+  uint32_t start_index;
+  int32_t vertex_offset;
+  // Vertices from vertex_offset on that the indices reach: the largest index plus one.
+  uint32_t vertex_count;
+  // Object-space bounding box of the vertices the indices reach.
+  Vec3 bounds_min;
+  Vec3 bounds_max;
+
+  uint32_t material_index;
+
+  uint32_t index(uint32_t i) const {
+    return index_size == 4 ? static_cast<const uint32_t*>(indices)[start_index + i]
+                           : static_cast<const uint16_t*>(indices)[start_index + i];
+  }
+};
+
+// The matrix and light constants App::InitMatrices computes, with the matrices stored transposed
+// like the constant buffers they are uploaded to. Use MulConstant() to apply them.
+struct DeferredConstants {
+  Mat4 world_view_mat;
+  Mat4 world_view_proj_mat;
+  // View space to the clip space of each cubemap face, in D3D face order (+x, -x, +y, -y, +z,
+  // -z).
+  Mat4 shadow_mats[6];
+
+  Vec4 light_pos;
+  Vec4 light_view_pos;
+};
+
+// Near and far planes of the shadow cubemap projection, which lighting_pass_ps.hlsl repeats, and
+// the size of its faces.
+constexpr float kShadowNearZ = 0.05f;
+constexpr float kShadowFarZ = 10.f;
+constexpr int kShadowMapSize = 1024;
+
+// Vertical field of view of the camera, in radians, and its near and far planes.
+constexpr float kCameraFovY = 3.14159265358979f / 4.f;
+constexpr float kCameraNearZ = 0.1f;
+constexpr float kCameraFarZ = 1000.f;
+
+// Recomputes App::InitMatrices for a |width| x |height| window.
+DeferredConstants MakeDeferredConstants(int width, int height);
+
+// What the DeferredShading app uploads for drawing: the vertex and index buffers, one
+// DrawCallArgs per opaque triangle list and the materials, built the same way as
+// App::LoadModelData.
+class DeferredScene {
+public:
+  // Loads a baked .scene, or bakes an .sdkmesh in memory. Throws std::runtime_error on failure.
+  explicit DeferredScene(const char* path);
+
+  // |num_triangles| random triangles in the volume of the Cornell box, in draws of up to
+  // 65536 triangles, for measuring throughput far beyond what the asset contains.
+  DeferredScene(uint32_t num_triangles, uint32_t seed);
+
+  const std::vector<DrawCallArgs>& draw_call_args() const { return draw_call_args_; }
+  const std::vector<DeferredMaterial>& materials() const { return materials_; }
+
+  uint32_t num_triangles() const { return num_triangles_; }
+
+private:
+  void AddDraw(const DrawCallArgs& args);
+
+  std::unique_ptr<scene_cache::Scene> scene_;
+
+  // Float copies of quantized vertex buffers, and the buffers of a synthetic scene.
+  std::vector<std::vector<scene_cache::Vertex>> owned_vertices_;
+  std::vector<std::vector<uint32_t>> owned_indices_;
+
+  std::vector<DrawCallArgs> draw_call_args_;
+  std::vector<DeferredMaterial> materials_;
+  uint32_t num_triangles_ = 0;
+};
+
+#endif  // DEFERRED_SCENE_H_
\ No newline at end of file
@@ -0,0 +1,301 @@
+#include "descriptor_allocator_checks.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <random>
+#include <stdexcept>
+#include <vector>
+
+#include "deferred_scene.h"
+#include "descriptor_allocator.h"
+
+namespace {
+
+// Allocations follow each other from the start of the heap.
+bool CheckAllocatesInOrder() {
+  DescriptorAllocator allocator(64, 0);
+  const uint32_t a = allocator.Allocate(4);
+  const uint32_t b = allocator.Allocate(2);
+  const uint32_t c = allocator.Allocate(10);
+  return a == 0 && b == 4 && c == 6 && allocator.stats().persistent_in_use == 16 &&
+         allocator.free_slots() == 48 && allocator.free_ranges() == 1 &&
+         allocator.Fragmentation() == 0.0;
+}
+
+// Freed ranges merge with their free neighbours, and the first range that fits is reused.
+bool CheckFreeMerges() {
+  DescriptorAllocator allocator(16, 0);
+  const uint32_t a = allocator.Allocate(4);
+  const uint32_t b = allocator.Allocate(4);
+  const uint32_t c = allocator.Allocate(4);
+  allocator.Free(a, 4);
+  allocator.Free(c, 4);
+  const bool split = allocator.free_ranges() == 2 && allocator.LargestFreeRange() == 8;
+  allocator.Free(b, 4);
+  const bool merged = allocator.free_ranges() == 1 && allocator.LargestFreeRange() == 16;
+  const uint32_t d = allocator.Allocate(16);
+  return split && merged && d == 0 && allocator.stats().peak_persistent_in_use == 16;
+}
+
+// Scattered free slots cannot hold a larger table, and the counters say so.
+bool CheckFragmentation() {
+  DescriptorAllocator allocator(16, 0);
+  for (int i = 0; i < 16; ++i)
+    allocator.Allocate(1);
+  for (uint32_t i = 0; i < 16; i += 2)
+    allocator.Free(i, 1);
+
+  return allocator.free_slots() == 8 && allocator.free_ranges() == 8 &&
+         allocator.LargestFreeRange() == 1 && allocator.Fragmentation() == 0.875 &&
+         allocator.Allocate(2) == DescriptorAllocator::kInvalid &&
+         allocator.stats().failed_allocations == 1 && allocator.Allocate(1) == 0;
+}
+
+bool CheckRejectsBadFrees() {
+  DescriptorAllocator allocator(16, 8);
+  const uint32_t a = allocator.Allocate(4);
+  allocator.Free(a, 4);
+
+  int rejected = 0;
+  const uint32_t frees[][2] = {{a, 4}, {2, 4}, {14, 4}, {16, 1}};
+  for (const auto& free : frees) {
+    try {
+      allocator.Free(free[0], free[1]);
+    } catch (const std::runtime_error&) {
+      ++rejected;
+    }
+  }
+  return rejected == 4 && allocator.free_ranges() == 1;
+}
+
+// Transient tables come after the persistent region and come back once their fence value has
+// completed.
+bool CheckTransientRing() {
+  DescriptorAllocator allocator(16, 8);
+  const uint32_t a = allocator.AllocateTransient(4);
+  allocator.Submit(1);
+  const uint32_t b = allocator.AllocateTransient(4);
+  allocator.Submit(2);
+  const bool full = allocator.AllocateTransient(1) == DescriptorAllocator::kInvalid;
+  allocator.Retire(1);
+  const uint32_t c = allocator.AllocateTransient(4);
+
+  DescriptorAllocator persistent_only(16, 0);
+  bool threw = false;
+  try {
+    persistent_only.AllocateTransient(1);
+  } catch (const std::runtime_error&) {
+    threw = true;
+  }
+  return a == 16 && b == 20 && full && c == 16 && allocator.transient_in_use() == 8 &&
+         allocator.oldest_fence_value() == 2 &&
+         allocator.stats().failed_transient_allocations == 1 && threw &&
+         !persistent_only.has_submissions();
+}
+
+// Random allocations and frees against a map of the slots in use: no allocation may overlap one,
+// a failed allocation must have had no free run long enough, and the counters must match the map.
+bool CheckRandom() {
+  struct Table {
+    uint32_t index;
+    uint32_t count;
+  };
+
+  const uint32_t kCapacity = 1024;
+  std::mt19937 rng(1);
+  std::uniform_int_distribution<uint32_t> count_dist(1, 32);
+  std::uniform_int_distribution<int> action_dist(0, 2);
+
+  DescriptorAllocator allocator(kCapacity, 0);
+  std::vector<bool> used(kCapacity, false);
+  std::vector<Table> tables;
+  double fragmentation_sum = 0.0;
+  int samples = 0;
+
+  for (int i = 0; i < 100000; ++i) {
+    if (action_dist(rng) != 0 || tables.empty()) {
+      const uint32_t count = count_dist(rng);
+      const uint32_t index = allocator.Allocate(count);
+      if (index == DescriptorAllocator::kInvalid) {
+        uint32_t run = 0;
+        for (uint32_t slot = 0; slot < kCapacity; ++slot) {
+          run = used[slot] ? 0 : run + 1;
+          if (run >= count)
+            return false;
+        }
+        continue;
+      }
+      if (index + count > kCapacity)
+        return false;
+      for (uint32_t slot = index; slot < index + count; ++slot) {
+        if (used[slot])
+          return false;
+        used[slot] = true;
+      }
+      tables.push_back({index, count});
+    } else {
+      std::uniform_int_distribution<size_t> table_dist(0, tables.size() - 1);
+      const size_t t = table_dist(rng);
+      allocator.Free(tables[t].index, tables[t].count);
+      for (uint32_t slot = tables[t].index; slot < tables[t].index + tables[t].count; ++slot)
+        used[slot] = false;
+      tables[t] = tables.back();
+      tables.pop_back();
+    }
+
+    uint32_t free_slots = 0;
+    uint32_t free_ranges = 0;
+    uint32_t largest = 0;
+    uint32_t run = 0;
+    for (uint32_t slot = 0; slot < kCapacity; ++slot) {
+      if (used[slot]) {
+        run = 0;
+        continue;
+      }
+      ++free_slots;
+      if (run++ == 0)
+        ++free_ranges;
+      largest = std::max(largest, run);
+    }
+    if (allocator.free_slots() != free_slots || allocator.free_ranges() != free_ranges ||
+        allocator.LargestFreeRange() != largest) {
+      return false;
+    }
+    fragmentation_sum += allocator.Fragmentation();
+    ++samples;
+  }
+  std::printf("         %zu tables live at the end, %.1f%% of the heap in use at most, %.2f "
+              "average fragmentation\n",
+              tables.size(), 100.0 * allocator.stats().peak_persistent_in_use / kCapacity,
+              fragmentation_sum / samples);
+  return true;
+}
+
+// Frames the descriptor-allocator command simulates when --frames is not given.
+constexpr int kDefaultDescriptorFrames = 1000;
+
+// DeferredShading's descriptor heaps (constants.h) and the tables its passes allocate from them
+// in CreateResourceViews(), with the heaps' sizes when InitDescriptorHeaps() summed the tables.
+struct AppDescriptorHeap {
+  const char* name;
+  uint32_t persistent_size;
+  uint32_t transient_size;
+  // Table sizes, one entry per table.
+  std::vector<uint32_t> tables;
+  uint32_t hand_sized;
+};
+
+std::vector<AppDescriptorHeap> AppDescriptorHeaps() {
+  std::vector<AppDescriptorHeap> heaps = {
+    // The geometry pass's two G-buffer RTVs, then the lighting pass's swap chain RTVs.
+    {"rtv", 32, 0, {2}, 3 * kAppFramesInFlight},
+    // The shadow pass's six cubemap faces and all of them at once, and the geometry pass's depth
+    // buffer.
+    {"dsv", 32, 0, {7, 1}, 6 * kAppFramesInFlight + 1},
+    {"cbv/srv/uav", 256, 256, {8, 1}, 6 + 1 + 4 * kAppFramesInFlight},
+    {"staging", 64, 0, {4}, 0},
+    {"sampler", 16, 0, {1}, 1},
+  };
+  for (int i = 0; i < kAppFramesInFlight; ++i)
+    heaps[0].tables.push_back(1);
+  return heaps;
+}
+
+}  // namespace
+
+bool RunDescriptorAllocatorChecks() {
+  struct Check {
+    const char* name;
+    bool (*run)();
+  };
+
+  const Check checks[] = {
+    {"allocates in order", CheckAllocatesInOrder},
+    {"merges freed ranges", CheckFreeMerges},
+    {"counts fragmentation", CheckFragmentation},
+    {"rejects frees of free slots", CheckRejectsBadFrees},
+    {"retires transient tables by fence value", CheckTransientRing},
+    {"never overlaps slots in use", CheckRandom},
+  };
+
+  bool all_passed = true;
+  for (const Check& check : checks) {
+    const bool passed = check.run();
+    std::printf("  %-6s %s\n", passed ? "ok" : "FAILED", check.name);
+    all_passed = all_passed && passed;
+  }
+  return all_passed;
+}
+
+int RunDescriptorAllocatorCommand(int requested_frames) {
+  std::printf("descriptor allocator checks:\n");
+  bool passed = RunDescriptorAllocatorChecks();
+
+  std::printf("DeferredShading's heaps:\n");
+  std::printf("  %-12s %6s %10s %9s %10s\n", "heap", "tables", "persistent", "transient",
+              "hand-sized");
+  for (const AppDescriptorHeap& heap : AppDescriptorHeaps()) {
+    DescriptorAllocator allocator(heap.persistent_size, heap.transient_size);
+    for (uint32_t count : heap.tables) {
+      if (allocator.Allocate(count) == DescriptorAllocator::kInvalid)
+        passed = false;
+    }
+    std::printf("  %-12s %6zu %6u/%-3u %9u %10u\n", heap.name, heap.tables.size(),
+                allocator.stats().persistent_in_use, heap.persistent_size, heap.transient_size,
+                heap.hand_sized);
+  }
+
+  const int frames = requested_frames > 1 ? requested_frames : kDefaultDescriptorFrames;
+  const uint32_t kLightingSrvTable = 4;
+  DescriptorAllocator ring(256, 256);
+  std::vector<uint64_t> frame_fence_values(frames, 0);
+  uint32_t peak_in_use = 0;
+  int stalls = 0;
+  for (int frame = 0; frame < frames; ++frame) {
+    if (frame >= kAppFramesInFlight)
+      ring.Retire(frame_fence_values[frame - kAppFramesInFlight]);
+    while (ring.AllocateTransient(kLightingSrvTable) == DescriptorAllocator::kInvalid) {
+      ++stalls;
+      ring.Retire(ring.oldest_fence_value());
+    }
+    peak_in_use = std::max(peak_in_use, ring.transient_in_use());
+    frame_fence_values[frame] = frame + 1;
+    ring.Submit(frame_fence_values[frame]);
+  }
+  std::printf("transient ring: %d frames, %llu tables, at most %u of %u descriptors in use, "
+              "%d stalls\n",
+              frames, static_cast<unsigned long long>(ring.stats().transient_allocations),
+              peak_in_use, ring.transient_capacity(), stalls);
+
+  // Views created and freed as resources stream in and out, holding about half the region.
+  std::mt19937 rng(1);
+  std::uniform_int_distribution<uint32_t> count_dist(1, 16);
+  DescriptorAllocator churn(4096, 0);
+  std::vector<std::pair<uint32_t, uint32_t>> live;
+  double fragmentation_sum = 0.0;
+  double worst_fragmentation = 0.0;
+  const int kChurnSteps = 100000;
+  for (int step = 0; step < kChurnSteps; ++step) {
+    if (churn.stats().persistent_in_use < 2048 || live.empty()) {
+      const uint32_t count = count_dist(rng);
+      const uint32_t index = churn.Allocate(count);
+      if (index != DescriptorAllocator::kInvalid)
+        live.emplace_back(index, count);
+    } else {
+      std::uniform_int_distribution<size_t> live_dist(0, live.size() - 1);
+      const size_t i = live_dist(rng);
+      churn.Free(live[i].first, live[i].second);
+      live[i] = live.back();
+      live.pop_back();
+    }
+    fragmentation_sum += churn.Fragmentation();
+    worst_fragmentation = std::max(worst_fragmentation, churn.Fragmentation());
+  }
+  std::printf("churn: %d steps around half of 4096 descriptors, %u free ranges at the end, "
+              "fragmentation %.2f on average and %.2f at worst, %llu failed allocations\n",
+              kChurnSteps, churn.free_ranges(), fragmentation_sum / kChurnSteps,
+              worst_fragmentation,
+              static_cast<unsigned long long>(churn.stats().failed_allocations));
+  return passed ? 0 : 1;
+}
\ No newline at end of file
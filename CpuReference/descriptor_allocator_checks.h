@@ -0,0 +1,15 @@
+#ifndef DESCRIPTOR_ALLOCATOR_CHECKS_H_
+#define DESCRIPTOR_ALLOCATOR_CHECKS_H_
+
+// Runs DescriptorAllocator through small sequences with known results and through random ones
+// checked against a map of the slots in use. Prints one line per check and returns whether all
+// passed.
+bool RunDescriptorAllocatorChecks();
+
+// The descriptor-allocator command: runs the checks, allocates DeferredShading's tables to print
+// each heap's occupancy, then runs the lighting pass's transient SRV table through the ring for
+// |requested_frames| frames (a default number for 1) and streams random tables through a
+// persistent region to show how much its free list fragments. Returns the exit code.
+int RunDescriptorAllocatorCommand(int requested_frames);
+
+#endif  // DESCRIPTOR_ALLOCATOR_CHECKS_H_
\ No newline at end of file
@@ -0,0 +1,304 @@
+#include "frame_constants_checks.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <stdexcept>
+#include <vector>
+
+#include "deferred_scene.h"
+#include "frame_constants.h"
+#include "profiling.h"
+
+namespace {
+
+// The first Flush() of each frame writes every block, at aligned offsets in that frame's copies.
+bool CheckFirstFlushWritesAll() {
+  FrameConstants constants({64, 100, 4}, 3, 256);
+  std::vector<uint8_t> buffer(constants.size(), 0);
+  const uint32_t value = 7;
+  constants.Set(2, value);
+
+  uint32_t copied = 0;
+  memcpy(&copied, &buffer[constants.offset(2, 2)], sizeof(copied));
+  const bool untouched = copied == 0;
+  const int written = constants.Flush(2, buffer.data());
+  memcpy(&copied, &buffer[constants.offset(2, 2)], sizeof(copied));
+
+  return untouched && written == 3 && copied == 7 && constants.size() == 3 * 768 &&
+         constants.offset(1, 1) == 1024 && constants.offset(2, 2) == 2048 &&
+         constants.Flush(2, buffer.data()) == 0 && constants.Flush(0, buffer.data()) == 3;
+}
+
+// Setting a block to what it already holds is not a change.
+bool CheckSameContentsIsNoChange() {
+  FrameConstants constants({16}, 2, 16);
+  std::vector<uint8_t> buffer(constants.size());
+  const float value[4] = {1.f, 2.f, 3.f, 4.f};
+  const bool changed = constants.Set(0, value);
+  constants.Flush(0, buffer.data());
+  constants.Flush(1, buffer.data());
+  const bool changed_again = constants.Set(0, value);
+  return changed && !changed_again && constants.Flush(0, buffer.data()) == 0 &&
+         constants.stats().changed_sets == 1 && constants.stats().sets == 2;
+}
+
+// A change is written once into every frame's copies, whenever each frame next flushes, and the
+// blocks that did not change are left alone.
+bool CheckWritesOnlyChangedBlocks() {
+  FrameConstants constants({4, 4}, 3, 4);
+  std::vector<uint8_t> buffer(constants.size());
+  for (int frame = 0; frame < 3; ++frame)
+    constants.Flush(frame, buffer.data());
+
+  // Marks the first block's copies, which a Flush() must not overwrite.
+  const uint32_t marker = 0xdeadbeef;
+  for (int frame = 0; frame < 3; ++frame)
+    memcpy(&buffer[constants.offset(frame, 0)], &marker, sizeof(marker));
+
+  constants.Set(1, uint32_t(5));
+  const int first = constants.Flush(0, buffer.data());
+  const int again = constants.Flush(0, buffer.data());
+  const int second = constants.Flush(1, buffer.data());
+  constants.Set(1, uint32_t(6));
+  const int third = constants.Flush(2, buffer.data());
+
+  uint32_t values[3][2];
+  for (int frame = 0; frame < 3; ++frame) {
+    for (int block = 0; block < 2; ++block)
+      memcpy(&values[frame][block], &buffer[constants.offset(frame, block)], sizeof(uint32_t));
+  }
+  return first == 1 && again == 0 && second == 1 && third == 1 && values[0][0] == marker &&
+         values[1][0] == marker && values[2][0] == marker && values[0][1] == 5 &&
+         values[1][1] == 5 && values[2][1] == 6 && constants.stats().bytes_written == 12 * 2 + 12;
+}
+
+bool CheckRejectsWrongSize() {
+  FrameConstants constants({16}, 2, 16);
+  try {
+    constants.Set(0, uint32_t(1));
+  } catch (const std::runtime_error&) {
+    return true;
+  }
+  return false;
+}
+
+// Random changes and flushes against a copy of the blocks each frame should hold: after a flush,
+// the frame's copies must hold the latest contents, and a flush must write exactly the blocks
+// that changed since that frame last flushed.
+bool CheckRandom() {
+  const int kFrames = 3;
+  const std::vector<uint32_t> block_sizes = {64, 128, 448, 96, 4};
+  const int kBlocks = static_cast<int>(block_sizes.size());
+
+  std::mt19937 rng(1);
+  std::uniform_int_distribution<int> block_dist(0, kBlocks - 1);
+  std::uniform_int_distribution<int> action_dist(0, 3);
+  std::uniform_int_distribution<int> byte_dist(0, 3);
+
+  FrameConstants constants(block_sizes, kFrames, 256);
+  std::vector<uint8_t> buffer(constants.size());
+  std::vector<std::vector<uint8_t>> latest(kBlocks);
+  for (int block = 0; block < kBlocks; ++block)
+    latest[block].assign(block_sizes[block], 0);
+  // Whether each frame's copy of each block is behind.
+  std::vector<bool> stale(kFrames * kBlocks, true);
+  std::vector<uint8_t> contents;
+
+  int frame = 0;
+  for (int i = 0; i < 100000; ++i) {
+    if (action_dist(rng) != 0) {
+      const int block = block_dist(rng);
+      contents = latest[block];
+      // Usually changes one byte, sometimes none.
+      contents[byte_dist(rng) * (contents.size() - 1) / 3] += static_cast<uint8_t>(byte_dist(rng));
+      const bool changed = contents != latest[block];
+      if (constants.Set(block, contents.data(), contents.size()) != changed)
+        return false;
+      if (changed) {
+        latest[block] = contents;
+        for (int f = 0; f < kFrames; ++f)
+          stale[f * kBlocks + block] = true;
+      }
+      continue;
+    }
+
+    int expected = 0;
+    for (int block = 0; block < kBlocks; ++block)
+      expected += stale[frame * kBlocks + block] ? 1 : 0;
+    if (constants.Flush(frame, buffer.data()) != expected)
+      return false;
+    for (int block = 0; block < kBlocks; ++block) {
+      if (memcmp(&buffer[constants.offset(frame, block)], latest[block].data(),
+                 latest[block].size()) != 0) {
+        return false;
+      }
+      stale[frame * kBlocks + block] = false;
+    }
+    frame = (frame + 1) % kFrames;
+  }
+  std::printf("         %llu random sets, %llu changed, %llu of %llu block copies written\n",
+              static_cast<unsigned long long>(constants.stats().sets),
+              static_cast<unsigned long long>(constants.stats().changed_sets),
+              static_cast<unsigned long long>(constants.stats().blocks_written),
+              static_cast<unsigned long long>(constants.stats().flushes * kBlocks));
+  return true;
+}
+
+// Frames the frame-constants command times per case when --frames is not given.
+constexpr int kDefaultConstantFrames = 1000000;
+
+// What the per-frame constant updates may cost the CPU.
+constexpr double kConstantUpdateBudgetNs = 1000.0;
+
+// DeferredShading's constant blocks, in App::ConstantBlock order: the view matrix, the geometry
+// and shadow passes' matrices and the lighting constants.
+const std::vector<uint32_t> kAppConstantBlockSizes = {64, 128, 448, 32};
+
+// Stand-ins for the app's constant blocks, in App::ConstantBlock order, recomputed the way
+// App::UpdateConstants() recomputes them: the camera turns the view and geometry matrices, and
+// the shadow matrices and the light's view-space position follow both the camera and the light.
+struct StandInConstants {
+  float view[16] = {};
+  float geometry[32] = {};
+  float shadow[112] = {};
+  float lighting[8] = {};
+
+  void Update(int frame, bool camera_moves) {
+    const float angle = 0.001f * static_cast<float>(frame);
+    if (camera_moves) {
+      const float c = std::cos(angle);
+      const float s = std::sin(angle);
+      view[0] = c;
+      view[2] = -s;
+      view[8] = s;
+      view[10] = c;
+      memcpy(geometry, view, sizeof(view));
+      geometry[16] = c;
+      geometry[26] = s;
+    }
+    for (int face = 0; face < 7; ++face)
+      shadow[face * 16 + 12] = angle + static_cast<float>(face);
+    lighting[0] = angle;
+  }
+};
+
+// Updates the app's constant blocks as App::RenderFrame() does: on frames where the camera or the
+// light moved, which are the frames SetCamera() or SetLightPosition() marked dirty, every block is
+// recomputed and Set(); every frame, Flush() writes what that frame's copies have not seen into
+// |buffer|. Returns the nanoseconds per frame.
+double TimeConstantUpdates(int frames, bool camera_moves, bool light_moves,
+                           FrameConstants* constants, std::vector<uint8_t>* buffer) {
+  StandInConstants blocks;
+  Stopwatch stopwatch;
+  for (int frame = 0; frame < frames; ++frame) {
+    if (camera_moves || light_moves) {
+      blocks.Update(frame, camera_moves);
+      constants->Set(0, blocks.view);
+      constants->Set(1, blocks.geometry);
+      constants->Set(2, blocks.shadow);
+      constants->Set(3, blocks.lighting);
+    }
+    constants->Flush(frame % constants->num_frames(), buffer->data());
+  }
+  return stopwatch.ElapsedSeconds() * 1e9 / frames;
+}
+
+// The same without tracking: the blocks are recomputed on the same frames, and every frame copies
+// all of them into its copies in |buffer|, at the offsets |constants| gives them. Returns the
+// nanoseconds per frame.
+double TimeConstantRewrites(int frames, bool camera_moves, bool light_moves,
+                            const FrameConstants& constants, std::vector<uint8_t>* buffer) {
+  StandInConstants blocks;
+  const void* sources[] = {blocks.view, blocks.geometry, blocks.shadow, blocks.lighting};
+  Stopwatch stopwatch;
+  for (int frame = 0; frame < frames; ++frame) {
+    if (camera_moves || light_moves)
+      blocks.Update(frame, camera_moves);
+    const int copy = frame % constants.num_frames();
+    for (int block = 0; block < constants.num_blocks(); ++block) {
+      memcpy(buffer->data() + constants.offset(copy, block), sources[block],
+             kAppConstantBlockSizes[block]);
+    }
+  }
+  return stopwatch.ElapsedSeconds() * 1e9 / frames;
+}
+
+}  // namespace
+
+bool RunFrameConstantsChecks() {
+  struct Check {
+    const char* name;
+    bool (*run)();
+  };
+
+  const Check checks[] = {
+    {"first flush writes every block", CheckFirstFlushWritesAll},
+    {"same contents are not a change", CheckSameContentsIsNoChange},
+    {"writes only the blocks that changed", CheckWritesOnlyChangedBlocks},
+    {"rejects contents of the wrong size", CheckRejectsWrongSize},
+    {"every frame's copies stay up to date", CheckRandom},
+  };
+
+  bool all_passed = true;
+  for (const Check& check : checks) {
+    const bool passed = check.run();
+    std::printf("  %-6s %s\n", passed ? "ok" : "FAILED", check.name);
+    all_passed = all_passed && passed;
+  }
+  return all_passed;
+}
+
+int RunFrameConstantsCommand(int requested_frames) {
+  std::printf("frame constants checks:\n");
+  bool passed = RunFrameConstantsChecks();
+
+  const int frames = requested_frames > 1 ? requested_frames : kDefaultConstantFrames;
+  FrameConstants constants(kAppConstantBlockSizes, kAppFramesInFlight, 256);
+  std::vector<uint8_t> buffer(constants.size());
+  uint64_t block_bytes = 0;
+  for (uint32_t size : kAppConstantBlockSizes)
+    block_bytes += size;
+  std::printf("%d frames per case, %d blocks of %llu bytes (%llu bytes with %d copies):\n",
+              frames, constants.num_blocks(), static_cast<unsigned long long>(block_bytes),
+              static_cast<unsigned long long>(constants.size()), kAppFramesInFlight);
+  std::printf("  %-18s %11s %13s %11s %11s\n", "case", "tracked ns", "blocks/frame",
+              "bytes/frame", "rewrite ns");
+
+  struct Case {
+    const char* name;
+    bool camera_moves;
+    bool light_moves;
+  };
+  const Case cases[] = {
+    {"still", false, false},
+    {"light moving", false, true},
+    {"camera and light", true, true},
+  };
+
+  double worst_ns = 0.0;
+  for (const Case& c : cases) {
+    const FrameConstants::Stats before = constants.stats();
+    const double tracked_ns = TimeConstantUpdates(frames, c.camera_moves, c.light_moves,
+                                                  &constants, &buffer);
+    const FrameConstants::Stats& after = constants.stats();
+    const double rewrite_ns = TimeConstantRewrites(frames, c.camera_moves, c.light_moves,
+                                                   constants, &buffer);
+    std::printf("  %-18s %11.1f %13.2f %11.1f %11.1f\n", c.name, tracked_ns,
+                static_cast<double>(after.blocks_written - before.blocks_written) / frames,
+                static_cast<double>(after.bytes_written - before.bytes_written) / frames,
+                rewrite_ns);
+    worst_ns = std::max(worst_ns, tracked_ns);
+  }
+  std::printf("  rewrite copies all %d blocks every frame\n", constants.num_blocks());
+
+  if (worst_ns > kConstantUpdateBudgetNs) {
+    std::printf("FAILED: %.1f ns per frame is over the %.0f ns budget\n", worst_ns,
+                kConstantUpdateBudgetNs);
+    passed = false;
+  }
+  return passed ? 0 : 1;
+}
\ No newline at end of file
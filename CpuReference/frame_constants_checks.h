@@ -0,0 +1,15 @@
+#ifndef FRAME_CONSTANTS_CHECKS_H_
+#define FRAME_CONSTANTS_CHECKS_H_
+
+// Runs FrameConstants through small sequences with known results and through random ones checked
+// against a copy of what every frame's buffer should hold. Prints one line per check and returns
+// whether all passed.
+bool RunFrameConstantsChecks();
+
+// The frame-constants command: runs the checks, then times the app's per-frame constant updates
+// with the camera and the light still and moving, against rewriting every block of the frame's
+// copies each frame. |requested_frames| is --frames; 1 times a default number per case. Returns
+// the exit code.
+int RunFrameConstantsCommand(int requested_frames);
+
+#endif  // FRAME_CONSTANTS_CHECKS_H_
\ No newline at end of file
@@ -0,0 +1,84 @@
+#include "image.h"
+
+#include <cstdint>
+#include <fstream>
+#include <limits>
+#include <stdexcept>
+#include <string>
+
+namespace {
+
+// Skips whitespace and comments, then reads the next number of a PPM header.
+int ReadHeaderValue(std::istream& file) {
+  for (;;) {
+    const int next = file.peek();
+    if (next == '#') {
+      file.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
+    } else if (next == ' ' || next == '\t' || next == '\r' || next == '\n') {
+      file.get();
+    } else {
+      break;
+    }
+  }
+
+  int value = -1;
+  file >> value;
+  return value;
+}
+
+}  // namespace
+
+void WritePpm(const char* path, const Image& image) {
+  std::ofstream file(path, std::ios::out | std::ios::binary | std::ios::trunc);
+  if (!file)
+    throw std::runtime_error(std::string("cannot create ") + path);
+
+  file << "P6\n" << image.width << " " << image.height << "\n255\n";
+
+  std::vector<uint8_t> row(static_cast<size_t>(image.width) * 3);
+  for (int y = 0; y < image.height; ++y) {
+    for (int x = 0; x < image.width; ++x) {
+      const Vec3& pixel = image.at(x, y);
+      row[x * 3 + 0] = ToUnorm8(pixel.x);
+      row[x * 3 + 1] = ToUnorm8(pixel.y);
+      row[x * 3 + 2] = ToUnorm8(pixel.z);
+    }
+    file.write(reinterpret_cast<const char*>(row.data()), row.size());
+  }
+
+  if (!file)
+    throw std::runtime_error(std::string("cannot write ") + path);
+}
+
+Image ReadPpm(const char* path) {
+  std::ifstream file(path, std::ios::in | std::ios::binary);
+  if (!file)
+    throw std::runtime_error(std::string("cannot open ") + path);
+
+  char magic[2] = {};
+  file.read(magic, 2);
+  const int width = ReadHeaderValue(file);
+  const int height = ReadHeaderValue(file);
+  const int max_value = ReadHeaderValue(file);
+  // One whitespace character separates the header from the pixels.
+  file.get();
+  if (!file || magic[0] != 'P' || magic[1] != '6' || width <= 0 || height <= 0 ||
+      max_value != 255) {
+    throw std::runtime_error(std::string(path) + " is not an 8-bit binary PPM");
+  }
+
+  Image image(width, height);
+  std::vector<uint8_t> row(static_cast<size_t>(width) * 3);
+  for (int y = 0; y < height; ++y) {
+    file.read(reinterpret_cast<char*>(row.data()), row.size());
+    if (!file)
+      throw std::runtime_error(std::string("cannot read ") + path);
+
+    for (int x = 0; x < width; ++x) {
+      image.at(x, y) = Vec3{static_cast<float>(row[x * 3 + 0]), static_cast<float>(row[x * 3 + 1]),
+                            static_cast<float>(row[x * 3 + 2])} /
+                       255.f;
+    }
+  }
+  return image;
+}
\ No newline at end of file
@@ -0,0 +1,37 @@
+#ifndef IMAGE_H_
+#define IMAGE_H_
+
+#include <cstdint>
+#include <vector>
+
+#include "vec_math.h"
+
+// Linear RGB float image, row-major from the top-left like a D3D texture.
+struct Image {
+  Image() = default;
+  Image(int width, int height)
+      : width(width), height(height), pixels(static_cast<size_t>(width) * height) {}
+
+  Vec3& at(int x, int y) { return pixels[static_cast<size_t>(y) * width + x]; }
+  const Vec3& at(int x, int y) const { return pixels[static_cast<size_t>(y) * width + x]; }
+
+  int width = 0;
+  int height = 0;
+  std::vector<Vec3> pixels;
+};
+
+// The 8-bit level an R8G8B8A8_UNORM render target stores |value| as: saturated, then rounded to the
+// nearest of 256 levels.
+inline uint8_t ToUnorm8(float value) {
+  return static_cast<uint8_t>(Saturate(value) * 255.f + 0.5f);
+}
+
+// Writes a binary PPM, converting each channel with ToUnorm8(). Throws std::runtime_error on
+// failure.
+void WritePpm(const char* path, const Image& image);
+
+// Reads a binary PPM with 8-bit channels, as WritePpm writes them, into values in [0, 1]. Throws
+// std::runtime_error on failure.
+Image ReadPpm(const char* path);
+
+#endif  // IMAGE_H_
\ No newline at end of file
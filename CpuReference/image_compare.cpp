@@ -0,0 +1,144 @@
+#include "image_compare.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <stdexcept>
+#include <vector>
+
+namespace {
+
+// The Gaussian window of Wang et al., "Image Quality Assessment: From Error Visibility to
+// Structural Similarity" (2004): 11 x 11 with a standard deviation of 1.5, and the constants that
+// keep the ratios stable, for values in [0, 1].
+constexpr int kSsimRadius = 5;
+constexpr float kSsimSigma = 1.5f;
+constexpr float kSsimC1 = 0.01f * 0.01f;
+constexpr float kSsimC2 = 0.03f * 0.03f;
+
+// A single-channel image, row-major like Image.
+struct Plane {
+  int width;
+  int height;
+  std::vector<float> values;
+};
+
+// Gaussian blur of |plane| with |weights| (2 * kSsimRadius + 1 taps), clamping at the edges.
+Plane Blur(const Plane& plane, const float* weights) {
+  const int width = plane.width;
+  const int height = plane.height;
+
+  Plane rows = {width, height, std::vector<float>(plane.values.size())};
+  for (int y = 0; y < height; ++y) {
+    const float* in = &plane.values[static_cast<size_t>(y) * width];
+    for (int x = 0; x < width; ++x) {
+      float sum = 0.f;
+      for (int k = -kSsimRadius; k <= kSsimRadius; ++k)
+        sum += weights[k + kSsimRadius] * in[std::min(std::max(x + k, 0), width - 1)];
+      rows.values[static_cast<size_t>(y) * width + x] = sum;
+    }
+  }
+
+  Plane result = {width, height, std::vector<float>(plane.values.size())};
+  for (int y = 0; y < height; ++y) {
+    for (int x = 0; x < width; ++x) {
+      float sum = 0.f;
+      for (int k = -kSsimRadius; k <= kSsimRadius; ++k) {
+        const int row = std::min(std::max(y + k, 0), height - 1);
+        sum += weights[k + kSsimRadius] * rows.values[static_cast<size_t>(row) * width + x];
+      }
+      result.values[static_cast<size_t>(y) * width + x] = sum;
+    }
+  }
+  return result;
+}
+
+// Product of two planes of the same size, pixel by pixel.
+Plane Multiply(const Plane& a, const Plane& b) {
+  Plane result = {a.width, a.height, std::vector<float>(a.values.size())};
+  for (size_t i = 0; i < a.values.size(); ++i)
+    result.values[i] = a.values[i] * b.values[i];
+  return result;
+}
+
+// Rec. 709 luma of |image| after 8-bit quantization.
+Plane Luma(const Image& image) {
+  Plane result = {image.width, image.height, std::vector<float>(image.pixels.size())};
+  for (size_t i = 0; i < image.pixels.size(); ++i) {
+    const Vec3& pixel = image.pixels[i];
+    result.values[i] = (0.2126f * ToUnorm8(pixel.x) + 0.7152f * ToUnorm8(pixel.y) +
+                        0.0722f * ToUnorm8(pixel.z)) /
+                       255.f;
+  }
+  return result;
+}
+
+double MeanSsim(const Image& image, const Image& reference) {
+  float weights[2 * kSsimRadius + 1];
+  float total = 0.f;
+  for (int k = -kSsimRadius; k <= kSsimRadius; ++k) {
+    weights[k + kSsimRadius] = std::exp(-0.5f * k * k / (kSsimSigma * kSsimSigma));
+    total += weights[k + kSsimRadius];
+  }
+  for (float& weight : weights)
+    weight /= total;
+
+  const Plane x = Luma(image);
+  const Plane y = Luma(reference);
+  const Plane mean_x = Blur(x, weights);
+  const Plane mean_y = Blur(y, weights);
+  const Plane mean_xx = Blur(Multiply(x, x), weights);
+  const Plane mean_yy = Blur(Multiply(y, y), weights);
+  const Plane mean_xy = Blur(Multiply(x, y), weights);
+
+  double sum = 0.0;
+  for (size_t i = 0; i < x.values.size(); ++i) {
+    const float mx = mean_x.values[i];
+    const float my = mean_y.values[i];
+    const float variance_x = mean_xx.values[i] - mx * mx;
+    const float variance_y = mean_yy.values[i] - my * my;
+    const float covariance = mean_xy.values[i] - mx * my;
+    sum += (2.f * mx * my + kSsimC1) * (2.f * covariance + kSsimC2) /
+           ((mx * mx + my * my + kSsimC1) * (variance_x + variance_y + kSsimC2));
+  }
+  return sum / x.values.size();
+}
+
+// Black through red and yellow to white as |t| goes from 0 to 1.
+Vec3 HeatColor(float t) {
+  return {Saturate(t * 3.f), Saturate(t * 3.f - 1.f), Saturate(t * 3.f - 2.f)};
+}
+
+}  // namespace
+
+ImageDifference CompareImages(const Image& image, const Image& reference, Image* heatmap) {
+  if (image.width != reference.width || image.height != reference.height)
+    throw std::runtime_error("cannot compare images of different sizes");
+
+  if (heatmap)
+    *heatmap = Image(image.width, image.height);
+
+  ImageDifference result;
+  double squared_error = 0.0;
+  for (size_t i = 0; i < image.pixels.size(); ++i) {
+    int pixel_error = 0;
+    for (int channel = 0; channel < 3; ++channel) {
+      const int error =
+          std::abs(ToUnorm8(image.pixels[i][channel]) - ToUnorm8(reference.pixels[i][channel]));
+      squared_error += static_cast<double>(error) * error;
+      pixel_error = std::max(pixel_error, error);
+    }
+
+    result.max_error = std::max(result.max_error, pixel_error);
+    result.changed_pixels += pixel_error > 0;
+    if (heatmap)
+      heatmap->pixels[i] = HeatColor(static_cast<float>(pixel_error) / kHeatmapFullScale);
+  }
+
+  const double mean_squared_error = squared_error / (3.0 * image.pixels.size()) / (255.0 * 255.0);
+  result.psnr = mean_squared_error > 0.0 ? -10.0 * std::log10(mean_squared_error)
+                                         : std::numeric_limits<double>::infinity();
+  result.ssim = MeanSsim(image, reference);
+  return result;
+}
\ No newline at end of file
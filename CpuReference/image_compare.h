@@ -0,0 +1,28 @@
+#ifndef IMAGE_COMPARE_H_
+#define IMAGE_COMPARE_H_
+
+#include <cstddef>
+
+#include "image.h"
+
+// How far an image is from a reference, measured on both as WritePpm stores them, so an image
+// compares equal to the PPM it was written to.
+struct ImageDifference {
+  // Peak signal-to-noise ratio over the RGB channels, in dB. Infinite for identical images.
+  double psnr = 0.0;
+  // Mean structural similarity of the luma, 1 for identical images.
+  double ssim = 0.0;
+  // Largest difference of any channel, in 8-bit levels, and pixels with any difference.
+  int max_error = 0;
+  size_t changed_pixels = 0;
+};
+
+// Compares |image| against |reference|, which must be the same size. If |heatmap| is not null,
+// fills it with each pixel's largest channel difference, running from black through red and
+// yellow to white at kHeatmapFullScale levels and above. Throws std::runtime_error if the sizes
+// differ.
+ImageDifference CompareImages(const Image& image, const Image& reference, Image* heatmap);
+
+constexpr int kHeatmapFullScale = 32;
+
+#endif  // IMAGE_COMPARE_H_
\ No newline at end of file
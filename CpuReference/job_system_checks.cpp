@@ -0,0 +1,520 @@
+#include "job_system_checks.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <numeric>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include "bvh.h"
+#include "job_system.h"
+#include "profiling.h"
+#include "thread_pool.h"
+
+namespace {
+
+constexpr int kThreads = 4;
+
+// Every index runs exactly once, on a valid thread, whatever the grain.
+bool CheckParallelForVisitsAll() {
+  JobSystem jobs(kThreads);
+  for (int grain : {1, 7, 64, 100000}) {
+    const int kCount = 100000;
+    std::vector<std::atomic<int>> visits(kCount);
+    for (std::atomic<int>& visit : visits)
+      visit.store(0);
+    std::atomic<bool> bad_thread{false};
+
+    jobs.ParallelFor(kCount, grain, [&](int index, int thread_index) {
+      visits[index].fetch_add(1);
+      if (thread_index < 0 || thread_index >= kThreads)
+        bad_thread.store(true);
+    });
+
+    for (const std::atomic<int>& visit : visits) {
+      if (visit.load() != 1)
+        return false;
+    }
+    if (bad_thread.load())
+      return false;
+  }
+  return true;
+}
+
+// Counts the leaves of a binary tree of |depth| levels, each node a job that starts its children
+// and waits for them, the way a BVH build recurses.
+int CountLeaves(JobSystem* jobs, int depth) {
+  if (depth == 0)
+    return 1;
+
+  int left = 0;
+  JobSystem::Counter counter;
+  jobs->Run([&](int) { left = CountLeaves(jobs, depth - 1); }, &counter);
+  const int right = CountLeaves(jobs, depth - 1);
+  jobs->Wait(&counter);
+  return left + right;
+}
+
+// Jobs that wait for their own jobs finish, since waiting threads run other jobs meanwhile.
+bool CheckNestedWaits() {
+  JobSystem jobs(kThreads);
+  for (int repeat = 0; repeat < 50; ++repeat) {
+    if (CountLeaves(&jobs, 12) != 1 << 12)
+      return false;
+  }
+  return true;
+}
+
+// Each stage's jobs start after the previous stage's counter reaches zero, so they see all of its
+// writes, even though the jobs of every stage are handed over up front.
+bool CheckDependencies() {
+  const int kStages = 8;
+  const int kWidth = 32;
+  JobSystem jobs(kThreads);
+
+  for (int repeat = 0; repeat < 50; ++repeat) {
+    std::vector<int> values(kStages * kWidth, 0);
+    std::vector<JobSystem::Counter> counters(kStages);
+    std::atomic<bool> started_early{false};
+
+    for (int stage = 0; stage < kStages; ++stage) {
+      for (int i = 0; i < kWidth; ++i) {
+        auto job = [&, stage, i](int) {
+          for (int j = 0; stage > 0 && j < kWidth; ++j) {
+            if (values[(stage - 1) * kWidth + j] != stage)
+              started_early.store(true);
+          }
+          values[stage * kWidth + i] = stage + 1;
+        };
+        if (stage == 0)
+          jobs.Run(job, &counters[stage]);
+        else
+          jobs.RunAfter(&counters[stage - 1], job, &counters[stage]);
+      }
+    }
+    jobs.Wait(&counters[kStages - 1]);
+    if (started_early.load())
+      return false;
+  }
+  return true;
+}
+
+// A job started after a counter that is already zero runs right away.
+bool CheckFinishedDependency() {
+  JobSystem jobs(kThreads);
+  JobSystem::Counter finished;
+  JobSystem::Counter counter;
+  bool ran = false;
+  jobs.RunAfter(&finished, [&](int) { ran = true; }, &counter);
+  jobs.Wait(&counter);
+  return ran;
+}
+
+// Starting more jobs than a deque holds at first grows it without losing any.
+bool CheckDequeGrows() {
+  JobSystem jobs(kThreads);
+  const int kJobs = 10000;
+  std::atomic<int> runs{0};
+  JobSystem::Counter counter;
+  for (int i = 0; i < kJobs; ++i)
+    jobs.Run([&](int) { runs.fetch_add(1); }, &counter);
+  jobs.Wait(&counter);
+  return runs.load() == kJobs && jobs.stats().jobs == kJobs;
+}
+
+// Idle workers take jobs from the thread that started them.
+bool CheckSteals() {
+  JobSystem jobs(kThreads);
+  jobs.ParallelFor(64, [](int, int) {
+    std::this_thread::sleep_for(std::chrono::microseconds(200));
+  });
+  std::printf("         %llu of %llu jobs stolen\n",
+              static_cast<unsigned long long>(jobs.stats().steals),
+              static_cast<unsigned long long>(jobs.stats().jobs));
+  return jobs.stats().steals > 0;
+}
+
+// An exception thrown by a job reaches the thread that waits for its counter, once the other jobs
+// have finished, and a loop rethrows the first one its calls threw.
+bool CheckForwardsExceptions() {
+  JobSystem jobs(kThreads);
+  std::atomic<int> runs{0};
+  bool caught = false;
+  JobSystem::Counter counter;
+  for (int i = 0; i < 64; ++i) {
+    jobs.Run(
+        [&, i](int) {
+          runs.fetch_add(1);
+          if (i == 37)
+            throw std::runtime_error("job 37");
+        },
+        &counter);
+  }
+  try {
+    jobs.Wait(&counter);
+  } catch (const std::runtime_error&) {
+    caught = runs.load() == 64;
+  }
+  if (!caught)
+    return false;
+
+  caught = false;
+  try {
+    jobs.ParallelFor(1000, [](int index, int) {
+      if (index % 100 == 99)
+        throw std::runtime_error("index");
+    });
+  } catch (const std::runtime_error&) {
+    caught = true;
+  }
+  // The system still runs jobs afterwards.
+  runs.store(0);
+  jobs.ParallelFor(1000, [&](int, int) { runs.fetch_add(1); });
+  return caught && runs.load() == 1000;
+}
+
+// Threads that are not the system's cannot start jobs.
+bool CheckRejectsOtherThreads() {
+  JobSystem jobs(kThreads);
+  bool threw = false;
+  std::thread other([&]() {
+    try {
+      jobs.Run([](int) {}, nullptr);
+    } catch (const std::runtime_error&) {
+      threw = true;
+    }
+  });
+  other.join();
+  return threw;
+}
+
+// Ranges of the median-split tree at least this large are worth handing to another thread.
+constexpr uint32_t kMinJobPrimitives = 4096;
+constexpr uint32_t kMedianTreeLeafSize = 4;
+// The bench-jobs raster tiles, and the slope of the view they are rasterized from, the same as
+// bench-bvh's rays.
+constexpr int kJobTileSize = 16;
+constexpr float kJobViewSlope = 0.6f;
+
+// Partitions |indices| at the median centroid along the longest axis of their bounds and returns
+// the size of the first half. Ties are broken by index, so every run splits the same way.
+uint32_t SplitAtMedian(const std::vector<Vec3>& centroids, uint32_t* indices, uint32_t count) {
+  Aabb bounds = Aabb::Empty();
+  for (uint32_t i = 0; i < count; ++i)
+    bounds.Grow(centroids[indices[i]]);
+  const Vec3 extent = bounds.max - bounds.min;
+  int axis = extent.y > extent.x ? 1 : 0;
+  if (extent.z > (axis == 0 ? extent.x : extent.y))
+    axis = 2;
+  auto key = [axis](const Vec3& v) { return axis == 0 ? v.x : axis == 1 ? v.y : v.z; };
+
+  const uint32_t half = count / 2;
+  std::nth_element(indices, indices + half, indices + count, [&](uint32_t a, uint32_t b) {
+    const float key_a = key(centroids[a]);
+    const float key_b = key(centroids[b]);
+    return key_a < key_b || (key_a == key_b && a < b);
+  });
+  return half;
+}
+
+// Splits |indices| at medians down to kMedianTreeLeafSize: the top-down partitioning a BVH build
+// spends its time in. With |jobs|, the first half of every large range is a job of its own.
+// Returns the number of leaves.
+uint32_t BuildMedianTree(const std::vector<Vec3>& centroids, uint32_t* indices, uint32_t count,
+                         JobSystem* jobs) {
+  if (count <= kMedianTreeLeafSize)
+    return 1;
+
+  const uint32_t half = SplitAtMedian(centroids, indices, count);
+  if (jobs == nullptr || count < kMinJobPrimitives) {
+    return BuildMedianTree(centroids, indices, half, jobs) +
+           BuildMedianTree(centroids, indices + half, count - half, jobs);
+  }
+
+  uint32_t left = 0;
+  JobSystem::Counter counter;
+  jobs->Run([&](int) { left = BuildMedianTree(centroids, indices, half, jobs); }, &counter);
+  const uint32_t right = BuildMedianTree(centroids, indices + half, count - half, jobs);
+  jobs->Wait(&counter);
+  return left + right;
+}
+
+// BuildMedianTree() the way Bvh's constructor uses its ThreadPool, which only runs flat loops:
+// the calling thread splits the largest range until there are kSubtreesPerThread per thread, and
+// the pool then finishes those subtrees.
+uint32_t BuildMedianTreeOnPool(const std::vector<Vec3>& centroids, uint32_t* indices,
+                               uint32_t count, ThreadPool* pool) {
+  const size_t kSubtreesPerThread = 8;
+  struct Range {
+    uint32_t first;
+    uint32_t count;
+  };
+
+  std::vector<Range> ranges = {{0, count}};
+  while (ranges.size() < pool->num_threads() * kSubtreesPerThread) {
+    auto largest = std::max_element(
+        ranges.begin(), ranges.end(),
+        [](const Range& a, const Range& b) { return a.count < b.count; });
+    if (largest->count < kMinJobPrimitives)
+      break;
+
+    const Range range = *largest;
+    const uint32_t half = SplitAtMedian(centroids, indices + range.first, range.count);
+    *largest = {range.first, half};
+    ranges.push_back({range.first + half, range.count - half});
+  }
+
+  std::vector<uint32_t> leaves(ranges.size());
+  pool->ParallelFor(static_cast<int>(ranges.size()), [&](int i, int) {
+    leaves[i] = BuildMedianTree(centroids, indices + ranges[i].first, ranges[i].count, nullptr);
+  });
+  uint32_t total = 0;
+  for (uint32_t subtree_leaves : leaves)
+    total += subtree_leaves;
+  return total;
+}
+
+struct TileTriangle {
+  float x[3];
+  float y[3];
+  // Distance of the nearest corner from the view.
+  float depth;
+  uint32_t id;
+};
+
+// The scene's triangles in front of bench-bvh's view, projected to a |width| x |height| image and
+// binned into kJobTileSize tiles by their bounds. Tiles over dense parts of the scene hold far
+// more triangles than the rest, as in the rasterizer.
+struct TileWorkload {
+  int width;
+  int height;
+  int tiles_x;
+  int tiles_y;
+  std::vector<TileTriangle> triangles;
+  // Tile t's triangles are tile_triangles[tile_offsets[t], tile_offsets[t + 1]).
+  std::vector<uint32_t> tile_offsets;
+  std::vector<uint32_t> tile_triangles;
+};
+
+TileWorkload BinJobTiles(const Scene& scene, int width, int height) {
+  const Vec3 kEye = {0.f, 1.f, 4.f};
+  TileWorkload workload;
+  workload.width = width;
+  workload.height = height;
+  workload.tiles_x = (width + kJobTileSize - 1) / kJobTileSize;
+  workload.tiles_y = (height + kJobTileSize - 1) / kJobTileSize;
+
+  for (uint32_t triangle = 0; triangle < scene.num_triangles(); ++triangle) {
+    TileTriangle projected;
+    projected.depth = std::numeric_limits<float>::infinity();
+    projected.id = triangle;
+    bool in_front = true;
+    for (int corner = 0; corner < 3; ++corner) {
+      const Vec3 p = scene.position(triangle, corner) - kEye;
+      const float distance = -p.z;
+      in_front = in_front && distance > 0.01f;
+      projected.x[corner] = (p.x / distance / kJobViewSlope * 0.5f + 0.5f) * width;
+      projected.y[corner] = (0.5f - p.y / distance / kJobViewSlope * 0.5f) * height;
+      projected.depth = std::min(projected.depth, distance);
+    }
+    if (in_front)
+      workload.triangles.push_back(projected);
+  }
+
+  const int num_tiles = workload.tiles_x * workload.tiles_y;
+  std::vector<std::vector<uint32_t>> bins(num_tiles);
+  for (uint32_t i = 0; i < workload.triangles.size(); ++i) {
+    const TileTriangle& triangle = workload.triangles[i];
+    const float min_x = std::min({triangle.x[0], triangle.x[1], triangle.x[2]});
+    const float max_x = std::max({triangle.x[0], triangle.x[1], triangle.x[2]});
+    const float min_y = std::min({triangle.y[0], triangle.y[1], triangle.y[2]});
+    const float max_y = std::max({triangle.y[0], triangle.y[1], triangle.y[2]});
+    if (max_x < 0.f || max_y < 0.f || min_x >= width || min_y >= height)
+      continue;
+    const int tx0 = std::max(0, static_cast<int>(min_x) / kJobTileSize);
+    const int ty0 = std::max(0, static_cast<int>(min_y) / kJobTileSize);
+    const int tx1 = std::min(workload.tiles_x - 1, static_cast<int>(max_x) / kJobTileSize);
+    const int ty1 = std::min(workload.tiles_y - 1, static_cast<int>(max_y) / kJobTileSize);
+    for (int ty = ty0; ty <= ty1; ++ty) {
+      for (int tx = tx0; tx <= tx1; ++tx)
+        bins[ty * workload.tiles_x + tx].push_back(i);
+    }
+  }
+
+  workload.tile_offsets.push_back(0);
+  for (const std::vector<uint32_t>& bin : bins) {
+    workload.tile_triangles.insert(workload.tile_triangles.end(), bin.begin(), bin.end());
+    workload.tile_offsets.push_back(static_cast<uint32_t>(workload.tile_triangles.size()));
+  }
+  return workload;
+}
+
+// Writes the id of the nearest triangle covering each pixel center of |tile|, or UINT32_MAX, to
+// |ids|. Ties go to the lower id, so the result does not depend on the order of the tiles.
+void RasterizeJobTile(const TileWorkload& workload, int tile, std::vector<uint32_t>* ids) {
+  float depths[kJobTileSize * kJobTileSize];
+  uint32_t tile_ids[kJobTileSize * kJobTileSize];
+  std::fill(std::begin(depths), std::end(depths), std::numeric_limits<float>::infinity());
+  std::fill(std::begin(tile_ids), std::end(tile_ids), UINT32_MAX);
+
+  const int x0 = (tile % workload.tiles_x) * kJobTileSize;
+  const int y0 = (tile / workload.tiles_x) * kJobTileSize;
+  const int x1 = std::min(x0 + kJobTileSize, workload.width);
+  const int y1 = std::min(y0 + kJobTileSize, workload.height);
+
+  for (uint32_t i = workload.tile_offsets[tile]; i < workload.tile_offsets[tile + 1]; ++i) {
+    const TileTriangle& t = workload.triangles[workload.tile_triangles[i]];
+    const float area =
+        (t.x[1] - t.x[0]) * (t.y[2] - t.y[0]) - (t.x[2] - t.x[0]) * (t.y[1] - t.y[0]);
+    if (area == 0.f)
+      continue;
+    for (int y = y0; y < y1; ++y) {
+      const float py = y + 0.5f;
+      for (int x = x0; x < x1; ++x) {
+        const float px = x + 0.5f;
+        bool inside = true;
+        for (int e = 0; e < 3 && inside; ++e) {
+          const int a = e;
+          const int b = (e + 1) % 3;
+          const float edge = (t.x[b] - t.x[a]) * (py - t.y[a]) - (t.y[b] - t.y[a]) * (px - t.x[a]);
+          inside = area > 0.f ? edge >= 0.f : edge <= 0.f;
+        }
+        const int texel = (y - y0) * kJobTileSize + (x - x0);
+        if (inside && (t.depth < depths[texel] ||
+                       (t.depth == depths[texel] && t.id < tile_ids[texel]))) {
+          depths[texel] = t.depth;
+          tile_ids[texel] = t.id;
+        }
+      }
+    }
+  }
+
+  for (int y = y0; y < y1; ++y) {
+    for (int x = x0; x < x1; ++x)
+      (*ids)[y * workload.width + x] = tile_ids[(y - y0) * kJobTileSize + (x - x0)];
+  }
+}
+
+// Runs |fn| |repeats| times and returns the best time in milliseconds.
+double BestMilliseconds(int repeats, const std::function<void()>& fn) {
+  double best = 0.0;
+  for (int i = 0; i < repeats; ++i) {
+    Stopwatch stopwatch;
+    fn();
+    const double milliseconds = stopwatch.ElapsedMilliseconds();
+    if (i == 0 || milliseconds < best)
+      best = milliseconds;
+  }
+  return best;
+}
+
+}  // namespace
+
+bool RunJobSystemChecks() {
+  struct Check {
+    const char* name;
+    bool (*run)();
+  };
+
+  const Check checks[] = {
+    {"runs every index of a loop once", CheckParallelForVisitsAll},
+    {"finishes trees of jobs waiting for their children", CheckNestedWaits},
+    {"starts dependent jobs after their dependencies", CheckDependencies},
+    {"starts jobs after a finished dependency", CheckFinishedDependency},
+    {"grows a full deque", CheckDequeGrows},
+    {"steals jobs for idle threads", CheckSteals},
+    {"rethrows exceptions on the waiting thread", CheckForwardsExceptions},
+    {"rejects threads that are not the system's", CheckRejectsOtherThreads},
+  };
+
+  bool all_passed = true;
+  for (const Check& check : checks) {
+    const bool passed = check.run();
+    std::printf("  %-6s %s\n", passed ? "ok" : "FAILED", check.name);
+    all_passed = all_passed && passed;
+  }
+  return all_passed;
+}
+
+int RunBenchJobsCommand(const Scene& scene, const char* scene_path, int width, int height,
+                        int repeats, int max_threads) {
+  std::printf("job system checks:\n");
+  bool passed = RunJobSystemChecks();
+
+  std::vector<Vec3> centroids(scene.num_triangles());
+  for (uint32_t i = 0; i < scene.num_triangles(); ++i) {
+    centroids[i] = (scene.position(i, 0) + scene.position(i, 1) + scene.position(i, 2)) *
+                   (1.f / 3.f);
+  }
+  const TileWorkload workload = BinJobTiles(scene, width, height);
+  const int num_tiles = workload.tiles_x * workload.tiles_y;
+
+  std::vector<uint32_t> serial_indices(scene.num_triangles());
+  std::vector<uint32_t> indices(scene.num_triangles());
+  uint32_t serial_leaves = 0;
+  const double serial_tree_ms = BestMilliseconds(repeats, [&]() {
+    std::iota(serial_indices.begin(), serial_indices.end(), 0);
+    serial_leaves =
+        BuildMedianTree(centroids, serial_indices.data(), scene.num_triangles(), nullptr);
+  });
+  std::vector<uint32_t> serial_ids(static_cast<size_t>(width) * height);
+  std::vector<uint32_t> ids(serial_ids.size());
+  const double serial_tiles_ms = BestMilliseconds(repeats, [&]() {
+    for (int tile = 0; tile < num_tiles; ++tile)
+      RasterizeJobTile(workload, tile, &serial_ids);
+  });
+
+  std::printf("%s: %u triangles, best of %d\n", scene_path, scene.num_triangles(), repeats);
+  std::printf("  median-split tree: %u leaves, %.3f ms on one thread\n", serial_leaves,
+              serial_tree_ms);
+  std::printf("  tiles:             %d tiles, %zu binned triangles, %.3f ms on one thread\n",
+              num_tiles, workload.tile_triangles.size(), serial_tiles_ms);
+  std::printf("  %7s %9s %9s %7s %9s | %9s %9s %7s %9s\n", "threads", "tree pool", "jobs",
+              "speedup", "steals", "tile pool", "jobs", "speedup", "steals");
+
+  for (int threads = 1; threads <= max_threads; threads *= 2) {
+    ThreadPool pool(threads);
+    JobSystem jobs(threads);
+
+    uint32_t leaves = 0;
+    const double tree_pool_ms = BestMilliseconds(repeats, [&]() {
+      std::iota(indices.begin(), indices.end(), 0);
+      leaves = BuildMedianTreeOnPool(centroids, indices.data(), scene.num_triangles(), &pool);
+    });
+    passed = passed && leaves == serial_leaves && indices == serial_indices;
+
+    uint64_t steals = jobs.stats().steals;
+    const double tree_jobs_ms = BestMilliseconds(repeats, [&]() {
+      std::iota(indices.begin(), indices.end(), 0);
+      leaves = BuildMedianTree(centroids, indices.data(), scene.num_triangles(), &jobs);
+    });
+    const uint64_t tree_steals = (jobs.stats().steals - steals) / repeats;
+    passed = passed && leaves == serial_leaves && indices == serial_indices;
+
+    std::fill(ids.begin(), ids.end(), 0);
+    const double tiles_pool_ms = BestMilliseconds(repeats, [&]() {
+      pool.ParallelFor(num_tiles, [&](int tile, int) { RasterizeJobTile(workload, tile, &ids); });
+    });
+    passed = passed && ids == serial_ids;
+
+    steals = jobs.stats().steals;
+    std::fill(ids.begin(), ids.end(), 0);
+    const double tiles_jobs_ms = BestMilliseconds(repeats, [&]() {
+      jobs.ParallelFor(num_tiles, [&](int tile, int) { RasterizeJobTile(workload, tile, &ids); });
+    });
+    const uint64_t tile_steals = (jobs.stats().steals - steals) / repeats;
+    passed = passed && ids == serial_ids;
+
+    std::printf("  %7d %9.3f %9.3f %6.2fx %9llu | %9.3f %9.3f %6.2fx %9llu\n", threads,
+                tree_pool_ms, tree_jobs_ms, serial_tree_ms / tree_jobs_ms,
+                static_cast<unsigned long long>(tree_steals), tiles_pool_ms, tiles_jobs_ms,
+                serial_tiles_ms / tiles_jobs_ms, static_cast<unsigned long long>(tile_steals));
+  }
+  std::printf("  %-6s every run matched the single-threaded results\n", passed ? "ok" : "FAILED");
+  return passed ? 0 : 1;
+}
\ No newline at end of file
@@ -0,0 +1,19 @@
+#ifndef JOB_SYSTEM_CHECKS_H_
+#define JOB_SYSTEM_CHECKS_H_
+
+#include "scene.h"
+
+// Runs JobSystem through loops, trees of nested jobs and chains of dependent jobs whose results
+// are known, many times over to shake out races. Prints one line per check and returns whether
+// all passed.
+bool RunJobSystemChecks();
+
+// The bench-jobs command: runs the checks, then times a median-split tree over |scene|'s triangles
+// and the rasterization of its triangles in |width| x |height| tiles, best of |repeats|, on 1, 2,
+// 4... up to |max_threads| threads, with a ThreadPool as the app and the tools use it and with a
+// JobSystem, against doing the same on one thread. Every result must match the single-threaded
+// one. |scene_path| names the scene in the report. Returns the exit code.
+int RunBenchJobsCommand(const Scene& scene, const char* scene_path, int width, int height,
+                        int repeats, int max_threads);
+
+#endif  // JOB_SYSTEM_CHECKS_H_
\ No newline at end of file
@@ -0,0 +1,1884 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "bvh.h"
+#include "bvh8.h"
+#include "clustered_lighting.h"
+#include "command_recorder.h"
+#include "cpu_features.h"
+#include "deferred_lighting.h"
+#include "deferred_scene.h"
+#include "descriptor_allocator_checks.h"
+#include "frame_constants_checks.h"
+#include "gbuffer_encoding.h"
+#include "image.h"
+#include "image_compare.h"
+#include "job_system_checks.h"
+#include "light_clusters.h"
+#include "material_table_checks.h"
+#include "rasterizer.h"
+#include "reference_tracer.h"
+#include "render_graph_checks.h"
+#include "sampler.h"
+#include "scene.h"
+#include "shadow_faces.h"
+#include "shadow_renderer.h"
+#include "profiling.h"
+#include "thin_gbuffer.h"
+#include "thread_pool.h"
+#include "upload_ring_checks.h"
+#include "wavefront_tracer.h"
+
+namespace {
+
+// Same size as the apps' windows.
+constexpr int kDefaultWidth = 1024;
+constexpr int kDefaultHeight = 768;
+
+struct Options {
+  int width = kDefaultWidth;
+  int height = kDefaultHeight;
+  int frames = 1;
+  int threads = 0;
+  // Prefix of the images and CSV files the commands write, under a directory of its own so that
+  // they stay out of the source tree.
+  std::string out = "out/reference";
+  // "scalar" or "avx2"; empty picks the fastest the CPU supports.
+  std::string kernel;
+  // Side of the square ray packets, or 0 to trace single rays.
+  int packet_size = 0;
+  // "megakernel" runs every shader for one ray before the next; "wavefront" runs each stage
+  // over a wave of paths.
+  std::string engine = "megakernel";
+  int wave_size = kDefaultWaveSize;
+  // "direct" shades like raytracing.hlsl; "path" path traces with the wavefront engine.
+  std::string integrator = "direct";
+  int bounces = PathTracingOptions().max_bounces;
+  // Stops accumulating samples once this much time has been spent, if positive.
+  double seconds = 0.0;
+  // Sampler for the wavefront engine, from MakeSampler(); empty keeps its built-in numbers.
+  std::string sampler;
+  // bench-samplers measures every power of two up to spp against reference_spp samples.
+  int spp = 64;
+  int reference_spp = 1024;
+  // Where golden keeps its images, and whether it replaces them instead of comparing.
+  std::string golden_dir = "golden";
+  bool update_golden = false;
+  // Point lights for clusters.
+  int lights = 1024;
+};
+
+// Parses the flags shared by every command. Returns false on an unknown flag.
+bool ParseOptions(int argc, char** argv, int first, Options* options) {
+  for (int i = first; i < argc; ++i) {
+    const char* arg = argv[i];
+    bool has_value = i + 1 < argc;
+
+    if (std::strcmp(arg, "--width") == 0 && has_value) {
+      options->width = std::max(1, std::atoi(argv[++i]));
+    } else if (std::strcmp(arg, "--height") == 0 && has_value) {
+      options->height = std::max(1, std::atoi(argv[++i]));
+    } else if (std::strcmp(arg, "--frames") == 0 && has_value) {
+      options->frames = std::max(1, std::atoi(argv[++i]));
+    } else if (std::strcmp(arg, "--threads") == 0 && has_value) {
+      options->threads = std::max(0, std::atoi(argv[++i]));
+    } else if (std::strcmp(arg, "--out") == 0 && has_value) {
+      options->out = argv[++i];
+    } else if (std::strcmp(arg, "--kernel") == 0 && has_value) {
+      options->kernel = argv[++i];
+    } else if (std::strcmp(arg, "--packet") == 0 && has_value) {
+      options->packet_size = std::atoi(argv[++i]);
+    } else if (std::strcmp(arg, "--engine") == 0 && has_value) {
+      options->engine = argv[++i];
+    } else if (std::strcmp(arg, "--wave") == 0 && has_value) {
+      options->wave_size = std::max(1, std::atoi(argv[++i]));
+    } else if (std::strcmp(arg, "--integrator") == 0 && has_value) {
+      options->integrator = argv[++i];
+    } else if (std::strcmp(arg, "--bounces") == 0 && has_value) {
+      options->bounces = std::max(0, std::atoi(argv[++i]));
+    } else if (std::strcmp(arg, "--seconds") == 0 && has_value) {
+      options->seconds = std::atof(argv[++i]);
+    } else if (std::strcmp(arg, "--sampler") == 0 && has_value) {
+      options->sampler = argv[++i];
+    } else if (std::strcmp(arg, "--spp") == 0 && has_value) {
+      options->spp = std::max(1, std::atoi(argv[++i]));
+    } else if (std::strcmp(arg, "--reference-spp") == 0 && has_value) {
+      options->reference_spp = std::max(1, std::atoi(argv[++i]));
+    } else if (std::strcmp(arg, "--golden") == 0 && has_value) {
+      options->golden_dir = argv[++i];
+    } else if (std::strcmp(arg, "--update") == 0) {
+      options->update_golden = true;
+    } else if (std::strcmp(arg, "--lights") == 0 && has_value) {
+      options->lights = std::max(1, std::atoi(argv[++i]));
+    } else {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Parses "synthetic:<triangle count>" into |num_triangles|. Returns false for other paths.
+bool ParseSyntheticPath(const char* path, uint32_t* num_triangles) {
+  const char kSyntheticPrefix[] = "synthetic:";
+  if (std::strncmp(path, kSyntheticPrefix, sizeof(kSyntheticPrefix) - 1) != 0)
+    return false;
+
+  long long count = std::atoll(path + sizeof(kSyntheticPrefix) - 1);
+  if (count <= 0 || count > 0x3fffffff)
+    throw std::runtime_error(std::string("bad triangle count in ") + path);
+  *num_triangles = static_cast<uint32_t>(count);
+  return true;
+}
+
+// Loads |path|, or builds a random triangle soup for "synthetic:<triangle count>".
+std::unique_ptr<Scene> LoadScene(const char* path) {
+  uint32_t num_triangles;
+  if (ParseSyntheticPath(path, &num_triangles))
+    return std::make_unique<Scene>(num_triangles, 1);
+  return std::make_unique<Scene>(path);
+}
+
+// Same for the rasterizer, which draws the DeferredShading app's buffers instead.
+std::unique_ptr<DeferredScene> LoadDeferredScene(const char* path) {
+  uint32_t num_triangles;
+  if (ParseSyntheticPath(path, &num_triangles))
+    return std::make_unique<DeferredScene>(num_triangles, 1);
+  return std::make_unique<DeferredScene>(path);
+}
+
+// Returns the traversal kernel named by |options.kernel|, building the BVH8 into |bvh8| if it is
+// the AVX2 one.
+const RayIntersector& SelectKernel(const Options& options, const Scene& scene, const Bvh& bvh,
+                                   std::unique_ptr<Bvh8>* bvh8) {
+  const bool use_avx2 = options.kernel.empty() ? CpuSupportsAvx2() : options.kernel == "avx2";
+
+  if (!use_avx2) {
+    if (!options.kernel.empty() && options.kernel != "scalar")
+      throw std::runtime_error("unknown kernel " + options.kernel);
+    return bvh;
+  }
+
+  if (!CpuSupportsAvx2())
+    throw std::runtime_error("the avx2 kernel needs a CPU with AVX2");
+
+  *bvh8 = std::make_unique<Bvh8>(scene, bvh);
+  return **bvh8;
+}
+
+// Renders |options.frames| frames, writes the last one to <out>.ppm and one line of timings per
+// frame to <out>.csv. Each frame adds one jittered sample per pixel to the image, and --seconds
+// can end the accumulation early. The rms_delta column is the root-mean-square change of the image
+// from the previous frame, which falls as the image converges.
+int RunTrace(const char* scene_path, const Options& options) {
+  std::unique_ptr<Scene> scene = LoadScene(scene_path);
+  ThreadPool pool(options.threads);
+  Bvh bvh(*scene, &pool);
+
+  std::unique_ptr<Bvh8> bvh8;
+  const RayIntersector& intersector = SelectKernel(options, *scene, bvh, &bvh8);
+
+  const bool wavefront = options.engine == "wavefront";
+  if (!wavefront && options.engine != "megakernel")
+    throw std::runtime_error("unknown engine " + options.engine);
+
+  const bool path_tracing = options.integrator == "path";
+  if (!path_tracing && options.integrator != "direct")
+    throw std::runtime_error("unknown integrator " + options.integrator);
+  if (path_tracing && !wavefront)
+    throw std::runtime_error("--integrator path needs --engine wavefront");
+  if (!options.sampler.empty() && !wavefront)
+    throw std::runtime_error("--sampler needs --engine wavefront");
+
+  ReferenceTracer tracer(*scene, intersector, &pool);
+  std::unique_ptr<WavefrontTracer> wavefront_tracer;
+  std::unique_ptr<Sampler> sampler;
+  if (wavefront) {
+    wavefront_tracer = std::make_unique<WavefrontTracer>(*scene, intersector, &pool,
+                                                         options.wave_size);
+    if (path_tracing) {
+      PathTracingOptions path_options;
+      path_options.max_bounces = options.bounces;
+      wavefront_tracer->SetPathTracing(&path_options);
+    }
+    if (!options.sampler.empty()) {
+      sampler = MakeSampler(options.sampler);
+      wavefront_tracer->SetSampler(sampler.get());
+    }
+  }
+
+  std::unique_ptr<PacketTraversal> packets;
+  if (options.packet_size != 0) {
+    if (options.packet_size != 8 && options.packet_size != 16)
+      throw std::runtime_error("--packet must be 0, 8 or 16");
+    if (wavefront)
+      throw std::runtime_error("--packet only applies to the megakernel engine");
+    if (!CpuSupportsAvx2())
+      throw std::runtime_error("packet traversal needs a CPU with AVX2");
+
+    packets = std::make_unique<PacketTraversal>(*scene, bvh);
+    tracer.SetPacketMode(packets.get(), options.packet_size);
+  }
+
+  Image image(options.width, options.height);
+
+  const std::string csv_path = options.out + ".csv";
+  FILE* csv = std::fopen(csv_path.c_str(), "w");
+  if (csv == nullptr)
+    throw std::runtime_error("cannot create " + csv_path);
+  std::fprintf(csv, "frame,milliseconds,primary_rays,shadow_rays,bounce_rays,rays_per_second,"
+                    "rms_delta\n");
+
+  TraceStats total;
+  // Stage timings summed over every frame, for the wavefront engine.
+  WavefrontStats stages;
+  int frames = 0;
+  Image previous(options.width, options.height);
+
+  while (frames < options.frames) {
+    TraceStats stats;
+    if (wavefront) {
+      const WavefrontStats frame_stages = wavefront_tracer->Render(&image);
+      stats = frame_stages.trace;
+
+      for (auto member : {&WavefrontStats::generate, &WavefrontStats::extend,
+                          &WavefrontStats::shade, &WavefrontStats::compact,
+                          &WavefrontStats::connect, &WavefrontStats::resolve}) {
+        (stages.*member).seconds += (frame_stages.*member).seconds;
+        (stages.*member).items += (frame_stages.*member).items;
+        (stages.*member).slots += (frame_stages.*member).slots;
+      }
+      stages.waves = frame_stages.waves;
+
+      stages.rays_per_depth.resize(
+          std::max(stages.rays_per_depth.size(), frame_stages.rays_per_depth.size()));
+      for (size_t depth = 0; depth < frame_stages.rays_per_depth.size(); ++depth)
+        stages.rays_per_depth[depth] += frame_stages.rays_per_depth[depth];
+    } else {
+      stats = tracer.Render(&image);
+    }
+
+    double squared_delta = 0.0;
+    for (size_t i = 0; i < image.pixels.size(); ++i) {
+      const Vec3 delta = image.pixels[i] - previous.pixels[i];
+      squared_delta += Dot(delta, delta);
+    }
+    previous.pixels = image.pixels;
+
+    std::fprintf(csv, "%d,%.3f,%llu,%llu,%llu,%.0f,%.6f\n", frames, stats.seconds * 1000.0,
+                 static_cast<unsigned long long>(stats.primary_rays),
+                 static_cast<unsigned long long>(stats.shadow_rays),
+                 static_cast<unsigned long long>(stats.bounce_rays), stats.RaysPerSecond(),
+                 std::sqrt(squared_delta / (3.0 * image.pixels.size())));
+
+    total.primary_rays += stats.primary_rays;
+    total.shadow_rays += stats.shadow_rays;
+    total.bounce_rays += stats.bounce_rays;
+    total.seconds += stats.seconds;
+    ++frames;
+
+    if (options.seconds > 0.0 && total.seconds >= options.seconds)
+      break;
+  }
+
+  std::fclose(csv);
+
+  const std::string image_path = options.out + ".ppm";
+  WritePpm(image_path.c_str(), image);
+
+  std::string mode = options.engine + ", " + (bvh8 ? "avx2" : "scalar");
+  if (sampler)
+    mode += std::string(", ") + sampler->name() + " sampler";
+  if (packets)
+    mode = options.engine + ", packet " + std::to_string(options.packet_size) + "x" +
+           std::to_string(options.packet_size);
+
+  std::printf("%s: %u triangles, %dx%d, %d frames on %d threads, %s, %.3f ms/frame, "
+              "%.2f Mrays/s\n",
+              scene_path, scene->num_triangles(), options.width, options.height, frames,
+              pool.num_threads(), mode.c_str(), total.seconds * 1000.0 / frames,
+              total.RaysPerSecond() / 1e6);
+
+  if (path_tracing) {
+    const double pixels = static_cast<double>(options.width) * options.height;
+    std::printf("  path tracing, up to %d bounces: %u spp, %.2f spp/s, %.2f Mpaths/s, "
+                "%.2f rays/path\n",
+                options.bounces, wavefront_tracer->num_samples(), frames / total.seconds,
+                pixels * frames / total.seconds / 1e6,
+                (total.primary_rays + total.shadow_rays + total.bounce_rays) / (pixels * frames));
+
+    std::printf("  rays per depth ");
+    for (uint64_t rays : stages.rays_per_depth)
+      std::printf(" %.1f%%", 100.0 * rays / (pixels * frames));
+    std::printf("\n");
+  }
+
+  if (wavefront) {
+    std::printf("  %d waves of up to %d paths\n", stages.waves, options.wave_size);
+    std::printf("  %-16s %10s %7s %12s %10s\n", "stage", "ms/frame", "time", "items/frame",
+                "occupancy");
+
+    auto print_stage = [&](const char* name, const StageStats& stage) {
+      std::printf("  %-16s %10.3f %6.1f%% %12llu %9.1f%%\n", name,
+                  stage.seconds * 1000.0 / frames, 100.0 * stage.seconds / total.seconds,
+                  static_cast<unsigned long long>(stage.items / frames),
+                  100.0 * stage.Occupancy());
+    };
+    print_stage("generate", stages.generate);
+    print_stage("extend", stages.extend);
+    print_stage("shade", stages.shade);
+    print_stage("compact", stages.compact);
+    print_stage("shadow-connect", stages.connect);
+    print_stage("resolve", stages.resolve);
+  }
+
+  std::printf("wrote %s and %s\n", image_path.c_str(), csv_path.c_str());
+
+  return 0;
+}
+
+// Builds the BVH |options.frames| times, prints the statistics of the last build and checks a
+// sample of rays against the brute-force intersector.
+int RunBenchBvh(const char* scene_path, const Options& options) {
+  std::unique_ptr<Scene> scene = LoadScene(scene_path);
+  ThreadPool pool(options.threads);
+
+  std::unique_ptr<Bvh> bvh;
+  double min_seconds = 0.0;
+  for (int i = 0; i < options.frames; ++i) {
+    bvh = std::make_unique<Bvh>(*scene, &pool);
+    if (i == 0 || bvh->stats().build_seconds < min_seconds)
+      min_seconds = bvh->stats().build_seconds;
+  }
+
+  const BvhStats& stats = bvh->stats();
+  std::printf("%s: %u triangles, %d threads\n", scene_path, scene->num_triangles(),
+              pool.num_threads());
+  std::printf("  build        %.3f ms (best of %d), %.2f Mtris/s\n", min_seconds * 1000.0,
+              options.frames, scene->num_triangles() / min_seconds / 1e6);
+  std::printf("  SAH cost     %.3f\n", stats.sah_cost);
+  std::printf("  nodes        %u (%u leaves), depth %u, %.2f MiB\n", stats.num_nodes,
+              stats.num_leaves, stats.max_depth, stats.memory_bytes / (1024.0 * 1024.0));
+  std::printf("  leaf size    min %u, max %u, average %.2f\n", stats.min_leaf_size,
+              stats.max_leaf_size, stats.average_leaf_size);
+
+  // Brute force is O(triangles) per ray, so the sample shrinks with the scene.
+  const int num_rays = scene->num_triangles() <= 100000 ? 4096 : 64;
+
+  std::mt19937 rng(7);
+  std::uniform_real_distribution<float> unit(-1.f, 1.f);
+  int mismatches = 0;
+
+  for (int i = 0; i < num_rays; ++i) {
+    Ray ray;
+    ray.origin = {0.f, 1.f, 4.f};
+    ray.direction = Normalize({unit(rng) * 0.6f, unit(rng) * 0.6f, -1.f});
+    ray.t_min = 0.f;
+    ray.t_max = 10000.f;
+
+    Hit expected, actual;
+    bool expected_hit = scene->Intersect(ray, &expected);
+    bool actual_hit = bvh->Intersect(ray, &actual);
+
+    bool same_hit = expected_hit == actual_hit &&
+                    (!expected_hit ||
+                     (expected.t == actual.t && expected.triangle == actual.triangle));
+
+    if (!same_hit || scene->Occluded(ray) != bvh->Occluded(ray))
+      ++mismatches;
+  }
+
+  std::printf("  validation   %d rays, %d mismatches against brute force\n", num_rays,
+              mismatches);
+
+  return mismatches == 0 ? 0 : 1;
+}
+
+// Runs |trace|(first, end, thread_index) over |count| items split into chunks of |chunk_size|,
+// keeping the best of |repeats| runs. Returns seconds.
+double TimeChunks(ThreadPool* pool, size_t count, size_t chunk_size, int repeats,
+                  const std::function<void(size_t, size_t, int)>& trace) {
+  const int num_chunks = static_cast<int>((count + chunk_size - 1) / chunk_size);
+
+  double best_seconds = 0.0;
+  for (int i = 0; i < repeats; ++i) {
+    Stopwatch stopwatch;
+    pool->ParallelFor(num_chunks, [&](int chunk, int thread_index) {
+      const size_t first = chunk * chunk_size;
+      trace(first, std::min(first + chunk_size, count), thread_index);
+    });
+    const double seconds = stopwatch.ElapsedSeconds();
+    if (i == 0 || seconds < best_seconds)
+      best_seconds = seconds;
+  }
+  return best_seconds;
+}
+
+// One frame's primary rays grouped into square blocks, the shadow rays from their hits grouped
+// the same way, and the scalar kernel's results for both as the reference.
+struct RaySet {
+  std::vector<Ray> primary_rays;
+  // Block b covers primary_rays[primary_blocks[b], primary_blocks[b + 1]).
+  std::vector<size_t> primary_blocks;
+  std::vector<Hit> hits;
+  std::vector<uint8_t> hit_flags;
+
+  std::vector<Ray> shadow_rays;
+  std::vector<size_t> shadow_blocks;
+  std::vector<uint8_t> occluded;
+
+  size_t num_blocks() const { return primary_blocks.size() - 1; }
+};
+
+RaySet MakeRaySet(const Bvh& bvh, int width, int height, int block_size) {
+  RaySet set;
+  set.primary_rays.reserve(static_cast<size_t>(width) * height);
+
+  for (int block_y = 0; block_y < height; block_y += block_size) {
+    for (int block_x = 0; block_x < width; block_x += block_size) {
+      set.primary_blocks.push_back(set.primary_rays.size());
+      set.shadow_blocks.push_back(set.shadow_rays.size());
+
+      for (int y = block_y; y < std::min(block_y + block_size, height); ++y) {
+        for (int x = block_x; x < std::min(block_x + block_size, width); ++x) {
+          const Ray ray = MakePrimaryRay(x, y, width, height);
+          Hit hit;
+          const bool is_hit = bvh.Intersect(ray, &hit);
+
+          set.primary_rays.push_back(ray);
+          set.hits.push_back(hit);
+          set.hit_flags.push_back(is_hit);
+
+          if (is_hit) {
+            set.shadow_rays.push_back(MakeShadowRay(ray.origin + ray.direction * hit.t));
+            set.occluded.push_back(bvh.Occluded(set.shadow_rays.back()));
+          }
+        }
+      }
+    }
+  }
+
+  set.primary_blocks.push_back(set.primary_rays.size());
+  set.shadow_blocks.push_back(set.shadow_rays.size());
+  return set;
+}
+
+// Results of one traversal mode over a RaySet.
+struct ModeResult {
+  double primary_seconds = 0.0;
+  double shadow_seconds = 0.0;
+  size_t primary_mismatches = 0;
+  size_t shadow_mismatches = 0;
+};
+
+// Times |intersector| one ray at a time.
+ModeResult BenchSingleRays(ThreadPool* pool, const RaySet& set, int repeats,
+                           const RayIntersector& intersector) {
+  const size_t kChunkSize = 1024;
+
+  std::vector<Hit> hits(set.primary_rays.size());
+  std::vector<uint8_t> hit_flags(set.primary_rays.size());
+  std::vector<uint8_t> occluded(set.shadow_rays.size());
+
+  ModeResult result;
+  result.primary_seconds = TimeChunks(
+      pool, set.primary_rays.size(), kChunkSize, repeats, [&](size_t first, size_t end, int) {
+        for (size_t i = first; i < end; ++i)
+          hit_flags[i] = intersector.Intersect(set.primary_rays[i], &hits[i]);
+      });
+  result.shadow_seconds = TimeChunks(
+      pool, set.shadow_rays.size(), kChunkSize, repeats, [&](size_t first, size_t end, int) {
+        for (size_t i = first; i < end; ++i)
+          occluded[i] = intersector.Occluded(set.shadow_rays[i]);
+      });
+
+  // Kernels with a different triangle test round differently, so only the triangle is compared.
+  for (size_t i = 0; i < set.primary_rays.size(); ++i) {
+    result.primary_mismatches += hit_flags[i] != set.hit_flags[i] ||
+                                 (hit_flags[i] && hits[i].triangle != set.hits[i].triangle);
+  }
+  for (size_t i = 0; i < set.shadow_rays.size(); ++i)
+    result.shadow_mismatches += occluded[i] != set.occluded[i];
+
+  return result;
+}
+
+// Times |packets| with one packet per block of |set|. |stats| sums every repeat.
+ModeResult BenchPackets(ThreadPool* pool, const RaySet& set, int repeats,
+                        const PacketTraversal& packets, PacketStats* stats) {
+  std::vector<uint32_t> triangles(set.primary_rays.size());
+  std::vector<uint8_t> occluded(set.shadow_rays.size());
+  std::vector<PacketStats> thread_stats(pool->num_threads());
+
+  // Traces blocks [first, end) of |rays| as packets, calling |trace| on each.
+  auto trace_blocks = [&](const std::vector<Ray>& rays, const std::vector<size_t>& blocks,
+                          size_t first, size_t end,
+                          const std::function<void(const RayPacket&, size_t)>& trace) {
+    RayPacket packet;
+    for (size_t block = first; block < end; ++block) {
+      packet.num_rays = 0;
+      for (size_t i = blocks[block]; i < blocks[block + 1]; ++i)
+        packet.Add(rays[i]);
+      trace(packet, blocks[block]);
+    }
+  };
+
+  ModeResult result;
+  result.primary_seconds = TimeChunks(
+      pool, set.num_blocks(), 1, repeats, [&](size_t first, size_t end, int thread_index) {
+        trace_blocks(set.primary_rays, set.primary_blocks, first, end,
+                     [&](const RayPacket& packet, size_t offset) {
+                       PacketHits hits;
+                       packets.Intersect(packet, &hits, &thread_stats[thread_index]);
+                       std::copy(hits.triangle, hits.triangle + packet.num_rays,
+                                 triangles.begin() + offset);
+                     });
+      });
+  result.shadow_seconds = TimeChunks(
+      pool, set.num_blocks(), 1, repeats, [&](size_t first, size_t end, int thread_index) {
+        trace_blocks(set.shadow_rays, set.shadow_blocks, first, end,
+                     [&](const RayPacket& packet, size_t offset) {
+                       packets.Occluded(packet, occluded.data() + offset,
+                                        &thread_stats[thread_index]);
+                     });
+      });
+
+  for (size_t i = 0; i < set.primary_rays.size(); ++i) {
+    const uint32_t expected = set.hit_flags[i] ? set.hits[i].triangle : kInvalidTriangle;
+    result.primary_mismatches += triangles[i] != expected;
+  }
+  for (size_t i = 0; i < set.shadow_rays.size(); ++i)
+    result.shadow_mismatches += occluded[i] != set.occluded[i];
+
+  *stats = PacketStats();
+  for (const PacketStats& thread : thread_stats) {
+    stats->packets += thread.packets;
+    stats->incoherent_packets += thread.incoherent_packets;
+    stats->node_visits += thread.node_visits;
+    stats->frustum_culls += thread.frustum_culls;
+    stats->single_rays += thread.single_rays;
+  }
+  return result;
+}
+
+// Traces one frame's primary rays, then the shadow rays from their hits, in every traversal
+// mode and reports the two throughputs separately. All modes trace the same shadow rays, built
+// from the scalar kernel's hits.
+int RunBenchTraversal(const char* scene_path, const Options& options) {
+  std::unique_ptr<Scene> scene = LoadScene(scene_path);
+  ThreadPool pool(options.threads);
+  Bvh bvh(*scene, &pool);
+
+  const bool avx2 = CpuSupportsAvx2();
+
+  std::unique_ptr<Bvh8> bvh8;
+  std::unique_ptr<PacketTraversal> packets;
+  if (avx2) {
+    bvh8 = std::make_unique<Bvh8>(*scene, bvh);
+    packets = std::make_unique<PacketTraversal>(*scene, bvh);
+  }
+
+  const RaySet blocks8 = MakeRaySet(bvh, options.width, options.height, 8);
+  const RaySet blocks16 = MakeRaySet(bvh, options.width, options.height, 16);
+
+  std::printf("%s: %u triangles, %dx%d, %zu primary and %zu shadow rays, %d threads, best of %d\n",
+              scene_path, scene->num_triangles(), options.width, options.height,
+              blocks8.primary_rays.size(), blocks8.shadow_rays.size(), pool.num_threads(),
+              options.frames);
+  std::printf("  bvh2  %u nodes, %.2f MiB\n", bvh.stats().num_nodes,
+              bvh.stats().memory_bytes / (1024.0 * 1024.0));
+
+  if (bvh8) {
+    const Bvh8Stats& stats = bvh8->stats();
+    std::printf("  bvh8  %u nodes, %u leaves, depth %u, %.2f children/node, %.2f triangles/leaf, "
+                "%.2f MiB, collapsed in %.3f ms\n",
+                stats.num_nodes, stats.num_leaves, stats.max_depth, stats.average_children,
+                stats.average_leaf_triangles, stats.memory_bytes / (1024.0 * 1024.0),
+                stats.build_seconds * 1000.0);
+  } else {
+    std::printf("  avx2 and packet modes skipped: the CPU does not support AVX2\n");
+  }
+
+  std::printf("  %-14s %16s %16s %14s\n", "mode", "primary Mrays/s", "shadow Mrays/s",
+              "rays differ");
+
+  double scalar_rates[2] = {};
+
+  // Prints one row, with speedups relative to the first (scalar) row.
+  auto print_row = [&](const char* mode, const RaySet& set, const ModeResult& result) {
+    const double rates[2] = {set.primary_rays.size() / result.primary_seconds / 1e6,
+                             set.shadow_rays.size() / result.shadow_seconds / 1e6};
+    if (scalar_rates[0] == 0.0) {
+      scalar_rates[0] = rates[0];
+      scalar_rates[1] = rates[1];
+    }
+    std::printf("  %-14s %8.2f (%5.2fx) %8.2f (%5.2fx) %6zu / %-6zu\n", mode, rates[0],
+                rates[0] / scalar_rates[0], rates[1], rates[1] / scalar_rates[1],
+                result.primary_mismatches, result.shadow_mismatches);
+  };
+
+  print_row("scalar", blocks8, BenchSingleRays(&pool, blocks8, options.frames, bvh));
+  if (!avx2)
+    return 0;
+
+  print_row("avx2", blocks8, BenchSingleRays(&pool, blocks8, options.frames, *bvh8));
+
+  PacketStats stats8, stats16;
+  print_row("packet 8x8", blocks8,
+            BenchPackets(&pool, blocks8, options.frames, *packets, &stats8));
+  print_row("packet 16x16", blocks16,
+            BenchPackets(&pool, blocks16, options.frames, *packets, &stats16));
+
+  // Ratios over both ray types and every repeat.
+  auto print_packet_stats = [&](const char* mode, const RaySet& set, const PacketStats& stats) {
+    const double rays = static_cast<double>(set.primary_rays.size() + set.shadow_rays.size()) *
+                        options.frames;
+    const double packets = static_cast<double>(std::max<uint64_t>(stats.packets, 1));
+    std::printf("  %-14s %.1f%% of packets incoherent, %.1f node visits/packet, %.1f%% of "
+                "visits frustum culled, %.3f single-ray handoffs/ray\n",
+                mode, 100.0 * stats.incoherent_packets / packets, stats.node_visits / packets,
+                100.0 * stats.frustum_culls / std::max<uint64_t>(stats.node_visits, 1),
+                stats.single_rays / rays);
+  };
+  print_packet_stats("packet 8x8", blocks8, stats8);
+  print_packet_stats("packet 16x16", blocks16, stats16);
+
+  return 0;
+}
+
+// Root-mean-square difference of |image| and |reference| over every channel. With
+// |box_radius| > 0, the difference is box-filtered first, which measures the error left after a
+// small blur: noise at high spatial frequencies, like blue noise's, mostly disappears.
+double Rmse(const Image& image, const Image& reference, int box_radius) {
+  double sum = 0.0;
+  for (int y = 0; y < image.height; ++y) {
+    for (int x = 0; x < image.width; ++x) {
+      Vec3 error = {0.f, 0.f, 0.f};
+      int count = 0;
+      for (int dy = -box_radius; dy <= box_radius; ++dy) {
+        for (int dx = -box_radius; dx <= box_radius; ++dx) {
+          const int sx = std::min(std::max(x + dx, 0), image.width - 1);
+          const int sy = std::min(std::max(y + dy, 0), image.height - 1);
+          error += image.at(sx, sy) - reference.at(sx, sy);
+          ++count;
+        }
+      }
+      error = error / static_cast<float>(count);
+      sum += Dot(error, error);
+    }
+  }
+  return std::sqrt(sum / (3.0 * image.pixels.size()));
+}
+
+// Path traces the scene with every sampler and reports the RMSE against a reference at each
+// power-of-two sample count up to --spp, with one line per measurement in <out>.csv. The reference
+// uses independent numbers with a seed no sampler uses, so its error does not correlate with
+// theirs. The slope is that of log RMSE against log spp: -0.5 for plain Monte Carlo, steeper when
+// the samples are well stratified.
+int RunBenchSamplers(const char* scene_path, const Options& options) {
+  constexpr uint32_t kReferenceSeed = 0x5eed;
+  const char* const kSamplers[] = {"random", "sobol", "lattice", "bluenoise"};
+
+  std::unique_ptr<Scene> scene = LoadScene(scene_path);
+  ThreadPool pool(options.threads);
+  Bvh bvh(*scene, &pool);
+
+  std::unique_ptr<Bvh8> bvh8;
+  const RayIntersector& intersector = SelectKernel(options, *scene, bvh, &bvh8);
+
+  WavefrontTracer tracer(*scene, intersector, &pool, options.wave_size);
+  PathTracingOptions path_options;
+  path_options.max_bounces = options.bounces;
+  tracer.SetPathTracing(&path_options);
+
+  Image reference(options.width, options.height);
+  RandomSampler reference_sampler(kReferenceSeed);
+  tracer.SetSampler(&reference_sampler);
+
+  double reference_seconds = 0.0;
+  for (int i = 0; i < options.reference_spp; ++i)
+    reference_seconds += tracer.Render(&reference).trace.seconds;
+
+  std::printf("%s: %u triangles, %dx%d, up to %d bounces, %d threads, reference %d spp in "
+              "%.1f s\n",
+              scene_path, scene->num_triangles(), options.width, options.height, options.bounces,
+              pool.num_threads(), options.reference_spp, reference_seconds);
+
+  const std::string csv_path = options.out + ".csv";
+  FILE* csv = std::fopen(csv_path.c_str(), "w");
+  if (csv == nullptr)
+    throw std::runtime_error("cannot create " + csv_path);
+  std::fprintf(csv, "sampler,spp,rmse,blurred_rmse,milliseconds\n");
+
+  std::vector<int> sample_counts;
+  for (int spp = 1; spp <= options.spp; spp *= 2)
+    sample_counts.push_back(spp);
+
+  std::printf("  RMSE, then RMSE after a 3x3 blur\n");
+  std::printf("  %-10s", "sampler");
+  for (int spp : sample_counts)
+    std::printf(" %9d", spp);
+  std::printf(" %7s %9s\n", "slope", "ms/spp");
+
+  for (const char* name : kSamplers) {
+    Stopwatch setup;
+    const std::unique_ptr<Sampler> sampler = MakeSampler(name);
+    const double setup_seconds = setup.ElapsedSeconds();
+    tracer.SetSampler(sampler.get());
+
+    Image image(options.width, options.height);
+    std::vector<double> rmse, blurred_rmse;
+    double seconds = 0.0;
+
+    for (int spp = 1; spp <= sample_counts.back(); ++spp) {
+      seconds += tracer.Render(&image).trace.seconds;
+      if ((spp & (spp - 1)) != 0)
+        continue;
+
+      rmse.push_back(Rmse(image, reference, 0));
+      blurred_rmse.push_back(Rmse(image, reference, 1));
+      std::fprintf(csv, "%s,%d,%.6f,%.6f,%.3f\n", name, spp, rmse.back(), blurred_rmse.back(),
+                   seconds * 1000.0);
+    }
+
+    // Least-squares fit of log RMSE against log spp.
+    auto slope = [&](const std::vector<double>& errors) {
+      if (errors.size() < 2)
+        return 0.0;
+      double sum_x = 0.0, sum_y = 0.0, sum_xx = 0.0, sum_xy = 0.0;
+      for (size_t i = 0; i < errors.size(); ++i) {
+        const double x = std::log(static_cast<double>(sample_counts[i]));
+        const double y = std::log(errors[i]);
+        sum_x += x;
+        sum_y += y;
+        sum_xx += x * x;
+        sum_xy += x * y;
+      }
+      const double n = static_cast<double>(errors.size());
+      return (n * sum_xy - sum_x * sum_y) / (n * sum_xx - sum_x * sum_x);
+    };
+
+    std::printf("  %-10s", name);
+    for (double error : rmse)
+      std::printf(" %9.5f", error);
+    std::printf(" %7.3f %9.2f\n", slope(rmse), seconds * 1000.0 / sample_counts.back());
+
+    std::printf("  %-10s", "");
+    for (double error : blurred_rmse)
+      std::printf(" %9.5f", error);
+    std::printf(" %7.3f", slope(blurred_rmse));
+    if (setup_seconds >= 0.001)
+      std::printf("  (%.0f ms to set up)", setup_seconds * 1000.0);
+    std::printf("\n");
+  }
+
+  std::fclose(csv);
+  std::printf("wrote %s\n", csv_path.c_str());
+
+  return 0;
+}
+
+// Whether |options.kernel| picks the AVX2 tile kernel of the rasterizer.
+bool SelectRasterKernel(const Options& options) {
+  if (options.kernel.empty())
+    return CpuSupportsAvx2();
+  if (options.kernel == "scalar")
+    return false;
+  if (options.kernel != "avx2")
+    throw std::runtime_error("unknown kernel " + options.kernel);
+  if (!CpuSupportsAvx2())
+    throw std::runtime_error("the avx2 kernel needs a CPU with AVX2");
+  return true;
+}
+
+// Renders |frames| frames with |rasterizer|, returning the stats of the fastest.
+RasterStats TimeRaster(GbufferRasterizer* rasterizer, const DeferredScene& scene, int frames,
+                       Gbuffer* gbuffer) {
+  const DeferredConstants constants = MakeDeferredConstants(gbuffer->width, gbuffer->height);
+
+  RasterStats best;
+  for (int i = 0; i < frames; ++i) {
+    RasterStats stats = rasterizer->Render(scene, constants, gbuffer);
+    if (i == 0 || stats.TotalSeconds() < best.TotalSeconds())
+      best = stats;
+  }
+  return best;
+}
+
+Vec3 UnpackUnorm(uint32_t texel) {
+  return Vec3{static_cast<float>(texel & 0xff), static_cast<float>((texel >> 8) & 0xff),
+              static_cast<float>((texel >> 16) & 0xff)} /
+         255.f;
+}
+
+// Writes each target of |gbuffer| as <prefix>_<target>.ppm. View-space positions are scaled by
+// 1/4 around the camera, normals mapped from [-1, 1] and depth stretched over the range covered.
+void WriteGbuffer(const std::string& prefix, const Gbuffer& gbuffer) {
+  Image image(gbuffer.width, gbuffer.height);
+  const size_t num_pixels = image.pixels.size();
+
+  for (size_t i = 0; i < num_pixels; ++i)
+    image.pixels[i] = UnpackUnorm(gbuffer.ambient[i]);
+  WritePpm((prefix + "_ambient.ppm").c_str(), image);
+
+  for (size_t i = 0; i < num_pixels; ++i)
+    image.pixels[i] = UnpackUnorm(gbuffer.diffuse[i]);
+  WritePpm((prefix + "_diffuse.ppm").c_str(), image);
+
+  for (size_t i = 0; i < num_pixels; ++i)
+    image.pixels[i] = gbuffer.position[i].xyz() * 0.25f + Vec3{0.5f, 0.5f, 0.5f};
+  WritePpm((prefix + "_position.ppm").c_str(), image);
+
+  for (size_t i = 0; i < num_pixels; ++i)
+    image.pixels[i] = gbuffer.normal[i].xyz() * 0.5f + Vec3{0.5f, 0.5f, 0.5f};
+  WritePpm((prefix + "_normal.ppm").c_str(), image);
+
+  float min_depth = 1.f;
+  for (float depth : gbuffer.depth)
+    min_depth = std::min(min_depth, depth);
+  const float scale = min_depth < 1.f ? 1.f / (1.f - min_depth) : 0.f;
+  for (size_t i = 0; i < num_pixels; ++i) {
+    const float value = (1.f - gbuffer.depth[i]) * scale;
+    image.pixels[i] = {value, value, value};
+  }
+  WritePpm((prefix + "_depth.ppm").c_str(), image);
+}
+
+void PrintRasterStages(const RasterStats& stats) {
+  const double total = stats.TotalSeconds();
+  const struct {
+    const char* name;
+    double seconds;
+  } stages[] = {
+      {"vertex", stats.vertex_seconds},
+      {"setup+bin", stats.setup_seconds},
+      {"raster", stats.raster_seconds},
+      {"resolve", stats.resolve_seconds},
+  };
+  for (const auto& stage : stages) {
+    std::printf("  %-12s %8.3f ms %6.1f%%\n", stage.name, stage.seconds * 1000.0,
+                total > 0.0 ? stage.seconds / total * 100.0 : 0.0);
+  }
+}
+
+// Rasterizes the G-buffer |options.frames| times and writes the fastest frame's targets.
+int RunRaster(const char* scene_path, const Options& options) {
+  std::unique_ptr<DeferredScene> scene = LoadDeferredScene(scene_path);
+  ThreadPool pool(options.threads);
+  const bool use_avx2 = SelectRasterKernel(options);
+  GbufferRasterizer rasterizer(&pool, use_avx2);
+
+  Gbuffer gbuffer;
+  gbuffer.Resize(options.width, options.height);
+  const RasterStats stats = TimeRaster(&rasterizer, *scene, options.frames, &gbuffer);
+  WriteGbuffer(options.out, gbuffer);
+
+  std::printf("%s: %u triangles in %zu draws, %dx%d, %d threads, %s kernel\n", scene_path,
+              scene->num_triangles(), scene->draw_call_args().size(), options.width,
+              options.height, pool.num_threads(), use_avx2 ? "avx2" : "scalar");
+  std::printf("  frame        %.3f ms (best of %d), %.2f Mtris/s\n", stats.TotalSeconds() * 1000.0,
+              options.frames, stats.triangles / stats.TotalSeconds() / 1e6);
+  std::printf("  rasterized   %llu triangles after clipping and culling, %.2f tiles each\n",
+              static_cast<unsigned long long>(stats.rasterized),
+              stats.rasterized > 0 ? static_cast<double>(stats.bin_entries) / stats.rasterized
+                                   : 0.0);
+  PrintRasterStages(stats);
+  std::printf("  wrote %s_{ambient,position,diffuse,normal,depth}.ppm\n", options.out.c_str());
+  return 0;
+}
+
+// Times the rasterizer at the apps' window size and at 4K with each tile kernel the CPU supports.
+int RunBenchRaster(const char* scene_path, const Options& options) {
+  std::unique_ptr<DeferredScene> scene = LoadDeferredScene(scene_path);
+  ThreadPool pool(options.threads);
+
+  std::printf("%s: %u triangles in %zu draws, %d threads, best of %d frames\n", scene_path,
+              scene->num_triangles(), scene->draw_call_args().size(), pool.num_threads(),
+              options.frames);
+  std::printf("  %-10s %-7s %9s %9s %9s %9s %9s %10s\n", "size", "kernel", "ms/frame", "vertex",
+              "setup", "raster", "resolve", "Mtris/s");
+
+  const int sizes[][2] = {{kDefaultWidth, kDefaultHeight}, {3840, 2160}};
+  for (const auto& size : sizes) {
+    Gbuffer gbuffer;
+    gbuffer.Resize(size[0], size[1]);
+
+    for (int avx2 = 0; avx2 < 2; ++avx2) {
+      if (avx2 && !CpuSupportsAvx2()) {
+        std::printf("  avx2 kernel skipped: the CPU does not support AVX2\n");
+        continue;
+      }
+
+      GbufferRasterizer rasterizer(&pool, avx2 != 0);
+      // One untimed frame sizes the buffers.
+      TimeRaster(&rasterizer, *scene, 1, &gbuffer);
+      const RasterStats stats = TimeRaster(&rasterizer, *scene, options.frames, &gbuffer);
+
+      const std::string label = std::to_string(size[0]) + "x" + std::to_string(size[1]);
+      std::printf("  %-10s %-7s %9.3f %9.3f %9.3f %9.3f %9.3f %10.2f\n", label.c_str(),
+                  avx2 ? "avx2" : "scalar", stats.TotalSeconds() * 1000.0,
+                  stats.vertex_seconds * 1000.0, stats.setup_seconds * 1000.0,
+                  stats.raster_seconds * 1000.0, stats.resolve_seconds * 1000.0,
+                  stats.triangles / stats.TotalSeconds() / 1e6);
+    }
+  }
+  return 0;
+}
+
+// Renders the shadow cubemap |frames| times with |renderer|, returning the stats of the fastest.
+ShadowStats TimeShadow(ShadowRenderer* renderer, const DeferredScene& scene,
+                       const DeferredConstants& constants, ShadowSubmission submission,
+                       int frames, ShadowCubemap* cubemap) {
+  ShadowStats best;
+  for (int i = 0; i < frames; ++i) {
+    ShadowStats stats = renderer->Render(scene, constants, submission, cubemap);
+    if (i == 0 || stats.TotalSeconds() < best.TotalSeconds())
+      best = stats;
+  }
+  return best;
+}
+
+// Writes the faces of |cubemap| side by side, in face order, with depth stretched over the range
+// covered.
+void WriteShadowCubemap(const std::string& path, const ShadowCubemap& cubemap) {
+  const int size = cubemap.size;
+  Image image(size * 6, size);
+
+  float min_depth = 1.f;
+  for (float depth : cubemap.depth)
+    min_depth = std::min(min_depth, depth);
+  const float scale = min_depth < 1.f ? 1.f / (1.f - min_depth) : 0.f;
+
+  for (int face = 0; face < 6; ++face) {
+    const float* depth = cubemap.face(face);
+    for (int y = 0; y < size; ++y) {
+      for (int x = 0; x < size; ++x) {
+        const float value = (1.f - depth[static_cast<size_t>(y) * size + x]) * scale;
+        image.pixels[static_cast<size_t>(y) * image.width + face * size + x] = {value, value,
+                                                                               value};
+      }
+    }
+  }
+  WritePpm(path.c_str(), image);
+}
+
+// Frames the shadow command records for each submission.
+constexpr int kShadowRecordingFrames = 100;
+
+// Records the shadow pass's draws the way |submission| submits them, with CommandRecorder
+// standing in for the command lists: ShadowPass::RenderFace() for each face, skipping the draws
+// whose |face_masks| bit for it is clear, or ShadowPass::RenderFrame() once. Returns the
+// microseconds per frame.
+double TimeShadowRecording(const DeferredScene& scene, const std::vector<uint32_t>& face_masks,
+                           ShadowSubmission submission, CommandRecorder* recorder) {
+  const uint64_t kConstantsAddress = uint64_t(1) << 40;
+  const std::vector<DrawCallArgs>& args = scene.draw_call_args();
+  std::vector<SubmittedDraw> draws(args.size());
+  for (size_t i = 0; i < args.size(); ++i) {
+    const uint64_t address = (uint64_t(1) << 32) + uint64_t(i) * 65536;
+    draws[i] = {address, 32768, address + 32768, 32768, args[i].index_count, args[i].start_index,
+                args[i].vertex_offset, args[i].material_index};
+  }
+
+  Stopwatch stopwatch;
+  for (int frame = 0; frame < kShadowRecordingFrames; ++frame) {
+    recorder->Reset();
+    if (submission == ShadowSubmission::kSinglePass) {
+      recorder->SetRootConstantBufferView(0, kConstantsAddress);
+      for (size_t i = 0; i < draws.size(); ++i) {
+        const int num_faces = CountShadowFaces(face_masks[i]);
+        if (num_faces == 0)
+          continue;
+        const uint32_t faces = PackShadowFaces(face_masks[i]);
+        recorder->SetRoot32BitConstants(1, 1, &faces);
+        recorder->DrawInstanced(draws[i], num_faces);
+      }
+      continue;
+    }
+
+    for (uint32_t face = 0; face < kNumShadowFaces; ++face) {
+      recorder->SetRootConstantBufferView(0, kConstantsAddress);
+      recorder->SetRoot32BitConstants(1, 1, &face);
+      for (size_t i = 0; i < draws.size(); ++i) {
+        if (face_masks[i] & (1u << face))
+          recorder->Draw(draws[i]);
+      }
+    }
+  }
+  return stopwatch.ElapsedSeconds() * 1e6 / kShadowRecordingFrames;
+}
+
+// Renders the shadow cubemap with each ShadowSubmission: every draw once per face as the app did,
+// once per face it reaches, and instanced once per face it reaches in a single pass. Prints what
+// each submits, the time to record it and the work per face, and writes <out>_shadow.ppm. Neither
+// culling nor instancing may change a single texel.
+int RunShadow(const char* scene_path, const Options& options) {
+  std::unique_ptr<DeferredScene> scene = LoadDeferredScene(scene_path);
+  ThreadPool pool(options.threads);
+  const bool use_avx2 = SelectRasterKernel(options);
+  ShadowRenderer renderer(&pool, use_avx2);
+  const DeferredConstants constants = MakeDeferredConstants(options.width, options.height);
+
+  std::printf("%s: %u triangles in %zu draws, %dx%d faces, %d threads, %s kernel, best of %d "
+              "frames\n",
+              scene_path, scene->num_triangles(), scene->draw_call_args().size(), kShadowMapSize,
+              kShadowMapSize, pool.num_threads(), use_avx2 ? "avx2" : "scalar", options.frames);
+
+  ShadowCubemap per_face;
+  per_face.Resize(kShadowMapSize);
+  ShadowCubemap culled;
+  culled.Resize(kShadowMapSize);
+  ShadowCubemap single_pass;
+  single_pass.Resize(kShadowMapSize);
+  const struct {
+    const char* name;
+    ShadowSubmission submission;
+    ShadowCubemap* cubemap;
+  } modes[] = {{"per face", ShadowSubmission::kPerFace, &per_face},
+               {"per face, culled", ShadowSubmission::kPerFaceCulled, &culled},
+               {"single pass", ShadowSubmission::kSinglePass, &single_pass}};
+
+  CommandRecorder recorder;
+  for (const auto& mode : modes) {
+    const ShadowStats stats =
+        TimeShadow(&renderer, *scene, constants, mode.submission, options.frames, mode.cubemap);
+    const double record_us =
+        TimeShadowRecording(*scene, renderer.face_masks(), mode.submission, &recorder);
+
+    std::printf("  %s: %llu draw calls, %llu instances, %llu vertex invocations, %.1f us and "
+                "%zu KiB to record\n",
+                mode.name, static_cast<unsigned long long>(stats.draw_calls),
+                static_cast<unsigned long long>(stats.instances),
+                static_cast<unsigned long long>(stats.vertex_invocations), record_us,
+                recorder.size() / 1024);
+    std::printf("    %.3f ms (cull %.3f, vertex %.3f, setup+bin %.3f, raster %.3f)\n",
+                stats.TotalSeconds() * 1000.0, stats.cull_seconds * 1000.0,
+                stats.vertex_seconds * 1000.0, stats.setup_seconds * 1000.0,
+                stats.raster_seconds * 1000.0);
+    std::printf("    %-5s %6s %7s %10s %11s %9s %9s\n", "face", "draws", "culled", "triangles",
+                "rasterized", "setup ms", "raster ms");
+
+    ShadowFaceStats total;
+    const char* face_names[] = {"+x", "-x", "+y", "-y", "+z", "-z"};
+    for (int face = 0; face < 6; ++face) {
+      const ShadowFaceStats& face_stats = stats.faces[face];
+      std::printf("    %-5s %6u %7u %10llu %11llu %9.3f %9.3f\n", face_names[face],
+                  face_stats.draws, face_stats.culled_draws,
+                  static_cast<unsigned long long>(face_stats.triangles),
+                  static_cast<unsigned long long>(face_stats.rasterized),
+                  face_stats.setup_seconds * 1000.0, face_stats.raster_seconds * 1000.0);
+      total.draws += face_stats.draws;
+      total.culled_draws += face_stats.culled_draws;
+      total.triangles += face_stats.triangles;
+      total.rasterized += face_stats.rasterized;
+      total.setup_seconds += face_stats.setup_seconds;
+      total.raster_seconds += face_stats.raster_seconds;
+    }
+    std::printf("    %-5s %6u %7u %10llu %11llu %9.3f %9.3f\n", "all", total.draws,
+                total.culled_draws, static_cast<unsigned long long>(total.triangles),
+                static_cast<unsigned long long>(total.rasterized), total.setup_seconds * 1000.0,
+                total.raster_seconds * 1000.0);
+  }
+
+  size_t culled_mismatches = 0;
+  size_t single_pass_mismatches = 0;
+  for (size_t i = 0; i < per_face.depth.size(); ++i) {
+    culled_mismatches += culled.depth[i] != per_face.depth[i];
+    single_pass_mismatches += single_pass.depth[i] != per_face.depth[i];
+  }
+  std::printf("  culled and single-pass cubemaps differ from per-face in %zu and %zu texels\n",
+              culled_mismatches, single_pass_mismatches);
+
+  WriteShadowCubemap(options.out + "_shadow.ppm", single_pass);
+  std::printf("  wrote %s_shadow.ppm\n", options.out.c_str());
+  return culled_mismatches == 0 && single_pass_mismatches == 0 ? 0 : 1;
+}
+
+// Lighting kernel named by |options.kernel|, by default the fastest the CPU supports.
+LightingKernel SelectLightingKernel(const Options& options) {
+  if (options.kernel.empty())
+    return CpuSupportsAvx2() ? LightingKernel::kAvx2 : LightingKernel::kSse2;
+  if (options.kernel == "scalar")
+    return LightingKernel::kScalar;
+  if (options.kernel == "sse2")
+    return LightingKernel::kSse2;
+  if (options.kernel != "avx2")
+    throw std::runtime_error("unknown kernel " + options.kernel);
+  if (!CpuSupportsAvx2())
+    throw std::runtime_error("the avx2 kernel needs a CPU with AVX2");
+  return LightingKernel::kAvx2;
+}
+
+// Lights |gbuffer| |frames| times and returns the fastest time in seconds.
+double TimeLighting(const Gbuffer& gbuffer, const ShadowCubemap& shadow, const Vec4& light,
+                    LightingKernel kernel, int frames, ThreadPool* pool,
+                    std::vector<uint32_t>* output) {
+  double best = 0.0;
+  for (int i = 0; i < frames; ++i) {
+    Stopwatch stopwatch;
+    ShadeLighting(gbuffer, shadow, light, kernel, pool, output);
+    const double seconds = stopwatch.ElapsedSeconds();
+    if (i == 0 || seconds < best)
+      best = seconds;
+  }
+  return best;
+}
+
+size_t CountMismatches(const std::vector<uint32_t>& a, const std::vector<uint32_t>& b) {
+  size_t mismatches = 0;
+  for (size_t i = 0; i < a.size(); ++i)
+    mismatches += a[i] != b[i];
+  return mismatches;
+}
+
+// GPU-free DeferredShading frame: rasterizes the G-buffer and the shadow cubemap, lights the frame
+// with the kernel from |options.kernel| and writes <out>_lit.ppm. Then times every lighting kernel
+// against the scalar one, with the cubemap the frame used and with one full of noise, which sends
+// pixels down both sides of the shadow test and through every face.
+int RunDeferred(const char* scene_path, const Options& options) {
+  std::unique_ptr<DeferredScene> scene = LoadDeferredScene(scene_path);
+  ThreadPool pool(options.threads);
+  const LightingKernel kernel = SelectLightingKernel(options);
+
+  Gbuffer gbuffer;
+  gbuffer.Resize(options.width, options.height);
+  GbufferRasterizer rasterizer(&pool, CpuSupportsAvx2());
+  const RasterStats raster_stats = TimeRaster(&rasterizer, *scene, options.frames, &gbuffer);
+  const DeferredConstants constants = MakeDeferredConstants(options.width, options.height);
+
+  ShadowCubemap shadow;
+  shadow.Resize(kShadowMapSize);
+  ShadowRenderer shadow_renderer(&pool, CpuSupportsAvx2());
+  const ShadowStats shadow_stats =
+      TimeShadow(&shadow_renderer, *scene, constants, ShadowSubmission::kSinglePass,
+                 options.frames, &shadow);
+
+  std::vector<uint32_t> lit;
+  const double lighting_seconds = TimeLighting(gbuffer, shadow, constants.light_view_pos, kernel,
+                                               options.frames, &pool, &lit);
+
+  Image image(gbuffer.width, gbuffer.height);
+  for (size_t i = 0; i < lit.size(); ++i)
+    image.pixels[i] = UnpackUnorm(lit[i]);
+  WritePpm((options.out + "_lit.ppm").c_str(), image);
+
+  std::printf("%s: %u triangles, %dx%d, %d threads, best of %d frames\n", scene_path,
+              scene->num_triangles(), options.width, options.height, pool.num_threads(),
+              options.frames);
+  std::printf("  geometry     %.3f ms\n", raster_stats.TotalSeconds() * 1000.0);
+  std::printf("  shadow       %.3f ms\n", shadow_stats.TotalSeconds() * 1000.0);
+  std::printf("  lighting     %.3f ms\n", lighting_seconds * 1000.0);
+  std::printf("  wrote %s_lit.ppm\n", options.out.c_str());
+
+  ShadowCubemap noise;
+  noise.Resize(kShadowMapSize);
+  std::mt19937 rng(3);
+  std::uniform_real_distribution<float> unit(0.f, 1.f);
+  for (float& depth : noise.depth)
+    depth = unit(rng);
+
+  const double num_pixels = static_cast<double>(gbuffer.width) * gbuffer.height;
+  const struct {
+    const char* name;
+    const ShadowCubemap* shadow;
+  } cubemaps[] = {{"shadow", &shadow}, {"noise", &noise}};
+  const struct {
+    const char* name;
+    LightingKernel kernel;
+  } kernels[] = {{"scalar", LightingKernel::kScalar},
+                 {"sse2", LightingKernel::kSse2},
+                 {"avx2", LightingKernel::kAvx2}};
+
+  std::printf("  %-8s %-7s %9s %10s %8s %11s\n", "cubemap", "kernel", "ms", "Mpixels/s",
+              "speedup", "mismatches");
+  size_t total_mismatches = 0;
+  for (const auto& cubemap : cubemaps) {
+    std::vector<uint32_t> expected;
+    const double scalar_seconds =
+        TimeLighting(gbuffer, *cubemap.shadow, constants.light_view_pos, LightingKernel::kScalar,
+                     options.frames, &pool, &expected);
+
+    for (const auto& entry : kernels) {
+      if (entry.kernel == LightingKernel::kAvx2 && !CpuSupportsAvx2()) {
+        std::printf("  avx2 kernel skipped: the CPU does not support AVX2\n");
+        continue;
+      }
+
+      std::vector<uint32_t> actual;
+      const double seconds =
+          entry.kernel == LightingKernel::kScalar
+              ? scalar_seconds
+              : TimeLighting(gbuffer, *cubemap.shadow, constants.light_view_pos, entry.kernel,
+                             options.frames, &pool, &actual);
+      const size_t mismatches =
+          entry.kernel == LightingKernel::kScalar ? 0 : CountMismatches(expected, actual);
+      total_mismatches += mismatches;
+
+      std::printf("  %-8s %-7s %9.3f %10.1f %7.2fx %11zu\n", cubemap.name, entry.name,
+                  seconds * 1000.0, num_pixels / seconds / 1e6, scalar_seconds / seconds,
+                  mismatches);
+    }
+  }
+
+  return total_mismatches == 0 ? 0 : 1;
+}
+
+// Builds the cluster lists |frames| times and returns the fastest time in seconds.
+double TimeClusterBuild(const ClusterConstants& constants, const std::vector<PointLight>& lights,
+                        bool brute_force, int frames, ThreadPool* pool, LightClusterGrid* grid) {
+  double best = 0.0;
+  for (int i = 0; i < frames; ++i) {
+    Stopwatch stopwatch;
+    if (brute_force)
+      BuildLightClustersBruteForce(constants, lights.data(), grid);
+    else
+      BuildLightClusters(constants, lights, pool, grid);
+    const double seconds = stopwatch.ElapsedSeconds();
+    if (i == 0 || seconds < best)
+      best = seconds;
+  }
+  return best;
+}
+
+// Shades the point lights |frames| times and returns the fastest time in seconds.
+double TimePointLights(const Gbuffer& gbuffer, const ClusterConstants& constants,
+                       const std::vector<PointLight>& lights, const LightClusterGrid* grid,
+                       int frames, ThreadPool* pool, std::vector<Vec3>* output,
+                       uint64_t* light_visits) {
+  double best = 0.0;
+  for (int i = 0; i < frames; ++i) {
+    Stopwatch stopwatch;
+    *light_visits = ShadePointLights(gbuffer, constants, lights, grid, pool, output);
+    const double seconds = stopwatch.ElapsedSeconds();
+    if (i == 0 || seconds < best)
+      best = seconds;
+  }
+  return best;
+}
+
+// Clustered lighting without a GPU: scatters |options.lights| point lights through the scene,
+// builds the cluster lists slice by slice and checks them against cluster_build_cs.hlsl's brute
+// force, then lights the G-buffer through the lists and through every light. The two must give
+// identical pixels, and no light may reach a pixel without being in its cluster's list. Writes
+// <out>_clusters.ppm, the lights listed for each pixel, and <out>_point_lights.ppm.
+int RunClusters(const char* scene_path, const Options& options) {
+  std::unique_ptr<DeferredScene> scene = LoadDeferredScene(scene_path);
+  ThreadPool pool(options.threads);
+
+  Gbuffer gbuffer;
+  gbuffer.Resize(options.width, options.height);
+  GbufferRasterizer rasterizer(&pool, CpuSupportsAvx2());
+  TimeRaster(&rasterizer, *scene, 1, &gbuffer);
+
+  const DeferredConstants constants = MakeDeferredConstants(options.width, options.height);
+  std::vector<PointLight> lights = MakeRandomPointLights(options.lights, 1);
+  for (PointLight& light : lights) {
+    const Vec4 world_pos = {light.view_pos[0], light.view_pos[1], light.view_pos[2], 1.f};
+    const Vec4 view_pos = MulConstant(world_pos, constants.world_view_mat);
+    for (int axis = 0; axis < 3; ++axis)
+      light.view_pos[axis] = view_pos[axis];
+  }
+  const ClusterConstants cluster_constants =
+      MakeClusterConstants(options.width, options.height, kCameraFovY, options.lights);
+
+  std::printf("%s: %d point lights, %ux%ux%u clusters, %dx%d, %d threads, best of %d frames\n",
+              scene_path, options.lights, kClusterGridX, kClusterGridY, kClusterGridZ,
+              options.width, options.height, pool.num_threads(), options.frames);
+
+  LightClusterGrid grid;
+  const double build_seconds =
+      TimeClusterBuild(cluster_constants, lights, false, options.frames, &pool, &grid);
+  LightClusterGrid brute_force;
+  brute_force.Resize();
+  const double brute_force_seconds =
+      TimeClusterBuild(cluster_constants, lights, true, options.frames, &pool, &brute_force);
+
+  size_t list_mismatches = grid.overflowed != brute_force.overflowed;
+  uint64_t listed = 0;
+  uint32_t max_listed = 0;
+  uint32_t empty_clusters = 0;
+  for (uint32_t cluster = 0; cluster < kNumClusters; ++cluster) {
+    const uint32_t count = grid.counts[cluster];
+    const size_t first = static_cast<size_t>(cluster) * kMaxLightsPerCluster;
+    list_mismatches += count != brute_force.counts[cluster] ||
+                       !std::equal(&grid.indices[first], &grid.indices[first] + count,
+                                   &brute_force.indices[first]);
+    listed += count;
+    max_listed = std::max(max_listed, count);
+    empty_clusters += count == 0;
+  }
+
+  std::printf("  build        %.3f ms by slice, %.3f ms brute force, %zu lists differ\n",
+              build_seconds * 1000.0, brute_force_seconds * 1000.0, list_mismatches);
+  std::printf("  lists        %.1f lights on average, %u at most, %u of %u empty, %u overflowed\n",
+              static_cast<double>(listed) / kNumClusters, max_listed, empty_clusters,
+              kNumClusters, grid.overflowed);
+
+  std::vector<Vec3> clustered;
+  uint64_t clustered_visits = 0;
+  const double clustered_seconds =
+      TimePointLights(gbuffer, cluster_constants, lights, &grid, options.frames, &pool,
+                      &clustered, &clustered_visits);
+  std::vector<Vec3> all_lights;
+  uint64_t all_visits = 0;
+  const double all_seconds = TimePointLights(gbuffer, cluster_constants, lights, nullptr,
+                                             options.frames, &pool, &all_lights, &all_visits);
+
+  size_t covered = 0;
+  for (const Vec4& normal : gbuffer.normal)
+    covered += normal.w == 0.f;
+  size_t pixel_mismatches = 0;
+  for (size_t i = 0; i < clustered.size(); ++i) {
+    for (int channel = 0; channel < 3; ++channel)
+      pixel_mismatches += clustered[i][channel] != all_lights[i][channel];
+  }
+  const uint64_t missed = CountMissedLights(gbuffer, cluster_constants, lights, grid, &pool);
+
+  std::printf("  %-12s %9s %14s\n", "shading", "ms", "lights/pixel");
+  std::printf("  %-12s %9.3f %14.1f\n", "clustered", clustered_seconds * 1000.0,
+              covered > 0 ? static_cast<double>(clustered_visits) / covered : 0.0);
+  std::printf("  %-12s %9.3f %14.1f\n", "all lights", all_seconds * 1000.0,
+              covered > 0 ? static_cast<double>(all_visits) / covered : 0.0);
+  std::printf("  speedup %.2fx, %zu channels differ, %llu pixel lights missed\n",
+              all_seconds / clustered_seconds, pixel_mismatches,
+              static_cast<unsigned long long>(missed));
+
+  Image image(gbuffer.width, gbuffer.height);
+  for (int y = 0; y < gbuffer.height; ++y) {
+    for (int x = 0; x < gbuffer.width; ++x) {
+      const size_t pixel = static_cast<size_t>(y) * gbuffer.width + x;
+      const uint32_t cluster =
+          ClusterOfPixel(cluster_constants, x + 0.5f, y + 0.5f, gbuffer.position[pixel].z);
+      const float value = gbuffer.normal[pixel].w == 0.f && max_listed > 0
+                              ? static_cast<float>(grid.counts[cluster]) / max_listed
+                              : 0.f;
+      image.pixels[pixel] = {value, value, value};
+    }
+  }
+  WritePpm((options.out + "_clusters.ppm").c_str(), image);
+  image.pixels = clustered;
+  WritePpm((options.out + "_point_lights.ppm").c_str(), image);
+  std::printf("  wrote %s_clusters.ppm and %s_point_lights.ppm\n", options.out.c_str(),
+              options.out.c_str());
+  return list_mismatches == 0 && pixel_mismatches == 0 && missed == 0 ? 0 : 1;
+}
+
+// Thresholds below which golden reports an image as changed.
+constexpr double kMinGoldenPsnr = 40.0;
+constexpr double kMinGoldenSsim = 0.99;
+
+// One frame of a technique and the fastest time it took over |options.frames|.
+struct GoldenFrame {
+  const char* technique;
+  Image image;
+  double seconds;
+};
+
+// The DeferredShading app's frame: G-buffer, shadow cubemap and lighting, timed stage by stage.
+GoldenFrame RenderDeferredGolden(const char* scene_path, const Options& options,
+                                 ThreadPool* pool) {
+  std::unique_ptr<DeferredScene> scene = LoadDeferredScene(scene_path);
+  const bool use_avx2 = SelectRasterKernel(options);
+  const DeferredConstants constants = MakeDeferredConstants(options.width, options.height);
+
+  Gbuffer gbuffer;
+  gbuffer.Resize(options.width, options.height);
+  GbufferRasterizer rasterizer(pool, use_avx2);
+  const RasterStats raster_stats = TimeRaster(&rasterizer, *scene, options.frames, &gbuffer);
+
+  ShadowCubemap shadow;
+  shadow.Resize(kShadowMapSize);
+  ShadowRenderer shadow_renderer(pool, use_avx2);
+  const ShadowStats shadow_stats =
+      TimeShadow(&shadow_renderer, *scene, constants, ShadowSubmission::kSinglePass,
+                 options.frames, &shadow);
+
+  std::vector<uint32_t> lit;
+  const double lighting_seconds =
+      TimeLighting(gbuffer, shadow, constants.light_view_pos, SelectLightingKernel(options),
+                   options.frames, pool, &lit);
+
+  GoldenFrame frame = {"deferred", Image(options.width, options.height),
+                       raster_stats.TotalSeconds() + shadow_stats.TotalSeconds() +
+                           lighting_seconds};
+  for (size_t i = 0; i < lit.size(); ++i)
+    frame.image.pixels[i] = UnpackUnorm(lit[i]);
+  return frame;
+}
+
+// The RayTracing app's first frame, before any jitter is accumulated. The BVH build is not timed,
+// as the app builds its acceleration structures once.
+GoldenFrame RenderRayTracedGolden(const char* scene_path, const Options& options,
+                                  ThreadPool* pool) {
+  std::unique_ptr<Scene> scene = LoadScene(scene_path);
+  Bvh bvh(*scene, pool);
+  std::unique_ptr<Bvh8> bvh8;
+  const RayIntersector& intersector = SelectKernel(options, *scene, bvh, &bvh8);
+  ReferenceTracer tracer(*scene, intersector, pool);
+
+  GoldenFrame frame = {"raytraced", Image(options.width, options.height), 0.0};
+  for (int i = 0; i < options.frames; ++i) {
+    tracer.ResetAccumulation();
+    const TraceStats stats = tracer.Render(&frame.image);
+    if (i == 0 || stats.seconds < frame.seconds)
+      frame.seconds = stats.seconds;
+  }
+  return frame;
+}
+
+// Reads the frame times stored with the golden images, or returns an empty list if there are none.
+std::vector<std::pair<std::string, double>> ReadGoldenTimes(const std::string& path) {
+  std::vector<std::pair<std::string, double>> times;
+  FILE* file = std::fopen(path.c_str(), "r");
+  if (file == nullptr)
+    return times;
+
+  char technique[64];
+  double milliseconds;
+  while (std::fscanf(file, " %63[^,],%lf", technique, &milliseconds) == 2)
+    times.emplace_back(technique, milliseconds);
+  std::fclose(file);
+  return times;
+}
+
+// Renders the scene through the CPU versions of both techniques and compares each image with its
+// golden copy in --golden: PSNR, SSIM, the pixels that changed and the frame time next to the time
+// stored with the golden. Writes each image, an error heatmap of it and <out>.csv with the numbers,
+// and fails if an image falls below kMinGoldenPsnr or kMinGoldenSsim. With --update, stores the
+// images and times as the new goldens instead, creating the directory.
+//
+// No goldens are checked in: the times only mean something on the machine that stored them, so
+// each machine stores its own with --update from a known-good tree and compares later trees
+// against them.
+int RunGolden(const char* scene_path, const Options& options) {
+  if (!options.update_golden) {
+    for (const char* technique : {"deferred", "raytraced"}) {
+      const std::string golden_path = options.golden_dir + "/" + technique + ".ppm";
+      if (!std::filesystem::exists(golden_path)) {
+        throw std::runtime_error("no golden " + golden_path + "; store this machine's goldens "
+                                 "with 'golden <scene> --update' first");
+      }
+    }
+  }
+
+  ThreadPool pool(options.threads);
+
+  GoldenFrame frames[] = {RenderDeferredGolden(scene_path, options, &pool),
+                          RenderRayTracedGolden(scene_path, options, &pool)};
+  const std::string times_path = options.golden_dir + "/times.csv";
+
+  std::printf("%s: %dx%d, %d threads, best of %d frames\n", scene_path, options.width,
+              options.height, pool.num_threads(), options.frames);
+
+  if (options.update_golden) {
+    std::filesystem::create_directories(options.golden_dir);
+    FILE* times = std::fopen(times_path.c_str(), "w");
+    if (times == nullptr)
+      throw std::runtime_error("cannot create " + times_path);
+    for (const GoldenFrame& frame : frames) {
+      const std::string path = options.golden_dir + "/" + frame.technique + ".ppm";
+      WritePpm(path.c_str(), frame.image);
+      std::fprintf(times, "%s,%.3f\n", frame.technique, frame.seconds * 1000.0);
+      std::printf("  %-10s %9.3f ms, wrote %s\n", frame.technique, frame.seconds * 1000.0,
+                  path.c_str());
+    }
+    std::fclose(times);
+    return 0;
+  }
+
+  const std::vector<std::pair<std::string, double>> golden_times = ReadGoldenTimes(times_path);
+
+  const std::string csv_path = options.out + ".csv";
+  FILE* csv = std::fopen(csv_path.c_str(), "w");
+  if (csv == nullptr)
+    throw std::runtime_error("cannot create " + csv_path);
+  std::fprintf(csv, "technique,milliseconds,golden_milliseconds,psnr,ssim,max_error,"
+                    "changed_pixels,passed\n");
+
+  std::printf("  %-10s %9s %9s %8s %9s %8s %9s %8s %s\n", "technique", "ms", "golden ms",
+              "ratio", "PSNR dB", "SSIM", "max error", "changed", "result");
+  bool passed = true;
+  for (const GoldenFrame& frame : frames) {
+    const std::string golden_path = options.golden_dir + "/" + frame.technique + ".ppm";
+    const Image golden = ReadPpm(golden_path.c_str());
+
+    Image heatmap;
+    const ImageDifference difference = CompareImages(frame.image, golden, &heatmap);
+    const bool frame_passed = difference.psnr >= kMinGoldenPsnr &&
+                              difference.ssim >= kMinGoldenSsim;
+    passed = passed && frame_passed;
+
+    double golden_milliseconds = 0.0;
+    for (const auto& entry : golden_times) {
+      if (entry.first == frame.technique)
+        golden_milliseconds = entry.second;
+    }
+    const double milliseconds = frame.seconds * 1000.0;
+    const double changed =
+        100.0 * difference.changed_pixels / static_cast<double>(frame.image.pixels.size());
+
+    std::printf("  %-10s %9.3f %9.3f %7.2fx %9.2f %8.5f %9d %7.3f%% %s\n", frame.technique,
+                milliseconds, golden_milliseconds,
+                golden_milliseconds > 0.0 ? milliseconds / golden_milliseconds : 0.0,
+                difference.psnr, difference.ssim, difference.max_error, changed,
+                frame_passed ? "ok" : "CHANGED");
+    std::fprintf(csv, "%s,%.3f,%.3f,%.3f,%.6f,%d,%zu,%d\n", frame.technique, milliseconds,
+                 golden_milliseconds, difference.psnr, difference.ssim, difference.max_error,
+                 difference.changed_pixels, frame_passed ? 1 : 0);
+
+    const std::string prefix = options.out + "_" + frame.technique;
+    WritePpm((prefix + ".ppm").c_str(), frame.image);
+    WritePpm((prefix + "_heatmap.ppm").c_str(), heatmap);
+  }
+  std::fclose(csv);
+
+  std::printf("  heatmaps saturate at %d levels; wrote %s_{deferred,raytraced}{,_heatmap}.ppm and "
+              "%s\n",
+              kHeatmapFullScale, options.out.c_str(), csv_path.c_str());
+  return passed ? 0 : 1;
+}
+
+// Largest angle, in degrees, the octahedral normals may turn a normal by.
+constexpr double kMaxNormalErrorDegrees = 0.01;
+
+// Angle between |a| and |b|, in degrees. The arc tangent keeps small angles exact, where the arc
+// cosine of a dot product would be lost to the rounding of the vectors' lengths.
+double AngleDegrees(const Vec3& a, const Vec3& b) {
+  const double cross_x = static_cast<double>(a.y) * b.z - static_cast<double>(a.z) * b.y;
+  const double cross_y = static_cast<double>(a.z) * b.x - static_cast<double>(a.x) * b.z;
+  const double cross_z = static_cast<double>(a.x) * b.y - static_cast<double>(a.y) * b.x;
+  const double dot = static_cast<double>(a.x) * b.x + static_cast<double>(a.y) * b.y +
+                     static_cast<double>(a.z) * b.z;
+  return std::atan2(std::sqrt(cross_x * cross_x + cross_y * cross_y + cross_z * cross_z), dot) *
+         180.0 / 3.14159265358979;
+}
+
+// Prints the G-buffer memory and traffic of each layout at common sizes. The geometry pass writes
+// every target once and the lighting pass reads it once; the thin layout also reads the depth
+// buffer, which both layouts write.
+void PrintGbufferBandwidth() {
+  int wide_bytes = 0;
+  for (const GbufferTarget& target : kWideGbufferTargets)
+    wide_bytes += target.bytes_per_pixel;
+  int thin_bytes = 0;
+  for (const GbufferTarget& target : kThinGbufferTargets)
+    thin_bytes += target.bytes_per_pixel;
+  const int depth_bytes = 4;
+  const int wide_traffic = wide_bytes * 2 + depth_bytes;
+  const int thin_traffic = thin_bytes * 2 + depth_bytes * 2;
+
+  std::printf("  layout  targets\n");
+  const struct {
+    const char* name;
+    const GbufferTarget* targets;
+    size_t count;
+  } layouts[] = {{"wide", kWideGbufferTargets, 4}, {"thin", kThinGbufferTargets, 2}};
+  for (const auto& layout : layouts) {
+    std::printf("  %-7s", layout.name);
+    for (size_t i = 0; i < layout.count; ++i) {
+      std::printf(" %s %s (%d B)%s", layout.targets[i].name, layout.targets[i].format,
+                  layout.targets[i].bytes_per_pixel, i + 1 < layout.count ? "," : "\n");
+    }
+  }
+  std::printf("  bytes per pixel: %d wide, %d thin, plus %d of depth; %d and %d moved per frame\n",
+              wide_bytes, thin_bytes, depth_bytes, wide_traffic, thin_traffic);
+
+  std::printf("  %-10s %12s %12s %14s %14s %8s\n", "size", "wide MiB", "thin MiB",
+              "wide MiB/frame", "thin MiB/frame", "saved");
+  const int sizes[][2] = {{1280, 720}, {1920, 1080}, {2560, 1440}, {3840, 2160}};
+  for (const auto& size : sizes) {
+    const double pixels_mib = static_cast<double>(size[0]) * size[1] / (1024.0 * 1024.0);
+    const std::string label = std::to_string(size[0]) + "x" + std::to_string(size[1]);
+    std::printf("  %-10s %12.1f %12.1f %14.1f %14.1f %7.1f%%\n", label.c_str(),
+                pixels_mib * wide_bytes, pixels_mib * thin_bytes, pixels_mib * wide_traffic,
+                pixels_mib * thin_traffic,
+                100.0 * (1.0 - static_cast<double>(thin_traffic) / wide_traffic));
+  }
+  std::printf("  (MiB is the G-buffer the frames share; MiB/frame is the geometry and lighting "
+              "passes' traffic)\n");
+}
+
+// Checks the thin G-buffer layout: round-trips normals in every direction and depths over the
+// scene's range, then rasterizes the scene, packs and unpacks its G-buffer and lights the frame
+// from both. Prints how much memory and bandwidth the layout saves.
+int RunThinGbuffer(const char* scene_path, const Options& options) {
+  std::unique_ptr<DeferredScene> scene = LoadDeferredScene(scene_path);
+  ThreadPool pool(options.threads);
+  const float aspect = static_cast<float>(options.width) / static_cast<float>(options.height);
+  const ViewReconstruction reconstruction =
+      MakeViewReconstruction(kCameraFovY, aspect, kCameraNearZ, kCameraFarZ);
+
+  std::printf("%s: %dx%d, %d threads\n", scene_path, options.width, options.height,
+              pool.num_threads());
+
+  // The axes and diagonals, where the octahedron folds, then random directions.
+  std::vector<Vec3> normals;
+  for (int z = -1; z <= 1; ++z) {
+    for (int y = -1; y <= 1; ++y) {
+      for (int x = -1; x <= 1; ++x) {
+        if (x != 0 || y != 0 || z != 0)
+          normals.push_back(Normalize(Vec3{static_cast<float>(x), static_cast<float>(y),
+                                           static_cast<float>(z)}));
+      }
+    }
+  }
+  std::mt19937 rng(5);
+  std::normal_distribution<float> gaussian;
+  while (normals.size() < (1u << 20)) {
+    const Vec3 direction = {gaussian(rng), gaussian(rng), gaussian(rng)};
+    if (Dot(direction, direction) > 1e-6f)
+      normals.push_back(Normalize(direction));
+  }
+
+  double max_normal_error = 0.0;
+  double sum_normal_error = 0.0;
+  for (const Vec3& normal : normals) {
+    const float xyz[3] = {normal.x, normal.y, normal.z};
+    float decoded[3];
+    DecodeOctahedralNormal(EncodeOctahedralNormal(xyz), decoded);
+    const double error = AngleDegrees(normal, Vec3{decoded[0], decoded[1], decoded[2]});
+    max_normal_error = std::max(max_normal_error, error);
+    sum_normal_error += error;
+  }
+  std::printf("  normals      %zu round trips, %.5f degrees on average, %.5f at most\n",
+              normals.size(), sum_normal_error / normals.size(), max_normal_error);
+
+  // Depths as the projection stores them, from the near plane to well past the back of the scene,
+  // across the screen.
+  const float max_view_z = 20.f;
+  double max_depth_error = 0.0;
+  const int depth_steps = 1024;
+  for (int i = 0; i <= depth_steps; ++i) {
+    const float view_z = kCameraNearZ * std::pow(max_view_z / kCameraNearZ,
+                                                 static_cast<float>(i) / depth_steps);
+    const float depth = reconstruction.depth_scale - reconstruction.depth_offset / view_z;
+    for (float ndc : {-1.f, -0.5f, 0.f, 0.5f, 1.f}) {
+      float view_pos[3];
+      ReconstructViewPosition(reconstruction, ndc, ndc, depth, view_pos);
+      const Vec3 expected = {ndc * reconstruction.inv_proj_x * view_z,
+                             ndc * reconstruction.inv_proj_y * view_z, view_z};
+      const Vec3 actual = {view_pos[0], view_pos[1], view_pos[2]};
+      max_depth_error = std::max(max_depth_error,
+                                 static_cast<double>(Length(actual - expected) / view_z));
+    }
+  }
+  std::printf("  depths       %.2f to %.0f, %.2e of the distance at most\n", kCameraNearZ,
+              max_view_z, max_depth_error);
+
+  Gbuffer gbuffer;
+  gbuffer.Resize(options.width, options.height);
+  GbufferRasterizer rasterizer(&pool, CpuSupportsAvx2());
+  TimeRaster(&rasterizer, *scene, 1, &gbuffer);
+
+  ThinGbuffer thin;
+  Stopwatch stopwatch;
+  EncodeThinGbuffer(gbuffer, &pool, &thin);
+  const double encode_seconds = stopwatch.ElapsedSeconds();
+  Gbuffer decoded;
+  stopwatch.Restart();
+  DecodeThinGbuffer(thin, reconstruction, PackMaterialColors(*scene), &pool, &decoded);
+  const double decode_seconds = stopwatch.ElapsedSeconds();
+
+  double max_position_error = 0.0;
+  double max_scene_normal_error = 0.0;
+  size_t color_mismatches = 0;
+  for (size_t i = 0; i < gbuffer.depth.size(); ++i) {
+    color_mismatches += gbuffer.ambient[i] != decoded.ambient[i] ||
+                        gbuffer.diffuse[i] != decoded.diffuse[i];
+    if (gbuffer.normal[i].w != 0.f)
+      continue;
+    max_position_error = std::max(
+        max_position_error,
+        static_cast<double>(Length(decoded.position[i].xyz() - gbuffer.position[i].xyz())));
+    max_scene_normal_error =
+        std::max(max_scene_normal_error,
+                 AngleDegrees(Normalize(gbuffer.normal[i].xyz()), decoded.normal[i].xyz()));
+  }
+  std::printf("  scene        encode %.3f ms, decode %.3f ms\n", encode_seconds * 1000.0,
+              decode_seconds * 1000.0);
+  std::printf("               positions off by %.2e at most, normals by %.5f degrees, %zu "
+              "colors differ\n",
+              max_position_error, max_scene_normal_error, color_mismatches);
+
+  const DeferredConstants constants = MakeDeferredConstants(options.width, options.height);
+  ShadowCubemap shadow;
+  shadow.Resize(kShadowMapSize);
+  ShadowRenderer shadow_renderer(&pool, CpuSupportsAvx2());
+  shadow_renderer.Render(*scene, constants, ShadowSubmission::kSinglePass, &shadow);
+
+  const LightingKernel kernel = SelectLightingKernel(options);
+  std::vector<uint32_t> wide_lit;
+  ShadeLighting(gbuffer, shadow, constants.light_view_pos, kernel, &pool, &wide_lit);
+  std::vector<uint32_t> thin_lit;
+  ShadeLighting(decoded, shadow, constants.light_view_pos, kernel, &pool, &thin_lit);
+
+  Image wide_image(options.width, options.height);
+  Image thin_image(options.width, options.height);
+  for (size_t i = 0; i < wide_lit.size(); ++i) {
+    wide_image.pixels[i] = UnpackUnorm(wide_lit[i]);
+    thin_image.pixels[i] = UnpackUnorm(thin_lit[i]);
+  }
+  const ImageDifference difference = CompareImages(thin_image, wide_image, nullptr);
+  std::printf("  lit frame    %zu pixels differ, by %d at most, PSNR %.2f dB, SSIM %.5f\n",
+              difference.changed_pixels, difference.max_error, difference.psnr, difference.ssim);
+  WritePpm((options.out + "_thin_lit.ppm").c_str(), thin_image);
+  std::printf("  wrote %s_thin_lit.ppm\n", options.out.c_str());
+
+  PrintGbufferBandwidth();
+
+  const bool passed = max_normal_error <= kMaxNormalErrorDegrees && color_mismatches == 0 &&
+                      difference.psnr >= kMinGoldenPsnr && difference.ssim >= kMinGoldenSsim;
+  return passed ? 0 : 1;
+}
+
+// The most threads the scaling benchmarks go up to, doubling from 1: --threads if given, else
+// the hardware threads but at least DeferredShading's kRecordingThreads.
+int MaxBenchThreads(const Options& options) {
+  if (options.threads > 0)
+    return options.threads;
+  return std::max(4, static_cast<int>(std::thread::hardware_concurrency()));
+}
+
+void PrintUsage() {
+  std::fprintf(stderr,
+               "usage:\n"
+               "  CpuReference trace <scene> [options]\n"
+               "  CpuReference bench-bvh <scene> [options]\n"
+               "  CpuReference bench-traversal <scene> [options]\n"
+               "  CpuReference bench-samplers <scene> [options]\n"
+               "  CpuReference raster <scene> [options]\n"
+               "  CpuReference bench-raster <scene> [options]\n"
+               "  CpuReference shadow <scene> [options]\n"
+               "  CpuReference deferred <scene> [options]\n"
+               "  CpuReference golden <scene> [options]\n"
+               "  CpuReference clusters <scene> [options]\n"
+               "  CpuReference thin-gbuffer <scene> [options]\n"
+               "  CpuReference render-graph [options]\n"
+               "  CpuReference upload-ring [options]\n"
+               "  CpuReference frame-constants [options]\n"
+               "  CpuReference descriptor-allocator [options]\n"
+               "  CpuReference material-table <material_table.hlsli> [options]\n"
+               "  CpuReference record-frame [options]\n"
+               "  CpuReference bench-jobs <scene> [options]\n"
+               "\n"
+               "<scene> is a .scene or .sdkmesh file, or synthetic:N for N random triangles.\n"
+               "\n"
+               "options:\n"
+               "  --width N, --height N   image size (default 1024x768)\n"
+               "  --frames N              frames or builds to time (default 1)\n"
+               "  --threads N             worker threads including the main thread (default all)\n"
+               "  --out PREFIX            output path prefix, its directory created if needed\n"
+               "                          (default 'out/reference')\n"
+               "  --kernel scalar|avx2    single-ray or raster tile kernel (default avx2 when\n"
+               "                          supported); deferred also takes sse2 for lighting\n"
+               "  --packet 0|8|16         trace NxN ray packets instead of single rays (AVX2)\n"
+               "  --engine megakernel|wavefront\n"
+               "                          per-ray shaders, or stages over waves of paths\n"
+               "  --wave N                paths in flight for the wavefront engine (default "
+               "262144)\n"
+               "  --integrator direct|path\n"
+               "                          raytracing.hlsl's lighting, or path tracing with the\n"
+               "                          wavefront engine, one sample per pixel per frame\n"
+               "  --bounces N             path-tracing bounces after the camera ray (default 8)\n"
+               "  --seconds S             stop accumulating after S seconds, even before --frames\n"
+               "  --sampler random|sobol|lattice|bluenoise\n"
+               "                          where the wavefront engine draws its subpixel positions\n"
+               "                          and bounce directions (default frame jitter and random)\n"
+               "  --spp N                 bench-samplers: largest sample count measured (default "
+               "64)\n"
+               "  --reference-spp N       bench-samplers: samples in the reference (default 1024)\n"
+               "  --golden DIR            golden: where the golden images are (default 'golden')\n"
+               "  --update                golden: store the images as the new goldens; run it\n"
+               "                          once per machine on a known-good tree, then compare\n"
+               "  --lights N              clusters: point lights to scatter (default 1024)\n");
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  if (argc < 2) {
+    PrintUsage();
+    return 1;
+  }
+
+  const std::string command = argv[1];
+  // render-graph, upload-ring, frame-constants, descriptor-allocator and record-frame run
+  // without a scene.
+  const bool takes_scene = command != "render-graph" && command != "upload-ring" &&
+                           command != "frame-constants" && command != "descriptor-allocator" &&
+                           command != "record-frame";
+  if (takes_scene && argc < 3) {
+    PrintUsage();
+    return 1;
+  }
+  const char* path = takes_scene ? argv[2] : nullptr;
+
+  Options options;
+  if (!ParseOptions(argc, argv, takes_scene ? 3 : 2, &options)) {
+    PrintUsage();
+    return 1;
+  }
+
+  try {
+    const std::filesystem::path out_dir = std::filesystem::path(options.out).parent_path();
+    if (takes_scene && !out_dir.empty())
+      std::filesystem::create_directories(out_dir);
+
+    if (command == "trace")
+      return RunTrace(path, options);
+    if (command == "bench-bvh")
+      return RunBenchBvh(path, options);
+    if (command == "bench-traversal")
+      return RunBenchTraversal(path, options);
+    if (command == "bench-samplers")
+      return RunBenchSamplers(path, options);
+    if (command == "raster")
+      return RunRaster(path, options);
+    if (command == "bench-raster")
+      return RunBenchRaster(path, options);
+    if (command == "shadow")
+      return RunShadow(path, options);
+    if (command == "deferred")
+      return RunDeferred(path, options);
+    if (command == "golden")
+      return RunGolden(path, options);
+    if (command == "clusters")
+      return RunClusters(path, options);
+    if (command == "thin-gbuffer")
+      return RunThinGbuffer(path, options);
+    if (command == "render-graph")
+      return RunRenderGraphCommand(options.width, options.height, options.frames);
+    if (command == "upload-ring")
+      return RunUploadRingCommand(options.frames);
+    if (command == "frame-constants")
+      return RunFrameConstantsCommand(options.frames);
+    if (command == "descriptor-allocator")
+      return RunDescriptorAllocatorCommand(options.frames);
+    if (command == "material-table")
+      return RunMaterialTableCommand(path, options.frames);
+    if (command == "record-frame")
+      return RunRecordFrameCommand(options.width, options.height, options.frames,
+                                   MaxBenchThreads(options));
+    if (command == "bench-jobs")
+      return RunBenchJobsCommand(*LoadScene(path), path, options.width, options.height,
+                                 options.frames, MaxBenchThreads(options));
+  } catch (const std::exception& e) {
+    std::fprintf(stderr, "error: %s\n", e.what());
+    return 1;
+  }
+
+  PrintUsage();
+  return 1;
+}
\ No newline at end of file
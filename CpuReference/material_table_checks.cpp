@@ -0,0 +1,301 @@
+#include "material_table_checks.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "command_recorder.h"
+#include "gbuffer_encoding.h"
+#include "material_table.h"
+#include "profiling.h"
+#include "scene_cache.h"
+
+namespace {
+
+// One member of a struct and where a structured buffer puts it.
+struct Field {
+  std::string name;
+  uint32_t offset;
+  uint32_t size;
+};
+
+struct Layout {
+  std::vector<Field> fields;
+  uint32_t stride = 0;
+};
+
+// Bytes of an HLSL scalar, vector or matrix type such as uint, float3 or float4x4, or 0 for
+// anything else, including structs.
+uint32_t HlslTypeSize(const std::string& type) {
+  const char* const scalars[] = {"float", "int", "uint", "bool", "dword"};
+  for (const char* scalar : scalars) {
+    const std::string prefix(scalar);
+    if (type.compare(0, prefix.size(), prefix) != 0)
+      continue;
+
+    const std::string dims = type.substr(prefix.size());
+    if (dims.empty())
+      return 4;
+    if (dims.size() == 1 && dims[0] >= '1' && dims[0] <= '4')
+      return 4 * (dims[0] - '0');
+    if (dims.size() == 3 && dims[1] == 'x' && dims[0] >= '1' && dims[0] <= '4' &&
+        dims[2] >= '1' && dims[2] <= '4') {
+      return 4 * (dims[0] - '0') * (dims[2] - '0');
+    }
+  }
+  return 0;
+}
+
+// Lays out struct |name| of |source| the way a StructuredBuffer does: every member 4-byte
+// aligned straight after the one before, with none of a constant buffer's 16-byte rows. Only
+// scalar, vector and matrix members and arrays of them are understood. Returns false if the
+// struct is missing or has a member it cannot lay out.
+bool ParseStructuredLayout(const std::string& source, const std::string& name, Layout* layout) {
+  const size_t start = source.find("struct " + name + " {");
+  if (start == std::string::npos)
+    return false;
+  const size_t body = source.find('{', start) + 1;
+  const size_t end = source.find("};", body);
+  if (end == std::string::npos)
+    return false;
+
+  std::istringstream members(source.substr(body, end - body));
+  std::string member;
+  *layout = Layout();
+  while (std::getline(members, member, ';')) {
+    // Drops comments, which run to the end of their line.
+    std::string code;
+    std::istringstream lines(member);
+    std::string line;
+    while (std::getline(lines, line))
+      code += line.substr(0, line.find("//")) + " ";
+
+    std::istringstream tokens(code);
+    std::string type;
+    std::string field_name;
+    if (!(tokens >> type))
+      continue;
+    if (!(tokens >> field_name))
+      return false;
+
+    uint32_t count = 1;
+    const size_t bracket = field_name.find('[');
+    if (bracket != std::string::npos) {
+      count = static_cast<uint32_t>(std::stoul(field_name.substr(bracket + 1)));
+      field_name = field_name.substr(0, bracket);
+    }
+
+    const uint32_t size = HlslTypeSize(type) * count;
+    if (size == 0)
+      return false;
+    layout->fields.push_back({field_name, layout->stride, size});
+    layout->stride += size;
+  }
+  return !layout->fields.empty();
+}
+
+bool SameLayout(const Layout& a, const Layout& b) {
+  if (a.stride != b.stride || a.fields.size() != b.fields.size())
+    return false;
+  for (size_t i = 0; i < a.fields.size(); ++i) {
+    if (a.fields[i].name != b.fields[i].name || a.fields[i].offset != b.fields[i].offset ||
+        a.fields[i].size != b.fields[i].size) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// A float3 followed by a float shares 16 bytes, a float followed by a float3 does not move the
+// float3 to the next 16 bytes, and arrays are packed without padding.
+bool CheckPacksLikeStructuredBuffers() {
+  const std::string source =
+      "struct Test {\n"
+      "  float3 a;\n"
+      "  float b;  // Packed after a.\n"
+      "  float2 c[3];\n"
+      "  uint d;\n"
+      "  float4x4 e;\n"
+      "};\n";
+  Layout expected;
+  expected.fields = {{"a", 0, 12}, {"b", 12, 4}, {"c", 16, 24}, {"d", 40, 4}, {"e", 44, 64}};
+  expected.stride = 108;
+
+  Layout layout;
+  return ParseStructuredLayout(source, "Test", &layout) && SameLayout(layout, expected);
+}
+
+bool CheckRejectsUnknownMembers() {
+  Layout layout;
+  return !ParseStructuredLayout("struct Outer {\n  Inner inner;\n};\n", "Outer", &layout) &&
+         !ParseStructuredLayout("struct Other {\n  float a;\n};\n", "Outer", &layout);
+}
+
+// The C++ struct and the HLSL struct agree on every member's name, offset and size, and on the
+// stride between entries.
+bool CheckMatchesHlsl(const char* hlsl_path) {
+  std::ifstream file(hlsl_path);
+  if (!file) {
+    std::printf("         cannot read %s\n", hlsl_path);
+    return false;
+  }
+  std::stringstream source;
+  source << file.rdbuf();
+
+  Layout hlsl;
+  if (!ParseStructuredLayout(source.str(), "MaterialTableEntry", &hlsl)) {
+    std::printf("         %s has no MaterialTableEntry this check can lay out\n", hlsl_path);
+    return false;
+  }
+
+  Layout cpp;
+  cpp.fields = {
+    {"ambient_color", offsetof(MaterialTableEntry, ambient_color),
+     sizeof(MaterialTableEntry::ambient_color)},
+    {"diffuse_color", offsetof(MaterialTableEntry, diffuse_color),
+     sizeof(MaterialTableEntry::diffuse_color)},
+  };
+  cpp.stride = sizeof(MaterialTableEntry);
+
+  const bool same = SameLayout(hlsl, cpp);
+  for (const Field& field : hlsl.fields)
+    std::printf("         %-14s hlsl %2u+%-2u\n", field.name.c_str(), field.offset, field.size);
+  std::printf("         stride: hlsl %u, c++ %u\n", hlsl.stride, cpp.stride);
+  return same;
+}
+
+// Entries copy the ambient and diffuse colors with w = 0, dropping the alpha, as the app's old
+// material constants did.
+bool CheckBuildsEntries() {
+  scene_cache::MaterialDesc desc{};
+  desc.ambient_color = {0.1f, 0.2f, 0.3f, 0.f};
+  desc.diffuse_color = {0.4f, 0.5f, 0.6f, 0.5f};
+  desc.emissive_color = {1.f, 1.f, 1.f, 0.f};
+
+  const MaterialTableEntry entry = MakeMaterialTableEntry(desc);
+  return entry.ambient_color[0] == 0.1f && entry.ambient_color[1] == 0.2f &&
+         entry.ambient_color[2] == 0.3f && entry.ambient_color[3] == 0.f &&
+         entry.diffuse_color[0] == 0.4f && entry.diffuse_color[1] == 0.5f &&
+         entry.diffuse_color[2] == 0.6f && entry.diffuse_color[3] == 0.f;
+}
+
+// Frames the material-table command records per case when --frames is not given, and the draws
+// in each.
+constexpr int kDefaultSubmissionFrames = 100;
+constexpr int kSubmissionDraws = 16384;
+
+// How a draw tells the lighting pass which material it has.
+enum class MaterialBinding {
+  // The index as a root constant, into the material table: what the app does.
+  kTableIndex,
+  // A root CBV of the material's own 256-byte constant buffer slice.
+  kConstantBufferView,
+  // The material's colors copied into the root constants.
+  kRootConstants,
+};
+
+// Records |frames| frames of |draws| with |binding| and returns the nanoseconds per draw.
+double TimeDrawSubmission(const std::vector<SubmittedDraw>& draws,
+                          const std::vector<MaterialTableEntry>& table, MaterialBinding binding,
+                          int frames, CommandRecorder* recorder) {
+  const uint64_t kMaterialBufferAddress = uint64_t(1) << 40;
+  Stopwatch stopwatch;
+  for (int frame = 0; frame < frames; ++frame) {
+    recorder->Reset();
+    for (const SubmittedDraw& draw : draws) {
+      switch (binding) {
+        case MaterialBinding::kTableIndex:
+          recorder->SetRoot32BitConstants(1, 1, &draw.material_index);
+          break;
+        case MaterialBinding::kConstantBufferView:
+          recorder->SetRootConstantBufferView(1, kMaterialBufferAddress +
+                                                     uint64_t(draw.material_index) * 256);
+          break;
+        case MaterialBinding::kRootConstants:
+          recorder->SetRoot32BitConstants(1, sizeof(MaterialTableEntry) / 4,
+                                          &table[draw.material_index]);
+          break;
+      }
+      recorder->Draw(draw);
+    }
+  }
+  return stopwatch.ElapsedSeconds() * 1e9 / (static_cast<double>(frames) * draws.size());
+}
+
+}  // namespace
+
+bool RunMaterialTableChecks(const char* hlsl_path) {
+  struct Check {
+    const char* name;
+    bool (*run)(const char*);
+  };
+
+  const Check checks[] = {
+    {"lays structs out like a structured buffer",
+     [](const char*) { return CheckPacksLikeStructuredBuffers(); }},
+    {"rejects members it cannot lay out", [](const char*) { return CheckRejectsUnknownMembers(); }},
+    {"MaterialTableEntry matches material_table.hlsli", CheckMatchesHlsl},
+    {"builds entries with w = 0", [](const char*) { return CheckBuildsEntries(); }},
+  };
+
+  bool all_passed = true;
+  for (const Check& check : checks) {
+    const bool passed = check.run(hlsl_path);
+    std::printf("  %-6s %s\n", passed ? "ok" : "FAILED", check.name);
+    all_passed = all_passed && passed;
+  }
+  return all_passed;
+}
+
+int RunMaterialTableCommand(const char* hlsl_path, int requested_frames) {
+  std::printf("material table checks:\n");
+  const bool passed = RunMaterialTableChecks(hlsl_path);
+
+  const int frames = requested_frames > 1 ? requested_frames : kDefaultSubmissionFrames;
+  std::printf("%d draws, %d frames per case; ns per draw for each material binding:\n",
+              kSubmissionDraws, frames);
+  std::printf("  %9s %10s %10s %9s %9s %9s %9s\n", "materials", "table KiB", "cbvs KiB",
+              "build ms", "index", "cbv", "copy");
+
+  std::mt19937 rng(1);
+  std::uniform_real_distribution<float> color_dist(0.f, 1.f);
+  CommandRecorder recorder;
+  for (uint32_t num_materials = 16; num_materials <= kMaxGbufferMaterials; num_materials *= 4) {
+    std::vector<scene_cache::MaterialDesc> descs(num_materials);
+    for (scene_cache::MaterialDesc& desc : descs) {
+      desc.ambient_color = {color_dist(rng), color_dist(rng), color_dist(rng), 0.f};
+      desc.diffuse_color = {color_dist(rng), color_dist(rng), color_dist(rng), 1.f};
+    }
+
+    Stopwatch build;
+    std::vector<MaterialTableEntry> table;
+    table.reserve(num_materials);
+    for (const scene_cache::MaterialDesc& desc : descs)
+      table.push_back(MakeMaterialTableEntry(desc));
+    const double build_ms = build.ElapsedMilliseconds();
+
+    // Draws in the scene's order, which does not follow the materials.
+    std::uniform_int_distribution<uint32_t> material_dist(0, num_materials - 1);
+    std::vector<SubmittedDraw> draws(kSubmissionDraws);
+    for (int i = 0; i < kSubmissionDraws; ++i) {
+      const uint64_t address = (uint64_t(1) << 32) + uint64_t(i) * 65536;
+      draws[i] = {address, 32768, address + 32768, 32768, 3072, 0, 0, material_dist(rng)};
+    }
+
+    const double index_ns =
+        TimeDrawSubmission(draws, table, MaterialBinding::kTableIndex, frames, &recorder);
+    const double cbv_ns =
+        TimeDrawSubmission(draws, table, MaterialBinding::kConstantBufferView, frames, &recorder);
+    const double copy_ns =
+        TimeDrawSubmission(draws, table, MaterialBinding::kRootConstants, frames, &recorder);
+    std::printf("  %9u %10.1f %10.1f %9.3f %9.2f %9.2f %9.2f\n", num_materials,
+                num_materials * sizeof(MaterialTableEntry) / 1024.0, num_materials * 256 / 1024.0,
+                build_ms, index_ns, cbv_ns, copy_ns);
+  }
+  return passed ? 0 : 1;
+}
\ No newline at end of file
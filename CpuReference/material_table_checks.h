@@ -0,0 +1,16 @@
+#ifndef MATERIAL_TABLE_CHECKS_H_
+#define MATERIAL_TABLE_CHECKS_H_
+
+// Checks that MaterialTableEntry lays out its members where a StructuredBuffer of the struct that
+// |hlsl_path|, material_table.hlsli, declares reads them, and that the table holds the colors the
+// shaders expect. Prints one line per check and returns whether all passed.
+bool RunMaterialTableChecks(const char* hlsl_path);
+
+// The material-table command: runs the checks, then records the geometry pass's draws for growing
+// numbers of materials, binding each draw's material as an index into the table, as a constant
+// buffer view per material and as root constants, and prints the per-draw cost and the GPU
+// memory each way needs. |requested_frames| is --frames; 1 records a default number per case.
+// Returns the exit code.
+int RunMaterialTableCommand(const char* hlsl_path, int requested_frames);
+
+#endif  // MATERIAL_TABLE_CHECKS_H_
\ No newline at end of file
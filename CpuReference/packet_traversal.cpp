@@ -0,0 +1,478 @@
+#include "packet_traversal.h"
+
+#include <immintrin.h>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <vector>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+namespace {
+
+constexpr int kGroupSize = 8;
+constexpr int kMaxGroups = kMaxPacketRays / kGroupSize;
+
+// With fewer active rays than this below a node, testing whole groups wastes most lanes, so the
+// rays finish the subtree on their own.
+constexpr int kSingleRayThreshold = 8;
+
+// One entry per level, and the binary builder keeps its trees below 80 levels.
+constexpr int kTraversalStackSize = 96;
+
+// Same padding of the slab exit as the single-ray traversal.
+constexpr float kSlabExitScale = 1.0000004f;
+
+// Direction components are clamped away from zero so the slab distances stay finite.
+constexpr float kMinDirection = 1e-30f;
+
+constexpr float kInfinity = std::numeric_limits<float>::infinity();
+
+inline int LowestSetBit(int mask) {
+#if defined(_MSC_VER)
+  unsigned long index;
+  _BitScanForward(&index, static_cast<unsigned long>(mask));
+  return static_cast<int>(index);
+#else
+  return __builtin_ctz(static_cast<unsigned>(mask));
+#endif
+}
+
+inline int PopCount(int mask) {
+#if defined(_MSC_VER)
+  return static_cast<int>(__popcnt(static_cast<unsigned>(mask)));
+#else
+  return __builtin_popcount(static_cast<unsigned>(mask));
+#endif
+}
+
+// Values derived from the packet once before traversal.
+struct alignas(32) PacketData {
+  float inv_direction[3][kMaxPacketRays];
+  // Upper end of each ray's interval: the closest hit so far, or -infinity once an any-hit ray
+  // is done, so later box tests reject it.
+  float t_limit[kMaxPacketRays];
+
+  int num_groups;
+  // Lanes of each group that hold rays.
+  int valid_masks[kMaxGroups];
+
+  // Frustum of the packet as intervals of its origins and reciprocal directions. Only usable
+  // when every ray's direction has the same sign on each axis.
+  bool coherent;
+  bool negative[3];
+  float origin_lo[3];
+  float origin_hi[3];
+  float inv_lo[3];
+  float inv_hi[3];
+  float t_min_lo;
+
+  // Summed directions, for picking which child to visit first.
+  Vec3 direction;
+};
+
+struct StackEntry {
+  uint32_t node;
+  // Rays that hit the parent, per group.
+  uint8_t masks[kMaxGroups];
+};
+
+void PreparePacket(const RayPacket& packet, PacketData* data) {
+  const int num_rays = packet.num_rays;
+  data->num_groups = (num_rays + kGroupSize - 1) / kGroupSize;
+
+  for (int group = 0; group < data->num_groups; ++group) {
+    const int lanes = std::min(kGroupSize, num_rays - group * kGroupSize);
+    data->valid_masks[group] = (1 << lanes) - 1;
+  }
+
+  data->coherent = true;
+  data->t_min_lo = kInfinity;
+  data->direction = {0.f, 0.f, 0.f};
+
+  for (int axis = 0; axis < 3; ++axis) {
+    data->origin_lo[axis] = kInfinity;
+    data->origin_hi[axis] = -kInfinity;
+    data->inv_lo[axis] = kInfinity;
+    data->inv_hi[axis] = -kInfinity;
+    data->negative[axis] = num_rays > 0 && packet.direction[axis][0] < 0.f;
+  }
+
+  for (int i = 0; i < kMaxGroups * kGroupSize; ++i) {
+    if (i >= num_rays) {
+      // Padding lanes get finite values so they never produce NaNs in the box tests.
+      for (int axis = 0; axis < 3; ++axis)
+        data->inv_direction[axis][i] = 1.f;
+      data->t_limit[i] = -kInfinity;
+      continue;
+    }
+
+    for (int axis = 0; axis < 3; ++axis) {
+      float direction = packet.direction[axis][i];
+      if (std::fabs(direction) < kMinDirection)
+        direction = std::copysign(kMinDirection, direction);
+
+      const float inv_direction = 1.f / direction;
+      data->inv_direction[axis][i] = inv_direction;
+
+      data->origin_lo[axis] = std::min(data->origin_lo[axis], packet.origin[axis][i]);
+      data->origin_hi[axis] = std::max(data->origin_hi[axis], packet.origin[axis][i]);
+      data->inv_lo[axis] = std::min(data->inv_lo[axis], inv_direction);
+      data->inv_hi[axis] = std::max(data->inv_hi[axis], inv_direction);
+
+      if ((inv_direction < 0.f) != data->negative[axis])
+        data->coherent = false;
+    }
+
+    data->direction += {packet.direction[0][i], packet.direction[1][i], packet.direction[2][i]};
+    data->t_limit[i] = packet.t_max[i];
+    data->t_min_lo = std::min(data->t_min_lo, packet.t_min[i]);
+  }
+}
+
+// Smallest and largest product of a value in [a_lo, a_hi] and one in [b_lo, b_hi].
+inline float MinProduct(float a_lo, float a_hi, float b_lo, float b_hi) {
+  return std::min(std::min(a_lo * b_lo, a_lo * b_hi), std::min(a_hi * b_lo, a_hi * b_hi));
+}
+
+inline float MaxProduct(float a_lo, float a_hi, float b_lo, float b_hi) {
+  return std::max(std::max(a_lo * b_lo, a_lo * b_hi), std::max(a_hi * b_lo, a_hi * b_hi));
+}
+
+// Conservative test of the whole packet against |node|'s box: the earliest any ray can enter
+// each slab and the latest any can leave it, from interval arithmetic on the packet's frustum.
+// Returns false only if no ray can hit the box before |t_max|.
+bool FrustumMayHit(const PacketData& data, const BvhNode& node, float t_max) {
+  float near = data.t_min_lo;
+  float far = t_max;
+
+  for (int axis = 0; axis < 3; ++axis) {
+    const float near_plane = data.negative[axis] ? node.bounds_max[axis] : node.bounds_min[axis];
+    const float far_plane = data.negative[axis] ? node.bounds_min[axis] : node.bounds_max[axis];
+
+    near = std::max(near, MinProduct(near_plane - data.origin_hi[axis],
+                                     near_plane - data.origin_lo[axis], data.inv_lo[axis],
+                                     data.inv_hi[axis]));
+    far = std::min(far, MaxProduct(far_plane - data.origin_hi[axis],
+                                   far_plane - data.origin_lo[axis], data.inv_lo[axis],
+                                   data.inv_hi[axis]));
+  }
+
+  return near <= far * kSlabExitScale;
+}
+
+// Slab test of the eight rays starting at |base| against |node|'s box.
+inline int IntersectBoxGroup(const RayPacket& packet, const PacketData& data, int base,
+                             const BvhNode& node) {
+  __m256 near = _mm256_load_ps(packet.t_min + base);
+  __m256 far = _mm256_load_ps(data.t_limit + base);
+
+  for (int axis = 0; axis < 3; ++axis) {
+    const __m256 origin = _mm256_load_ps(packet.origin[axis] + base);
+    const __m256 inv_direction = _mm256_load_ps(data.inv_direction[axis] + base);
+
+    const __m256 t0 = _mm256_mul_ps(
+        _mm256_sub_ps(_mm256_set1_ps(node.bounds_min[axis]), origin), inv_direction);
+    const __m256 t1 = _mm256_mul_ps(
+        _mm256_sub_ps(_mm256_set1_ps(node.bounds_max[axis]), origin), inv_direction);
+
+    near = _mm256_max_ps(near, _mm256_min_ps(t0, t1));
+    far = _mm256_min_ps(far, _mm256_mul_ps(_mm256_max_ps(t0, t1),
+                                           _mm256_set1_ps(kSlabExitScale)));
+  }
+
+  return _mm256_movemask_ps(_mm256_cmp_ps(near, far, _CMP_LE_OQ));
+}
+
+struct TriangleData {
+  __m256 v0[3];
+  __m256 edge1[3];
+  __m256 edge2[3];
+};
+
+// IntersectTriangle with back faces culled, for the eight rays starting at |base|. Returns the
+// mask of lanes that hit within [t_min, t_limit].
+inline int IntersectTriangleGroup(const RayPacket& packet, const PacketData& data, int base,
+                                  const TriangleData& triangle, __m256* t, __m256* u,
+                                  __m256* v) {
+  const __m256 dx = _mm256_load_ps(packet.direction[0] + base);
+  const __m256 dy = _mm256_load_ps(packet.direction[1] + base);
+  const __m256 dz = _mm256_load_ps(packet.direction[2] + base);
+
+  const __m256* e1 = triangle.edge1;
+  const __m256* e2 = triangle.edge2;
+
+  // p = cross(direction, edge2)
+  const __m256 px = _mm256_sub_ps(_mm256_mul_ps(dy, e2[2]), _mm256_mul_ps(dz, e2[1]));
+  const __m256 py = _mm256_sub_ps(_mm256_mul_ps(dz, e2[0]), _mm256_mul_ps(dx, e2[2]));
+  const __m256 pz = _mm256_sub_ps(_mm256_mul_ps(dx, e2[1]), _mm256_mul_ps(dy, e2[0]));
+
+  const __m256 det = _mm256_add_ps(
+      _mm256_add_ps(_mm256_mul_ps(e1[0], px), _mm256_mul_ps(e1[1], py)), _mm256_mul_ps(e1[2], pz));
+
+  const __m256 zero = _mm256_setzero_ps();
+  const __m256 one = _mm256_set1_ps(1.f);
+  __m256 hit = _mm256_cmp_ps(det, zero, _CMP_GT_OQ);
+  if (_mm256_movemask_ps(hit) == 0)
+    return 0;
+
+  const __m256 inv_det = _mm256_div_ps(one, det);
+
+  // s = origin - v0
+  const __m256 sx = _mm256_sub_ps(_mm256_load_ps(packet.origin[0] + base), triangle.v0[0]);
+  const __m256 sy = _mm256_sub_ps(_mm256_load_ps(packet.origin[1] + base), triangle.v0[1]);
+  const __m256 sz = _mm256_sub_ps(_mm256_load_ps(packet.origin[2] + base), triangle.v0[2]);
+
+  const __m256 hit_u = _mm256_mul_ps(
+      _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(sx, px), _mm256_mul_ps(sy, py)),
+                    _mm256_mul_ps(sz, pz)),
+      inv_det);
+  hit = _mm256_and_ps(hit, _mm256_cmp_ps(hit_u, zero, _CMP_GE_OQ));
+  hit = _mm256_and_ps(hit, _mm256_cmp_ps(hit_u, one, _CMP_LE_OQ));
+
+  // q = cross(s, edge1)
+  const __m256 qx = _mm256_sub_ps(_mm256_mul_ps(sy, e1[2]), _mm256_mul_ps(sz, e1[1]));
+  const __m256 qy = _mm256_sub_ps(_mm256_mul_ps(sz, e1[0]), _mm256_mul_ps(sx, e1[2]));
+  const __m256 qz = _mm256_sub_ps(_mm256_mul_ps(sx, e1[1]), _mm256_mul_ps(sy, e1[0]));
+
+  const __m256 hit_v = _mm256_mul_ps(
+      _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(dx, qx), _mm256_mul_ps(dy, qy)),
+                    _mm256_mul_ps(dz, qz)),
+      inv_det);
+  hit = _mm256_and_ps(hit, _mm256_cmp_ps(hit_v, zero, _CMP_GE_OQ));
+  hit = _mm256_and_ps(hit, _mm256_cmp_ps(_mm256_add_ps(hit_u, hit_v), one, _CMP_LE_OQ));
+
+  const __m256 hit_t = _mm256_mul_ps(
+      _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(e2[0], qx), _mm256_mul_ps(e2[1], qy)),
+                    _mm256_mul_ps(e2[2], qz)),
+      inv_det);
+  hit = _mm256_and_ps(hit, _mm256_cmp_ps(hit_t, _mm256_load_ps(packet.t_min + base),
+                                         _CMP_GE_OQ));
+  hit = _mm256_and_ps(hit, _mm256_cmp_ps(hit_t, _mm256_load_ps(data.t_limit + base),
+                                         _CMP_LE_OQ));
+
+  *t = hit_t;
+  *u = hit_u;
+  *v = hit_v;
+  return _mm256_movemask_ps(hit);
+}
+
+}  // namespace
+
+void RayPacket::Add(const Ray& ray) {
+  const int index = num_rays++;
+  for (int axis = 0; axis < 3; ++axis) {
+    origin[axis][index] = ray.origin[axis];
+    direction[axis][index] = ray.direction[axis];
+  }
+  t_min[index] = ray.t_min;
+  t_max[index] = ray.t_max;
+}
+
+Ray RayPacket::ray(int index) const {
+  Ray ray;
+  ray.origin = {origin[0][index], origin[1][index], origin[2][index]};
+  ray.direction = {direction[0][index], direction[1][index], direction[2][index]};
+  ray.t_min = t_min[index];
+  ray.t_max = t_max[index];
+  return ray;
+}
+
+PacketTraversal::PacketTraversal(const Scene& scene, const Bvh& bvh) : scene_(scene), bvh_(bvh) {}
+
+void PacketTraversal::Intersect(const RayPacket& packet, PacketHits* hits,
+                                PacketStats* stats) const {
+  Traverse<false>(packet, hits, nullptr, stats);
+}
+
+void PacketTraversal::Occluded(const RayPacket& packet, uint8_t* occluded,
+                               PacketStats* stats) const {
+  Traverse<true>(packet, nullptr, occluded, stats);
+}
+
+template <bool kAnyHit>
+void PacketTraversal::Traverse(const RayPacket& packet, PacketHits* hits, uint8_t* occluded,
+                               PacketStats* stats) const {
+  const std::vector<BvhNode>& nodes = bvh_.nodes();
+  const std::vector<uint32_t>& primitive_indices = bvh_.primitive_indices();
+
+  PacketData data;
+  PreparePacket(packet, &data);
+
+  for (int i = 0; i < packet.num_rays; ++i) {
+    if (kAnyHit) {
+      occluded[i] = 0;
+    } else {
+      hits->t[i] = packet.t_max[i];
+      hits->u[i] = 0.f;
+      hits->v[i] = 0.f;
+      hits->triangle[i] = kInvalidTriangle;
+    }
+  }
+
+  ++stats->packets;
+  if (!data.coherent)
+    ++stats->incoherent_packets;
+
+  if (packet.num_rays == 0 || primitive_indices.empty())
+    return;
+
+  // Largest t_limit over the packet, which bounds the frustum test.
+  float packet_t_max = -kInfinity;
+  for (int i = 0; i < packet.num_rays; ++i)
+    packet_t_max = std::max(packet_t_max, data.t_limit[i]);
+
+  StackEntry stack[kTraversalStackSize];
+  int stack_size = 0;
+
+  StackEntry& root = stack[stack_size++];
+  root.node = 0;
+  for (int group = 0; group < data.num_groups; ++group)
+    root.masks[group] = static_cast<uint8_t>(data.valid_masks[group]);
+
+  while (stack_size > 0) {
+    const StackEntry entry = stack[--stack_size];
+    const BvhNode& node = nodes[entry.node];
+
+    ++stats->node_visits;
+
+    if (data.coherent && !FrustumMayHit(data, node, packet_t_max)) {
+      ++stats->frustum_culls;
+      continue;
+    }
+
+    uint8_t masks[kMaxGroups];
+    int num_active = 0;
+
+    for (int group = 0; group < data.num_groups; ++group) {
+      if (entry.masks[group] == 0) {
+        masks[group] = 0;
+        continue;
+      }
+      const int mask =
+          IntersectBoxGroup(packet, data, group * kGroupSize, node) & entry.masks[group];
+      masks[group] = static_cast<uint8_t>(mask);
+      num_active += PopCount(mask);
+    }
+
+    if (num_active == 0)
+      continue;
+
+    if (num_active < kSingleRayThreshold) {
+      // The packet has diverged: finish this subtree one ray at a time.
+      stats->single_rays += num_active;
+
+      for (int group = 0; group < data.num_groups; ++group) {
+        int mask = masks[group];
+        while (mask != 0) {
+          const int i = group * kGroupSize + LowestSetBit(mask);
+          mask &= mask - 1;
+
+          const Ray ray = packet.ray(i);
+          if (kAnyHit) {
+            if (bvh_.OccludedSubtree(entry.node, ray)) {
+              occluded[i] = 1;
+              data.t_limit[i] = -kInfinity;
+            }
+          } else {
+            Hit hit = {hits->t[i], hits->u[i], hits->v[i], hits->triangle[i]};
+            bvh_.IntersectSubtree(entry.node, ray, &hit);
+            hits->t[i] = hit.t;
+            hits->u[i] = hit.u;
+            hits->v[i] = hit.v;
+            hits->triangle[i] = hit.triangle;
+            data.t_limit[i] = hit.t;
+          }
+        }
+      }
+      continue;
+    }
+
+    if (node.is_leaf()) {
+      for (uint32_t i = node.first; i < node.first + node.count; ++i) {
+        const uint32_t triangle = primitive_indices[i];
+        const Vec3& v0 = scene_.position(triangle, 0);
+        const Vec3 edge1 = scene_.position(triangle, 1) - v0;
+        const Vec3 edge2 = scene_.position(triangle, 2) - v0;
+
+        TriangleData triangle_data;
+        for (int axis = 0; axis < 3; ++axis) {
+          triangle_data.v0[axis] = _mm256_set1_ps(v0[axis]);
+          triangle_data.edge1[axis] = _mm256_set1_ps(edge1[axis]);
+          triangle_data.edge2[axis] = _mm256_set1_ps(edge2[axis]);
+        }
+
+        for (int group = 0; group < data.num_groups; ++group) {
+          if (masks[group] == 0)
+            continue;
+
+          const int base = group * kGroupSize;
+
+          __m256 t, u, v;
+          int mask = IntersectTriangleGroup(packet, data, base, triangle_data, &t, &u, &v) &
+                     masks[group];
+          if (mask == 0)
+            continue;
+
+          if (kAnyHit) {
+            // Finished rays also drop out of this leaf's remaining triangles.
+            masks[group] &= static_cast<uint8_t>(~mask);
+            while (mask != 0) {
+              const int lane = LowestSetBit(mask);
+              mask &= mask - 1;
+              occluded[base + lane] = 1;
+              data.t_limit[base + lane] = -kInfinity;
+            }
+            continue;
+          }
+
+          alignas(32) float ts[8], us[8], vs[8];
+          _mm256_store_ps(ts, t);
+          _mm256_store_ps(us, u);
+          _mm256_store_ps(vs, v);
+
+          while (mask != 0) {
+            const int lane = LowestSetBit(mask);
+            mask &= mask - 1;
+
+            const int ray = base + lane;
+            Hit current = {hits->t[ray], hits->u[ray], hits->v[ray], hits->triangle[ray]};
+            if (IsCloser(ts[lane], triangle, current)) {
+              hits->t[ray] = ts[lane];
+              hits->u[ray] = us[lane];
+              hits->v[ray] = vs[lane];
+              hits->triangle[ray] = triangle;
+              data.t_limit[ray] = ts[lane];
+            }
+          }
+        }
+      }
+
+      packet_t_max = -kInfinity;
+      for (int i = 0; i < packet.num_rays; ++i)
+        packet_t_max = std::max(packet_t_max, data.t_limit[i]);
+      if (packet_t_max == -kInfinity)
+        break;
+
+      continue;
+    }
+
+    // Visit the child nearer along the packet's direction first.
+    const BvhNode& left = nodes[node.first];
+    const BvhNode& right = nodes[node.first + 1];
+    const Vec3 separation = (right.bounds_min + right.bounds_max) -
+                            (left.bounds_min + left.bounds_max);
+    const bool left_first = Dot(separation, data.direction) >= 0.f;
+
+    StackEntry& far_entry = stack[stack_size++];
+    far_entry.node = left_first ? node.first + 1 : node.first;
+    std::copy(masks, masks + data.num_groups, far_entry.masks);
+
+    StackEntry& near_entry = stack[stack_size++];
+    near_entry.node = left_first ? node.first : node.first + 1;
+    std::copy(masks, masks + data.num_groups, near_entry.masks);
+  }
+}
\ No newline at end of file
@@ -0,0 +1,71 @@
+#ifndef PACKET_TRAVERSAL_H_
+#define PACKET_TRAVERSAL_H_
+
+#include <cstdint>
+
+#include "bvh.h"
+#include "ray.h"
+#include "scene.h"
+
+// Largest packet: one 16x16 block of pixels.
+constexpr int kMaxPacketRays = 256;
+
+// Rays traced together, as structure of arrays so groups of eight fill an AVX2 register.
+struct alignas(32) RayPacket {
+  float origin[3][kMaxPacketRays];
+  float direction[3][kMaxPacketRays];
+  float t_min[kMaxPacketRays];
+  float t_max[kMaxPacketRays];
+  int num_rays = 0;
+
+  void Add(const Ray& ray);
+  Ray ray(int index) const;
+};
+
+struct alignas(32) PacketHits {
+  float t[kMaxPacketRays];
+  float u[kMaxPacketRays];
+  float v[kMaxPacketRays];
+  uint32_t triangle[kMaxPacketRays];
+};
+
+// How much of the work stayed in packet form.
+struct PacketStats {
+  uint64_t packets = 0;
+  // Packets whose directions disagree in sign on some axis, which disables the frustum test.
+  uint64_t incoherent_packets = 0;
+  uint64_t node_visits = 0;
+  // Nodes culled for the whole packet by the frustum test alone.
+  uint64_t frustum_culls = 0;
+  // Subtrees handed to single-ray traversal after the packet thinned out, counted per ray.
+  uint64_t single_rays = 0;
+};
+
+// Packet traversal of the binary Bvh. Every visited node is tested against the packet's rays
+// eight at a time, after an interval-arithmetic frustum test that can cull the node for the
+// whole packet at once. Once fewer than a handful of rays remain active below a node, the
+// packet has diverged and those rays finish the subtree with single-ray traversal. Results are
+// the same as Bvh::Intersect and Bvh::Occluded.
+//
+// packet_traversal.cpp is compiled for AVX2, so only construct this when CpuSupportsAvx2()
+// returns true.
+class PacketTraversal {
+public:
+  PacketTraversal(const Scene& scene, const Bvh& bvh);
+
+  // Closest hit for each ray; misses have triangle kInvalidTriangle.
+  void Intersect(const RayPacket& packet, PacketHits* hits, PacketStats* stats) const;
+
+  // Sets occluded[i] to whether ray i hits anything.
+  void Occluded(const RayPacket& packet, uint8_t* occluded, PacketStats* stats) const;
+
+private:
+  template <bool kAnyHit>
+  void Traverse(const RayPacket& packet, PacketHits* hits, uint8_t* occluded,
+                PacketStats* stats) const;
+
+  const Scene& scene_;
+  const Bvh& bvh_;
+};
+
+#endif  // PACKET_TRAVERSAL_H_
\ No newline at end of file
@@ -0,0 +1,22 @@
+#ifndef RANDOM_H_
+#define RANDOM_H_
+
+#include <cstdint>
+
+// Integer hash with good avalanche, from "Hash Functions for GPU Rendering" (Jarzynski and Olano
+// 2020), as used in PCG.
+inline uint32_t PcgHash(uint32_t value) {
+  const uint32_t state = value * 747796405u + 2891336453u;
+  const uint32_t word = ((state >> ((state >> 28u) + 4u)) ^ state) * 277803737u;
+  return (word >> 22u) ^ word;
+}
+
+// Counter-based random number in [0, 1): the same pixel, sample and dimension always give the
+// same value, so paths carry no generator state and the result does not depend on which thread or
+// stage draws it.
+inline float RandomFloat(uint32_t pixel, uint32_t sample, uint32_t dimension) {
+  const uint32_t hash = PcgHash(pixel ^ PcgHash(sample ^ PcgHash(dimension)));
+  return static_cast<float>(hash >> 8) * (1.f / 16777216.f);
+}
+
+#endif  // RANDOM_H_
\ No newline at end of file
@@ -0,0 +1,151 @@
+#ifndef RASTER_TILE_H_
+#define RASTER_TILE_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "vec_math.h"
+
+// Building blocks the CPU rasterizers share: clipping, triangle setup, binning into screen tiles
+// and the tile kernels.
+
+// Screen tiles are kRasterTileSize pixels square; each is rasterized by one thread.
+constexpr int kRasterTileSize = 64;
+
+// Vertices are snapped to 1/16 pixel, so edge functions are exact in integers and triangles that
+// share an edge never both cover, or both miss, a pixel on it.
+constexpr int kSubpixelBits = 4;
+constexpr int kSubpixelScale = 1 << kSubpixelBits;
+
+// Id buffer value of pixels no triangle covers.
+constexpr uint32_t kNoTriangle = 0xffffffff;
+
+// A clipped, front-facing screen-space triangle, wound so its edge functions are positive inside.
+// Only what the depth test needs, so tiles stream through as few cache lines as possible.
+struct RasterTriangle {
+  // Snapped vertices in pixels times kSubpixelScale.
+  int32_t x[3];
+  int32_t y[3];
+
+  // Pixels whose centers can be covered: [min_x, max_x] x [min_y, max_y], inside the viewport.
+  int32_t min_x;
+  int32_t min_y;
+  int32_t max_x;
+  int32_t max_y;
+
+  // Depth at a pixel center (cx, cy) is z0 + dz_dx * (cx - x0) + dz_dy * (cy - y0), where
+  // (x0, y0) is vertex 0 in pixels.
+  float z0;
+  float dz_dx;
+  float dz_dy;
+};
+
+// Triangles are clipped to the near (z >= 0) and far (z <= w) planes, and to a guard band only
+// where they reach far off screen. The guard band keeps snapped coordinates within
+// kMaxGuardBandPixels of the origin, so edge functions over a tile fit in 32 bits and over the
+// whole guard band in 64.
+constexpr int kMaxGuardBandPixels = 8192;
+constexpr int kNumClipPlanes = 6;
+constexpr int kMaxClipVertices = 3 + kNumClipPlanes;
+
+// Half-extent of the guard band, as a multiple of w, for a target |size| pixels across.
+inline float GuardBand(int size) { return 2.f * kMaxGuardBandPixels / size - 1.f; }
+
+// A vertex of a clipped triangle, with the barycentric weights of the original triangle's vertices
+// to interpolate attributes with.
+struct ClippedVertex {
+  Vec4 position;
+  float weights[3];
+};
+
+// Clips the clip-space triangle (a, b, c) with Sutherland-Hodgman, only against the planes it
+// crosses. Writes the convex polygon left to |polygon| and returns its vertex count, which is
+// below 3 when nothing is left.
+int ClipTriangle(const Vec4& a, const Vec4& b, const Vec4& c, float guard_x, float guard_y,
+                 ClippedVertex* polygon);
+
+// A clipped vertex after the viewport transform to a target, snapped to kSubpixelScale.
+struct ProjectedVertex {
+  int32_t x;
+  int32_t y;
+  float z;
+  float inv_w;
+};
+
+// Applies the viewport transform of a |width| x |height| target to the clip-space |position|.
+ProjectedVertex ProjectVertex(const Vec4& position, int width, int height);
+
+// Sets up the triangle (a, b, c) on a |width| x |height| target. Returns false if it is
+// back-facing (counterclockwise on screen, as D3D12_CULL_MODE_BACK culls by default), has no area
+// or covers no pixel center.
+bool SetUpTriangle(const ProjectedVertex& a, const ProjectedVertex& b, const ProjectedVertex& c,
+                   int width, int height, RasterTriangle* triangle);
+
+// Triangles binned by screen tile with a counting sort: tile t holds ids[tile_offsets[t]] up to
+// ids[tile_offsets[t + 1]], in the order the triangles were added.
+struct TileBins {
+  std::vector<RasterTriangle> triangles;
+  std::vector<uint32_t> tile_offsets;
+  std::vector<uint16_t> ids;
+
+  // Fills the bins for a target of |tiles_x| x |tiles_y| tiles from the triangles.
+  void Bin(int tiles_x, int tiles_y);
+};
+
+// TileBins ids are 16 bits.
+constexpr size_t kMaxBinnedTriangles = 1 << 16;
+
+// Where a tile's results go: rows of |stride| pixels in the depth and id buffers.
+struct RasterTarget {
+  float* depth;
+  uint32_t* ids;
+  int stride;
+};
+
+// Depth tests triangles |ids| (indices into |triangles|, in draw order) over the pixels
+// [x0, x1) x [y0, y1) of one tile with the less-than test. Where a triangle is closer, writes its
+// depth and id_base + its index. Both versions give bit-identical results.
+void RasterizeTileScalar(const RasterTriangle* triangles, const uint16_t* ids, size_t count,
+                         uint32_t id_base, int x0, int y0, int x1, int y1,
+                         const RasterTarget& target);
+
+// raster_tile_avx2.cpp is compiled for AVX2, so only call this when CpuSupportsAvx2() returns true.
+void RasterizeTileAvx2(const RasterTriangle* triangles, const uint16_t* ids, size_t count,
+                       uint32_t id_base, int x0, int y0, int x1, int y1,
+                       const RasterTarget& target);
+
+// Runs the tile kernel over the triangles of |bins| in tile |tile|, which covers the pixels
+// [x0, x1) x [y0, y1).
+void RasterizeBinnedTile(const TileBins& bins, int tile, uint32_t id_base, int x0, int y0, int x1,
+                         int y1, bool use_avx2, const RasterTarget& target);
+
+// Edge functions of one triangle over a block of pixels. Edge k runs from vertex k to vertex
+// k + 1 and is e[k] at the block's first pixel center, plus step_x[k] per pixel to the right and
+// step_y[k] per pixel down. Pixels are covered where all three are >= 0; edges that are not top or
+// left edges are biased by -1 so pixel centers exactly on them are left to the neighbour.
+struct EdgeSetup {
+  int32_t e[3];
+  int32_t step_x[3];
+  int32_t step_y[3];
+};
+
+// Vertex 0 of |triangle| in pixels.
+inline float VertexX(const RasterTriangle& triangle) {
+  return static_cast<float>(triangle.x[0]) * (1.f / kSubpixelScale);
+}
+inline float VertexY(const RasterTriangle& triangle) {
+  return static_cast<float>(triangle.y[0]) * (1.f / kSubpixelScale);
+}
+
+// Depth of |triangle|'s plane on row |y| of pixel centers, directly below or above vertex 0. Both
+// kernels add dz_dx * (cx - x0) to it. Defined out of line, away from the AVX2 code, so the two
+// kernels round it the same way.
+float RowDepth(const RasterTriangle& triangle, int y);
+
+// Sets up the edges of |triangle| over the pixels [x0, x1] x [y0, y1], inclusive. Returns false if
+// the triangle covers none of them. Edges that cover all of them get zero values and steps, so the
+// integers stay small however large the triangle is.
+bool SetUpEdges(const RasterTriangle& triangle, int x0, int y0, int x1, int y1, EdgeSetup* setup);
+
+#endif  // RASTER_TILE_H_
\ No newline at end of file
@@ -0,0 +1,88 @@
+#include "raster_tile.h"
+
+#include <immintrin.h>
+
+#include <algorithm>
+
+// Same loops as RasterizeTileScalar, eight pixels of a row at a time. The last group of a row may
+// reach past the block, even past the buffer, but the depth test loads and stores only the covered
+// lanes.
+void RasterizeTileAvx2(const RasterTriangle* triangles, const uint16_t* ids, size_t count,
+                       uint32_t id_base, int x0, int y0, int x1, int y1,
+                       const RasterTarget& target) {
+  const __m256i lanes = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+  const __m256 half = _mm256_set1_ps(0.5f);
+  const __m256 zero = _mm256_setzero_ps();
+  const __m256 one = _mm256_set1_ps(1.f);
+
+  for (size_t i = 0; i < count; ++i) {
+    const RasterTriangle& triangle = triangles[ids[i]];
+
+    const int block_x0 = std::max(x0, triangle.min_x);
+    const int block_y0 = std::max(y0, triangle.min_y);
+    const int block_x1 = std::min(x1 - 1, triangle.max_x);
+    const int block_y1 = std::min(y1 - 1, triangle.max_y);
+    if (block_x0 > block_x1 || block_y0 > block_y1)
+      continue;
+
+    EdgeSetup edges;
+    if (!SetUpEdges(triangle, block_x0, block_y0, block_x1, block_y1, &edges))
+      continue;
+
+    const __m256i id = _mm256_set1_epi32(static_cast<int>(id_base + ids[i]));
+    const __m256i block_end = _mm256_set1_epi32(block_x1 + 1);
+    const __m256 dz_dx = _mm256_set1_ps(triangle.dz_dx);
+    const __m256 vertex_x = _mm256_set1_ps(VertexX(triangle));
+
+    // Edge values of the row's first eight pixels, and their steps.
+    __m256i row_e[3];
+    __m256i step_x[3];
+    __m256i step_y[3];
+    for (int edge = 0; edge < 3; ++edge) {
+      row_e[edge] = _mm256_add_epi32(
+          _mm256_set1_epi32(edges.e[edge]),
+          _mm256_mullo_epi32(lanes, _mm256_set1_epi32(edges.step_x[edge])));
+      step_x[edge] = _mm256_set1_epi32(edges.step_x[edge] * 8);
+      step_y[edge] = _mm256_set1_epi32(edges.step_y[edge]);
+    }
+
+    for (int y = block_y0; y <= block_y1; ++y) {
+      float* depth = target.depth + static_cast<size_t>(y) * target.stride;
+      uint32_t* pixel_ids = target.ids + static_cast<size_t>(y) * target.stride;
+      const __m256 row_z = _mm256_set1_ps(RowDepth(triangle, y));
+
+      __m256i e0 = row_e[0];
+      __m256i e1 = row_e[1];
+      __m256i e2 = row_e[2];
+      for (int x = block_x0; x <= block_x1; x += 8) {
+        const __m256i columns = _mm256_add_epi32(_mm256_set1_epi32(x), lanes);
+
+        // All three edges non-negative, within the block.
+        const __m256i outside = _mm256_or_si256(_mm256_or_si256(e0, e1), e2);
+        const __m256i covered =
+            _mm256_andnot_si256(_mm256_srai_epi32(outside, 31),
+                                _mm256_cmpgt_epi32(block_end, columns));
+
+        if (!_mm256_testz_si256(covered, covered)) {
+          const __m256 center_x = _mm256_add_ps(_mm256_cvtepi32_ps(columns), half);
+          __m256 z = _mm256_add_ps(row_z,
+                                   _mm256_mul_ps(dz_dx, _mm256_sub_ps(center_x, vertex_x)));
+          z = _mm256_min_ps(_mm256_max_ps(z, zero), one);
+
+          const __m256 old_z = _mm256_maskload_ps(depth + x, covered);
+          const __m256i closer = _mm256_and_si256(
+              covered, _mm256_castps_si256(_mm256_cmp_ps(z, old_z, _CMP_LT_OQ)));
+          _mm256_maskstore_ps(depth + x, closer, z);
+          _mm256_maskstore_epi32(reinterpret_cast<int*>(pixel_ids + x), closer, id);
+        }
+
+        e0 = _mm256_add_epi32(e0, step_x[0]);
+        e1 = _mm256_add_epi32(e1, step_x[1]);
+        e2 = _mm256_add_epi32(e2, step_x[2]);
+      }
+
+      for (int edge = 0; edge < 3; ++edge)
+        row_e[edge] = _mm256_add_epi32(row_e[edge], step_y[edge]);
+    }
+  }
+}
\ No newline at end of file
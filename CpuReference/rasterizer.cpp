@@ -0,0 +1,562 @@
+#include "rasterizer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+#include <string>
+
+#include "gbuffer_encoding.h"
+#include "profiling.h"
+
+namespace {
+
+// Vertices per task of the vertex stage, and input triangles per setup chunk.
+constexpr size_t kVertexChunkSize = 4096;
+constexpr size_t kSetupChunkSize = 2048;
+
+// Clipping a triangle against the six planes leaves at most nine vertices, which make seven
+// triangles, so a setup chunk holds fewer than 2^kLocalIdBits of them. Triangle ids are the chunk
+// index above those bits and the index in the chunk below.
+constexpr int kLocalIdBits = 14;
+constexpr uint32_t kLocalIdMask = (1u << kLocalIdBits) - 1;
+
+static_assert(kSetupChunkSize * (kMaxClipVertices - 2) <= (1u << kLocalIdBits),
+              "setup chunks must fit in the local ids");
+static_assert((1u << kLocalIdBits) <= kMaxBinnedTriangles, "setup chunks must fit in TileBins");
+
+// Clear values of App::RenderGeometryPass: (0, 0, 0, 1) for every target and 1 for depth.
+constexpr uint32_t kClearColor = 0xff000000;
+constexpr Vec4 kClearVector = {0.f, 0.f, 0.f, 1.f};
+constexpr float kClearDepth = 1.f;
+
+// Rounds |value| in [0, 1] to 8 bits, as an R8G8B8A8_UNORM render target stores it.
+uint32_t ToUnorm8(float value) {
+  return static_cast<uint32_t>(std::floor(Saturate(value) * 255.f + 0.5f));
+}
+
+uint32_t PackUnorm4x8(const Vec4& color) {
+  return ToUnorm8(color.x) | (ToUnorm8(color.y) << 8) | (ToUnorm8(color.z) << 16) |
+         (ToUnorm8(color.w) << 24);
+}
+
+// Rounds towards negative infinity, unlike integer division.
+int32_t FloorDiv(int32_t value, int32_t divisor) {
+  return value >= 0 ? value / divisor : -((-value + divisor - 1) / divisor);
+}
+
+// Distance of |p| inside clip plane |plane|: near, far, then the guard band's four sides.
+float PlaneDistance(const Vec4& p, int plane, float guard_x, float guard_y) {
+  switch (plane) {
+    case 0: return p.z;
+    case 1: return p.w - p.z;
+    case 2: return guard_x * p.w - p.x;
+    case 3: return guard_x * p.w + p.x;
+    case 4: return guard_y * p.w - p.y;
+    default: return guard_y * p.w + p.y;
+  }
+}
+
+uint32_t Outcode(const Vec4& p, float guard_x, float guard_y) {
+  uint32_t code = 0;
+  for (int plane = 0; plane < kNumClipPlanes; ++plane) {
+    if (PlaneDistance(p, plane, guard_x, guard_y) < 0.f)
+      code |= 1u << plane;
+  }
+  return code;
+}
+
+// Calls |fn(tile)| for every tile |triangle|'s bounds touch.
+template <typename Fn>
+void ForEachTile(const RasterTriangle& triangle, int tiles_x, Fn fn) {
+  for (int ty = triangle.min_y / kRasterTileSize; ty <= triangle.max_y / kRasterTileSize; ++ty) {
+    for (int tx = triangle.min_x / kRasterTileSize; tx <= triangle.max_x / kRasterTileSize; ++tx)
+      fn(ty * tiles_x + tx);
+  }
+}
+
+}  // namespace
+
+void Gbuffer::Resize(int new_width, int new_height) {
+  width = new_width;
+  height = new_height;
+
+  const size_t num_pixels = static_cast<size_t>(width) * height;
+  ambient.resize(num_pixels);
+  position.resize(num_pixels);
+  diffuse.resize(num_pixels);
+  normal.resize(num_pixels);
+  material.resize(num_pixels);
+  depth.resize(num_pixels);
+}
+
+std::vector<uint32_t> PackMaterialColors(const DeferredScene& scene) {
+  // The colors were written with alpha 1.
+  std::vector<uint32_t> colors(scene.materials().size() * 2);
+  for (size_t i = 0; i < scene.materials().size(); ++i) {
+    Vec4 ambient = scene.materials()[i].ambient_color;
+    Vec4 diffuse = scene.materials()[i].diffuse_color;
+    ambient.w = 1.f;
+    diffuse.w = 1.f;
+    colors[i * 2] = PackUnorm4x8(ambient);
+    colors[i * 2 + 1] = PackUnorm4x8(diffuse);
+  }
+  return colors;
+}
+
+int ClipTriangle(const Vec4& a, const Vec4& b, const Vec4& c, float guard_x, float guard_y,
+                 ClippedVertex* polygon) {
+  const uint32_t codes[3] = {Outcode(a, guard_x, guard_y), Outcode(b, guard_x, guard_y),
+                             Outcode(c, guard_x, guard_y)};
+
+  // Entirely outside one plane.
+  if (codes[0] & codes[1] & codes[2])
+    return 0;
+
+  polygon[0] = {a, {1.f, 0.f, 0.f}};
+  polygon[1] = {b, {0.f, 1.f, 0.f}};
+  polygon[2] = {c, {0.f, 0.f, 1.f}};
+  int num_vertices = 3;
+
+  const uint32_t crossed = codes[0] | codes[1] | codes[2];
+  for (int plane = 0; plane < kNumClipPlanes && num_vertices > 0; ++plane) {
+    if (!(crossed & (1u << plane)))
+      continue;
+
+    // Keeps the inside vertices and adds one where each edge crosses.
+    ClippedVertex clipped[kMaxClipVertices];
+    int num_clipped = 0;
+    for (int i = 0; i < num_vertices; ++i) {
+      const ClippedVertex& from = polygon[i];
+      const ClippedVertex& to = polygon[i + 1 == num_vertices ? 0 : i + 1];
+      const float distance_from = PlaneDistance(from.position, plane, guard_x, guard_y);
+      const float distance_to = PlaneDistance(to.position, plane, guard_x, guard_y);
+
+      if (distance_from >= 0.f)
+        clipped[num_clipped++] = from;
+      if ((distance_from >= 0.f) != (distance_to >= 0.f)) {
+        const float t = distance_from / (distance_from - distance_to);
+        ClippedVertex& v = clipped[num_clipped++];
+        for (int axis = 0; axis < 4; ++axis)
+          v.position[axis] = Lerp(from.position[axis], to.position[axis], t);
+        for (int k = 0; k < 3; ++k)
+          v.weights[k] = Lerp(from.weights[k], to.weights[k], t);
+      }
+    }
+
+    std::copy(clipped, clipped + num_clipped, polygon);
+    num_vertices = num_clipped;
+  }
+  return num_vertices;
+}
+
+ProjectedVertex ProjectVertex(const Vec4& position, int width, int height) {
+  ProjectedVertex result;
+  result.inv_w = 1.f / position.w;
+  const float screen_x = (position.x * result.inv_w * 0.5f + 0.5f) * width;
+  const float screen_y = (0.5f - position.y * result.inv_w * 0.5f) * height;
+  result.x = static_cast<int32_t>(std::floor(screen_x * kSubpixelScale + 0.5f));
+  result.y = static_cast<int32_t>(std::floor(screen_y * kSubpixelScale + 0.5f));
+  result.z = position.z * result.inv_w;
+  return result;
+}
+
+bool SetUpTriangle(const ProjectedVertex& a, const ProjectedVertex& b, const ProjectedVertex& c,
+                   int width, int height, RasterTriangle* triangle) {
+  const ProjectedVertex* corners[3] = {&a, &b, &c};
+  for (int k = 0; k < 3; ++k) {
+    triangle->x[k] = corners[k]->x;
+    triangle->y[k] = corners[k]->y;
+  }
+
+  // Twice the signed area, positive for clockwise triangles on screen, which face the camera.
+  const int64_t area = (static_cast<int64_t>(b.x) - a.x) * (static_cast<int64_t>(c.y) - a.y) -
+                       (static_cast<int64_t>(c.x) - a.x) * (static_cast<int64_t>(b.y) - a.y);
+  if (area <= 0)
+    return false;
+
+  // Pixels whose centers, at 16 * x + 8, fall in the bounding box.
+  const int32_t min_x = std::min({a.x, b.x, c.x});
+  const int32_t min_y = std::min({a.y, b.y, c.y});
+  const int32_t max_x = std::max({a.x, b.x, c.x});
+  const int32_t max_y = std::max({a.y, b.y, c.y});
+  const int32_t half = kSubpixelScale / 2;
+  triangle->min_x = std::max(0, FloorDiv(min_x - half + kSubpixelScale - 1, kSubpixelScale));
+  triangle->min_y = std::max(0, FloorDiv(min_y - half + kSubpixelScale - 1, kSubpixelScale));
+  triangle->max_x = std::min(width - 1, FloorDiv(max_x - half, kSubpixelScale));
+  triangle->max_y = std::min(height - 1, FloorDiv(max_y - half, kSubpixelScale));
+  if (triangle->min_x > triangle->max_x || triangle->min_y > triangle->max_y)
+    return false;
+
+  // Depth plane through the snapped vertices, which is what the hardware interpolates.
+  const float x0 = VertexX(*triangle);
+  const float y0 = VertexY(*triangle);
+  const float dx1 = static_cast<float>(b.x) * (1.f / kSubpixelScale) - x0;
+  const float dy1 = static_cast<float>(b.y) * (1.f / kSubpixelScale) - y0;
+  const float dx2 = static_cast<float>(c.x) * (1.f / kSubpixelScale) - x0;
+  const float dy2 = static_cast<float>(c.y) * (1.f / kSubpixelScale) - y0;
+  const float dz1 = b.z - a.z;
+  const float dz2 = c.z - a.z;
+  const float inv_det = 1.f / (dx1 * dy2 - dx2 * dy1);
+  triangle->z0 = a.z;
+  triangle->dz_dx = (dz1 * dy2 - dz2 * dy1) * inv_det;
+  triangle->dz_dy = (dx1 * dz2 - dx2 * dz1) * inv_det;
+  return true;
+}
+
+void TileBins::Bin(int tiles_x, int tiles_y) {
+  const int num_tiles = tiles_x * tiles_y;
+  tile_offsets.assign(num_tiles + 1, 0);
+
+  for (const RasterTriangle& triangle : triangles)
+    ForEachTile(triangle, tiles_x, [this](int tile) { ++tile_offsets[tile]; });
+
+  // Turns the counts into the end of each tile's range, then fills the ranges from the back, in
+  // reverse order. Each ends up in the order the triangles were added and starting at its offset.
+  for (int tile = 1; tile < num_tiles; ++tile)
+    tile_offsets[tile] += tile_offsets[tile - 1];
+  tile_offsets[num_tiles] = num_tiles > 0 ? tile_offsets[num_tiles - 1] : 0;
+
+  ids.resize(tile_offsets[num_tiles]);
+  for (size_t i = triangles.size(); i-- > 0;) {
+    ForEachTile(triangles[i], tiles_x, [this, i](int tile) {
+      ids[--tile_offsets[tile]] = static_cast<uint16_t>(i);
+    });
+  }
+}
+
+void RasterizeBinnedTile(const TileBins& bins, int tile, uint32_t id_base, int x0, int y0, int x1,
+                         int y1, bool use_avx2, const RasterTarget& target) {
+  const uint32_t begin = bins.tile_offsets[tile];
+  const uint32_t count = bins.tile_offsets[tile + 1] - begin;
+  if (count == 0)
+    return;
+
+  if (use_avx2) {
+    RasterizeTileAvx2(bins.triangles.data(), &bins.ids[begin], count, id_base, x0, y0, x1, y1,
+                      target);
+  } else {
+    RasterizeTileScalar(bins.triangles.data(), &bins.ids[begin], count, id_base, x0, y0, x1, y1,
+                        target);
+  }
+}
+
+float RowDepth(const RasterTriangle& triangle, int y) {
+  return triangle.z0 + triangle.dz_dy * (static_cast<float>(y) + 0.5f - VertexY(triangle));
+}
+
+bool SetUpEdges(const RasterTriangle& triangle, int x0, int y0, int x1, int y1, EdgeSetup* setup) {
+  const int64_t center_x = static_cast<int64_t>(x0) * kSubpixelScale + kSubpixelScale / 2;
+  const int64_t center_y = static_cast<int64_t>(y0) * kSubpixelScale + kSubpixelScale / 2;
+
+  for (int edge = 0; edge < 3; ++edge) {
+    const int next = edge == 2 ? 0 : edge + 1;
+    const int64_t a = static_cast<int64_t>(triangle.y[edge]) - triangle.y[next];
+    const int64_t b = static_cast<int64_t>(triangle.x[next]) - triangle.x[edge];
+
+    // With positive area and y down, top edges run to the right and left edges run up.
+    const bool top_left = a > 0 || (a == 0 && b > 0);
+
+    const int64_t e = a * (center_x - triangle.x[edge]) + b * (center_y - triangle.y[edge]) -
+                      (top_left ? 0 : 1);
+    const int64_t step_x = a * kSubpixelScale;
+    const int64_t step_y = b * kSubpixelScale;
+
+    // The edge function is linear, so its extremes over the block are at the corners.
+    const int64_t across = step_x * (x1 - x0);
+    const int64_t down = step_y * (y1 - y0);
+    const int64_t min_e = e + std::min<int64_t>(across, 0) + std::min<int64_t>(down, 0);
+    const int64_t max_e = e + std::max<int64_t>(across, 0) + std::max<int64_t>(down, 0);
+
+    if (max_e < 0)
+      return false;
+
+    if (min_e >= 0) {
+      setup->e[edge] = 0;
+      setup->step_x[edge] = 0;
+      setup->step_y[edge] = 0;
+    } else {
+      setup->e[edge] = static_cast<int32_t>(e);
+      setup->step_x[edge] = static_cast<int32_t>(step_x);
+      setup->step_y[edge] = static_cast<int32_t>(step_y);
+    }
+  }
+  return true;
+}
+
+void RasterizeTileScalar(const RasterTriangle* triangles, const uint16_t* ids, size_t count,
+                         uint32_t id_base, int x0, int y0, int x1, int y1,
+                         const RasterTarget& target) {
+  for (size_t i = 0; i < count; ++i) {
+    const RasterTriangle& triangle = triangles[ids[i]];
+
+    const int block_x0 = std::max(x0, triangle.min_x);
+    const int block_y0 = std::max(y0, triangle.min_y);
+    const int block_x1 = std::min(x1 - 1, triangle.max_x);
+    const int block_y1 = std::min(y1 - 1, triangle.max_y);
+    if (block_x0 > block_x1 || block_y0 > block_y1)
+      continue;
+
+    EdgeSetup edges;
+    if (!SetUpEdges(triangle, block_x0, block_y0, block_x1, block_y1, &edges))
+      continue;
+
+    const uint32_t id = id_base + ids[i];
+    const float vertex_x = VertexX(triangle);
+    int32_t row_e[3] = {edges.e[0], edges.e[1], edges.e[2]};
+
+    for (int y = block_y0; y <= block_y1; ++y) {
+      float* depth = target.depth + static_cast<size_t>(y) * target.stride;
+      uint32_t* pixel_ids = target.ids + static_cast<size_t>(y) * target.stride;
+      const float row_z = RowDepth(triangle, y);
+
+      int32_t e0 = row_e[0];
+      int32_t e1 = row_e[1];
+      int32_t e2 = row_e[2];
+      for (int x = block_x0; x <= block_x1; ++x) {
+        if ((e0 | e1 | e2) >= 0) {
+          float z = row_z + triangle.dz_dx * (static_cast<float>(x) + 0.5f - vertex_x);
+          z = std::min(std::max(z, 0.f), 1.f);
+          if (z < depth[x]) {
+            depth[x] = z;
+            pixel_ids[x] = id;
+          }
+        }
+        e0 += edges.step_x[0];
+        e1 += edges.step_x[1];
+        e2 += edges.step_x[2];
+      }
+
+      for (int edge = 0; edge < 3; ++edge)
+        row_e[edge] += edges.step_y[edge];
+    }
+  }
+}
+
+GbufferRasterizer::GbufferRasterizer(ThreadPool* pool, bool use_avx2)
+    : pool_(pool), use_avx2_(use_avx2) {}
+
+RasterStats GbufferRasterizer::Render(const DeferredScene& scene,
+                                      const DeferredConstants& constants, Gbuffer* gbuffer) {
+  if (scene.materials().size() > kMaxGbufferMaterials) {
+    throw std::runtime_error("the G-buffer cannot index more than " +
+                             std::to_string(kMaxGbufferMaterials) + " materials");
+  }
+
+  const int width = gbuffer->width;
+  const int height = gbuffer->height;
+
+  guard_band_x_ = GuardBand(width);
+  guard_band_y_ = GuardBand(height);
+  tiles_x_ = (width + kRasterTileSize - 1) / kRasterTileSize;
+  tiles_y_ = (height + kRasterTileSize - 1) / kRasterTileSize;
+  ids_.resize(static_cast<size_t>(width) * height);
+
+  RasterStats stats;
+  stats.triangles = scene.num_triangles();
+
+  Stopwatch stopwatch;
+  ShadeVertices(scene, constants);
+  stats.vertex_seconds = stopwatch.ElapsedSeconds();
+
+  stopwatch.Restart();
+  const size_t num_chunks = (first_triangle_.back() + kSetupChunkSize - 1) / kSetupChunkSize;
+  if (num_chunks > (1u << (32 - kLocalIdBits)) - 1)
+    throw std::runtime_error("too many triangles for the rasterizer's ids");
+  chunks_.resize(num_chunks);
+  pool_->ParallelFor(static_cast<int>(num_chunks), [&](int chunk, int) {
+    SetUpTriangles(scene, *gbuffer, chunk);
+  });
+  stats.setup_seconds = stopwatch.ElapsedSeconds();
+
+  for (const SetupChunk& chunk : chunks_) {
+    stats.rasterized += chunk.bins.triangles.size();
+    stats.bin_entries += chunk.bins.ids.size();
+  }
+
+  stopwatch.Restart();
+  pool_->ParallelFor(tiles_x_ * tiles_y_, [&](int tile, int) { RasterizeTile(tile, gbuffer); });
+  stats.raster_seconds = stopwatch.ElapsedSeconds();
+
+  stopwatch.Restart();
+  material_colors_ = PackMaterialColors(scene);
+  pool_->ParallelFor(height, [&](int row, int) { Resolve(row, gbuffer); });
+  stats.resolve_seconds = stopwatch.ElapsedSeconds();
+
+  return stats;
+}
+
+void GbufferRasterizer::ShadeVertices(const DeferredScene& scene,
+                                      const DeferredConstants& constants) {
+  const std::vector<DrawCallArgs>& draws = scene.draw_call_args();
+
+  first_vertex_.resize(draws.size() + 1);
+  first_triangle_.resize(draws.size() + 1);
+  first_vertex_[0] = 0;
+  first_triangle_[0] = 0;
+  for (size_t i = 0; i < draws.size(); ++i) {
+    first_vertex_[i + 1] = first_vertex_[i] + draws[i].vertex_count;
+    first_triangle_[i + 1] = first_triangle_[i] + draws[i].index_count / 3;
+  }
+  vertices_.resize(first_vertex_.back());
+
+  const size_t num_chunks = (vertices_.size() + kVertexChunkSize - 1) / kVertexChunkSize;
+  pool_->ParallelFor(static_cast<int>(num_chunks), [&](int chunk, int) {
+    const size_t begin = chunk * kVertexChunkSize;
+    const size_t end = std::min(begin + kVertexChunkSize, vertices_.size());
+
+    size_t draw = std::upper_bound(first_vertex_.begin(), first_vertex_.end(), begin) -
+                  first_vertex_.begin() - 1;
+    for (size_t i = begin; i < end; ++i) {
+      while (i >= first_vertex_[draw + 1])
+        ++draw;
+
+      const DrawCallArgs& args = draws[draw];
+      const scene_cache::Vertex& vertex =
+          args.vertices[args.vertex_offset + static_cast<int64_t>(i - first_vertex_[draw])];
+      const Vec4 position = {vertex.position.x, vertex.position.y, vertex.position.z, 1.f};
+      const Vec4 normal = {vertex.normal.x, vertex.normal.y, vertex.normal.z, 0.f};
+
+      ClipVertex& out = vertices_[i];
+      out.clip_pos = MulConstant(position, constants.world_view_proj_mat);
+      out.view_pos = MulConstant(position, constants.world_view_mat).xyz();
+      out.normal = MulConstant(normal, constants.world_view_mat).xyz();
+    }
+  });
+}
+
+void GbufferRasterizer::SetUpTriangles(const DeferredScene& scene, const Gbuffer& gbuffer,
+                                       int chunk_index) {
+  const std::vector<DrawCallArgs>& draws = scene.draw_call_args();
+  SetupChunk& chunk = chunks_[chunk_index];
+  chunk.bins.triangles.clear();
+  chunk.attributes.clear();
+
+  const size_t begin = chunk_index * kSetupChunkSize;
+  const size_t end = std::min(begin + kSetupChunkSize, first_triangle_.back());
+
+  size_t draw = std::upper_bound(first_triangle_.begin(), first_triangle_.end(), begin) -
+                first_triangle_.begin() - 1;
+  for (size_t triangle = begin; triangle < end; ++triangle) {
+    while (triangle >= first_triangle_[draw + 1])
+      ++draw;
+
+    const DrawCallArgs& args = draws[draw];
+    const ClipVertex* draw_vertices = &vertices_[first_vertex_[draw]];
+    const uint32_t first_index = static_cast<uint32_t>(triangle - first_triangle_[draw]) * 3;
+
+    const ClipVertex* corners[3];
+    for (int k = 0; k < 3; ++k)
+      corners[k] = &draw_vertices[args.index(first_index + k)];
+
+    ClippedVertex polygon[kMaxClipVertices];
+    const int num_vertices =
+        ClipTriangle(corners[0]->clip_pos, corners[1]->clip_pos, corners[2]->clip_pos,
+                     guard_band_x_, guard_band_y_, polygon);
+    if (num_vertices < 3)
+      continue;
+
+    ProjectedVertex projected[kMaxClipVertices];
+    for (int i = 0; i < num_vertices; ++i)
+      projected[i] = ProjectVertex(polygon[i].position, gbuffer.width, gbuffer.height);
+
+    // Fan around vertex 0.
+    for (int i = 1; i + 1 < num_vertices; ++i) {
+      const int fan[3] = {0, i, i + 1};
+
+      RasterTriangle raster_triangle;
+      if (!SetUpTriangle(projected[0], projected[i], projected[i + 1], gbuffer.width,
+                         gbuffer.height, &raster_triangle)) {
+        continue;
+      }
+
+      TriangleAttributes attributes;
+      for (int k = 0; k < 3; ++k) {
+        const ClippedVertex& vertex = polygon[fan[k]];
+        attributes.screen_x[k] = static_cast<float>(raster_triangle.x[k]) / kSubpixelScale;
+        attributes.screen_y[k] = static_cast<float>(raster_triangle.y[k]) / kSubpixelScale;
+        attributes.inv_w[k] = projected[fan[k]].inv_w;
+        attributes.view_pos[k] = corners[0]->view_pos * vertex.weights[0] +
+                                 corners[1]->view_pos * vertex.weights[1] +
+                                 corners[2]->view_pos * vertex.weights[2];
+        attributes.normal[k] = corners[0]->normal * vertex.weights[0] +
+                               corners[1]->normal * vertex.weights[1] +
+                               corners[2]->normal * vertex.weights[2];
+      }
+      attributes.material_index = args.material_index;
+
+      chunk.bins.triangles.push_back(raster_triangle);
+      chunk.attributes.push_back(attributes);
+    }
+  }
+
+  chunk.bins.Bin(tiles_x_, tiles_y_);
+}
+
+void GbufferRasterizer::RasterizeTile(int tile, Gbuffer* gbuffer) {
+  const int x0 = (tile % tiles_x_) * kRasterTileSize;
+  const int y0 = (tile / tiles_x_) * kRasterTileSize;
+  const int x1 = std::min(x0 + kRasterTileSize, gbuffer->width);
+  const int y1 = std::min(y0 + kRasterTileSize, gbuffer->height);
+
+  const RasterTarget target = {gbuffer->depth.data(), ids_.data(), gbuffer->width};
+  for (int y = y0; y < y1; ++y) {
+    const size_t row = static_cast<size_t>(y) * target.stride;
+    std::fill(target.depth + row + x0, target.depth + row + x1, kClearDepth);
+    std::fill(target.ids + row + x0, target.ids + row + x1, kNoTriangle);
+  }
+
+  for (size_t chunk = 0; chunk < chunks_.size(); ++chunk) {
+    RasterizeBinnedTile(chunks_[chunk].bins, tile, static_cast<uint32_t>(chunk) << kLocalIdBits,
+                        x0, y0, x1, y1, use_avx2_, target);
+  }
+}
+
+void GbufferRasterizer::Resolve(int y, Gbuffer* gbuffer) const {
+  const size_t row = static_cast<size_t>(y) * gbuffer->width;
+  const float center_y = static_cast<float>(y) + 0.5f;
+
+  for (int x = 0; x < gbuffer->width; ++x) {
+    const size_t pixel = row + x;
+    const uint32_t id = ids_[pixel];
+    if (id == kNoTriangle) {
+      gbuffer->ambient[pixel] = kClearColor;
+      gbuffer->position[pixel] = kClearVector;
+      gbuffer->diffuse[pixel] = kClearColor;
+      gbuffer->normal[pixel] = kClearVector;
+      gbuffer->material[pixel] = 0;
+      continue;
+    }
+
+    const TriangleAttributes& triangle =
+        chunks_[id >> kLocalIdBits].attributes[id & kLocalIdMask];
+
+    // Barycentrics at the pixel center from the areas of the sub-triangles opposite each vertex,
+    // weighted by 1 / w for perspective-correct interpolation.
+    const float center_x = static_cast<float>(x) + 0.5f;
+    float weights[3];
+    for (int k = 0; k < 3; ++k) {
+      const int a = k == 2 ? 0 : k + 1;
+      const int b = a == 2 ? 0 : a + 1;
+      const float ax = triangle.screen_x[a] - center_x;
+      const float ay = triangle.screen_y[a] - center_y;
+      const float bx = triangle.screen_x[b] - center_x;
+      const float by = triangle.screen_y[b] - center_y;
+      weights[k] = (ax * by - bx * ay) * triangle.inv_w[k];
+    }
+    const float inv_sum = 1.f / (weights[0] + weights[1] + weights[2]);
+
+    Vec3 view_pos = {0.f, 0.f, 0.f};
+    Vec3 normal = {0.f, 0.f, 0.f};
+    for (int k = 0; k < 3; ++k) {
+      view_pos = view_pos + triangle.view_pos[k] * (weights[k] * inv_sum);
+      normal = normal + triangle.normal[k] * (weights[k] * inv_sum);
+    }
+
+    // The normal is written as interpolated, without normalizing, like geometry_pass_ps.hlsl.
+    gbuffer->ambient[pixel] = material_colors_[triangle.material_index * 2];
+    gbuffer->position[pixel] = {view_pos.x, view_pos.y, view_pos.z, 1.f};
+    gbuffer->diffuse[pixel] = material_colors_[triangle.material_index * 2 + 1];
+    gbuffer->normal[pixel] = {normal.x, normal.y, normal.z, 0.f};
+    gbuffer->material[pixel] = static_cast<uint16_t>(triangle.material_index);
+  }
+}
\ No newline at end of file
@@ -0,0 +1,134 @@
+#ifndef RASTERIZER_H_
+#define RASTERIZER_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "deferred_scene.h"
+#include "raster_tile.h"
+#include "thread_pool.h"
+#include "vec_math.h"
+
+// The G-buffer attributes the lighting pass works with, and the D32_FLOAT depth buffer, row-major
+// from the top-left: ambient and diffuse colors as packed R8G8B8A8_UNORM texels, red in the low
+// byte, view-space positions and normals, and the material index. The app stores only the normal
+// and material index and reconstructs the rest; thin_gbuffer.h converts between the two.
+struct Gbuffer {
+  int width = 0;
+  int height = 0;
+  std::vector<uint32_t> ambient;
+  std::vector<Vec4> position;
+  std::vector<uint32_t> diffuse;
+  std::vector<Vec4> normal;
+  std::vector<uint16_t> material;
+  std::vector<float> depth;
+
+  void Resize(int new_width, int new_height);
+};
+
+struct RasterStats {
+  // Wall time of each stage over the frame.
+  double vertex_seconds = 0.0;
+  double setup_seconds = 0.0;
+  double raster_seconds = 0.0;
+  double resolve_seconds = 0.0;
+
+  // Triangles drawn, and the ones left after clipping and culling. Clipping can split one
+  // triangle into several.
+  uint64_t triangles = 0;
+  uint64_t rasterized = 0;
+  // Triangle-tile pairs the binning produced.
+  uint64_t bin_entries = 0;
+
+  double TotalSeconds() const {
+    return vertex_seconds + setup_seconds + raster_seconds + resolve_seconds;
+  }
+};
+
+// Software version of App::RenderGeometryPass: draws every DrawCallArgs with the same matrices
+// and fixed-function state (back-face culling with clockwise front faces, less-than depth test)
+// into a Gbuffer. A frame runs in four parallel stages:
+//
+//   vertex   geometry_pass_vs.hlsl for every vertex the draws reference
+//   setup    clips triangles to the near and far planes and a guard band, culls back faces,
+//            snaps them to 1/16 pixel and bins them into kRasterTileSize tiles
+//   raster   depth tests each tile's triangles in draw order, keeping the depth and the triangle
+//            of the closest one (a visibility buffer)
+//   resolve  interpolates the closest triangle's attributes with perspective correction and writes
+//            the render targets, as geometry_pass_ps.hlsl would
+//
+// Each pixel is shaded once, and tiles are independent, so every thread works on its own part of
+// the image with no synchronization.
+// Packed ambient and diffuse colors of each of |scene|'s materials, in pairs, as
+// geometry_pass_ps.hlsl wrote them to the G-buffer.
+std::vector<uint32_t> PackMaterialColors(const DeferredScene& scene);
+
+class GbufferRasterizer {
+public:
+  // |use_avx2| picks RasterizeTileAvx2 over RasterizeTileScalar, so it may only be set when
+  // CpuSupportsAvx2() returns true.
+  GbufferRasterizer(ThreadPool* pool, bool use_avx2);
+
+  RasterStats Render(const DeferredScene& scene, const DeferredConstants& constants,
+                     Gbuffer* gbuffer);
+
+private:
+  // geometry_pass_vs.hlsl's outputs, and the view-space position, which the lighting pass
+  // reconstructs from depth.
+  struct ClipVertex {
+    Vec4 clip_pos;
+    Vec3 view_pos;
+    Vec3 normal;
+  };
+
+  // What the resolve interpolates over a RasterTriangle: its vertices in pixels, their 1 / w and
+  // the ClipVertex attributes.
+  struct TriangleAttributes {
+    float screen_x[3];
+    float screen_y[3];
+    float inv_w[3];
+    Vec3 view_pos[3];
+    Vec3 normal[3];
+    uint32_t material_index;
+  };
+
+  // Triangles set up from one run of consecutive input triangles, binned by tile, and their
+  // attributes.
+  struct SetupChunk {
+    TileBins bins;
+    std::vector<TriangleAttributes> attributes;
+  };
+
+  void ShadeVertices(const DeferredScene& scene, const DeferredConstants& constants);
+  void SetUpTriangles(const DeferredScene& scene, const Gbuffer& gbuffer, int chunk);
+  void RasterizeTile(int tile, Gbuffer* gbuffer);
+  void Resolve(int y, Gbuffer* gbuffer) const;
+
+  ThreadPool* pool_;
+  bool use_avx2_;
+
+  // Guard band in clip space: triangles are only clipped where |x| or |y| exceeds this times w,
+  // which keeps snapped coordinates within 8192 pixels of the origin.
+  float guard_band_x_ = 0.f;
+  float guard_band_y_ = 0.f;
+  int tiles_x_ = 0;
+  int tiles_y_ = 0;
+
+  // Shaded vertices of every draw, starting at first_vertex_[draw], and the first triangle of each
+  // draw with the total at the end.
+  std::vector<ClipVertex> vertices_;
+  std::vector<size_t> first_vertex_;
+  std::vector<size_t> first_triangle_;
+
+  std::vector<SetupChunk> chunks_;
+
+  // Packed ambient and diffuse colors of each material, in pairs.
+  std::vector<uint32_t> material_colors_;
+
+  // Visibility buffer: the id of the closest triangle at each pixel, whose depth goes straight to
+  // the Gbuffer.
+  std::vector<uint32_t> ids_;
+};
+
+#endif  // RASTERIZER_H_
\ No newline at end of file
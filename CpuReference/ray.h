@@ -0,0 +1,83 @@
+#ifndef RAY_H_
+#define RAY_H_
+
+#include <cstdint>
+
+#include "vec_math.h"
+
+struct Ray {
+  Vec3 origin;
+  Vec3 direction;
+  float t_min;
+  float t_max;
+};
+
+// Barycentrics follow BuiltInTriangleIntersectionAttributes: u weights the second vertex and v
+// the third.
+struct Hit {
+  float t;
+  float u;
+  float v;
+  uint32_t triangle;
+};
+
+constexpr uint32_t kInvalidTriangle = 0xffffffff;
+
+// Whether a hit at |t| on |triangle| replaces |hit|. Ties, which happen along shared edges, go to
+// the lower triangle index so every traversal order picks the same triangle.
+inline bool IsCloser(float t, uint32_t triangle, const Hit& hit) {
+  return t < hit.t || (t == hit.t && triangle < hit.triangle);
+}
+
+// Moller-Trumbore test against the triangle (v0, v1, v2). With |cull_back_faces| it matches
+// RAY_FLAG_CULL_BACK_FACING_TRIANGLES under D3D's clockwise-is-front-facing rule: triangles whose
+// cross(v1 - v0, v2 - v0) points along the ray are skipped. Returns true for hits with t in
+// [ray.t_min, t_max].
+inline bool IntersectTriangle(const Ray& ray, const Vec3& v0, const Vec3& v1, const Vec3& v2,
+                              bool cull_back_faces, float t_max, float* t, float* u, float* v) {
+  const Vec3 edge1 = v1 - v0;
+  const Vec3 edge2 = v2 - v0;
+
+  const Vec3 p = Cross(ray.direction, edge2);
+  const float det = Dot(edge1, p);
+
+  // det is -dot(direction, cross(edge1, edge2)), positive for front faces.
+  if (cull_back_faces ? det <= 0.f : det == 0.f)
+    return false;
+
+  const float inv_det = 1.f / det;
+
+  const Vec3 s = ray.origin - v0;
+  const float hit_u = Dot(s, p) * inv_det;
+  if (hit_u < 0.f || hit_u > 1.f)
+    return false;
+
+  const Vec3 q = Cross(s, edge1);
+  const float hit_v = Dot(ray.direction, q) * inv_det;
+  if (hit_v < 0.f || hit_u + hit_v > 1.f)
+    return false;
+
+  const float hit_t = Dot(edge2, q) * inv_det;
+  if (hit_t < ray.t_min || hit_t > t_max)
+    return false;
+
+  *t = hit_t;
+  *u = hit_u;
+  *v = hit_v;
+  return true;
+}
+
+// Closest-hit and any-hit queries, implemented by each acceleration structure so the tracer and
+// the benchmarks can switch between them at runtime.
+class RayIntersector {
+public:
+  virtual ~RayIntersector() = default;
+
+  // Closest front-facing hit in [t_min, t_max], or false on a miss.
+  virtual bool Intersect(const Ray& ray, Hit* hit) const = 0;
+
+  // True if any front-facing triangle is hit in [t_min, t_max].
+  virtual bool Occluded(const Ray& ray) const = 0;
+};
+
+#endif  // RAY_H_
\ No newline at end of file
@@ -0,0 +1,207 @@
+#include "reference_tracer.h"
+
+#include <algorithm>
+#include <vector>
+
+#include "jitter.h"
+#include "profiling.h"
+
+namespace {
+
+// Values hard-coded in raytracing.hlsl.
+const Vec3 kCameraOrigin = {0.f, 1.f, 4.f};
+constexpr float kFovScale = 0.414f;
+const Vec3 kLightPosition = {0.f, 1.9f, 0.f};
+constexpr float kAmbientScale = 0.3f;
+
+constexpr int kTileSize = 16;
+
+}  // namespace
+
+Ray MakePrimaryRay(int x, int y, int width, int height, float jitter_x, float jitter_y) {
+  // RaygenShader. The viewport runs from (aspect, 1) at the top-left to (-aspect, -1) at the
+  // bottom-right, and the lerp starts from the pixel's corner rather than its center.
+  const float aspect_ratio = static_cast<float>(width) / static_cast<float>(height);
+
+  const float viewport_x =
+      Lerp(aspect_ratio, -aspect_ratio, (static_cast<float>(x) + jitter_x) / width);
+  const float viewport_y = Lerp(1.f, -1.f, (static_cast<float>(y) + jitter_y) / height);
+
+  Ray ray;
+  ray.origin = kCameraOrigin;
+  ray.direction = {viewport_x * kFovScale, viewport_y * kFovScale, -1.f};
+  ray.t_min = 0.f;
+  ray.t_max = kRayTMax;
+  return ray;
+}
+
+Ray MakeShadowRay(const Vec3& position) {
+  const Vec3 light_dist_vec = kLightPosition - position;
+
+  Ray ray;
+  ray.origin = position;
+  ray.direction = Normalize(light_dist_vec);
+  ray.t_min = 0.f;
+  ray.t_max = Length(light_dist_vec);
+  return ray;
+}
+
+SurfaceShading ShadeSurface(const Scene& scene, const Hit& hit, const Vec3& light_dir) {
+  const float w = 1.f - hit.u - hit.v;
+  const Vec3 normal = Normalize(scene.normal(hit.triangle, 0) * w +
+                                scene.normal(hit.triangle, 1) * hit.u +
+                                scene.normal(hit.triangle, 2) * hit.v);
+
+  const Material& material = scene.triangle_material(hit.triangle);
+
+  SurfaceShading shading;
+  shading.ambient = kAmbientScale * material.ambient_color;
+  shading.diffuse = Saturate(Dot(light_dir, normal)) * material.diffuse_color;
+  shading.normal = normal;
+  return shading;
+}
+
+ReferenceTracer::ReferenceTracer(const Scene& scene, const RayIntersector& intersector,
+                                 ThreadPool* pool)
+    : scene_(scene), intersector_(intersector), pool_(pool) {}
+
+void ReferenceTracer::SetPacketMode(const PacketTraversal* packets, int packet_size) {
+  packets_ = packets;
+  packet_size_ = packets != nullptr ? packet_size : 0;
+}
+
+void ReferenceTracer::ResetAccumulation() {
+  accumulation_.clear();
+  num_samples_ = 0;
+}
+
+TraceStats ReferenceTracer::Render(Image* image) {
+  const int tiles_x = (image->width + kTileSize - 1) / kTileSize;
+  const int tiles_y = (image->height + kTileSize - 1) / kTileSize;
+
+  if (accumulation_.size() != image->pixels.size()) {
+    accumulation_.assign(image->pixels.size(), {0.f, 0.f, 0.f});
+    num_samples_ = 0;
+  }
+
+  GetSubpixelJitter(num_samples_, &jitter_x_, &jitter_y_);
+  const float num_samples = static_cast<float>(num_samples_ + 1);
+
+  // Counted per thread so the hot loop does not share a cache line.
+  struct alignas(64) ThreadCounters {
+    uint64_t shadow_rays = 0;
+  };
+  std::vector<ThreadCounters> counters(pool_->num_threads());
+
+  Stopwatch stopwatch;
+
+  pool_->ParallelFor(tiles_x * tiles_y, [&](int tile, int thread_index) {
+    const int x0 = (tile % tiles_x) * kTileSize;
+    const int y0 = (tile / tiles_x) * kTileSize;
+    const int x1 = std::min(x0 + kTileSize, image->width);
+    const int y1 = std::min(y0 + kTileSize, image->height);
+
+    uint64_t* shadow_rays = &counters[thread_index].shadow_rays;
+
+    if (packets_ != nullptr) {
+      for (int y = y0; y < y1; y += packet_size_) {
+        for (int x = x0; x < x1; x += packet_size_)
+          TracePacket(x, y, image, shadow_rays);
+      }
+    } else {
+      for (int y = y0; y < y1; ++y) {
+        for (int x = x0; x < x1; ++x)
+          image->at(x, y) = TracePixel(x, y, image->width, image->height, shadow_rays);
+      }
+    }
+
+    // The end of RaygenShader: add the frame to the sum and output the average.
+    for (int y = y0; y < y1; ++y) {
+      for (int x = x0; x < x1; ++x) {
+        Vec3& sum = accumulation_[static_cast<size_t>(y) * image->width + x];
+        sum += image->at(x, y);
+        image->at(x, y) = sum / num_samples;
+      }
+    }
+  });
+
+  ++num_samples_;
+
+  TraceStats stats;
+  stats.seconds = stopwatch.ElapsedSeconds();
+  stats.primary_rays = static_cast<uint64_t>(image->width) * image->height;
+  for (const ThreadCounters& counter : counters)
+    stats.shadow_rays += counter.shadow_rays;
+
+  return stats;
+}
+
+Vec3 ReferenceTracer::TracePixel(int x, int y, int width, int height,
+                                 uint64_t* shadow_rays) const {
+  const Ray ray = MakePrimaryRay(x, y, width, height, jitter_x_, jitter_y_);
+
+  Hit hit;
+  if (!intersector_.Intersect(ray, &hit)) {
+    // MissShader.
+    return {0.f, 0.f, 0.f};
+  }
+
+  // ClosestHitShader.
+  const Ray shadow_ray = MakeShadowRay(ray.origin + ray.direction * hit.t);
+
+  ++*shadow_rays;
+  return Shade(hit, shadow_ray.direction, intersector_.Occluded(shadow_ray));
+}
+
+void ReferenceTracer::TracePacket(int x0, int y0, Image* image, uint64_t* shadow_rays) const {
+  const int x1 = std::min(x0 + packet_size_, image->width);
+  const int y1 = std::min(y0 + packet_size_, image->height);
+
+  RayPacket primary;
+  for (int y = y0; y < y1; ++y) {
+    for (int x = x0; x < x1; ++x)
+      primary.Add(MakePrimaryRay(x, y, image->width, image->height, jitter_x_, jitter_y_));
+  }
+
+  PacketStats stats;
+  PacketHits hits;
+  packets_->Intersect(primary, &hits, &stats);
+
+  // Shadow rays only leave the pixels that hit something; |shadow_pixels| maps them back.
+  RayPacket shadow;
+  int shadow_pixels[kMaxPacketRays];
+
+  for (int i = 0; i < primary.num_rays; ++i) {
+    if (hits.triangle[i] == kInvalidTriangle)
+      continue;
+
+    const Ray ray = primary.ray(i);
+    shadow_pixels[shadow.num_rays] = i;
+    shadow.Add(MakeShadowRay(ray.origin + ray.direction * hits.t[i]));
+  }
+
+  uint8_t occluded[kMaxPacketRays];
+  packets_->Occluded(shadow, occluded, &stats);
+  *shadow_rays += shadow.num_rays;
+
+  // MissShader for every pixel, then ClosestHitShader over the ones that hit.
+  const int width = x1 - x0;
+  for (int i = 0; i < primary.num_rays; ++i)
+    image->at(x0 + i % width, y0 + i / width) = {0.f, 0.f, 0.f};
+
+  for (int i = 0; i < shadow.num_rays; ++i) {
+    const int pixel = shadow_pixels[i];
+    const Hit hit = {hits.t[pixel], hits.u[pixel], hits.v[pixel], hits.triangle[pixel]};
+    const Vec3 light_dir = {shadow.direction[0][i], shadow.direction[1][i],
+                            shadow.direction[2][i]};
+    image->at(x0 + pixel % width, y0 + pixel / width) = Shade(hit, light_dir, occluded[i] != 0);
+  }
+}
+
+Vec3 ReferenceTracer::Shade(const Hit& hit, const Vec3& light_dir, bool occluded) const {
+  const SurfaceShading shading = ShadeSurface(scene_, hit, light_dir);
+
+  const float is_illuminated = occluded ? 0.f : 1.f;
+
+  return shading.ambient + is_illuminated * shading.diffuse;
+}
\ No newline at end of file
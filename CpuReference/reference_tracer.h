@@ -0,0 +1,95 @@
+#ifndef REFERENCE_TRACER_H_
+#define REFERENCE_TRACER_H_
+
+#include <cstdint>
+#include <vector>
+
+#include "image.h"
+#include "packet_traversal.h"
+#include "ray.h"
+#include "scene.h"
+#include "thread_pool.h"
+
+struct TraceStats {
+  uint64_t primary_rays = 0;
+  uint64_t shadow_rays = 0;
+  // Diffuse bounces, which only the path-tracing mode traces.
+  uint64_t bounce_rays = 0;
+  double seconds = 0.0;
+
+  double RaysPerSecond() const {
+    return seconds > 0.0 ? (primary_rays + shadow_rays + bounce_rays) / seconds : 0.0;
+  }
+};
+
+// TMax of the camera rays in raytracing.hlsl, which is also used for bounce rays.
+constexpr float kRayTMax = 10000.f;
+
+// The camera ray RaygenShader traces for pixel (x, y), offset by the frame's subpixel jitter.
+Ray MakePrimaryRay(int x, int y, int width, int height, float jitter_x = 0.f,
+                   float jitter_y = 0.f);
+
+// The ray ClosestHitShader traces from |position| towards the light.
+Ray MakeShadowRay(const Vec3& position);
+
+// The two terms of ClosestHitShader's color: ambient is always added, diffuse only when the
+// shadow ray is unoccluded.
+struct SurfaceShading {
+  Vec3 ambient;
+  Vec3 diffuse;
+  // Interpolated vertex normal, as used for the diffuse term.
+  Vec3 normal;
+};
+
+// Lights |hit| from |light_dir|, the direction of its shadow ray.
+SurfaceShading ShadeSurface(const Scene& scene, const Hit& hit, const Vec3& light_dir);
+
+// CPU port of RaygenShader, ClosestHitShader, MissShader and ShadowMissShader in
+// RayTracing/raytracing.hlsl. Produces the same image as the DXR path, so it can stand in for it
+// on machines without a raytracing GPU. The image is split into square tiles which the pool's
+// threads pick up one at a time. Within a tile, rays are traced one at a time through
+// |intersector|, or as square packets once SetPacketMode() is called.
+//
+// Like the app, each Render() traces the frame with the next subpixel jitter and adds it to a
+// running average, so repeated frames converge to an antialiased image.
+class ReferenceTracer {
+public:
+  ReferenceTracer(const Scene& scene, const RayIntersector& intersector, ThreadPool* pool);
+
+  // Traces |packet_size| x |packet_size| packets (8 or 16) of primary rays, and packets of the
+  // shadow rays from their hits, with |packets|. A null |packets| goes back to single rays.
+  void SetPacketMode(const PacketTraversal* packets, int packet_size);
+
+  // Starts a new average, as the app does when the camera or scene changes. A new image size
+  // also starts one.
+  void ResetAccumulation();
+
+  // Frames averaged into the last rendered image.
+  uint32_t num_samples() const { return num_samples_; }
+
+  TraceStats Render(Image* image);
+
+private:
+  Vec3 TracePixel(int x, int y, int width, int height, uint64_t* shadow_rays) const;
+
+  // Traces the |packet_size_| square of pixels at (x0, y0), clipped to the image.
+  void TracePacket(int x0, int y0, Image* image, uint64_t* shadow_rays) const;
+
+  // ClosestHitShader, given the outcome of the shadow ray it traces.
+  Vec3 Shade(const Hit& hit, const Vec3& light_dir, bool occluded) const;
+
+  const Scene& scene_;
+  const RayIntersector& intersector_;
+  ThreadPool* pool_;
+
+  const PacketTraversal* packets_ = nullptr;
+  int packet_size_ = 0;
+
+  // The current frame's jitter, and the running sum of the frames so far.
+  float jitter_x_ = 0.f;
+  float jitter_y_ = 0.f;
+  std::vector<Vec3> accumulation_;
+  uint32_t num_samples_ = 0;
+};
+
+#endif  // REFERENCE_TRACER_H_
\ No newline at end of file
@@ -0,0 +1,971 @@
+#include "render_graph_checks.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <functional>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "command_recorder.h"
+#include "deferred_scene.h"
+#include "job_system.h"
+#include "memory_planner.h"
+#include "profiling.h"
+
+namespace {
+
+void DoNothing() {}
+
+// Number of transitions in |graph|'s schedule, a split pair counting once.
+int CountTransitions(const RenderGraph& graph) {
+  int count = 0;
+  auto add = [&](const std::vector<RenderGraph::Barrier>& barriers) {
+    for (const RenderGraph::Barrier& barrier : barriers) {
+      if (barrier.type == RenderGraph::Barrier::kTransition &&
+          barrier.split != RenderGraph::Barrier::kEnd)
+        ++count;
+    }
+  };
+  for (const RenderGraph::Step& step : graph.steps())
+    add(step.barriers);
+  add(graph.final_barriers());
+  return count;
+}
+
+// The barriers before the pass called |name|, or nullptr if it was culled.
+const std::vector<RenderGraph::Barrier>* BarriersBefore(const RenderGraph& graph,
+                                                        const char* name) {
+  for (const RenderGraph::Step& step : graph.steps()) {
+    if (graph.pass_name(step.pass) == name)
+      return &step.barriers;
+  }
+  return nullptr;
+}
+
+bool HasBarrier(const std::vector<RenderGraph::Barrier>& barriers,
+                RenderGraph::Barrier::Type type, RenderGraph::Barrier::Split split,
+                RenderGraph::ResourceId resource, uint32_t before, uint32_t after) {
+  for (const RenderGraph::Barrier& barrier : barriers) {
+    if (barrier.type == type && barrier.split == split && barrier.resource == resource &&
+        barrier.before == before && barrier.after == after)
+      return true;
+  }
+  return false;
+}
+
+// A depth prepass that only a debug view reads, and a debug view whose texture nothing reads: both
+// go, while the pass that writes the output stays.
+bool CheckCulling() {
+  RenderGraph graph;
+  RenderGraph::ResourceId depth = graph.ImportResource("depth", kResourceStateDepthWrite);
+  RenderGraph::ResourceId debug = graph.ImportResource("debug", kResourceStateRenderTarget);
+  RenderGraph::ResourceId output = graph.ImportResource("output", kResourceStatePresent);
+  graph.MarkOutput(output);
+
+  RenderGraph::PassId prepass = graph.AddPass("prepass", DoNothing);
+  graph.Write(prepass, depth, kResourceStateDepthWrite);
+  RenderGraph::PassId debug_view = graph.AddPass("debug view", DoNothing);
+  graph.Read(debug_view, depth, kResourceStatePixelShaderResource);
+  graph.Write(debug_view, debug, kResourceStateRenderTarget);
+  RenderGraph::PassId present = graph.AddPass("present", DoNothing);
+  graph.Write(present, output, kResourceStateRenderTarget);
+  graph.Compile();
+
+  return graph.culled(prepass) && graph.culled(debug_view) && !graph.culled(present) &&
+         graph.steps().size() == 1 && ValidateRenderGraph(graph).empty();
+}
+
+// Passes that feed the output through other passes all stay.
+bool CheckChainKept() {
+  RenderGraph graph;
+  RenderGraph::ResourceId a = graph.ImportResource("a", kResourceStateRenderTarget);
+  RenderGraph::ResourceId b = graph.ImportResource("b", kResourceStateUnorderedAccess);
+  RenderGraph::ResourceId output = graph.ImportResource("output", kResourceStatePresent);
+  graph.MarkOutput(output);
+
+  RenderGraph::PassId first = graph.AddPass("first", DoNothing);
+  graph.Write(first, a, kResourceStateRenderTarget);
+  RenderGraph::PassId second = graph.AddPass("second", DoNothing);
+  graph.Read(second, a, kResourceStateNonPixelShaderResource);
+  graph.Write(second, b, kResourceStateUnorderedAccess);
+  RenderGraph::PassId third = graph.AddPass("third", DoNothing);
+  graph.Read(third, b, kResourceStatePixelShaderResource);
+  graph.Write(third, output, kResourceStateRenderTarget);
+  graph.Compile();
+
+  return !graph.culled(first) && !graph.culled(second) && !graph.culled(third) &&
+         ValidateRenderGraph(graph).empty();
+}
+
+// Two passes in a row that read a texture in different states share one transition into the
+// combined state.
+bool CheckReadsMerged() {
+  RenderGraph graph;
+  RenderGraph::ResourceId texture = graph.ImportResource("texture", kResourceStateRenderTarget);
+  RenderGraph::ResourceId out_a = graph.ImportResource("out a", kResourceStateRenderTarget);
+  RenderGraph::ResourceId out_b = graph.ImportResource("out b", kResourceStateUnorderedAccess);
+  graph.MarkOutput(out_a);
+  graph.MarkOutput(out_b);
+
+  RenderGraph::PassId draw = graph.AddPass("draw", DoNothing);
+  graph.Write(draw, texture, kResourceStateRenderTarget);
+  RenderGraph::PassId shade = graph.AddPass("shade", DoNothing);
+  graph.Read(shade, texture, kResourceStatePixelShaderResource);
+  graph.Write(shade, out_a, kResourceStateRenderTarget);
+  RenderGraph::PassId compute = graph.AddPass("compute", DoNothing);
+  graph.Read(compute, texture, kResourceStateNonPixelShaderResource);
+  graph.Write(compute, out_b, kResourceStateUnorderedAccess);
+  graph.Compile();
+
+  const uint32_t read_state =
+      kResourceStatePixelShaderResource | kResourceStateNonPixelShaderResource;
+  return HasBarrier(*BarriersBefore(graph, "shade"), RenderGraph::Barrier::kTransition,
+                    RenderGraph::Barrier::kFull, texture, kResourceStateRenderTarget,
+                    read_state) &&
+         BarriersBefore(graph, "compute")->empty() && CountTransitions(graph) == 2 &&
+         ValidateRenderGraph(graph).empty();
+}
+
+// A texture written by the first pass and read by the third idles while the second runs, but its
+// transition is not split, since the two passes are separate tasks. Its return to the imported
+// state at the end of the frame is split across the last pass, which records the final barriers
+// too, unless that pass has parts of its own.
+bool CheckSplit() {
+  for (int last_parts = 1; last_parts <= 2; ++last_parts) {
+    RenderGraph graph;
+    RenderGraph::ResourceId texture = graph.ImportResource("texture", kResourceStateRenderTarget);
+    RenderGraph::ResourceId other = graph.ImportResource("other", kResourceStateDepthWrite);
+    RenderGraph::ResourceId output = graph.ImportResource("output", kResourceStatePresent);
+    graph.MarkOutput(other);
+    graph.MarkOutput(output);
+
+    RenderGraph::PassId draw = graph.AddPass("draw", DoNothing);
+    graph.Write(draw, texture, kResourceStateRenderTarget);
+    RenderGraph::PassId unrelated = graph.AddPass("unrelated", DoNothing);
+    graph.Write(unrelated, other, kResourceStateDepthWrite);
+    RenderGraph::PassId shade = graph.AddPass("shade", DoNothing);
+    graph.Read(shade, texture, kResourceStatePixelShaderResource);
+    graph.Write(shade, output, kResourceStateRenderTarget);
+    RenderGraph::PassId last = graph.AddPass("last", last_parts, [](void*, int) {});
+    graph.Write(last, other, kResourceStateDepthWrite);
+    graph.Compile();
+
+    const bool split_return = last_parts == 1;
+    if (!BarriersBefore(graph, "unrelated")->empty() ||
+        !HasBarrier(*BarriersBefore(graph, "shade"), RenderGraph::Barrier::kTransition,
+                    RenderGraph::Barrier::kFull, texture, kResourceStateRenderTarget,
+                    kResourceStatePixelShaderResource) ||
+        HasBarrier(*BarriersBefore(graph, "last"), RenderGraph::Barrier::kTransition,
+                   RenderGraph::Barrier::kBegin, texture, kResourceStatePixelShaderResource,
+                   kResourceStateRenderTarget) != split_return ||
+        !HasBarrier(graph.final_barriers(), RenderGraph::Barrier::kTransition,
+                    split_return ? RenderGraph::Barrier::kEnd : RenderGraph::Barrier::kFull,
+                    texture, kResourceStatePixelShaderResource, kResourceStateRenderTarget) ||
+        !ValidateRenderGraph(graph).empty())
+      return false;
+  }
+  return true;
+}
+
+// Back-to-back unordered-access passes need a UAV barrier but no transition.
+bool CheckUavBarrier() {
+  RenderGraph graph;
+  RenderGraph::ResourceId buffer = graph.ImportResource("buffer", kResourceStateUnorderedAccess);
+  graph.MarkOutput(buffer);
+
+  RenderGraph::PassId first = graph.AddPass("first", DoNothing);
+  graph.Write(first, buffer, kResourceStateUnorderedAccess);
+  RenderGraph::PassId second = graph.AddPass("second", DoNothing);
+  graph.Write(second, buffer, kResourceStateUnorderedAccess);
+  graph.Compile();
+
+  const std::vector<RenderGraph::Barrier>& barriers = *BarriersBefore(graph, "second");
+  return BarriersBefore(graph, "first")->empty() && barriers.size() == 1 &&
+         HasBarrier(barriers, RenderGraph::Barrier::kUav, RenderGraph::Barrier::kFull, buffer,
+                    kResourceStateUnorderedAccess, kResourceStateUnorderedAccess) &&
+         CountTransitions(graph) == 0 && ValidateRenderGraph(graph).empty();
+}
+
+// A resource already in a state that covers the reads needs no barrier at all.
+bool CheckNoRedundantBarriers() {
+  RenderGraph graph;
+  RenderGraph::ResourceId texture = graph.ImportResource(
+      "texture", kResourceStatePixelShaderResource | kResourceStateNonPixelShaderResource);
+  RenderGraph::ResourceId output = graph.ImportResource("output", kResourceStateRenderTarget);
+  graph.MarkOutput(output);
+
+  RenderGraph::PassId shade = graph.AddPass("shade", DoNothing);
+  graph.Read(shade, texture, kResourceStatePixelShaderResource);
+  graph.Write(shade, output, kResourceStateRenderTarget);
+  graph.Compile();
+
+  return graph.steps().size() == 1 && graph.steps()[0].barriers.empty() &&
+         graph.final_barriers().empty() && ValidateRenderGraph(graph).empty();
+}
+
+bool Throws(const std::function<void()>& fn) {
+  try {
+    fn();
+  } catch (const std::runtime_error&) {
+    return true;
+  }
+  return false;
+}
+
+bool CheckInvalidAccesses() {
+  RenderGraph graph;
+  RenderGraph::ResourceId texture = graph.ImportResource("texture", kResourceStateRenderTarget);
+  RenderGraph::PassId pass = graph.AddPass("pass", DoNothing);
+
+  return Throws([&]() { graph.Read(pass, texture, kResourceStateRenderTarget); }) &&
+         Throws([&]() {
+           graph.Write(pass, texture,
+                       kResourceStateRenderTarget | kResourceStateUnorderedAccess);
+         }) &&
+         Throws([&]() {
+           graph.Read(pass, texture, kResourceStatePixelShaderResource);
+           graph.Write(pass, texture, kResourceStateRenderTarget);
+         });
+}
+
+// Three transient textures in a chain: the first and the last are never alive together, so they
+// share memory. The first goes back to its between-frames state before the last takes the memory
+// over with an aliasing barrier.
+bool CheckTransientAliasing() {
+  const uint64_t kSize = 1 << 20;
+  RenderGraph graph;
+  RenderGraph::ResourceId output = graph.ImportResource("output", kResourceStatePresent);
+  graph.MarkOutput(output);
+  RenderGraph::ResourceId a = graph.CreateTransientResource("a", kSize, kTextureAlignment);
+  RenderGraph::ResourceId b = graph.CreateTransientResource("b", kSize, kTextureAlignment);
+  RenderGraph::ResourceId c = graph.CreateTransientResource("c", kSize, kTextureAlignment);
+
+  RenderGraph::PassId first = graph.AddPass("first", DoNothing);
+  graph.Write(first, a, kResourceStateRenderTarget);
+  RenderGraph::PassId second = graph.AddPass("second", DoNothing);
+  graph.Read(second, a, kResourceStatePixelShaderResource);
+  graph.Write(second, b, kResourceStateRenderTarget);
+  RenderGraph::PassId third = graph.AddPass("third", DoNothing);
+  graph.Read(third, b, kResourceStatePixelShaderResource);
+  graph.Write(third, c, kResourceStateUnorderedAccess);
+  RenderGraph::PassId fourth = graph.AddPass("fourth", DoNothing);
+  graph.Read(fourth, c, kResourceStateNonPixelShaderResource);
+  graph.Write(fourth, output, kResourceStateRenderTarget);
+  graph.Compile();
+
+  const std::vector<RenderGraph::Barrier>& third_barriers = *BarriersBefore(graph, "third");
+  const bool return_first = !third_barriers.empty() &&
+                            third_barriers.front().resource == a &&
+                            third_barriers.front().type == RenderGraph::Barrier::kTransition;
+  return graph.transient_heap_size() == 2 * kSize &&
+         graph.transient_offset(a) == graph.transient_offset(c) &&
+         graph.transient_offset(a) != graph.transient_offset(b) &&
+         graph.imported_state(c) == kResourceStateUnorderedAccess && return_first &&
+         HasBarrier(third_barriers, RenderGraph::Barrier::kAliasing, RenderGraph::Barrier::kFull,
+                    c, 0, 0) &&
+         HasBarrier(*BarriersBefore(graph, "first"), RenderGraph::Barrier::kAliasing,
+                    RenderGraph::Barrier::kFull, a, 0, 0) &&
+         ValidateRenderGraph(graph).empty();
+}
+
+// Transient resources have no contents at the start of the frame, so their first use must write.
+bool CheckTransientReadFirst() {
+  RenderGraph graph;
+  RenderGraph::ResourceId output = graph.ImportResource("output", kResourceStatePresent);
+  graph.MarkOutput(output);
+  RenderGraph::ResourceId texture =
+      graph.CreateTransientResource("texture", 1 << 16, kTextureAlignment);
+
+  RenderGraph::PassId pass = graph.AddPass("pass", DoNothing);
+  graph.Read(pass, texture, kResourceStatePixelShaderResource);
+  graph.Write(pass, output, kResourceStateRenderTarget);
+  return Throws([&]() { graph.Compile(); });
+}
+
+// Appends "<pass> <part>" to |recorder|, a std::vector<std::string>.
+void LogPart(void* recorder, const char* pass, int part) {
+  static_cast<std::vector<std::string>*>(recorder)->push_back(std::string(pass) + " " +
+                                                              std::to_string(part));
+}
+
+// Execute() runs the passes that survive culling in order, each after its barriers.
+bool CheckExecutionOrder() {
+  std::vector<std::string> log;
+  RenderGraph graph;
+  AddDeferredFrame(&graph, 1024, 768, true, LogPart);
+  graph.Compile();
+
+  int batches = 0;
+  graph.Execute(
+      [&](const std::vector<RenderGraph::Barrier>& barriers) {
+        if (!barriers.empty())
+          ++batches;
+      },
+      &log);
+
+  const std::vector<std::string> expected = {
+    "shadow 0", "shadow 1", "shadow 2", "shadow 3", "shadow 4", "shadow 5",
+    "geometry 0", "cluster 0", "lighting 0",
+  };
+  return log == expected && batches > 0;
+}
+
+// ExecuteParallel() records every task once, into its own recorder, and the recorders in task
+// order hold what Execute() records, barriers included.
+bool CheckParallelExecution() {
+  RenderGraph graph;
+  AddDeferredFrame(&graph, 1024, 768, true, LogPart);
+  graph.Compile();
+
+  std::vector<std::string> sequential;
+  graph.Execute(
+      [&](const std::vector<RenderGraph::Barrier>& barriers) {
+        sequential.push_back(std::to_string(barriers.size()) + " barriers");
+      },
+      &sequential);
+
+  JobSystem jobs(4);
+  std::vector<std::vector<std::string>> recorders(graph.tasks().size());
+  std::vector<int> ends(graph.tasks().size(), 0);
+  for (int repeat = 0; repeat < 100; ++repeat) {
+    for (std::vector<std::string>& recorder : recorders)
+      recorder.clear();
+    graph.ExecuteParallel(
+        &jobs, [&](int task, int) { return static_cast<void*>(&recorders[task]); },
+        [](void* recorder, const std::vector<RenderGraph::Barrier>& barriers) {
+          static_cast<std::vector<std::string>*>(recorder)->push_back(
+              std::to_string(barriers.size()) + " barriers");
+        },
+        [&](int task, void* recorder) {
+          if (recorder == &recorders[task])
+            ++ends[task];
+        });
+
+    std::vector<std::string> parallel;
+    for (const std::vector<std::string>& recorder : recorders)
+      parallel.insert(parallel.end(), recorder.begin(), recorder.end());
+    if (parallel != sequential)
+      return false;
+  }
+  return graph.tasks().size() == kShadowPassParts + 3 &&
+         std::all_of(ends.begin(), ends.end(), [](int count) { return count == 100; });
+}
+
+bool OverlapsInMemory(uint64_t offset_a, uint64_t size_a, uint64_t offset_b, uint64_t size_b) {
+  return offset_a < offset_b + size_b && offset_b < offset_a + size_a;
+}
+
+// What is wrong with |offsets| as a plan for |requests| in |heap_size| bytes, or an empty string.
+std::string ValidatePlan(const std::vector<MemoryRequest>& requests,
+                         const std::vector<uint64_t>& offsets, uint64_t heap_size) {
+  for (size_t i = 0; i < requests.size(); ++i) {
+    if (offsets[i] % requests[i].alignment != 0)
+      return "request " + std::to_string(i) + " is misaligned";
+    if (offsets[i] + requests[i].size > heap_size)
+      return "request " + std::to_string(i) + " ends past the heap";
+    for (size_t j = 0; j < i; ++j) {
+      if (LifetimesOverlap(requests[i], requests[j]) &&
+          OverlapsInMemory(offsets[i], requests[i].size, offsets[j], requests[j].size))
+        return "requests " + std::to_string(j) + " and " + std::to_string(i) + " overlap";
+    }
+  }
+  return "";
+}
+
+// Requests that live one after the other all go at offset 0.
+bool CheckPlanSequential() {
+  const std::vector<MemoryRequest> requests = {
+    {3 << 16, 1 << 16, 0, 0}, {5 << 16, 1 << 16, 1, 1}, {2 << 16, 1 << 16, 2, 3}};
+  uint64_t heap_size;
+  const std::vector<uint64_t> offsets = PlanMemory(requests, &heap_size);
+  return heap_size == (5 << 16) && offsets == std::vector<uint64_t>(3, 0) &&
+         ValidatePlan(requests, offsets, heap_size).empty();
+}
+
+// Requests that are all alive at once are stacked, each aligned.
+bool CheckPlanOverlapping() {
+  const std::vector<MemoryRequest> requests = {
+    {100, 256, 0, 2}, {300, 256, 1, 2}, {50, 4096, 2, 2}};
+  uint64_t heap_size;
+  const std::vector<uint64_t> offsets = PlanMemory(requests, &heap_size);
+  // 300 bytes at 0, 100 at 512 and 50 at 4096.
+  return heap_size == 4096 + 50 && offsets[1] == 0 && offsets[0] == 512 && offsets[2] == 4096 &&
+         ValidatePlan(requests, offsets, heap_size).empty();
+}
+
+// A large request alive at the start and two small ones that overlap it and each other in turn:
+// the plan fits in the peak number of live bytes.
+bool CheckPlanReachesPeak() {
+  const std::vector<MemoryRequest> requests = {
+    {4 << 16, 1 << 16, 0, 1}, {2 << 16, 1 << 16, 1, 2}, {2 << 16, 1 << 16, 2, 3}};
+  uint64_t heap_size;
+  const std::vector<uint64_t> offsets = PlanMemory(requests, &heap_size);
+  return heap_size == PeakLiveBytes(requests) && heap_size == (6 << 16) &&
+         ValidatePlan(requests, offsets, heap_size).empty();
+}
+
+// Random request lists: the plans must be valid, and the greedy placement should stay close to
+// the peak.
+bool CheckPlanRandom() {
+  std::mt19937 rng(1);
+  std::uniform_int_distribution<int> count_dist(1, 16);
+  std::uniform_int_distribution<int> size_dist(1, 256);
+  std::uniform_int_distribution<int> alignment_dist(0, 1);
+  std::uniform_int_distribution<int> step_dist(0, 11);
+
+  const int kTrials = 2000;
+  double total_ratio = 0.0;
+  double worst_ratio = 1.0;
+  for (int trial = 0; trial < kTrials; ++trial) {
+    std::vector<MemoryRequest> requests(count_dist(rng));
+    for (MemoryRequest& request : requests) {
+      // 4 KiB or 64 KiB, D3D12's small and default placement alignments.
+      request.alignment = uint64_t(4096) << (alignment_dist(rng) * 4);
+      request.size = static_cast<uint64_t>(size_dist(rng)) * 4096;
+      const int a = step_dist(rng);
+      const int b = step_dist(rng);
+      request.first_use = std::min(a, b);
+      request.last_use = std::max(a, b);
+    }
+
+    uint64_t heap_size;
+    const std::vector<uint64_t> offsets = PlanMemory(requests, &heap_size);
+    const std::string error = ValidatePlan(requests, offsets, heap_size);
+    if (!error.empty()) {
+      std::printf("         trial %d: %s\n", trial, error.c_str());
+      return false;
+    }
+    const uint64_t peak = PeakLiveBytes(requests);
+    if (heap_size < peak)
+      return false;
+    const double ratio = static_cast<double>(heap_size) / peak;
+    total_ratio += ratio;
+    worst_ratio = std::max(worst_ratio, ratio);
+  }
+  std::printf("         %d random plans: heap %.3fx the peak live bytes on average, %.3fx at "
+              "worst\n",
+              kTrials, total_ratio / kTrials, worst_ratio);
+  return true;
+}
+
+struct Check {
+  const char* name;
+  bool (*run)();
+};
+
+bool RunChecks(const Check* checks, size_t count) {
+  bool all_passed = true;
+  for (size_t i = 0; i < count; ++i) {
+    const bool passed = checks[i].run();
+    std::printf("  %-6s %s\n", passed ? "ok" : "FAILED", checks[i].name);
+    all_passed = all_passed && passed;
+  }
+  return all_passed;
+}
+
+// The barriers DeferredShading recorded by hand before the render graph: the swap chain buffer's
+// two transitions in App::RenderFrame(), and a batch before and after each of the cluster pass,
+// for its two light-list buffers, and the lighting pass, for the depth buffer, the two G-buffer
+// targets and the shadow cubemap.
+constexpr int kHandWrittenTransitions = 2 + 2 * 2 + 2 * 4;
+constexpr int kHandWrittenBatches = 2 + 2 + 2;
+
+const char* BarrierSplitName(RenderGraph::Barrier::Split split) {
+  switch (split) {
+  case RenderGraph::Barrier::kBegin:
+    return "begin";
+  case RenderGraph::Barrier::kEnd:
+    return "end";
+  default:
+    return "full";
+  }
+}
+
+void PrintBarriers(const RenderGraph& graph, const std::vector<RenderGraph::Barrier>& barriers) {
+  for (const RenderGraph::Barrier& barrier : barriers) {
+    if (barrier.type == RenderGraph::Barrier::kUav) {
+      std::printf("      uav    %s\n", graph.resource_name(barrier.resource).c_str());
+      continue;
+    }
+    if (barrier.type == RenderGraph::Barrier::kAliasing) {
+      std::printf("      alias  %s\n", graph.resource_name(barrier.resource).c_str());
+      continue;
+    }
+    std::printf("      %-6s %-18s %s -> %s\n", BarrierSplitName(barrier.split),
+                graph.resource_name(barrier.resource).c_str(),
+                ResourceStateString(barrier.before).c_str(),
+                ResourceStateString(barrier.after).c_str());
+  }
+}
+
+// How many committed copies of a transient resource DeferredShading kept before the render graph
+// placed them: one per frame in flight, except for the depth buffer.
+int CommittedCopies(const std::string& name) {
+  return name == "depth stencil" ? 1 : kAppFramesInFlight;
+}
+
+double Mib(uint64_t bytes) { return static_cast<double>(bytes) / (1024.0 * 1024.0); }
+
+// Prints where the transient resources of the compiled |graph| live and how much memory they take
+// next to the committed textures the app used to create.
+void PrintTransientMemory(const RenderGraph& graph) {
+  std::printf("  %-18s %9s %7s %11s\n", "transient", "MiB", "steps", "offset MiB");
+  std::vector<MemoryRequest> requests;
+  uint64_t committed_bytes = 0;
+  for (RenderGraph::ResourceId resource = 0; resource < graph.num_resources(); ++resource) {
+    if (!graph.transient(resource) || graph.transient_offset(resource) == RenderGraph::kNotPlaced)
+      continue;
+    const MemoryRequest& memory = graph.memory_request(resource);
+    const std::string steps =
+        std::to_string(memory.first_use) + "-" + std::to_string(memory.last_use);
+    std::printf("  %-18s %9.2f %7s %11.2f\n", graph.resource_name(resource).c_str(),
+                Mib(memory.size), steps.c_str(), Mib(graph.transient_offset(resource)));
+    requests.push_back(memory);
+    committed_bytes += memory.size * CommittedCopies(graph.resource_name(resource));
+  }
+
+  std::printf("  committed: %.2f MiB (%d copies of each per-frame texture)\n",
+              Mib(committed_bytes), kAppFramesInFlight);
+  std::printf("  transient heap: %.2f MiB (peak live %.2f MiB), %.1f%% less\n",
+              Mib(graph.transient_heap_size()), Mib(PeakLiveBytes(requests)),
+              100.0 * (1.0 - static_cast<double>(graph.transient_heap_size()) / committed_bytes));
+}
+
+// Frames the record-frame command times for each thread count when --frames is not given.
+constexpr int kDefaultRecordingFrames = 100;
+// Draws in the stand-in scene, each recorded once per shadow face and once by the geometry pass.
+constexpr int kRecordedDraws = 4096;
+
+// Records what each pass of AddDeferredFrame() records into its command list, with
+// CommandRecorder standing in for the command list: the shadow pass's draw loop for one face, the
+// geometry pass's draw loop with each draw's material, one dispatch and one full-screen triangle.
+void RecordDeferredPass(const std::vector<SubmittedDraw>& draws, CommandRecorder* recorder,
+                        const char* pass, int part) {
+  const uint64_t kConstantsAddress = uint64_t(1) << 40;
+  const std::string name = pass;
+  if (name == "shadow") {
+    const uint32_t face = part;
+    recorder->SetRootConstantBufferView(0, kConstantsAddress);
+    recorder->SetRoot32BitConstants(1, 1, &face);
+    for (const SubmittedDraw& draw : draws)
+      recorder->Draw(draw);
+  } else if (name == "geometry") {
+    recorder->SetRootConstantBufferView(0, kConstantsAddress + 256);
+    for (const SubmittedDraw& draw : draws) {
+      recorder->SetRoot32BitConstants(1, 1, &draw.material_index);
+      recorder->Draw(draw);
+    }
+  } else {
+    recorder->SetRootConstantBufferView(0, kConstantsAddress + 512);
+    recorder->Draw(draws.front());
+  }
+}
+
+void RecordBarrierBatch(CommandRecorder* recorder,
+                        const std::vector<RenderGraph::Barrier>& barriers) {
+  for (const RenderGraph::Barrier& barrier : barriers)
+    recorder->ResourceBarrier(barrier);
+}
+
+}  // namespace
+
+uint64_t EstimateTextureBytes(int width, int height, int layers, int bytes_per_texel) {
+  const uint64_t bytes = static_cast<uint64_t>(width) * height * layers * bytes_per_texel;
+  return (bytes + kTextureAlignment - 1) / kTextureAlignment * kTextureAlignment;
+}
+
+void AddDeferredFrame(RenderGraph* graph, int width, int height, bool debug_view,
+                      const DeferredPassFn& record) {
+  auto add_pass = [&](const char* name, int num_parts) {
+    return graph->AddPass(name, num_parts, [record, name](void* recorder, int part) {
+      if (record)
+        record(recorder, name, part);
+    });
+  };
+
+  // Created like App::InitRenderGraph() does.
+  RenderGraph::ResourceId swap_chain_buffer =
+      graph->ImportResource("swap chain buffer", kResourceStatePresent);
+  RenderGraph::ResourceId view_lights =
+      graph->ImportResource("view lights", kResourceStatePixelShaderResource);
+  RenderGraph::ResourceId light_counts =
+      graph->ImportResource("light counts", kResourceStatePixelShaderResource);
+  RenderGraph::ResourceId light_indices =
+      graph->ImportResource("light indices", kResourceStatePixelShaderResource);
+
+  RenderGraph::ResourceId depth_stencil = graph->CreateTransientResource(
+      "depth stencil", EstimateTextureBytes(width, height, 1, 4), kTextureAlignment);
+  RenderGraph::ResourceId normal_gbuffer = graph->CreateTransientResource(
+      "normal gbuffer", EstimateTextureBytes(width, height, 1, 4), kTextureAlignment);
+  RenderGraph::ResourceId material_gbuffer = graph->CreateTransientResource(
+      "material gbuffer", EstimateTextureBytes(width, height, 1, 2), kTextureAlignment);
+  RenderGraph::ResourceId shadow_cubemap = graph->CreateTransientResource(
+      "shadow cubemap", EstimateTextureBytes(kShadowMapSize, kShadowMapSize, 6, 4),
+      kTextureAlignment);
+
+  graph->MarkOutput(swap_chain_buffer);
+
+  RenderGraph::PassId shadow = add_pass("shadow", kShadowPassParts);
+  graph->Write(shadow, shadow_cubemap, kResourceStateDepthWrite);
+
+  RenderGraph::PassId geometry = add_pass("geometry", 1);
+  graph->Write(geometry, depth_stencil, kResourceStateDepthWrite);
+  graph->Write(geometry, normal_gbuffer, kResourceStateRenderTarget);
+  graph->Write(geometry, material_gbuffer, kResourceStateRenderTarget);
+
+  if (debug_view) {
+    RenderGraph::ResourceId debug_texture = graph->CreateTransientResource(
+        "debug texture", EstimateTextureBytes(width, height, 1, 4), kTextureAlignment);
+    RenderGraph::PassId debug = add_pass("debug view", 1);
+    graph->Read(debug, normal_gbuffer, kResourceStatePixelShaderResource);
+    graph->Write(debug, debug_texture, kResourceStateRenderTarget);
+  }
+
+  RenderGraph::PassId cluster = add_pass("cluster", 1);
+  graph->Write(cluster, view_lights, kResourceStateUnorderedAccess);
+  graph->Write(cluster, light_counts, kResourceStateUnorderedAccess);
+  graph->Write(cluster, light_indices, kResourceStateUnorderedAccess);
+
+  RenderGraph::PassId lighting = add_pass("lighting", 1);
+  graph->Read(lighting, depth_stencil, kResourceStatePixelShaderResource);
+  graph->Read(lighting, normal_gbuffer, kResourceStatePixelShaderResource);
+  graph->Read(lighting, material_gbuffer, kResourceStatePixelShaderResource);
+  graph->Read(lighting, shadow_cubemap, kResourceStatePixelShaderResource);
+  graph->Read(lighting, view_lights, kResourceStatePixelShaderResource);
+  graph->Read(lighting, light_counts, kResourceStatePixelShaderResource);
+  graph->Read(lighting, light_indices, kResourceStatePixelShaderResource);
+  graph->Write(lighting, swap_chain_buffer, kResourceStateRenderTarget);
+}
+
+std::string ValidateRenderGraph(const RenderGraph& graph) {
+  struct Tracked {
+    uint32_t state;
+    bool split_pending = false;
+    uint32_t split_after = 0;
+    // Whether the resource owns its memory. Transient resources that share memory with another
+    // one only do after their aliasing barrier.
+    bool active = true;
+  };
+
+  auto shares_memory = [&](RenderGraph::ResourceId a, RenderGraph::ResourceId b) {
+    return a != b && graph.transient(a) && graph.transient(b) &&
+           graph.transient_offset(a) != RenderGraph::kNotPlaced &&
+           graph.transient_offset(b) != RenderGraph::kNotPlaced &&
+           OverlapsInMemory(graph.transient_offset(a), graph.memory_request(a).size,
+                            graph.transient_offset(b), graph.memory_request(b).size);
+  };
+
+  std::vector<Tracked> resources(graph.num_resources());
+  for (RenderGraph::ResourceId resource = 0; resource < graph.num_resources(); ++resource) {
+    resources[resource].state = graph.imported_state(resource);
+    if (!graph.transient(resource) || graph.transient_offset(resource) == RenderGraph::kNotPlaced)
+      continue;
+
+    const MemoryRequest& memory = graph.memory_request(resource);
+    const std::string name = "'" + graph.resource_name(resource) + "' ";
+    if (graph.transient_offset(resource) % memory.alignment != 0)
+      return name + "is misaligned in the transient heap";
+    if (graph.transient_offset(resource) + memory.size > graph.transient_heap_size())
+      return name + "ends past the transient heap";
+    for (RenderGraph::ResourceId other = 0; other < resource; ++other) {
+      if (shares_memory(resource, other)) {
+        resources[resource].active = false;
+        resources[other].active = false;
+        if (LifetimesOverlap(memory, graph.memory_request(other)))
+          return name + "overlaps '" + graph.resource_name(other) + "' while both are alive";
+      }
+    }
+  }
+
+  auto replay = [&](const std::vector<RenderGraph::Barrier>& barriers,
+                    const std::string& where) -> std::string {
+    for (const RenderGraph::Barrier& barrier : barriers) {
+      Tracked& tracked = resources[barrier.resource];
+      const std::string name = "'" + graph.resource_name(barrier.resource) + "' " + where;
+
+      if (barrier.type == RenderGraph::Barrier::kAliasing) {
+        for (RenderGraph::ResourceId other = 0; other < graph.num_resources(); ++other) {
+          if (!shares_memory(barrier.resource, other))
+            continue;
+          if (resources[other].split_pending)
+            return "aliasing barrier for " + name + " during a split transition of '" +
+                   graph.resource_name(other) + "'";
+          resources[other].active = false;
+        }
+        tracked.active = true;
+        continue;
+      }
+      if (!tracked.active)
+        return "barrier on " + name + " while another resource owns its memory";
+
+      if (barrier.type == RenderGraph::Barrier::kUav) {
+        if (tracked.state != kResourceStateUnorderedAccess || tracked.split_pending)
+          return "UAV barrier on " + name + " outside UNORDERED_ACCESS";
+        continue;
+      }
+
+      if (tracked.state != barrier.before)
+        return "transition of " + name + " starts from " + ResourceStateString(barrier.before) +
+               " but it is in " + ResourceStateString(tracked.state);
+      if (barrier.before == barrier.after)
+        return "transition of " + name + " changes nothing";
+
+      switch (barrier.split) {
+      case RenderGraph::Barrier::kFull:
+        if (tracked.split_pending)
+          return "transition of " + name + " while a split one is pending";
+        tracked.state = barrier.after;
+        break;
+      case RenderGraph::Barrier::kBegin:
+        if (tracked.split_pending)
+          return "split transition of " + name + " begun twice";
+        tracked.split_pending = true;
+        tracked.split_after = barrier.after;
+        break;
+      case RenderGraph::Barrier::kEnd:
+        if (!tracked.split_pending || tracked.split_after != barrier.after)
+          return "split transition of " + name + " ended without a matching begin";
+        tracked.split_pending = false;
+        tracked.state = barrier.after;
+        break;
+      }
+    }
+    return "";
+  };
+
+  for (const RenderGraph::Step& step : graph.steps()) {
+    const std::string& pass_name = graph.pass_name(step.pass);
+    std::string error = replay(step.barriers, "before '" + pass_name + "'");
+    if (!error.empty())
+      return error;
+
+    for (const RenderGraph::Access& access : graph.accesses(step.pass)) {
+      const Tracked& tracked = resources[access.resource];
+      const std::string name = "'" + pass_name + "' uses '" +
+                               graph.resource_name(access.resource) + "' ";
+      if (tracked.split_pending)
+        return name + "during a split transition";
+      if (!tracked.active)
+        return name + "while another resource owns its memory";
+      const bool in_state = access.write ? tracked.state == access.state
+                                         : (tracked.state & kWriteResourceStates) == 0 &&
+                                               (tracked.state & access.state) == access.state;
+      if (!in_state)
+        return name + "in " + ResourceStateString(tracked.state) + " instead of " +
+               ResourceStateString(access.state);
+    }
+  }
+
+  std::string error = replay(graph.final_barriers(), "at the end of the frame");
+  if (!error.empty())
+    return error;
+
+  for (RenderGraph::ResourceId resource = 0; resource < graph.num_resources(); ++resource) {
+    if (resources[resource].split_pending ||
+        resources[resource].state != graph.imported_state(resource))
+      return "'" + graph.resource_name(resource) + "' ends the frame in " +
+             ResourceStateString(resources[resource].state);
+  }
+
+  // Each task on its own: the batches it records, as RenderGraph::Task describes them, must end
+  // every split transition they begin.
+  const std::vector<RenderGraph::Task>& tasks = graph.tasks();
+  for (int task = 0; task < static_cast<int>(tasks.size()); ++task) {
+    std::vector<const std::vector<RenderGraph::Barrier>*> batches;
+    if (tasks[task].part == 0)
+      batches.push_back(&graph.steps()[tasks[task].step].barriers);
+    if (task + 1 == static_cast<int>(tasks.size()))
+      batches.push_back(&graph.final_barriers());
+
+    const std::string where = " in task " + std::to_string(task) + " ('" +
+                              graph.pass_name(graph.steps()[tasks[task].step].pass) + "' part " +
+                              std::to_string(tasks[task].part) + ")";
+    std::vector<RenderGraph::Barrier> begun;
+    for (const std::vector<RenderGraph::Barrier>* batch : batches) {
+      for (const RenderGraph::Barrier& barrier : *batch) {
+        if (barrier.split == RenderGraph::Barrier::kBegin) {
+          begun.push_back(barrier);
+        } else if (barrier.split == RenderGraph::Barrier::kEnd) {
+          auto match = std::find_if(begun.begin(), begun.end(),
+                                    [&](const RenderGraph::Barrier& other) {
+                                      return other.resource == barrier.resource &&
+                                             other.after == barrier.after;
+                                    });
+          if (match == begun.end())
+            return "split transition of '" + graph.resource_name(barrier.resource) +
+                   "' ends" + where + " without beginning in it";
+          begun.erase(match);
+        }
+      }
+    }
+    if (!begun.empty())
+      return "split transition of '" + graph.resource_name(begun.front().resource) +
+             "' begins" + where + " without ending in it";
+  }
+  return "";
+}
+
+bool RunRenderGraphChecks() {
+  const Check checks[] = {
+    {"culls passes whose outputs nothing reads", CheckCulling},
+    {"keeps passes that feed the output", CheckChainKept},
+    {"merges back-to-back reads into one transition", CheckReadsMerged},
+    {"splits transitions over idle passes within a task", CheckSplit},
+    {"puts UAV barriers between unordered-access passes", CheckUavBarrier},
+    {"skips transitions the state already covers", CheckNoRedundantBarriers},
+    {"rejects invalid accesses", CheckInvalidAccesses},
+    {"aliases transient resources with disjoint lifetimes", CheckTransientAliasing},
+    {"rejects reading a transient resource first", CheckTransientReadFirst},
+    {"executes the passes in order", CheckExecutionOrder},
+    {"records tasks in parallel in task order", CheckParallelExecution},
+  };
+  return RunChecks(checks, sizeof(checks) / sizeof(checks[0]));
+}
+
+bool RunMemoryPlannerChecks() {
+  const Check checks[] = {
+    {"reuses memory across disjoint lifetimes", CheckPlanSequential},
+    {"stacks overlapping lifetimes with alignment", CheckPlanOverlapping},
+    {"fits a staggered plan in the peak", CheckPlanReachesPeak},
+    {"plans random requests without overlaps", CheckPlanRandom},
+  };
+  return RunChecks(checks, sizeof(checks) / sizeof(checks[0]));
+}
+
+int RunRenderGraphCommand(int width, int height, int frames) {
+  std::printf("render graph checks:\n");
+  bool passed = RunRenderGraphChecks();
+  std::printf("memory planner checks:\n");
+  passed = RunMemoryPlannerChecks() && passed;
+
+  RenderGraph graph;
+  AddDeferredFrame(&graph, width, height, true, nullptr);
+
+  double compile_seconds = 1e30;
+  for (int frame = 0; frame < frames; ++frame) {
+    Stopwatch stopwatch;
+    graph.Compile();
+    compile_seconds = std::min(compile_seconds, stopwatch.ElapsedSeconds());
+  }
+
+  std::printf("deferred frame:\n");
+  for (RenderGraph::PassId pass = 0; pass < graph.num_passes(); ++pass) {
+    if (graph.culled(pass))
+      std::printf("  %-10s culled\n", graph.pass_name(pass).c_str());
+  }
+
+  int transitions = 0;
+  int split_transitions = 0;
+  int batches = 0;
+  auto count = [&](const std::vector<RenderGraph::Barrier>& barriers) {
+    if (!barriers.empty())
+      ++batches;
+    for (const RenderGraph::Barrier& barrier : barriers) {
+      if (barrier.type != RenderGraph::Barrier::kTransition ||
+          barrier.split == RenderGraph::Barrier::kEnd)
+        continue;
+      ++transitions;
+      if (barrier.split == RenderGraph::Barrier::kBegin)
+        ++split_transitions;
+    }
+  };
+
+  for (const RenderGraph::Step& step : graph.steps()) {
+    std::printf("  %s\n", graph.pass_name(step.pass).c_str());
+    PrintBarriers(graph, step.barriers);
+    count(step.barriers);
+  }
+  std::printf("  end of frame\n");
+  PrintBarriers(graph, graph.final_barriers());
+  count(graph.final_barriers());
+
+  const std::string error = ValidateRenderGraph(graph);
+  if (!error.empty()) {
+    std::printf("  schedule is invalid: %s\n", error.c_str());
+    passed = false;
+  }
+
+  std::printf("  graph:        %d transitions (%d split) in %d batches, compiled in %.4f ms "
+              "(best of %d)\n",
+              transitions, split_transitions, batches, compile_seconds * 1000.0, frames);
+  std::printf("  hand-written: %d transitions (0 split) in %d batches\n",
+              kHandWrittenTransitions, kHandWrittenBatches);
+
+  std::printf("transient memory at %dx%d:\n", width, height);
+  PrintTransientMemory(graph);
+  return passed ? 0 : 1;
+}
+
+int RunRecordFrameCommand(int width, int height, int requested_frames, int max_threads) {
+  RenderGraph graph;
+  std::vector<SubmittedDraw> draws(kRecordedDraws);
+  AddDeferredFrame(&graph, width, height, false,
+                   [&draws](void* recorder, const char* pass, int part) {
+                     RecordDeferredPass(draws, static_cast<CommandRecorder*>(recorder), pass,
+                                        part);
+                   });
+  graph.Compile();
+
+  std::mt19937 rng(1);
+  std::uniform_int_distribution<uint32_t> material_dist(0, 255);
+  for (int i = 0; i < kRecordedDraws; ++i) {
+    const uint64_t address = (uint64_t(1) << 32) + uint64_t(i) * 65536;
+    draws[i] = {address, 32768, address + 32768, 32768, 3072, 0, 0, material_dist(rng)};
+  }
+
+  const int frames = requested_frames > 1 ? requested_frames : kDefaultRecordingFrames;
+  const int num_tasks = static_cast<int>(graph.tasks().size());
+  std::printf("%d tasks, %d draws, %d frames per case:\n", num_tasks, kRecordedDraws, frames);
+
+  CommandRecorder single;
+  Stopwatch sequential;
+  for (int frame = 0; frame < frames; ++frame) {
+    single.Reset();
+    graph.Execute(
+        [&single](const std::vector<RenderGraph::Barrier>& barriers) {
+          RecordBarrierBatch(&single, barriers);
+        },
+        &single);
+  }
+  const double sequential_ms = sequential.ElapsedMilliseconds() / frames;
+  std::printf("  %-10s %9.3f ms per frame, %zu KiB recorded\n", "Execute", sequential_ms,
+              single.size() / 1024);
+
+  std::vector<CommandRecorder> recorders(num_tasks);
+  bool passed = true;
+  for (int threads = 1; threads <= max_threads; threads *= 2) {
+    JobSystem jobs(threads);
+    Stopwatch parallel;
+    for (int frame = 0; frame < frames; ++frame) {
+      graph.ExecuteParallel(
+          &jobs,
+          [&recorders](int task, int) -> void* {
+            recorders[task].Reset();
+            return &recorders[task];
+          },
+          [](void* recorder, const std::vector<RenderGraph::Barrier>& barriers) {
+            RecordBarrierBatch(static_cast<CommandRecorder*>(recorder), barriers);
+          },
+          [](int, void*) {});
+    }
+    const double parallel_ms = parallel.ElapsedMilliseconds() / frames;
+
+    // Each task's recorder must hold its own slice of Execute()'s recording.
+    const std::vector<uint32_t>& expected = single.words();
+    size_t offset = 0;
+    for (const CommandRecorder& recorder : recorders) {
+      const std::vector<uint32_t>& words = recorder.words();
+      if (words.size() > expected.size() - offset ||
+          !std::equal(words.begin(), words.end(), expected.begin() + offset))
+        passed = false;
+      offset += std::min(words.size(), expected.size() - offset);
+    }
+    passed = passed && offset == expected.size();
+    std::printf("  %2d %-7s %9.3f ms per frame, %5.2fx Execute\n", threads,
+                threads == 1 ? "thread" : "threads", parallel_ms, sequential_ms / parallel_ms);
+  }
+  std::printf("  %-6s the tasks recorded what Execute does\n", passed ? "ok" : "FAILED");
+  return passed ? 0 : 1;
+}
\ No newline at end of file
@@ -0,0 +1,61 @@
+#ifndef RENDER_GRAPH_CHECKS_H_
+#define RENDER_GRAPH_CHECKS_H_
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "render_graph.h"
+
+// D3D12's default placement alignment, which the app's G-buffer and shadow textures get.
+constexpr uint64_t kTextureAlignment = 64 * 1024;
+
+// Bytes a |width| x |height| texture with |layers| array slices of |bytes_per_texel| takes in a
+// heap, rounded up to kTextureAlignment. Drivers may pad the real textures further.
+uint64_t EstimateTextureBytes(int width, int height, int layers, int bytes_per_texel);
+
+// Records part |part| of the pass called |pass| into |recorder|.
+using DeferredPassFn = std::function<void(void* recorder, const char* pass, int part)>;
+
+// The parts of the app's shadow pass, one per cubemap face, which it records in parallel in
+// per-face mode. In single-pass mode the first draws every face and the others stay empty.
+constexpr int kShadowPassParts = 6;
+
+// Adds the DeferredShading app's passes to |graph| with the same reads and writes and parts as
+// their AddToRenderGraph() methods, and its transient resources for a |width| x |height| window
+// with sizes from EstimateTextureBytes(). The passes record with |record|, if it is not null.
+// With |debug_view|, also adds a pass that draws the normals into a texture nothing reads, which
+// Compile() should cull.
+void AddDeferredFrame(RenderGraph* graph, int width, int height, bool debug_view,
+                      const DeferredPassFn& record);
+
+// Replays the compiled schedule of |graph|, checking that every barrier starts from the state the
+// resource is in, that split barriers are ended before the resource is used and within the task
+// that began them, since each task records into a command list of its own, that every pass
+// finds its resources in the states it declared, and that transient resources live in the
+// transient heap, do not overlap a resource alive at the same time and are only used while they
+// own their memory. Returns what went wrong first, or an empty string.
+std::string ValidateRenderGraph(const RenderGraph& graph);
+
+// Compiles small graphs whose schedules are known and compares. Prints one line per check and
+// returns whether all passed.
+bool RunRenderGraphChecks();
+
+// The same for PlanMemory(), on small request lists with known plans and on random ones.
+bool RunMemoryPlannerChecks();
+
+// The render-graph command: runs both sets of checks, then compiles DeferredShading's frame at
+// |width| x |height|, with an extra debug view for the compiler to cull, best of |frames| times,
+// and prints its schedule next to the barriers the app used to record by hand and its transient
+// memory next to the textures it used to commit. Returns the exit code.
+int RunRenderGraphCommand(int width, int height, int frames);
+
+// The record-frame command: records the deferred frame's render graph at |width| x |height| into
+// one recorder with Execute(), as the app did before it recorded in parallel, then with
+// ExecuteParallel() into a recorder per task on 1, 2, 4... up to |max_threads| threads, and prints
+// the time per frame of each. The recorders of the tasks together must hold what the single
+// recorder does. |requested_frames| is --frames; 1 times a default number. Returns the exit code.
+int RunRecordFrameCommand(int width, int height, int requested_frames, int max_threads);
+
+#endif  // RENDER_GRAPH_CHECKS_H_
\ No newline at end of file
@@ -0,0 +1,131 @@
+#include "sampler.h"
+
+#include <stdexcept>
+#include <utility>
+
+#include "random.h"
+
+namespace {
+
+// Scrambled values are 32-bit fixed point; the top 24 bits are exact in a float.
+float ToUnitFloat(uint32_t value) { return static_cast<float>(value >> 8) * (1.f / 16777216.f); }
+
+uint32_t ReverseBits(uint32_t value) {
+  value = (value << 16) | (value >> 16);
+  value = ((value & 0x00ff00ffu) << 8) | ((value & 0xff00ff00u) >> 8);
+  value = ((value & 0x0f0f0f0fu) << 4) | ((value & 0xf0f0f0f0u) >> 4);
+  value = ((value & 0x33333333u) << 2) | ((value & 0xccccccccu) >> 2);
+  value = ((value & 0x55555555u) << 1) | ((value & 0xaaaaaaaau) >> 1);
+  return value;
+}
+
+// Seed shared by every dimension of one pixel.
+uint32_t PixelSeed(uint32_t x, uint32_t y, uint32_t seed) {
+  return PcgHash(seed ^ PcgHash(x ^ PcgHash(y)));
+}
+
+// Burley's variant of the Laine-Karras permutation: each bit is flipped depending only on the
+// bits below it, so after bit reversal it is an Owen scramble.
+uint32_t LaineKarrasPermutation(uint32_t value, uint32_t seed) {
+  value += seed;
+  value ^= value * 0x6c50b47cu;
+  value ^= value * 0xb82f1e52u;
+  value ^= value * 0xc7afe638u;
+  value ^= value * 0x8d22f6e6u;
+  return value;
+}
+
+uint32_t NestedUniformScramble(uint32_t value, uint32_t seed) {
+  return ReverseBits(LaineKarrasPermutation(ReverseBits(value), seed));
+}
+
+// Second Sobol dimension, whose generator matrix is Pascal's triangle mod 2.
+uint32_t SobolDimension1(uint32_t index) {
+  uint32_t result = 0;
+  for (uint32_t direction = 1u << 31; index != 0; index >>= 1, direction ^= direction >> 1) {
+    if (index & 1)
+      result ^= direction;
+  }
+  return result;
+}
+
+// Components of the generating vector "lattice-39102-1024-1048576.3600" (Cools, Kuo and Nuyens
+// 2006), for up to 2^20 points.
+constexpr uint32_t kLatticeGenerator[kNumLatticeDimensions] = {
+    1,      182667, 469891, 498753, 110745, 446247, 250185, 118627,
+    245333, 283199, 408519, 391023, 246327, 126539, 399185, 461527,
+    300343, 69681,  516695, 436179, 106383, 238523, 413283, 70841,
+    47719,  300129, 113029, 123925, 410745, 211325, 17489,  511893,
+};
+
+// log2 of the number of points the generating vector was built for.
+constexpr int kLatticeLog2Points = 20;
+
+// |dimension| of point |sample| of the Owen-scrambled Sobol sequence picked by |seed|, as 32-bit
+// fixed point.
+uint32_t ScrambledSobol(uint32_t sample, uint32_t dimension, uint32_t seed) {
+  const uint32_t pair = dimension / 2;
+
+  // Shuffling the sample order per pair keeps the pairs independent of each other while each one
+  // keeps its stratification.
+  const uint32_t index = NestedUniformScramble(sample, PcgHash(seed ^ PcgHash(pair)));
+  const uint32_t value = (dimension & 1) ? SobolDimension1(index) : ReverseBits(index);
+  return NestedUniformScramble(value, PcgHash(seed + PcgHash(dimension + 0x9e3779b9u)));
+}
+
+}  // namespace
+
+float RandomSampler::Get(uint32_t x, uint32_t y, uint32_t sample, uint32_t dimension) const {
+  return RandomFloat(PixelSeed(x, y, seed_), sample, dimension);
+}
+
+float SobolSampler::Get(uint32_t x, uint32_t y, uint32_t sample, uint32_t dimension) const {
+  return ToUnitFloat(ScrambledSobol(sample, dimension, PixelSeed(x, y, seed_)));
+}
+
+float LatticeSampler::Get(uint32_t x, uint32_t y, uint32_t sample, uint32_t dimension) const {
+  const uint32_t pixel_seed = PixelSeed(x, y, seed_);
+  if (dimension >= kNumLatticeDimensions)
+    return RandomFloat(pixel_seed, sample, dimension);
+
+  // phi2(i) * g is computed mod 2^20 and moved to the top bits, where the unsigned overflow is
+  // the frac().
+  const uint32_t point = ((ReverseBits(sample) >> (32 - kLatticeLog2Points)) *
+                         kLatticeGenerator[dimension]) << (32 - kLatticeLog2Points);
+  return ToUnitFloat(point + PcgHash(pixel_seed ^ PcgHash(dimension)));
+}
+
+BlueNoiseSampler::BlueNoiseSampler(BlueNoiseTiles tiles, uint32_t seed)
+    : tiles_(std::move(tiles)), seed_(seed) {
+  if (tiles_.num_slices < 1)
+    throw std::runtime_error("BlueNoiseSampler: no tiles");
+}
+
+float BlueNoiseSampler::Get(uint32_t x, uint32_t y, uint32_t sample, uint32_t dimension) const {
+  const uint32_t num_slices = static_cast<uint32_t>(tiles_.num_slices);
+  const uint32_t mask = static_cast<uint32_t>(tiles_.size - 1);
+
+  // Repeats of a slice are shifted by a random offset, which decorrelates them.
+  const uint32_t offset = PcgHash(seed_ ^ PcgHash(dimension / num_slices));
+  const uint32_t value = tiles_.at(dimension % num_slices, (x + offset) & mask,
+                                   (y + (offset >> 16)) & mask);
+
+  // The 16-bit value moved to the top bits, plus half the gap between ranks to center it. Every
+  // pixel shifts the same sequence point, so the pixels' errors differ only by the blue noise.
+  const uint32_t half_gap = (1u << 31) / (mask + 1) / (mask + 1);
+  return ToUnitFloat((value << 16) + half_gap + ScrambledSobol(sample, dimension, seed_));
+}
+
+std::unique_ptr<Sampler> MakeSampler(const std::string& name, uint32_t seed) {
+  if (name == "random")
+    return std::make_unique<RandomSampler>(seed);
+  if (name == "sobol")
+    return std::make_unique<SobolSampler>(seed);
+  if (name == "lattice")
+    return std::make_unique<LatticeSampler>(seed);
+  if (name == "bluenoise") {
+    return std::make_unique<BlueNoiseSampler>(
+        GenerateBlueNoise(kBlueNoiseTileSize, kBlueNoiseSlices, seed), seed);
+  }
+  throw std::runtime_error("unknown sampler " + name);
+}
\ No newline at end of file
@@ -0,0 +1,101 @@
+#ifndef SAMPLER_H_
+#define SAMPLER_H_
+
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#include "blue_noise.h"
+
+// Source of the numbers a path consumes, one per dimension: the subpixel position first, then
+// three per bounce. Like RandomFloat, a sampler is a pure function of its arguments, so paths carry
+// no generator state and any thread or stage can draw any sample.
+//
+// The low-discrepancy samplers spread the samples of one pixel more evenly than independent
+// numbers, so the error falls faster with the sample count. Each decorrelates pixels with a
+// per-pixel scramble or offset; otherwise every pixel would make the same mistakes and the error
+// would show up as structure instead of noise.
+class Sampler {
+public:
+  virtual ~Sampler() = default;
+
+  virtual const char* name() const = 0;
+
+  // Number in [0, 1) for |dimension| of sample |sample| of pixel (x, y).
+  virtual float Get(uint32_t x, uint32_t y, uint32_t sample, uint32_t dimension) const = 0;
+};
+
+// Independent uniform numbers, the baseline every other sampler is measured against.
+class RandomSampler : public Sampler {
+public:
+  explicit RandomSampler(uint32_t seed = 0) : seed_(seed) {}
+
+  const char* name() const override { return "random"; }
+  float Get(uint32_t x, uint32_t y, uint32_t sample, uint32_t dimension) const override;
+
+private:
+  uint32_t seed_;
+};
+
+// Sobol points with hash-based Owen scrambling, from "Practical Hash-based Owen Scrambling"
+// (Burley 2020). Dimensions are taken in pairs from the first two Sobol dimensions, which form a
+// (0, 2)-sequence, and each pair shuffles the sample order with its own scramble so the pairs do
+// not correlate. Sample counts that are powers of two are stratified best.
+class SobolSampler : public Sampler {
+public:
+  explicit SobolSampler(uint32_t seed = 0) : seed_(seed) {}
+
+  const char* name() const override { return "sobol"; }
+  float Get(uint32_t x, uint32_t y, uint32_t sample, uint32_t dimension) const override;
+
+private:
+  uint32_t seed_;
+};
+
+// Extensible rank-1 lattice: sample i is frac(phi2(i) * g / 2^20) per dimension, where phi2 is the
+// base-2 radical inverse and g an extensible generating vector from Cools, Kuo and Nuyens (2006),
+// so every power-of-two prefix is a full lattice. Pixels are decorrelated with a random shift
+// (Cranley-Patterson rotation). The vector has kNumLatticeDimensions components; later dimensions
+// fall back to independent numbers.
+constexpr uint32_t kNumLatticeDimensions = 32;
+
+class LatticeSampler : public Sampler {
+public:
+  explicit LatticeSampler(uint32_t seed = 0) : seed_(seed) {}
+
+  const char* name() const override { return "lattice"; }
+  float Get(uint32_t x, uint32_t y, uint32_t sample, uint32_t dimension) const override;
+
+private:
+  uint32_t seed_;
+};
+
+// Blue-noise dithered sampling (Georgiev and Fajardo 2016): every pixel uses the same scrambled
+// Sobol sequence, shifted per dimension by the value of a blue-noise slice at the pixel. Each
+// pixel keeps the sequence's stratification over time, and at any sample count the pixels'
+// errors differ the way the blue noise does, as high-frequency noise that a small blur or the
+// eye averages away. Dimensions beyond the number of slices reuse them with another toroidal
+// offset.
+class BlueNoiseSampler : public Sampler {
+public:
+  explicit BlueNoiseSampler(BlueNoiseTiles tiles, uint32_t seed = 0);
+
+  const char* name() const override { return "bluenoise"; }
+  float Get(uint32_t x, uint32_t y, uint32_t sample, uint32_t dimension) const override;
+
+  const BlueNoiseTiles& tiles() const { return tiles_; }
+
+private:
+  BlueNoiseTiles tiles_;
+  uint32_t seed_;
+};
+
+// Tiles MakeSampler generates for BlueNoiseSampler.
+constexpr int kBlueNoiseTileSize = 64;
+constexpr int kBlueNoiseSlices = 8;
+
+// The sampler called |name|: random, sobol, lattice or bluenoise. Throws std::runtime_error for
+// any other name.
+std::unique_ptr<Sampler> MakeSampler(const std::string& name, uint32_t seed = 0);
+
+#endif  // SAMPLER_H_
\ No newline at end of file
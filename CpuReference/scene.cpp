@@ -0,0 +1,151 @@
+#include "scene.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <memory>
+#include <random>
+#include <string>
+
+#include "scene_cache.h"
+#include "sdkmesh.h"
+
+namespace {
+
+bool EndsWith(const std::string& str, const char* suffix) {
+  size_t length = std::strlen(suffix);
+  return str.size() >= length && str.compare(str.size() - length, length, suffix) == 0;
+}
+
+Vec3 ToVec3(const sdkmesh::Float3& value) {
+  return {value.x, value.y, value.z};
+}
+
+Vec3 ToVec3(const sdkmesh::Float4& value) {
+  return {value.x, value.y, value.z};
+}
+
+}  // namespace
+
+Scene::Scene(const char* path) {
+  std::unique_ptr<scene_cache::Scene> scene;
+  if (EndsWith(path, ".scene")) {
+    scene = std::make_unique<scene_cache::Scene>(path);
+  } else {
+    sdkmesh::Mesh mesh(path);
+    scene = std::make_unique<scene_cache::Scene>(
+        scene_cache::Bake(mesh, scene_cache::BakeOptions()));
+  }
+
+  // Vertex buffers are concatenated; |base_vertices| maps each one to its first vertex.
+  std::vector<uint32_t> base_vertices;
+  std::vector<scene_cache::Vertex> vertices;
+
+  for (uint32_t i = 0; i < scene->num_vertex_buffers(); ++i) {
+    const scene_cache::VertexBufferDesc& desc = scene->vertex_buffer(i);
+
+    base_vertices.push_back(static_cast<uint32_t>(positions_.size()));
+
+    vertices.resize(desc.num_vertices);
+    scene_cache::DecodeVertices(desc, scene->vertex_data(i), vertices.data());
+
+    for (const scene_cache::Vertex& vertex : vertices) {
+      positions_.push_back(ToVec3(vertex.position));
+      normals_.push_back(ToVec3(vertex.normal));
+    }
+  }
+
+  for (uint32_t i = 0; i < scene->num_draw_ranges(); ++i) {
+    const scene_cache::DrawRange& range = scene->draw_range(i);
+    if ((range.flags & scene_cache::kDrawRangeAlpha) ||
+        range.primitive_type != sdkmesh::kTriangleList) {
+      continue;
+    }
+
+    const scene_cache::IndexBufferDesc& ib = scene->index_buffer(range.index_buffer);
+    const uint8_t* index_data = scene->index_data(range.index_buffer);
+    const uint32_t base_vertex = base_vertices[range.vertex_buffer] + range.vertex_offset;
+
+    for (uint32_t j = 0; j < range.index_count; ++j) {
+      uint32_t index = range.start_index + j;
+      uint32_t vertex = ib.index_type == sdkmesh::kIndexType32Bit
+          ? reinterpret_cast<const uint32_t*>(index_data)[index]
+          : reinterpret_cast<const uint16_t*>(index_data)[index];
+      indices_.push_back(base_vertex + vertex);
+    }
+
+    for (uint32_t j = 0; j < range.index_count / 3; ++j)
+      triangle_materials_.push_back(range.material_index);
+  }
+
+  for (uint32_t i = 0; i < scene->num_materials(); ++i) {
+    const scene_cache::MaterialDesc& desc = scene->material(i);
+    materials_.push_back({ToVec3(desc.ambient_color), ToVec3(desc.diffuse_color),
+                          ToVec3(desc.emissive_color)});
+  }
+}
+
+Scene::Scene(uint32_t num_triangles, uint32_t seed) {
+  std::mt19937 rng(seed);
+  std::uniform_real_distribution<float> unit(-1.f, 1.f);
+
+  // Sized so the triangles roughly tile the volume without all overlapping.
+  const float triangle_size = 1.5f / std::cbrt(static_cast<float>(std::max(num_triangles, 1u)));
+
+  positions_.reserve(static_cast<size_t>(num_triangles) * 3);
+  normals_.reserve(static_cast<size_t>(num_triangles) * 3);
+  indices_.reserve(static_cast<size_t>(num_triangles) * 3);
+
+  for (uint32_t i = 0; i < num_triangles; ++i) {
+    const Vec3 center = {unit(rng), 1.f + unit(rng), unit(rng)};
+
+    Vec3 corners[3];
+    for (Vec3& corner : corners)
+      corner = center + Vec3{unit(rng), unit(rng), unit(rng)} * triangle_size;
+
+    Vec3 normal = Cross(corners[1] - corners[0], corners[2] - corners[0]);
+    float length = Length(normal);
+    normal = length > 0.f ? normal / length : Vec3{0.f, 1.f, 0.f};
+
+    for (const Vec3& corner : corners) {
+      indices_.push_back(static_cast<uint32_t>(positions_.size()));
+      positions_.push_back(corner);
+      normals_.push_back(normal);
+    }
+
+    triangle_materials_.push_back(0);
+  }
+
+  const Vec3 white = {0.725f, 0.71f, 0.68f};
+  materials_.push_back({white, white, {0.f, 0.f, 0.f}});
+}
+
+bool Scene::Intersect(const Ray& ray, Hit* hit) const {
+  hit->t = ray.t_max;
+  hit->triangle = kInvalidTriangle;
+
+  for (uint32_t i = 0; i < num_triangles(); ++i) {
+    float t, u, v;
+    if (IntersectTriangle(ray, position(i, 0), position(i, 1), position(i, 2), true, hit->t, &t,
+                          &u, &v) &&
+        IsCloser(t, i, *hit)) {
+      hit->t = t;
+      hit->u = u;
+      hit->v = v;
+      hit->triangle = i;
+    }
+  }
+
+  return hit->triangle != kInvalidTriangle;
+}
+
+bool Scene::Occluded(const Ray& ray) const {
+  for (uint32_t i = 0; i < num_triangles(); ++i) {
+    float t, u, v;
+    if (IntersectTriangle(ray, position(i, 0), position(i, 1), position(i, 2), true, ray.t_max,
+                          &t, &u, &v)) {
+      return true;
+    }
+  }
+  return false;
+}
\ No newline at end of file
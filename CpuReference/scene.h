@@ -0,0 +1,54 @@
+#ifndef SCENE_H_
+#define SCENE_H_
+
+#include <cstdint>
+#include <vector>
+
+#include "ray.h"
+#include "vec_math.h"
+
+struct Material {
+  Vec3 ambient_color;
+  Vec3 diffuse_color;
+  Vec3 emissive_color;
+};
+
+// Triangle soup of the opaque triangle lists in a scene - the same geometry the RayTracing app
+// puts in its BLAS. Indices are absolute, with each range's base vertex already applied.
+class Scene {
+public:
+  // Loads a baked .scene, or bakes an .sdkmesh in memory. Throws std::runtime_error on failure.
+  explicit Scene(const char* path);
+
+  // Random soup of |num_triangles| small triangles filling the volume of the Cornell box, for
+  // measuring scaling far beyond what the asset contains.
+  Scene(uint32_t num_triangles, uint32_t seed);
+
+  uint32_t num_triangles() const { return static_cast<uint32_t>(triangle_materials_.size()); }
+
+  const Vec3& position(uint32_t triangle, int corner) const {
+    return positions_[indices_[triangle * 3 + corner]];
+  }
+  const Vec3& normal(uint32_t triangle, int corner) const {
+    return normals_[indices_[triangle * 3 + corner]];
+  }
+
+  const Material& triangle_material(uint32_t triangle) const {
+    return materials_[triangle_materials_[triangle]];
+  }
+
+  // Closest front-facing hit, or false on a miss.
+  bool Intersect(const Ray& ray, Hit* hit) const;
+
+  // True if any front-facing triangle is hit in [t_min, t_max].
+  bool Occluded(const Ray& ray) const;
+
+private:
+  std::vector<Vec3> positions_;
+  std::vector<Vec3> normals_;
+  std::vector<uint32_t> indices_;
+  std::vector<uint32_t> triangle_materials_;
+  std::vector<Material> materials_;
+};
+
+#endif  // SCENE_H_
\ No newline at end of file
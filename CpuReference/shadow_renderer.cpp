@@ -0,0 +1,224 @@
+#include "shadow_renderer.h"
+
+#include <algorithm>
+
+#include "profiling.h"
+#include "shadow_faces.h"
+
+namespace {
+
+// Depth the shadow pass clears each face to.
+constexpr float kClearDepth = 1.f;
+
+// Triangles a clipped input triangle can turn into.
+constexpr size_t kMaxTrianglesPerInput = kMaxClipVertices - 2;
+
+constexpr uint32_t kAllFaces = (1u << kNumShadowFaces) - 1;
+
+}  // namespace
+
+ShadowRenderer::ShadowRenderer(ThreadPool* pool, bool use_avx2)
+    : pool_(pool), use_avx2_(use_avx2) {}
+
+ShadowStats ShadowRenderer::Render(const DeferredScene& scene, const DeferredConstants& constants,
+                                   ShadowSubmission submission, ShadowCubemap* cubemap) {
+  const int size = cubemap->size;
+  tiles_per_side_ = (size + kRasterTileSize - 1) / kRasterTileSize;
+  const int tiles_per_face = tiles_per_side_ * tiles_per_side_;
+  ids_.resize(cubemap->depth.size());
+  tile_seconds_.resize(static_cast<size_t>(tiles_per_face) * 6);
+
+  ShadowStats stats;
+
+  Stopwatch stopwatch;
+  CullDraws(scene, constants, submission);
+  stats.cull_seconds = stopwatch.ElapsedSeconds();
+
+  const std::vector<DrawCallArgs>& draws = scene.draw_call_args();
+  for (size_t i = 0; i < draws.size(); ++i) {
+    const int num_faces = CountShadowFaces(face_masks_[i]);
+    if (submission == ShadowSubmission::kSinglePass)
+      stats.draw_calls += num_faces > 0 ? 1 : 0;
+    else
+      stats.draw_calls += num_faces;
+    stats.instances += num_faces;
+    stats.vertex_invocations += static_cast<uint64_t>(draws[i].vertex_count) * num_faces;
+  }
+
+  stopwatch.Restart();
+  TransformVertices(scene, constants);
+  stats.vertex_seconds = stopwatch.ElapsedSeconds();
+
+  stopwatch.Restart();
+  pool_->ParallelFor(6, [&](int face, int) {
+    SetUpFace(scene, constants, face, submission, size, &stats.faces[face]);
+  });
+  stats.setup_seconds = stopwatch.ElapsedSeconds();
+
+  stopwatch.Restart();
+  pool_->ParallelFor(tiles_per_face * 6, [&](int index, int) {
+    RasterizeTile(index / tiles_per_face, index % tiles_per_face, cubemap);
+  });
+  stats.raster_seconds = stopwatch.ElapsedSeconds();
+
+  for (int face = 0; face < 6; ++face) {
+    for (int tile = 0; tile < tiles_per_face; ++tile)
+      stats.faces[face].raster_seconds += tile_seconds_[face * tiles_per_face + tile];
+  }
+  return stats;
+}
+
+void ShadowRenderer::TransformVertices(const DeferredScene& scene,
+                                       const DeferredConstants& constants) {
+  const std::vector<DrawCallArgs>& draws = scene.draw_call_args();
+
+  first_vertex_.resize(draws.size() + 1);
+  first_vertex_[0] = 0;
+  for (size_t i = 0; i < draws.size(); ++i)
+    first_vertex_[i + 1] = first_vertex_[i] + draws[i].vertex_count;
+  view_positions_.resize(first_vertex_.back());
+
+  pool_->ParallelFor(static_cast<int>(draws.size()), [&](int draw, int) {
+    const DrawCallArgs& args = draws[draw];
+    Vec4* positions = &view_positions_[first_vertex_[draw]];
+    for (uint32_t i = 0; i < args.vertex_count; ++i) {
+      const scene_cache::Vertex& vertex =
+          args.vertices[args.vertex_offset + static_cast<int64_t>(i)];
+      const Vec4 position = {vertex.position.x, vertex.position.y, vertex.position.z, 1.f};
+      positions[i] = MulConstant(position, constants.world_view_mat);
+    }
+  });
+}
+
+void ShadowRenderer::CullDraws(const DeferredScene& scene, const DeferredConstants& constants,
+                               ShadowSubmission submission) {
+  const std::vector<DrawCallArgs>& draws = scene.draw_call_args();
+  face_masks_.assign(draws.size(), kAllFaces);
+  packed_faces_.assign(draws.size(), PackShadowFaces(kAllFaces));
+  if (submission == ShadowSubmission::kPerFace)
+    return;
+
+  pool_->ParallelFor(static_cast<int>(draws.size()), [&](int draw, int) {
+    const DrawCallArgs& args = draws[draw];
+    Vec4 view_corners[8];
+    for (int corner = 0; corner < 8; ++corner) {
+      const Vec4 position = {corner & 1 ? args.bounds_max.x : args.bounds_min.x,
+                             corner & 2 ? args.bounds_max.y : args.bounds_min.y,
+                             corner & 4 ? args.bounds_max.z : args.bounds_min.z, 1.f};
+      view_corners[corner] = MulConstant(position, constants.world_view_mat);
+    }
+
+    uint32_t mask = 0;
+    for (int face = 0; face < kNumShadowFaces; ++face) {
+      float corners[8][4];
+      for (int corner = 0; corner < 8; ++corner) {
+        const Vec4 clip = MulConstant(view_corners[corner], constants.shadow_mats[face]);
+        corners[corner][0] = clip.x;
+        corners[corner][1] = clip.y;
+        corners[corner][2] = clip.z;
+        corners[corner][3] = clip.w;
+      }
+      if (BoxInFrustum(corners))
+        mask |= 1u << face;
+    }
+    face_masks_[draw] = mask;
+    packed_faces_[draw] = PackShadowFaces(mask);
+  });
+}
+
+void ShadowRenderer::SetUpFace(const DeferredScene& scene, const DeferredConstants& constants,
+                               int face, ShadowSubmission submission, int size,
+                               ShadowFaceStats* stats) {
+  Stopwatch stopwatch;
+  const std::vector<DrawCallArgs>& draws = scene.draw_call_args();
+  const Mat4& shadow_mat = constants.shadow_mats[face];
+  const float guard_band = GuardBand(size);
+
+  FaceBins& face_bins = faces_[face];
+  face_bins.num_bins = 0;
+  TileBins* bins = nullptr;
+
+  for (size_t draw = 0; draw < draws.size(); ++draw) {
+    if (!(face_masks_[draw] & (1u << face))) {
+      ++stats->culled_draws;
+      continue;
+    }
+
+    // shadow_pass_single_vs.hlsl finds the face of each instance in the packed list, which has
+    // to agree with the mask.
+    if (submission == ShadowSubmission::kSinglePass) {
+      bool routed = false;
+      for (int instance = 0; instance < CountShadowFaces(face_masks_[draw]); ++instance)
+        routed = routed || UnpackShadowFace(packed_faces_[draw], instance) == face;
+      if (!routed)
+        continue;
+    }
+
+    const DrawCallArgs& args = draws[draw];
+    ++stats->draws;
+    stats->triangles += args.index_count / 3;
+
+    // shadow_pass_vs.hlsl.
+    face_bins.clip_positions.resize(args.vertex_count);
+    const Vec4* view_positions = &view_positions_[first_vertex_[draw]];
+    for (uint32_t i = 0; i < args.vertex_count; ++i)
+      face_bins.clip_positions[i] = MulConstant(view_positions[i], shadow_mat);
+
+    for (uint32_t first_index = 0; first_index + 3 <= args.index_count; first_index += 3) {
+      ClippedVertex polygon[kMaxClipVertices];
+      const int num_vertices =
+          ClipTriangle(face_bins.clip_positions[args.index(first_index)],
+                       face_bins.clip_positions[args.index(first_index + 1)],
+                       face_bins.clip_positions[args.index(first_index + 2)], guard_band,
+                       guard_band, polygon);
+      if (num_vertices < 3)
+        continue;
+
+      if (!bins || bins->triangles.size() + kMaxTrianglesPerInput > kMaxBinnedTriangles) {
+        if (face_bins.num_bins == face_bins.bins.size())
+          face_bins.bins.emplace_back();
+        bins = &face_bins.bins[face_bins.num_bins++];
+        bins->triangles.clear();
+      }
+
+      ProjectedVertex projected[kMaxClipVertices];
+      for (int i = 0; i < num_vertices; ++i)
+        projected[i] = ProjectVertex(polygon[i].position, size, size);
+
+      for (int i = 1; i + 1 < num_vertices; ++i) {
+        RasterTriangle triangle;
+        if (SetUpTriangle(projected[0], projected[i], projected[i + 1], size, size, &triangle))
+          bins->triangles.push_back(triangle);
+      }
+    }
+  }
+
+  for (size_t i = 0; i < face_bins.num_bins; ++i) {
+    face_bins.bins[i].Bin(tiles_per_side_, tiles_per_side_);
+    stats->rasterized += face_bins.bins[i].triangles.size();
+  }
+  stats->setup_seconds = stopwatch.ElapsedSeconds();
+}
+
+void ShadowRenderer::RasterizeTile(int face, int tile, ShadowCubemap* cubemap) {
+  Stopwatch stopwatch;
+  const int size = cubemap->size;
+  const int x0 = (tile % tiles_per_side_) * kRasterTileSize;
+  const int y0 = (tile / tiles_per_side_) * kRasterTileSize;
+  const int x1 = std::min(x0 + kRasterTileSize, size);
+  const int y1 = std::min(y0 + kRasterTileSize, size);
+
+  const size_t face_offset = static_cast<size_t>(face) * size * size;
+  const RasterTarget target = {cubemap->face(face), &ids_[face_offset], size};
+  for (int y = y0; y < y1; ++y) {
+    const size_t row = static_cast<size_t>(y) * size;
+    std::fill(target.depth + row + x0, target.depth + row + x1, kClearDepth);
+  }
+
+  const FaceBins& face_bins = faces_[face];
+  for (size_t i = 0; i < face_bins.num_bins; ++i)
+    RasterizeBinnedTile(face_bins.bins[i], tile, 0, x0, y0, x1, y1, use_avx2_, target);
+
+  tile_seconds_[static_cast<size_t>(face) * tiles_per_side_ * tiles_per_side_ + tile] =
+      stopwatch.ElapsedSeconds();
+}
\ No newline at end of file
@@ -0,0 +1,121 @@
+#ifndef SHADOW_RENDERER_H_
+#define SHADOW_RENDERER_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "deferred_lighting.h"
+#include "deferred_scene.h"
+#include "raster_tile.h"
+#include "thread_pool.h"
+#include "vec_math.h"
+
+// How the draws reach the cubemap's faces.
+enum class ShadowSubmission {
+  // Every draw once per face, as ShadowPass::RenderFace() does.
+  kPerFace,
+  // Once per face, skipping the faces whose frustum the draw's bounding box misses.
+  kPerFaceCulled,
+  // One draw each, instanced once per face it reaches, as ShadowPass::RenderFrame() does.
+  kSinglePass,
+};
+
+// Work done for one cubemap face.
+struct ShadowFaceStats {
+  // Draws, or instances of draws, that reached the face, and the draws culled because their bounds
+  // miss its frustum.
+  uint32_t draws = 0;
+  uint32_t culled_draws = 0;
+  // Triangles of the submitted draws, and the ones left after clipping and culling.
+  uint64_t triangles = 0;
+  uint64_t rasterized = 0;
+
+  // Thread time spent on the face in each stage.
+  double setup_seconds = 0.0;
+  double raster_seconds = 0.0;
+};
+
+struct ShadowStats {
+  // What the frame submits: draw calls, the instances they draw, and the vertex shader
+  // invocations of those instances.
+  uint64_t draw_calls = 0;
+  uint64_t instances = 0;
+  uint64_t vertex_invocations = 0;
+
+  // Wall time of each stage over the frame.
+  double cull_seconds = 0.0;
+  double vertex_seconds = 0.0;
+  double setup_seconds = 0.0;
+  double raster_seconds = 0.0;
+
+  ShadowFaceStats faces[6];
+
+  double TotalSeconds() const {
+    return cull_seconds + vertex_seconds + setup_seconds + raster_seconds;
+  }
+};
+
+// Software version of the shadow pass: draws the scene into each face of a ShadowCubemap with
+// shadow_pass_vs.hlsl's transforms and the default fixed-function state, which the G-buffer pass
+// shares. Every ShadowSubmission leaves the same cubemap, since a culled draw has no triangle in
+// the face's frustum; they differ in the draws and vertex work they submit. A frame runs in four
+// parallel stages:
+//
+//   cull     tests each draw's bounding box against the faces, as ShadowPass::CullDraws() does
+//   vertex   transforms every vertex to view space once for all faces
+//   setup    one task per face: transforms the draws, or the instances, that reach the face to its
+//            clip space, then clips, sets up and bins their triangles like GbufferRasterizer
+//   raster   one task per tile of every face, with the same tile kernels, keeping only depth
+class ShadowRenderer {
+public:
+  // |use_avx2| picks RasterizeTileAvx2 over RasterizeTileScalar, so it may only be set when
+  // CpuSupportsAvx2() returns true.
+  ShadowRenderer(ThreadPool* pool, bool use_avx2);
+
+  // Renders into |cubemap| at its current size.
+  ShadowStats Render(const DeferredScene& scene, const DeferredConstants& constants,
+                     ShadowSubmission submission, ShadowCubemap* cubemap);
+
+  // The faces each draw reached in the last Render(), bit f for face f.
+  const std::vector<uint32_t>& face_masks() const { return face_masks_; }
+
+private:
+  // Triangles set up for one face, split into bins of at most kMaxBinnedTriangles in draw order.
+  struct FaceBins {
+    std::vector<TileBins> bins;
+    size_t num_bins = 0;
+    // Clip-space positions of the draw being set up.
+    std::vector<Vec4> clip_positions;
+  };
+
+  void TransformVertices(const DeferredScene& scene, const DeferredConstants& constants);
+  // Sets face_masks_ and packed_faces_ from the draws' bounding boxes, or to every face for
+  // kPerFace.
+  void CullDraws(const DeferredScene& scene, const DeferredConstants& constants,
+                 ShadowSubmission submission);
+  void SetUpFace(const DeferredScene& scene, const DeferredConstants& constants, int face,
+                 ShadowSubmission submission, int size, ShadowFaceStats* stats);
+  void RasterizeTile(int face, int tile, ShadowCubemap* cubemap);
+
+  ThreadPool* pool_;
+  bool use_avx2_;
+
+  int tiles_per_side_ = 0;
+
+  // View-space positions of every draw's vertices, draw i's from first_vertex_[i] on.
+  std::vector<Vec4> view_positions_;
+  std::vector<size_t> first_vertex_;
+
+  // The faces each draw reaches, and the same faces packed by PackShadowFaces().
+  std::vector<uint32_t> face_masks_;
+  std::vector<uint32_t> packed_faces_;
+
+  FaceBins faces_[6];
+  // The tile kernels also write triangle ids; nothing reads them here.
+  std::vector<uint32_t> ids_;
+  // Thread time of each tile in the raster stage.
+  std::vector<double> tile_seconds_;
+};
+
+#endif  // SHADOW_RENDERER_H_
\ No newline at end of file
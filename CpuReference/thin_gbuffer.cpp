@@ -0,0 +1,67 @@
+#include "thin_gbuffer.h"
+
+const GbufferTarget kWideGbufferTargets[4] = {
+    {"ambient", "R8G8B8A8_UNORM", 4},
+    {"position", "R32G32B32A32_FLOAT", 16},
+    {"diffuse", "R8G8B8A8_UNORM", 4},
+    {"normal", "R32G32B32A32_FLOAT", 16},
+};
+
+const GbufferTarget kThinGbufferTargets[2] = {
+    {"normal", "R16G16_SNORM", 4},
+    {"material", "R16_UINT", 2},
+};
+
+void EncodeThinGbuffer(const Gbuffer& gbuffer, ThreadPool* pool, ThinGbuffer* thin) {
+  const size_t num_pixels = static_cast<size_t>(gbuffer.width) * gbuffer.height;
+  thin->width = gbuffer.width;
+  thin->height = gbuffer.height;
+  thin->normal.resize(num_pixels);
+  thin->material = gbuffer.material;
+  thin->depth = gbuffer.depth;
+
+  pool->ParallelFor(gbuffer.height, [&](int y, int) {
+    const size_t row = static_cast<size_t>(y) * gbuffer.width;
+    for (size_t pixel = row; pixel < row + gbuffer.width; ++pixel) {
+      const Vec4& normal = gbuffer.normal[pixel];
+      const float xyz[3] = {normal.x, normal.y, normal.z};
+      // Empty pixels keep the clear value of 0.
+      thin->normal[pixel] = normal.w == 0.f ? EncodeOctahedralNormal(xyz) : 0;
+    }
+  });
+}
+
+void DecodeThinGbuffer(const ThinGbuffer& thin, const ViewReconstruction& reconstruction,
+                       const std::vector<uint32_t>& material_colors, ThreadPool* pool,
+                       Gbuffer* gbuffer) {
+  gbuffer->Resize(thin.width, thin.height);
+  gbuffer->depth = thin.depth;
+
+  pool->ParallelFor(thin.height, [&](int y, int) {
+    const float ndc_y = 1.f - (y + 0.5f) * 2.f / thin.height;
+    for (int x = 0; x < thin.width; ++x) {
+      const size_t pixel = static_cast<size_t>(y) * thin.width + x;
+      if (thin.depth[pixel] == 1.f) {
+        gbuffer->ambient[pixel] = 0xff000000;
+        gbuffer->position[pixel] = {0.f, 0.f, 0.f, 1.f};
+        gbuffer->diffuse[pixel] = 0xff000000;
+        gbuffer->normal[pixel] = {0.f, 0.f, 0.f, 1.f};
+        gbuffer->material[pixel] = 0;
+        continue;
+      }
+
+      const float ndc_x = (x + 0.5f) * 2.f / thin.width - 1.f;
+      float view_pos[3];
+      ReconstructViewPosition(reconstruction, ndc_x, ndc_y, thin.depth[pixel], view_pos);
+      float normal[3];
+      DecodeOctahedralNormal(thin.normal[pixel], normal);
+
+      const uint16_t material = thin.material[pixel];
+      gbuffer->ambient[pixel] = material_colors[material * 2];
+      gbuffer->position[pixel] = {view_pos[0], view_pos[1], view_pos[2], 1.f};
+      gbuffer->diffuse[pixel] = material_colors[material * 2 + 1];
+      gbuffer->normal[pixel] = {normal[0], normal[1], normal[2], 0.f};
+      gbuffer->material[pixel] = material;
+    }
+  });
+}
\ No newline at end of file
@@ -0,0 +1,43 @@
+#ifndef THIN_GBUFFER_H_
+#define THIN_GBUFFER_H_
+
+#include <cstdint>
+#include <vector>
+
+#include "gbuffer_encoding.h"
+#include "rasterizer.h"
+#include "thread_pool.h"
+
+// What the DeferredShading app's geometry pass writes: octahedral normals as R16G16_SNORM texels,
+// 16-bit material indices and the depth buffer the lighting pass reconstructs positions from.
+struct ThinGbuffer {
+  int width = 0;
+  int height = 0;
+  std::vector<uint32_t> normal;
+  std::vector<uint16_t> material;
+  std::vector<float> depth;
+};
+
+// Packs |gbuffer| like geometry_pass_ps.hlsl, one row per task.
+void EncodeThinGbuffer(const Gbuffer& gbuffer, ThreadPool* pool, ThinGbuffer* thin);
+
+// Expands |thin| into |gbuffer| the way lighting_pass_ps.hlsl reads it: positions from depth and
+// |reconstruction|, unit normals, and colors from |material_colors| as PackMaterialColors() packs
+// them. Pixels at the far plane get the clear values, like the wide targets.
+void DecodeThinGbuffer(const ThinGbuffer& thin, const ViewReconstruction& reconstruction,
+                       const std::vector<uint32_t>& material_colors, ThreadPool* pool,
+                       Gbuffer* gbuffer);
+
+// One render target of a G-buffer layout.
+struct GbufferTarget {
+  const char* name;
+  const char* format;
+  int bytes_per_pixel;
+};
+
+// The app's targets before and after the thin layout, not counting the depth buffer, which both
+// have.
+extern const GbufferTarget kWideGbufferTargets[4];
+extern const GbufferTarget kThinGbufferTargets[2];
+
+#endif  // THIN_GBUFFER_H_
\ No newline at end of file
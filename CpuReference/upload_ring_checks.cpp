@@ -0,0 +1,294 @@
+#include "upload_ring_checks.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <random>
+#include <stdexcept>
+#include <vector>
+
+#include "deferred_scene.h"
+#include "upload_ring.h"
+
+namespace {
+
+// Allocations follow each other, each aligned.
+bool CheckAllocatesInOrder() {
+  UploadRing ring(4096);
+  const uint64_t a = ring.Allocate(100, 1);
+  const uint64_t b = ring.Allocate(100, 256);
+  const uint64_t c = ring.Allocate(8, 8);
+  return a == 0 && b == 256 && c == 360 && ring.bytes_in_use() == 368 &&
+         ring.open_bytes() == 368 && ring.stats().bytes_skipped == 160;
+}
+
+// A full ring refuses allocations until the submission holding its memory has completed, and
+// only that submission's memory comes back.
+bool CheckRetiresByFence() {
+  UploadRing ring(1024);
+  ring.Allocate(512, 1);
+  ring.Submit(1);
+  ring.Allocate(256, 1);
+  ring.Submit(2);
+  ring.Allocate(256, 1);
+
+  const bool full = ring.Allocate(256, 1) == UploadRing::kFull;
+  ring.Retire(0);
+  const bool still_full = ring.Allocate(256, 1) == UploadRing::kFull;
+  ring.Retire(1);
+  return full && still_full && ring.bytes_in_use() == 512 && ring.oldest_fence_value() == 2 &&
+         ring.Allocate(512, 1) == 0 && ring.stats().failed_allocations == 2;
+}
+
+// An allocation that does not fit before the end of the ring starts over at offset 0 instead of
+// wrapping around, once the memory there is free.
+bool CheckWraps() {
+  UploadRing ring(1000);
+  ring.Allocate(600, 1);
+  ring.Submit(1);
+  ring.Allocate(300, 1);
+  ring.Submit(2);
+
+  const bool blocked = ring.Allocate(200, 1) == UploadRing::kFull;
+  ring.Retire(1);
+  const uint64_t offset = ring.Allocate(200, 1);
+  return blocked && offset == 0 && ring.stats().bytes_skipped == 100 &&
+         ring.bytes_in_use() == 600;
+}
+
+// Once everything is retired, the next allocation starts at offset 0 even mid-ring.
+bool CheckRewindsWhenEmpty() {
+  UploadRing ring(1000);
+  ring.Allocate(700, 1);
+  ring.Submit(1);
+  ring.Retire(1);
+  return ring.bytes_in_use() == 0 && ring.Allocate(900, 1) == 0 &&
+         ring.stats().bytes_skipped == 0;
+}
+
+// Submitting without allocating leaves nothing to retire, and the stats count bytes per
+// submission.
+bool CheckSubmissionStats() {
+  UploadRing ring(4096);
+  ring.Allocate(1000, 1);
+  ring.Allocate(24, 1);
+  ring.Submit(1);
+  ring.Submit(2);
+  ring.Allocate(10, 1);
+  ring.Submit(3);
+  return ring.stats().submissions == 3 && ring.stats().last_submission_bytes == 10 &&
+         ring.stats().peak_submission_bytes == 1024 && ring.oldest_fence_value() == 1;
+}
+
+bool CheckRejectsOversized() {
+  UploadRing ring(1024);
+  try {
+    ring.Allocate(1025, 1);
+  } catch (const std::runtime_error&) {
+    return true;
+  }
+  return false;
+}
+
+// Random allocations, submissions and retirements against a list of the ranges still in use: no
+// allocation may overlap one of them or run past the end, and the ring may only be full while
+// something is in use.
+bool CheckRandom() {
+  struct Range {
+    uint64_t offset;
+    uint64_t size;
+    uint64_t fence_value;
+  };
+
+  const uint64_t kCapacity = 64 * 1024;
+  std::mt19937 rng(1);
+  std::uniform_int_distribution<int> size_dist(1, 8 * 1024);
+  std::uniform_int_distribution<int> alignment_dist(0, 8);
+  std::uniform_int_distribution<int> action_dist(0, 9);
+
+  UploadRing ring(kCapacity);
+  std::vector<Range> live;
+  uint64_t next_fence_value = 1;
+  uint64_t completed_fence_value = 0;
+  int allocations = 0;
+
+  for (int i = 0; i < 200000; ++i) {
+    const int action = action_dist(rng);
+    if (action == 0) {
+      ring.Submit(next_fence_value++);
+    } else if (action <= 3) {
+      if (completed_fence_value + 1 < next_fence_value)
+        ++completed_fence_value;
+      ring.Retire(completed_fence_value);
+      std::vector<Range> still_live;
+      for (const Range& range : live) {
+        if (range.fence_value > completed_fence_value)
+          still_live.push_back(range);
+      }
+      live.swap(still_live);
+    } else {
+      const uint64_t size = size_dist(rng);
+      const uint64_t alignment = uint64_t(1) << alignment_dist(rng);
+      const uint64_t offset = ring.Allocate(size, alignment);
+      if (offset == UploadRing::kFull) {
+        if (live.empty())
+          return false;
+        continue;
+      }
+      if (offset % alignment != 0 || offset + size > kCapacity)
+        return false;
+      for (const Range& range : live) {
+        if (offset < range.offset + range.size && range.offset < offset + size)
+          return false;
+      }
+      // Open allocations belong to the next submission.
+      live.push_back({offset, size, next_fence_value});
+      ++allocations;
+    }
+  }
+  std::printf("         %d random allocations, %.1f%% of the bytes skipped, %llu full\n",
+              allocations,
+              100.0 * ring.stats().bytes_skipped /
+                  (ring.stats().bytes_allocated + ring.stats().bytes_skipped),
+              static_cast<unsigned long long>(ring.stats().failed_allocations));
+  return true;
+}
+
+double Mib(uint64_t bytes) { return static_cast<double>(bytes) / (1024.0 * 1024.0); }
+
+// Frames the upload-ring command simulates when --frames is not given.
+constexpr int kDefaultUploadFrames = 1000;
+
+// The largest copy DeferredShading's App::UploadDataToBuffer() puts in its ring at once, as a
+// fraction of the ring.
+constexpr int kUploadChunksPerRing = 4;
+
+struct UploadSimulation {
+  uint64_t uploads = 0;
+  uint64_t copies = 0;
+  uint64_t bytes = 0;
+  double peak_mib_per_frame = 0.0;
+  double peak_mib_in_use = 0.0;
+  // Waits for an earlier frame to finish, and submissions of a frame's uploads before the frame
+  // was done, when the ring was full of them.
+  int stalls = 0;
+  int flushes = 0;
+};
+
+// Streams a frame loop's uploads through an UploadRing of |capacity| bytes with the GPU
+// kAppFramesInFlight frames behind, allocating and retiring like DeferredShading's App does. The
+// first frame loads |initial_bytes| of scene data; every frame then writes a constant block per
+// pass, and one in eight streams in a buffer of up to 2 MiB. The app itself now keeps its
+// constants in FrameConstants and only uploads at startup, so this is the ring under a heavier
+// streaming load than the app gives it.
+UploadSimulation SimulateUploads(uint64_t capacity, uint64_t initial_bytes, int frames) {
+  std::mt19937 rng(1);
+  std::uniform_int_distribution<int> stream_dist(0, 7);
+  std::uniform_int_distribution<uint64_t> stream_size_dist(64 * 1024, 2 * 1024 * 1024);
+  const int kPasses = 4;
+  const uint64_t kConstantBlock = 256;
+
+  UploadRing ring(capacity);
+  UploadSimulation result;
+  std::vector<uint64_t> frame_fence_values(frames, 0);
+  uint64_t next_fence_value = 1;
+  uint64_t completed_fence_value = 0;
+
+  auto upload = [&](uint64_t size, uint64_t alignment) {
+    for (uint64_t done = 0; done < size;) {
+      const uint64_t chunk = std::min(size - done, capacity / kUploadChunksPerRing);
+      while (ring.Allocate(chunk, alignment) == UploadRing::kFull) {
+        if (ring.has_submissions()) {
+          ++result.stalls;
+          completed_fence_value = std::max(completed_fence_value, ring.oldest_fence_value());
+        } else {
+          ++result.flushes;
+          ring.Submit(next_fence_value);
+          completed_fence_value = next_fence_value++;
+        }
+        ring.Retire(completed_fence_value);
+      }
+      done += chunk;
+      ++result.copies;
+    }
+    ++result.uploads;
+    result.bytes += size;
+  };
+
+  for (int frame = 0; frame < frames; ++frame) {
+    if (frame >= kAppFramesInFlight) {
+      completed_fence_value =
+          std::max(completed_fence_value, frame_fence_values[frame - kAppFramesInFlight]);
+    }
+    ring.Retire(completed_fence_value);
+
+    if (frame == 0)
+      upload(initial_bytes, 4);
+    for (int pass = 0; pass < kPasses; ++pass)
+      upload(kConstantBlock, kConstantBlock);
+    if (stream_dist(rng) == 0)
+      upload(stream_size_dist(rng), 4);
+
+    result.peak_mib_in_use = std::max(result.peak_mib_in_use, Mib(ring.bytes_in_use()));
+    ring.Submit(next_fence_value);
+    frame_fence_values[frame] = next_fence_value++;
+    if (frame > 0) {
+      result.peak_mib_per_frame =
+          std::max(result.peak_mib_per_frame, Mib(ring.stats().last_submission_bytes));
+    }
+  }
+  return result;
+}
+
+}  // namespace
+
+bool RunUploadRingChecks() {
+  struct Check {
+    const char* name;
+    bool (*run)();
+  };
+
+  const Check checks[] = {
+    {"allocates in order with alignment", CheckAllocatesInOrder},
+    {"retires memory by fence value", CheckRetiresByFence},
+    {"starts over at 0 instead of wrapping", CheckWraps},
+    {"rewinds an empty ring", CheckRewindsWhenEmpty},
+    {"counts bytes per submission", CheckSubmissionStats},
+    {"rejects allocations larger than the ring", CheckRejectsOversized},
+    {"never overlaps memory in use", CheckRandom},
+  };
+
+  bool all_passed = true;
+  for (const Check& check : checks) {
+    const bool passed = check.run();
+    std::printf("  %-6s %s\n", passed ? "ok" : "FAILED", check.name);
+    all_passed = all_passed && passed;
+  }
+  return all_passed;
+}
+
+int RunUploadRingCommand(int requested_frames) {
+  std::printf("upload ring checks:\n");
+  const bool passed = RunUploadRingChecks();
+
+  const int frames = requested_frames > 1 ? requested_frames : kDefaultUploadFrames;
+  const uint64_t kInitialBytes = 6 * 1024 * 1024;
+  std::printf("%d frames, %.1f MiB loaded in the first, %d frames in flight:\n", frames,
+              Mib(kInitialBytes), kAppFramesInFlight);
+  std::printf("  %-9s %8s %13s %14s %13s %7s %8s\n", "ring MiB", "copies", "MiB/frame",
+              "peak MiB/frame", "peak MiB used", "stalls", "flushes");
+
+  const int ring_mib[] = {1, 2, 4, 8, 16};
+  UploadSimulation simulation;
+  for (int mib : ring_mib) {
+    simulation = SimulateUploads(static_cast<uint64_t>(mib) * 1024 * 1024, kInitialBytes, frames);
+    std::printf("  %-9d %8llu %13.3f %14.2f %13.2f %7d %8d\n", mib,
+                static_cast<unsigned long long>(simulation.copies),
+                Mib(simulation.bytes - kInitialBytes) / (frames - 1),
+                simulation.peak_mib_per_frame, simulation.peak_mib_in_use, simulation.stalls,
+                simulation.flushes);
+  }
+  std::printf("  committed per call: %llu upload buffers, %.1f MiB never freed\n",
+              static_cast<unsigned long long>(simulation.uploads), Mib(simulation.bytes));
+  return passed ? 0 : 1;
+}
\ No newline at end of file
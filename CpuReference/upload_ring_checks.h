@@ -0,0 +1,14 @@
+#ifndef UPLOAD_RING_CHECKS_H_
+#define UPLOAD_RING_CHECKS_H_
+
+// Runs UploadRing through small sequences with known results and through random ones checked
+// against a list of the ranges in use. Prints one line per check and returns whether all passed.
+bool RunUploadRingChecks();
+
+// The upload-ring command: runs the checks, then simulates DeferredShading's uploads through rings
+// of several sizes and prints how much each frame uploads and how often the CPU has to wait for
+// the GPU, next to the committed upload buffers the app used to create for every call.
+// |requested_frames| is --frames; 1 simulates a default number. Returns the exit code.
+int RunUploadRingCommand(int requested_frames);
+
+#endif  // UPLOAD_RING_CHECKS_H_
\ No newline at end of file
@@ -0,0 +1,149 @@
+#ifndef VEC_MATH_H_
+#define VEC_MATH_H_
+
+#include <algorithm>
+#include <cmath>
+
+// Minimal vector and matrix math for the CPU renderers. DirectXMath is not available off Windows,
+// so these mirror the handful of HLSL intrinsics and DirectXMath functions the apps use.
+struct Vec3 {
+  float x;
+  float y;
+  float z;
+
+  float operator[](int axis) const { return (&x)[axis]; }
+  float& operator[](int axis) { return (&x)[axis]; }
+};
+
+inline Vec3 operator+(const Vec3& a, const Vec3& b) { return {a.x + b.x, a.y + b.y, a.z + b.z}; }
+inline Vec3 operator-(const Vec3& a, const Vec3& b) { return {a.x - b.x, a.y - b.y, a.z - b.z}; }
+inline Vec3 operator-(const Vec3& a) { return {-a.x, -a.y, -a.z}; }
+inline Vec3 operator*(const Vec3& a, const Vec3& b) { return {a.x * b.x, a.y * b.y, a.z * b.z}; }
+inline Vec3 operator*(const Vec3& a, float s) { return {a.x * s, a.y * s, a.z * s}; }
+inline Vec3 operator*(float s, const Vec3& a) { return a * s; }
+inline Vec3 operator/(const Vec3& a, float s) { return a * (1.f / s); }
+
+inline Vec3& operator+=(Vec3& a, const Vec3& b) {
+  a = a + b;
+  return a;
+}
+
+inline float Dot(const Vec3& a, const Vec3& b) { return a.x * b.x + a.y * b.y + a.z * b.z; }
+
+inline Vec3 Cross(const Vec3& a, const Vec3& b) {
+  return {a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x};
+}
+
+inline float Length(const Vec3& a) { return std::sqrt(Dot(a, a)); }
+
+inline Vec3 Normalize(const Vec3& a) { return a / Length(a); }
+
+inline Vec3 Min(const Vec3& a, const Vec3& b) {
+  return {std::min(a.x, b.x), std::min(a.y, b.y), std::min(a.z, b.z)};
+}
+
+inline Vec3 Max(const Vec3& a, const Vec3& b) {
+  return {std::max(a.x, b.x), std::max(a.y, b.y), std::max(a.z, b.z)};
+}
+
+inline float Saturate(float value) { return std::min(std::max(value, 0.f), 1.f); }
+
+inline float Lerp(float a, float b, float t) { return a + (b - a) * t; }
+
+struct Vec4 {
+  float x;
+  float y;
+  float z;
+  float w;
+
+  float operator[](int axis) const { return (&x)[axis]; }
+  float& operator[](int axis) { return (&x)[axis]; }
+
+  Vec3 xyz() const { return {x, y, z}; }
+};
+
+// 4x4 matrix in DirectXMath's layout, m[row][column], for row vectors: v' = v * M.
+struct Mat4 {
+  float m[4][4];
+};
+
+inline Mat4 operator*(const Mat4& a, const Mat4& b) {
+  Mat4 result;
+  for (int row = 0; row < 4; ++row) {
+    for (int column = 0; column < 4; ++column) {
+      result.m[row][column] = a.m[row][0] * b.m[0][column] + a.m[row][1] * b.m[1][column] +
+                              a.m[row][2] * b.m[2][column] + a.m[row][3] * b.m[3][column];
+    }
+  }
+  return result;
+}
+
+inline Mat4 Transpose(const Mat4& a) {
+  Mat4 result;
+  for (int row = 0; row < 4; ++row) {
+    for (int column = 0; column < 4; ++column)
+      result.m[row][column] = a.m[column][row];
+  }
+  return result;
+}
+
+// XMVector4Transform: v * M.
+inline Vec4 Transform(const Vec4& v, const Mat4& a) {
+  Vec4 result;
+  for (int column = 0; column < 4; ++column) {
+    result[column] = v.x * a.m[0][column] + v.y * a.m[1][column] + v.z * a.m[2][column] +
+                     v.w * a.m[3][column];
+  }
+  return result;
+}
+
+// HLSL's mul(v, M) for a matrix uploaded the way the apps upload theirs: DirectXMath's M stored
+// transposed, which HLSL reads back as M because it defaults to column-major constants.
+inline Vec4 MulConstant(const Vec4& v, const Mat4& transposed) {
+  Vec4 result;
+  for (int column = 0; column < 4; ++column) {
+    const float* row = transposed.m[column];
+    result[column] = v.x * row[0] + v.y * row[1] + v.z * row[2] + v.w * row[3];
+  }
+  return result;
+}
+
+// The DirectXMath constructors the apps use.
+inline Mat4 MatrixIdentity() {
+  return {{{1.f, 0.f, 0.f, 0.f}, {0.f, 1.f, 0.f, 0.f}, {0.f, 0.f, 1.f, 0.f}, {0.f, 0.f, 0.f, 1.f}}};
+}
+
+inline Mat4 MatrixTranslation(float x, float y, float z) {
+  return {{{1.f, 0.f, 0.f, 0.f}, {0.f, 1.f, 0.f, 0.f}, {0.f, 0.f, 1.f, 0.f}, {x, y, z, 1.f}}};
+}
+
+inline Mat4 MatrixRotationX(float angle) {
+  const float c = std::cos(angle);
+  const float s = std::sin(angle);
+  return {{{1.f, 0.f, 0.f, 0.f}, {0.f, c, s, 0.f}, {0.f, -s, c, 0.f}, {0.f, 0.f, 0.f, 1.f}}};
+}
+
+inline Mat4 MatrixRotationY(float angle) {
+  const float c = std::cos(angle);
+  const float s = std::sin(angle);
+  return {{{c, 0.f, -s, 0.f}, {0.f, 1.f, 0.f, 0.f}, {s, 0.f, c, 0.f}, {0.f, 0.f, 0.f, 1.f}}};
+}
+
+inline Mat4 MatrixRotationZ(float angle) {
+  const float c = std::cos(angle);
+  const float s = std::sin(angle);
+  return {{{c, s, 0.f, 0.f}, {-s, c, 0.f, 0.f}, {0.f, 0.f, 1.f, 0.f}, {0.f, 0.f, 0.f, 1.f}}};
+}
+
+// Left-handed perspective projection to D3D clip space, depth 0 at |near_z| and 1 at |far_z|.
+inline Mat4 MatrixPerspectiveFovLH(float fov_y, float aspect_ratio, float near_z, float far_z) {
+  const float height = std::cos(0.5f * fov_y) / std::sin(0.5f * fov_y);
+  const float width = height / aspect_ratio;
+  const float range = far_z / (far_z - near_z);
+  return {{{width, 0.f, 0.f, 0.f},
+           {0.f, height, 0.f, 0.f},
+           {0.f, 0.f, range, 1.f},
+           {0.f, 0.f, -range * near_z, 0.f}}};
+}
+
+#endif  // VEC_MATH_H_
\ No newline at end of file
@@ -0,0 +1,424 @@
+#include "wavefront_tracer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+
+#include "jitter.h"
+#include "profiling.h"
+#include "random.h"
+
+namespace {
+
+// Rays per work item within a stage. Large enough to amortize the pool's dispatch, small enough
+// that a wave still splits into many more items than there are threads.
+constexpr size_t kChunkSize = 2048;
+
+// Random numbers each path draws: two for its subpixel position, then per bounce two for its
+// direction and one for Russian roulette.
+constexpr uint32_t kCameraDimensions = 2;
+constexpr uint32_t kDimensionsPerBounce = 3;
+
+// Russian roulette never keeps a path with certainty, so even bright paths end eventually.
+constexpr float kMaxSurvivalProbability = 0.95f;
+
+constexpr float kPi = 3.14159265358979f;
+
+size_t NumChunks(size_t count) { return (count + kChunkSize - 1) / kChunkSize; }
+
+Vec3 Load(const float* const* soa, size_t index) {
+  return {soa[0][index], soa[1][index], soa[2][index]};
+}
+
+void Store(float* const* soa, size_t index, const Vec3& value) {
+  for (int axis = 0; axis < 3; ++axis)
+    soa[axis][index] = value[axis];
+}
+
+float MaxComponent(const Vec3& v) { return std::max(v.x, std::max(v.y, v.z)); }
+
+// Direction around the unit vector |normal| with density cos(theta) / pi, from two uniform
+// numbers. The tangent frame is the branchless one from "Building an Orthonormal Basis,
+// Revisited" (Duff et al. 2017).
+Vec3 SampleCosineHemisphere(const Vec3& normal, float u1, float u2) {
+  const float sign = std::copysign(1.f, normal.z);
+  const float a = -1.f / (sign + normal.z);
+  const float b = normal.x * normal.y * a;
+  const Vec3 tangent = {1.f + sign * normal.x * normal.x * a, sign * b, -sign * normal.x};
+  const Vec3 bitangent = {b, sign + normal.y * normal.y * a, -normal.y};
+
+  const float r = std::sqrt(u1);
+  const float phi = 2.f * kPi * u2;
+  return tangent * (r * std::cos(phi)) + bitangent * (r * std::sin(phi)) +
+         normal * std::sqrt(std::max(0.f, 1.f - u1));
+}
+
+// Runs |fn(chunk, first, end)| over [0, count) in chunks of kChunkSize and adds the elapsed time
+// to |stats|.
+void RunStage(ThreadPool* pool, size_t count, StageStats* stats,
+              const std::function<void(size_t, size_t, size_t)>& fn) {
+  Stopwatch stopwatch;
+  pool->ParallelFor(static_cast<int>(NumChunks(count)), [&](int chunk, int) {
+    const size_t first = chunk * kChunkSize;
+    fn(chunk, first, std::min(first + kChunkSize, count));
+  });
+  stats->seconds += stopwatch.ElapsedSeconds();
+}
+
+// Packs the slots of |candidates| flagged in |live| into |queue|, keeping their order. Reads the
+// per-chunk counts from |chunk_counts| and leaves each chunk's first slot there.
+template <typename Queue>
+void CompactQueue(ThreadPool* pool, size_t num_candidates, const Queue& candidates,
+                  const std::vector<uint8_t>& live, std::vector<size_t>* chunk_counts,
+                  Queue* queue, StageStats* stats) {
+  Stopwatch stopwatch;
+
+  // Exclusive prefix sum: chunk_counts[c] becomes the first slot of chunk c's rays.
+  size_t total = 0;
+  for (size_t chunk = 0; chunk < NumChunks(num_candidates); ++chunk) {
+    const size_t count = (*chunk_counts)[chunk];
+    (*chunk_counts)[chunk] = total;
+    total += count;
+  }
+  queue->size = total;
+
+  stats->seconds += stopwatch.ElapsedSeconds();
+
+  RunStage(pool, num_candidates, stats, [&](size_t chunk, size_t first, size_t end) {
+    size_t slot = (*chunk_counts)[chunk];
+    for (size_t i = first; i < end; ++i) {
+      if (live[i])
+        queue->CopyFrom(candidates, i, slot++);
+    }
+  });
+
+  stats->items += total;
+  stats->slots += num_candidates;
+}
+
+}  // namespace
+
+void SoaStorage::Allocate(int num_arrays, size_t capacity) {
+  const size_t kPageElements = 4096 / sizeof(uint32_t);
+  const size_t kCacheLineElements = 64 / sizeof(uint32_t);
+
+  stride_ = (capacity + kPageElements - 1) / kPageElements * kPageElements + kCacheLineElements;
+  storage_.assign(stride_ * num_arrays, 0);
+}
+
+void RayQueue::Allocate(size_t capacity, int extra_arrays) {
+  storage_.Allocate(kNumArrays + extra_arrays, capacity);
+  for (int axis = 0; axis < 3; ++axis) {
+    origin[axis] = storage_.floats(axis);
+    direction[axis] = storage_.floats(3 + axis);
+  }
+  t_min = storage_.floats(6);
+  t_max = storage_.floats(7);
+  path = storage_.uints(8);
+}
+
+void RayQueue::Set(size_t slot, const Ray& ray, uint32_t path_index) {
+  for (int axis = 0; axis < 3; ++axis) {
+    origin[axis][slot] = ray.origin[axis];
+    direction[axis][slot] = ray.direction[axis];
+  }
+  t_min[slot] = ray.t_min;
+  t_max[slot] = ray.t_max;
+  path[slot] = path_index;
+}
+
+void RayQueue::CopyFrom(const RayQueue& other, size_t from, size_t to) {
+  for (int axis = 0; axis < 3; ++axis) {
+    origin[axis][to] = other.origin[axis][from];
+    direction[axis][to] = other.direction[axis][from];
+  }
+  t_min[to] = other.t_min[from];
+  t_max[to] = other.t_max[from];
+  path[to] = other.path[from];
+}
+
+Ray RayQueue::ray(size_t slot) const {
+  Ray ray;
+  ray.origin = {origin[0][slot], origin[1][slot], origin[2][slot]};
+  ray.direction = {direction[0][slot], direction[1][slot], direction[2][slot]};
+  ray.t_min = t_min[slot];
+  ray.t_max = t_max[slot];
+  return ray;
+}
+
+void ShadowQueue::Resize(size_t capacity) {
+  Allocate(capacity, 3);
+  for (int channel = 0; channel < 3; ++channel)
+    contribution[channel] = storage_.floats(kNumArrays + channel);
+}
+
+void ShadowQueue::CopyFrom(const ShadowQueue& other, size_t from, size_t to) {
+  RayQueue::CopyFrom(other, from, to);
+  for (int channel = 0; channel < 3; ++channel)
+    contribution[channel][to] = other.contribution[channel][from];
+}
+
+void HitQueue::Resize(size_t capacity) {
+  storage_.Allocate(4, capacity);
+  t = storage_.floats(0);
+  u = storage_.floats(1);
+  v = storage_.floats(2);
+  triangle = storage_.uints(3);
+}
+
+WavefrontTracer::WavefrontTracer(const Scene& scene, const RayIntersector& intersector,
+                                 ThreadPool* pool, int wave_size)
+    : scene_(scene),
+      intersector_(intersector),
+      pool_(pool),
+      wave_size_(static_cast<size_t>(std::max(wave_size, 1))) {
+  path_storage_.Allocate(6, wave_size_);
+  for (int channel = 0; channel < 3; ++channel) {
+    radiance_[channel] = path_storage_.floats(channel);
+    throughput_[channel] = path_storage_.floats(3 + channel);
+  }
+
+  extend_queue_.Resize(wave_size_);
+  hits_.Resize(wave_size_);
+  shadow_candidates_.Resize(wave_size_);
+  bounce_candidates_.Resize(wave_size_);
+  has_shadow_ray_.resize(wave_size_);
+  has_bounce_ray_.resize(wave_size_);
+  shadow_queue_.Resize(wave_size_);
+  shadow_counts_.resize(NumChunks(wave_size_));
+  bounce_counts_.resize(NumChunks(wave_size_));
+}
+
+void WavefrontTracer::SetPathTracing(const PathTracingOptions* options) {
+  path_tracing_ = options != nullptr;
+  if (options != nullptr)
+    path_options_ = *options;
+
+  ResetAccumulation();
+}
+
+void WavefrontTracer::SetSampler(const Sampler* sampler) {
+  sampler_ = sampler;
+  ResetAccumulation();
+}
+
+void WavefrontTracer::ResetAccumulation() {
+  accumulation_.clear();
+  num_samples_ = 0;
+}
+
+WavefrontStats WavefrontTracer::Render(Image* image) {
+  const size_t num_pixels = image->pixels.size();
+
+  // A new image size starts a new average.
+  if (accumulation_.size() != num_pixels) {
+    accumulation_.assign(num_pixels, {0.f, 0.f, 0.f});
+    num_samples_ = 0;
+  }
+
+  width_ = image->width;
+  GetSubpixelJitter(num_samples_, &jitter_x_, &jitter_y_);
+
+  WavefrontStats stats;
+  Stopwatch stopwatch;
+
+  for (size_t first_pixel = 0; first_pixel < num_pixels; first_pixel += wave_size_) {
+    const size_t num_paths = std::min(wave_size_, num_pixels - first_pixel);
+
+    Generate(*image, first_pixel, &stats.generate);
+
+    for (int depth = 0; extend_queue_.size > 0; ++depth) {
+      if (stats.rays_per_depth.size() <= static_cast<size_t>(depth))
+        stats.rays_per_depth.push_back(0);
+      stats.rays_per_depth[depth] += extend_queue_.size;
+
+      Extend(&stats.extend);
+      Shade(first_pixel, depth, &stats.shade);
+      Compact(&stats.compact);
+      Connect(&stats.connect);
+    }
+
+    Resolve(image, first_pixel, num_paths, &stats.resolve);
+    ++stats.waves;
+  }
+
+  ++num_samples_;
+
+  stats.trace.seconds = stopwatch.ElapsedSeconds();
+  stats.trace.primary_rays = num_pixels;
+  stats.trace.shadow_rays = stats.connect.items;
+  stats.trace.bounce_rays = stats.extend.items - num_pixels;
+  return stats;
+}
+
+void WavefrontTracer::Generate(const Image& image, size_t first_pixel, StageStats* stats) {
+  extend_queue_.size = std::min(wave_size_, image.pixels.size() - first_pixel);
+
+  RunStage(pool_, extend_queue_.size, stats, [&](size_t, size_t first, size_t end) {
+    for (size_t i = first; i < end; ++i) {
+      const size_t pixel = first_pixel + i;
+      const int x = static_cast<int>(pixel % image.width);
+      const int y = static_cast<int>(pixel / image.width);
+      const float jitter_x = sampler_ ? Random(pixel, 0) : jitter_x_;
+      const float jitter_y = sampler_ ? Random(pixel, 1) : jitter_y_;
+      extend_queue_.Set(i, MakePrimaryRay(x, y, image.width, image.height, jitter_x, jitter_y),
+                        static_cast<uint32_t>(i));
+
+      Store(radiance_, i, {0.f, 0.f, 0.f});
+      Store(throughput_, i, {1.f, 1.f, 1.f});
+    }
+  });
+  stats->items += extend_queue_.size;
+  stats->slots += wave_size_;
+}
+
+void WavefrontTracer::Extend(StageStats* stats) {
+  RunStage(pool_, extend_queue_.size, stats, [&](size_t, size_t first, size_t end) {
+    for (size_t i = first; i < end; ++i) {
+      Hit hit;
+      if (!intersector_.Intersect(extend_queue_.ray(i), &hit))
+        hit = {0.f, 0.f, 0.f, kInvalidTriangle};
+
+      hits_.t[i] = hit.t;
+      hits_.u[i] = hit.u;
+      hits_.v[i] = hit.v;
+      hits_.triangle[i] = hit.triangle;
+    }
+  });
+  stats->items += extend_queue_.size;
+  stats->slots += wave_size_;
+}
+
+void WavefrontTracer::Shade(size_t first_pixel, int depth, StageStats* stats) {
+  const bool can_bounce = path_tracing_ && depth < path_options_.max_bounces;
+
+  RunStage(pool_, extend_queue_.size, stats, [&](size_t chunk, size_t first, size_t end) {
+    size_t num_shadow_rays = 0;
+    size_t num_bounce_rays = 0;
+
+    for (size_t i = first; i < end; ++i) {
+      has_shadow_ray_[i] = 0;
+      has_bounce_ray_[i] = 0;
+
+      // MissShader: the background is black, so the path just ends.
+      const Hit hit = hits_.hit(i);
+      if (hit.triangle == kInvalidTriangle)
+        continue;
+
+      const uint32_t path = extend_queue_.path[i];
+      const Ray ray = extend_queue_.ray(i);
+      const Vec3 position = ray.origin + ray.direction * hit.t;
+
+      // ClosestHitShader, with the shadow ray deferred to shadow-connect.
+      const Ray shadow_ray = MakeShadowRay(position);
+      const SurfaceShading shading = ShadeSurface(scene_, hit, shadow_ray.direction);
+      const Material& material = scene_.triangle_material(hit.triangle);
+
+      Vec3 radiance = Load(radiance_, path);
+      Vec3 light = shading.diffuse;
+
+      if (!path_tracing_) {
+        radiance += shading.ambient;
+      } else {
+        // Indirect light replaces the ambient term, so only emission is added here.
+        const Vec3 throughput = Load(throughput_, path);
+        radiance += throughput * material.emissive_color;
+        light = throughput * shading.diffuse;
+      }
+      Store(radiance_, path, radiance);
+
+      // Surfaces facing away from the light get nothing from it, occluded or not.
+      if (MaxComponent(light) > 0.f) {
+        shadow_candidates_.Set(i, shadow_ray, path);
+        for (int channel = 0; channel < 3; ++channel)
+          shadow_candidates_.contribution[channel][i] = light[channel];
+        has_shadow_ray_[i] = 1;
+        ++num_shadow_rays;
+      }
+
+      if (!can_bounce)
+        continue;
+
+      // With cosine-weighted directions, the Lambertian BRDF times the cosine over the density
+      // is just the albedo.
+      const size_t pixel = first_pixel + path;
+      const uint32_t dimension = kCameraDimensions + depth * kDimensionsPerBounce;
+      Vec3 throughput = Load(throughput_, path) * material.diffuse_color;
+
+      if (depth >= path_options_.roulette_start) {
+        const float survival = std::min(MaxComponent(throughput), kMaxSurvivalProbability);
+        if (Random(pixel, dimension + 2) >= survival)
+          continue;
+        throughput = throughput / survival;
+      }
+
+      if (MaxComponent(throughput) <= 0.f)
+        continue;
+
+      Ray bounce_ray;
+      bounce_ray.origin = position;
+      bounce_ray.direction =
+          SampleCosineHemisphere(shading.normal, Random(pixel, dimension),
+                                 Random(pixel, dimension + 1));
+      bounce_ray.t_min = 0.f;
+      bounce_ray.t_max = kRayTMax;
+
+      Store(throughput_, path, throughput);
+      bounce_candidates_.Set(i, bounce_ray, path);
+      has_bounce_ray_[i] = 1;
+      ++num_bounce_rays;
+    }
+
+    shadow_counts_[chunk] = num_shadow_rays;
+    bounce_counts_[chunk] = num_bounce_rays;
+  });
+  stats->items += extend_queue_.size;
+  stats->slots += wave_size_;
+}
+
+void WavefrontTracer::Compact(StageStats* stats) {
+  // The extend queue has been shaded, so it can take the bounce rays for the next depth.
+  const size_t num_candidates = extend_queue_.size;
+
+  CompactQueue(pool_, num_candidates, shadow_candidates_, has_shadow_ray_, &shadow_counts_,
+               &shadow_queue_, stats);
+  CompactQueue(pool_, num_candidates, bounce_candidates_, has_bounce_ray_, &bounce_counts_,
+               &extend_queue_, stats);
+}
+
+void WavefrontTracer::Connect(StageStats* stats) {
+  RunStage(pool_, shadow_queue_.size, stats, [&](size_t, size_t first, size_t end) {
+    for (size_t i = first; i < end; ++i) {
+      if (intersector_.Occluded(shadow_queue_.ray(i)))
+        continue;
+
+      const uint32_t path = shadow_queue_.path[i];
+      Store(radiance_, path, Load(radiance_, path) + Load(shadow_queue_.contribution, i));
+    }
+  });
+  stats->items += shadow_queue_.size;
+  stats->slots += wave_size_;
+}
+
+void WavefrontTracer::Resolve(Image* image, size_t first_pixel, size_t num_paths,
+                              StageStats* stats) {
+  const float num_samples = static_cast<float>(num_samples_ + 1);
+
+  RunStage(pool_, num_paths, stats, [&](size_t, size_t first, size_t end) {
+    for (size_t i = first; i < end; ++i) {
+      Vec3& sum = accumulation_[first_pixel + i];
+      sum += Load(radiance_, i);
+      image->pixels[first_pixel + i] = sum / num_samples;
+    }
+  });
+  stats->items += num_paths;
+  stats->slots += wave_size_;
+}
+
+float WavefrontTracer::Random(size_t pixel, uint32_t dimension) const {
+  if (sampler_ == nullptr)
+    return RandomFloat(static_cast<uint32_t>(pixel), num_samples_, dimension);
+
+  return sampler_->Get(static_cast<uint32_t>(pixel % width_), static_cast<uint32_t>(pixel / width_),
+                       num_samples_, dimension);
+}
\ No newline at end of file
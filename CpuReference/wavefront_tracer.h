@@ -0,0 +1,212 @@
+#ifndef WAVEFRONT_TRACER_H_
+#define WAVEFRONT_TRACER_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "image.h"
+#include "ray.h"
+#include "reference_tracer.h"
+#include "sampler.h"
+#include "scene.h"
+#include "thread_pool.h"
+
+// Default number of paths in flight, which bounds the queues to a few tens of MiB.
+constexpr int kDefaultWaveSize = 1 << 18;
+
+// Arrays of 4-byte elements sharing one allocation. Separate allocations of the same large size
+// all start at the same offset within a page, so a loop walking a dozen of them in step maps every
+// stream to the same L1 sets and keeps evicting its own lines. Here each array starts one cache
+// line further into the page than the one before.
+class SoaStorage {
+public:
+  SoaStorage() = default;
+  SoaStorage(const SoaStorage&) = delete;
+  SoaStorage& operator=(const SoaStorage&) = delete;
+
+  void Allocate(int num_arrays, size_t capacity);
+
+  float* floats(int array) { return reinterpret_cast<float*>(&storage_[array * stride_]); }
+  uint32_t* uints(int array) { return &storage_[array * stride_]; }
+
+private:
+  std::vector<uint32_t> storage_;
+  size_t stride_ = 0;
+};
+
+// Rays as structure of arrays. Slot i belongs to path[i], an index into the current wave.
+struct RayQueue {
+  float* origin[3] = {};
+  float* direction[3] = {};
+  float* t_min = nullptr;
+  float* t_max = nullptr;
+  uint32_t* path = nullptr;
+  size_t size = 0;
+
+  void Resize(size_t capacity) { Allocate(capacity, 0); }
+  void Set(size_t slot, const Ray& ray, uint32_t path_index);
+  // Copies slot |from| of |other| into slot |to|.
+  void CopyFrom(const RayQueue& other, size_t from, size_t to);
+  Ray ray(size_t slot) const;
+
+protected:
+  static constexpr int kNumArrays = 9;
+
+  // Allocates the ray arrays followed by |extra_arrays| more for derived queues.
+  void Allocate(size_t capacity, int extra_arrays);
+
+  SoaStorage storage_;
+};
+
+// Shadow rays with the radiance each one adds to its path when it reaches the light.
+struct ShadowQueue : RayQueue {
+  float* contribution[3] = {};
+
+  void Resize(size_t capacity);
+  void CopyFrom(const ShadowQueue& other, size_t from, size_t to);
+};
+
+// Closest hits of a RayQueue, slot for slot. Misses have triangle kInvalidTriangle.
+struct HitQueue {
+  float* t = nullptr;
+  float* u = nullptr;
+  float* v = nullptr;
+  uint32_t* triangle = nullptr;
+
+  void Resize(size_t capacity);
+  Hit hit(size_t slot) const { return {t[slot], u[slot], v[slot], triangle[slot]}; }
+
+private:
+  SoaStorage storage_;
+};
+
+// Time spent in one stage over a frame, and how full its queue was. Occupancy is items / slots,
+// where slots is the wave capacity summed over every launch of the stage, so it drops as paths
+// terminate.
+struct StageStats {
+  double seconds = 0.0;
+  uint64_t items = 0;
+  uint64_t slots = 0;
+
+  double Occupancy() const { return slots > 0 ? static_cast<double>(items) / slots : 0.0; }
+};
+
+struct WavefrontStats {
+  TraceStats trace;
+  int waves = 0;
+
+  StageStats generate;
+  StageStats extend;
+  StageStats shade;
+  // Items are the shadow and bounce rays kept, out of two candidate slots per shaded ray.
+  StageStats compact;
+  StageStats connect;
+  StageStats resolve;
+
+  // Rays traced by the extend stage at each path depth, camera rays first.
+  std::vector<uint64_t> rays_per_depth;
+};
+
+// Settings of WavefrontTracer's path-tracing mode.
+struct PathTracingOptions {
+  // Diffuse bounces after the camera ray. Paths that survive Russian roulette this long end here.
+  int max_bounces = 8;
+  // Bounces that are always taken before Russian roulette may end a path.
+  int roulette_start = 3;
+};
+
+// Stream version of ReferenceTracer. Instead of running every shader for one ray before starting
+// the next, each stage runs over a whole wave of paths before the next stage starts:
+//
+//   generate        camera rays for every pixel in the wave, into the extend queue
+//   extend          closest hit for every ray in the extend queue
+//   shade           ClosestHitShader or MissShader for every hit, writing a candidate shadow ray
+//                   and bounce ray into the slot of the ray that spawned them
+//   compact         packs the live candidates into a dense shadow queue and the next extend queue
+//   shadow-connect  traces the whole shadow queue and adds the light of the unoccluded rays
+//   resolve         writes the wave's radiance to the image
+//
+// Extend through shadow-connect repeat until no path is left, so the rays in the extend queue
+// always share one depth. Each stage keeps its code and data hot in cache and traces rays in large
+// batches.
+//
+// By default paths end at their first hit and the image is the same as ReferenceTracer's. With
+// SetPathTracing(), the constant ambient term is replaced by diffuse interreflection: paths
+// bounce in cosine-weighted directions, every vertex connects to the point light (next-event
+// estimation), and Russian roulette ends paths that carry little light. Either way, each Render()
+// adds one jittered sample per pixel to a running average, so the image converges for as long as
+// it is called. The jitter is the frame's, shared by every pixel, and the bounces draw
+// independent random numbers, unless SetSampler() supplies all of them.
+class WavefrontTracer {
+public:
+  // |wave_size| paths are in flight at once; the queues are sized for that many rays.
+  WavefrontTracer(const Scene& scene, const RayIntersector& intersector, ThreadPool* pool,
+                  int wave_size = kDefaultWaveSize);
+
+  // Switches to path tracing with |options|, or back to direct lighting when |options| is null.
+  // Either way, the accumulated samples are discarded.
+  void SetPathTracing(const PathTracingOptions* options);
+
+  // Takes the subpixel positions and bounce directions from |sampler|, or goes back to the frame
+  // jitter and independent numbers when it is null. Discards the accumulated samples. |sampler|
+  // must outlive its use.
+  void SetSampler(const Sampler* sampler);
+
+  // Starts a new average. A new image size also starts one.
+  void ResetAccumulation();
+
+  // Samples per pixel averaged into the last rendered image.
+  uint32_t num_samples() const { return num_samples_; }
+
+  WavefrontStats Render(Image* image);
+
+private:
+  void Generate(const Image& image, size_t first_pixel, StageStats* stats);
+  void Extend(StageStats* stats);
+  void Shade(size_t first_pixel, int depth, StageStats* stats);
+  void Compact(StageStats* stats);
+  void Connect(StageStats* stats);
+  void Resolve(Image* image, size_t first_pixel, size_t num_paths, StageStats* stats);
+
+  // |dimension| of the current sample of image pixel |pixel|.
+  float Random(size_t pixel, uint32_t dimension) const;
+
+  const Scene& scene_;
+  const RayIntersector& intersector_;
+  ThreadPool* pool_;
+  size_t wave_size_;
+
+  bool path_tracing_ = false;
+  PathTracingOptions path_options_;
+  const Sampler* sampler_ = nullptr;
+
+  // Per-path state, indexed by the path numbers in the queues.
+  float* radiance_[3];
+  float* throughput_[3];
+  SoaStorage path_storage_;
+
+  RayQueue extend_queue_;
+  HitQueue hits_;
+
+  // Written by shade at the slot of the ray that spawned them, with has_shadow_ray_ and
+  // has_bounce_ray_ marking the used slots, then packed into shadow_queue_ and extend_queue_.
+  ShadowQueue shadow_candidates_;
+  RayQueue bounce_candidates_;
+  std::vector<uint8_t> has_shadow_ray_;
+  std::vector<uint8_t> has_bounce_ray_;
+  ShadowQueue shadow_queue_;
+
+  // Live candidates per chunk of the extend queue, turned into offsets in the packed queues.
+  std::vector<size_t> shadow_counts_;
+  std::vector<size_t> bounce_counts_;
+
+  // The current sample's jitter and image width, and the running sum of the samples so far.
+  int width_ = 0;
+  float jitter_x_ = 0.f;
+  float jitter_y_ = 0.f;
+  std::vector<Vec3> accumulation_;
+  uint32_t num_samples_ = 0;
+};
+
+#endif  // WAVEFRONT_TRACER_H_
\ No newline at end of file
@@ -4,21 +4,54 @@
 #include <dxgi1_6.h>
 #include <wrl/client.h>
 
+#include <algorithm>
+#include <cfloat>
+#include <cstdio>
 #include <cstring>
+#include <memory>
+#include <stdexcept>
+#include <string>
 #include <vector>
 
 #include "d3dx12.h"
 #include "DirectXMath.h"
 
-#include "Model.h"
-#include "ResourceUploadBatch.h"
-
 #include "dx_utils.h"
 #include "ReadData.h"
+#include "scene_cache.h"
+#include "sdkmesh.h"
 
 using Microsoft::WRL::ComPtr;
 using DX::ThrowIfFailed;
 
+namespace {
+
+// UploadDataToBuffer() copies larger uploads in pieces of this size, so that they fit in the ring
+// next to the frames' uploads.
+constexpr UINT64 kMaxUploadChunkSize = kUploadRingSize / 4;
+
+// Bounding box of the |index_count| vertices of |vertices| that |indices|, of |index_type|,
+// index from |start_index| on, each plus |vertex_offset|.
+void IndexedBounds(const scene_cache::Vertex* vertices, const void* indices, uint32_t index_type,
+                   uint32_t start_index, uint32_t index_count, int32_t vertex_offset,
+                   DirectX::XMFLOAT3* bounds_min, DirectX::XMFLOAT3* bounds_max) {
+  DirectX::XMVECTOR box_min = DirectX::XMVectorReplicate(FLT_MAX);
+  DirectX::XMVECTOR box_max = DirectX::XMVectorReplicate(-FLT_MAX);
+  for (uint32_t i = start_index; i < start_index + index_count; ++i) {
+    const uint32_t index = index_type == sdkmesh::kIndexType16Bit
+                               ? static_cast<const uint16_t*>(indices)[i]
+                               : static_cast<const uint32_t*>(indices)[i];
+    const sdkmesh::Float3& p = vertices[static_cast<int64_t>(index) + vertex_offset].position;
+    const DirectX::XMVECTOR position = DirectX::XMVectorSet(p.x, p.y, p.z, 0.f);
+    box_min = DirectX::XMVectorMin(box_min, position);
+    box_max = DirectX::XMVectorMax(box_max, position);
+  }
+  DirectX::XMStoreFloat3(bounds_min, box_min);
+  DirectX::XMStoreFloat3(bounds_max, box_max);
+}
+
+}  // namespace
+
 App::App(HWND window_hwnd, int window_width, int window_height)
   : window_hwnd_(window_hwnd),
     window_width_(window_width),
@@ -27,7 +60,19 @@ App::App(HWND window_hwnd, int window_width, int window_height)
     scissor_rect_(0, 0, window_width, window_height),
     shadow_pass_(this),
     geometry_pass_(this),
-    lighting_pass_(this) {}
+    cluster_pass_(this),
+    lighting_pass_(this),
+    rtv_heap_(D3D12_DESCRIPTOR_HEAP_TYPE_RTV, kRtvHeapSize, 0, false),
+    dsv_heap_(D3D12_DESCRIPTOR_HEAP_TYPE_DSV, kDsvHeapSize, 0, false),
+    cbv_srv_heap_(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV, kCbvSrvUavHeapSize,
+                  kTransientDescriptorRingSize, true),
+    staging_heap_(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV, kStagingHeapSize, 0, false),
+    sampler_heap_(D3D12_DESCRIPTOR_HEAP_TYPE_SAMPLER, kSamplerHeapSize, 0, true),
+    upload_ring_(kUploadRingSize),
+    frame_constants_({sizeof(ViewConstants), sizeof(GeometryPass::Matrices),
+                      sizeof(ShadowPass::Matrices), sizeof(LightingPass::LightingConstants)},
+                     kNumFrames, D3D12_CONSTANT_BUFFER_DATA_PLACEMENT_ALIGNMENT),
+    recording_jobs_(kRecordingThreads) {}
 
 void App::Initialize() {
   InitDeviceAndSwapChain();
@@ -88,6 +133,12 @@ void App::InitCommandAllocators() {
   for (int i = 0; i < kNumFrames; ++i) {
     ThrowIfFailed(device_->CreateCommandAllocator(D3D12_COMMAND_LIST_TYPE_DIRECT,
                                                   IID_PPV_ARGS(&frames_[i].command_allocator)));
+
+    frames_[i].recording_allocators.resize(recording_jobs_.num_threads());
+    for (ComPtr<ID3D12CommandAllocator>& allocator : frames_[i].recording_allocators) {
+      ThrowIfFailed(device_->CreateCommandAllocator(D3D12_COMMAND_LIST_TYPE_DIRECT,
+                                                    IID_PPV_ARGS(&allocator)));
+    }
   }
 
   ThrowIfFailed(device_->CreateCommandList(0, D3D12_COMMAND_LIST_TYPE_DIRECT,
@@ -122,148 +173,51 @@ void App::InitPipelines() {
 
   geometry_pass_.InitPipeline();
 
+  cluster_pass_.InitPipeline();
+
   lighting_pass_.InitPipeline();
 }
 
 void App::InitDescriptorHeaps() {
-  {
-    D3D12_DESCRIPTOR_HEAP_DESC rtv_heap_desc{};
-    rtv_heap_desc.NumDescriptors =
-        GeometryPass::RtvPerFrame::kNumDescriptors * kNumFrames +
-        LightingPass::RtvPerFrame::kNumDescriptors * kNumFrames;
-    rtv_heap_desc.Type = D3D12_DESCRIPTOR_HEAP_TYPE_RTV;
-    rtv_heap_desc.Flags = D3D12_DESCRIPTOR_HEAP_FLAG_NONE;
-    ThrowIfFailed(device_->CreateDescriptorHeap(&rtv_heap_desc, IID_PPV_ARGS(&rtv_heap_)));
-
-    rtv_descriptor_size_ = device_->GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_RTV);
-
-    CD3DX12_CPU_DESCRIPTOR_HANDLE rtv_handle(rtv_heap_->GetCPUDescriptorHandleForHeapStart());
-
-    for (int i = 0; i < kNumFrames; ++i) {
-      geometry_pass_.frames_[i].base_rtv_handle_ = rtv_handle;
-
-      rtv_handle.Offset(GeometryPass::RtvPerFrame::kNumDescriptors, rtv_descriptor_size_);
-    }
-
-    for (int i = 0; i < kNumFrames; ++i) {
-      lighting_pass_.frames_[i].base_rtv_handle_ = rtv_handle;
-
-      rtv_handle.Offset(LightingPass::RtvPerFrame::kNumDescriptors, rtv_descriptor_size_);
-    }
-  }
-
-  {
-    D3D12_DESCRIPTOR_HEAP_DESC dsv_heap_desc{};
-    dsv_heap_desc.NumDescriptors =
-        ShadowPass::DsvPerFrame::kNumDescriptors * kNumFrames +
-        GeometryPass::DsvStatic::kNumDescriptors;
-    dsv_heap_desc.Type = D3D12_DESCRIPTOR_HEAP_TYPE_DSV;
-    dsv_heap_desc.Flags = D3D12_DESCRIPTOR_HEAP_FLAG_NONE;
-    ThrowIfFailed(device_->CreateDescriptorHeap(&dsv_heap_desc, IID_PPV_ARGS(&dsv_heap_)));
-
-    dsv_descriptor_size_ =
-        device_->GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_DSV);
-
-    CD3DX12_CPU_DESCRIPTOR_HANDLE dsv_cpu_handle(dsv_heap_->GetCPUDescriptorHandleForHeapStart());
-
-    for (int i = 0; i < kNumFrames; ++i) {
-      shadow_pass_.frames_[i].base_dsv_handle = dsv_cpu_handle;
-
-      dsv_cpu_handle.Offset(ShadowPass::DsvPerFrame::kNumDescriptors, dsv_descriptor_size_);
-    }
-
-    geometry_pass_.dsv_handle_ = dsv_cpu_handle;
-  }
-
-  {
-    D3D12_DESCRIPTOR_HEAP_DESC cbv_srv_heap_desc{};
-    cbv_srv_heap_desc.NumDescriptors =
-        ShadowPass::CbvStatic::kNumDescriptors +
-        GeometryPass::CbvStatic::kNumDescriptors +
-        LightingPass::CbvStatic::kNumDescriptors +
-        LightingPass::SrvPerFrame::kNumDescriptors * kNumFrames;
-    cbv_srv_heap_desc.Type = D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV;
-    cbv_srv_heap_desc.Flags = D3D12_DESCRIPTOR_HEAP_FLAG_SHADER_VISIBLE;
-    ThrowIfFailed(device_->CreateDescriptorHeap(&cbv_srv_heap_desc, IID_PPV_ARGS(&cbv_srv_heap_)));
-
-    cbv_srv_descriptor_size_ =
-         device_->GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
-
-    CD3DX12_CPU_DESCRIPTOR_HANDLE cbv_srv_cpu_handle(
-        cbv_srv_heap_->GetCPUDescriptorHandleForHeapStart());
-    CD3DX12_GPU_DESCRIPTOR_HANDLE cbv_srv_gpu_handle(
-        cbv_srv_heap_->GetGPUDescriptorHandleForHeapStart());
-
-    shadow_pass_.cbv_cpu_handle_ = cbv_srv_cpu_handle;
-    shadow_pass_.cbv_gpu_handle_ = cbv_srv_gpu_handle;
-
-    cbv_srv_cpu_handle.Offset(ShadowPass::CbvStatic::kNumDescriptors, cbv_srv_descriptor_size_);
-    cbv_srv_gpu_handle.Offset(ShadowPass::CbvStatic::kNumDescriptors, cbv_srv_descriptor_size_);
-
-    geometry_pass_.base_cbv_cpu_handle_ = cbv_srv_cpu_handle;
-    geometry_pass_.base_cbv_gpu_handle_ = cbv_srv_gpu_handle;
-
-    cbv_srv_cpu_handle.Offset(GeometryPass::CbvStatic::kNumDescriptors, cbv_srv_descriptor_size_);
-    cbv_srv_gpu_handle.Offset(GeometryPass::CbvStatic::kNumDescriptors, cbv_srv_descriptor_size_);
-
-    for (int i = 0; i < kNumFrames; ++i) {
-      lighting_pass_.frames_[i].base_srv_cpu_handle_ = cbv_srv_cpu_handle;
-      lighting_pass_.frames_[i].base_srv_gpu_handle_ = cbv_srv_gpu_handle;
-
-      cbv_srv_cpu_handle.Offset(LightingPass::SrvPerFrame::kNumDescriptors,
-                                cbv_srv_descriptor_size_);
-      cbv_srv_gpu_handle.Offset(LightingPass::SrvPerFrame::kNumDescriptors,
-                                cbv_srv_descriptor_size_);
-    }
-
-    lighting_pass_.cbv_cpu_handle_ = cbv_srv_cpu_handle;
-    lighting_pass_.cbv_gpu_handle_ = cbv_srv_gpu_handle;
-  }
-
-  {
-    D3D12_DESCRIPTOR_HEAP_DESC sampler_heap_desc{};
-    sampler_heap_desc.NumDescriptors = LightingPass::SamplerStatic::kNumDescriptors;
-    sampler_heap_desc.Type = D3D12_DESCRIPTOR_HEAP_TYPE_SAMPLER;
-    sampler_heap_desc.Flags = D3D12_DESCRIPTOR_HEAP_FLAG_SHADER_VISIBLE;
-    ThrowIfFailed(device_->CreateDescriptorHeap(&sampler_heap_desc, IID_PPV_ARGS(&sampler_heap_)));
-
-    CD3DX12_CPU_DESCRIPTOR_HANDLE sampler_cpu_handle(
-        sampler_heap_->GetCPUDescriptorHandleForHeapStart());
-    CD3DX12_GPU_DESCRIPTOR_HANDLE sampler_gpu_handle(
-        sampler_heap_->GetGPUDescriptorHandleForHeapStart());
-
-    lighting_pass_.base_sampler_cpu_handle_ = sampler_cpu_handle;
-    lighting_pass_.base_sampler_gpu_handle_ = sampler_gpu_handle;
-  }
+  rtv_heap_.Create(device_.Get());
+  dsv_heap_.Create(device_.Get());
+  cbv_srv_heap_.Create(device_.Get());
+  staging_heap_.Create(device_.Get());
+  sampler_heap_.Create(device_.Get());
 }
 
 void App::InitResources() {
   CreateSharedBuffers();
-
-  LoadModelData();
-
-  InitMatrices();
+  CreateUploadRing();
+  CreateFrameConstants();
 
   ThrowIfFailed(frames_[frame_index_].command_allocator->Reset());
   ThrowIfFailed(command_list_->Reset(frames_[frame_index_].command_allocator.Get(), nullptr));
 
-  shadow_pass_.CreateBuffersAndUploadData();
+  LoadModelData();
 
-  geometry_pass_.CreateBuffersAndUploadData();
+  cluster_pass_.CreateBuffersAndUploadData();
 
   lighting_pass_.CreateBuffersAndUploadData();
 
   ThrowIfFailed(command_list_->Close());
   ID3D12CommandList* command_lists[] = { command_list_.Get() };
   command_queue_->ExecuteCommandLists(_countof(command_lists), command_lists);
+  upload_ring_.Submit(latest_fence_value_);
 
   // TODO: Don't stall here.
   WaitForGpu();
+  upload_ring_.Retire(fence_->GetCompletedValue());
+
+  // Creates the transient textures, which the passes make views of.
+  InitRenderGraph();
 
   shadow_pass_.CreateResourceViews();
 
   geometry_pass_.CreateResourceViews();
 
+  cluster_pass_.CreateResourceViews();
+
   lighting_pass_.CreateResourceViews();
 }
 
@@ -271,286 +225,549 @@ void App::CreateSharedBuffers() {
   for (int i = 0; i < kNumFrames; ++i) {
     ThrowIfFailed(swap_chain_->GetBuffer(i, IID_PPV_ARGS(&frames_[i].swap_chain_buffer)));
   }
+}
 
-  D3D12_CLEAR_VALUE clear_color{};
-  clear_color.Format = DXGI_FORMAT_R8G8B8A8_UNORM;
-  clear_color.Color[0] = 0.f;
-  clear_color.Color[1] = 0.f;
-  clear_color.Color[2] = 0.f;
-  clear_color.Color[3] = 1.f;
+void App::CreateUploadRing() {
+  CD3DX12_HEAP_PROPERTIES heap_props(D3D12_HEAP_TYPE_UPLOAD);
+  CD3DX12_RESOURCE_DESC buffer_desc = CD3DX12_RESOURCE_DESC::Buffer(kUploadRingSize);
 
-  for (int i = 0; i < kNumFrames; ++i) {
-    CD3DX12_HEAP_PROPERTIES heap_props(D3D12_HEAP_TYPE_DEFAULT);
-    CD3DX12_RESOURCE_DESC resource_desc =
-        CD3DX12_RESOURCE_DESC::Tex2D(DXGI_FORMAT_R8G8B8A8_UNORM, window_width_, window_height_, 1,
-                                     1, 1, 0, D3D12_RESOURCE_FLAG_ALLOW_RENDER_TARGET);
+  ThrowIfFailed(device_->CreateCommittedResource(&heap_props, D3D12_HEAP_FLAG_NONE, &buffer_desc,
+                                                 D3D12_RESOURCE_STATE_GENERIC_READ, nullptr,
+                                                 IID_PPV_ARGS(&upload_ring_buffer_)));
 
-    ThrowIfFailed(device_->CreateCommittedResource(&heap_props, D3D12_HEAP_FLAG_NONE,
-                                                   &resource_desc,
-                                                   D3D12_RESOURCE_STATE_RENDER_TARGET, &clear_color,
-                                                   IID_PPV_ARGS(&frames_[i].gbuffer)));
+  // Upload heaps may stay mapped for their whole life.
+  CD3DX12_RANGE read_range(0, 0);
+  ThrowIfFailed(upload_ring_buffer_->Map(0, &read_range,
+                                         reinterpret_cast<void**>(&upload_ring_data_)));
+}
 
-    ThrowIfFailed(device_->CreateCommittedResource(&heap_props, D3D12_HEAP_FLAG_NONE,
-                                                   &resource_desc,
-                                                   D3D12_RESOURCE_STATE_RENDER_TARGET, &clear_color,
-                                                   IID_PPV_ARGS(&frames_[i].diffuse_gbuffer)));
-  }
+void App::CreateFrameConstants() {
+  CD3DX12_HEAP_PROPERTIES heap_props(D3D12_HEAP_TYPE_UPLOAD);
+  CD3DX12_RESOURCE_DESC buffer_desc = CD3DX12_RESOURCE_DESC::Buffer(frame_constants_.size());
 
-  D3D12_CLEAR_VALUE clear_pos{};
-  clear_pos.Format = DXGI_FORMAT_R32G32B32A32_FLOAT;
-  clear_pos.Color[0] = 0.f;
-  clear_pos.Color[1] = 0.f;
-  clear_pos.Color[2] = 0.f;
-  clear_pos.Color[3] = 1.f;
+  ThrowIfFailed(device_->CreateCommittedResource(&heap_props, D3D12_HEAP_FLAG_NONE, &buffer_desc,
+                                                 D3D12_RESOURCE_STATE_GENERIC_READ, nullptr,
+                                                 IID_PPV_ARGS(&frame_constants_buffer_)));
 
-  for (int i = 0; i < kNumFrames; ++i) {
-    CD3DX12_HEAP_PROPERTIES heap_props(D3D12_HEAP_TYPE_DEFAULT);
-    CD3DX12_RESOURCE_DESC resource_desc =
-        CD3DX12_RESOURCE_DESC::Tex2D(DXGI_FORMAT_R32G32B32A32_FLOAT, window_width_, window_height_,
-                                     1, 1, 1, 0, D3D12_RESOURCE_FLAG_ALLOW_RENDER_TARGET);
+  CD3DX12_RANGE read_range(0, 0);
+  ThrowIfFailed(frame_constants_buffer_->Map(0, &read_range,
+                                             reinterpret_cast<void**>(&frame_constants_data_)));
 
-    ThrowIfFailed(device_->CreateCommittedResource(&heap_props, D3D12_HEAP_FLAG_NONE,
-                                                   &resource_desc,
-                                                   D3D12_RESOURCE_STATE_RENDER_TARGET, &clear_pos,
-                                                   IID_PPV_ARGS(&frames_[i].pos_gbuffer)));
+  float aspect_ratio = static_cast<float>(window_width_) / static_cast<float>(window_height_);
+  view_reconstruction_ = MakeViewReconstruction(DirectX::XM_PI / 4.f, aspect_ratio, 0.1f, 1000.f);
+}
 
-    ThrowIfFailed(device_->CreateCommittedResource(&heap_props, D3D12_HEAP_FLAG_NONE,
-                                                   &resource_desc,
-                                                   D3D12_RESOURCE_STATE_RENDER_TARGET, &clear_pos,
-                                                   IID_PPV_ARGS(&frames_[i].normal_gbuffer)));
-  }
+D3D12_GPU_VIRTUAL_ADDRESS App::ConstantBlockAddress(int block) const {
+  return frame_constants_buffer_->GetGPUVirtualAddress() +
+         frame_constants_.offset(frame_index_, block);
+}
 
-  D3D12_CLEAR_VALUE clear_depth{};
-  clear_depth.Format = DXGI_FORMAT_D32_FLOAT;
-  clear_depth.DepthStencil.Depth = 1.0f;
-  clear_depth.DepthStencil.Stencil = 0;
+void App::LoadModelData() {
+  // Falls back to baking the .sdkmesh in memory if there is no up-to-date baked scene.
+  std::unique_ptr<scene_cache::Scene> scene =
+      scene_cache::LoadOrBake("cornell_box.scene", "cornell_box.sdkmesh");
+
+  // Float vertices of each vertex buffer, kept until the draws' bounds are known.
+  std::vector<std::vector<scene_cache::Vertex>> decoded_vertices(scene->num_vertex_buffers());
+  std::vector<const scene_cache::Vertex*> float_vertices(scene->num_vertex_buffers());
+
+  // Vertex and index data is copied into the upload buffers straight from the scene.
+  for (uint32_t i = 0; i < scene->num_vertex_buffers(); ++i) {
+    const scene_cache::VertexBufferDesc& vb = scene->vertex_buffer(i);
+
+    const void* vertex_data = scene->vertex_data(i);
+    UINT64 vertex_data_size = vb.size_bytes;
+
+    // The input layout only takes float vertices.
+    if (vb.format != scene_cache::kVertexFormatFloat) {
+      decoded_vertices[i].resize(vb.num_vertices);
+      scene_cache::DecodeVertices(vb, scene->vertex_data(i), decoded_vertices[i].data());
+
+      vertex_data = decoded_vertices[i].data();
+      vertex_data_size = decoded_vertices[i].size() * sizeof(scene_cache::Vertex);
+    }
+    float_vertices[i] = static_cast<const scene_cache::Vertex*>(vertex_data);
+
+    ComPtr<ID3D12Resource> vertex_buffer;
 
-  {
     CD3DX12_HEAP_PROPERTIES heap_props(D3D12_HEAP_TYPE_DEFAULT);
-    CD3DX12_RESOURCE_DESC resource_desc =
-        CD3DX12_RESOURCE_DESC::Tex2D(DXGI_FORMAT_D32_FLOAT, window_width_, window_height_, 1, 0, 1,
-                                     0, D3D12_RESOURCE_FLAG_ALLOW_DEPTH_STENCIL);
+    CD3DX12_RESOURCE_DESC buffer_desc = CD3DX12_RESOURCE_DESC::Buffer(vertex_data_size);
 
     ThrowIfFailed(device_->CreateCommittedResource(&heap_props, D3D12_HEAP_FLAG_NONE,
-                                                   &resource_desc, D3D12_RESOURCE_STATE_DEPTH_WRITE,
-                                                   &clear_depth, IID_PPV_ARGS(&depth_stencil_)));
+                                                   &buffer_desc, D3D12_RESOURCE_STATE_COPY_DEST,
+                                                   nullptr, IID_PPV_ARGS(&vertex_buffer)));
+
+    UploadDataToBuffer(vertex_data, vertex_data_size, vertex_buffer.Get());
+
+    model_vertex_buffers_.push_back(vertex_buffer);
   }
 
-  for (int i = 0; i < kNumFrames; ++i) {
+  for (uint32_t i = 0; i < scene->num_index_buffers(); ++i) {
+    const scene_cache::IndexBufferDesc& ib = scene->index_buffer(i);
+
+    ComPtr<ID3D12Resource> index_buffer;
+
     CD3DX12_HEAP_PROPERTIES heap_props(D3D12_HEAP_TYPE_DEFAULT);
-    CD3DX12_RESOURCE_DESC resource_desc =
-        CD3DX12_RESOURCE_DESC::Tex2D(DXGI_FORMAT_D32_FLOAT, kShadowBufferWidth, kShadowBufferHeight,
-                                     6, 0, 1, 0, D3D12_RESOURCE_FLAG_ALLOW_DEPTH_STENCIL);
+    CD3DX12_RESOURCE_DESC buffer_desc = CD3DX12_RESOURCE_DESC::Buffer(ib.size_bytes);
 
     ThrowIfFailed(device_->CreateCommittedResource(&heap_props, D3D12_HEAP_FLAG_NONE,
-                                                   &resource_desc, D3D12_RESOURCE_STATE_DEPTH_WRITE,
-                                                   &clear_depth,
-                                                   IID_PPV_ARGS(&frames_[i].shadow_cubemap)));
+                                                   &buffer_desc, D3D12_RESOURCE_STATE_COPY_DEST,
+                                                   nullptr, IID_PPV_ARGS(&index_buffer)));
+
+    UploadDataToBuffer(scene->index_data(i), ib.size_bytes, index_buffer.Get(),
+                       D3D12_RESOURCE_STATE_INDEX_BUFFER);
+
+    model_index_buffers_.push_back(index_buffer);
   }
-}
 
-void App::LoadModelData() {
-  graphics_memory_ = std::make_unique<DirectX::GraphicsMemory>(device_.Get());
-  model_ = DirectX::Model::CreateFromSDKMESH(device_.Get(), L"cornell_box.sdkmesh");
+  for (uint32_t i = 0; i < scene->num_draw_ranges(); ++i) {
+    const scene_cache::DrawRange& range = scene->draw_range(i);
 
-  DirectX::ResourceUploadBatch resource_upload(device_.Get());
-  resource_upload.Begin();
-  model_->LoadStaticBuffers(device_.Get(), resource_upload);
+    // Only opaque parts are drawn.
+    if (range.flags & scene_cache::kDrawRangeAlpha)
+      continue;
 
-  std::future<void> resource_upload_done = resource_upload.End(command_queue_.Get());
-  resource_upload_done.wait();
+    const scene_cache::IndexBufferDesc& ib = scene->index_buffer(range.index_buffer);
 
-  for (auto& mesh : model_->meshes) {
-    for (auto& mesh_part : mesh->opaqueMeshParts) {
-      DrawCallArgs args{};
+    DrawCallArgs args{};
 
-      args.primitive_type = mesh_part->primitiveType;
+    args.primitive_type = static_cast<D3D12_PRIMITIVE_TOPOLOGY>(
+        sdkmesh::ToD3DPrimitiveTopology(range.primitive_type));
 
-      args.vertex_buffer_view.BufferLocation =
-          mesh_part->staticVertexBuffer->GetGPUVirtualAddress();
-      args.vertex_buffer_view.SizeInBytes = mesh_part->vertexBufferSize;
-      args.vertex_buffer_view.StrideInBytes = mesh_part->vertexStride;
+    D3D12_RESOURCE_DESC vertex_buffer_desc =
+        model_vertex_buffers_[range.vertex_buffer]->GetDesc();
 
-      args.index_buffer_view.BufferLocation =
-          mesh_part->staticIndexBuffer->GetGPUVirtualAddress();
-      args.index_buffer_view.SizeInBytes = mesh_part->indexBufferSize;
-      args.index_buffer_view.Format = mesh_part->indexFormat;
+    args.vertex_buffer_view.BufferLocation =
+        model_vertex_buffers_[range.vertex_buffer]->GetGPUVirtualAddress();
+    args.vertex_buffer_view.SizeInBytes = static_cast<UINT>(vertex_buffer_desc.Width);
+    args.vertex_buffer_view.StrideInBytes = sizeof(scene_cache::Vertex);
 
-      args.index_count = mesh_part->indexCount;
-      args.start_index = mesh_part->startIndex;
-      args.vertex_offset = mesh_part->vertexOffset;
+    args.index_buffer_view.BufferLocation =
+        model_index_buffers_[range.index_buffer]->GetGPUVirtualAddress();
+    args.index_buffer_view.SizeInBytes = static_cast<UINT>(ib.size_bytes);
+    args.index_buffer_view.Format =
+        static_cast<DXGI_FORMAT>(sdkmesh::ToDxgiIndexFormat(ib.index_type));
 
-      args.material_index = mesh_part->materialIndex;
+    args.index_count = range.index_count;
+    args.start_index = range.start_index;
+    args.vertex_offset = range.vertex_offset;
 
-      draw_call_args_.push_back(args);
-    }
-  }
+    args.material_index = range.material_index;
 
-  for (const auto& effect_info : model_->materials) {
-    Material material{};
-    material.ambient_color = DirectX::XMFLOAT4(effect_info.ambientColor.x,
-                                               effect_info.ambientColor.y,
-                                               effect_info.ambientColor.z, 0.f);
-    material.diffuse_color = DirectX::XMFLOAT4(effect_info.diffuseColor.x,
-                                               effect_info.diffuseColor.y,
-                                               effect_info.diffuseColor.z, 0.f);
+    IndexedBounds(float_vertices[range.vertex_buffer], scene->index_data(range.index_buffer),
+                  ib.index_type, range.start_index, range.index_count, range.vertex_offset,
+                  &args.bounds_min, &args.bounds_max);
+
+    draw_call_args_.push_back(args);
+  }
 
-    materials_.push_back(material);
+  // The geometry pass writes material indices into the material G-buffer.
+  if (scene->num_materials() > kMaxGbufferMaterials) {
+    throw std::runtime_error("app: the scene has " + std::to_string(scene->num_materials()) +
+                             " materials, more than the G-buffer can index");
   }
+  // The lighting pass's material table is sized by the scene and cannot be empty.
+  if (scene->num_materials() == 0)
+    throw std::runtime_error("app: the scene has no materials");
+  materials_ = BuildMaterialTable(*scene);
 }
 
-void App::InitMatrices() {
-  camera_yaw_ = DirectX::XM_PI;
+void App::SetCamera(const DirectX::XMFLOAT3& position, float yaw, float pitch) {
+  camera_pos_ = position;
+  camera_yaw_ = yaw;
+  camera_pitch_ = pitch;
+  constants_dirty_ = true;
+}
 
-  DirectX::XMMATRIX camera_view_mat =
-      DirectX::XMMatrixRotationY(-camera_yaw_) *
-      DirectX::XMMatrixRotationX(-camera_pitch_) *
-      DirectX::XMMatrixRotationZ(-camera_roll_);
+void App::SetLightPosition(const DirectX::XMFLOAT3& position) {
+  light_pos_ = position;
+  constants_dirty_ = true;
+}
+
+void App::SetSinglePassShadows(bool single_pass) {
+  shadow_pass_.set_single_pass(single_pass);
+}
 
-  DirectX::XMMATRIX world_mat = DirectX::XMMatrixIdentity();
+void App::UpdateConstants() {
+  // The scene is drawn with an identity world matrix, so world-to-view is the view matrix.
   DirectX::XMMATRIX view_mat =
-      DirectX::XMMatrixTranslation(0.f, -1.f, -4.f) * camera_view_mat;
+      DirectX::XMMatrixTranslation(-camera_pos_.x, -camera_pos_.y, -camera_pos_.z) *
+      DirectX::XMMatrixRotationY(-camera_yaw_) *
+      DirectX::XMMatrixRotationX(-camera_pitch_);
+  float aspect_ratio = static_cast<float>(window_width_) / static_cast<float>(window_height_);
   DirectX::XMMATRIX proj_mat =
-      DirectX::XMMatrixPerspectiveFovLH(
-          DirectX::XM_PI / 4.f,
-          static_cast<float>(window_width_) / static_cast<float>(window_height_), 0.1f, 1000.f);
-
-  DirectX::XMStoreFloat4x4(&world_view_mat_, DirectX::XMMatrixTranspose(world_mat * view_mat));
+      DirectX::XMMatrixPerspectiveFovLH(DirectX::XM_PI / 4.f, aspect_ratio, 0.1f, 1000.f);
 
   // DirectXMath stores the matrix in row-major order while hlsl needs the matrix to be stored in
   // column-major order. So, we apply a transpose when storing the matrix in the buffer.
-  DirectX::XMStoreFloat4x4(&world_view_proj_mat_,
-                           DirectX::XMMatrixTranspose(world_mat * view_mat * proj_mat));
-
-  DirectX::XMVECTOR light_pos = DirectX::XMVectorSet(0.f, 1.9f, 0.f, 1.f);
-
-  DirectX::XMStoreFloat4(&light_pos_ , light_pos);
-
-  DirectX::XMVECTOR light_view_pos = DirectX::XMVector4Transform(light_pos, view_mat);
-
-  DirectX::XMStoreFloat4(&light_view_pos_ , light_view_pos);
-
+  DirectX::XMFLOAT4X4 world_view_mat;
+  DirectX::XMStoreFloat4x4(&world_view_mat, DirectX::XMMatrixTranspose(view_mat));
+
+  ViewConstants view;
+  view.world_view = world_view_mat;
+  frame_constants_.Set(ConstantBlock::kView, view);
+
+  GeometryPass::Matrices geometry_matrices;
+  geometry_matrices.world_view = world_view_mat;
+  DirectX::XMStoreFloat4x4(&geometry_matrices.world_view_proj,
+                           DirectX::XMMatrixTranspose(view_mat * proj_mat));
+  frame_constants_.Set(ConstantBlock::kGeometryMatrices, geometry_matrices);
+
+  DirectX::XMVECTOR light_view_pos = DirectX::XMVector3TransformCoord(
+      DirectX::XMLoadFloat3(&light_pos_), view_mat);
+
+  LightingPass::LightingConstants lighting_constants;
+  DirectX::XMStoreFloat4(&lighting_constants.light_view_pos,
+                         DirectX::XMVectorSetW(light_view_pos, 1.f));
+  lighting_constants.view_reconstruction = view_reconstruction_;
+  frame_constants_.Set(ConstantBlock::kLightingConstants, lighting_constants);
+
+  ShadowPass::Matrices shadow_matrices;
+  shadow_matrices.world_view = world_view_mat;
   {
     DirectX::XMMATRIX light_view_pos_inverse_mat =
-        DirectX::XMMatrixTranslation(-light_view_pos_.x, -light_view_pos_.y, -light_view_pos_.z);
+        DirectX::XMMatrixTranslationFromVector(DirectX::XMVectorNegate(light_view_pos));
     DirectX::XMMATRIX shadow_proj_mat = DirectX::XMMatrixPerspectiveFovLH(
       DirectX::XM_PI / 2.f,
       static_cast<float>(kShadowBufferWidth) / static_cast<float>(kShadowBufferHeight), 0.05f,
       10.f);
 
+    // The faces' rotations, in the order of the cubemap's array slices.
+    const DirectX::XMMATRIX face_mats[6] = {
+      DirectX::XMMatrixRotationY(-DirectX::XM_PI / 2.f),  // Right (+x)
+      DirectX::XMMatrixRotationY(DirectX::XM_PI / 2.f),  // Left (-x)
+      DirectX::XMMatrixRotationX(DirectX::XM_PI / 2.f),  // Top (+y)
+      DirectX::XMMatrixRotationX(-DirectX::XM_PI / 2.f),  // Bottom (-y)
+      DirectX::XMMatrixIdentity(),  // Front (+z)
+      DirectX::XMMatrixRotationY(DirectX::XM_PI)  // Back (-z)
+    };
+
     // Only apply these matrices to vertices in view space.
-    DirectX::XMStoreFloat4x4(
-        &shadow_mats_[0],
-        DirectX::XMMatrixTranspose(light_view_pos_inverse_mat *
-                                   DirectX::XMMatrixRotationY(-DirectX::XM_PI / 2.f) *
-                                   shadow_proj_mat));  // Right (+x)
-    DirectX::XMStoreFloat4x4(
-        &shadow_mats_[1],
-        DirectX::XMMatrixTranspose(light_view_pos_inverse_mat *
-                                   DirectX::XMMatrixRotationY(DirectX::XM_PI / 2.f) *
-                                   shadow_proj_mat));  // Left (-x)
-    DirectX::XMStoreFloat4x4(
-        &shadow_mats_[2],
-        DirectX::XMMatrixTranspose(light_view_pos_inverse_mat *
-                                   DirectX::XMMatrixRotationX(DirectX::XM_PI / 2.f) *
-                                   shadow_proj_mat));  // Top (+y)
-    DirectX::XMStoreFloat4x4(
-        &shadow_mats_[3],
-        DirectX::XMMatrixTranspose(light_view_pos_inverse_mat *
-                                   DirectX::XMMatrixRotationX(-DirectX::XM_PI / 2.f) *
-                                   shadow_proj_mat));  // Bottom (-y)
-    DirectX::XMStoreFloat4x4(
-        &shadow_mats_[4],
-        DirectX::XMMatrixTranspose(light_view_pos_inverse_mat *
-                                   shadow_proj_mat));  // Front (+z)
-    DirectX::XMStoreFloat4x4(
-        &shadow_mats_[5],
-        DirectX::XMMatrixTranspose(light_view_pos_inverse_mat *
-                                   DirectX::XMMatrixRotationY(DirectX::XM_PI) *
-                                   shadow_proj_mat));  // Back (-z)
+    DirectX::XMMATRIX world_to_face[ShadowPass::kNumFaces];
+    for (int i = 0; i < 6; ++i) {
+      DirectX::XMMATRIX face_mat = light_view_pos_inverse_mat * face_mats[i] * shadow_proj_mat;
+      DirectX::XMStoreFloat4x4(&shadow_matrices.shadow[i], DirectX::XMMatrixTranspose(face_mat));
+      world_to_face[i] = view_mat * face_mat;
+    }
+
+    // The faces the draws reach move with the light and the camera.
+    shadow_pass_.CullDraws(world_to_face);
   }
+  frame_constants_.Set(ConstantBlock::kShadowMatrices, shadow_matrices);
 }
 
-void App::UploadDataToBuffer(const void* data, UINT64 data_size, ID3D12Resource* dst_buffer) {
-  Microsoft::WRL::ComPtr<ID3D12Resource> upload_buffer;
+void App::UploadDataToBuffer(const void* data, UINT64 data_size, ID3D12Resource* dst_buffer,
+                             D3D12_RESOURCE_STATES after_state) {
+  const UINT8* src = static_cast<const UINT8*>(data);
 
-  CD3DX12_HEAP_PROPERTIES heap_props(D3D12_HEAP_TYPE_UPLOAD);
-  CD3DX12_RESOURCE_DESC buffer_desc = CD3DX12_RESOURCE_DESC::Buffer(data_size);
-
-  ThrowIfFailed(device_->CreateCommittedResource(&heap_props, D3D12_HEAP_FLAG_NONE, &buffer_desc,
-                                                  D3D12_RESOURCE_STATE_GENERIC_READ, nullptr,
-                                                  IID_PPV_ARGS(&upload_buffer)));
+  for (UINT64 copied = 0; copied < data_size;) {
+    const UINT64 chunk_size = std::min(data_size - copied, kMaxUploadChunkSize);
+    UploadAllocation allocation = AllocateUpload(chunk_size, 4);
 
-  D3D12_SUBRESOURCE_DATA subresource_data = {};
-  subresource_data.pData = data;
-  subresource_data.RowPitch = data_size;
-  subresource_data.SlicePitch = subresource_data.RowPitch;
-
-  UpdateSubresources<1>(command_list_.Get(), dst_buffer, upload_buffer.Get(), 0, 0, 1,
-                        &subresource_data);
+    std::memcpy(allocation.cpu_address, src + copied, chunk_size);
+    command_list_->CopyBufferRegion(dst_buffer, copied, upload_ring_buffer_.Get(),
+                                    allocation.offset, chunk_size);
+    copied += chunk_size;
+  }
 
   D3D12_RESOURCE_BARRIER barrier =
       CD3DX12_RESOURCE_BARRIER::Transition(dst_buffer, D3D12_RESOURCE_STATE_COPY_DEST,
-                                           D3D12_RESOURCE_STATE_VERTEX_AND_CONSTANT_BUFFER);
+                                           after_state);
   command_list_->ResourceBarrier(1, &barrier);
+}
+
+App::UploadAllocation App::AllocateUpload(UINT64 size, UINT64 alignment) {
+  UINT64 offset;
+  while ((offset = upload_ring_.Allocate(size, alignment)) == UploadRing::kFull) {
+    ++upload_stalls_;
+    if (upload_ring_.has_submissions())
+      WaitForFenceValue(upload_ring_.oldest_fence_value());
+    else
+      FlushCommandList();
+    upload_ring_.Retire(fence_->GetCompletedValue());
+  }
+
+  UploadAllocation allocation;
+  allocation.cpu_address = upload_ring_data_ + offset;
+  allocation.offset = offset;
+  return allocation;
+}
+
+DescriptorHeap::Table App::AllocateTransientDescriptors(uint32_t count) {
+  std::lock_guard<std::mutex> lock(transient_descriptors_mutex_);
+
+  DescriptorHeap::Table table;
+  while ((table = cbv_srv_heap_.AllocateTransient(count)).index == DescriptorAllocator::kInvalid) {
+    // The ring is full of the current frame's own tables.
+    if (!cbv_srv_heap_.allocator().has_submissions())
+      throw std::runtime_error("app: the descriptor ring cannot hold one frame's tables");
+
+    WaitForFenceValue(cbv_srv_heap_.allocator().oldest_fence_value());
+    cbv_srv_heap_.Retire(fence_->GetCompletedValue());
+  }
+  return table;
+}
+
+void App::FlushCommandList() {
+  ThrowIfFailed(command_list_->Close());
+  ID3D12CommandList* command_lists[] = { command_list_.Get() };
+  command_queue_->ExecuteCommandLists(_countof(command_lists), command_lists);
+  upload_ring_.Submit(latest_fence_value_);
+
+  WaitForGpu();
 
-  // Upload buffers must be kept alive until the copy commands are completed.
-  upload_buffers_.push_back(upload_buffer);
+  ThrowIfFailed(command_list_->Reset(frames_[frame_index_].command_allocator.Get(), nullptr));
 }
 
 void App::Cleanup() {
   WaitForGpu();
 
+  // Only the scene and the other startup uploads go through the ring.
+  const UploadRing::Stats& stats = upload_ring_.stats();
+  char message[256];
+  std::snprintf(message, sizeof(message),
+                "upload ring: %.2f MiB of startup uploads in %llu submissions, at most %.2f MiB "
+                "per submission and %.2f MiB in use at once, %d stalls\n",
+                stats.bytes_allocated / (1024.0 * 1024.0),
+                static_cast<unsigned long long>(stats.submissions),
+                stats.peak_submission_bytes / (1024.0 * 1024.0),
+                stats.peak_bytes_in_use / (1024.0 * 1024.0), upload_stalls_);
+  OutputDebugStringA(message);
+
+  const FrameConstants::Stats& constants_stats = frame_constants_.stats();
+  std::snprintf(message, sizeof(message),
+                "frame constants: %llu of %llu block copies rewritten in %llu frames\n",
+                static_cast<unsigned long long>(constants_stats.blocks_written),
+                static_cast<unsigned long long>(constants_stats.flushes *
+                                                frame_constants_.num_blocks()),
+                static_cast<unsigned long long>(constants_stats.flushes));
+  OutputDebugStringA(message);
+
+  // Per frame, summed over the pass's command lists, for each mode that ran.
+  auto report_shadow_stats = [&](const char* mode, const ShadowPass::RecordStats* lists,
+                                 int num_lists) {
+    if (lists[0].recordings == 0)
+      return;
+    ShadowPass::RecordStats totals;
+    for (int i = 0; i < num_lists; ++i) {
+      totals.draws += lists[i].draws;
+      totals.instances += lists[i].instances;
+      totals.seconds += lists[i].seconds;
+    }
+    const double frames = static_cast<double>(lists[0].recordings);
+    std::snprintf(message, sizeof(message),
+                  "shadow pass: %s, %llu frames, %.1f draws and %.1f instances per frame, %.1f us "
+                  "of recording per frame, render target array index %s\n",
+                  mode, static_cast<unsigned long long>(lists[0].recordings),
+                  totals.draws / frames, totals.instances / frames, totals.seconds * 1e6 / frames,
+                  shadow_pass_.array_index_without_gs_ ? "native" : "through a geometry shader");
+    OutputDebugStringA(message);
+  };
+  report_shadow_stats("single pass", &shadow_pass_.single_pass_stats_, 1);
+  report_shadow_stats("one pass per face", shadow_pass_.face_stats_, ShadowPass::kNumFaces);
+
   if (fence_event_ != nullptr)
     CloseHandle(fence_event_);
 }
 
-void App::RenderFrame() {
-  ThrowIfFailed(frames_[frame_index_].command_allocator->Reset());
-  ThrowIfFailed(command_list_->Reset(frames_[frame_index_].command_allocator.Get(), nullptr));
-
-  {
-    CD3DX12_RESOURCE_BARRIER barrier = CD3DX12_RESOURCE_BARRIER::Transition(
-        frames_[frame_index_].swap_chain_buffer.Get(), D3D12_RESOURCE_STATE_PRESENT,
-        D3D12_RESOURCE_STATE_RENDER_TARGET);
-    command_list_->ResourceBarrier(1, &barrier);
+void App::InitRenderGraph() {
+  graph_resources_.swap_chain_buffer =
+      render_graph_.ImportResource("swap chain buffer", D3D12_RESOURCE_STATE_PRESENT);
+  graph_resources_.view_lights =
+      render_graph_.ImportResource("view lights", D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE);
+  graph_resources_.light_counts =
+      render_graph_.ImportResource("light counts", D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE);
+  graph_resources_.light_indices =
+      render_graph_.ImportResource("light indices", D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE);
+
+  render_graph_.MarkOutput(graph_resources_.swap_chain_buffer);
+
+  // Typeless so that the lighting pass can read it as R32_FLOAT to reconstruct positions.
+  CD3DX12_RESOURCE_DESC depth_stencil_desc =
+      CD3DX12_RESOURCE_DESC::Tex2D(DXGI_FORMAT_R32_TYPELESS, window_width_, window_height_, 1, 1,
+                                   1, 0, D3D12_RESOURCE_FLAG_ALLOW_DEPTH_STENCIL);
+  CD3DX12_RESOURCE_DESC normal_gbuffer_desc =
+      CD3DX12_RESOURCE_DESC::Tex2D(DXGI_FORMAT_R16G16_SNORM, window_width_, window_height_, 1, 1,
+                                   1, 0, D3D12_RESOURCE_FLAG_ALLOW_RENDER_TARGET);
+  CD3DX12_RESOURCE_DESC material_gbuffer_desc =
+      CD3DX12_RESOURCE_DESC::Tex2D(DXGI_FORMAT_R16_UINT, window_width_, window_height_, 1, 1, 1, 0,
+                                   D3D12_RESOURCE_FLAG_ALLOW_RENDER_TARGET);
+  CD3DX12_RESOURCE_DESC shadow_cubemap_desc =
+      CD3DX12_RESOURCE_DESC::Tex2D(DXGI_FORMAT_D32_FLOAT, kShadowBufferWidth, kShadowBufferHeight,
+                                   6, 1, 1, 0, D3D12_RESOURCE_FLAG_ALLOW_DEPTH_STENCIL);
+
+  auto create_transient = [this](const char* name, const D3D12_RESOURCE_DESC& desc) {
+    D3D12_RESOURCE_ALLOCATION_INFO info = device_->GetResourceAllocationInfo(0, 1, &desc);
+    return render_graph_.CreateTransientResource(name, info.SizeInBytes, info.Alignment);
+  };
+
+  graph_resources_.depth_stencil = create_transient("depth stencil", depth_stencil_desc);
+  graph_resources_.normal_gbuffer = create_transient("normal gbuffer", normal_gbuffer_desc);
+  graph_resources_.material_gbuffer = create_transient("material gbuffer", material_gbuffer_desc);
+  graph_resources_.shadow_cubemap = create_transient("shadow cubemap", shadow_cubemap_desc);
+
+  shadow_pass_.AddToRenderGraph(&render_graph_);
+
+  geometry_pass_.AddToRenderGraph(&render_graph_);
+
+  cluster_pass_.AddToRenderGraph(&render_graph_);
+
+  lighting_pass_.AddToRenderGraph(&render_graph_);
+
+  // The passes are the same every frame, so the schedule and the placement are too.
+  render_graph_.Compile();
+
+  // Created closed, since each frame resets them.
+  task_command_lists_.resize(render_graph_.tasks().size());
+  submitted_lists_.clear();
+  for (ComPtr<ID3D12GraphicsCommandList>& command_list : task_command_lists_) {
+    ThrowIfFailed(device_->CreateCommandList(0, D3D12_COMMAND_LIST_TYPE_DIRECT,
+                                             frames_[frame_index_].command_allocator.Get(),
+                                             nullptr, IID_PPV_ARGS(&command_list)));
+    ThrowIfFailed(command_list->Close());
+    submitted_lists_.push_back(command_list.Get());
   }
 
-  shadow_pass_.RenderFrame(command_list_.Get());
+  CD3DX12_HEAP_DESC heap_desc(render_graph_.transient_heap_size(), D3D12_HEAP_TYPE_DEFAULT, 0,
+                              D3D12_HEAP_FLAG_ALLOW_ONLY_RT_DS_TEXTURES);
+  ThrowIfFailed(device_->CreateHeap(&heap_desc, IID_PPV_ARGS(&transient_heap_)));
+
+  // Created in the state of their first use, which the graph returns them to after their last. A
+  // texture that shares memory with another must be cleared after its aliasing barrier, which the
+  // passes do anyway.
+  auto place_transient = [this](RenderGraph::ResourceId resource, const D3D12_RESOURCE_DESC& desc,
+                                const D3D12_CLEAR_VALUE& clear_value,
+                                Microsoft::WRL::ComPtr<ID3D12Resource>* placed) {
+    ThrowIfFailed(device_->CreatePlacedResource(
+        transient_heap_.Get(), render_graph_.transient_offset(resource), &desc,
+        static_cast<D3D12_RESOURCE_STATES>(render_graph_.imported_state(resource)), &clear_value,
+        IID_PPV_ARGS(placed->ReleaseAndGetAddressOf())));
+  };
 
-  geometry_pass_.RenderFrame(command_list_.Get());
+  D3D12_CLEAR_VALUE clear_depth{};
+  clear_depth.Format = DXGI_FORMAT_D32_FLOAT;
+  clear_depth.DepthStencil.Depth = 1.0f;
+  clear_depth.DepthStencil.Stencil = 0;
 
-  lighting_pass_.RenderFrame(command_list_.Get());
+  D3D12_CLEAR_VALUE clear_normal{};
+  clear_normal.Format = DXGI_FORMAT_R16G16_SNORM;
 
-  {
-    CD3DX12_RESOURCE_BARRIER barrier = CD3DX12_RESOURCE_BARRIER::Transition(
-        frames_[frame_index_].swap_chain_buffer.Get(),
-        D3D12_RESOURCE_STATE_RENDER_TARGET, D3D12_RESOURCE_STATE_PRESENT);
-    command_list_->ResourceBarrier(1, &barrier);
-  }
+  D3D12_CLEAR_VALUE clear_material{};
+  clear_material.Format = DXGI_FORMAT_R16_UINT;
 
-  ThrowIfFailed(command_list_->Close());
+  place_transient(graph_resources_.depth_stencil, depth_stencil_desc, clear_depth,
+                  &depth_stencil_);
+  place_transient(graph_resources_.normal_gbuffer, normal_gbuffer_desc, clear_normal,
+                  &normal_gbuffer_);
+  place_transient(graph_resources_.material_gbuffer, material_gbuffer_desc, clear_material,
+                  &material_gbuffer_);
+  place_transient(graph_resources_.shadow_cubemap, shadow_cubemap_desc, clear_depth,
+                  &shadow_cubemap_);
 
-  ID3D12CommandList* command_lists[] = { command_list_.Get() };
-  command_queue_->ExecuteCommandLists(_countof(command_lists), command_lists);
+  for (int i = 0; i < kNumFrames; ++i) {
+    std::vector<ID3D12Resource*>& resources = frames_[i].graph_resources;
+    resources.resize(render_graph_.num_resources());
+
+    resources[graph_resources_.swap_chain_buffer] = frames_[i].swap_chain_buffer.Get();
+    resources[graph_resources_.depth_stencil] = depth_stencil_.Get();
+    resources[graph_resources_.normal_gbuffer] = normal_gbuffer_.Get();
+    resources[graph_resources_.material_gbuffer] = material_gbuffer_.Get();
+    resources[graph_resources_.shadow_cubemap] = shadow_cubemap_.Get();
+    resources[graph_resources_.view_lights] = cluster_pass_.view_lights_buffer_.Get();
+    resources[graph_resources_.light_counts] = cluster_pass_.light_counts_buffer_.Get();
+    resources[graph_resources_.light_indices] = cluster_pass_.light_indices_buffer_.Get();
+  }
+}
+
+void App::RenderFrame() {
+  if (constants_dirty_) {
+    UpdateConstants();
+    constants_dirty_ = false;
+  }
+  frame_constants_.Flush(frame_index_, frame_constants_data_);
+
+  Frame& frame = frames_[frame_index_];
+  for (ComPtr<ID3D12CommandAllocator>& allocator : frame.recording_allocators)
+    ThrowIfFailed(allocator->Reset());
+
+  // Runs on recording_jobs_'s threads. A failed call there, or a full descriptor ring, is rethrown
+  // here once every task has finished.
+  render_graph_.ExecuteParallel(
+      &recording_jobs_,
+      [&](int task, int thread_index) -> void* {
+        ID3D12GraphicsCommandList* command_list = task_command_lists_[task].Get();
+        ThrowIfFailed(command_list->Reset(frame.recording_allocators[thread_index].Get(),
+                                          nullptr));
+        return command_list;
+      },
+      [this](void* command_list, const std::vector<RenderGraph::Barrier>& barriers) {
+        RecordBarriers(static_cast<ID3D12GraphicsCommandList*>(command_list), barriers);
+      },
+      [](int, void* command_list) {
+        ThrowIfFailed(static_cast<ID3D12GraphicsCommandList*>(command_list)->Close());
+      });
+
+  // One submission in task order runs the commands in the order the graph scheduled them.
+  command_queue_->ExecuteCommandLists(static_cast<UINT>(submitted_lists_.size()),
+                                      submitted_lists_.data());
 
   ThrowIfFailed(swap_chain_->Present(1, 0));
 
   MoveToNextFrame();
 }
 
+void App::RecordBarriers(ID3D12GraphicsCommandList* command_list,
+                         const std::vector<RenderGraph::Barrier>& barriers) {
+  // Most passes need no barriers, and ResourceBarrier() with none is invalid.
+  if (barriers.empty())
+    return;
+
+  // Local, since the recording threads record barriers at the same time.
+  std::vector<CD3DX12_RESOURCE_BARRIER> barrier_batch;
+  barrier_batch.reserve(barriers.size());
+
+  for (const RenderGraph::Barrier& barrier : barriers) {
+    ID3D12Resource* resource = frames_[frame_index_].graph_resources[barrier.resource];
+
+    if (barrier.type == RenderGraph::Barrier::kUav) {
+      barrier_batch.push_back(CD3DX12_RESOURCE_BARRIER::UAV(resource));
+      continue;
+    }
+    if (barrier.type == RenderGraph::Barrier::kAliasing) {
+      barrier_batch.push_back(CD3DX12_RESOURCE_BARRIER::Aliasing(nullptr, resource));
+      continue;
+    }
+
+    D3D12_RESOURCE_BARRIER_FLAGS flags = D3D12_RESOURCE_BARRIER_FLAG_NONE;
+    if (barrier.split == RenderGraph::Barrier::kBegin)
+      flags = D3D12_RESOURCE_BARRIER_FLAG_BEGIN_ONLY;
+    else if (barrier.split == RenderGraph::Barrier::kEnd)
+      flags = D3D12_RESOURCE_BARRIER_FLAG_END_ONLY;
+
+    barrier_batch.push_back(CD3DX12_RESOURCE_BARRIER::Transition(
+        resource, static_cast<D3D12_RESOURCE_STATES>(barrier.before),
+        static_cast<D3D12_RESOURCE_STATES>(barrier.after),
+        D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES, flags));
+  }
+
+  command_list->ResourceBarrier(static_cast<UINT>(barrier_batch.size()), barrier_batch.data());
+}
+
 void App::MoveToNextFrame() {
   ThrowIfFailed(command_queue_->Signal(fence_.Get(), latest_fence_value_));
   frames_[frame_index_].fence_value = latest_fence_value_;
+  // The per-frame constants go through frame_constants_buffer_, so most frames upload nothing.
+  if (upload_ring_.open_bytes() > 0)
+    upload_ring_.Submit(latest_fence_value_);
+  cbv_srv_heap_.Submit(latest_fence_value_);
 
   ++latest_fence_value_;
 
   frame_index_ = swap_chain_->GetCurrentBackBufferIndex();
 
-  if (fence_->GetCompletedValue() < frames_[frame_index_].fence_value) {
-    ThrowIfFailed(fence_->SetEventOnCompletion(frames_[frame_index_].fence_value, fence_event_));
-    WaitForSingleObjectEx(fence_event_, INFINITE, false);
-  }
+  WaitForFenceValue(frames_[frame_index_].fence_value);
+  upload_ring_.Retire(fence_->GetCompletedValue());
+  cbv_srv_heap_.Retire(fence_->GetCompletedValue());
 }
 
 void App::WaitForGpu() {
@@ -561,4 +778,12 @@ void App::WaitForGpu() {
 
   ThrowIfFailed(fence_->SetEventOnCompletion(wait_value, fence_event_));
   WaitForSingleObjectEx(fence_event_, INFINITE, false);
+}
+
+void App::WaitForFenceValue(UINT64 fence_value) {
+  if (fence_->GetCompletedValue() >= fence_value)
+    return;
+
+  ThrowIfFailed(fence_->SetEventOnCompletion(fence_value, fence_event_));
+  WaitForSingleObjectEx(fence_event_, INFINITE, false);
 }
\ No newline at end of file
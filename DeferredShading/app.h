@@ -6,26 +6,24 @@
 #include <wrl/client.h>
 
 #include <memory>
+#include <mutex>
 #include <vector>
 
 #include "d3dx12.h"
 #include "DirectXMath.h"
 
-// TODO: See if this can be removed. Currently needed so that "Model.h" doesn't error out.
-#include <stdexcept>
-
-#include "GraphicsMemory.h"
-#include "Model.h"
-
+#include "cluster_pass.h"
 #include "constants.h"
+#include "descriptor_heap.h"
+#include "frame_constants.h"
+#include "gbuffer_encoding.h"
 #include "geometry_pass.h"
+#include "job_system.h"
 #include "lighting_pass.h"
+#include "material_table.h"
+#include "render_graph.h"
 #include "shadow_pass.h"
-
-struct Material {
-  DirectX::XMFLOAT4 ambient_color;
-  DirectX::XMFLOAT4 diffuse_color;
-};
+#include "upload_ring.h"
 
 class App {
 public:
@@ -37,7 +35,21 @@ public:
 
   void RenderFrame();
 
+  // Moves the camera to |position| in world space, turned |yaw| radians about the y axis and then
+  // |pitch| radians about its x axis. Takes effect from the next RenderFrame(); frames already
+  // submitted keep the old view.
+  void SetCamera(const DirectX::XMFLOAT3& position, float yaw, float pitch);
+
+  // Moves the shadow-casting light to |position| in world space, from the next RenderFrame().
+  void SetLightPosition(const DirectX::XMFLOAT3& position);
+
+  // Switches the shadow pass between drawing the cubemap in one instanced pass and once per face,
+  // from the next RenderFrame(). Cleanup() reports both modes' recording costs.
+  void SetSinglePassShadows(bool single_pass);
+  bool single_pass_shadows() const { return shadow_pass_.single_pass(); }
+
 private:
+  friend class ClusterPass;
   friend class GeometryPass;
   friend class LightingPass;
   friend class ShadowPass;
@@ -54,16 +66,69 @@ private:
   void InitResources();
   void CreateSharedBuffers();
   void LoadModelData();
-  void InitMatrices();
+  void InitRenderGraph();
+  void CreateUploadRing();
+  void CreateFrameConstants();
+
+  // Recomputes the matrices from the camera and the light and stages the constant blocks, of which
+  // only those whose contents changed are rewritten in the frames' copies.
+  void UpdateConstants();
+
+  // The constant blocks the passes bind as root CBVs, each with a copy per frame in
+  // frame_constants_buffer_.
+  struct ConstantBlock {
+    static constexpr int kView = 0;
+    static constexpr int kGeometryMatrices = 1;
+    static constexpr int kShadowMatrices = 2;
+    static constexpr int kLightingConstants = 3;
+    static constexpr int kMax = kLightingConstants;
+  };
+
+  // Matches View in cluster_build_cs.hlsl and lighting_pass_ps.hlsl.
+  struct ViewConstants {
+    DirectX::XMFLOAT4X4 world_view;
+  };
+
+  // The GPU address of the current frame's copy of |block|.
+  D3D12_GPU_VIRTUAL_ADDRESS ConstantBlockAddress(int block) const;
+
+  // Copies |data| to |dst_buffer| through the upload ring, then transitions the buffer from
+  // COPY_DEST to |after_state|.
+  void UploadDataToBuffer(const void* data, UINT64 data_size, ID3D12Resource* dst_buffer,
+                          D3D12_RESOURCE_STATES after_state =
+                              D3D12_RESOURCE_STATE_VERTEX_AND_CONSTANT_BUFFER);
+
+  struct UploadAllocation {
+    UINT8* cpu_address;
+    UINT64 offset;
+  };
 
-  void UploadDataToBuffer(const void* data, UINT64 data_size, ID3D12Resource* dst_buffer);
+  // |size| bytes of the upload ring, free until the GPU has run the commands recorded after this
+  // call. Waits for the GPU when the ring is full, and when it is full of the current command
+  // list's own uploads, submits the list and reopens it, which loses its bound state.
+  UploadAllocation AllocateUpload(UINT64 size, UINT64 alignment);
+
+  // A table of |count| descriptors in cbv_srv_heap_'s ring, valid until the GPU has run the
+  // current frame. Waits for the GPU when the ring is full. Safe to call from the recording
+  // threads.
+  DescriptorHeap::Table AllocateTransientDescriptors(uint32_t count);
+
+  // Submits the commands recorded so far, waits for them and reopens the command list.
+  void FlushCommandList();
+
+  // Records one batch of the render graph's barriers for the current frame's resources into
+  // |command_list|.
+  void RecordBarriers(ID3D12GraphicsCommandList* command_list,
+                      const std::vector<RenderGraph::Barrier>& barriers);
 
   void MoveToNextFrame();
 
   void WaitForGpu();
+  void WaitForFenceValue(UINT64 fence_value);
 
   ShadowPass shadow_pass_;
   GeometryPass geometry_pass_;
+  ClusterPass cluster_pass_;
   LightingPass lighting_pass_;
 
   HWND window_hwnd_;
@@ -81,44 +146,95 @@ private:
   Microsoft::WRL::ComPtr<ID3D12CommandQueue> command_queue_;
   Microsoft::WRL::ComPtr<IDXGISwapChain3> swap_chain_;
 
+  // Records the uploads while the app starts. Each frame is recorded into
+  // task_command_lists_ instead.
   Microsoft::WRL::ComPtr<ID3D12GraphicsCommandList> command_list_;
 
   Microsoft::WRL::ComPtr<ID3D12Fence> fence_;
   UINT64 latest_fence_value_ = 0;
   HANDLE fence_event_;
 
-  Microsoft::WRL::ComPtr<ID3D12DescriptorHeap> rtv_heap_;
-  UINT rtv_descriptor_size_ = 0;
-  Microsoft::WRL::ComPtr<ID3D12DescriptorHeap> dsv_heap_;
-  UINT dsv_descriptor_size_ = 0;
-  Microsoft::WRL::ComPtr<ID3D12DescriptorHeap> cbv_srv_heap_;
-  UINT cbv_srv_descriptor_size_ = 0;
-  Microsoft::WRL::ComPtr<ID3D12DescriptorHeap> sampler_heap_;
-  UINT sampler_descriptor_size_ = 0;
-
-  std::vector<Microsoft::WRL::ComPtr<ID3D12Resource>> upload_buffers_;
-
+  // The passes allocate their descriptors from these when they create their views. The
+  // shader-visible cbv_srv_heap_ also holds the tables built each frame, mostly copied from views
+  // in staging_heap_.
+  DescriptorHeap rtv_heap_;
+  DescriptorHeap dsv_heap_;
+  DescriptorHeap cbv_srv_heap_;
+  DescriptorHeap staging_heap_;
+  DescriptorHeap sampler_heap_;
+
+  // A persistently mapped upload buffer that upload_ring_ hands out and takes back by fence value.
+  Microsoft::WRL::ComPtr<ID3D12Resource> upload_ring_buffer_;
+  UINT8* upload_ring_data_ = nullptr;
+  UploadRing upload_ring_;
+  // Times AllocateUpload() had to wait for the GPU.
+  int upload_stalls_ = 0;
+
+  // A persistently mapped upload buffer with a copy of every constant block per frame. The GPU
+  // reads the constants from there, and RenderFrame() only rewrites the current frame's copy,
+  // which the GPU finished with when MoveToNextFrame() waited for the frame's fence.
+  Microsoft::WRL::ComPtr<ID3D12Resource> frame_constants_buffer_;
+  UINT8* frame_constants_data_ = nullptr;
+  FrameConstants frame_constants_;
+
+  // The textures that only live from the shadow or geometry pass to the lighting pass, placed in
+  // transient_heap_ where render_graph_ puts them. The GPU runs the frames one after the other,
+  // so the frames in flight share this one set, and the passes one set of views of it. Their
+  // lifetimes within a frame all overlap, so none alias each other: the memory saved over a
+  // committed set per frame comes from the sharing alone.
+  Microsoft::WRL::ComPtr<ID3D12Heap> transient_heap_;
   Microsoft::WRL::ComPtr<ID3D12Resource> depth_stencil_;
+  Microsoft::WRL::ComPtr<ID3D12Resource> normal_gbuffer_;
+  Microsoft::WRL::ComPtr<ID3D12Resource> material_gbuffer_;
+  Microsoft::WRL::ComPtr<ID3D12Resource> shadow_cubemap_;
 
   struct Frame {
     Microsoft::WRL::ComPtr<ID3D12CommandAllocator> command_allocator;
+    // One per thread of recording_jobs_, which only records one command list at a time into
+    // each.
+    std::vector<Microsoft::WRL::ComPtr<ID3D12CommandAllocator>> recording_allocators;
 
     Microsoft::WRL::ComPtr<ID3D12Resource> swap_chain_buffer;
-    Microsoft::WRL::ComPtr<ID3D12Resource> gbuffer;
-
-    Microsoft::WRL::ComPtr<ID3D12Resource> pos_gbuffer;
-    Microsoft::WRL::ComPtr<ID3D12Resource> diffuse_gbuffer;
-    Microsoft::WRL::ComPtr<ID3D12Resource> normal_gbuffer;
 
-    Microsoft::WRL::ComPtr<ID3D12Resource> shadow_cubemap;
+    // This frame's resource for each render graph resource id.
+    std::vector<ID3D12Resource*> graph_resources;
 
     UINT64 fence_value = 0;
   };
 
   Frame frames_[kNumFrames];
 
-  std::unique_ptr<DirectX::GraphicsMemory> graphics_memory_;
-  std::unique_ptr<DirectX::Model> model_;
+  // The passes declare what they read and write in render_graph_, which places all the barriers
+  // between them.
+  RenderGraph render_graph_;
+
+  struct GraphResources {
+    RenderGraph::ResourceId swap_chain_buffer;
+    RenderGraph::ResourceId depth_stencil;
+    RenderGraph::ResourceId normal_gbuffer;
+    RenderGraph::ResourceId material_gbuffer;
+    RenderGraph::ResourceId shadow_cubemap;
+    RenderGraph::ResourceId view_lights;
+    RenderGraph::ResourceId light_counts;
+    RenderGraph::ResourceId light_indices;
+  };
+
+  GraphResources graph_resources_;
+
+  // Records the render graph's tasks, the shadow pass's faces and the other passes, in parallel,
+  // each into its own command list. A command list can be reset as soon as it is submitted, so
+  // the frames share them, and the frame's allocators hold the commands until the GPU has run
+  // them.
+  JobSystem recording_jobs_;
+  std::vector<Microsoft::WRL::ComPtr<ID3D12GraphicsCommandList>> task_command_lists_;
+  // task_command_lists_ in task order, submitted together.
+  std::vector<ID3D12CommandList*> submitted_lists_;
+
+  // Guards the descriptor ring, which the recording threads allocate tables from.
+  std::mutex transient_descriptors_mutex_;
+
+  std::vector<Microsoft::WRL::ComPtr<ID3D12Resource>> model_vertex_buffers_;
+  std::vector<Microsoft::WRL::ComPtr<ID3D12Resource>> model_index_buffers_;
 
   struct DrawCallArgs {
     D3D12_PRIMITIVE_TOPOLOGY primitive_type;
@@ -130,23 +246,25 @@ private:
     int32_t vertex_offset;
 
     uint32_t material_index;
+
+    // World-space bounding box of the vertices the draw indexes, for culling shadow faces.
+    DirectX::XMFLOAT3 bounds_min;
+    DirectX::XMFLOAT3 bounds_max;
   };
 
-  float camera_yaw_ = 0.f;
+  DirectX::XMFLOAT3 camera_pos_ = DirectX::XMFLOAT3(0.f, 1.f, 4.f);
+  float camera_yaw_ = DirectX::XM_PI;
   float camera_pitch_ = 0.f;
-  float camera_roll_ = 0.f;
+  // Whether the camera or the light moved since the constants were last staged.
+  bool constants_dirty_ = true;
 
   std::vector<DrawCallArgs> draw_call_args_;
 
-  DirectX::XMFLOAT4X4 world_view_mat_;
-  DirectX::XMFLOAT4X4 world_view_proj_mat_;
-
-  DirectX::XMFLOAT4X4 shadow_mats_[6];
+  ViewReconstruction view_reconstruction_;
 
-  std::vector<Material> materials_;
+  std::vector<MaterialTableEntry> materials_;
 
-  DirectX::XMFLOAT4 light_pos_;
-  DirectX::XMFLOAT4 light_view_pos_;
+  DirectX::XMFLOAT3 light_pos_ = DirectX::XMFLOAT3(0.f, 1.9f, 0.f);
 };
 
 #endif  // APP_H_
\ No newline at end of file
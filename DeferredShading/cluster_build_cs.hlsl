@@ -0,0 +1,117 @@
+// Bins the point lights into view-space clusters, one thread per cluster. The grid, the cluster
+// bounds and the sphere test repeat light_clusters.h and light_clusters.cpp, which build the same
+// lists on the CPU. The lights stay in world space, so that the buffer does not change when the
+// camera moves; they are moved into the frame's view here, once per frame, and written out for the
+// lighting pass.
+
+#define GRID_X 16
+#define GRID_Y 9
+#define GRID_Z 24
+#define MAX_LIGHTS_PER_CLUSTER 256
+#define NEAR_Z 0.1f
+#define FAR_Z 20.f
+#define BOUNDS_PADDING 1e-4f
+
+#define THREAD_GROUP_SIZE 64
+
+// In world space in |lights| and in view space in |view_lights|.
+struct PointLight {
+  float3 pos;
+  float radius;
+  float3 color;
+  float padding;
+};
+
+struct ClusterConstants {
+  float tan_half_fov_x;
+  float tan_half_fov_y;
+  float tile_width;
+  float tile_height;
+  float slice_scale;
+  float slice_bias;
+  uint num_lights;
+  uint padding;
+};
+
+ConstantBuffer<ClusterConstants> constants : register(b0);
+
+struct View {
+  float4x4 world_view;
+};
+
+ConstantBuffer<View> view : register(b1);
+
+StructuredBuffer<PointLight> lights : register(t0);
+
+RWStructuredBuffer<uint> light_counts : register(u0);
+RWStructuredBuffer<uint> light_indices : register(u1);
+RWStructuredBuffer<PointLight> view_lights : register(u2);
+
+// The part of a light the sphere test needs, in view space.
+struct LightSphere {
+  float3 view_pos;
+  float radius;
+};
+
+// Each group loads the lights a batch at a time, so every light is read from memory and moved
+// into view space once per group rather than once per cluster.
+groupshared LightSphere batch[THREAD_GROUP_SIZE];
+
+float SliceDepth(uint z) {
+  return NEAR_Z * pow(FAR_Z / NEAR_Z, (float)z / GRID_Z);
+}
+
+[numthreads(THREAD_GROUP_SIZE, 1, 1)]
+void main(uint3 thread_id : SV_DispatchThreadID, uint3 group_id : SV_GroupID,
+          uint group_index : SV_GroupIndex) {
+  uint cluster = thread_id.x;
+  uint x = cluster % GRID_X;
+  uint y = (cluster / GRID_X) % GRID_Y;
+  uint z = cluster / (GRID_X * GRID_Y);
+
+  float near_z = z == 0 ? 0.f : SliceDepth(z);
+  float far_z = z + 1 == GRID_Z ? FAR_Z : SliceDepth(z + 1);
+
+  // The tile's edges in NDC, y up, and the box around the froxel's corners on its near and far
+  // planes.
+  float2 ndc_min = float2(2.f * x / GRID_X - 1.f, 1.f - 2.f * (y + 1) / GRID_Y);
+  float2 ndc_max = float2(2.f * (x + 1) / GRID_X - 1.f, 1.f - 2.f * y / GRID_Y);
+  float2 tan_half_fov = float2(constants.tan_half_fov_x, constants.tan_half_fov_y);
+
+  float2 near_min = ndc_min * near_z * tan_half_fov;
+  float2 near_max = ndc_max * near_z * tan_half_fov;
+  float2 far_min = ndc_min * far_z * tan_half_fov;
+  float2 far_max = ndc_max * far_z * tan_half_fov;
+
+  float padding = far_z * BOUNDS_PADDING;
+  float3 bounds_min = float3(min(near_min, far_min), near_z) - padding;
+  float3 bounds_max = float3(max(near_max, far_max), far_z) + padding;
+
+  uint count = 0;
+  for (uint first = 0; first < constants.num_lights; first += THREAD_GROUP_SIZE) {
+    if (first + group_index < constants.num_lights) {
+      PointLight light = lights[first + group_index];
+      light.pos = mul(float4(light.pos, 1.f), view.world_view).xyz;
+      // Every group sees every light, so the first one alone writes them out.
+      if (group_id.x == 0)
+        view_lights[first + group_index] = light;
+      batch[group_index].view_pos = light.pos;
+      batch[group_index].radius = light.radius;
+    }
+    GroupMemoryBarrierWithGroupSync();
+
+    uint batch_size = min(THREAD_GROUP_SIZE, constants.num_lights - first);
+    for (uint i = 0; i < batch_size; ++i) {
+      LightSphere light = batch[i];
+      float3 distance = max(max(bounds_min - light.view_pos, light.view_pos - bounds_max), 0.f);
+      if (dot(distance, distance) <= light.radius * light.radius &&
+          count < MAX_LIGHTS_PER_CLUSTER) {
+        light_indices[cluster * MAX_LIGHTS_PER_CLUSTER + count] = first + i;
+        ++count;
+      }
+    }
+    GroupMemoryBarrierWithGroupSync();
+  }
+
+  light_counts[cluster] = count;
+}
\ No newline at end of file
@@ -0,0 +1,236 @@
+#include "cluster_pass.h"
+
+#include <d3d12.h>
+#include <dxgi1_6.h>
+#include <wrl/client.h>
+
+#include <vector>
+
+#include "d3dx12.h"
+#include "DirectXMath.h"
+
+#include "dx_utils.h"
+#include "light_clusters.h"
+#include "ReadData.h"
+
+#include "app.h"
+
+using Microsoft::WRL::ComPtr;
+using DX::ThrowIfFailed;
+
+namespace {
+
+// One thread per cluster. Must match numthreads in cluster_build_cs.hlsl.
+constexpr UINT kThreadGroupSize = 64;
+
+static_assert(kNumClusters % kThreadGroupSize == 0, "Clusters must fill whole thread groups");
+
+}  // namespace
+
+void ClusterPass::InitPipeline() {
+  CD3DX12_DESCRIPTOR_RANGE1 ranges[3] = {};
+  ranges[0].Init(D3D12_DESCRIPTOR_RANGE_TYPE_CBV, 1, 0, 0, D3D12_DESCRIPTOR_RANGE_FLAG_NONE,
+                 CbvSrvUavStatic::Index::kClusterConstantsBuffer);
+  ranges[1].Init(D3D12_DESCRIPTOR_RANGE_TYPE_SRV, 1, 0, 0, D3D12_DESCRIPTOR_RANGE_FLAG_NONE,
+                 CbvSrvUavStatic::Index::kLightsBufferSrv);
+  ranges[2].Init(D3D12_DESCRIPTOR_RANGE_TYPE_UAV, 3, 0, 0, D3D12_DESCRIPTOR_RANGE_FLAG_NONE,
+                 CbvSrvUavStatic::Index::kLightCountsBufferUav);
+
+  CD3DX12_ROOT_PARAMETER1 root_params[2] = {};
+  root_params[0].InitAsDescriptorTable(_countof(ranges), ranges);
+  // The view moves the lights out of world space, and changes with the camera.
+  root_params[1].InitAsConstantBufferView(
+      1, 0, D3D12_ROOT_DESCRIPTOR_FLAG_DATA_STATIC_WHILE_SET_AT_EXECUTE);
+
+  CD3DX12_VERSIONED_ROOT_SIGNATURE_DESC root_signature_desc;
+  root_signature_desc.Init_1_1(_countof(root_params), root_params, 0, nullptr,
+                               D3D12_ROOT_SIGNATURE_FLAG_NONE);
+
+  ComPtr<ID3DBlob> signature;
+  ComPtr<ID3DBlob> error;
+  ThrowIfFailed(D3DX12SerializeVersionedRootSignature(&root_signature_desc,
+                                                      app_->root_signature_version_, &signature,
+                                                      &error));
+  ThrowIfFailed(app_->device_->CreateRootSignature(0, signature->GetBufferPointer(),
+                                                   signature->GetBufferSize(),
+                                                   IID_PPV_ARGS(&root_signature_)));
+
+  std::vector<uint8_t> compute_shader_data = DX::ReadData(L"cluster_build_cs.cso");
+
+  D3D12_COMPUTE_PIPELINE_STATE_DESC pso_desc{};
+  pso_desc.pRootSignature = root_signature_.Get();
+  pso_desc.CS = { compute_shader_data.data(), compute_shader_data.size() };
+
+  ThrowIfFailed(app_->device_->CreateComputePipelineState(&pso_desc, IID_PPV_ARGS(&pipeline_)));
+}
+
+void ClusterPass::CreateBuffersAndUploadData() {
+  // Must be a multiple 256 bytes.
+  constant_buffer_size_ =
+      (sizeof(ClusterConstants) + (D3D12_CONSTANT_BUFFER_DATA_PLACEMENT_ALIGNMENT - 1)) &
+      ~(D3D12_CONSTANT_BUFFER_DATA_PLACEMENT_ALIGNMENT - 1);
+
+  {
+    CD3DX12_HEAP_PROPERTIES heap_props(D3D12_HEAP_TYPE_DEFAULT);
+    CD3DX12_RESOURCE_DESC resource_desc = CD3DX12_RESOURCE_DESC::Buffer(constant_buffer_size_);
+
+    ThrowIfFailed(app_->device_->CreateCommittedResource(&heap_props, D3D12_HEAP_FLAG_NONE,
+                                                         &resource_desc,
+                                                         D3D12_RESOURCE_STATE_COPY_DEST,
+                                                         nullptr,
+                                                         IID_PPV_ARGS(&constant_buffer_)));
+
+    const ClusterConstants constants = MakeClusterConstants(
+        app_->window_width_, app_->window_height_, DirectX::XM_PI / 4.f, kNumPointLights);
+    app_->UploadDataToBuffer(&constants, sizeof(constants), constant_buffer_.Get());
+  }
+
+  // The lights stay in world space, so that the buffer does not change when the camera moves. The
+  // cluster build moves them into the frame's view.
+  {
+    const std::vector<PointLight> lights = MakeRandomPointLights(kNumPointLights, 1);
+
+    const UINT64 lights_size = sizeof(PointLight) * lights.size();
+
+    CD3DX12_HEAP_PROPERTIES heap_props(D3D12_HEAP_TYPE_DEFAULT);
+    CD3DX12_RESOURCE_DESC buffer_desc = CD3DX12_RESOURCE_DESC::Buffer(lights_size);
+
+    ThrowIfFailed(app_->device_->CreateCommittedResource(&heap_props, D3D12_HEAP_FLAG_NONE,
+                                                         &buffer_desc,
+                                                         D3D12_RESOURCE_STATE_COPY_DEST, nullptr,
+                                                         IID_PPV_ARGS(&lights_buffer_)));
+
+    app_->UploadDataToBuffer(lights.data(), lights_size, lights_buffer_.Get(),
+                             D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
+
+    CD3DX12_RESOURCE_DESC view_lights_desc =
+        CD3DX12_RESOURCE_DESC::Buffer(lights_size, D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS);
+    ThrowIfFailed(app_->device_->CreateCommittedResource(&heap_props, D3D12_HEAP_FLAG_NONE,
+                                                         &view_lights_desc,
+                                                         D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE,
+                                                         nullptr,
+                                                         IID_PPV_ARGS(&view_lights_buffer_)));
+  }
+
+  {
+    CD3DX12_HEAP_PROPERTIES heap_props(D3D12_HEAP_TYPE_DEFAULT);
+
+    CD3DX12_RESOURCE_DESC counts_desc = CD3DX12_RESOURCE_DESC::Buffer(
+        sizeof(uint32_t) * kNumClusters, D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS);
+    ThrowIfFailed(app_->device_->CreateCommittedResource(&heap_props, D3D12_HEAP_FLAG_NONE,
+                                                         &counts_desc,
+                                                         D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE,
+                                                         nullptr,
+                                                         IID_PPV_ARGS(&light_counts_buffer_)));
+
+    CD3DX12_RESOURCE_DESC indices_desc = CD3DX12_RESOURCE_DESC::Buffer(
+        sizeof(uint32_t) * kNumClusters * kMaxLightsPerCluster,
+        D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS);
+    ThrowIfFailed(app_->device_->CreateCommittedResource(&heap_props, D3D12_HEAP_FLAG_NONE,
+                                                         &indices_desc,
+                                                         D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE,
+                                                         nullptr,
+                                                         IID_PPV_ARGS(&light_indices_buffer_)));
+  }
+}
+
+void ClusterPass::CreateResourceViews() {
+  DescriptorHeap::Table table = app_->cbv_srv_heap_.Allocate(CbvSrvUavStatic::kNumDescriptors);
+  base_cpu_handle_ = table.cpu_handle;
+  base_gpu_handle_ = table.gpu_handle;
+
+  {
+    D3D12_CONSTANT_BUFFER_VIEW_DESC cbv_desc{};
+    cbv_desc.BufferLocation = constant_buffer_->GetGPUVirtualAddress();
+    cbv_desc.SizeInBytes = constant_buffer_size_;
+
+    CD3DX12_CPU_DESCRIPTOR_HANDLE cbv_handle(base_cpu_handle_,
+                                             CbvSrvUavStatic::Index::kClusterConstantsBuffer,
+                                             app_->cbv_srv_heap_.descriptor_size());
+    app_->device_->CreateConstantBufferView(&cbv_desc, cbv_handle);
+  }
+
+  const struct {
+    ID3D12Resource* buffer;
+    UINT num_elements;
+    UINT stride;
+    int srv_index;
+  } srvs[] = {
+    {lights_buffer_.Get(), kNumPointLights, sizeof(PointLight),
+     CbvSrvUavStatic::Index::kLightsBufferSrv},
+    {view_lights_buffer_.Get(), kNumPointLights, sizeof(PointLight),
+     CbvSrvUavStatic::Index::kViewLightsBufferSrv},
+    {light_counts_buffer_.Get(), kNumClusters, sizeof(uint32_t),
+     CbvSrvUavStatic::Index::kLightCountsBufferSrv},
+    {light_indices_buffer_.Get(), kNumClusters * kMaxLightsPerCluster, sizeof(uint32_t),
+     CbvSrvUavStatic::Index::kLightIndicesBufferSrv},
+  };
+
+  for (const auto& srv : srvs) {
+    D3D12_SHADER_RESOURCE_VIEW_DESC srv_desc{};
+    srv_desc.Format = DXGI_FORMAT_UNKNOWN;
+    srv_desc.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
+    srv_desc.ViewDimension = D3D12_SRV_DIMENSION_BUFFER;
+    srv_desc.Buffer.FirstElement = 0;
+    srv_desc.Buffer.NumElements = srv.num_elements;
+    srv_desc.Buffer.StructureByteStride = srv.stride;
+
+    CD3DX12_CPU_DESCRIPTOR_HANDLE srv_handle(base_cpu_handle_, srv.srv_index,
+                                             app_->cbv_srv_heap_.descriptor_size());
+    app_->device_->CreateShaderResourceView(srv.buffer, &srv_desc, srv_handle);
+  }
+
+  const struct {
+    ID3D12Resource* buffer;
+    UINT num_elements;
+    UINT stride;
+    int uav_index;
+  } uavs[] = {
+    {light_counts_buffer_.Get(), kNumClusters, sizeof(uint32_t),
+     CbvSrvUavStatic::Index::kLightCountsBufferUav},
+    {light_indices_buffer_.Get(), kNumClusters * kMaxLightsPerCluster, sizeof(uint32_t),
+     CbvSrvUavStatic::Index::kLightIndicesBufferUav},
+    {view_lights_buffer_.Get(), kNumPointLights, sizeof(PointLight),
+     CbvSrvUavStatic::Index::kViewLightsBufferUav},
+  };
+
+  for (const auto& uav : uavs) {
+    D3D12_UNORDERED_ACCESS_VIEW_DESC uav_desc{};
+    uav_desc.Format = DXGI_FORMAT_UNKNOWN;
+    uav_desc.ViewDimension = D3D12_UAV_DIMENSION_BUFFER;
+    uav_desc.Buffer.FirstElement = 0;
+    uav_desc.Buffer.NumElements = uav.num_elements;
+    uav_desc.Buffer.StructureByteStride = uav.stride;
+
+    CD3DX12_CPU_DESCRIPTOR_HANDLE uav_handle(base_cpu_handle_, uav.uav_index,
+                                             app_->cbv_srv_heap_.descriptor_size());
+    app_->device_->CreateUnorderedAccessView(uav.buffer, nullptr, &uav_desc, uav_handle);
+  }
+}
+
+void ClusterPass::AddToRenderGraph(RenderGraph* graph) {
+  const App::GraphResources& resources = app_->graph_resources_;
+
+  RenderGraph::PassId pass =
+      graph->AddPass("cluster", 1, [this](void* command_list, int) {
+        RenderFrame(static_cast<ID3D12GraphicsCommandList*>(command_list));
+      });
+  graph->Write(pass, resources.view_lights, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
+  graph->Write(pass, resources.light_counts, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
+  graph->Write(pass, resources.light_indices, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
+}
+
+void ClusterPass::RenderFrame(ID3D12GraphicsCommandList* command_list) {
+  command_list->SetPipelineState(pipeline_.Get());
+
+  command_list->SetComputeRootSignature(root_signature_.Get());
+
+  ID3D12DescriptorHeap* heaps[] = { app_->cbv_srv_heap_.heap() };
+  command_list->SetDescriptorHeaps(_countof(heaps), heaps);
+
+  command_list->SetComputeRootDescriptorTable(0, base_gpu_handle_);
+  command_list->SetComputeRootConstantBufferView(
+      1, app_->ConstantBlockAddress(App::ConstantBlock::kView));
+
+  command_list->Dispatch(kNumClusters / kThreadGroupSize, 1, 1);
+}
\ No newline at end of file
@@ -0,0 +1,71 @@
+#ifndef CLUSTER_PASS_H_
+#define CLUSTER_PASS_H_
+
+#include <d3d12.h>
+#include <dxgi1_6.h>
+#include <wrl/client.h>
+
+#include "d3dx12.h"
+
+#include "constants.h"
+#include "render_graph.h"
+
+class App;
+
+// Compute pass that bins the point lights into the view-space clusters of light_clusters.h. The
+// lighting pass reads the lists it builds.
+class ClusterPass {
+public:
+  ClusterPass(App* app) : app_(app) {}
+
+  void InitPipeline();
+  void CreateBuffersAndUploadData();
+  void CreateResourceViews();
+
+  // Adds the pass, and the resources it reads and writes, to |graph|.
+  void AddToRenderGraph(RenderGraph* graph);
+
+  void RenderFrame(ID3D12GraphicsCommandList* command_list);
+
+  // Table of the cluster constants followed by the view-space lights, counts and indices SRVs, in
+  // the order lighting_pass_ps.hlsl binds them (b2, t4 - t6).
+  CD3DX12_GPU_DESCRIPTOR_HANDLE light_lists_gpu_handle() const { return base_gpu_handle_; }
+
+private:
+  friend class App;
+
+  App* app_;
+
+  Microsoft::WRL::ComPtr<ID3D12RootSignature> root_signature_;
+  Microsoft::WRL::ComPtr<ID3D12PipelineState> pipeline_;
+
+  Microsoft::WRL::ComPtr<ID3D12Resource> constant_buffer_;
+  UINT constant_buffer_size_ = 0;
+
+  // The lights in world space, which the cluster build moves into the frame's view and writes to
+  // view_lights_buffer_ for the lighting pass.
+  Microsoft::WRL::ComPtr<ID3D12Resource> lights_buffer_;
+  Microsoft::WRL::ComPtr<ID3D12Resource> view_lights_buffer_;
+  Microsoft::WRL::ComPtr<ID3D12Resource> light_counts_buffer_;
+  Microsoft::WRL::ComPtr<ID3D12Resource> light_indices_buffer_;
+
+  CD3DX12_CPU_DESCRIPTOR_HANDLE base_cpu_handle_;
+  CD3DX12_GPU_DESCRIPTOR_HANDLE base_gpu_handle_;
+
+  struct CbvSrvUavStatic {
+    struct Index {
+      static constexpr int kClusterConstantsBuffer = 0;
+      static constexpr int kViewLightsBufferSrv = 1;
+      static constexpr int kLightCountsBufferSrv = 2;
+      static constexpr int kLightIndicesBufferSrv = 3;
+      static constexpr int kLightCountsBufferUav = 4;
+      static constexpr int kLightIndicesBufferUav = 5;
+      static constexpr int kViewLightsBufferUav = 6;
+      static constexpr int kLightsBufferSrv = 7;
+      static constexpr int kMax = kLightsBufferSrv;
+    };
+    static constexpr int kNumDescriptors = Index::kMax + 1;
+  };
+};
+
+#endif  // CLUSTER_PASS_H_
\ No newline at end of file
@@ -1,9 +1,39 @@
 #ifndef CONSTANTS_H_
 #define CONSTANTS_H_
 
+#include <cstdint>
+
 constexpr int kNumFrames = 3;
 
+// Bytes of the persistently mapped upload buffer that every copy to a default-heap buffer goes
+// through.
+constexpr uint64_t kUploadRingSize = 8 * 1024 * 1024;
+
+// Descriptors in each heap's persistent region, which holds views that live until they are freed.
+constexpr uint32_t kRtvHeapSize = 32;
+constexpr uint32_t kDsvHeapSize = 32;
+constexpr uint32_t kCbvSrvUavHeapSize = 256;
+constexpr uint32_t kSamplerHeapSize = 16;
+// The CPU-only heap the per-frame tables are copied from.
+constexpr uint32_t kStagingHeapSize = 64;
+
+// Descriptors in the shader-visible CBV/SRV/UAV heap's ring of tables built each frame, after its
+// persistent region.
+constexpr uint32_t kTransientDescriptorRingSize = 256;
+
+// Threads, counting the main thread, that record the render graph's command lists each frame.
+constexpr int kRecordingThreads = 4;
+
 constexpr int kShadowBufferWidth = 1024;
 constexpr int kShadowBufferHeight = 1024;
 
+// Whether the shadow pass starts out drawing the cubemap in one pass, each draw instanced once per
+// face its bounds reach and routed to the face's slice by the vertex shader, instead of once per
+// face. App::SetSinglePassShadows() switches between the two.
+constexpr bool kDefaultSinglePassShadows = true;
+
+// Point lights scattered through the scene on top of the shadowed light. The cluster pass bins
+// them so the lighting pass only loops over the ones near each pixel.
+constexpr int kNumPointLights = 1024;
+
 #endif  // CONSTANTS_H_
\ No newline at end of file
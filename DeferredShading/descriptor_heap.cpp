@@ -0,0 +1,63 @@
+#include "descriptor_heap.h"
+
+#include <d3d12.h>
+#include <wrl/client.h>
+
+#include <stdexcept>
+#include <string>
+
+#include "d3dx12.h"
+
+#include "dx_utils.h"
+
+using DX::ThrowIfFailed;
+
+DescriptorHeap::DescriptorHeap(D3D12_DESCRIPTOR_HEAP_TYPE type, uint32_t persistent_size,
+                               uint32_t transient_size, bool shader_visible)
+  : type_(type),
+    shader_visible_(shader_visible),
+    allocator_(persistent_size, transient_size) {}
+
+void DescriptorHeap::Create(ID3D12Device* device) {
+  D3D12_DESCRIPTOR_HEAP_DESC heap_desc{};
+  heap_desc.NumDescriptors = allocator_.capacity();
+  heap_desc.Type = type_;
+  heap_desc.Flags = shader_visible_ ? D3D12_DESCRIPTOR_HEAP_FLAG_SHADER_VISIBLE :
+                                      D3D12_DESCRIPTOR_HEAP_FLAG_NONE;
+  ThrowIfFailed(device->CreateDescriptorHeap(&heap_desc, IID_PPV_ARGS(&heap_)));
+
+  descriptor_size_ = device->GetDescriptorHandleIncrementSize(type_);
+}
+
+DescriptorHeap::Table DescriptorHeap::Allocate(uint32_t count) {
+  const uint32_t index = allocator_.Allocate(count);
+  if (index == DescriptorAllocator::kInvalid) {
+    throw std::runtime_error("descriptor_heap: no room for " + std::to_string(count) +
+                             " descriptors, " + std::to_string(allocator_.free_slots()) +
+                             " free in " + std::to_string(allocator_.free_ranges()) + " ranges");
+  }
+  return TableAt(index);
+}
+
+void DescriptorHeap::Free(const Table& table, uint32_t count) {
+  allocator_.Free(table.index, count);
+}
+
+DescriptorHeap::Table DescriptorHeap::AllocateTransient(uint32_t count) {
+  const uint32_t index = allocator_.AllocateTransient(count);
+  if (index == DescriptorAllocator::kInvalid)
+    return Table();
+  return TableAt(index);
+}
+
+DescriptorHeap::Table DescriptorHeap::TableAt(uint32_t index) const {
+  Table table;
+  table.index = index;
+  table.cpu_handle = CD3DX12_CPU_DESCRIPTOR_HANDLE(heap_->GetCPUDescriptorHandleForHeapStart(),
+                                                   index, descriptor_size_);
+  if (shader_visible_) {
+    table.gpu_handle = CD3DX12_GPU_DESCRIPTOR_HANDLE(heap_->GetGPUDescriptorHandleForHeapStart(),
+                                                     index, descriptor_size_);
+  }
+  return table;
+}
\ No newline at end of file
@@ -0,0 +1,54 @@
+#ifndef DESCRIPTOR_HEAP_H_
+#define DESCRIPTOR_HEAP_H_
+
+#include <d3d12.h>
+#include <wrl/client.h>
+
+#include "d3dx12.h"
+
+#include "descriptor_allocator.h"
+
+// A D3D12 descriptor heap whose slots a DescriptorAllocator hands out: persistent tables that live
+// until freed, and, in shader-visible heaps, transient tables that live for one frame.
+class DescriptorHeap {
+public:
+  // A table of contiguous descriptors. The GPU handle is only valid in shader-visible heaps.
+  struct Table {
+    CD3DX12_CPU_DESCRIPTOR_HANDLE cpu_handle;
+    CD3DX12_GPU_DESCRIPTOR_HANDLE gpu_handle;
+    uint32_t index = DescriptorAllocator::kInvalid;
+  };
+
+  DescriptorHeap(D3D12_DESCRIPTOR_HEAP_TYPE type, uint32_t persistent_size,
+                 uint32_t transient_size, bool shader_visible);
+
+  void Create(ID3D12Device* device);
+
+  // |count| persistent descriptors. Throws if the heap has no free range that large.
+  Table Allocate(uint32_t count);
+  void Free(const Table& table, uint32_t count);
+
+  // |count| transient descriptors, or a table with index kInvalid if the ring is full of tables
+  // the GPU may still read. They are valid until the fence value of the next Submit() completes.
+  Table AllocateTransient(uint32_t count);
+
+  void Submit(uint64_t fence_value) { allocator_.Submit(fence_value); }
+  void Retire(uint64_t completed_fence_value) { allocator_.Retire(completed_fence_value); }
+
+  ID3D12DescriptorHeap* heap() const { return heap_.Get(); }
+  UINT descriptor_size() const { return descriptor_size_; }
+  const DescriptorAllocator& allocator() const { return allocator_; }
+
+private:
+  Table TableAt(uint32_t index) const;
+
+  D3D12_DESCRIPTOR_HEAP_TYPE type_;
+  bool shader_visible_;
+
+  Microsoft::WRL::ComPtr<ID3D12DescriptorHeap> heap_;
+  UINT descriptor_size_ = 0;
+
+  DescriptorAllocator allocator_;
+};
+
+#endif  // DESCRIPTOR_HEAP_H_
\ No newline at end of file
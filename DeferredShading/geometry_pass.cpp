@@ -15,14 +15,13 @@ using Microsoft::WRL::ComPtr;
 using DX::ThrowIfFailed;
 
 void GeometryPass::InitPipeline() {
-  CD3DX12_DESCRIPTOR_RANGE1 ranges[2] = {};
-  ranges[0].Init(D3D12_DESCRIPTOR_RANGE_TYPE_CBV, 1, 0, 0);
-  ranges[1].Init(D3D12_DESCRIPTOR_RANGE_TYPE_CBV, 1, 1, 0);
-
-  CD3DX12_ROOT_PARAMETER1 root_params[3] = {};
-  root_params[0].InitAsDescriptorTable(1, &ranges[0], D3D12_SHADER_VISIBILITY_VERTEX);
-  root_params[1].InitAsDescriptorTable(1, &ranges[1], D3D12_SHADER_VISIBILITY_PIXEL);
-  root_params[2].InitAsConstants(1, 2, 0, D3D12_SHADER_VISIBILITY_PIXEL);
+  // The matrices change with the camera, so they are bound straight from the frame's constants.
+  CD3DX12_ROOT_PARAMETER1 root_params[2] = {};
+  root_params[0].InitAsConstantBufferView(
+      0, 0, D3D12_ROOT_DESCRIPTOR_FLAG_DATA_STATIC_WHILE_SET_AT_EXECUTE,
+      D3D12_SHADER_VISIBILITY_VERTEX);
+  // The draw's material index, which the lighting pass looks up in the material table.
+  root_params[1].InitAsConstants(1, 1, 0, D3D12_SHADER_VISIBILITY_PIXEL);
 
   CD3DX12_VERSIONED_ROOT_SIGNATURE_DESC root_signature_desc;
   root_signature_desc.Init_1_1(_countof(root_params), root_params, 0, nullptr,
@@ -64,125 +63,45 @@ void GeometryPass::InitPipeline() {
   pso_desc.DepthStencilState = CD3DX12_DEPTH_STENCIL_DESC(D3D12_DEFAULT);
   pso_desc.SampleMask = UINT_MAX;
   pso_desc.PrimitiveTopologyType = D3D12_PRIMITIVE_TOPOLOGY_TYPE_TRIANGLE;
-  pso_desc.NumRenderTargets = 4;
-  pso_desc.RTVFormats[0] = DXGI_FORMAT_R8G8B8A8_UNORM;
-  pso_desc.RTVFormats[1] = DXGI_FORMAT_R32G32B32A32_FLOAT;
-  pso_desc.RTVFormats[2] = DXGI_FORMAT_R8G8B8A8_UNORM;
-  pso_desc.RTVFormats[3] = DXGI_FORMAT_R32G32B32A32_FLOAT;
+  pso_desc.NumRenderTargets = 2;
+  pso_desc.RTVFormats[0] = DXGI_FORMAT_R16G16_SNORM;
+  pso_desc.RTVFormats[1] = DXGI_FORMAT_R16_UINT;
   pso_desc.DSVFormat = DXGI_FORMAT_D32_FLOAT;
   pso_desc.SampleDesc.Count = 1;
 
   ThrowIfFailed(app_->device_->CreateGraphicsPipelineState(&pso_desc, IID_PPV_ARGS(&pipeline_)));
 }
 
-void GeometryPass::CreateBuffersAndUploadData() {
-  // TODO: Replace the raw matrix count with a variable."
-  // Must be a multiple 256 bytes.
-  matrix_buffer_size_ =
-      (sizeof(DirectX::XMFLOAT4X4) * 2 + (D3D12_CONSTANT_BUFFER_DATA_PLACEMENT_ALIGNMENT - 1)) &
-      ~(D3D12_CONSTANT_BUFFER_DATA_PLACEMENT_ALIGNMENT - 1);
+void GeometryPass::CreateResourceViews() {
+  base_rtv_handle_ = app_->rtv_heap_.Allocate(RtvStatic::kNumDescriptors).cpu_handle;
 
   {
-    CD3DX12_HEAP_PROPERTIES heap_props(D3D12_HEAP_TYPE_UPLOAD);
-    CD3DX12_RESOURCE_DESC resource_desc =
-        CD3DX12_RESOURCE_DESC::Buffer(matrix_buffer_size_);
-
-    ThrowIfFailed(app_->device_->CreateCommittedResource(&heap_props, D3D12_HEAP_FLAG_NONE,
-                                                          &resource_desc,
-                                                          D3D12_RESOURCE_STATE_GENERIC_READ,
-                                                          nullptr, IID_PPV_ARGS(&matrix_buffer_)));
-
-    DirectX::XMFLOAT4X4* buffer_ptr;
-    ThrowIfFailed(matrix_buffer_->Map(0, nullptr, reinterpret_cast<void**>(&buffer_ptr)));
+    CD3DX12_CPU_DESCRIPTOR_HANDLE rtv_handle(base_rtv_handle_,
+                                             RtvStatic::Index::kNormalGbufferTexture,
+                                             app_->rtv_heap_.descriptor_size());
 
-    buffer_ptr[0] = app_->world_view_mat_;
-    buffer_ptr[1] = app_->world_view_proj_mat_;
+    D3D12_RENDER_TARGET_VIEW_DESC rtv_desc{};
+    rtv_desc.Format = DXGI_FORMAT_R16G16_SNORM;
+    rtv_desc.ViewDimension = D3D12_RTV_DIMENSION_TEXTURE2D;
 
-    matrix_buffer_->Unmap(0, nullptr);
+    app_->device_->CreateRenderTargetView(app_->normal_gbuffer_.Get(), &rtv_desc, rtv_handle);
   }
 
-  // Must be a multiple 256 bytes.
-  materials_buffer_size_ =
-      (sizeof(Material) * 16 + (D3D12_CONSTANT_BUFFER_DATA_PLACEMENT_ALIGNMENT - 1)) &
-      ~(D3D12_CONSTANT_BUFFER_DATA_PLACEMENT_ALIGNMENT - 1);
-
   {
-    CD3DX12_HEAP_PROPERTIES heap_props(D3D12_HEAP_TYPE_UPLOAD);
-    CD3DX12_RESOURCE_DESC resource_desc =
-        CD3DX12_RESOURCE_DESC::Buffer(materials_buffer_size_);
-
-    ThrowIfFailed(app_->device_->CreateCommittedResource(&heap_props, D3D12_HEAP_FLAG_NONE,
-                                                          &resource_desc,
-                                                          D3D12_RESOURCE_STATE_GENERIC_READ,
-                                                          nullptr,
-                                                          IID_PPV_ARGS(&materials_buffer_)));
-
-    DirectX::XMFLOAT4X4* buffer_ptr;
-    ThrowIfFailed(materials_buffer_->Map(0, nullptr, reinterpret_cast<void**>(&buffer_ptr)));
+    CD3DX12_CPU_DESCRIPTOR_HANDLE rtv_handle(base_rtv_handle_,
+                                             RtvStatic::Index::kMaterialGbufferTexture,
+                                             app_->rtv_heap_.descriptor_size());
 
-    std::memcpy(buffer_ptr, app_->materials_.data(), app_->materials_.size() * sizeof(Material));
+    D3D12_RENDER_TARGET_VIEW_DESC rtv_desc{};
+    rtv_desc.Format = DXGI_FORMAT_R16_UINT;
+    rtv_desc.ViewDimension = D3D12_RTV_DIMENSION_TEXTURE2D;
 
-    materials_buffer_->Unmap(0, nullptr);
-  }
-}
-
-void GeometryPass::CreateResourceViews() {
-  for (int i = 0; i < kNumFrames; ++i) {
-    CD3DX12_CPU_DESCRIPTOR_HANDLE frame_base_rtv_handle = frames_[i].base_rtv_handle_;
-
-    {
-      CD3DX12_CPU_DESCRIPTOR_HANDLE rtv_handle(frame_base_rtv_handle,
-                                               RtvPerFrame::Index::kAmbientGbufferTexture,
-                                               app_->rtv_descriptor_size_);
-
-      D3D12_RENDER_TARGET_VIEW_DESC rtv_desc{};
-      rtv_desc.Format = DXGI_FORMAT_R8G8B8A8_UNORM;
-      rtv_desc.ViewDimension = D3D12_RTV_DIMENSION_TEXTURE2D;
-
-      app_->device_->CreateRenderTargetView(app_->frames_[i].gbuffer.Get(), &rtv_desc, rtv_handle);
-    }
-
-    {
-      CD3DX12_CPU_DESCRIPTOR_HANDLE rtv_handle(frame_base_rtv_handle,
-                                               RtvPerFrame::Index::kPositionGbufferTexture,
-                                               app_->rtv_descriptor_size_);
-
-      D3D12_RENDER_TARGET_VIEW_DESC rtv_desc{};
-      rtv_desc.Format = DXGI_FORMAT_R32G32B32A32_FLOAT;
-      rtv_desc.ViewDimension = D3D12_RTV_DIMENSION_TEXTURE2D;
-
-      app_->device_->CreateRenderTargetView(app_->frames_[i].pos_gbuffer.Get(), &rtv_desc,
-                                            rtv_handle);
-    }
-
-    {
-      CD3DX12_CPU_DESCRIPTOR_HANDLE rtv_handle(frame_base_rtv_handle,
-                                               RtvPerFrame::Index::kDiffuseGbufferTexture,
-                                               app_->rtv_descriptor_size_);
-
-      D3D12_RENDER_TARGET_VIEW_DESC rtv_desc{};
-      rtv_desc.Format = DXGI_FORMAT_R8G8B8A8_UNORM;
-      rtv_desc.ViewDimension = D3D12_RTV_DIMENSION_TEXTURE2D;
-
-      app_->device_->CreateRenderTargetView(app_->frames_[i].diffuse_gbuffer.Get(), &rtv_desc,
-                                            rtv_handle);
-    }
-
-    {
-      CD3DX12_CPU_DESCRIPTOR_HANDLE rtv_handle(frame_base_rtv_handle,
-                                               RtvPerFrame::Index::kNormalGbufferTexture,
-                                               app_->rtv_descriptor_size_);
-
-      D3D12_RENDER_TARGET_VIEW_DESC rtv_desc{};
-      rtv_desc.Format = DXGI_FORMAT_R32G32B32A32_FLOAT;
-      rtv_desc.ViewDimension = D3D12_RTV_DIMENSION_TEXTURE2D;
-
-      app_->device_->CreateRenderTargetView(app_->frames_[i].normal_gbuffer.Get(), &rtv_desc,
-                                            rtv_handle);
-    }
+    app_->device_->CreateRenderTargetView(app_->material_gbuffer_.Get(), &rtv_desc, rtv_handle);
   }
 
   {
+    dsv_handle_ = app_->dsv_heap_.Allocate(DsvStatic::kNumDescriptors).cpu_handle;
+
     D3D12_DEPTH_STENCIL_VIEW_DESC depth_stencil_desc{};
     depth_stencil_desc.Format = DXGI_FORMAT_D32_FLOAT;
     depth_stencil_desc.ViewDimension = D3D12_DSV_DIMENSION_TEXTURE2D;
@@ -191,86 +110,53 @@ void GeometryPass::CreateResourceViews() {
     app_->device_->CreateDepthStencilView(app_->depth_stencil_.Get(), &depth_stencil_desc,
                                           dsv_handle_);
   }
+}
 
-  {
-    CD3DX12_CPU_DESCRIPTOR_HANDLE cbv_handle(base_cbv_cpu_handle_, CbvStatic::Index::kMatrixBuffer,
-                                             app_->cbv_srv_descriptor_size_);
-
-    D3D12_CONSTANT_BUFFER_VIEW_DESC cbv_desc{};
-    cbv_desc.BufferLocation = matrix_buffer_->GetGPUVirtualAddress();
-    cbv_desc.SizeInBytes = matrix_buffer_size_;
-
-    app_->device_->CreateConstantBufferView(&cbv_desc, cbv_handle);
-  }
-
-  {
-    CD3DX12_CPU_DESCRIPTOR_HANDLE cbv_handle(base_cbv_cpu_handle_,
-                                             CbvStatic::Index::kMaterialsBuffer,
-                                             app_->cbv_srv_descriptor_size_);
-
-    D3D12_CONSTANT_BUFFER_VIEW_DESC cbv_desc{};
-    cbv_desc.BufferLocation = materials_buffer_->GetGPUVirtualAddress();
-    cbv_desc.SizeInBytes = materials_buffer_size_;
+void GeometryPass::AddToRenderGraph(RenderGraph* graph) {
+  const App::GraphResources& resources = app_->graph_resources_;
 
-    app_->device_->CreateConstantBufferView(&cbv_desc, cbv_handle);
-  }
+  RenderGraph::PassId pass =
+      graph->AddPass("geometry", 1, [this](void* command_list, int) {
+        RenderFrame(static_cast<ID3D12GraphicsCommandList*>(command_list));
+      });
+  graph->Write(pass, resources.depth_stencil, D3D12_RESOURCE_STATE_DEPTH_WRITE);
+  graph->Write(pass, resources.normal_gbuffer, D3D12_RESOURCE_STATE_RENDER_TARGET);
+  graph->Write(pass, resources.material_gbuffer, D3D12_RESOURCE_STATE_RENDER_TARGET);
 }
 
 void GeometryPass::RenderFrame(ID3D12GraphicsCommandList* command_list) {
   command_list->SetPipelineState(pipeline_.Get());
   command_list->SetGraphicsRootSignature(root_signature_.Get());
 
-  ID3D12DescriptorHeap* heaps[] = { app_->cbv_srv_heap_.Get() };
-  command_list->SetDescriptorHeaps(_countof(heaps), heaps);
-
-  CD3DX12_GPU_DESCRIPTOR_HANDLE cbv_handle = base_cbv_gpu_handle_;
-
-  command_list->SetGraphicsRootDescriptorTable(0, cbv_handle);
-
-  cbv_handle.Offset(1, app_->cbv_srv_descriptor_size_);
-
-  command_list->SetGraphicsRootDescriptorTable(1, cbv_handle);
+  command_list->SetGraphicsRootConstantBufferView(
+      0, app_->ConstantBlockAddress(App::ConstantBlock::kGeometryMatrices));
 
   command_list->RSSetViewports(1, &app_->viewport_);
   command_list->RSSetScissorRects(1, &app_->scissor_rect_);
 
-  CD3DX12_CPU_DESCRIPTOR_HANDLE frame_base_rtv_handle =
-      frames_[app_->frame_index_].base_rtv_handle_;
-
-  CD3DX12_CPU_DESCRIPTOR_HANDLE ambient_rtv_handle(frame_base_rtv_handle,
-                                                   RtvPerFrame::Index::kAmbientGbufferTexture,
-                                                   app_->rtv_descriptor_size_);
-  CD3DX12_CPU_DESCRIPTOR_HANDLE pos_rtv_handle(frame_base_rtv_handle,
-                                               RtvPerFrame::Index::kPositionGbufferTexture,
-                                               app_->rtv_descriptor_size_);
-  CD3DX12_CPU_DESCRIPTOR_HANDLE diffuse_rtv_handle(frame_base_rtv_handle,
-                                                   RtvPerFrame::Index::kDiffuseGbufferTexture,
-                                                   app_->rtv_descriptor_size_);
-  CD3DX12_CPU_DESCRIPTOR_HANDLE normal_rtv_handle(frame_base_rtv_handle,
-                                                  RtvPerFrame::Index::kNormalGbufferTexture,
-                                                  app_->rtv_descriptor_size_);
+  CD3DX12_CPU_DESCRIPTOR_HANDLE normal_rtv_handle(base_rtv_handle_,
+                                                  RtvStatic::Index::kNormalGbufferTexture,
+                                                  app_->rtv_heap_.descriptor_size());
+  CD3DX12_CPU_DESCRIPTOR_HANDLE material_rtv_handle(base_rtv_handle_,
+                                                    RtvStatic::Index::kMaterialGbufferTexture,
+                                                    app_->rtv_heap_.descriptor_size());
 
   CD3DX12_CPU_DESCRIPTOR_HANDLE rtv_handles[] = {
-    ambient_rtv_handle,
-    pos_rtv_handle,
-    diffuse_rtv_handle,
-    normal_rtv_handle
+    normal_rtv_handle,
+    material_rtv_handle
   };
 
   command_list->OMSetRenderTargets(_countof(rtv_handles), rtv_handles, false, &dsv_handle_);
 
-  const float clear_color[] = {0.f, 0.f, 0.f, 1.f};
-  command_list->ClearRenderTargetView(ambient_rtv_handle, clear_color, 0, nullptr);
-  command_list->ClearRenderTargetView(diffuse_rtv_handle, clear_color, 0, nullptr);
-
-  const float clear_pos[] = {0.f, 0.f, 0.f, 1.f};
-  command_list->ClearRenderTargetView(pos_rtv_handle, clear_pos, 0, nullptr);
-  command_list->ClearRenderTargetView(normal_rtv_handle, clear_pos, 0, nullptr);
+  // The lighting pass tells empty pixels by their depth, so the clear values are never read.
+  const float clear_color[] = {0.f, 0.f, 0.f, 0.f};
+  command_list->ClearRenderTargetView(normal_rtv_handle, clear_color, 0, nullptr);
+  command_list->ClearRenderTargetView(material_rtv_handle, clear_color, 0, nullptr);
 
   command_list->ClearDepthStencilView(dsv_handle_, D3D12_CLEAR_FLAG_DEPTH, 1.f, 0, 0, nullptr);
 
   for (App::DrawCallArgs& args : app_->draw_call_args_) {
-    command_list->SetGraphicsRoot32BitConstant(2, args.material_index, 0);
+    command_list->SetGraphicsRoot32BitConstant(1, args.material_index, 0);
 
     command_list->IASetPrimitiveTopology(args.primitive_type);
 
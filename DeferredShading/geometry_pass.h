@@ -6,8 +6,10 @@
 #include <wrl/client.h>
 
 #include "d3dx12.h"
+#include "DirectXMath.h"
 
 #include "constants.h"
+#include "render_graph.h"
 
 class App;
 
@@ -16,9 +18,11 @@ public:
   GeometryPass(App* app) : app_(app) {}
 
   void InitPipeline();
-  void CreateBuffersAndUploadData();
   void CreateResourceViews();
 
+  // Adds the pass, and the resources it reads and writes, to |graph|.
+  void AddToRenderGraph(RenderGraph* graph);
+
   void RenderFrame(ID3D12GraphicsCommandList* command_list);
 
 private:
@@ -29,17 +33,14 @@ private:
   Microsoft::WRL::ComPtr<ID3D12RootSignature> root_signature_;
   Microsoft::WRL::ComPtr<ID3D12PipelineState> pipeline_;
 
-  Microsoft::WRL::ComPtr<ID3D12Resource> matrix_buffer_;
-  UINT matrix_buffer_size_ = 0;
-
-  Microsoft::WRL::ComPtr<ID3D12Resource> materials_buffer_;
-  UINT materials_buffer_size_ = 0;
+  // Matches Matrices in geometry_pass_vs.hlsl. The app writes it to its frame constants.
+  struct Matrices {
+    DirectX::XMFLOAT4X4 world_view;
+    DirectX::XMFLOAT4X4 world_view_proj;
+  };
 
   CD3DX12_CPU_DESCRIPTOR_HANDLE dsv_handle_;
 
-  CD3DX12_CPU_DESCRIPTOR_HANDLE base_cbv_cpu_handle_;
-  CD3DX12_GPU_DESCRIPTOR_HANDLE base_cbv_gpu_handle_;
-
   struct DsvStatic {
     struct Index {
       static constexpr int kDepthBuffer = 0;
@@ -48,28 +49,15 @@ private:
     static constexpr int kNumDescriptors = Index::kMax + 1;
   };
 
-  struct CbvStatic {
-    struct Index {
-      static constexpr int kMatrixBuffer = 0;
-      static constexpr int kMaterialsBuffer = 1;
-      static constexpr int kMax = kMaterialsBuffer;
-    };
-    static constexpr int kNumDescriptors = Index::kMax + 1;
-  };
-
-  struct Frame {
-    CD3DX12_CPU_DESCRIPTOR_HANDLE base_rtv_handle_;
-  };
-
-  Frame frames_[kNumFrames];
+  // The G-buffer is shared by the frames in flight (see App::InitRenderGraph()), so one set of
+  // views serves them all.
+  CD3DX12_CPU_DESCRIPTOR_HANDLE base_rtv_handle_;
 
-  struct RtvPerFrame {
+  struct RtvStatic {
     struct Index {
-      static constexpr int kAmbientGbufferTexture = 0;
-      static constexpr int kPositionGbufferTexture = 1;
-      static constexpr int kDiffuseGbufferTexture = 2;
-      static constexpr int kNormalGbufferTexture = 3;
-      static constexpr int kMax = kNormalGbufferTexture;
+      static constexpr int kNormalGbufferTexture = 0;
+      static constexpr int kMaterialGbufferTexture = 1;
+      static constexpr int kMax = kMaterialGbufferTexture;
     };
     static constexpr int kNumDescriptors = Index::kMax + 1;
   };
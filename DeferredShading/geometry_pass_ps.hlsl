@@ -1,42 +1,35 @@
-struct Material {
-  float4 ambient_color;
-  float4 diffuse_color;
-};
-
-struct Materials {
-  Material materials[32];
-};
-
-ConstantBuffer<Materials> materials : register(b1);
-
 struct MaterialIndex {
   uint index;
 };
 
-ConstantBuffer<MaterialIndex> material_index : register(b2);
+ConstantBuffer<MaterialIndex> material_index : register(b1);
 
 struct PSInput {
 	float4 position : SV_POSITION;
-	float3 view_pos : POSITION;
   float3 normal : NORMAL;
 };
 
+// The thin G-buffer of gbuffer_encoding.h: the lighting pass reconstructs the position from the
+// depth buffer and looks the colors up by material.
 struct PSOutput {
-  float4 color : SV_TARGET0;
-  float4 position : SV_TARGET1;
-  float4 diffuse : SV_TARGET2;
-  float4 normal : SV_TARGET3;
+  float2 normal : SV_TARGET0;
+  uint material : SV_TARGET1;
 };
 
+// EncodeOctahedralNormal() in gbuffer_encoding.cpp: projects the normal onto the octahedron and
+// folds the lower half over the upper. The R16G16_SNORM target does the rounding.
+float2 EncodeOctahedralNormal(float3 normal) {
+  normal /= abs(normal.x) + abs(normal.y) + abs(normal.z);
+  if (normal.z < 0.f)
+    normal.xy = (1.f - abs(normal.yx)) * (normal.xy >= 0.f ? 1.f : -1.f);
+  return normal.xy;
+}
+
 PSOutput main(PSInput input) {
   PSOutput result;
 
-  Material material = materials.materials[material_index.index];
-
-  result.color = float4((material.ambient_color).rgb, 1.f);
-  result.position = float4(input.view_pos, 1.f);
-  result.diffuse = float4((material.diffuse_color).rgb, 1.f);
-  result.normal = float4(input.normal, 0.f);
+  result.normal = EncodeOctahedralNormal(input.normal);
+  result.material = material_index.index;
 
   return result;
 }
\ No newline at end of file
@@ -15,15 +15,25 @@ using Microsoft::WRL::ComPtr;
 using DX::ThrowIfFailed;
 
 void LightingPass::InitPipeline() {
-  CD3DX12_DESCRIPTOR_RANGE1 ranges[3] = {};
-  ranges[0].Init(D3D12_DESCRIPTOR_RANGE_TYPE_SRV, 5, 0, 0);
-  ranges[1].Init(D3D12_DESCRIPTOR_RANGE_TYPE_CBV, 1, 0, 0);
-  ranges[2].Init(D3D12_DESCRIPTOR_RANGE_TYPE_SAMPLER, 2, 0, 0);
-
-  CD3DX12_ROOT_PARAMETER1 root_params[3] = {};
+  CD3DX12_DESCRIPTOR_RANGE1 ranges[5] = {};
+  ranges[0].Init(D3D12_DESCRIPTOR_RANGE_TYPE_SRV, 4, 0, 0);
+  // The material table.
+  ranges[1].Init(D3D12_DESCRIPTOR_RANGE_TYPE_SRV, 1, 7, 0);
+  ranges[2].Init(D3D12_DESCRIPTOR_RANGE_TYPE_SAMPLER, 1, 0, 0);
+  // The cluster pass's constants and light lists.
+  ranges[3].Init(D3D12_DESCRIPTOR_RANGE_TYPE_CBV, 1, 2, 0);
+  ranges[4].Init(D3D12_DESCRIPTOR_RANGE_TYPE_SRV, 3, 4, 0);
+
+  CD3DX12_ROOT_PARAMETER1 root_params[5] = {};
   root_params[0].InitAsDescriptorTable(1, &ranges[0], D3D12_SHADER_VISIBILITY_PIXEL);
   root_params[1].InitAsDescriptorTable(1, &ranges[1], D3D12_SHADER_VISIBILITY_PIXEL);
   root_params[2].InitAsDescriptorTable(1, &ranges[2], D3D12_SHADER_VISIBILITY_PIXEL);
+  root_params[3].InitAsDescriptorTable(2, &ranges[3], D3D12_SHADER_VISIBILITY_PIXEL);
+  // The lighting constants, which move with the camera and the light, are bound straight from the
+  // frame's constants.
+  root_params[4].InitAsConstantBufferView(
+      0, 0, D3D12_ROOT_DESCRIPTOR_FLAG_DATA_STATIC_WHILE_SET_AT_EXECUTE,
+      D3D12_SHADER_VISIBILITY_PIXEL);
 
   CD3DX12_VERSIONED_ROOT_SIGNATURE_DESC root_signature_desc;
   root_signature_desc.Init_1_1(_countof(root_params), root_params, 0, nullptr,
@@ -73,28 +83,21 @@ void LightingPass::InitPipeline() {
 }
 
 void LightingPass::CreateBuffersAndUploadData() {
-   // Must be a multiple 256 bytes.
-  light_pos_buffer_size_ =
-      (sizeof(DirectX::XMFLOAT4) + (D3D12_CONSTANT_BUFFER_DATA_PLACEMENT_ALIGNMENT - 1)) &
-      ~(D3D12_CONSTANT_BUFFER_DATA_PLACEMENT_ALIGNMENT - 1);
-
   {
-    CD3DX12_HEAP_PROPERTIES heap_props(D3D12_HEAP_TYPE_UPLOAD);
-    CD3DX12_RESOURCE_DESC resource_desc =
-        CD3DX12_RESOURCE_DESC::Buffer(light_pos_buffer_size_);
+    // Sized by the scene, so that any number of materials the G-buffer can index fits.
+    const UINT64 table_size = app_->materials_.size() * sizeof(MaterialTableEntry);
+
+    CD3DX12_HEAP_PROPERTIES heap_props(D3D12_HEAP_TYPE_DEFAULT);
+    CD3DX12_RESOURCE_DESC resource_desc = CD3DX12_RESOURCE_DESC::Buffer(table_size);
 
     ThrowIfFailed(app_->device_->CreateCommittedResource(&heap_props, D3D12_HEAP_FLAG_NONE,
                                                           &resource_desc,
-                                                          D3D12_RESOURCE_STATE_GENERIC_READ,
+                                                          D3D12_RESOURCE_STATE_COPY_DEST,
                                                           nullptr,
-                                                          IID_PPV_ARGS(&light_pos_buffer_)));
-
-    DirectX::XMFLOAT4* buffer_ptr;
-    ThrowIfFailed(light_pos_buffer_->Map(0, nullptr, reinterpret_cast<void**>(&buffer_ptr)));
-
-    *buffer_ptr = app_->light_view_pos_;
+                                                          IID_PPV_ARGS(&material_table_)));
 
-    light_pos_buffer_->Unmap(0, nullptr);
+    app_->UploadDataToBuffer(app_->materials_.data(), table_size, material_table_.Get(),
+                             D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE);
   }
 
   // (x, y) - screen coords, (u,v) - texcoords.
@@ -123,127 +126,109 @@ void LightingPass::CreateBuffersAndUploadData() {
 
 void LightingPass::CreateResourceViews() {
   for (int i = 0; i < kNumFrames; ++i) {
+    frames_[i].base_rtv_handle_ =
+        app_->rtv_heap_.Allocate(RtvPerFrame::kNumDescriptors).cpu_handle;
+
     CD3DX12_CPU_DESCRIPTOR_HANDLE rtv_handle(frames_[i].base_rtv_handle_,
                                              RtvPerFrame::Index::kSwapChainBuffer,
-                                             app_->rtv_descriptor_size_);
+                                             app_->rtv_heap_.descriptor_size());
 
     app_->device_->CreateRenderTargetView(app_->frames_[i].swap_chain_buffer.Get(), nullptr,
                                           rtv_handle);
   }
 
+  srv_staging_table_ = app_->staging_heap_.Allocate(SrvStatic::kNumDescriptors);
 
-  for (int i = 0; i < kNumFrames; ++i) {
-    CD3DX12_CPU_DESCRIPTOR_HANDLE frame_base_srv_cpu_handle = frames_[i].base_srv_cpu_handle_;
-
-    {
-      CD3DX12_CPU_DESCRIPTOR_HANDLE srv_handle(frame_base_srv_cpu_handle,
-                                               SrvPerFrame::Index::kAmbientGbufferTexture,
-                                               app_->cbv_srv_descriptor_size_);
-      D3D12_SHADER_RESOURCE_VIEW_DESC srv_desc{};
-      srv_desc.Format = DXGI_FORMAT_R8G8B8A8_UNORM;
-      srv_desc.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
-      srv_desc.ViewDimension = D3D12_SRV_DIMENSION_TEXTURE2D;
-      srv_desc.Texture2D.MipLevels = 1;
-      srv_desc.Texture2D.MostDetailedMip = 0;
-
-      app_->device_->CreateShaderResourceView(app_->frames_[i].gbuffer.Get(), &srv_desc,
-                                              srv_handle);
-    }
-
-    {
-      CD3DX12_CPU_DESCRIPTOR_HANDLE srv_handle(frame_base_srv_cpu_handle,
-                                               SrvPerFrame::Index::kPositionGbufferTexture,
-                                               app_->cbv_srv_descriptor_size_);
-      D3D12_SHADER_RESOURCE_VIEW_DESC srv_desc{};
-      srv_desc.Format = DXGI_FORMAT_R32G32B32A32_FLOAT;
-      srv_desc.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
-      srv_desc.ViewDimension = D3D12_SRV_DIMENSION_TEXTURE2D;
-      srv_desc.Texture2D.MipLevels = 1;
-      srv_desc.Texture2D.MostDetailedMip = 0;
-
-      app_->device_->CreateShaderResourceView(app_->frames_[i].pos_gbuffer.Get(), &srv_desc,
-                                              srv_handle);
-    }
-
-    {
-      CD3DX12_CPU_DESCRIPTOR_HANDLE srv_handle(frame_base_srv_cpu_handle,
-                                               SrvPerFrame::Index::kDiffuseGbufferTexture,
-                                               app_->cbv_srv_descriptor_size_);
-      D3D12_SHADER_RESOURCE_VIEW_DESC srv_desc{};
-      srv_desc.Format = DXGI_FORMAT_R8G8B8A8_UNORM;
-      srv_desc.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
-      srv_desc.ViewDimension = D3D12_SRV_DIMENSION_TEXTURE2D;
-      srv_desc.Texture2D.MipLevels = 1;
-      srv_desc.Texture2D.MostDetailedMip = 0;
-
-      app_->device_->CreateShaderResourceView(app_->frames_[i].diffuse_gbuffer.Get(), &srv_desc,
-                                              srv_handle);
-    }
-
-    {
-      CD3DX12_CPU_DESCRIPTOR_HANDLE srv_handle(frame_base_srv_cpu_handle,
-                                               SrvPerFrame::Index::kNormalGbufferTexture,
-                                               app_->cbv_srv_descriptor_size_);
-      D3D12_SHADER_RESOURCE_VIEW_DESC srv_desc{};
-      srv_desc.Format = DXGI_FORMAT_R32G32B32A32_FLOAT;
-      srv_desc.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
-      srv_desc.ViewDimension = D3D12_SRV_DIMENSION_TEXTURE2D;
-      srv_desc.Texture2D.MipLevels = 1;
-      srv_desc.Texture2D.MostDetailedMip = 0;
-
-      app_->device_->CreateShaderResourceView(app_->frames_[i].normal_gbuffer.Get(), &srv_desc,
-                                              srv_handle);
-    }
-
-    {
-      CD3DX12_CPU_DESCRIPTOR_HANDLE srv_handle(frame_base_srv_cpu_handle,
-                                               SrvPerFrame::Index::kShadowCubemapTexture,
-                                               app_->cbv_srv_descriptor_size_);
-      D3D12_SHADER_RESOURCE_VIEW_DESC srv_desc{};
-      srv_desc.Format = DXGI_FORMAT_R32_FLOAT;
-      srv_desc.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
-      srv_desc.ViewDimension = D3D12_SRV_DIMENSION_TEXTURECUBE;
-      srv_desc.Texture2D.MipLevels = 1;
-      srv_desc.Texture2D.MostDetailedMip = 0;
-
-      app_->device_->CreateShaderResourceView(app_->frames_[i].shadow_cubemap.Get(), &srv_desc,
-                                              srv_handle);
-    }
+  {
+    CD3DX12_CPU_DESCRIPTOR_HANDLE srv_handle(srv_staging_table_.cpu_handle,
+                                             SrvStatic::Index::kDepthTexture,
+                                             app_->staging_heap_.descriptor_size());
+    D3D12_SHADER_RESOURCE_VIEW_DESC srv_desc{};
+    srv_desc.Format = DXGI_FORMAT_R32_FLOAT;
+    srv_desc.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
+    srv_desc.ViewDimension = D3D12_SRV_DIMENSION_TEXTURE2D;
+    srv_desc.Texture2D.MipLevels = 1;
+    srv_desc.Texture2D.MostDetailedMip = 0;
+
+    app_->device_->CreateShaderResourceView(app_->depth_stencil_.Get(), &srv_desc, srv_handle);
   }
 
-  D3D12_CONSTANT_BUFFER_VIEW_DESC cbv_desc{};
-  cbv_desc.BufferLocation = light_pos_buffer_->GetGPUVirtualAddress();
-  cbv_desc.SizeInBytes = light_pos_buffer_size_;
-
-  app_->device_->CreateConstantBufferView(&cbv_desc, cbv_cpu_handle_);
+  {
+    CD3DX12_CPU_DESCRIPTOR_HANDLE srv_handle(srv_staging_table_.cpu_handle,
+                                             SrvStatic::Index::kNormalGbufferTexture,
+                                             app_->staging_heap_.descriptor_size());
+    D3D12_SHADER_RESOURCE_VIEW_DESC srv_desc{};
+    srv_desc.Format = DXGI_FORMAT_R16G16_SNORM;
+    srv_desc.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
+    srv_desc.ViewDimension = D3D12_SRV_DIMENSION_TEXTURE2D;
+    srv_desc.Texture2D.MipLevels = 1;
+    srv_desc.Texture2D.MostDetailedMip = 0;
+
+    app_->device_->CreateShaderResourceView(app_->normal_gbuffer_.Get(), &srv_desc,
+                                            srv_handle);
+  }
 
   {
-    CD3DX12_CPU_DESCRIPTOR_HANDLE sampler_handle(base_sampler_cpu_handle_,
-                                                 SamplerStatic::Index::kGBufferSampler,
-                                                 app_->cbv_srv_descriptor_size_);
+    CD3DX12_CPU_DESCRIPTOR_HANDLE srv_handle(srv_staging_table_.cpu_handle,
+                                             SrvStatic::Index::kMaterialGbufferTexture,
+                                             app_->staging_heap_.descriptor_size());
+    D3D12_SHADER_RESOURCE_VIEW_DESC srv_desc{};
+    srv_desc.Format = DXGI_FORMAT_R16_UINT;
+    srv_desc.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
+    srv_desc.ViewDimension = D3D12_SRV_DIMENSION_TEXTURE2D;
+    srv_desc.Texture2D.MipLevels = 1;
+    srv_desc.Texture2D.MostDetailedMip = 0;
+
+    app_->device_->CreateShaderResourceView(app_->material_gbuffer_.Get(), &srv_desc,
+                                            srv_handle);
+  }
 
-    D3D12_SAMPLER_DESC sampler_desc{};
-    sampler_desc.Filter = D3D12_FILTER_MIN_MAG_MIP_LINEAR;
-    sampler_desc.AddressU = D3D12_TEXTURE_ADDRESS_MODE_WRAP;
-    sampler_desc.AddressV = D3D12_TEXTURE_ADDRESS_MODE_WRAP;
-    sampler_desc.AddressW = D3D12_TEXTURE_ADDRESS_MODE_WRAP;
-    sampler_desc.MinLOD = 0;
-    sampler_desc.MaxLOD = D3D12_FLOAT32_MAX;
-    sampler_desc.MipLODBias = 0.0f;
-    sampler_desc.MaxAnisotropy = 1;
-    sampler_desc.ComparisonFunc = D3D12_COMPARISON_FUNC_ALWAYS;
-    sampler_desc.BorderColor[0] = 0;
-    sampler_desc.BorderColor[1] = 0;
-    sampler_desc.BorderColor[2] = 0;
-    sampler_desc.BorderColor[3] = 0;
+  {
+    CD3DX12_CPU_DESCRIPTOR_HANDLE srv_handle(srv_staging_table_.cpu_handle,
+                                             SrvStatic::Index::kShadowCubemapTexture,
+                                             app_->staging_heap_.descriptor_size());
+    D3D12_SHADER_RESOURCE_VIEW_DESC srv_desc{};
+    srv_desc.Format = DXGI_FORMAT_R32_FLOAT;
+    srv_desc.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
+    srv_desc.ViewDimension = D3D12_SRV_DIMENSION_TEXTURECUBE;
+    srv_desc.Texture2D.MipLevels = 1;
+    srv_desc.Texture2D.MostDetailedMip = 0;
+
+    app_->device_->CreateShaderResourceView(app_->shadow_cubemap_.Get(), &srv_desc,
+                                            srv_handle);
+  }
 
-    app_->device_->CreateSampler(&sampler_desc, sampler_handle);
+  {
+    DescriptorHeap::Table material_table =
+        app_->cbv_srv_heap_.Allocate(MaterialSrvStatic::kNumDescriptors);
+    base_material_srv_cpu_handle_ = material_table.cpu_handle;
+    base_material_srv_gpu_handle_ = material_table.gpu_handle;
+
+    CD3DX12_CPU_DESCRIPTOR_HANDLE srv_handle(base_material_srv_cpu_handle_,
+                                             MaterialSrvStatic::Index::kMaterialTable,
+                                             app_->cbv_srv_heap_.descriptor_size());
+
+    D3D12_SHADER_RESOURCE_VIEW_DESC srv_desc{};
+    srv_desc.Format = DXGI_FORMAT_UNKNOWN;
+    srv_desc.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
+    srv_desc.ViewDimension = D3D12_SRV_DIMENSION_BUFFER;
+    srv_desc.Buffer.FirstElement = 0;
+    srv_desc.Buffer.NumElements = static_cast<UINT>(app_->materials_.size());
+    srv_desc.Buffer.StructureByteStride = sizeof(MaterialTableEntry);
+    srv_desc.Buffer.Flags = D3D12_BUFFER_SRV_FLAG_NONE;
+
+    app_->device_->CreateShaderResourceView(material_table_.Get(), &srv_desc, srv_handle);
   }
 
   {
+    DescriptorHeap::Table sampler_table =
+        app_->sampler_heap_.Allocate(SamplerStatic::kNumDescriptors);
+    base_sampler_cpu_handle_ = sampler_table.cpu_handle;
+    base_sampler_gpu_handle_ = sampler_table.gpu_handle;
+
     CD3DX12_CPU_DESCRIPTOR_HANDLE sampler_handle(base_sampler_cpu_handle_,
                                                  SamplerStatic::Index::kShadowCubemapSampler,
-                                                 app_->cbv_srv_descriptor_size_);
+                                                 app_->sampler_heap_.descriptor_size());
 
     D3D12_SAMPLER_DESC sampler_desc{};
     sampler_desc.Filter = D3D12_FILTER_MIN_MAG_MIP_LINEAR;
@@ -265,48 +250,52 @@ void LightingPass::CreateResourceViews() {
 }
 
 
-void LightingPass::RenderFrame(ID3D12GraphicsCommandList* command_list) {
-  {
-    CD3DX12_RESOURCE_BARRIER barriers[5] = {};
-
-    barriers[0] = CD3DX12_RESOURCE_BARRIER::Transition(
-        app_->frames_[app_->frame_index_].gbuffer.Get(),
-        D3D12_RESOURCE_STATE_RENDER_TARGET, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE);
-    barriers[1] = CD3DX12_RESOURCE_BARRIER::Transition(
-        app_->frames_[app_->frame_index_].pos_gbuffer.Get(),
-        D3D12_RESOURCE_STATE_RENDER_TARGET, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE);
-    barriers[2] = CD3DX12_RESOURCE_BARRIER::Transition(
-        app_->frames_[app_->frame_index_].diffuse_gbuffer.Get(),
-        D3D12_RESOURCE_STATE_RENDER_TARGET, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE);
-    barriers[3] = CD3DX12_RESOURCE_BARRIER::Transition(
-        app_->frames_[app_->frame_index_].normal_gbuffer.Get(),
-        D3D12_RESOURCE_STATE_RENDER_TARGET, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE);
-    barriers[4] = CD3DX12_RESOURCE_BARRIER::Transition(
-        app_->frames_[app_->frame_index_].shadow_cubemap.Get(),
-        D3D12_RESOURCE_STATE_DEPTH_WRITE, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE);
-
-    command_list->ResourceBarrier(_countof(barriers), barriers);
-  }
+void LightingPass::AddToRenderGraph(RenderGraph* graph) {
+  const App::GraphResources& resources = app_->graph_resources_;
+
+  RenderGraph::PassId pass =
+      graph->AddPass("lighting", 1, [this](void* command_list, int) {
+        RenderFrame(static_cast<ID3D12GraphicsCommandList*>(command_list));
+      });
+  graph->Read(pass, resources.depth_stencil, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE);
+  graph->Read(pass, resources.normal_gbuffer, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE);
+  graph->Read(pass, resources.material_gbuffer, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE);
+  graph->Read(pass, resources.shadow_cubemap, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE);
+  graph->Read(pass, resources.view_lights, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE);
+  graph->Read(pass, resources.light_counts, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE);
+  graph->Read(pass, resources.light_indices, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE);
+  graph->Write(pass, resources.swap_chain_buffer, D3D12_RESOURCE_STATE_RENDER_TARGET);
+}
 
+void LightingPass::RenderFrame(ID3D12GraphicsCommandList* command_list) {
   command_list->SetPipelineState(pipeline_.Get());
 
   command_list->SetGraphicsRootSignature(root_signature_.Get());
 
-  ID3D12DescriptorHeap* heaps[] = { app_->cbv_srv_heap_.Get(), app_->sampler_heap_.Get() };
+  ID3D12DescriptorHeap* heaps[] = { app_->cbv_srv_heap_.heap(), app_->sampler_heap_.heap() };
   command_list->SetDescriptorHeaps(_countof(heaps), heaps);
 
-  CD3DX12_GPU_DESCRIPTOR_HANDLE cbv_gpu_handle = cbv_gpu_handle_;
+  // The G-buffer views are copied into a table of the frame's own, so that recreating the views
+  // never changes a table the GPU may still be reading.
+  DescriptorHeap::Table srv_table =
+      app_->AllocateTransientDescriptors(SrvStatic::kNumDescriptors);
+  app_->device_->CopyDescriptorsSimple(SrvStatic::kNumDescriptors, srv_table.cpu_handle,
+                                       srv_staging_table_.cpu_handle,
+                                       D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
 
-  command_list->SetGraphicsRootDescriptorTable(0, frames_[app_->frame_index_].base_srv_gpu_handle_);
-  command_list->SetGraphicsRootDescriptorTable(1, cbv_gpu_handle);
+  command_list->SetGraphicsRootDescriptorTable(0, srv_table.gpu_handle);
+  command_list->SetGraphicsRootDescriptorTable(1, base_material_srv_gpu_handle_);
   command_list->SetGraphicsRootDescriptorTable(2, base_sampler_gpu_handle_);
+  command_list->SetGraphicsRootDescriptorTable(3, app_->cluster_pass_.light_lists_gpu_handle());
+  command_list->SetGraphicsRootConstantBufferView(
+      4, app_->ConstantBlockAddress(App::ConstantBlock::kLightingConstants));
 
   command_list->RSSetViewports(1, &app_->viewport_);
   command_list->RSSetScissorRects(1, &app_->scissor_rect_);
 
   CD3DX12_CPU_DESCRIPTOR_HANDLE swap_chain_rtv_handle(frames_[app_->frame_index_].base_rtv_handle_,
                                                       RtvPerFrame::Index::kSwapChainBuffer,
-                                                      app_->rtv_descriptor_size_);
+                                                      app_->rtv_heap_.descriptor_size());
 
   CD3DX12_CPU_DESCRIPTOR_HANDLE rtv_handles[] = { swap_chain_rtv_handle };
 
@@ -320,26 +309,4 @@ void LightingPass::RenderFrame(ID3D12GraphicsCommandList* command_list) {
   command_list->IASetVertexBuffers(0, 1, &vertex_buffer_view_);
 
   command_list->DrawInstanced(4, 1, 0, 0);
-
-  {
-    CD3DX12_RESOURCE_BARRIER barriers[5] = {};
-
-    barriers[0] = CD3DX12_RESOURCE_BARRIER::Transition(
-        app_->frames_[app_->frame_index_].gbuffer.Get(),
-        D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE, D3D12_RESOURCE_STATE_RENDER_TARGET);
-    barriers[1] = CD3DX12_RESOURCE_BARRIER::Transition(
-        app_->frames_[app_->frame_index_].pos_gbuffer.Get(),
-        D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE, D3D12_RESOURCE_STATE_RENDER_TARGET);
-    barriers[2] = CD3DX12_RESOURCE_BARRIER::Transition(
-        app_->frames_[app_->frame_index_].diffuse_gbuffer.Get(),
-        D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE, D3D12_RESOURCE_STATE_RENDER_TARGET);
-    barriers[3] = CD3DX12_RESOURCE_BARRIER::Transition(
-        app_->frames_[app_->frame_index_].normal_gbuffer.Get(),
-        D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE, D3D12_RESOURCE_STATE_RENDER_TARGET);
-    barriers[4] = CD3DX12_RESOURCE_BARRIER::Transition(
-        app_->frames_[app_->frame_index_].shadow_cubemap.Get(),
-        D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE, D3D12_RESOURCE_STATE_DEPTH_WRITE);
-
-    command_list->ResourceBarrier(_countof(barriers), barriers);
-  }
 }
\ No newline at end of file
@@ -6,8 +6,12 @@
 #include <wrl/client.h>
 
 #include "d3dx12.h"
+#include "DirectXMath.h"
 
 #include "constants.h"
+#include "descriptor_heap.h"
+#include "render_graph.h"
+#include "gbuffer_encoding.h"
 
 class App;
 
@@ -19,6 +23,9 @@ public:
   void CreateBuffersAndUploadData();
   void CreateResourceViews();
 
+  // Adds the pass, and the resources it reads and writes, to |graph|.
+  void AddToRenderGraph(RenderGraph* graph);
+
   void RenderFrame(ID3D12GraphicsCommandList* command_list);
 
 private:
@@ -29,27 +36,33 @@ private:
   Microsoft::WRL::ComPtr<ID3D12RootSignature> root_signature_;
   Microsoft::WRL::ComPtr<ID3D12PipelineState> pipeline_;
 
-  Microsoft::WRL::ComPtr<ID3D12Resource> light_pos_buffer_;
-  UINT light_pos_buffer_size_ = 0;
+  // Matches LightingConstants in lighting_pass_ps.hlsl. The app writes it to its frame constants.
+  struct LightingConstants {
+    DirectX::XMFLOAT4 light_view_pos;
+    ViewReconstruction view_reconstruction;
+  };
+
+  // The thin G-buffer stores only material indices, so the colors are looked up here: the app's
+  // material table, one MaterialTableEntry per material, read as a structured buffer.
+  Microsoft::WRL::ComPtr<ID3D12Resource> material_table_;
 
-  CD3DX12_CPU_DESCRIPTOR_HANDLE cbv_cpu_handle_;
-  CD3DX12_GPU_DESCRIPTOR_HANDLE cbv_gpu_handle_;
+  CD3DX12_CPU_DESCRIPTOR_HANDLE base_material_srv_cpu_handle_;
+  CD3DX12_GPU_DESCRIPTOR_HANDLE base_material_srv_gpu_handle_;
 
   CD3DX12_CPU_DESCRIPTOR_HANDLE base_sampler_cpu_handle_;
   CD3DX12_GPU_DESCRIPTOR_HANDLE base_sampler_gpu_handle_;
 
-  struct CbvStatic {
+  struct MaterialSrvStatic {
     struct Index {
-      static constexpr int kLightPosBuffer = 0;
-      static constexpr int kMax = kLightPosBuffer;
+      static constexpr int kMaterialTable = 0;
+      static constexpr int kMax = kMaterialTable;
     };
     static constexpr int kNumDescriptors = Index::kMax + 1;
   };
 
   struct SamplerStatic {
     struct Index {
-      static constexpr int kGBufferSampler = 0;
-      static constexpr int kShadowCubemapSampler = 1;
+      static constexpr int kShadowCubemapSampler = 0;
       static constexpr int kMax = kShadowCubemapSampler;
     };
     static constexpr int kNumDescriptors = Index::kMax + 1;
@@ -57,9 +70,6 @@ private:
 
   struct Frame {
     CD3DX12_CPU_DESCRIPTOR_HANDLE base_rtv_handle_;
-
-    CD3DX12_CPU_DESCRIPTOR_HANDLE base_srv_cpu_handle_;
-    CD3DX12_GPU_DESCRIPTOR_HANDLE base_srv_gpu_handle_;
   };
 
   Frame frames_[kNumFrames];
@@ -72,13 +82,15 @@ private:
     static constexpr int kNumDescriptors = Index::kMax + 1;
   };
 
-  struct SrvPerFrame {
+  // The SRVs live in the app's staging heap and are copied into a transient table each frame.
+  DescriptorHeap::Table srv_staging_table_;
+
+  struct SrvStatic {
     struct Index {
-      static constexpr int kAmbientGbufferTexture = 0;
-      static constexpr int kPositionGbufferTexture = 1;
-      static constexpr int kDiffuseGbufferTexture = 2;
-      static constexpr int kNormalGbufferTexture = 3;
-      static constexpr int kShadowCubemapTexture = 4;
+      static constexpr int kDepthTexture = 0;
+      static constexpr int kNormalGbufferTexture = 1;
+      static constexpr int kMaterialGbufferTexture = 2;
+      static constexpr int kShadowCubemapTexture = 3;
       static constexpr int kMax = kShadowCubemapTexture;
     };
     static constexpr int kNumDescriptors = Index::kMax + 1;
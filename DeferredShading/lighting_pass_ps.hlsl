@@ -1,34 +1,132 @@
+#include "../Utils/material_table.hlsli"
+
 struct PSInput {
   float4 position : SV_POSITION;
   float2 texcoord : TEXCOORD;
 };
 
-Texture2D gbuf_tex : register(t0);
-Texture2D pos_gbuf_tex : register(t1);
-Texture2D diffuse_gbuf_tex : register(t2);
-Texture2D normal_gbuf_tex : register(t3);
+// The thin G-buffer of gbuffer_encoding.h.
+Texture2D<float> depth_tex : register(t0);
+Texture2D<float2> normal_gbuf_tex : register(t1);
+Texture2D<uint> material_gbuf_tex : register(t2);
+
+TextureCube shadow_cubemap_tex : register(t3);
 
-TextureCube shadow_cubemap_tex : register(t4);
+struct ViewReconstruction {
+  float inv_proj_x;
+  float inv_proj_y;
+  float depth_scale;
+  float depth_offset;
+};
 
-struct Light {
-  float4 view_pos;
+struct LightingConstants {
+  float4 light_view_pos;
+  ViewReconstruction reconstruction;
 };
 
-ConstantBuffer<Light> light : register(b0);
+ConstantBuffer<LightingConstants> constants : register(b0);
+
+// Indexed by the material G-buffer, with an entry per scene material.
+StructuredBuffer<MaterialTableEntry> material_table : register(t7);
 
-SamplerState gbuf_sampler : register(s0);
-SamplerState shadow_cubemap_sampler : register(s1);
+// The point lights and the cluster lists cluster_build_cs.hlsl builds for them. The grid repeats
+// light_clusters.h.
+
+#define GRID_X 16
+#define GRID_Y 9
+#define GRID_Z 24
+#define MAX_LIGHTS_PER_CLUSTER 256
+
+// Moved into the frame's view by cluster_build_cs.hlsl.
+struct PointLight {
+  float3 view_pos;
+  float radius;
+  float3 color;
+  float padding;
+};
+
+struct ClusterConstants {
+  float tan_half_fov_x;
+  float tan_half_fov_y;
+  float tile_width;
+  float tile_height;
+  float slice_scale;
+  float slice_bias;
+  uint num_lights;
+  uint padding;
+};
+
+ConstantBuffer<ClusterConstants> clusters : register(b2);
+
+StructuredBuffer<PointLight> point_lights : register(t4);
+StructuredBuffer<uint> light_counts : register(t5);
+StructuredBuffer<uint> light_indices : register(t6);
+
+SamplerState shadow_cubemap_sampler : register(s0);
+
+// DecodeOctahedralNormal() in gbuffer_encoding.cpp.
+float3 DecodeOctahedralNormal(float2 encoded) {
+  float3 normal = float3(encoded, 1.f - abs(encoded.x) - abs(encoded.y));
+  if (normal.z < 0.f)
+    normal.xy += (normal.xy >= 0.f ? normal.z : -normal.z);
+  return normalize(normal);
+}
+
+// ReconstructViewPosition() in gbuffer_encoding.cpp.
+float3 ReconstructViewPosition(float2 texcoord, float depth) {
+  ViewReconstruction reconstruction = constants.reconstruction;
+  float2 ndc = float2(texcoord.x * 2.f - 1.f, 1.f - texcoord.y * 2.f);
+  float view_z = reconstruction.depth_offset / (reconstruction.depth_scale - depth);
+  return float3(ndc * float2(reconstruction.inv_proj_x, reconstruction.inv_proj_y) * view_z,
+                view_z);
+}
+
+uint ClusterOfPixel(float2 pixel_pos, float view_z) {
+  uint2 tile = min(uint2(pixel_pos / float2(clusters.tile_width, clusters.tile_height)),
+                   uint2(GRID_X - 1, GRID_Y - 1));
+  float slice = view_z > 0.f ? floor(log(view_z) * clusters.slice_scale + clusters.slice_bias)
+                             : 0.f;
+  uint z = (uint)clamp(slice, 0.f, GRID_Z - 1.f);
+  return (z * GRID_Y + tile.y) * GRID_X + tile.x;
+}
+
+// Diffuse light from the point lights listed in the pixel's cluster. Each falls off as
+// (1 - d^2 / r^2)^2 to zero at its radius.
+float3 PointLighting(float2 pixel_pos, float3 view_pos, float3 normal) {
+  uint cluster = ClusterOfPixel(pixel_pos, view_pos.z);
+  uint count = light_counts[cluster];
+
+  float3 result = float3(0.f, 0.f, 0.f);
+  for (uint i = 0; i < count; ++i) {
+    PointLight point_light = point_lights[light_indices[cluster * MAX_LIGHTS_PER_CLUSTER + i]];
+
+    float3 to_light = point_light.view_pos - view_pos;
+    float distance_squared = dot(to_light, to_light);
+    float falloff = saturate(1.f - distance_squared / (point_light.radius * point_light.radius));
+    float coeff = saturate(dot(normal, to_light * rsqrt(distance_squared)));
+    result += point_light.color * (coeff * falloff * falloff);
+  }
+  return result;
+}
 
 float4 main(PSInput input) : SV_TARGET {
-  float3 view_pos = pos_gbuf_tex.Sample(gbuf_sampler, input.texcoord).xyz;
-   float3 light_vec = light.view_pos.xyz - view_pos;
+  int3 texel = int3(input.position.xy, 0);
 
-   float3 normal = normalize(normal_gbuf_tex.Sample(gbuf_sampler, input.texcoord).xyz);
+  // Nothing was drawn where the depth buffer still holds its clear value.
+  float view_depth = depth_tex.Load(texel);
+  if (view_depth == 1.f)
+    return float4(0.f, 0.f, 0.f, 1.f);
+
+  float3 view_pos = ReconstructViewPosition(input.texcoord, view_depth);
+  float3 light_vec = constants.light_view_pos.xyz - view_pos;
+
+  float3 normal = DecodeOctahedralNormal(normal_gbuf_tex.Load(texel));
 
   float diffuse_coeff = clamp(dot(normalize(light_vec), normal), 0.f, 1.f);
 
-  float3 ambient_color = gbuf_tex.Sample(gbuf_sampler, input.texcoord).rgb;
-  float3 diffuse_color = diffuse_gbuf_tex.Sample(gbuf_sampler, input.texcoord).rgb;
+  MaterialTableEntry material = material_table[material_gbuf_tex.Load(texel)];
+  float3 ambient_color = material.ambient_color.rgb;
+  float3 diffuse_color = material.diffuse_color.rgb;
 
   float near = 0.05f;
   float far = 10.f;
@@ -42,11 +140,14 @@ float4 main(PSInput input) : SV_TARGET {
   float depth_bias = (1.f - depth) * (0.1f + (1.f - max_component) * 0.1f);
   depth = clamp(depth - depth_bias, 0.f, 1.f);
 
-  float3 cubemap_coord = normalize(view_pos - light.view_pos.xyz);
+  float3 cubemap_coord = normalize(view_pos - constants.light_view_pos.xyz);
 
   float shadow_tex_depth = shadow_cubemap_tex.Sample(shadow_cubemap_sampler, cubemap_coord).r;
 
   float illuminated = clamp(sign(shadow_tex_depth - depth), 0.f, 1.f);
 
-	return float4(0.3f * ambient_color + illuminated * diffuse_coeff * diffuse_color, 1.f);
+  float3 point_light = PointLighting(input.position.xy, view_pos, normal);
+
+  return float4(0.3f * ambient_color + (illuminated * diffuse_coeff + point_light) * diffuse_color,
+                1.f);
 }
\ No newline at end of file
@@ -42,6 +42,10 @@ int WINAPI WinMain(HINSTANCE hinstance, HINSTANCE prev_hinstance, LPSTR cmd_line
   MSG msg = {};
   while (msg.message != WM_QUIT) {
     if (PeekMessage(&msg, nullptr, 0, 0, PM_REMOVE)) {
+      // S switches the shadow pass between one instanced pass and one pass per face.
+      if (msg.message == WM_KEYDOWN && msg.wParam == 'S')
+        app.SetSinglePassShadows(!app.single_pass_shadows());
+
       TranslateMessage(&msg);
       DispatchMessage(&msg);
     }
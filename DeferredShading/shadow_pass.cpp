@@ -8,7 +8,9 @@
 #include "DirectXMath.h"
 
 #include "dx_utils.h"
+#include "profiling.h"
 #include "ReadData.h"
+#include "shadow_faces.h"
 
 #include "app.h"
 
@@ -22,11 +24,12 @@ ShadowPass::ShadowPass(App* app)
     scissor_rect_(0, 0, kShadowBufferWidth, kShadowBufferHeight) {}
 
 void ShadowPass::InitPipeline() {
-  CD3DX12_DESCRIPTOR_RANGE1 range;
-  range.Init(D3D12_DESCRIPTOR_RANGE_TYPE_CBV, 1, 0, 0);
-
+  // The matrices follow the camera and the light, so they are bound straight from the frame's
+  // constants.
   CD3DX12_ROOT_PARAMETER1 root_params[2] = {};
-  root_params[0].InitAsDescriptorTable(1, &range, D3D12_SHADER_VISIBILITY_VERTEX);
+  root_params[0].InitAsConstantBufferView(
+      0, 0, D3D12_ROOT_DESCRIPTOR_FLAG_DATA_STATIC_WHILE_SET_AT_EXECUTE,
+      D3D12_SHADER_VISIBILITY_VERTEX);
   root_params[1].InitAsConstants(1, 1, 0, D3D12_SHADER_VISIBILITY_VERTEX);
 
   CD3DX12_VERSIONED_ROOT_SIGNATURE_DESC root_signature_desc;
@@ -69,93 +72,188 @@ void ShadowPass::InitPipeline() {
   pso_desc.SampleDesc.Count = 1;
 
   ThrowIfFailed(app_->device_->CreateGraphicsPipelineState(&pso_desc, IID_PPV_ARGS(&pipeline_)));
-}
-
-void ShadowPass::CreateBuffersAndUploadData() {
-  // Must be a multiple 256 bytes.
-  matrix_buffer_size_ =
-      (sizeof(DirectX::XMFLOAT4X4) * 7 + (D3D12_CONSTANT_BUFFER_DATA_PLACEMENT_ALIGNMENT - 1)) &
-      ~(D3D12_CONSTANT_BUFFER_DATA_PLACEMENT_ALIGNMENT - 1);
-
-  CD3DX12_HEAP_PROPERTIES heap_props(D3D12_HEAP_TYPE_UPLOAD);
-  CD3DX12_RESOURCE_DESC resource_desc =
-      CD3DX12_RESOURCE_DESC::Buffer(matrix_buffer_size_);
 
-  ThrowIfFailed(app_->device_->CreateCommittedResource(&heap_props, D3D12_HEAP_FLAG_NONE,
-                                                        &resource_desc,
-                                                        D3D12_RESOURCE_STATE_GENERIC_READ,
-                                                        nullptr, IID_PPV_ARGS(&matrix_buffer_)));
+  // The same root signature serves both: root constant b1 holds the face for RenderFace() and the
+  // draw's packed faces for RenderFrame().
+  std::vector<uint8_t> single_pass_shader_data = DX::ReadData(L"shadow_pass_single_vs.cso");
+  pso_desc.VS = { single_pass_shader_data.data(), single_pass_shader_data.size() };
 
-  DirectX::XMFLOAT4X4* buffer_ptr;
-  ThrowIfFailed(matrix_buffer_->Map(0, nullptr, reinterpret_cast<void**>(&buffer_ptr)));
+  ThrowIfFailed(app_->device_->CreateGraphicsPipelineState(
+      &pso_desc, IID_PPV_ARGS(&single_pass_pipeline_)));
 
-  buffer_ptr[0] = app_->world_view_mat_;
-  memcpy(&buffer_ptr[1], app_->shadow_mats_, sizeof(DirectX::XMFLOAT4X4) * 6);
-
-  matrix_buffer_->Unmap(0, nullptr);
+  // Devices without it still take the shader, with the runtime inserting a geometry shader.
+  D3D12_FEATURE_DATA_D3D12_OPTIONS options{};
+  if (SUCCEEDED(app_->device_->CheckFeatureSupport(D3D12_FEATURE_D3D12_OPTIONS, &options,
+                                                   sizeof(options)))) {
+    array_index_without_gs_ =
+        options.VPAndRTArrayIndexFromAnyShaderFeedingRasterizerSupportedWithoutGSEmulation;
+  }
 }
 
 void ShadowPass::CreateResourceViews() {
-  for (int i = 0; i < kNumFrames; ++i) {
-    for (int j = 0; j < 6; ++j) {
-      D3D12_DEPTH_STENCIL_VIEW_DESC depth_stencil_desc{};
-      depth_stencil_desc.Format = DXGI_FORMAT_D32_FLOAT;
-      depth_stencil_desc.ViewDimension = D3D12_DSV_DIMENSION_TEXTURE2DARRAY;
-      depth_stencil_desc.Flags = D3D12_DSV_FLAG_NONE;
-      depth_stencil_desc.Texture2DArray.FirstArraySlice = j;
-      depth_stencil_desc.Texture2DArray.ArraySize = 1;
-
-      CD3DX12_CPU_DESCRIPTOR_HANDLE dsv_handle(frames_[i].base_dsv_handle,
-                                               DsvPerFrame::Index::kDepthCubemapBase + j,
-                                               app_->dsv_descriptor_size_);
-
-      app_->device_->CreateDepthStencilView(app_->frames_[i].shadow_cubemap.Get(),
-                                            &depth_stencil_desc, dsv_handle);
-    }
+  base_dsv_handle_ = app_->dsv_heap_.Allocate(DsvStatic::kNumDescriptors).cpu_handle;
+
+  for (int j = 0; j < 6; ++j) {
+    D3D12_DEPTH_STENCIL_VIEW_DESC depth_stencil_desc{};
+    depth_stencil_desc.Format = DXGI_FORMAT_D32_FLOAT;
+    depth_stencil_desc.ViewDimension = D3D12_DSV_DIMENSION_TEXTURE2DARRAY;
+    depth_stencil_desc.Flags = D3D12_DSV_FLAG_NONE;
+    depth_stencil_desc.Texture2DArray.FirstArraySlice = j;
+    depth_stencil_desc.Texture2DArray.ArraySize = 1;
+
+    CD3DX12_CPU_DESCRIPTOR_HANDLE dsv_handle(base_dsv_handle_,
+                                             DsvStatic::Index::kDepthCubemapBase + j,
+                                             app_->dsv_heap_.descriptor_size());
+
+    app_->device_->CreateDepthStencilView(app_->shadow_cubemap_.Get(), &depth_stencil_desc,
+                                          dsv_handle);
   }
 
-  {
-    CD3DX12_CPU_DESCRIPTOR_HANDLE cbv_handle(cbv_cpu_handle_, CbvStatic::Index::kMatrixBuffer,
-                                             app_->cbv_srv_descriptor_size_);
+  // All six faces, for RenderFrame().
+  D3D12_DEPTH_STENCIL_VIEW_DESC depth_stencil_desc{};
+  depth_stencil_desc.Format = DXGI_FORMAT_D32_FLOAT;
+  depth_stencil_desc.ViewDimension = D3D12_DSV_DIMENSION_TEXTURE2DARRAY;
+  depth_stencil_desc.Flags = D3D12_DSV_FLAG_NONE;
+  depth_stencil_desc.Texture2DArray.FirstArraySlice = 0;
+  depth_stencil_desc.Texture2DArray.ArraySize = kNumFaces;
+
+  CD3DX12_CPU_DESCRIPTOR_HANDLE dsv_handle(base_dsv_handle_,
+                                           DsvStatic::Index::kDepthCubemapAllFaces,
+                                           app_->dsv_heap_.descriptor_size());
 
-    D3D12_CONSTANT_BUFFER_VIEW_DESC cbv_desc{};
-    cbv_desc.BufferLocation = matrix_buffer_->GetGPUVirtualAddress();
-    cbv_desc.SizeInBytes = matrix_buffer_size_;
+  app_->device_->CreateDepthStencilView(app_->shadow_cubemap_.Get(), &depth_stencil_desc,
+                                        dsv_handle);
+}
+
+void ShadowPass::AddToRenderGraph(RenderGraph* graph) {
+  const App::GraphResources& resources = app_->graph_resources_;
+
+  // One part per face in both modes, so that the compiled graph and its command lists stay the
+  // same when the mode changes. In single-pass mode the first part draws every face and the others
+  // record nothing.
+  RenderGraph::PassId pass =
+      graph->AddPass("shadow", kNumFaces, [this](void* command_list, int face) {
+        if (!single_pass_)
+          RenderFace(static_cast<ID3D12GraphicsCommandList*>(command_list), face);
+        else if (face == 0)
+          RenderFrame(static_cast<ID3D12GraphicsCommandList*>(command_list));
+      });
+  graph->Write(pass, resources.shadow_cubemap, D3D12_RESOURCE_STATE_DEPTH_WRITE);
+}
 
-    app_->device_->CreateConstantBufferView(&cbv_desc, cbv_handle);
+void ShadowPass::CullDraws(const DirectX::XMMATRIX (&world_to_face)[kNumFaces]) {
+  const std::vector<App::DrawCallArgs>& draws = app_->draw_call_args_;
+  face_masks_.resize(draws.size());
+  packed_faces_.resize(draws.size());
+
+  for (size_t i = 0; i < draws.size(); ++i) {
+    const DirectX::XMFLOAT3& bounds_min = draws[i].bounds_min;
+    const DirectX::XMFLOAT3& bounds_max = draws[i].bounds_max;
+
+    uint32_t mask = 0;
+    for (int face = 0; face < kNumFaces; ++face) {
+      float corners[8][4];
+      for (int corner = 0; corner < 8; ++corner) {
+        DirectX::XMVECTOR position = DirectX::XMVectorSet(
+            corner & 1 ? bounds_max.x : bounds_min.x, corner & 2 ? bounds_max.y : bounds_min.y,
+            corner & 4 ? bounds_max.z : bounds_min.z, 1.f);
+        DirectX::XMStoreFloat4(reinterpret_cast<DirectX::XMFLOAT4*>(corners[corner]),
+                               DirectX::XMVector4Transform(position, world_to_face[face]));
+      }
+      if (BoxInFrustum(corners))
+        mask |= 1u << face;
+    }
+    face_masks_[i] = mask;
+    packed_faces_[i] = PackShadowFaces(mask);
   }
 }
 
-void ShadowPass::RenderFrame(ID3D12GraphicsCommandList* command_list) {
-  command_list->SetPipelineState(pipeline_.Get());
+void ShadowPass::SetCommonState(ID3D12GraphicsCommandList* command_list,
+                                ID3D12PipelineState* pipeline) {
+  command_list->SetPipelineState(pipeline);
   command_list->SetGraphicsRootSignature(root_signature_.Get());
 
   command_list->RSSetViewports(1, &viewport_);
   command_list->RSSetScissorRects(1, &scissor_rect_);
 
-  ID3D12DescriptorHeap* heaps[] = { app_->cbv_srv_heap_.Get() };
-  command_list->SetDescriptorHeaps(_countof(heaps), heaps);
+  command_list->SetGraphicsRootConstantBufferView(
+      0, app_->ConstantBlockAddress(App::ConstantBlock::kShadowMatrices));
+}
 
-  command_list->SetGraphicsRootDescriptorTable(0, cbv_gpu_handle_);
+// One clear and one instanced draw per draw that reaches any face. Root constant b1 changes per
+// draw instead of per face.
+void ShadowPass::RenderFrame(ID3D12GraphicsCommandList* command_list) {
+  Stopwatch stopwatch;
+  RecordStats& stats = single_pass_stats_;
 
-  for (int i = 0; i < 6; ++i) {
-    command_list->SetGraphicsRoot32BitConstant(1, i, 0);
+  SetCommonState(command_list, single_pass_pipeline_.Get());
 
-    CD3DX12_CPU_DESCRIPTOR_HANDLE dsv_handle(frames_[app_->frame_index_].base_dsv_handle, i,
-                                             app_->dsv_descriptor_size_);
+  CD3DX12_CPU_DESCRIPTOR_HANDLE dsv_handle(base_dsv_handle_,
+                                           DsvStatic::Index::kDepthCubemapAllFaces,
+                                           app_->dsv_heap_.descriptor_size());
 
-    command_list->OMSetRenderTargets(0, nullptr, false, &dsv_handle);
+  command_list->OMSetRenderTargets(0, nullptr, false, &dsv_handle);
 
-    command_list->ClearDepthStencilView(dsv_handle, D3D12_CLEAR_FLAG_DEPTH, 1.f, 0, 0, nullptr);
+  command_list->ClearDepthStencilView(dsv_handle, D3D12_CLEAR_FLAG_DEPTH, 1.f, 0, 0, nullptr);
 
-    for (App::DrawCallArgs& args : app_->draw_call_args_) {
-      command_list->IASetPrimitiveTopology(args.primitive_type);
+  const std::vector<App::DrawCallArgs>& draws = app_->draw_call_args_;
+  for (size_t i = 0; i < draws.size(); ++i) {
+    const int num_faces = CountShadowFaces(face_masks_[i]);
+    if (num_faces == 0)
+      continue;
 
-      command_list->IASetVertexBuffers(0, 1, &args.vertex_buffer_view);
-      command_list->IASetIndexBuffer(&args.index_buffer_view);
+    const App::DrawCallArgs& args = draws[i];
+    command_list->IASetPrimitiveTopology(args.primitive_type);
 
-      command_list->DrawIndexedInstanced(args.index_count, 1, args.start_index, args.vertex_offset,
-                                         0);
-    }
+    command_list->IASetVertexBuffers(0, 1, &args.vertex_buffer_view);
+    command_list->IASetIndexBuffer(&args.index_buffer_view);
+
+    command_list->SetGraphicsRoot32BitConstant(1, packed_faces_[i], 0);
+
+    command_list->DrawIndexedInstanced(args.index_count, num_faces, args.start_index,
+                                       args.vertex_offset, 0);
+    ++stats.draws;
+    stats.instances += num_faces;
+  }
+
+  ++stats.recordings;
+  stats.seconds += stopwatch.ElapsedSeconds();
+}
+
+// Each face's command list starts without any state, so each sets everything it uses. The draws
+// are culled with the same masks as RenderFrame()'s, so that both modes draw the same work.
+void ShadowPass::RenderFace(ID3D12GraphicsCommandList* command_list, int face) {
+  Stopwatch stopwatch;
+  RecordStats& stats = face_stats_[face];
+
+  SetCommonState(command_list, pipeline_.Get());
+
+  command_list->SetGraphicsRoot32BitConstant(1, face, 0);
+
+  CD3DX12_CPU_DESCRIPTOR_HANDLE dsv_handle(base_dsv_handle_, face,
+                                           app_->dsv_heap_.descriptor_size());
+
+  command_list->OMSetRenderTargets(0, nullptr, false, &dsv_handle);
+
+  command_list->ClearDepthStencilView(dsv_handle, D3D12_CLEAR_FLAG_DEPTH, 1.f, 0, 0, nullptr);
+
+  const std::vector<App::DrawCallArgs>& draws = app_->draw_call_args_;
+  for (size_t i = 0; i < draws.size(); ++i) {
+    if ((face_masks_[i] & (1u << face)) == 0)
+      continue;
+
+    const App::DrawCallArgs& args = draws[i];
+    command_list->IASetPrimitiveTopology(args.primitive_type);
+
+    command_list->IASetVertexBuffers(0, 1, &args.vertex_buffer_view);
+    command_list->IASetIndexBuffer(&args.index_buffer_view);
+
+    command_list->DrawIndexedInstanced(args.index_count, 1, args.start_index, args.vertex_offset,
+                                       0);
+    ++stats.draws;
+    ++stats.instances;
   }
+
+  ++stats.recordings;
+  stats.seconds += stopwatch.ElapsedSeconds();
 }
\ No newline at end of file
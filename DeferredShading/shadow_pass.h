@@ -5,10 +5,14 @@
 #include <dxgi1_6.h>
 #include <wrl/client.h>
 
+#include <cstdint>
+#include <vector>
+
 #include "d3dx12.h"
 #include "DirectXMath.h"
 
 #include "constants.h"
+#include "render_graph.h"
 
 class App;
 
@@ -17,46 +21,86 @@ public:
   ShadowPass(App* app);
 
   void InitPipeline();
-  void CreateBuffersAndUploadData();
   void CreateResourceViews();
 
+  // The cubemap faces, and the parts of the pass. In per-face mode each part records its face
+  // into a command list of its own, in parallel.
+  static constexpr int kNumFaces = 6;
+
+  // Whether RenderFrame() draws every face at once rather than RenderFace() each. Only changed
+  // between frames.
+  bool single_pass() const { return single_pass_; }
+  void set_single_pass(bool single_pass) { single_pass_ = single_pass; }
+
+  // Adds the pass, and the resources it reads and writes, to |graph|.
+  void AddToRenderGraph(RenderGraph* graph);
+
+  // Culls the app's draws against each face's frustum, |world_to_face[i]| taking world space to
+  // face i's clip space. The draws that miss every face are skipped.
+  void CullDraws(const DirectX::XMMATRIX (&world_to_face)[kNumFaces]);
+
+  // Draws all faces at once, each draw instanced once per face it reaches.
   void RenderFrame(ID3D12GraphicsCommandList* command_list);
 
+  // Draws face |face|, skipping the draws CullDraws() found do not reach it.
+  void RenderFace(ID3D12GraphicsCommandList* command_list, int face);
+
 private:
   friend class App;
 
+  // Work recorded by one of the pass's command lists, summed over the frames.
+  struct RecordStats {
+    uint64_t recordings = 0;
+    uint64_t draws = 0;
+    uint64_t instances = 0;
+    double seconds = 0.0;
+  };
+
+  // Sets the state both ways of drawing share.
+  void SetCommonState(ID3D12GraphicsCommandList* command_list, ID3D12PipelineState* pipeline);
+
   App* app_;
 
   Microsoft::WRL::ComPtr<ID3D12RootSignature> root_signature_;
   Microsoft::WRL::ComPtr<ID3D12PipelineState> pipeline_;
+  // shadow_pass_single_vs.hlsl, which sends each instance to its face's array slice.
+  Microsoft::WRL::ComPtr<ID3D12PipelineState> single_pass_pipeline_;
 
-  CD3DX12_VIEWPORT viewport_;
-  CD3DX12_RECT scissor_rect_;
+  // Whether the device routes SV_RenderTargetArrayIndex from the vertex shader without emulating a
+  // geometry shader.
+  bool array_index_without_gs_ = false;
 
-  Microsoft::WRL::ComPtr<ID3D12Resource> matrix_buffer_;
-  UINT matrix_buffer_size_ = 0;
+  bool single_pass_ = kDefaultSinglePassShadows;
 
-  CD3DX12_CPU_DESCRIPTOR_HANDLE cbv_cpu_handle_;
-  CD3DX12_GPU_DESCRIPTOR_HANDLE cbv_gpu_handle_;
+  // The faces each of the app's draws reaches, bit f for face f, and the same faces packed by
+  // PackShadowFaces() for the vertex shader.
+  std::vector<uint32_t> face_masks_;
+  std::vector<uint32_t> packed_faces_;
 
-  struct CbvStatic {
-    struct Index {
-      static constexpr int kMatrixBuffer = 0;
-      static constexpr int kMax = kMatrixBuffer;
-    };
-    static constexpr int kNumDescriptors = Index::kMax + 1;
-  };
+  // Kept apart for each mode, so that the two can be compared after switching. The per-face
+  // stats have one per command list of the pass, so that the recording threads write their own.
+  RecordStats single_pass_stats_;
+  RecordStats face_stats_[kNumFaces];
+
+  CD3DX12_VIEWPORT viewport_;
+  CD3DX12_RECT scissor_rect_;
 
-  struct Frame {
-    CD3DX12_CPU_DESCRIPTOR_HANDLE base_dsv_handle;
+  // Matches Matrices in shadow_pass_vs.hlsl. The app writes it to its frame constants.
+  struct Matrices {
+    DirectX::XMFLOAT4X4 world_view;
+    // One per cubemap face, from view space.
+    DirectX::XMFLOAT4X4 shadow[kNumFaces];
   };
 
-  Frame frames_[kNumFrames];
+  // The cubemap is shared by the frames in flight (see App::InitRenderGraph()), so one set of
+  // views serves them all.
+  CD3DX12_CPU_DESCRIPTOR_HANDLE base_dsv_handle_;
 
-  struct DsvPerFrame {
+  struct DsvStatic {
     struct Index {
-      static constexpr int kDepthCubemapBase = 0;
-      static constexpr int kMax = 5;  // Cubemap takes six faces - index 0 to 5.
+      static constexpr int kDepthCubemapBase = 0;  // Cubemap takes six faces - index 0 to 5.
+      static constexpr int kDepthCubemapAllFaces = 6;
+      static constexpr int kMax = 6;
     };
     static constexpr int kNumDescriptors = Index::kMax + 1;
   };
@@ -0,0 +1,27 @@
+struct Matrices {
+	float4x4 world_view;
+	float4x4 shadow[6];
+};
+
+ConstantBuffer<Matrices> matrices : register(b0);
+
+// The faces the draw's instances go to, 3 bits each, from PackShadowFaces().
+struct DrawFaces {
+	uint faces;
+};
+
+ConstantBuffer<DrawFaces> draw_faces : register(b1);
+
+struct VertexOutput {
+	float4 position : SV_POSITION;
+	uint face : SV_RenderTargetArrayIndex;
+};
+
+VertexOutput main(float3 position : POSITION, uint instance : SV_InstanceID) {
+	uint face = (draw_faces.faces >> (3 * instance)) & 7;
+
+	VertexOutput output;
+	output.position = mul(mul(float4(position, 1.f), matrices.world_view), matrices.shadow[face]);
+	output.face = face;
+	return output;
+}
\ No newline at end of file
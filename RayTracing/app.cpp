@@ -1,9 +1,16 @@
 #include "app.h"
 
+#include <memory>
+#include <stdexcept>
+#include <vector>
+
 #include "build\raytracing.hlsl.h"
 
 #include "constants.h"
 #include "dx_includes.h"
+#include "jitter.h"
+#include "scene_cache.h"
+#include "sdkmesh.h"
 
 using Microsoft::WRL::ComPtr;
 using DX::ThrowIfFailed;
@@ -22,6 +29,9 @@ App::App(HWND hwnd) : m_hwnd(hwnd) {
   float aspectRatio = static_cast<float>(k_windowWidth) / static_cast<float>(k_windowHeight);
 
   m_rayGenConstants.Viewport = { aspectRatio, 1.f, -aspectRatio, -1.f };
+  m_rayGenConstants.JitterX = 0.f;
+  m_rayGenConstants.JitterY = 0.f;
+  m_rayGenConstants.AccumulatedFrames = 0;
 }
 
 void App::Initialize() {
@@ -115,7 +125,7 @@ void App::CreatePipeline() {
   // Global root signature creation.
   {
     CD3DX12_DESCRIPTOR_RANGE1 ranges[2];
-    ranges[0].Init(D3D12_DESCRIPTOR_RANGE_TYPE_UAV, 1, 0);
+    ranges[0].Init(D3D12_DESCRIPTOR_RANGE_TYPE_UAV, 2, 0);
     ranges[1].Init(D3D12_DESCRIPTOR_RANGE_TYPE_SRV, 3, 1);
 
     CD3DX12_ROOT_PARAMETER1 rootParams[3] = {};
@@ -238,7 +248,7 @@ void App::CreatePipeline() {
 
 void App::CreateDescriptorHeap() {
   D3D12_DESCRIPTOR_HEAP_DESC heapDesc{};
-  heapDesc.NumDescriptors = 4;
+  heapDesc.NumDescriptors = 5;
   heapDesc.Type = D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV;
   heapDesc.Flags = D3D12_DESCRIPTOR_HEAP_FLAG_SHADER_VISIBLE;
 
@@ -256,6 +266,12 @@ void App::CreateDescriptorHeap() {
   cpuHandle.Offset(m_cbvSrvUavOffsetSize);
   gpuHandle.Offset(m_cbvSrvUavOffsetSize);
 
+  // Follows the output so both UAVs are in the same descriptor table.
+  m_accumulationCpuHandle = cpuHandle;
+
+  cpuHandle.Offset(m_cbvSrvUavOffsetSize);
+  gpuHandle.Offset(m_cbvSrvUavOffsetSize);
+
   m_indexBufferCpuHandle = cpuHandle;
   m_indexBufferGpuHandle = gpuHandle;
 
@@ -275,25 +291,113 @@ void App::CreateDescriptorHeap() {
 void App::InitData() {
   DirectX::XMStoreFloat3x4(&m_worldViewMat, DirectX::XMMatrixIdentity());
 
-  m_graphicsMemory = std::make_unique<DirectX::GraphicsMemory>(m_device.Get());
-  m_model = DirectX::Model::CreateFromSDKMESH(m_device.Get(), L"cornell_box.sdkmesh");
+  // Falls back to baking the .sdkmesh in memory if there is no up-to-date baked scene.
+  std::unique_ptr<scene_cache::Scene> scene =
+      scene_cache::LoadOrBake("cornell_box.scene", "cornell_box.sdkmesh");
 
-  DirectX::ResourceUploadBatch resourceUpload(m_device.Get());
-  resourceUpload.Begin();
-  m_model->LoadStaticBuffers(m_device.Get(), resourceUpload);
+  // The shaders index a single vertex buffer and read 16-bit indices.
+  if (scene->num_vertex_buffers() != 1 || scene->num_index_buffers() != 1 ||
+      scene->index_buffer(0).index_type != sdkmesh::kIndexType16Bit) {
+    throw std::runtime_error("Expected one vertex buffer and one 16-bit index buffer.");
+  }
 
-  std::future<void> resourceLoadDone = resourceUpload.End(m_commandQueue.Get());
-  resourceLoadDone.wait();
+  const scene_cache::VertexBufferDesc& vb = scene->vertex_buffer(0);
+  const scene_cache::IndexBufferDesc& ib = scene->index_buffer(0);
+
+  // Vertex and index data is copied into the upload buffers straight from the scene, unless the
+  // vertices were quantized.
+  if (vb.format == scene_cache::kVertexFormatFloat) {
+    m_vertexBuffer = UploadToDefaultBuffer(scene->vertex_data(0), vb.size_bytes,
+                                           D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
+  } else {
+    std::vector<scene_cache::Vertex> vertices(vb.num_vertices);
+    scene_cache::DecodeVertices(vb, scene->vertex_data(0), vertices.data());
+
+    m_vertexBuffer = UploadToDefaultBuffer(vertices.data(),
+                                           vertices.size() * sizeof(scene_cache::Vertex),
+                                           D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
+  }
+  m_vertexCount = vb.num_vertices;
+  m_vertexStride = sizeof(scene_cache::Vertex);
+
+  m_indexBuffer = UploadToDefaultBuffer(scene->index_data(0), ib.size_bytes,
+                                        D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
+  m_indexBufferSize = static_cast<UINT>(ib.size_bytes);
+
+  // The hit shaders index the vertex buffer directly, so base vertices are not supported.
+  if (scene->num_geometries() > 0) {
+    // Baked BLAS inputs carry tight vertex counts.
+    for (uint32_t i = 0; i < scene->num_geometries(); ++i) {
+      const scene_cache::GeometryDesc& geometry = scene->geometry(i);
+      if (geometry.vertex_offset != 0)
+        throw std::runtime_error("Base vertices are not supported.");
+
+      MeshPart part{};
+      part.StartIndex = geometry.start_index;
+      part.IndexCount = geometry.index_count;
+      part.VertexCount = geometry.vertex_count;
+      part.MaterialIndex = geometry.material_index;
+
+      m_meshParts.push_back(part);
+    }
+  } else {
+    for (uint32_t i = 0; i < scene->num_draw_ranges(); ++i) {
+      const scene_cache::DrawRange& range = scene->draw_range(i);
+      if ((range.flags & scene_cache::kDrawRangeAlpha) ||
+          range.primitive_type != sdkmesh::kTriangleList) {
+        continue;
+      }
+      if (range.vertex_offset != 0)
+        throw std::runtime_error("Base vertices are not supported.");
 
-  for (const auto& effectInfo : m_model->materials) {
-    Material material{};
-    material.AmbientColor = DirectX::XMFLOAT4(effectInfo.ambientColor.x, effectInfo.ambientColor.y,
-                                              effectInfo.ambientColor.z, 0.f);
-    material.DiffuseColor = DirectX::XMFLOAT4(effectInfo.diffuseColor.x, effectInfo.diffuseColor.y,
-                                              effectInfo.diffuseColor.z, 0.f);
+      MeshPart part{};
+      part.StartIndex = range.start_index;
+      part.IndexCount = range.index_count;
+      part.VertexCount = m_vertexCount;
+      part.MaterialIndex = range.material_index;
 
-    m_materials.push_back(material);
+      m_meshParts.push_back(part);
+    }
   }
+
+  m_materials = BuildMaterialTable(*scene);
+}
+
+ComPtr<ID3D12Resource> App::UploadToDefaultBuffer(const void* data, UINT64 dataSize,
+                                                  D3D12_RESOURCE_STATES finalState) {
+  CD3DX12_RESOURCE_DESC bufferDesc = CD3DX12_RESOURCE_DESC::Buffer(dataSize);
+
+  ComPtr<ID3D12Resource> uploadBuffer;
+
+  CD3DX12_HEAP_PROPERTIES uploadHeapProps(D3D12_HEAP_TYPE_UPLOAD);
+  ThrowIfFailed(m_device->CreateCommittedResource(&uploadHeapProps, D3D12_HEAP_FLAG_NONE,
+                                                  &bufferDesc, D3D12_RESOURCE_STATE_GENERIC_READ,
+                                                  nullptr, IID_PPV_ARGS(&uploadBuffer)));
+
+  ComPtr<ID3D12Resource> buffer;
+
+  CD3DX12_HEAP_PROPERTIES bufferHeapProps(D3D12_HEAP_TYPE_DEFAULT);
+  ThrowIfFailed(m_device->CreateCommittedResource(&bufferHeapProps, D3D12_HEAP_FLAG_NONE,
+                                                  &bufferDesc, D3D12_RESOURCE_STATE_COPY_DEST,
+                                                  nullptr, IID_PPV_ARGS(&buffer)));
+
+  D3D12_SUBRESOURCE_DATA subresourceData{};
+  subresourceData.pData = data;
+  subresourceData.RowPitch = dataSize;
+  subresourceData.SlicePitch = subresourceData.RowPitch;
+
+  UpdateSubresources<1>(m_commandList.Get(), buffer.Get(), uploadBuffer.Get(), 0, 0, 1,
+                        &subresourceData);
+
+  CD3DX12_RESOURCE_BARRIER barrier =
+      CD3DX12_RESOURCE_BARRIER::Transition(buffer.Get(), D3D12_RESOURCE_STATE_COPY_DEST,
+                                           finalState);
+  m_commandList->ResourceBarrier(1, &barrier);
+
+  // Upload buffers must be kept alive until the copy commands are completed.
+  m_uploadBuffers.push_back(uploadBuffer);
+
+  return buffer;
 }
 
 void App::CreateBuffersAndViews() {;
@@ -322,8 +426,8 @@ void App::CreateBuffersAndViews() {;
   }
 
   {
-    UINT bufferSize = Align(sizeof(Material) * m_materials.size(),
-                            D3D12_CONSTANT_BUFFER_DATA_PLACEMENT_ALIGNMENT);
+    // A structured buffer, so it needs no padding to the constant buffer alignment.
+    UINT bufferSize = static_cast<UINT>(sizeof(MaterialTableEntry) * m_materials.size());
     CD3DX12_RESOURCE_DESC bufferDesc = CD3DX12_RESOURCE_DESC::Buffer(bufferSize);
 
     ComPtr<ID3D12Resource> uploadBuffer;
@@ -341,7 +445,7 @@ void App::CreateBuffersAndViews() {;
 
     D3D12_SUBRESOURCE_DATA subresourceData{};
     subresourceData.pData = m_materials.data();
-    subresourceData.RowPitch = sizeof(Material);
+    subresourceData.RowPitch = bufferSize;
     subresourceData.SlicePitch = subresourceData.RowPitch;
 
     UpdateSubresources<1>(m_commandList.Get(), m_materialsBuffer.Get(), uploadBuffer.Get(), 0, 0, 1,
@@ -367,33 +471,45 @@ void App::CreateBuffersAndViews() {;
   }
 
   {
-    auto const& firstMeshPart = m_model->meshes[0]->opaqueMeshParts[0];
+    CD3DX12_HEAP_PROPERTIES heapProps(D3D12_HEAP_TYPE_DEFAULT);
+    CD3DX12_RESOURCE_DESC textureDesc =
+        CD3DX12_RESOURCE_DESC::Tex2D(DXGI_FORMAT_R32G32B32A32_FLOAT, k_windowWidth,
+                                     k_windowHeight, 1, 1, 1, 0,
+                                     D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS);
 
+    ThrowIfFailed(m_device->CreateCommittedResource(&heapProps, D3D12_HEAP_FLAG_NONE,
+                                                    &textureDesc,
+                                                    D3D12_RESOURCE_STATE_UNORDERED_ACCESS, nullptr,
+                                                    IID_PPV_ARGS(&m_accumulationTarget)));
+    D3D12_UNORDERED_ACCESS_VIEW_DESC uavDesc{};
+    uavDesc.ViewDimension = D3D12_UAV_DIMENSION_TEXTURE2D;
+
+    m_device->CreateUnorderedAccessView(m_accumulationTarget.Get(), nullptr, &uavDesc,
+                                        m_accumulationCpuHandle);
+  }
+
+  {
     D3D12_SHADER_RESOURCE_VIEW_DESC srvDesc{};
     srvDesc.ViewDimension = D3D12_SRV_DIMENSION_BUFFER;
     srvDesc.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
     srvDesc.Format = DXGI_FORMAT_R32_TYPELESS;
-    srvDesc.Buffer.NumElements = firstMeshPart->indexBufferSize / 4;
+    srvDesc.Buffer.NumElements = m_indexBufferSize / 4;
     srvDesc.Buffer.Flags = D3D12_BUFFER_SRV_FLAG_RAW;
     srvDesc.Buffer.StructureByteStride = 0;
 
-    m_device->CreateShaderResourceView(firstMeshPart->staticIndexBuffer.Get(), &srvDesc,
-                                       m_indexBufferCpuHandle);
+    m_device->CreateShaderResourceView(m_indexBuffer.Get(), &srvDesc, m_indexBufferCpuHandle);
   }
 
   {
-    auto const& firstMeshPart = m_model->meshes[0]->opaqueMeshParts[0];
-
     D3D12_SHADER_RESOURCE_VIEW_DESC srvDesc{};
     srvDesc.ViewDimension = D3D12_SRV_DIMENSION_BUFFER;
     srvDesc.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
     srvDesc.Format = DXGI_FORMAT_UNKNOWN;
-    srvDesc.Buffer.NumElements = firstMeshPart->vertexCount;
+    srvDesc.Buffer.NumElements = m_vertexCount;
     srvDesc.Buffer.Flags = D3D12_BUFFER_SRV_FLAG_NONE;
-    srvDesc.Buffer.StructureByteStride = firstMeshPart->vertexStride;
+    srvDesc.Buffer.StructureByteStride = m_vertexStride;
 
-    m_device->CreateShaderResourceView(firstMeshPart->staticVertexBuffer.Get(), &srvDesc,
-                                       m_vertexBufferCpuHandle);
+    m_device->CreateShaderResourceView(m_vertexBuffer.Get(), &srvDesc, m_vertexBufferCpuHandle);
   }
 
   {
@@ -403,7 +519,7 @@ void App::CreateBuffersAndViews() {;
     srvDesc.Format = DXGI_FORMAT_UNKNOWN;
     srvDesc.Buffer.NumElements = m_materials.size();
     srvDesc.Buffer.Flags = D3D12_BUFFER_SRV_FLAG_NONE;
-    srvDesc.Buffer.StructureByteStride = sizeof(Material);
+    srvDesc.Buffer.StructureByteStride = sizeof(MaterialTableEntry);
 
     m_device->CreateShaderResourceView(m_materialsBuffer.Get(), &srvDesc,
                                        m_materialsBufferCpuHandle);
@@ -417,10 +533,14 @@ void App::CreateShaderTables() {
   constexpr UINT shaderIdSize = D3D12_SHADER_IDENTIFIER_SIZE_IN_BYTES;
 
   {
+    // Each record is the start of the ray generation table for its frame, so it needs the table
+    // alignment rather than the record alignment.
+    m_rayGenShaderRecordSize = Align(shaderIdSize + sizeof(RayGenConstantBuffer),
+                                     D3D12_RAYTRACING_SHADER_TABLE_BYTE_ALIGNMENT);
+
     CD3DX12_HEAP_PROPERTIES heapProps(D3D12_HEAP_TYPE_UPLOAD);
     CD3DX12_RESOURCE_DESC bufferDesc =
-        CD3DX12_RESOURCE_DESC::Buffer(Align(shaderIdSize + sizeof(RayGenConstantBuffer),
-                                            D3D12_RAYTRACING_SHADER_RECORD_BYTE_ALIGNMENT));
+        CD3DX12_RESOURCE_DESC::Buffer(static_cast<UINT64>(m_rayGenShaderRecordSize) * k_numFrames);
 
     ThrowIfFailed(m_device->CreateCommittedResource(&heapProps, D3D12_HEAP_FLAG_NONE,
                                                     &bufferDesc, D3D12_RESOURCE_STATE_GENERIC_READ,
@@ -428,24 +548,22 @@ void App::CreateShaderTables() {
 
     void* rayGenShaderId = stateObjectProps->GetShaderIdentifier(k_rayGenShaderName);
 
-    uint8_t* ptr;
-    ThrowIfFailed(m_rayGenShaderTable->Map(0, nullptr, reinterpret_cast<void**>(&ptr)));
-
-    memcpy(ptr, rayGenShaderId, shaderIdSize);
-    ptr += shaderIdSize;
-    memcpy(ptr, &m_rayGenConstants, sizeof(RayGenConstantBuffer));
+    // Stays mapped so RenderFrame can write each frame's constants.
+    ThrowIfFailed(m_rayGenShaderTable->Map(0, nullptr,
+                                           reinterpret_cast<void**>(&m_rayGenShaderRecords)));
 
-    m_rayGenShaderTable->Unmap(0, nullptr);
+    for (int i = 0; i < k_numFrames; ++i) {
+      UINT8* ptr = m_rayGenShaderRecords + i * m_rayGenShaderRecordSize;
+      memcpy(ptr, rayGenShaderId, shaderIdSize);
+      memcpy(ptr + shaderIdSize, &m_rayGenConstants, sizeof(RayGenConstantBuffer));
+    }
   }
 
   {
     m_hitGroupShaderRecordSize = Align(shaderIdSize + sizeof(ClosestHitConstants),
                                        D3D12_RAYTRACING_SHADER_RECORD_BYTE_ALIGNMENT);
 
-    int numMeshes = 0;
-    for (auto& mesh : m_model->meshes) {
-      numMeshes += static_cast<UINT>(mesh->opaqueMeshParts.size());
-    }
+    UINT numMeshes = static_cast<UINT>(m_meshParts.size());
 
     CD3DX12_HEAP_PROPERTIES heapProps(D3D12_HEAP_TYPE_UPLOAD);
     CD3DX12_RESOURCE_DESC bufferDesc =
@@ -460,21 +578,15 @@ void App::CreateShaderTables() {
     uint8_t* ptr;
     ThrowIfFailed(m_hitGroupShaderTable->Map(0, nullptr, reinterpret_cast<void**>(&ptr)));
 
-    for (auto& mesh : m_model->meshes) {
-      uint32_t baseIbIndex = 0;
+    for (const MeshPart& meshPart : m_meshParts) {
+      memcpy(ptr, hitGroupShaderId, shaderIdSize);
 
-      for (auto& mesh_part : mesh->opaqueMeshParts) {
-        memcpy(ptr, hitGroupShaderId, shaderIdSize);
+      ClosestHitConstants* constantsPtr =
+          reinterpret_cast<ClosestHitConstants*>(ptr + shaderIdSize);
+      constantsPtr->MaterialIndex = meshPart.MaterialIndex;
+      constantsPtr->BaseIbIndex = meshPart.StartIndex;
 
-        ClosestHitConstants* constantsPtr =
-            reinterpret_cast<ClosestHitConstants*>(ptr + shaderIdSize);
-        constantsPtr->MaterialIndex = mesh_part->materialIndex;
-        constantsPtr->BaseIbIndex = baseIbIndex;
-
-        ptr += m_hitGroupShaderRecordSize;
-
-        baseIbIndex += mesh_part->indexCount;
-      }
+      ptr += m_hitGroupShaderRecordSize;
     }
 
     m_hitGroupShaderTable->Unmap(0, nullptr);
@@ -508,25 +620,21 @@ void App::CreateShaderTables() {
 void App::CreateAccelerationStructure() {
   std::vector<D3D12_RAYTRACING_GEOMETRY_DESC> geometryDescs;
 
-  for (auto& mesh : m_model->meshes) {
-    for (auto& meshPart : mesh->opaqueMeshParts) {
-      D3D12_RAYTRACING_GEOMETRY_DESC geometryDesc{};
-      geometryDesc.Type = D3D12_RAYTRACING_GEOMETRY_TYPE_TRIANGLES;
-      geometryDesc.Triangles.IndexBuffer =
-          meshPart->staticIndexBuffer->GetGPUVirtualAddress() +
-          meshPart->startIndex * sizeof(UINT16);
-      geometryDesc.Triangles.IndexCount = meshPart->indexCount;
-      geometryDesc.Triangles.IndexFormat = meshPart->indexFormat;
-      geometryDesc.Triangles.Transform3x4 = m_matrixBuffer->GetGPUVirtualAddress();
-      geometryDesc.Triangles.VertexBuffer.StartAddress =
-          meshPart->staticVertexBuffer->GetGPUVirtualAddress();
-      geometryDesc.Triangles.VertexBuffer.StrideInBytes = meshPart->vertexStride;
-      geometryDesc.Triangles.VertexCount = meshPart->vertexCount;
-      geometryDesc.Triangles.VertexFormat = DXGI_FORMAT_R32G32B32_FLOAT;
-      geometryDesc.Flags = D3D12_RAYTRACING_GEOMETRY_FLAG_OPAQUE;
-
-      geometryDescs.push_back(geometryDesc);
-    }
+  for (const MeshPart& meshPart : m_meshParts) {
+    D3D12_RAYTRACING_GEOMETRY_DESC geometryDesc{};
+    geometryDesc.Type = D3D12_RAYTRACING_GEOMETRY_TYPE_TRIANGLES;
+    geometryDesc.Triangles.IndexBuffer =
+        m_indexBuffer->GetGPUVirtualAddress() + meshPart.StartIndex * sizeof(UINT16);
+    geometryDesc.Triangles.IndexCount = meshPart.IndexCount;
+    geometryDesc.Triangles.IndexFormat = DXGI_FORMAT_R16_UINT;
+    geometryDesc.Triangles.Transform3x4 = m_matrixBuffer->GetGPUVirtualAddress();
+    geometryDesc.Triangles.VertexBuffer.StartAddress = m_vertexBuffer->GetGPUVirtualAddress();
+    geometryDesc.Triangles.VertexBuffer.StrideInBytes = m_vertexStride;
+    geometryDesc.Triangles.VertexCount = meshPart.VertexCount;
+    geometryDesc.Triangles.VertexFormat = DXGI_FORMAT_R32G32B32_FLOAT;
+    geometryDesc.Flags = D3D12_RAYTRACING_GEOMETRY_FLAG_OPAQUE;
+
+    geometryDescs.push_back(geometryDesc);
   }
 
   D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_INPUTS tlasInputs{};
@@ -645,6 +753,10 @@ void App::Cleanup() {
 
 }
 
+void App::ResetAccumulation() {
+  m_accumulatedFrames = 0;
+}
+
 void App::RenderFrame() {
   ThrowIfFailed(m_Frames[m_frameIndex].CommandAllocator->Reset());
   ThrowIfFailed(m_dxrCommandList->Reset(m_Frames[m_frameIndex].CommandAllocator.Get(), nullptr));
@@ -656,34 +768,48 @@ void App::RenderFrame() {
     m_dxrCommandList->ResourceBarrier(1, &barrier);
   }
 
-  m_dxrCommandList->SetComputeRootSignature(m_globalRootSignature.Get());
+  // Once the average has converged, the output already holds it and only needs presenting.
+  if (m_accumulatedFrames < k_maxAccumulatedFrames) {
+    GetSubpixelJitter(m_accumulatedFrames, &m_rayGenConstants.JitterX,
+                      &m_rayGenConstants.JitterY);
+    m_rayGenConstants.AccumulatedFrames = m_accumulatedFrames;
+    ++m_accumulatedFrames;
 
-  ID3D12DescriptorHeap* descriptorHeaps[] = { m_cbvSrvUavHeap.Get() };
-  m_dxrCommandList->SetDescriptorHeaps(_countof(descriptorHeaps), descriptorHeaps);
+    // MoveToNextFrame waited for the last use of this frame's record, so it can be rewritten.
+    UINT8* rayGenRecord = m_rayGenShaderRecords + m_frameIndex * m_rayGenShaderRecordSize;
+    memcpy(rayGenRecord + D3D12_SHADER_IDENTIFIER_SIZE_IN_BYTES, &m_rayGenConstants,
+           sizeof(RayGenConstantBuffer));
 
-  m_dxrCommandList->SetComputeRootDescriptorTable(0, m_raytracingOutputGpuHandle);
-  m_dxrCommandList->SetComputeRootShaderResourceView(1, m_tlas->GetGPUVirtualAddress());
-  m_dxrCommandList->SetComputeRootDescriptorTable(2, m_indexBufferGpuHandle);
+    m_dxrCommandList->SetComputeRootSignature(m_globalRootSignature.Get());
 
-  D3D12_DISPATCH_RAYS_DESC dispatchDesc{};
+    ID3D12DescriptorHeap* descriptorHeaps[] = { m_cbvSrvUavHeap.Get() };
+    m_dxrCommandList->SetDescriptorHeaps(_countof(descriptorHeaps), descriptorHeaps);
 
-  dispatchDesc.RayGenerationShaderRecord.StartAddress = m_rayGenShaderTable->GetGPUVirtualAddress();
-  dispatchDesc.RayGenerationShaderRecord.SizeInBytes = m_rayGenShaderTable->GetDesc().Width;
+    m_dxrCommandList->SetComputeRootDescriptorTable(0, m_raytracingOutputGpuHandle);
+    m_dxrCommandList->SetComputeRootShaderResourceView(1, m_tlas->GetGPUVirtualAddress());
+    m_dxrCommandList->SetComputeRootDescriptorTable(2, m_indexBufferGpuHandle);
 
-  dispatchDesc.HitGroupTable.StartAddress = m_hitGroupShaderTable->GetGPUVirtualAddress();
-  dispatchDesc.HitGroupTable.SizeInBytes = m_hitGroupShaderTable->GetDesc().Width;
-  dispatchDesc.HitGroupTable.StrideInBytes = m_hitGroupShaderRecordSize;
+    D3D12_DISPATCH_RAYS_DESC dispatchDesc{};
 
-  dispatchDesc.MissShaderTable.StartAddress = m_missShaderTable->GetGPUVirtualAddress();
-  dispatchDesc.MissShaderTable.SizeInBytes = m_missShaderTable->GetDesc().Width;
-  dispatchDesc.MissShaderTable.StrideInBytes = m_missShaderRecordSize;
+    dispatchDesc.RayGenerationShaderRecord.StartAddress =
+        m_rayGenShaderTable->GetGPUVirtualAddress() + m_frameIndex * m_rayGenShaderRecordSize;
+    dispatchDesc.RayGenerationShaderRecord.SizeInBytes = m_rayGenShaderRecordSize;
 
-  dispatchDesc.Width = k_windowWidth;
-  dispatchDesc.Height = k_windowHeight;
-  dispatchDesc.Depth = 1;
+    dispatchDesc.HitGroupTable.StartAddress = m_hitGroupShaderTable->GetGPUVirtualAddress();
+    dispatchDesc.HitGroupTable.SizeInBytes = m_hitGroupShaderTable->GetDesc().Width;
+    dispatchDesc.HitGroupTable.StrideInBytes = m_hitGroupShaderRecordSize;
 
-  m_dxrCommandList->SetPipelineState1(m_dxrStateObject.Get());
-  m_dxrCommandList->DispatchRays(&dispatchDesc);
+    dispatchDesc.MissShaderTable.StartAddress = m_missShaderTable->GetGPUVirtualAddress();
+    dispatchDesc.MissShaderTable.SizeInBytes = m_missShaderTable->GetDesc().Width;
+    dispatchDesc.MissShaderTable.StrideInBytes = m_missShaderRecordSize;
+
+    dispatchDesc.Width = k_windowWidth;
+    dispatchDesc.Height = k_windowHeight;
+    dispatchDesc.Depth = 1;
+
+    m_dxrCommandList->SetPipelineState1(m_dxrStateObject.Get());
+    m_dxrCommandList->DispatchRays(&dispatchDesc);
+  }
 
   {
     D3D12_RESOURCE_BARRIER preCopyBarriers[2] = {};
@@ -5,13 +5,9 @@
 
 #include "constants.h"
 #include "dx_includes.h"
+#include "material_table.h"
 #include "raytracing_shader.h"
 
-struct Material {
-  DirectX::XMFLOAT4 AmbientColor;
-  DirectX::XMFLOAT4 DiffuseColor;
-};
-
 struct ClosestHitConstants {
   UINT MaterialIndex;
   UINT BaseIbIndex;
@@ -27,6 +23,9 @@ public:
 
   void RenderFrame();
 
+  // Starts a new progressive average. Call whenever the camera or scene changes.
+  void ResetAccumulation();
+
 private:
   void InitDeviceAndSwapChain();
 
@@ -44,6 +43,9 @@ private:
 
   void CreateAccelerationStructure();
 
+  Microsoft::WRL::ComPtr<ID3D12Resource> UploadToDefaultBuffer(const void* data, UINT64 dataSize,
+                                                               D3D12_RESOURCE_STATES finalState);
+
   void MoveToNextFrame();
 
   void WaitForGpu();
@@ -78,6 +80,8 @@ private:
    CD3DX12_CPU_DESCRIPTOR_HANDLE m_raytracingOutputCpuHandle;
    CD3DX12_GPU_DESCRIPTOR_HANDLE m_raytracingOutputGpuHandle;
 
+   CD3DX12_CPU_DESCRIPTOR_HANDLE m_accumulationCpuHandle;
+
    Microsoft::WRL::ComPtr<ID3D12Resource> m_matrixBuffer;
    Microsoft::WRL::ComPtr<ID3D12Resource> m_materialsBuffer;
 
@@ -92,10 +96,18 @@ private:
 
    Microsoft::WRL::ComPtr<ID3D12Resource> m_raytracingOutput;
 
+   // Running sum of the jittered frames, in float so the average keeps its precision.
+   Microsoft::WRL::ComPtr<ID3D12Resource> m_accumulationTarget;
+   UINT m_accumulatedFrames = 0;
+
    Microsoft::WRL::ComPtr<ID3D12Resource> m_rayGenShaderTable;
    Microsoft::WRL::ComPtr<ID3D12Resource> m_hitGroupShaderTable;
    Microsoft::WRL::ComPtr<ID3D12Resource> m_missShaderTable;
 
+   // One ray generation record per frame in flight, since its constants change every frame.
+   UINT8* m_rayGenShaderRecords = nullptr;
+   UINT m_rayGenShaderRecordSize = 0;
+
    UINT m_hitGroupShaderRecordSize = 0;
    UINT m_missShaderRecordSize = 0;
 
@@ -116,10 +128,23 @@ private:
 
    DirectX::XMFLOAT3X4 m_worldViewMat;
 
-   std::unique_ptr<DirectX::GraphicsMemory> m_graphicsMemory;
-   std::unique_ptr<DirectX::Model> m_model;
+   struct MeshPart {
+     UINT StartIndex;
+     UINT IndexCount;
+     UINT VertexCount;
+     UINT MaterialIndex;
+   };
+
+   Microsoft::WRL::ComPtr<ID3D12Resource> m_vertexBuffer;
+   UINT m_vertexCount = 0;
+   UINT m_vertexStride = 0;
+
+   Microsoft::WRL::ComPtr<ID3D12Resource> m_indexBuffer;
+   UINT m_indexBufferSize = 0;
+
+   std::vector<MeshPart> m_meshParts;
 
-   std::vector<Material> m_materials;
+   std::vector<MaterialTableEntry> m_materials;
 };
 
 #endif  // APP_H_
\ No newline at end of file
@@ -6,6 +6,10 @@ constexpr int k_numFrames = 3;
 constexpr int k_windowWidth = 1024;
 constexpr int k_windowHeight = 768;
 
+// Frames averaged before the image counts as converged and stops tracing rays. Also keeps the
+// float sum far from losing precision.
+constexpr int k_maxAccumulatedFrames = 1024;
+
 extern const wchar_t* k_hitGroupName;
 extern const wchar_t* k_rayGenShaderName;
 extern const wchar_t* k_closestHitShaderName;
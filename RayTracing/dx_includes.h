@@ -8,13 +8,6 @@
 #include "d3dx12.h"
 #include "DirectXMath.h"
 
-// Without this, "Model.h" will error out.
-#include <stdexcept>
-
-#include "GraphicsMemory.h"
-#include "Model.h"
-#include "ResourceUploadBatch.h"
-
 #include "dx_utils.h"
 #include "ReadData.h"
 
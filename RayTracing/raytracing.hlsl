@@ -1,10 +1,6 @@
+#include "../Utils/material_table.hlsli"
 #include "raytracing_shader.h"
 
-struct Material {
-  float4 AmbientColor;
-  float4 DiffuseColor;
-};
-
 struct ClosestHitConstants {
   uint MaterialIndex;
   uint BaseIbIndex;
@@ -29,10 +25,11 @@ struct ShadowRayPayload {
 
 RaytracingAccelerationStructure s_scene : register(t0);
 RWTexture2D<float4> s_raytracingOutput : register(u0);
+RWTexture2D<float4> s_accumulation : register(u1);
 
 ByteAddressBuffer s_indexBuffer : register(t1);
 StructuredBuffer<Vertex> s_vertexBuffer : register(t2);
-StructuredBuffer<Material> s_materials : register(t3);
+StructuredBuffer<MaterialTableEntry> s_materials : register(t3);
 
 // Ray generation descriptors.
 
@@ -44,7 +41,9 @@ ConstantBuffer<ClosestHitConstants> s_closestHitConstants : register(b1);
 
 [shader("raygeneration")]
 void RaygenShader() {
-  float2 lerpValues = (float2)DispatchRaysIndex() / (float2)DispatchRaysDimensions();
+  float2 jitter = float2(s_rayGenConstants.JitterX, s_rayGenConstants.JitterY);
+  float2 lerpValues =
+      ((float2)DispatchRaysIndex().xy + jitter) / (float2)DispatchRaysDimensions().xy;
 
   float viewportX = lerp(s_rayGenConstants.Viewport.Left, s_rayGenConstants.Viewport.Right,
                           lerpValues.x);
@@ -60,7 +59,15 @@ void RaygenShader() {
 
   TraceRay(s_scene, RAY_FLAG_CULL_BACK_FACING_TRIANGLES, ~0, 0, 1, 0, ray, payload);
 
-  s_raytracingOutput[DispatchRaysIndex().xy] = payload.Color;
+  // The camera and scene are static between resets, so each frame adds one jittered sample to
+  // the running sum and the output shows the average.
+  float4 sum = payload.Color;
+  if (s_rayGenConstants.AccumulatedFrames > 0) {
+    sum += s_accumulation[DispatchRaysIndex().xy];
+  }
+  s_accumulation[DispatchRaysIndex().xy] = sum;
+
+  s_raytracingOutput[DispatchRaysIndex().xy] = sum / (s_rayGenConstants.AccumulatedFrames + 1);
 }
 
 // Taken from Microsoft sample.
@@ -127,10 +134,10 @@ void ClosestHitShader(inout RayPayload payload, IntersectAttributes intersectAtt
   float3 lightDistVec = lightPos - hitPos;
   float3 lightDir = normalize(lightDistVec);
 
-  Material mtl = s_materials[s_closestHitConstants.MaterialIndex];
+  MaterialTableEntry mtl = s_materials[s_closestHitConstants.MaterialIndex];
 
-  float3 ambient = mtl.AmbientColor.rgb;
-  float3 diffuse = clamp(dot(lightDir, normal), 0.0, 1.0) * mtl.DiffuseColor.rgb;
+  float3 ambient = mtl.ambient_color.rgb;
+  float3 diffuse = clamp(dot(lightDir, normal), 0.0, 1.0) * mtl.diffuse_color.rgb;
 
   RayDesc shadowRay;
   shadowRay.Origin = hitPos;
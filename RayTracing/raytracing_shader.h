@@ -1,6 +1,10 @@
 #ifndef RAYTRACING_SHADER_H_
 #define RAYTRACING_SHADER_H_
 
+#ifdef __cplusplus
+typedef unsigned int uint;
+#endif
+
 struct Viewport {
   float Left;
   float Top;
@@ -10,6 +14,13 @@ struct Viewport {
 
 struct RayGenConstantBuffer {
   Viewport Viewport;
+
+  // Offset of this frame's rays from each pixel's top-left corner, in pixels.
+  float JitterX;
+  float JitterY;
+
+  // Frames already summed into the accumulation target. 0 starts a new average.
+  uint AccumulatedFrames;
 };
 
 #endif  // RAYTRACING_SHADER_H_
\ No newline at end of file
@@ -0,0 +1,191 @@
+#include "blue_noise.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <stdexcept>
+#include <string>
+
+namespace {
+
+// Width of the Gaussian that measures how crowded a pixel's neighbourhood is, as in the paper.
+constexpr float kSigma = 1.5f;
+
+// Fraction of the pixels set in the initial pattern.
+constexpr float kInitialDensity = 0.1f;
+
+// Void-and-cluster state for one slice. energy_[p] is the sum of the Gaussian, on the torus, over
+// the distances from p to every set pixel.
+class VoidAndCluster {
+public:
+  explicit VoidAndCluster(int size) : size_(size), num_pixels_(size * size) {
+    // The kernel depends only on the wrapped offset, so it is tabulated once per slice.
+    kernel_.resize(num_pixels_);
+    for (int dy = 0; dy < size_; ++dy) {
+      for (int dx = 0; dx < size_; ++dx) {
+        const int wx = std::min(dx, size_ - dx);
+        const int wy = std::min(dy, size_ - dy);
+        kernel_[dy * size_ + dx] = std::exp(-(wx * wx + wy * wy) / (2.f * kSigma * kSigma));
+      }
+    }
+    set_.assign(num_pixels_, 0);
+    energy_.assign(num_pixels_, 0.f);
+  }
+
+  int num_pixels() const { return num_pixels_; }
+  bool is_set(int pixel) const { return set_[pixel] != 0; }
+
+  void Toggle(int pixel) {
+    const float sign = set_[pixel] ? -1.f : 1.f;
+    set_[pixel] ^= 1;
+
+    const int px = pixel % size_;
+    const int py = pixel / size_;
+    for (int y = 0; y < size_; ++y) {
+      const float* kernel_row = &kernel_[((y - py) & (size_ - 1)) * size_];
+      float* energy_row = &energy_[y * size_];
+      for (int x = 0; x < size_; ++x)
+        energy_row[x] += sign * kernel_row[(x - px) & (size_ - 1)];
+    }
+  }
+
+  // The set pixel with the most energy.
+  int TightestCluster() const { return Extreme(1, 1.f); }
+
+  // The clear pixel with the least energy.
+  int LargestVoid() const { return Extreme(0, -1.f); }
+
+private:
+  int Extreme(uint8_t state, float sign) const {
+    int best = -1;
+    for (int i = 0; i < num_pixels_; ++i) {
+      if (set_[i] == state && (best < 0 || sign * energy_[i] > sign * energy_[best]))
+        best = i;
+    }
+    return best;
+  }
+
+  int size_;
+  int num_pixels_;
+  std::vector<float> kernel_;
+  std::vector<uint8_t> set_;
+  std::vector<float> energy_;
+};
+
+// Ranks the pixels of one slice and writes them to |values| as 16-bit unorms.
+void GenerateSlice(int size, std::mt19937* rng, uint16_t* values) {
+  VoidAndCluster pattern(size);
+  const int num_pixels = pattern.num_pixels();
+  const int num_initial = std::max(1, static_cast<int>(num_pixels * kInitialDensity));
+
+  // A random initial pattern, then relaxed by moving the tightest cluster to the largest void
+  // until that changes nothing. The bound only guards against a pattern that cycles.
+  std::uniform_int_distribution<int> pixel_distribution(0, num_pixels - 1);
+  for (int placed = 0; placed < num_initial;) {
+    const int pixel = pixel_distribution(*rng);
+    if (!pattern.is_set(pixel)) {
+      pattern.Toggle(pixel);
+      ++placed;
+    }
+  }
+
+  for (int step = 0; step < num_pixels; ++step) {
+    const int cluster = pattern.TightestCluster();
+    pattern.Toggle(cluster);
+    const int void_pixel = pattern.LargestVoid();
+    pattern.Toggle(void_pixel);
+    if (void_pixel == cluster)
+      break;
+  }
+
+  std::vector<int> ranks(num_pixels);
+
+  // Phase 1 ranks the initial pixels by removing the tightest cluster each time, on a copy so the
+  // initial pattern is still there for phase 2.
+  VoidAndCluster removal = pattern;
+  for (int rank = num_initial - 1; rank >= 0; --rank) {
+    const int cluster = removal.TightestCluster();
+    removal.Toggle(cluster);
+    ranks[cluster] = rank;
+  }
+
+  // Phases 2 and 3 fill the largest void until every pixel is set. Past half, the paper looks for
+  // the tightest cluster of clear pixels instead, but the energy of the clear pixels is a constant
+  // minus that of the set ones, so it is the same pixel.
+  for (int rank = num_initial; rank < num_pixels; ++rank) {
+    const int void_pixel = pattern.LargestVoid();
+    pattern.Toggle(void_pixel);
+    ranks[void_pixel] = rank;
+  }
+
+  for (int i = 0; i < num_pixels; ++i)
+    values[i] = static_cast<uint16_t>(static_cast<uint32_t>(ranks[i]) * 65536u / num_pixels);
+}
+
+}  // namespace
+
+BlueNoiseTiles GenerateBlueNoise(int size, int num_slices, uint32_t seed) {
+  if (size < 4 || size > 256 || (size & (size - 1)) != 0)
+    throw std::runtime_error("GenerateBlueNoise: size must be a power of two from 4 to 256");
+  if (num_slices < 1)
+    throw std::runtime_error("GenerateBlueNoise: need at least one slice");
+
+  BlueNoiseTiles tiles;
+  tiles.size = size;
+  tiles.num_slices = num_slices;
+  tiles.values.resize(static_cast<size_t>(size) * size * num_slices);
+
+  std::mt19937 rng(seed);
+  for (int slice = 0; slice < num_slices; ++slice)
+    GenerateSlice(size, &rng, &tiles.values[static_cast<size_t>(slice) * size * size]);
+
+  return tiles;
+}
+
+void SaveBlueNoise(const char* path, const BlueNoiseTiles& tiles) {
+  FILE* file = std::fopen(path, "wb");
+  if (file == nullptr)
+    throw std::runtime_error(std::string("SaveBlueNoise: cannot create ") + path);
+
+  BlueNoiseFileHeader header{};
+  std::memcpy(header.magic, kBlueNoiseMagic, sizeof(header.magic));
+  header.version = kBlueNoiseFileVersion;
+  header.size = tiles.size;
+  header.num_slices = tiles.num_slices;
+
+  const bool ok =
+      std::fwrite(&header, sizeof(header), 1, file) == 1 &&
+      std::fwrite(tiles.values.data(), sizeof(uint16_t), tiles.values.size(), file) ==
+          tiles.values.size();
+  std::fclose(file);
+
+  if (!ok)
+    throw std::runtime_error(std::string("SaveBlueNoise: cannot write ") + path);
+}
+
+BlueNoiseTiles LoadBlueNoise(const char* path) {
+  FILE* file = std::fopen(path, "rb");
+  if (file == nullptr)
+    throw std::runtime_error(std::string("LoadBlueNoise: cannot open ") + path);
+
+  BlueNoiseFileHeader header{};
+  BlueNoiseTiles tiles;
+  bool ok = std::fread(&header, sizeof(header), 1, file) == 1 &&
+            std::memcmp(header.magic, kBlueNoiseMagic, sizeof(header.magic)) == 0 &&
+            header.version == kBlueNoiseFileVersion && header.size >= 4 && header.size <= 256 &&
+            header.num_slices >= 1 && header.num_slices <= 4096;
+  if (ok) {
+    tiles.size = static_cast<int>(header.size);
+    tiles.num_slices = static_cast<int>(header.num_slices);
+    tiles.values.resize(static_cast<size_t>(header.size) * header.size * header.num_slices);
+    ok = std::fread(tiles.values.data(), sizeof(uint16_t), tiles.values.size(), file) ==
+         tiles.values.size();
+  }
+  std::fclose(file);
+
+  if (!ok)
+    throw std::runtime_error(std::string("LoadBlueNoise: invalid file ") + path);
+  return tiles;
+}
\ No newline at end of file
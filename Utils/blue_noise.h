@@ -0,0 +1,51 @@
+#ifndef BLUE_NOISE_H_
+#define BLUE_NOISE_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Tileable blue-noise masks: each slice is a size x size permutation of the ranks 0 to
+// size * size - 1, spread so that pixels of close rank are far apart. Thresholding a slice at any
+// level gives evenly spaced points without the clumps of white noise, so per-pixel samples drawn
+// from it turn error into high-frequency noise that averages out over a few pixels.
+//
+// Values are stored as 16-bit unorm ranks, slice after slice with rows in order, which is the
+// layout of an R16_UNORM Texture2DArray upload. Shaders read slice d at (x, y) mod size for
+// dimension d.
+struct BlueNoiseTiles {
+  int size = 0;
+  int num_slices = 0;
+  std::vector<uint16_t> values;
+
+  uint16_t at(int slice, int x, int y) const {
+    return values[(static_cast<size_t>(slice) * size + y) * size + x];
+  }
+
+  // The value at (x, y) of |slice| as a number in (0, 1).
+  float unorm(int slice, int x, int y) const {
+    return (at(slice, x, y) + 0.5f) * (1.f / 65536.f);
+  }
+};
+
+// Makes |num_slices| independent masks of |size| x |size| with the void-and-cluster method
+// (Ulichney 1993). |size| must be a power of two from 4 to 256. The cost grows with the fourth
+// power of |size|: a 64 x 64 slice takes over a hundred milliseconds.
+BlueNoiseTiles GenerateBlueNoise(int size, int num_slices, uint32_t seed);
+
+// .bluenoise files are a BlueNoiseFileHeader followed by the values. Throw std::runtime_error on
+// failure.
+void SaveBlueNoise(const char* path, const BlueNoiseTiles& tiles);
+BlueNoiseTiles LoadBlueNoise(const char* path);
+
+constexpr char kBlueNoiseMagic[4] = {'D', 'X', 'B', 'N'};
+constexpr uint32_t kBlueNoiseFileVersion = 1;
+
+struct BlueNoiseFileHeader {
+  char magic[4];
+  uint32_t version;
+  uint32_t size;
+  uint32_t num_slices;
+};
+
+#endif  // BLUE_NOISE_H_
\ No newline at end of file
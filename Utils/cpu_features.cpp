@@ -0,0 +1,32 @@
+#include "cpu_features.h"
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#include <immintrin.h>
+#endif
+
+bool CpuSupportsAvx2() {
+#if defined(_MSC_VER)
+  int info[4];
+  __cpuid(info, 0);
+  if (info[0] < 7)
+    return false;
+
+  // Leaf 1 ECX: OSXSAVE (bit 27) and AVX (bit 28).
+  __cpuid(info, 1);
+  if ((info[2] & (1 << 27)) == 0 || (info[2] & (1 << 28)) == 0)
+    return false;
+
+  // The OS must save both the XMM and YMM state.
+  if ((_xgetbv(0) & 0x6) != 0x6)
+    return false;
+
+  // Leaf 7 EBX: AVX2 (bit 5).
+  __cpuidex(info, 7, 0);
+  return (info[1] & (1 << 5)) != 0;
+#elif defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+  return __builtin_cpu_supports("avx2");
+#else
+  return false;
+#endif
+}
\ No newline at end of file
@@ -0,0 +1,8 @@
+#ifndef CPU_FEATURES_H_
+#define CPU_FEATURES_H_
+
+// Whether the CPU and OS support AVX2 (including saving the YMM registers on context switches).
+// Code compiled for AVX2 must only run when this returns true.
+bool CpuSupportsAvx2();
+
+#endif  // CPU_FEATURES_H_
\ No newline at end of file
@@ -0,0 +1,105 @@
+#include "descriptor_allocator.h"
+
+#include <algorithm>
+#include <iterator>
+#include <stdexcept>
+#include <string>
+
+DescriptorAllocator::DescriptorAllocator(uint32_t persistent_capacity, uint32_t transient_capacity)
+    : persistent_capacity_(persistent_capacity), transient_capacity_(transient_capacity) {
+  if (persistent_capacity_ > 0)
+    free_ranges_[0] = persistent_capacity_;
+  if (transient_capacity_ > 0)
+    transient_.reset(new UploadRing(transient_capacity_));
+}
+
+uint32_t DescriptorAllocator::Allocate(uint32_t count) {
+  if (count == 0)
+    throw std::runtime_error("descriptor_allocator: cannot allocate 0 descriptors");
+
+  for (auto it = free_ranges_.begin(); it != free_ranges_.end(); ++it) {
+    if (it->second < count)
+      continue;
+
+    const uint32_t index = it->first;
+    const uint32_t remaining = it->second - count;
+    free_ranges_.erase(it);
+    if (remaining > 0)
+      free_ranges_[index + count] = remaining;
+
+    stats_.persistent_in_use += count;
+    stats_.peak_persistent_in_use =
+        std::max(stats_.peak_persistent_in_use, stats_.persistent_in_use);
+    return index;
+  }
+
+  ++stats_.failed_allocations;
+  return kInvalid;
+}
+
+void DescriptorAllocator::Free(uint32_t index, uint32_t count) {
+  if (count == 0 || index >= persistent_capacity_ || count > persistent_capacity_ - index) {
+    throw std::runtime_error("descriptor_allocator: " + std::to_string(count) +
+                             " descriptors at " + std::to_string(index) +
+                             " are not in the persistent region");
+  }
+
+  // The free ranges on either side must not reach into the freed one.
+  auto next = free_ranges_.lower_bound(index);
+  auto prev = next == free_ranges_.begin() ? free_ranges_.end() : std::prev(next);
+  if ((next != free_ranges_.end() && next->first < index + count) ||
+      (prev != free_ranges_.end() && prev->first + prev->second > index)) {
+    throw std::runtime_error("descriptor_allocator: freeing descriptors at " +
+                             std::to_string(index) + " that are already free");
+  }
+
+  uint32_t first = index;
+  uint32_t merged_count = count;
+  if (next != free_ranges_.end() && next->first == index + count) {
+    merged_count += next->second;
+    free_ranges_.erase(next);
+  }
+  if (prev != free_ranges_.end() && prev->first + prev->second == index) {
+    first = prev->first;
+    merged_count += prev->second;
+  }
+  free_ranges_[first] = merged_count;
+
+  stats_.persistent_in_use -= count;
+}
+
+uint32_t DescriptorAllocator::AllocateTransient(uint32_t count) {
+  if (!transient_)
+    throw std::runtime_error("descriptor_allocator: the heap has no transient region");
+
+  const uint64_t offset = transient_->Allocate(count, 1);
+  if (offset == UploadRing::kFull) {
+    ++stats_.failed_transient_allocations;
+    return kInvalid;
+  }
+  ++stats_.transient_allocations;
+  return persistent_capacity_ + static_cast<uint32_t>(offset);
+}
+
+void DescriptorAllocator::Submit(uint64_t fence_value) {
+  if (transient_)
+    transient_->Submit(fence_value);
+}
+
+void DescriptorAllocator::Retire(uint64_t completed_fence_value) {
+  if (transient_)
+    transient_->Retire(completed_fence_value);
+}
+
+uint32_t DescriptorAllocator::LargestFreeRange() const {
+  uint32_t largest = 0;
+  for (const auto& range : free_ranges_)
+    largest = std::max(largest, range.second);
+  return largest;
+}
+
+double DescriptorAllocator::Fragmentation() const {
+  if (free_slots() == 0)
+    return 0.0;
+  return 1.0 - static_cast<double>(LargestFreeRange()) / free_slots();
+}
\ No newline at end of file
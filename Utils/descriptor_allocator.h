@@ -0,0 +1,83 @@
+#ifndef DESCRIPTOR_ALLOCATOR_H_
+#define DESCRIPTOR_ALLOCATOR_H_
+
+#include <cstdint>
+#include <map>
+#include <memory>
+
+#include "upload_ring.h"
+
+// Hands out the slots of a descriptor heap, by index. The heap starts with a persistent region,
+// whose ranges are allocated and freed in any order through a free list, followed by a transient
+// region used as a ring of tables that live for one frame and are retired by fence value, like
+// UploadRing's ranges.
+class DescriptorAllocator {
+public:
+  static constexpr uint32_t kInvalid = UINT32_MAX;
+
+  struct Stats {
+    uint32_t persistent_in_use = 0;
+    uint32_t peak_persistent_in_use = 0;
+    // Allocate() calls that found no free range large enough.
+    uint64_t failed_allocations = 0;
+    uint64_t transient_allocations = 0;
+    // AllocateTransient() calls that failed because the ring was full.
+    uint64_t failed_transient_allocations = 0;
+  };
+
+  // |transient_capacity| may be 0 for heaps without per-frame tables.
+  DescriptorAllocator(uint32_t persistent_capacity, uint32_t transient_capacity);
+
+  // First index of |count| contiguous persistent slots, or kInvalid if no free range is large
+  // enough. Takes the first range that fits.
+  uint32_t Allocate(uint32_t count);
+
+  // Gives back slots from Allocate(), merging them with the free ranges next to them. Throws if
+  // they are not all in use.
+  void Free(uint32_t index, uint32_t count);
+
+  // First index of |count| contiguous transient slots, which stay valid until the fence value of
+  // the next Submit() has completed, or kInvalid if the ring is full.
+  uint32_t AllocateTransient(uint32_t count);
+
+  // As UploadRing::Submit() and UploadRing::Retire(), for the transient tables.
+  void Submit(uint64_t fence_value);
+  void Retire(uint64_t completed_fence_value);
+
+  bool has_submissions() const { return transient_ && transient_->has_submissions(); }
+  uint64_t oldest_fence_value() const { return transient_->oldest_fence_value(); }
+
+  uint32_t capacity() const { return persistent_capacity_ + transient_capacity_; }
+  uint32_t persistent_capacity() const { return persistent_capacity_; }
+  uint32_t transient_capacity() const { return transient_capacity_; }
+
+  uint32_t transient_in_use() const {
+    return transient_ ? static_cast<uint32_t>(transient_->bytes_in_use()) : 0;
+  }
+
+  // The persistent region's free slots, in how many ranges, and the largest of those.
+  uint32_t free_slots() const { return persistent_capacity_ - stats_.persistent_in_use; }
+  uint32_t free_ranges() const { return static_cast<uint32_t>(free_ranges_.size()); }
+  uint32_t LargestFreeRange() const;
+
+  // 1 - LargestFreeRange() / free_slots(): 0 when the free slots are in one range, and close to 1
+  // when they are scattered in small ones. 0 when nothing is free.
+  double Fragmentation() const;
+
+  const Stats& stats() const { return stats_; }
+
+private:
+  uint32_t persistent_capacity_;
+  uint32_t transient_capacity_;
+
+  // The persistent region's free ranges: count by first index. Neighbouring ranges are always
+  // merged.
+  std::map<uint32_t, uint32_t> free_ranges_;
+
+  // Offsets in the transient region, which starts at persistent_capacity_. Null without one.
+  std::unique_ptr<UploadRing> transient_;
+
+  Stats stats_;
+};
+
+#endif  // DESCRIPTOR_ALLOCATOR_H_
\ No newline at end of file
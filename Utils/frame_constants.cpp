@@ -0,0 +1,62 @@
+#include "frame_constants.h"
+
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+FrameConstants::FrameConstants(const std::vector<uint32_t>& block_sizes, int num_frames,
+                               uint32_t alignment)
+    : block_sizes_(block_sizes), num_frames_(num_frames) {
+  if (num_frames <= 0)
+    throw std::runtime_error("frame_constants: there must be at least one frame");
+  if (alignment == 0 || (alignment & (alignment - 1)) != 0)
+    throw std::runtime_error("frame_constants: alignment must be a power of two");
+
+  for (uint32_t size : block_sizes_) {
+    block_offsets_.push_back(frame_size_);
+    frame_size_ += (size + alignment - 1) & ~uint64_t(alignment - 1);
+  }
+  staging_.resize(frame_size_);
+
+  // Every copy starts out behind, so that the first Flush() of each frame writes everything.
+  versions_.assign(block_sizes_.size(), 1);
+  written_versions_.assign(block_sizes_.size() * num_frames_, 0);
+}
+
+bool FrameConstants::Set(int block, const void* data, size_t size) {
+  if (size != block_sizes_[block]) {
+    throw std::runtime_error("frame_constants: block " + std::to_string(block) + " holds " +
+                             std::to_string(block_sizes_[block]) + " bytes, not " +
+                             std::to_string(size));
+  }
+
+  ++stats_.sets;
+  uint8_t* staged = &staging_[block_offsets_[block]];
+  if (memcmp(staged, data, size) == 0)
+    return false;
+
+  memcpy(staged, data, size);
+  ++versions_[block];
+  ++stats_.changed_sets;
+  return true;
+}
+
+int FrameConstants::Flush(int frame, uint8_t* copies) {
+  ++stats_.flushes;
+  uint64_t* written = &written_versions_[frame * block_sizes_.size()];
+  uint8_t* frame_copies = copies + frame_size_ * frame;
+
+  int blocks_written = 0;
+  for (size_t block = 0; block < block_sizes_.size(); ++block) {
+    if (written[block] == versions_[block])
+      continue;
+
+    memcpy(frame_copies + block_offsets_[block], &staging_[block_offsets_[block]],
+           block_sizes_[block]);
+    written[block] = versions_[block];
+    ++blocks_written;
+    stats_.bytes_written += block_sizes_[block];
+  }
+  stats_.blocks_written += blocks_written;
+  return blocks_written;
+}
\ No newline at end of file
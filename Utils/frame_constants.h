@@ -0,0 +1,68 @@
+#ifndef FRAME_CONSTANTS_H_
+#define FRAME_CONSTANTS_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Constant blocks written by the CPU every frame and read by the GPU frames later. Each frame in
+// flight has its own copy of every block in one buffer, so that the CPU never writes a copy the GPU
+// may still be reading.
+//
+// Set() stages a block and gives it a new version when its contents changed. Flush() brings one
+// frame's copies up to date, writing only the blocks whose version that copy has not seen. Neither
+// allocates.
+class FrameConstants {
+public:
+  struct Stats {
+    uint64_t sets = 0;
+    // Set() calls that changed their block.
+    uint64_t changed_sets = 0;
+    uint64_t flushes = 0;
+    uint64_t blocks_written = 0;
+    uint64_t bytes_written = 0;
+  };
+
+  // Blocks of |block_sizes| bytes, with every copy of a block starting at a multiple of
+  // |alignment|, a power of two.
+  FrameConstants(const std::vector<uint32_t>& block_sizes, int num_frames, uint32_t alignment);
+
+  // Stages |size| bytes for |block|. Returns whether they differ from the block's contents. Throws
+  // if |size| is not the block's size.
+  bool Set(int block, const void* data, size_t size);
+
+  template <typename T>
+  bool Set(int block, const T& value) { return Set(block, &value, sizeof(T)); }
+
+  // Writes the blocks that changed since |frame|'s copies were last written into |copies|, the
+  // start of a buffer of size() bytes. Returns the number of blocks written.
+  int Flush(int frame, uint8_t* copies);
+
+  // Bytes for all copies of all blocks.
+  uint64_t size() const { return frame_size_ * num_frames_; }
+
+  uint64_t offset(int frame, int block) const {
+    return frame_size_ * frame + block_offsets_[block];
+  }
+
+  int num_blocks() const { return static_cast<int>(block_sizes_.size()); }
+  int num_frames() const { return num_frames_; }
+
+  const Stats& stats() const { return stats_; }
+
+private:
+  std::vector<uint32_t> block_sizes_;
+  // Where each block starts in a frame's copies and in staging_.
+  std::vector<uint64_t> block_offsets_;
+  uint64_t frame_size_ = 0;
+  int num_frames_;
+
+  std::vector<uint8_t> staging_;
+  std::vector<uint64_t> versions_;
+  // The version of each block in each frame's copies, indexed by frame * num_blocks() + block.
+  std::vector<uint64_t> written_versions_;
+
+  Stats stats_;
+};
+
+#endif  // FRAME_CONSTANTS_H_
\ No newline at end of file
@@ -0,0 +1,73 @@
+#include "gbuffer_encoding.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+constexpr float kSnorm16Max = 32767.f;
+
+// Float to 16-bit snorm, as a render target converts it.
+uint32_t ToSnorm16(float value) {
+  const float scaled = std::round(std::min(std::max(value, -1.f), 1.f) * kSnorm16Max);
+  return static_cast<uint32_t>(static_cast<int32_t>(scaled)) & 0xffff;
+}
+
+// 16-bit snorm to float. Both -32768 and -32767 are -1.
+float FromSnorm16(uint32_t bits) {
+  const int16_t value = static_cast<int16_t>(bits & 0xffff);
+  return std::max(static_cast<float>(value) / kSnorm16Max, -1.f);
+}
+
+float SignNotZero(float value) { return value >= 0.f ? 1.f : -1.f; }
+
+}  // namespace
+
+uint32_t EncodeOctahedralNormal(const float normal[3]) {
+  const float length = std::fabs(normal[0]) + std::fabs(normal[1]) + std::fabs(normal[2]);
+  if (!(length > 0.f))
+    return 0;
+
+  float x = normal[0] / length;
+  float y = normal[1] / length;
+  if (normal[2] < 0.f) {
+    // Folds the lower half over the diagonals.
+    const float folded_x = (1.f - std::fabs(y)) * SignNotZero(x);
+    const float folded_y = (1.f - std::fabs(x)) * SignNotZero(y);
+    x = folded_x;
+    y = folded_y;
+  }
+  return ToSnorm16(x) | (ToSnorm16(y) << 16);
+}
+
+void DecodeOctahedralNormal(uint32_t texel, float normal[3]) {
+  float x = FromSnorm16(texel);
+  float y = FromSnorm16(texel >> 16);
+  const float z = 1.f - std::fabs(x) - std::fabs(y);
+  if (z < 0.f) {
+    x += x >= 0.f ? z : -z;
+    y += y >= 0.f ? z : -z;
+  }
+
+  const float length = std::sqrt(x * x + y * y + z * z);
+  normal[0] = x / length;
+  normal[1] = y / length;
+  normal[2] = z / length;
+}
+
+ViewReconstruction MakeViewReconstruction(float fov_y, float aspect, float near_z, float far_z) {
+  ViewReconstruction reconstruction;
+  reconstruction.inv_proj_y = std::tan(fov_y * 0.5f);
+  reconstruction.inv_proj_x = reconstruction.inv_proj_y * aspect;
+  reconstruction.depth_scale = far_z / (far_z - near_z);
+  reconstruction.depth_offset = far_z * near_z / (far_z - near_z);
+  return reconstruction;
+}
+
+void ReconstructViewPosition(const ViewReconstruction& reconstruction, float ndc_x, float ndc_y,
+                             float depth, float view_pos[3]) {
+  const float view_z = reconstruction.depth_offset / (reconstruction.depth_scale - depth);
+  view_pos[0] = ndc_x * reconstruction.inv_proj_x * view_z;
+  view_pos[1] = ndc_y * reconstruction.inv_proj_y * view_z;
+  view_pos[2] = view_z;
+}
\ No newline at end of file
@@ -0,0 +1,45 @@
+#ifndef GBUFFER_ENCODING_H_
+#define GBUFFER_ENCODING_H_
+
+#include <cstdint>
+
+// The thin G-buffer: the geometry pass writes only an octahedral normal (R16G16_SNORM) and a
+// material index (R16_UINT). The lighting pass reconstructs the view-space position from the depth
+// buffer and looks the colors up in the material table.
+//
+// geometry_pass_ps.hlsl and lighting_pass_ps.hlsl repeat the functions below; these are the same
+// encodings in portable C++, for measuring their error without a GPU.
+
+// Material indices must fit the R16_UINT target.
+constexpr uint32_t kMaxGbufferMaterials = 65536;
+
+// Packs a normal into the two 16-bit snorm channels of an R16G16_SNORM texel, x in the low half.
+// The normal is projected onto the octahedron |x| + |y| + |z| = 1, whose lower half is folded
+// over the upper, which spreads the 32 bits evenly over the sphere. |normal| need not be unit
+// length; a zero normal encodes as +z.
+uint32_t EncodeOctahedralNormal(const float normal[3]);
+
+// Unpacks a texel written by EncodeOctahedralNormal() into a unit normal.
+void DecodeOctahedralNormal(uint32_t texel, float normal[3]);
+
+// What the lighting pass needs to turn a depth-buffer value back into a view-space position: the
+// inverse of an XMMatrixPerspectiveFovLH projection, which maps view-space depth z to
+// depth_scale - depth_offset / z.
+struct ViewReconstruction {
+  // View-space x and y per unit of depth at the right and top edges of the screen.
+  float inv_proj_x;
+  float inv_proj_y;
+  float depth_scale;
+  float depth_offset;
+};
+
+static_assert(sizeof(ViewReconstruction) == 16, "ViewReconstruction must match the HLSL struct");
+
+ViewReconstruction MakeViewReconstruction(float fov_y, float aspect, float near_z, float far_z);
+
+// View-space position of the point at normalized device coordinates (ndc_x, ndc_y) whose
+// depth-buffer value is |depth|. Depth 1, the far plane, is where nothing was drawn.
+void ReconstructViewPosition(const ViewReconstruction& reconstruction, float ndc_x, float ndc_y,
+                             float depth, float view_pos[3]);
+
+#endif  // GBUFFER_ENCODING_H_
\ No newline at end of file
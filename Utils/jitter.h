@@ -0,0 +1,29 @@
+#ifndef JITTER_H_
+#define JITTER_H_
+
+#include <cstdint>
+
+// Radical inverse of |index| in |base|: its digits mirrored around the radix point, in [0, 1).
+inline float RadicalInverse(uint32_t index, uint32_t base) {
+  const float inv_base = 1.f / static_cast<float>(base);
+
+  float scale = inv_base;
+  float result = 0.f;
+  while (index > 0) {
+    result += static_cast<float>(index % base) * scale;
+    index /= base;
+    scale *= inv_base;
+  }
+  return result;
+}
+
+// Subpixel offset in [0, 1)^2 for frame |frame_index| of a progressive render, in pixels from the
+// pixel's top-left corner. The (2, 3) Halton sequence covers the pixel evenly after any number of
+// frames. Frame 0 gets (0, 0), the corner the renderers sample without jitter, so a single frame
+// looks the same as before.
+inline void GetSubpixelJitter(uint32_t frame_index, float* x, float* y) {
+  *x = RadicalInverse(frame_index, 2);
+  *y = RadicalInverse(frame_index, 3);
+}
+
+#endif  // JITTER_H_
\ No newline at end of file
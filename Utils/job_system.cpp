@@ -0,0 +1,452 @@
+#include "job_system.h"
+
+#include <condition_variable>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace {
+
+// The system and index of the calling thread, set for the creating thread and each worker.
+thread_local const JobSystem* t_system = nullptr;
+thread_local int t_thread_index = -1;
+
+// Initial capacity of each deque, a power of two. A full deque doubles.
+constexpr int64_t kInitialDequeCapacity = 256;
+
+// Rounds of stealing an idle worker tries before it sleeps.
+constexpr int kStealRoundsBeforeSleep = 64;
+
+// Job records in each system's pool. The BVH builds and loops here keep far fewer pending at once;
+// past that, starting a job runs others first.
+constexpr uint32_t kJobPoolSize = 4096;
+
+// Holds a Counter's lock for its scope.
+class CounterLock {
+public:
+  explicit CounterLock(std::atomic<bool>* locked) : locked_(locked) {
+    while (locked_->exchange(true, std::memory_order_acquire)) {
+      while (locked_->load(std::memory_order_relaxed))
+        std::this_thread::yield();
+    }
+  }
+  ~CounterLock() { locked_->store(false, std::memory_order_release); }
+
+  CounterLock(const CounterLock&) = delete;
+  CounterLock& operator=(const CounterLock&) = delete;
+
+private:
+  std::atomic<bool>* locked_;
+};
+
+}  // namespace
+
+struct JobSystem::Job {
+  JobFn fn;
+  Counter* counter;
+  // The next continuation of the counter the job waits for.
+  Job* next;
+  // The next free record while the job is in the pool, as an index plus one, or 0 for none.
+  std::atomic<uint32_t> next_free;
+  // The thread whose deque the job was pushed to.
+  int owner;
+  alignas(std::max_align_t) unsigned char data[kMaxJobSize];
+};
+
+// A free list of job records, which any thread takes from and returns to. The head packs the
+// first free record, as an index plus one, with a count of the changes to it, so that a thread
+// that read a record's successor before another took and returned that record fails its
+// compare-exchange.
+class JobPool {
+public:
+  using Job = JobSystem::Job;
+
+  JobPool() : jobs_(new Job[kJobPoolSize]) {
+    for (uint32_t i = 0; i < kJobPoolSize; ++i)
+      jobs_[i].next_free.store(i + 1 < kJobPoolSize ? i + 2 : 0, std::memory_order_relaxed);
+    head_.store(1, std::memory_order_relaxed);
+  }
+
+  // Returns nullptr when every record is in use.
+  Job* Take() {
+    uint64_t head = head_.load(std::memory_order_acquire);
+    for (;;) {
+      const uint32_t first = static_cast<uint32_t>(head);
+      if (first == 0)
+        return nullptr;
+      const uint64_t next = jobs_[first - 1].next_free.load(std::memory_order_relaxed);
+      if (head_.compare_exchange_weak(head, ((head >> 32) + 1) << 32 | next,
+                                      std::memory_order_acquire, std::memory_order_acquire))
+        return &jobs_[first - 1];
+    }
+  }
+
+  void Return(Job* job) {
+    const uint64_t index = static_cast<uint64_t>(job - jobs_.get()) + 1;
+    uint64_t head = head_.load(std::memory_order_relaxed);
+    do {
+      job->next_free.store(static_cast<uint32_t>(head), std::memory_order_relaxed);
+    } while (!head_.compare_exchange_weak(head, ((head >> 32) + 1) << 32 | index,
+                                          std::memory_order_release, std::memory_order_relaxed));
+  }
+
+private:
+  std::unique_ptr<Job[]> jobs_;
+  std::atomic<uint64_t> head_{0};
+};
+
+// Chase-Lev deque, with the memory orders of Le et al., "Correct and Efficient Work-Stealing for
+// Weak Memory Models". Only the owning thread calls Push() and Pop(); any thread calls Steal().
+// Arrays outgrown by Push() stay alive until the deque is destroyed, since a thief may still be
+// reading one.
+class JobSystem::Deque {
+public:
+  Deque() {
+    arrays_.emplace_back(new Array(kInitialDequeCapacity));
+    array_.store(arrays_.back().get(), std::memory_order_relaxed);
+  }
+
+  void Push(Job* job) {
+    const int64_t bottom = bottom_.load(std::memory_order_relaxed);
+    const int64_t top = top_.load(std::memory_order_acquire);
+    Array* array = array_.load(std::memory_order_relaxed);
+    if (bottom - top > array->capacity - 1) {
+      Array* grown = new Array(array->capacity * 2);
+      for (int64_t i = top; i < bottom; ++i)
+        grown->Put(i, array->Get(i));
+      arrays_.emplace_back(grown);
+      array_.store(grown, std::memory_order_release);
+      array = grown;
+    }
+    array->Put(bottom, job);
+    std::atomic_thread_fence(std::memory_order_release);
+    bottom_.store(bottom + 1, std::memory_order_relaxed);
+  }
+
+  Job* Pop() {
+    const int64_t bottom = bottom_.load(std::memory_order_relaxed) - 1;
+    Array* array = array_.load(std::memory_order_relaxed);
+    bottom_.store(bottom, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    int64_t top = top_.load(std::memory_order_relaxed);
+
+    if (top > bottom) {
+      bottom_.store(bottom + 1, std::memory_order_relaxed);
+      return nullptr;
+    }
+
+    Job* job = array->Get(bottom);
+    if (top == bottom) {
+      // The last job, which a thief may be taking at the same time.
+      if (!top_.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst,
+                                        std::memory_order_relaxed))
+        job = nullptr;
+      bottom_.store(bottom + 1, std::memory_order_relaxed);
+    }
+    return job;
+  }
+
+  Job* Steal() {
+    int64_t top = top_.load(std::memory_order_acquire);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    const int64_t bottom = bottom_.load(std::memory_order_acquire);
+    if (top >= bottom)
+      return nullptr;
+
+    Array* array = array_.load(std::memory_order_acquire);
+    Job* job = array->Get(top);
+    if (!top_.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst,
+                                      std::memory_order_relaxed))
+      return nullptr;
+    return job;
+  }
+
+private:
+  struct Array {
+    explicit Array(int64_t capacity)
+        : capacity(capacity), jobs(new std::atomic<Job*>[capacity]) {}
+
+    Job* Get(int64_t i) const {
+      return jobs[i & (capacity - 1)].load(std::memory_order_relaxed);
+    }
+    void Put(int64_t i, Job* job) {
+      jobs[i & (capacity - 1)].store(job, std::memory_order_relaxed);
+    }
+
+    const int64_t capacity;
+    std::unique_ptr<std::atomic<Job*>[]> jobs;
+  };
+
+  // On their own cache lines, since the thieves write top_ and the owner writes bottom_. The
+  // Workers that hold the deques are created with new, which honors the alignment since C++17.
+  alignas(64) std::atomic<int64_t> top_{0};
+  alignas(64) std::atomic<int64_t> bottom_{0};
+  std::atomic<Array*> array_{nullptr};
+  std::vector<std::unique_ptr<Array>> arrays_;
+};
+
+struct JobSystem::Worker {
+  Deque deque;
+  std::atomic<uint64_t> jobs{0};
+  std::atomic<uint64_t> steals{0};
+  // Where the worker starts looking for jobs to steal, moved on after each try so that thieves
+  // spread over the victims.
+  int next_victim = 0;
+};
+
+struct JobSystem::State {
+  std::vector<std::unique_ptr<Worker>> workers;
+  std::vector<std::thread> threads;
+  JobPool pool;
+
+  // Jobs pushed and not yet taken, which the sleeping workers wait for.
+  std::atomic<int> queued{0};
+  std::atomic<int> sleeping{0};
+  std::mutex mutex;
+  std::condition_variable work_available;
+  std::atomic<bool> exiting{false};
+};
+
+JobSystem::JobSystem(int num_threads) : state_(new State) {
+  if (num_threads <= 0)
+    num_threads = static_cast<int>(std::thread::hardware_concurrency());
+  if (num_threads <= 0)
+    num_threads = 1;
+  if (t_system != nullptr)
+    throw std::runtime_error("job_system: a thread may only create one job system at a time");
+
+  num_threads_ = num_threads;
+  for (int i = 0; i < num_threads; ++i) {
+    state_->workers.emplace_back(new Worker);
+    state_->workers.back()->next_victim = (i + 1) % num_threads;
+  }
+
+  t_system = this;
+  t_thread_index = 0;
+  for (int i = 1; i < num_threads; ++i)
+    state_->threads.emplace_back(&JobSystem::WorkerMain, this, i);
+}
+
+JobSystem::~JobSystem() {
+  {
+    std::lock_guard<std::mutex> lock(state_->mutex);
+    state_->exiting.store(true);
+  }
+  state_->work_available.notify_all();
+
+  for (std::thread& thread : state_->threads)
+    thread.join();
+
+  t_system = nullptr;
+  t_thread_index = -1;
+}
+
+bool JobSystem::Counter::done() {
+  if (count_.load(std::memory_order_acquire) != 0)
+    return false;
+  // The job that brought the count to zero may still hold the lock, and the counter must outlive
+  // it.
+  CounterLock lock(&locked_);
+  return true;
+}
+
+JobSystem::Job* JobSystem::AllocateJob(JobFn fn, Counter* counter) {
+  const int index = thread_index();
+  Job* job;
+  while ((job = state_->pool.Take()) == nullptr) {
+    // Every record is held by a pending job, which finishing returns.
+    if (!RunOne(index))
+      std::this_thread::yield();
+  }
+
+  if (counter != nullptr)
+    counter->count_.fetch_add(1, std::memory_order_relaxed);
+  job->fn = fn;
+  job->counter = counter;
+  job->next = nullptr;
+  job->owner = index;
+  return job;
+}
+
+void* JobSystem::JobData(Job* job) {
+  return job->data;
+}
+
+void JobSystem::Start(Counter* dependency, Job* job) {
+  if (dependency != nullptr) {
+    // The count only reaches zero with the lock held.
+    CounterLock lock(&dependency->locked_);
+    if (dependency->count_.load(std::memory_order_acquire) != 0) {
+      job->next = dependency->continuations_;
+      dependency->continuations_ = job;
+      return;
+    }
+  }
+  Push(job->owner, job);
+}
+
+void JobSystem::Wait(Counter* counter) {
+  const int index = thread_index();
+  while (!counter->done()) {
+    if (!RunOne(index))
+      std::this_thread::yield();
+  }
+
+  if (counter->exception_) {
+    std::exception_ptr exception = std::move(counter->exception_);
+    counter->exception_ = nullptr;
+    std::rethrow_exception(exception);
+  }
+}
+
+void JobSystem::Push(int thread_index, Job* job) {
+  // A worker about to sleep either sees the new job in queued or is counted in sleeping, since
+  // both are sequentially consistent.
+  state_->queued.fetch_add(1);
+  state_->workers[thread_index]->deque.Push(job);
+  if (state_->sleeping.load() > 0) {
+    std::lock_guard<std::mutex> lock(state_->mutex);
+    state_->work_available.notify_one();
+  }
+}
+
+void JobSystem::Fail(Counter* counter, std::exception_ptr exception) {
+  CounterLock lock(&counter->locked_);
+  if (!counter->exception_)
+    counter->exception_ = std::move(exception);
+}
+
+void JobSystem::Finish(int thread_index, Counter* counter) {
+  // Counts down without the lock while other jobs are left.
+  int count = counter->count_.load(std::memory_order_relaxed);
+  while (count > 1) {
+    if (counter->count_.compare_exchange_weak(count, count - 1, std::memory_order_release,
+                                              std::memory_order_relaxed))
+      return;
+  }
+
+  Job* ready = nullptr;
+  {
+    CounterLock lock(&counter->locked_);
+    if (counter->count_.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+      ready = counter->continuations_;
+      counter->continuations_ = nullptr;
+    }
+  }
+  // The counter may be gone from here on.
+  while (ready != nullptr) {
+    Job* job = ready;
+    ready = job->next;
+    job->owner = thread_index;
+    Push(thread_index, job);
+  }
+}
+
+void JobSystem::RunLoop(int count, int grain, LoopFn fn, const void* data) {
+  if (count <= 0)
+    return;
+  if (grain < 1)
+    grain = 1;
+
+  Counter counter;
+  try {
+    RunRange(0, count, grain, fn, data, &counter);
+  } catch (...) {
+    // The halves handed to other threads still use the counter, so it is reported after them.
+    Fail(&counter, std::current_exception());
+  }
+  Wait(&counter);
+}
+
+int JobSystem::thread_index() const {
+  if (t_system != this)
+    throw std::runtime_error("job_system: called from a thread that is not the system's");
+  return t_thread_index;
+}
+
+JobSystem::Stats JobSystem::stats() const {
+  Stats stats;
+  for (const std::unique_ptr<Worker>& worker : state_->workers) {
+    stats.jobs += worker->jobs.load(std::memory_order_relaxed);
+    stats.steals += worker->steals.load(std::memory_order_relaxed);
+  }
+  return stats;
+}
+
+void JobSystem::WorkerMain(int thread_index) {
+  t_system = this;
+  t_thread_index = thread_index;
+
+  State& state = *state_;
+  int idle_rounds = 0;
+  while (!state.exiting.load(std::memory_order_relaxed)) {
+    if (RunOne(thread_index)) {
+      idle_rounds = 0;
+      continue;
+    }
+    if (++idle_rounds < kStealRoundsBeforeSleep) {
+      std::this_thread::yield();
+      continue;
+    }
+
+    std::unique_lock<std::mutex> lock(state.mutex);
+    state.sleeping.fetch_add(1);
+    state.work_available.wait(lock,
+                              [&state] { return state.exiting.load() || state.queued.load() > 0; });
+    state.sleeping.fetch_sub(1);
+    idle_rounds = 0;
+  }
+}
+
+bool JobSystem::RunOne(int thread_index) {
+  State& state = *state_;
+  Worker& self = *state.workers[thread_index];
+  Job* job = self.deque.Pop();
+
+  for (int i = 0; job == nullptr && i < num_threads_ - 1; ++i) {
+    const int victim = self.next_victim;
+    self.next_victim = (victim + 1) % num_threads_;
+    if (self.next_victim == thread_index)
+      self.next_victim = (self.next_victim + 1) % num_threads_;
+    if (victim != thread_index)
+      job = state.workers[victim]->deque.Steal();
+  }
+  if (job == nullptr)
+    return false;
+
+  state.queued.fetch_sub(1);
+  self.jobs.fetch_add(1, std::memory_order_relaxed);
+  if (job->owner != thread_index)
+    self.steals.fetch_add(1, std::memory_order_relaxed);
+
+  if (job->counter == nullptr) {
+    job->fn(job->data, thread_index);
+  } else {
+    try {
+      job->fn(job->data, thread_index);
+    } catch (...) {
+      Fail(job->counter, std::current_exception());
+    }
+  }
+  if (job->counter != nullptr)
+    Finish(thread_index, job->counter);
+  state.pool.Return(job);
+  return true;
+}
+
+// Hands the upper half of the range to the deque until at most |grain| indices are left, which
+// run here. A thief takes the oldest, largest half and splits it the same way.
+void JobSystem::RunRange(int begin, int end, int grain, LoopFn fn, const void* data,
+                         Counter* counter) {
+  while (end - begin > grain) {
+    const int middle = begin + (end - begin) / 2;
+    Run([=](int) { RunRange(middle, end, grain, fn, data, counter); }, counter);
+    end = middle;
+  }
+
+  const int index = thread_index();
+  for (int i = begin; i < end; ++i)
+    fn(data, i, index);
+}
\ No newline at end of file
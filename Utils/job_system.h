@@ -0,0 +1,164 @@
+#ifndef JOB_SYSTEM_H_
+#define JOB_SYSTEM_H_
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <memory>
+#include <new>
+#include <type_traits>
+
+// Work-stealing scheduler for jobs that spawn more jobs, such as the subtrees of a BVH build, as
+// well as flat loops. Every thread, the one that creates the JobSystem included, has a Chase-Lev
+// deque: it pushes and pops its own jobs at the bottom, newest first, while idle threads steal
+// the oldest, and so largest, jobs from the top of the others.
+//
+// A Counter counts the unfinished jobs started with it. Wait() runs other jobs until the counter
+// reaches zero instead of blocking, so a job may wait for the jobs it started itself without tying
+// up its thread. A job that depends on jobs it did not start is started with RunAfter() instead,
+// since waiting for them could leave one of them stuck below the wait on the same thread. Only the
+// creating thread and the jobs themselves may use a JobSystem.
+//
+// An exception a job throws is kept by its counter, the first one only, and Wait() rethrows it on
+// the waiting thread once every job the counter counted has finished. A job started without a
+// counter must not throw, since nothing could report it.
+//
+// Jobs are copied into fixed-size records from a pool the system allocates up front, so starting
+// one allocates nothing. While every record is in use, starting a job runs other jobs until one is
+// free.
+class JobSystem {
+public:
+  struct Job;
+
+  // Bytes a job's callable may take, e.g. a lambda that captures up to eight pointers.
+  static constexpr size_t kMaxJobSize = 64;
+
+  class Counter {
+  public:
+    Counter() = default;
+    Counter(const Counter&) = delete;
+    Counter& operator=(const Counter&) = delete;
+
+    // Whether the count is zero, with every job it counted finished with the counter.
+    bool done();
+
+  private:
+    friend class JobSystem;
+    std::atomic<int> count_{0};
+    // Held while the count goes from 1 to 0 and the continuations are taken, so that neither
+    // RunAfter() nor the end of Wait() can come in between. Spun on, since it is only held for a
+    // few instructions.
+    std::atomic<bool> locked_{false};
+    // The jobs waiting for the count to reach zero, linked through Job::next.
+    Job* continuations_ = nullptr;
+    // The first exception a counted job threw, guarded by locked_.
+    std::exception_ptr exception_;
+  };
+
+  struct Stats {
+    uint64_t jobs = 0;
+    // Jobs run by a thread other than the one that started them.
+    uint64_t steals = 0;
+  };
+
+  // |num_threads| counts the creating thread. 0 uses one thread per hardware thread.
+  explicit JobSystem(int num_threads = 0);
+  ~JobSystem();
+
+  JobSystem(const JobSystem&) = delete;
+  JobSystem& operator=(const JobSystem&) = delete;
+
+  int num_threads() const { return num_threads_; }
+
+  // Starts a copy of |job|, which the calling thread or any other may run, as |job(thread_index)|.
+  // |counter|, if not null, counts it until it returns. |job| must fit in kMaxJobSize bytes and be
+  // trivially destructible, as lambdas that capture pointers, references and numbers are.
+  template <typename Fn>
+  void Run(const Fn& job, Counter* counter) {
+    Start(nullptr, NewJob(job, counter));
+  }
+
+  // Like Run(), but |job| starts only once |dependency| has reached zero, which it may have
+  // already. |counter| counts it from now on.
+  template <typename Fn>
+  void RunAfter(Counter* dependency, const Fn& job, Counter* counter) {
+    Start(dependency, NewJob(job, counter));
+  }
+
+  // Runs other jobs until |counter| reaches zero, then rethrows the first exception a job it
+  // counted threw, if any.
+  void Wait(Counter* counter);
+
+  // Calls |fn(index, thread_index)| for every index in [0, count) and returns once all calls have
+  // finished. The range is split in halves down to |grain| indices, so that idle threads steal
+  // large pieces. thread_index is in [0, num_threads()) and, unless |fn| waits, unique among
+  // concurrent calls, for per-thread scratch data. If calls throw, the first exception is rethrown
+  // once all calls have finished.
+  template <typename Fn>
+  void ParallelFor(int count, int grain, const Fn& fn) {
+    RunLoop(count, grain, &CallLoop<Fn>, &fn);
+  }
+  template <typename Fn>
+  void ParallelFor(int count, const Fn& fn) {
+    ParallelFor(count, 1, fn);
+  }
+
+  // The index of the calling thread, which must be one of this system's.
+  int thread_index() const;
+
+  Stats stats() const;
+
+private:
+  class Deque;
+  struct Worker;
+  struct State;
+
+  using JobFn = void (*)(const void* data, int thread_index);
+  using LoopFn = void (*)(const void* fn, int index, int thread_index);
+
+  template <typename Fn>
+  static void CallJob(const void* data, int thread_index) {
+    (*static_cast<const Fn*>(data))(thread_index);
+  }
+  template <typename Fn>
+  static void CallLoop(const void* fn, int index, int thread_index) {
+    (*static_cast<const Fn*>(fn))(index, thread_index);
+  }
+
+  template <typename Fn>
+  Job* NewJob(const Fn& fn, Counter* counter) {
+    static_assert(sizeof(Fn) <= kMaxJobSize && alignof(Fn) <= alignof(std::max_align_t),
+                  "job_system: the job does not fit in a job record");
+    static_assert(std::is_trivially_destructible<Fn>::value,
+                  "job_system: job records are reused without destroying the job");
+    Job* job = AllocateJob(&CallJob<Fn>, counter);
+    new (JobData(job)) Fn(fn);
+    return job;
+  }
+
+  // Takes a record from the pool for a job that runs as |fn(data, thread_index)|, with its
+  // callable in JobData(), and counts it in |counter|.
+  Job* AllocateJob(JobFn fn, Counter* counter);
+  static void* JobData(Job* job);
+  // Pushes |job| to the calling thread's deque, once |dependency| has reached zero if it is not
+  // null.
+  void Start(Counter* dependency, Job* job);
+  void Push(int thread_index, Job* job);
+  // Keeps |exception| in |counter| unless it already holds one.
+  static void Fail(Counter* counter, std::exception_ptr exception);
+  // Counts down |counter| for a finished job and starts its continuations if it reached zero.
+  void Finish(int thread_index, Counter* counter);
+  void WorkerMain(int thread_index);
+  // Runs one job from the thread's own deque or stolen from another. Returns false if there was
+  // none.
+  bool RunOne(int thread_index);
+  void RunLoop(int count, int grain, LoopFn fn, const void* data);
+  void RunRange(int begin, int end, int grain, LoopFn fn, const void* data, Counter* counter);
+
+  int num_threads_;
+  // The workers, their threads and the job pool, which only job_system.cpp needs to see.
+  std::unique_ptr<State> state_;
+};
+
+#endif  // JOB_SYSTEM_H_
\ No newline at end of file
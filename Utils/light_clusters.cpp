@@ -0,0 +1,190 @@
+#include "light_clusters.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <random>
+
+namespace {
+
+// Cluster bounds are padded by this fraction of their far depth, so a pixel that rounding puts
+// just outside its cluster's box cannot lose a light that reaches it.
+constexpr float kBoundsPadding = 1e-4f;
+
+constexpr float kInfinity = std::numeric_limits<float>::infinity();
+
+// Near and far view-space depth of slice |z|, before padding.
+void GetSliceDepths(uint32_t z, float* near_z, float* far_z) {
+  const float ratio = kClusterFarZ / kClusterNearZ;
+  *near_z = z == 0 ? 0.f
+                   : kClusterNearZ * std::pow(ratio, static_cast<float>(z) / kClusterGridZ);
+  *far_z = z + 1 == kClusterGridZ
+               ? kClusterFarZ
+               : kClusterNearZ * std::pow(ratio, static_cast<float>(z + 1) / kClusterGridZ);
+}
+
+// Distance from |center| to the range [low, high] along one axis, or 0 inside it.
+float AxisDistance(float center, float low, float high) {
+  return std::max(std::max(low - center, center - high), 0.f);
+}
+
+// Appends light |index| to |cluster|'s list, or returns false if the list is full.
+bool AddLight(uint32_t cluster, uint32_t index, LightClusterGrid* grid) {
+  uint32_t& count = grid->counts[cluster];
+  if (count == kMaxLightsPerCluster)
+    return false;
+  grid->indices[static_cast<size_t>(cluster) * kMaxLightsPerCluster + count++] = index;
+  return true;
+}
+
+}  // namespace
+
+ClusterConstants MakeClusterConstants(int width, int height, float fov_y, uint32_t num_lights) {
+  ClusterConstants constants{};
+  constants.tan_half_fov_y = std::tan(fov_y * 0.5f);
+  constants.tan_half_fov_x =
+      constants.tan_half_fov_y * static_cast<float>(width) / static_cast<float>(height);
+  constants.tile_width = static_cast<float>(width) / kClusterGridX;
+  constants.tile_height = static_cast<float>(height) / kClusterGridY;
+  constants.slice_scale = kClusterGridZ / std::log(kClusterFarZ / kClusterNearZ);
+  constants.slice_bias = -std::log(kClusterNearZ) * constants.slice_scale;
+  constants.num_lights = num_lights;
+  return constants;
+}
+
+uint32_t ClusterSlice(const ClusterConstants& constants, float view_z) {
+  if (!(view_z > 0.f))
+    return 0;
+  const float slice = std::floor(std::log(view_z) * constants.slice_scale + constants.slice_bias);
+  return static_cast<uint32_t>(std::min(std::max(slice, 0.f), kClusterGridZ - 1.f));
+}
+
+uint32_t ClusterOfPixel(const ClusterConstants& constants, float pixel_x, float pixel_y,
+                        float view_z) {
+  const float tile_x = std::floor(pixel_x / constants.tile_width);
+  const float tile_y = std::floor(pixel_y / constants.tile_height);
+  const uint32_t x = static_cast<uint32_t>(std::min(std::max(tile_x, 0.f), kClusterGridX - 1.f));
+  const uint32_t y = static_cast<uint32_t>(std::min(std::max(tile_y, 0.f), kClusterGridY - 1.f));
+  return ClusterIndex(x, y, ClusterSlice(constants, view_z));
+}
+
+void GetClusterBounds(const ClusterConstants& constants, uint32_t x, uint32_t y, uint32_t z,
+                      float bounds_min[3], float bounds_max[3]) {
+  float near_z;
+  float far_z;
+  GetSliceDepths(z, &near_z, &far_z);
+
+  // The tile's edges in NDC, y up.
+  const float ndc_x[2] = {2.f * x / kClusterGridX - 1.f, 2.f * (x + 1) / kClusterGridX - 1.f};
+  const float ndc_y[2] = {1.f - 2.f * (y + 1) / kClusterGridY, 1.f - 2.f * y / kClusterGridY};
+
+  // The froxel's corners lie on its near and far planes; the box holds all eight.
+  const float depths[2] = {near_z, far_z};
+  bounds_min[0] = bounds_min[1] = kInfinity;
+  bounds_max[0] = bounds_max[1] = -kInfinity;
+  for (float depth : depths) {
+    for (int i = 0; i < 2; ++i) {
+      const float view_x = ndc_x[i] * depth * constants.tan_half_fov_x;
+      const float view_y = ndc_y[i] * depth * constants.tan_half_fov_y;
+      bounds_min[0] = std::min(bounds_min[0], view_x);
+      bounds_max[0] = std::max(bounds_max[0], view_x);
+      bounds_min[1] = std::min(bounds_min[1], view_y);
+      bounds_max[1] = std::max(bounds_max[1], view_y);
+    }
+  }
+  bounds_min[2] = near_z;
+  bounds_max[2] = far_z;
+
+  const float padding = far_z * kBoundsPadding;
+  for (int axis = 0; axis < 3; ++axis) {
+    bounds_min[axis] -= padding;
+    bounds_max[axis] += padding;
+  }
+}
+
+bool LightTouchesBox(const PointLight& light, const float bounds_min[3],
+                     const float bounds_max[3]) {
+  float distance_squared = 0.f;
+  for (int axis = 0; axis < 3; ++axis) {
+    const float distance = AxisDistance(light.view_pos[axis], bounds_min[axis], bounds_max[axis]);
+    distance_squared += distance * distance;
+  }
+  return distance_squared <= light.radius * light.radius;
+}
+
+uint32_t BuildClusterSlice(const ClusterConstants& constants, const PointLight* lights,
+                           uint32_t z, LightClusterGrid* grid) {
+  float bounds_min[kClusterGridX * kClusterGridY][3];
+  float bounds_max[kClusterGridX * kClusterGridY][3];
+  for (uint32_t y = 0; y < kClusterGridY; ++y) {
+    for (uint32_t x = 0; x < kClusterGridX; ++x) {
+      const uint32_t tile = y * kClusterGridX + x;
+      GetClusterBounds(constants, x, y, z, bounds_min[tile], bounds_max[tile]);
+      grid->counts[ClusterIndex(x, y, z)] = 0;
+    }
+  }
+
+  // Every cluster of the slice has the same depth range. A light too far from it along z is
+  // rejected by LightTouchesBox for every cluster, since the distance squared it sums can only
+  // grow past the z term.
+  const float slice_min_z = bounds_min[0][2];
+  const float slice_max_z = bounds_max[0][2];
+  bool overflowed[kClusterGridX * kClusterGridY] = {};
+  for (uint32_t i = 0; i < constants.num_lights; ++i) {
+    const PointLight& light = lights[i];
+    const float distance_z = AxisDistance(light.view_pos[2], slice_min_z, slice_max_z);
+    if (distance_z * distance_z > light.radius * light.radius)
+      continue;
+
+    for (uint32_t tile = 0; tile < kClusterGridX * kClusterGridY; ++tile) {
+      if (LightTouchesBox(light, bounds_min[tile], bounds_max[tile]))
+        overflowed[tile] |= !AddLight(z * kClusterGridX * kClusterGridY + tile, i, grid);
+    }
+  }
+  return static_cast<uint32_t>(std::count(overflowed, overflowed + kClusterGridX * kClusterGridY,
+                                          true));
+}
+
+void BuildLightClustersBruteForce(const ClusterConstants& constants, const PointLight* lights,
+                                  LightClusterGrid* grid) {
+  grid->overflowed = 0;
+  for (uint32_t z = 0; z < kClusterGridZ; ++z) {
+    for (uint32_t y = 0; y < kClusterGridY; ++y) {
+      for (uint32_t x = 0; x < kClusterGridX; ++x) {
+        float bounds_min[3];
+        float bounds_max[3];
+        GetClusterBounds(constants, x, y, z, bounds_min, bounds_max);
+
+        const uint32_t cluster = ClusterIndex(x, y, z);
+        grid->counts[cluster] = 0;
+        bool overflowed = false;
+        for (uint32_t i = 0; i < constants.num_lights; ++i) {
+          if (LightTouchesBox(lights[i], bounds_min, bounds_max))
+            overflowed |= !AddLight(cluster, i, grid);
+        }
+        grid->overflowed += overflowed;
+      }
+    }
+  }
+}
+
+std::vector<PointLight> MakeRandomPointLights(uint32_t count, uint32_t seed) {
+  std::mt19937 rng(seed);
+  std::uniform_real_distribution<float> unit(0.f, 1.f);
+
+  // About the same number of lights reach each point whatever the count.
+  const float base_radius =
+      std::min(0.6f, 0.6f * std::cbrt(64.f / static_cast<float>(std::max(count, 1u))));
+
+  std::vector<PointLight> lights(count);
+  for (PointLight& light : lights) {
+    light.view_pos[0] = unit(rng) * 2.f - 1.f;
+    light.view_pos[1] = unit(rng) * 2.f;
+    light.view_pos[2] = unit(rng) * 2.f - 1.f;
+    light.radius = base_radius * (0.75f + 0.5f * unit(rng));
+    for (float& channel : light.color)
+      channel = 0.25f * unit(rng);
+    light.padding = 0.f;
+  }
+  return lights;
+}
\ No newline at end of file
@@ -0,0 +1,119 @@
+#ifndef LIGHT_CLUSTERS_H_
+#define LIGHT_CLUSTERS_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Clustered lighting: the view frustum is cut into kClusterGridX x kClusterGridY screen tiles by
+// kClusterGridZ depth slices, and each of these froxels (clusters) lists the point lights whose
+// sphere of influence reaches it. The lighting pass only loops over the lights of the pixel's
+// cluster instead of over every light in the scene.
+//
+// cluster_build_cs.hlsl builds the lists on the GPU and lighting_pass_ps.hlsl reads them; both
+// repeat the constants and layouts below. The functions here are the same build in portable C++,
+// for checking and timing it without a GPU.
+
+constexpr uint32_t kClusterGridX = 16;
+constexpr uint32_t kClusterGridY = 9;
+constexpr uint32_t kClusterGridZ = 24;
+constexpr uint32_t kNumClusters = kClusterGridX * kClusterGridY * kClusterGridZ;
+
+// Each cluster has a fixed-size slot of light indices. Lights past the limit are dropped.
+constexpr uint32_t kMaxLightsPerCluster = 256;
+
+// View-space depths the slices cover, spaced exponentially so froxels stay roughly cubic. The first
+// slice reaches down to the camera. Pixels beyond kClusterFarZ use the last slice, so they may miss
+// lights that do not reach it.
+constexpr float kClusterNearZ = 0.1f;
+constexpr float kClusterFarZ = 20.f;
+
+// A point light as the lights StructuredBuffer stores it. Its light falls off smoothly to zero at
+// |radius|, so it cannot reach pixels outside that sphere. DeferredShading uploads world-space
+// positions in |view_pos|; its cluster build moves them into each frame's view once and writes
+// the view-space lights the lighting pass reads.
+struct PointLight {
+  float view_pos[3];
+  float radius;
+  float color[3];
+  float padding;
+};
+
+static_assert(sizeof(PointLight) == 32, "PointLight must match the HLSL struct");
+
+// The cluster constant buffer.
+struct ClusterConstants {
+  // View-space x and y per unit of depth at the right and top edges of the screen.
+  float tan_half_fov_x;
+  float tan_half_fov_y;
+  // Screen pixels per cluster tile.
+  float tile_width;
+  float tile_height;
+
+  // A view-space depth z is in slice floor(log(z) * slice_scale + slice_bias).
+  float slice_scale;
+  float slice_bias;
+  uint32_t num_lights;
+  uint32_t padding;
+};
+
+static_assert(sizeof(ClusterConstants) == 32, "ClusterConstants must match the HLSL cbuffer");
+
+// Constants for a |width| x |height| viewport with a vertical field of view of |fov_y| radians,
+// as XMMatrixPerspectiveFovLH takes it.
+ClusterConstants MakeClusterConstants(int width, int height, float fov_y, uint32_t num_lights);
+
+// Index of cluster (x, y, z): x fastest, then y.
+inline uint32_t ClusterIndex(uint32_t x, uint32_t y, uint32_t z) {
+  return (z * kClusterGridY + y) * kClusterGridX + x;
+}
+
+// Slice of view-space depth |view_z|, clamped to the grid.
+uint32_t ClusterSlice(const ClusterConstants& constants, float view_z);
+
+// Cluster of the pixel whose center is at (pixel_x, pixel_y), as SV_Position gives it, and whose
+// view-space depth is |view_z|.
+uint32_t ClusterOfPixel(const ClusterConstants& constants, float pixel_x, float pixel_y,
+                        float view_z);
+
+// View-space bounding box of cluster (x, y, z).
+void GetClusterBounds(const ClusterConstants& constants, uint32_t x, uint32_t y, uint32_t z,
+                      float bounds_min[3], float bounds_max[3]);
+
+// Whether |light|'s sphere reaches the box.
+bool LightTouchesBox(const PointLight& light, const float bounds_min[3],
+                     const float bounds_max[3]);
+
+// The light lists, in the layout of the GPU buffers: cluster i has counts[i] light indices, in
+// increasing order, from indices[i * kMaxLightsPerCluster] on.
+struct LightClusterGrid {
+  std::vector<uint32_t> counts;
+  std::vector<uint32_t> indices;
+  // Clusters that reached more lights than they could list.
+  uint32_t overflowed = 0;
+
+  void Resize() {
+    counts.resize(kNumClusters);
+    indices.resize(static_cast<size_t>(kNumClusters) * kMaxLightsPerCluster);
+  }
+};
+
+// Builds the lists of slice |z|, whose clusters are independent of every other slice's, so slices
+// can be built in parallel. The GPU tests every light against every cluster; this first keeps the
+// lights whose depth range reaches the slice, then tests those against the slice's clusters, which
+// gives the same lists. |grid| must have been resized. Returns the slice's overflowed clusters,
+// which the caller adds up.
+uint32_t BuildClusterSlice(const ClusterConstants& constants, const PointLight* lights,
+                           uint32_t z, LightClusterGrid* grid);
+
+// Tests every light against every cluster, like cluster_build_cs.hlsl, and counts the overflowed
+// clusters. For checking BuildClusterSlice.
+void BuildLightClustersBruteForce(const ClusterConstants& constants, const PointLight* lights,
+                                  LightClusterGrid* grid);
+
+// |count| lights scattered through the volume of the Cornell box, with their positions in world
+// space; transform them to view space before building. The radii shrink as the count grows, so
+// about the same number of lights reach each point.
+std::vector<PointLight> MakeRandomPointLights(uint32_t count, uint32_t seed);
+
+#endif  // LIGHT_CLUSTERS_H_
\ No newline at end of file
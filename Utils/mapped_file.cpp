@@ -0,0 +1,117 @@
+#include "mapped_file.h"
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+#if defined(_WIN32)
+
+MappedFile::MappedFile(const char* path) {
+  HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                            FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+  if (file == INVALID_HANDLE_VALUE)
+    throw std::runtime_error(std::string("MappedFile: cannot open ") + path);
+
+  file_handle_ = file;
+
+  LARGE_INTEGER file_size{};
+  if (!GetFileSizeEx(file, &file_size) || file_size.QuadPart == 0) {
+    Close();
+    throw std::runtime_error(std::string("MappedFile: empty or unreadable file ") + path);
+  }
+
+  mapping_handle_ = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+  if (mapping_handle_ == nullptr) {
+    Close();
+    throw std::runtime_error(std::string("MappedFile: cannot map ") + path);
+  }
+
+  data_ = static_cast<const uint8_t*>(MapViewOfFile(mapping_handle_, FILE_MAP_READ, 0, 0, 0));
+  if (data_ == nullptr) {
+    Close();
+    throw std::runtime_error(std::string("MappedFile: cannot map ") + path);
+  }
+
+  size_ = static_cast<size_t>(file_size.QuadPart);
+}
+
+void MappedFile::Close() {
+  if (data_ != nullptr)
+    UnmapViewOfFile(data_);
+  if (mapping_handle_ != nullptr)
+    CloseHandle(mapping_handle_);
+  if (file_handle_ != nullptr)
+    CloseHandle(file_handle_);
+
+  data_ = nullptr;
+  size_ = 0;
+  mapping_handle_ = nullptr;
+  file_handle_ = nullptr;
+}
+
+#else
+
+MappedFile::MappedFile(const char* path) {
+  int fd = open(path, O_RDONLY);
+  if (fd < 0)
+    throw std::runtime_error(std::string("MappedFile: cannot open ") + path);
+
+  struct stat file_stat{};
+  if (fstat(fd, &file_stat) != 0 || file_stat.st_size == 0) {
+    close(fd);
+    throw std::runtime_error(std::string("MappedFile: empty or unreadable file ") + path);
+  }
+
+  void* ptr = mmap(nullptr, static_cast<size_t>(file_stat.st_size), PROT_READ, MAP_PRIVATE, fd,
+                   0);
+
+  // The mapping keeps its own reference to the file.
+  close(fd);
+
+  if (ptr == MAP_FAILED)
+    throw std::runtime_error(std::string("MappedFile: cannot map ") + path);
+
+  data_ = static_cast<const uint8_t*>(ptr);
+  size_ = static_cast<size_t>(file_stat.st_size);
+}
+
+void MappedFile::Close() {
+  if (data_ != nullptr)
+    munmap(const_cast<uint8_t*>(data_), size_);
+
+  data_ = nullptr;
+  size_ = 0;
+}
+
+#endif  // defined(_WIN32)
+
+MappedFile::~MappedFile() {
+  Close();
+}
+
+MappedFile::MappedFile(MappedFile&& other) noexcept {
+  *this = std::move(other);
+}
+
+MappedFile& MappedFile::operator=(MappedFile&& other) noexcept {
+  if (this != &other) {
+    Close();
+
+    std::swap(data_, other.data_);
+    std::swap(size_, other.size_);
+#if defined(_WIN32)
+    std::swap(file_handle_, other.file_handle_);
+    std::swap(mapping_handle_, other.mapping_handle_);
+#endif
+  }
+  return *this;
+}
\ No newline at end of file
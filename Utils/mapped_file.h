@@ -0,0 +1,35 @@
+#ifndef MAPPED_FILE_H_
+#define MAPPED_FILE_H_
+
+#include <cstddef>
+#include <cstdint>
+
+// Read-only memory mapping of a whole file. Pages are faulted in lazily by the OS, so opening a
+// large file costs nothing until its bytes are touched. Throws std::runtime_error on failure.
+class MappedFile {
+public:
+  explicit MappedFile(const char* path);
+  ~MappedFile();
+
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+
+  MappedFile(MappedFile&& other) noexcept;
+  MappedFile& operator=(MappedFile&& other) noexcept;
+
+  const uint8_t* data() const { return data_; }
+  size_t size() const { return size_; }
+
+private:
+  void Close();
+
+  const uint8_t* data_ = nullptr;
+  size_t size_ = 0;
+
+#if defined(_WIN32)
+  void* file_handle_ = nullptr;
+  void* mapping_handle_ = nullptr;
+#endif
+};
+
+#endif  // MAPPED_FILE_H_
\ No newline at end of file
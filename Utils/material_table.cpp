@@ -0,0 +1,20 @@
+#include "material_table.h"
+
+MaterialTableEntry MakeMaterialTableEntry(const scene_cache::MaterialDesc& desc) {
+  MaterialTableEntry entry{};
+  entry.ambient_color[0] = desc.ambient_color.x;
+  entry.ambient_color[1] = desc.ambient_color.y;
+  entry.ambient_color[2] = desc.ambient_color.z;
+  entry.diffuse_color[0] = desc.diffuse_color.x;
+  entry.diffuse_color[1] = desc.diffuse_color.y;
+  entry.diffuse_color[2] = desc.diffuse_color.z;
+  return entry;
+}
+
+std::vector<MaterialTableEntry> BuildMaterialTable(const scene_cache::Scene& scene) {
+  std::vector<MaterialTableEntry> table;
+  table.reserve(scene.num_materials());
+  for (uint32_t i = 0; i < scene.num_materials(); ++i)
+    table.push_back(MakeMaterialTableEntry(scene.material(i)));
+  return table;
+}
\ No newline at end of file
@@ -0,0 +1,26 @@
+#ifndef MATERIAL_TABLE_H_
+#define MATERIAL_TABLE_H_
+
+#include <cstdint>
+#include <vector>
+
+#include "scene_cache.h"
+
+// One entry of the material table: a StructuredBuffer<MaterialTableEntry> with an entry per scene
+// material, which the DeferredShading lighting pass and the RayTracing closest-hit shader index
+// by material index. material_table.hlsli declares the same struct for the shaders; the
+// material-table command of CpuReference checks that the two agree.
+struct MaterialTableEntry {
+  // Colors with w = 0.
+  float ambient_color[4];
+  float diffuse_color[4];
+};
+
+static_assert(sizeof(MaterialTableEntry) == 32, "MaterialTableEntry must match the HLSL struct");
+
+MaterialTableEntry MakeMaterialTableEntry(const scene_cache::MaterialDesc& desc);
+
+// An entry per material of |scene|, in material index order.
+std::vector<MaterialTableEntry> BuildMaterialTable(const scene_cache::Scene& scene);
+
+#endif  // MATERIAL_TABLE_H_
\ No newline at end of file
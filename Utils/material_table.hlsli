@@ -0,0 +1,11 @@
+#ifndef MATERIAL_TABLE_HLSLI_
+#define MATERIAL_TABLE_HLSLI_
+
+// MaterialTableEntry in material_table.h. Structured buffers pack their members tightly, with no
+// 16-byte rows, so the C++ struct needs no padding beyond its own.
+struct MaterialTableEntry {
+  float4 ambient_color;
+  float4 diffuse_color;
+};
+
+#endif  // MATERIAL_TABLE_HLSLI_
\ No newline at end of file
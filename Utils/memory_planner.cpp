@@ -0,0 +1,72 @@
+#include "memory_planner.h"
+
+#include <algorithm>
+#include <numeric>
+
+namespace {
+
+uint64_t AlignUp(uint64_t value, uint64_t alignment) {
+  return (value + alignment - 1) & ~(alignment - 1);
+}
+
+}  // namespace
+
+bool LifetimesOverlap(const MemoryRequest& a, const MemoryRequest& b) {
+  return a.first_use <= b.last_use && b.first_use <= a.last_use;
+}
+
+std::vector<uint64_t> PlanMemory(const std::vector<MemoryRequest>& requests,
+                                 uint64_t* heap_size) {
+  std::vector<size_t> order(requests.size());
+  std::iota(order.begin(), order.end(), 0);
+  std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+    if (requests[a].size != requests[b].size)
+      return requests[a].size > requests[b].size;
+    return requests[a].first_use < requests[b].first_use;
+  });
+
+  std::vector<uint64_t> offsets(requests.size());
+  // Placed requests that are alive at the same time as the current one, by offset.
+  std::vector<size_t> neighbors;
+  std::vector<size_t> placed;
+  *heap_size = 0;
+
+  for (size_t index : order) {
+    const MemoryRequest& request = requests[index];
+
+    neighbors.clear();
+    for (size_t other : placed) {
+      if (LifetimesOverlap(request, requests[other]))
+        neighbors.push_back(other);
+    }
+    std::sort(neighbors.begin(), neighbors.end(),
+              [&](size_t a, size_t b) { return offsets[a] < offsets[b]; });
+
+    // First gap between the neighbors that fits.
+    uint64_t offset = 0;
+    for (size_t other : neighbors) {
+      if (offset + request.size <= offsets[other])
+        break;
+      offset = std::max(offset, AlignUp(offsets[other] + requests[other].size, request.alignment));
+    }
+
+    offsets[index] = offset;
+    placed.push_back(index);
+    *heap_size = std::max(*heap_size, offset + request.size);
+  }
+  return offsets;
+}
+
+uint64_t PeakLiveBytes(const std::vector<MemoryRequest>& requests) {
+  uint64_t peak = 0;
+  for (const MemoryRequest& request : requests) {
+    // The peak is reached at the start of some request's lifetime.
+    uint64_t live = 0;
+    for (const MemoryRequest& other : requests) {
+      if (other.first_use <= request.first_use && request.first_use <= other.last_use)
+        live += other.size;
+    }
+    peak = std::max(peak, live);
+  }
+  return peak;
+}
\ No newline at end of file
@@ -0,0 +1,31 @@
+#ifndef MEMORY_PLANNER_H_
+#define MEMORY_PLANNER_H_
+
+#include <cstdint>
+#include <vector>
+
+// Places resources that only live for part of a frame in one shared heap, so that resources
+// never alive at the same time can share memory.
+
+// A block of memory used from step |first_use| to step |last_use|, inclusive.
+struct MemoryRequest {
+  uint64_t size;
+  // Power of two.
+  uint64_t alignment;
+  int first_use;
+  int last_use;
+};
+
+bool LifetimesOverlap(const MemoryRequest& a, const MemoryRequest& b);
+
+// Offsets for |requests| in a heap of *|heap_size| bytes. Requests whose lifetimes overlap never
+// overlap in memory. Greedy: the largest requests are placed first, each at the lowest aligned
+// offset that is free for its whole lifetime.
+std::vector<uint64_t> PlanMemory(const std::vector<MemoryRequest>& requests,
+                                 uint64_t* heap_size);
+
+// Most bytes alive at any one step, a lower bound on the heap size of any plan, ignoring
+// alignment.
+uint64_t PeakLiveBytes(const std::vector<MemoryRequest>& requests);
+
+#endif  // MEMORY_PLANNER_H_
\ No newline at end of file
@@ -0,0 +1,33 @@
+#ifndef PROFILING_H_
+#define PROFILING_H_
+
+#include <chrono>
+#include <cstdint>
+
+// Wall-clock stopwatch for the tools' timing reports.
+class Stopwatch {
+public:
+  Stopwatch() : start_(std::chrono::steady_clock::now()) {}
+
+  void Restart() { start_ = std::chrono::steady_clock::now(); }
+
+  double ElapsedSeconds() const {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start_).count();
+  }
+
+  double ElapsedMilliseconds() const { return ElapsedSeconds() * 1000.0; }
+
+private:
+  std::chrono::steady_clock::time_point start_;
+};
+
+// Peak resident set size of the current process in bytes, or 0 if the platform does not report
+// it.
+uint64_t GetPeakResidentBytes();
+
+// Asks the OS to drop the cached pages of |path| so the next read comes from disk, for cold-start
+// measurements. Only clean pages are dropped. Returns false if the platform offers no way to do
+// it.
+bool EvictFileFromCache(const char* path);
+
+#endif  // PROFILING_H_
\ No newline at end of file
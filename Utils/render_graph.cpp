@@ -0,0 +1,378 @@
+#include "render_graph.h"
+
+#include <stdexcept>
+#include <utility>
+
+#include "job_system.h"
+
+namespace {
+
+struct StateName {
+  uint32_t state;
+  const char* name;
+};
+
+constexpr StateName kStateNames[] = {
+  {kResourceStateVertexAndConstantBuffer, "VERTEX_AND_CONSTANT_BUFFER"},
+  {kResourceStateIndexBuffer, "INDEX_BUFFER"},
+  {kResourceStateRenderTarget, "RENDER_TARGET"},
+  {kResourceStateUnorderedAccess, "UNORDERED_ACCESS"},
+  {kResourceStateDepthWrite, "DEPTH_WRITE"},
+  {kResourceStateDepthRead, "DEPTH_READ"},
+  {kResourceStateNonPixelShaderResource, "NON_PIXEL_SHADER_RESOURCE"},
+  {kResourceStatePixelShaderResource, "PIXEL_SHADER_RESOURCE"},
+  {kResourceStateStreamOut, "STREAM_OUT"},
+  {kResourceStateIndirectArgument, "INDIRECT_ARGUMENT"},
+  {kResourceStateCopyDest, "COPY_DEST"},
+  {kResourceStateCopySource, "COPY_SOURCE"},
+  {kResourceStateResolveDest, "RESOLVE_DEST"},
+  {kResourceStateResolveSource, "RESOLVE_SOURCE"},
+};
+
+bool IsReadState(uint32_t state) { return state != 0 && (state & kWriteResourceStates) == 0; }
+
+// Exactly one write flag.
+bool IsWriteState(uint32_t state) {
+  return state != 0 && (state & kWriteResourceStates) == state && (state & (state - 1)) == 0;
+}
+
+RenderGraph::Barrier MakeBarrier(RenderGraph::Barrier::Type type,
+                                 RenderGraph::Barrier::Split split,
+                                 RenderGraph::ResourceId resource, uint32_t before,
+                                 uint32_t after) {
+  RenderGraph::Barrier barrier;
+  barrier.type = type;
+  barrier.split = split;
+  barrier.resource = resource;
+  barrier.before = before;
+  barrier.after = after;
+  return barrier;
+}
+
+}  // namespace
+
+std::string ResourceStateString(uint32_t state) {
+  if (state == 0)
+    return "COMMON";
+
+  std::string result;
+  for (const StateName& name : kStateNames) {
+    if ((state & name.state) == 0)
+      continue;
+    if (!result.empty())
+      result += " | ";
+    result += name.name;
+  }
+  return result;
+}
+
+RenderGraph::ResourceId RenderGraph::ImportResource(const std::string& name, uint32_t state) {
+  Resource resource;
+  resource.name = name;
+  resource.state = state;
+  resources_.push_back(std::move(resource));
+  return static_cast<ResourceId>(resources_.size() - 1);
+}
+
+RenderGraph::ResourceId RenderGraph::CreateTransientResource(const std::string& name,
+                                                             uint64_t size, uint64_t alignment) {
+  Resource resource;
+  resource.name = name;
+  resource.state = kResourceStateCommon;
+  resource.transient = true;
+  resource.memory.size = size;
+  resource.memory.alignment = alignment;
+  resources_.push_back(std::move(resource));
+  return static_cast<ResourceId>(resources_.size() - 1);
+}
+
+void RenderGraph::MarkOutput(ResourceId resource) {
+  resources_[resource].output = true;
+}
+
+RenderGraph::PassId RenderGraph::AddPass(const std::string& name,
+                                         std::function<void()> execute) {
+  return AddPass(name, 1, [execute](void*, int) { execute(); });
+}
+
+RenderGraph::PassId RenderGraph::AddPass(const std::string& name, int num_parts,
+                                         RecordFn record) {
+  if (num_parts < 1)
+    throw std::runtime_error("render_graph: pass '" + name + "' must have at least one part");
+
+  Pass pass;
+  pass.name = name;
+  pass.num_parts = num_parts;
+  pass.record = std::move(record);
+  passes_.push_back(std::move(pass));
+  return static_cast<PassId>(passes_.size() - 1);
+}
+
+void RenderGraph::Read(PassId pass, ResourceId resource, uint32_t state) {
+  if (!IsReadState(state)) {
+    throw std::runtime_error("render_graph: pass '" + passes_[pass].name + "' reads '" +
+                             resources_[resource].name + "' in " + ResourceStateString(state));
+  }
+  AddAccess(pass, resource, state, false);
+}
+
+void RenderGraph::Write(PassId pass, ResourceId resource, uint32_t state) {
+  if (!IsWriteState(state)) {
+    throw std::runtime_error("render_graph: pass '" + passes_[pass].name + "' writes '" +
+                             resources_[resource].name + "' in " + ResourceStateString(state));
+  }
+  AddAccess(pass, resource, state, true);
+}
+
+void RenderGraph::AddAccess(PassId pass, ResourceId resource, uint32_t state, bool write) {
+  for (Access& access : passes_[pass].accesses) {
+    if (access.resource != resource)
+      continue;
+
+    if (!access.write && !write) {
+      access.state |= state;
+      return;
+    }
+    if (access.write && write && access.state == state)
+      return;
+
+    throw std::runtime_error("render_graph: pass '" + passes_[pass].name + "' uses '" +
+                             resources_[resource].name + "' in both " +
+                             ResourceStateString(access.state) + " and " +
+                             ResourceStateString(state));
+  }
+
+  Access access;
+  access.resource = resource;
+  access.state = state;
+  access.write = write;
+  passes_[pass].accesses.push_back(access);
+}
+
+void RenderGraph::Compile() {
+  CullPasses();
+
+  steps_.clear();
+  final_barriers_.clear();
+  tasks_.clear();
+  for (PassId pass = 0; pass < num_passes(); ++pass) {
+    if (passes_[pass].culled)
+      continue;
+    for (int part = 0; part < passes_[pass].num_parts; ++part)
+      tasks_.push_back({static_cast<int>(steps_.size()), part});
+    Step step;
+    step.pass = pass;
+    steps_.push_back(std::move(step));
+  }
+
+  PlaceTransientResources();
+
+  for (ResourceId resource = 0; resource < num_resources(); ++resource)
+    PlaceBarriers(resource);
+
+  PlaceAliasingBarriers();
+}
+
+// Walks the passes backwards, tracking which resources a later running pass still needs. Writes
+// do not end a resource's liveness, since a pass may only write part of it, e.g. when it depth
+// tests against an earlier pass's depth.
+void RenderGraph::CullPasses() {
+  std::vector<bool> needed(resources_.size());
+  for (ResourceId resource = 0; resource < num_resources(); ++resource)
+    needed[resource] = resources_[resource].output;
+
+  for (PassId pass = num_passes() - 1; pass >= 0; --pass) {
+    Pass& current = passes_[pass];
+
+    current.culled = true;
+    for (const Access& access : current.accesses) {
+      if (access.write && needed[access.resource])
+        current.culled = false;
+    }
+    if (current.culled)
+      continue;
+
+    for (const Access& access : current.accesses) {
+      if (!access.write)
+        needed[access.resource] = true;
+    }
+  }
+}
+
+void RenderGraph::PlaceTransientResources() {
+  std::vector<ResourceId> placed;
+  std::vector<MemoryRequest> requests;
+
+  for (ResourceId resource = 0; resource < num_resources(); ++resource) {
+    Resource& current = resources_[resource];
+    if (!current.transient)
+      continue;
+
+    current.memory.first_use = -1;
+    current.memory.last_use = -1;
+    current.offset = kNotPlaced;
+    for (int step = 0; step < static_cast<int>(steps_.size()); ++step) {
+      for (const Access& access : passes_[steps_[step].pass].accesses) {
+        if (access.resource != resource)
+          continue;
+        if (current.memory.first_use < 0) {
+          if (!access.write) {
+            throw std::runtime_error("render_graph: pass '" + passes_[steps_[step].pass].name +
+                                     "' reads transient resource '" + current.name +
+                                     "' before any pass writes it");
+          }
+          current.memory.first_use = step;
+          current.state = access.state;
+        }
+        current.memory.last_use = step;
+      }
+    }
+
+    if (current.memory.first_use >= 0) {
+      placed.push_back(resource);
+      requests.push_back(current.memory);
+    }
+  }
+
+  const std::vector<uint64_t> offsets = PlanMemory(requests, &transient_heap_size_);
+  for (size_t i = 0; i < placed.size(); ++i)
+    resources_[placed[i]].offset = offsets[i];
+}
+
+void RenderGraph::PlaceBarriers(ResourceId resource) {
+  struct Use {
+    int step;
+    uint32_t state;
+    bool write;
+  };
+
+  std::vector<Use> uses;
+  for (int step = 0; step < static_cast<int>(steps_.size()); ++step) {
+    for (const Access& access : passes_[steps_[step].pass].accesses) {
+      if (access.resource == resource)
+        uses.push_back({step, access.state, access.write});
+    }
+  }
+
+  // Transitions |resource| from |before| to |after| by step |end_step|. When no pass between
+  // |begin_step| and |end_step| uses it, and one task records both, the transition is split
+  // across them.
+  auto transition = [&](int begin_step, int end_step, uint32_t before, uint32_t after) {
+    std::vector<Barrier>& end_batch =
+        end_step < static_cast<int>(steps_.size()) ? steps_[end_step].barriers : final_barriers_;
+    if (begin_step >= end_step || BarrierTask(begin_step) != BarrierTask(end_step)) {
+      end_batch.push_back(MakeBarrier(Barrier::kTransition, Barrier::kFull, resource, before,
+                                      after));
+      return;
+    }
+    steps_[begin_step].barriers.push_back(
+        MakeBarrier(Barrier::kTransition, Barrier::kBegin, resource, before, after));
+    end_batch.push_back(MakeBarrier(Barrier::kTransition, Barrier::kEnd, resource, before, after));
+  };
+
+  uint32_t state = resources_[resource].state;
+  // The step of the last use, or -1 for the start of the frame.
+  int last_step = -1;
+
+  for (size_t first = 0; first < uses.size();) {
+    const Use& use = uses[first];
+
+    // Back-to-back reads share one combined read state.
+    uint32_t needed_state = use.state;
+    size_t end = first + 1;
+    if (!use.write) {
+      for (; end < uses.size() && !uses[end].write; ++end)
+        needed_state |= uses[end].state;
+    }
+
+    if (use.write && state == needed_state) {
+      // Previous frames' writes are complete by the time this frame runs.
+      if (needed_state == kResourceStateUnorderedAccess && last_step >= 0) {
+        steps_[use.step].barriers.push_back(
+            MakeBarrier(Barrier::kUav, Barrier::kFull, resource, state, state));
+      }
+    } else if (use.write || !IsReadState(state) || (needed_state & ~state) != 0) {
+      transition(last_step + 1, use.step, state, needed_state);
+      state = needed_state;
+    }
+
+    last_step = uses[end - 1].step;
+    first = end;
+  }
+
+  if (state == resources_[resource].state)
+    return;
+
+  // A transient resource may hand its memory over right after its last use, so it goes back to
+  // its between-frames state straight away.
+  if (resources_[resource].transient)
+    transition(last_step + 1, last_step + 1, state, resources_[resource].state);
+  else
+    transition(last_step + 1, static_cast<int>(steps_.size()), state, resources_[resource].state);
+}
+
+int RenderGraph::BarrierTask(int step) const {
+  if (step == static_cast<int>(steps_.size()))
+    return static_cast<int>(tasks_.size()) - 1;
+  int task = 0;
+  while (tasks_[task].step != step)
+    ++task;
+  return task;
+}
+
+// After the other barriers of the batch, so that the transient resources that were using the
+// memory have finished their transitions.
+void RenderGraph::PlaceAliasingBarriers() {
+  for (ResourceId resource = 0; resource < num_resources(); ++resource) {
+    const Resource& current = resources_[resource];
+    if (!current.transient || current.offset == kNotPlaced)
+      continue;
+
+    bool shares_memory = false;
+    for (const Resource& other : resources_) {
+      if (&other == &current || !other.transient || other.offset == kNotPlaced)
+        continue;
+      if (current.offset < other.offset + other.memory.size &&
+          other.offset < current.offset + current.memory.size)
+        shares_memory = true;
+    }
+
+    if (shares_memory) {
+      steps_[current.memory.first_use].barriers.push_back(
+          MakeBarrier(Barrier::kAliasing, Barrier::kFull, resource, 0, 0));
+    }
+  }
+}
+
+void RenderGraph::Execute(
+    const std::function<void(const std::vector<Barrier>&)>& record_barriers,
+    void* recorder) const {
+  for (int task = 0; task < static_cast<int>(tasks_.size()); ++task)
+    ExecuteTask(task, recorder, record_barriers);
+}
+
+void RenderGraph::ExecuteParallel(
+    JobSystem* jobs, const std::function<void*(int, int)>& begin_task,
+    const std::function<void(void*, const std::vector<Barrier>&)>& record_barriers,
+    const std::function<void(int, void*)>& end_task) const {
+  jobs->ParallelFor(static_cast<int>(tasks_.size()), [&](int task, int thread_index) {
+    void* recorder = begin_task(task, thread_index);
+    ExecuteTask(task, recorder, [&](const std::vector<Barrier>& barriers) {
+      record_barriers(recorder, barriers);
+    });
+    end_task(task, recorder);
+  });
+}
+
+void RenderGraph::ExecuteTask(
+    int task, void* recorder,
+    const std::function<void(const std::vector<Barrier>&)>& record_barriers) const {
+  const Step& step = steps_[tasks_[task].step];
+  if (tasks_[task].part == 0 && !step.barriers.empty())
+    record_barriers(step.barriers);
+
+  passes_[step.pass].record(recorder, tasks_[task].part);
+
+  if (task + 1 == static_cast<int>(tasks_.size()) && !final_barriers_.empty())
+    record_barriers(final_barriers_);
+}
\ No newline at end of file
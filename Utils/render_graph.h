@@ -0,0 +1,237 @@
+#ifndef RENDER_GRAPH_H_
+#define RENDER_GRAPH_H_
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "memory_planner.h"
+
+class JobSystem;
+
+// Resource states, with the values of the D3D12_RESOURCE_STATES flags they stand for so that the
+// D3D12 apps can pass their own states in and cast the compiled ones back. The graph itself only
+// needs to know which states write.
+enum ResourceState : uint32_t {
+  kResourceStateCommon = 0,
+  kResourceStateVertexAndConstantBuffer = 0x1,
+  kResourceStateIndexBuffer = 0x2,
+  kResourceStateRenderTarget = 0x4,
+  kResourceStateUnorderedAccess = 0x8,
+  kResourceStateDepthWrite = 0x10,
+  kResourceStateDepthRead = 0x20,
+  kResourceStateNonPixelShaderResource = 0x40,
+  kResourceStatePixelShaderResource = 0x80,
+  kResourceStateStreamOut = 0x100,
+  kResourceStateIndirectArgument = 0x200,
+  kResourceStateCopyDest = 0x400,
+  kResourceStateCopySource = 0x800,
+  kResourceStateResolveDest = 0x1000,
+  kResourceStateResolveSource = 0x2000,
+  kResourceStatePresent = 0,
+};
+
+// States in which a pass may modify a resource. Each must be used on its own, while read states
+// combine.
+constexpr uint32_t kWriteResourceStates =
+    kResourceStateRenderTarget | kResourceStateUnorderedAccess | kResourceStateDepthWrite |
+    kResourceStateStreamOut | kResourceStateCopyDest | kResourceStateResolveDest;
+
+// "PIXEL_SHADER_RESOURCE | NON_PIXEL_SHADER_RESOURCE" and the like, for printing.
+std::string ResourceStateString(uint32_t state);
+
+// A frame as a list of passes that declare the resources they read and write. Compile() works out
+// from the declarations alone, without any graphics API:
+//
+//  - which passes to run: a pass is culled unless it writes an output or a resource a later
+//    running pass reads;
+//  - the fewest state transitions that put every resource in the state each pass needs, with
+//    back-to-back reads merged into one combined read state and UAV barriers between
+//    back-to-back unordered-access passes;
+//  - where to put them: all of a pass's barriers go in one batch before it, and a transition
+//    whose resource sits idle for one or more passes is split, begun right after its last use and
+//    ended right before its next, so the GPU can do it while the passes in between run. D3D12
+//    split barriers must begin and end in the same command list, so only transitions whose halves
+//    fall in the same task are split; the others are one full barrier before the next use.
+//
+// Resources are imported in the state they stay in between frames and are returned to it at the
+// end of the frame. Transient resources only live from the first running pass that uses them to
+// the last, and Compile() places them in one heap with a MemoryRequest each, so that transient
+// resources whose lifetimes do not overlap share memory. An aliasing barrier activates a
+// transient resource before its first use, and its return to its between-frames state, the state
+// of that first use, comes right after its last, while it still owns its memory.
+//
+// The compiled schedule only depends on the declarations, so a graph that does not change is
+// compiled once and executed every frame.
+//
+// A pass may split its work into parts. Each part of each running pass is a task that
+// ExecuteParallel() records into a recorder of its own, e.g. a command list, on whichever thread
+// is free, and submitting the recorders in task order runs the frame in the order Execute()
+// records it.
+class RenderGraph {
+public:
+  using ResourceId = int;
+  using PassId = int;
+
+  // Records part |part| of a pass into |recorder|, an ID3D12GraphicsCommandList* in the D3D12
+  // apps.
+  using RecordFn = std::function<void(void* recorder, int part)>;
+
+  struct Barrier {
+    enum Type {
+      kTransition,
+      // The resource stays in UNORDERED_ACCESS but the next pass must see the previous writes.
+      kUav,
+      // The transient resource takes over its memory from whichever overlapping one had it.
+      kAliasing,
+    };
+
+    enum Split {
+      kFull,
+      kBegin,
+      kEnd,
+    };
+
+    Type type;
+    Split split;
+    ResourceId resource;
+    uint32_t before;
+    uint32_t after;
+  };
+
+  // How a pass uses a resource.
+  struct Access {
+    ResourceId resource;
+    uint32_t state;
+    bool write;
+  };
+
+  // A pass to run and the barriers to record right before it.
+  struct Step {
+    PassId pass;
+    std::vector<Barrier> barriers;
+  };
+
+  // One part of the pass of a step. The first part of a step records the step's barriers and the
+  // last task the final barriers.
+  struct Task {
+    int step;
+    int part;
+  };
+
+  static constexpr uint64_t kNotPlaced = UINT64_MAX;
+
+  ResourceId ImportResource(const std::string& name, uint32_t state);
+
+  // A resource of |size| bytes, aligned to |alignment|, that is only needed within the frame. The
+  // first running pass that uses it must write it, and with D3D12, clear it or overwrite it
+  // entirely if it is a render target or depth buffer, since its memory may hold another
+  // resource's data.
+  ResourceId CreateTransientResource(const std::string& name, uint64_t size, uint64_t alignment);
+
+  // The frame's result, e.g. the swap chain buffer: passes that write it are never culled.
+  void MarkOutput(ResourceId resource);
+
+  // Passes run in the order they are added. |execute| records the pass's work.
+  PassId AddPass(const std::string& name, std::function<void()> execute);
+
+  // A pass whose work splits into |num_parts| parts, such as the faces of a cubemap, that may be
+  // recorded at the same time on different threads, each into its own recorder.
+  PassId AddPass(const std::string& name, int num_parts, RecordFn record);
+
+  // A pass may read a resource in several read states, which are combined, or write it in one
+  // write state, which it may also read in. Anything else throws std::runtime_error.
+  void Read(PassId pass, ResourceId resource, uint32_t state);
+  void Write(PassId pass, ResourceId resource, uint32_t state);
+
+  void Compile();
+
+  // Runs the compiled passes in order, every part into |recorder|, handing each batch of
+  // barriers, never empty, to |record_barriers| first.
+  void Execute(const std::function<void(const std::vector<Barrier>&)>& record_barriers,
+               void* recorder = nullptr) const;
+
+  // Records the compiled tasks as jobs of |jobs|, several at a time, and returns once all are
+  // recorded. Each task records into the recorder |begin_task(task, thread_index)| returns on the
+  // thread that runs it, with |record_barriers(recorder, barriers)| for its batches of barriers,
+  // and |end_task(task, recorder)| runs once it is complete. If tasks throw, the first exception is
+  // rethrown here once every task has finished.
+  void ExecuteParallel(
+      JobSystem* jobs, const std::function<void*(int task, int thread_index)>& begin_task,
+      const std::function<void(void* recorder, const std::vector<Barrier>&)>& record_barriers,
+      const std::function<void(int task, void* recorder)>& end_task) const;
+
+  int num_resources() const { return static_cast<int>(resources_.size()); }
+  int num_passes() const { return static_cast<int>(passes_.size()); }
+
+  const std::string& resource_name(ResourceId resource) const {
+    return resources_[resource].name;
+  }
+  // For transient resources, the state of their first use once compiled.
+  uint32_t imported_state(ResourceId resource) const { return resources_[resource].state; }
+  bool transient(ResourceId resource) const { return resources_[resource].transient; }
+  const MemoryRequest& memory_request(ResourceId resource) const {
+    return resources_[resource].memory;
+  }
+
+  const std::string& pass_name(PassId pass) const { return passes_[pass].name; }
+  int num_parts(PassId pass) const { return passes_[pass].num_parts; }
+  bool culled(PassId pass) const { return passes_[pass].culled; }
+  const std::vector<Access>& accesses(PassId pass) const { return passes_[pass].accesses; }
+
+  // The result of Compile(): the passes that run, and the barriers after the last of them that
+  // return the resources to their imported states.
+  const std::vector<Step>& steps() const { return steps_; }
+  const std::vector<Barrier>& final_barriers() const { return final_barriers_; }
+  // The compiled steps' parts in order, one recorder each with ExecuteParallel().
+  const std::vector<Task>& tasks() const { return tasks_; }
+
+  // Where each transient resource goes in the transient heap, or kNotPlaced for those no running
+  // pass uses, and the heap's size.
+  uint64_t transient_offset(ResourceId resource) const { return resources_[resource].offset; }
+  uint64_t transient_heap_size() const { return transient_heap_size_; }
+
+private:
+  struct Resource {
+    std::string name;
+    uint32_t state;
+    bool output = false;
+
+    bool transient = false;
+    // The size and alignment of transient resources, and their lifetime in steps once compiled.
+    MemoryRequest memory = {};
+    uint64_t offset = kNotPlaced;
+  };
+
+  struct Pass {
+    std::string name;
+    int num_parts = 1;
+    RecordFn record;
+    std::vector<Access> accesses;
+    bool culled = false;
+  };
+
+  void AddAccess(PassId pass, ResourceId resource, uint32_t state, bool write);
+  void CullPasses();
+  void PlaceTransientResources();
+  void PlaceBarriers(ResourceId resource);
+  // The task that records the barriers before step |step|, or the final barriers for
+  // steps_.size().
+  int BarrierTask(int step) const;
+  void PlaceAliasingBarriers();
+
+  // Records task |task|, with its barriers, into |recorder|.
+  void ExecuteTask(int task, void* recorder,
+                   const std::function<void(const std::vector<Barrier>&)>& record_barriers) const;
+
+  std::vector<Resource> resources_;
+  std::vector<Pass> passes_;
+
+  std::vector<Step> steps_;
+  std::vector<Barrier> final_barriers_;
+  std::vector<Task> tasks_;
+  uint64_t transient_heap_size_ = 0;
+};
+
+#endif  // RENDER_GRAPH_H_
\ No newline at end of file
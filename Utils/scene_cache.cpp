@@ -0,0 +1,503 @@
+#include "scene_cache.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+
+namespace scene_cache {
+
+namespace {
+
+// D3DDECLUSAGE and D3DDECLTYPE values used by the .sdkmesh vertex declaration.
+constexpr uint8_t kDeclUsagePosition = 0;
+constexpr uint8_t kDeclUsageNormal = 3;
+constexpr uint8_t kDeclTypeFloat3 = 2;
+
+constexpr uint32_t kFloatVertexStride = 24;
+constexpr uint32_t kQuantizedVertexStride = 16;
+
+// True if [offset, offset + count * stride) lies inside a buffer of |size| bytes, without
+// overflowing.
+bool RangeInFile(uint64_t offset, uint64_t count, uint64_t stride, uint64_t size) {
+  if (offset > size)
+    return false;
+  if (stride != 0 && count > (size - offset) / stride)
+    return false;
+  return true;
+}
+
+uint64_t AlignUp(uint64_t value, uint64_t alignment) {
+  return (value + alignment - 1) / alignment * alignment;
+}
+
+uint32_t VertexStride(uint32_t format) {
+  return format == kVertexFormatQuantized ? kQuantizedVertexStride : kFloatVertexStride;
+}
+
+// The apps only understand position + normal vertices, so that is all the baker accepts.
+bool IsPositionNormalLayout(const sdkmesh::VertexBufferHeader& vb) {
+  const sdkmesh::VertexElement& position = vb.decl[0];
+  const sdkmesh::VertexElement& normal = vb.decl[1];
+
+  return vb.stride_bytes == kFloatVertexStride &&
+         position.stream == 0 && position.offset == 0 && position.type == kDeclTypeFloat3 &&
+         position.usage == kDeclUsagePosition &&
+         normal.stream == 0 && normal.offset == 12 && normal.type == kDeclTypeFloat3 &&
+         normal.usage == kDeclUsageNormal;
+}
+
+uint16_t QuantizeUnorm16(float value, float min, float extent) {
+  float t = extent > 0.f ? (value - min) / extent : 0.f;
+  t = std::min(std::max(t, 0.f), 1.f);
+  return static_cast<uint16_t>(std::lround(t * 65535.f));
+}
+
+int16_t QuantizeSnorm16(float value) {
+  float t = std::min(std::max(value, -1.f), 1.f);
+  return static_cast<int16_t>(std::lround(t * 32767.f));
+}
+
+void AppendAligned(std::vector<uint8_t>* blob, const void* data, size_t size) {
+  blob->resize(AlignUp(blob->size(), kSectionAlignment));
+  const uint8_t* bytes = static_cast<const uint8_t*>(data);
+  blob->insert(blob->end(), bytes, bytes + size);
+}
+
+struct Section {
+  SectionType type;
+  uint32_t count;
+  const void* data;
+  uint64_t size;
+};
+
+}  // namespace
+
+std::vector<uint8_t> Bake(const sdkmesh::Mesh& mesh, const BakeOptions& options) {
+  std::vector<VertexBufferDesc> vertex_buffers;
+  std::vector<IndexBufferDesc> index_buffers;
+  std::vector<DrawRange> draw_ranges;
+  std::vector<MaterialDesc> materials;
+  std::vector<GeometryDesc> geometries;
+
+  // Vertex and index data, with offsets relative to the start of this blob until the final
+  // layout is known.
+  std::vector<uint8_t> buffer_data;
+
+  for (uint32_t i = 0; i < mesh.num_vertex_buffers(); ++i) {
+    const sdkmesh::VertexBufferHeader& vb = mesh.vertex_buffer(i);
+
+    if (!IsPositionNormalLayout(vb)) {
+      throw std::runtime_error("scene_cache: vertex buffer " + std::to_string(i) +
+                               " is not a float3 position + float3 normal buffer");
+    }
+    if (vb.num_vertices > UINT32_MAX)
+      throw std::runtime_error("scene_cache: vertex buffer " + std::to_string(i) + " too large");
+
+    const uint32_t num_vertices = static_cast<uint32_t>(vb.num_vertices);
+    const Vertex* vertices = reinterpret_cast<const Vertex*>(mesh.vertex_data(i));
+
+    VertexBufferDesc desc{};
+    desc.format = options.quantize_vertices ? kVertexFormatQuantized : kVertexFormatFloat;
+    desc.stride = VertexStride(desc.format);
+    desc.num_vertices = num_vertices;
+    desc.size_bytes = static_cast<uint64_t>(num_vertices) * desc.stride;
+
+    if (num_vertices > 0) {
+      desc.bounds_min = vertices[0].position;
+      desc.bounds_max = vertices[0].position;
+    }
+    for (uint32_t v = 0; v < num_vertices; ++v) {
+      const sdkmesh::Float3& p = vertices[v].position;
+      desc.bounds_min = {std::min(desc.bounds_min.x, p.x), std::min(desc.bounds_min.y, p.y),
+                         std::min(desc.bounds_min.z, p.z)};
+      desc.bounds_max = {std::max(desc.bounds_max.x, p.x), std::max(desc.bounds_max.y, p.y),
+                         std::max(desc.bounds_max.z, p.z)};
+    }
+
+    buffer_data.resize(AlignUp(buffer_data.size(), kSectionAlignment));
+    desc.data_offset = buffer_data.size();
+
+    if (desc.format == kVertexFormatFloat) {
+      AppendAligned(&buffer_data, vertices, desc.size_bytes);
+    } else {
+      const sdkmesh::Float3 extent = {desc.bounds_max.x - desc.bounds_min.x,
+                                      desc.bounds_max.y - desc.bounds_min.y,
+                                      desc.bounds_max.z - desc.bounds_min.z};
+
+      std::vector<uint16_t> quantized(static_cast<size_t>(num_vertices) * 8);
+      for (uint32_t v = 0; v < num_vertices; ++v) {
+        const Vertex& vertex = vertices[v];
+        uint16_t* out = &quantized[v * 8];
+
+        out[0] = QuantizeUnorm16(vertex.position.x, desc.bounds_min.x, extent.x);
+        out[1] = QuantizeUnorm16(vertex.position.y, desc.bounds_min.y, extent.y);
+        out[2] = QuantizeUnorm16(vertex.position.z, desc.bounds_min.z, extent.z);
+        out[3] = 0;
+        out[4] = static_cast<uint16_t>(QuantizeSnorm16(vertex.normal.x));
+        out[5] = static_cast<uint16_t>(QuantizeSnorm16(vertex.normal.y));
+        out[6] = static_cast<uint16_t>(QuantizeSnorm16(vertex.normal.z));
+        out[7] = 0;
+      }
+      AppendAligned(&buffer_data, quantized.data(), desc.size_bytes);
+    }
+
+    vertex_buffers.push_back(desc);
+  }
+
+  for (uint32_t i = 0; i < mesh.num_index_buffers(); ++i) {
+    const sdkmesh::IndexBufferHeader& ib = mesh.index_buffer(i);
+
+    if (ib.num_indices > UINT32_MAX)
+      throw std::runtime_error("scene_cache: index buffer " + std::to_string(i) + " too large");
+
+    IndexBufferDesc desc{};
+    desc.index_type = ib.index_type;
+    desc.num_indices = static_cast<uint32_t>(ib.num_indices);
+
+    buffer_data.resize(AlignUp(buffer_data.size(), kSectionAlignment));
+    desc.data_offset = buffer_data.size();
+
+    if (ib.index_type == sdkmesh::kIndexType32Bit) {
+      const uint32_t* indices = reinterpret_cast<const uint32_t*>(mesh.index_data(i));
+      const uint32_t* end = indices + desc.num_indices;
+
+      if (options.narrow_indices && std::all_of(indices, end,
+                                                [](uint32_t index) { return index <= 0xffff; })) {
+        std::vector<uint16_t> narrowed(indices, end);
+        desc.index_type = sdkmesh::kIndexType16Bit;
+        desc.size_bytes = narrowed.size() * sizeof(uint16_t);
+        AppendAligned(&buffer_data, narrowed.data(), desc.size_bytes);
+      } else {
+        desc.size_bytes = static_cast<uint64_t>(desc.num_indices) * sizeof(uint32_t);
+        AppendAligned(&buffer_data, indices, desc.size_bytes);
+      }
+    } else {
+      desc.size_bytes = static_cast<uint64_t>(desc.num_indices) * sizeof(uint16_t);
+      AppendAligned(&buffer_data, mesh.index_data(i), desc.size_bytes);
+    }
+
+    index_buffers.push_back(desc);
+  }
+
+  for (const sdkmesh::MeshPart& part : mesh.parts()) {
+    DrawRange range{};
+    range.vertex_buffer = part.vertex_buffer;
+    range.index_buffer = part.index_buffer;
+    range.material_index = part.material_index;
+    range.primitive_type = part.primitive_type;
+    range.start_index = part.start_index;
+    range.index_count = part.index_count;
+    range.vertex_offset = part.vertex_offset;
+    range.vertex_count = part.vertex_count;
+    range.flags = part.is_alpha ? kDrawRangeAlpha : 0u;
+
+    draw_ranges.push_back(range);
+
+    if (!options.include_geometries || part.is_alpha ||
+        part.primitive_type != sdkmesh::kTriangleList) {
+      continue;
+    }
+
+    const sdkmesh::IndexBufferHeader& ib = mesh.index_buffer(part.index_buffer);
+    const uint8_t* index_data = mesh.index_data(part.index_buffer);
+
+    uint32_t max_index = 0;
+    for (uint32_t j = part.start_index; j < part.start_index + part.index_count; ++j) {
+      uint32_t index = ib.index_type == sdkmesh::kIndexType32Bit
+          ? reinterpret_cast<const uint32_t*>(index_data)[j]
+          : reinterpret_cast<const uint16_t*>(index_data)[j];
+      max_index = std::max(max_index, index);
+    }
+
+    GeometryDesc geometry{};
+    geometry.vertex_buffer = part.vertex_buffer;
+    geometry.index_buffer = part.index_buffer;
+    geometry.start_index = part.start_index;
+    geometry.index_count = part.index_count;
+    geometry.vertex_offset = static_cast<uint32_t>(part.vertex_offset);
+    geometry.vertex_count = part.index_count > 0 ? max_index + 1 : 0;
+    geometry.material_index = part.material_index;
+
+    geometries.push_back(geometry);
+  }
+
+  for (uint32_t i = 0; i < mesh.num_materials(); ++i) {
+    sdkmesh::MaterialInfo info = mesh.material_info(i);
+
+    MaterialDesc material{};
+    material.ambient_color = {info.ambient_color.x, info.ambient_color.y, info.ambient_color.z,
+                              0.f};
+    material.diffuse_color = {info.diffuse_color.x, info.diffuse_color.y, info.diffuse_color.z,
+                              info.alpha};
+    material.emissive_color = {info.emissive_color.x, info.emissive_color.y,
+                               info.emissive_color.z, 0.f};
+
+    materials.push_back(material);
+  }
+
+  std::vector<Section> sections = {
+    {kSectionVertexBuffers, static_cast<uint32_t>(vertex_buffers.size()), vertex_buffers.data(),
+     vertex_buffers.size() * sizeof(VertexBufferDesc)},
+    {kSectionIndexBuffers, static_cast<uint32_t>(index_buffers.size()), index_buffers.data(),
+     index_buffers.size() * sizeof(IndexBufferDesc)},
+    {kSectionDrawRanges, static_cast<uint32_t>(draw_ranges.size()), draw_ranges.data(),
+     draw_ranges.size() * sizeof(DrawRange)},
+    {kSectionMaterials, static_cast<uint32_t>(materials.size()), materials.data(),
+     materials.size() * sizeof(MaterialDesc)},
+  };
+  if (options.include_geometries) {
+    sections.push_back({kSectionGeometries, static_cast<uint32_t>(geometries.size()),
+                        geometries.data(), geometries.size() * sizeof(GeometryDesc)});
+  }
+  sections.push_back({kSectionBufferData, 0, buffer_data.data(), buffer_data.size()});
+
+  std::vector<SectionHeader> section_headers(sections.size());
+
+  uint64_t offset = sizeof(FileHeader) + sections.size() * sizeof(SectionHeader);
+  for (size_t i = 0; i < sections.size(); ++i) {
+    offset = AlignUp(offset, kSectionAlignment);
+
+    section_headers[i].type = sections[i].type;
+    section_headers[i].count = sections[i].count;
+    section_headers[i].offset = offset;
+    section_headers[i].size = sections[i].size;
+
+    offset += sections[i].size;
+  }
+
+  // Buffer offsets become file offsets now that the data section has a place.
+  const uint64_t buffer_data_offset = section_headers.back().offset;
+  for (VertexBufferDesc& desc : vertex_buffers)
+    desc.data_offset += buffer_data_offset;
+  for (IndexBufferDesc& desc : index_buffers)
+    desc.data_offset += buffer_data_offset;
+
+  FileHeader header{};
+  std::memcpy(header.magic, kMagic, sizeof(kMagic));
+  header.version = kFileVersion;
+  header.num_sections = static_cast<uint32_t>(sections.size());
+  header.file_size = offset;
+
+  std::vector<uint8_t> data(static_cast<size_t>(offset));
+  std::memcpy(data.data(), &header, sizeof(header));
+  std::memcpy(data.data() + sizeof(header), section_headers.data(),
+              section_headers.size() * sizeof(SectionHeader));
+  for (size_t i = 0; i < sections.size(); ++i) {
+    if (sections[i].size > 0) {
+      std::memcpy(data.data() + section_headers[i].offset, sections[i].data,
+                  static_cast<size_t>(sections[i].size));
+    }
+  }
+
+  return data;
+}
+
+void WriteFile(const char* path, const std::vector<uint8_t>& data) {
+  std::ofstream file(path, std::ios::out | std::ios::binary | std::ios::trunc);
+  if (!file)
+    throw std::runtime_error(std::string("scene_cache: cannot create ") + path);
+
+  file.write(reinterpret_cast<const char*>(data.data()), data.size());
+  if (!file)
+    throw std::runtime_error(std::string("scene_cache: cannot write ") + path);
+}
+
+void DecodeVertices(const VertexBufferDesc& desc, const uint8_t* data, Vertex* out) {
+  if (desc.format == kVertexFormatFloat) {
+    std::memcpy(out, data, static_cast<size_t>(desc.num_vertices) * sizeof(Vertex));
+    return;
+  }
+
+  const sdkmesh::Float3 scale = {(desc.bounds_max.x - desc.bounds_min.x) / 65535.f,
+                                 (desc.bounds_max.y - desc.bounds_min.y) / 65535.f,
+                                 (desc.bounds_max.z - desc.bounds_min.z) / 65535.f};
+
+  for (uint32_t v = 0; v < desc.num_vertices; ++v) {
+    uint16_t in[8];
+    std::memcpy(in, data + static_cast<size_t>(v) * kQuantizedVertexStride, sizeof(in));
+
+    out[v].position = {desc.bounds_min.x + in[0] * scale.x, desc.bounds_min.y + in[1] * scale.y,
+                       desc.bounds_min.z + in[2] * scale.z};
+    out[v].normal = {std::max(static_cast<int16_t>(in[4]) / 32767.f, -1.f),
+                     std::max(static_cast<int16_t>(in[5]) / 32767.f, -1.f),
+                     std::max(static_cast<int16_t>(in[6]) / 32767.f, -1.f)};
+  }
+}
+
+Scene::Scene(const char* path) : file_(new MappedFile(path)) {
+  base_ = file_->data();
+  size_ = file_->size();
+  Validate(path);
+}
+
+Scene::Scene(std::vector<uint8_t> data) : owned_data_(std::move(data)) {
+  base_ = owned_data_.data();
+  size_ = owned_data_.size();
+  Validate("<memory>");
+}
+
+void Scene::Validate(const char* name) {
+  const std::string prefix = std::string("scene_cache: ") + name + ": ";
+
+  if (size_ < sizeof(FileHeader))
+    throw std::runtime_error(prefix + "file is smaller than the header");
+
+  const FileHeader* header = reinterpret_cast<const FileHeader*>(base_);
+
+  if (std::memcmp(header->magic, kMagic, sizeof(kMagic)) != 0)
+    throw std::runtime_error(prefix + "not a baked scene");
+  if (header->version != kFileVersion) {
+    throw std::runtime_error(prefix + "baked with version " + std::to_string(header->version) +
+                             ", expected " + std::to_string(kFileVersion) + "; re-run the baker");
+  }
+  if (header->file_size != size_)
+    throw std::runtime_error(prefix + "file is truncated");
+  if (!RangeInFile(sizeof(FileHeader), header->num_sections, sizeof(SectionHeader), size_))
+    throw std::runtime_error(prefix + "section table lies outside the file");
+
+  const SectionHeader* sections =
+      reinterpret_cast<const SectionHeader*>(base_ + sizeof(FileHeader));
+
+  bool has_vertex_buffers = false;
+  bool has_index_buffers = false;
+  bool has_draw_ranges = false;
+  bool has_materials = false;
+
+  for (uint32_t i = 0; i < header->num_sections; ++i) {
+    const SectionHeader& section = sections[i];
+
+    if (!RangeInFile(section.offset, section.size, 1, size_) ||
+        section.offset % kSectionAlignment != 0) {
+      throw std::runtime_error(prefix + "section " + std::to_string(i) + " is out of range");
+    }
+
+    const uint8_t* data = base_ + section.offset;
+
+    // Checks that the section is exactly |count| elements of |stride| bytes and marks it as seen.
+    auto check_table = [&](size_t stride, bool* seen) {
+      if (*seen)
+        throw std::runtime_error(prefix + "duplicate section " + std::to_string(section.type));
+      if (section.size != static_cast<uint64_t>(section.count) * stride)
+        throw std::runtime_error(prefix + "section " + std::to_string(i) + " has a bad size");
+      *seen = true;
+    };
+
+    switch (section.type) {
+    case kSectionVertexBuffers:
+      check_table(sizeof(VertexBufferDesc), &has_vertex_buffers);
+      vertex_buffers_ = reinterpret_cast<const VertexBufferDesc*>(data);
+      num_vertex_buffers_ = section.count;
+      break;
+    case kSectionIndexBuffers:
+      check_table(sizeof(IndexBufferDesc), &has_index_buffers);
+      index_buffers_ = reinterpret_cast<const IndexBufferDesc*>(data);
+      num_index_buffers_ = section.count;
+      break;
+    case kSectionDrawRanges:
+      check_table(sizeof(DrawRange), &has_draw_ranges);
+      draw_ranges_ = reinterpret_cast<const DrawRange*>(data);
+      num_draw_ranges_ = section.count;
+      break;
+    case kSectionMaterials:
+      check_table(sizeof(MaterialDesc), &has_materials);
+      materials_ = reinterpret_cast<const MaterialDesc*>(data);
+      num_materials_ = section.count;
+      break;
+    case kSectionGeometries: {
+      bool has_geometries = geometries_ != nullptr;
+      check_table(sizeof(GeometryDesc), &has_geometries);
+      geometries_ = reinterpret_cast<const GeometryDesc*>(data);
+      num_geometries_ = section.count;
+      break;
+    }
+    default:
+      // kSectionBufferData is only reached through the buffer descs. Unknown sections are
+      // skipped.
+      break;
+    }
+  }
+
+  if (!has_vertex_buffers || !has_index_buffers || !has_draw_ranges || !has_materials)
+    throw std::runtime_error(prefix + "missing a required section");
+
+  for (uint32_t i = 0; i < num_vertex_buffers_; ++i) {
+    const VertexBufferDesc& desc = vertex_buffers_[i];
+
+    if (desc.format != kVertexFormatFloat && desc.format != kVertexFormatQuantized)
+      throw std::runtime_error(prefix + "vertex buffer " + std::to_string(i) + " has a bad format");
+    if (desc.stride != VertexStride(desc.format) ||
+        desc.size_bytes != static_cast<uint64_t>(desc.num_vertices) * desc.stride ||
+        !RangeInFile(desc.data_offset, desc.size_bytes, 1, size_) || desc.data_offset % 4 != 0) {
+      throw std::runtime_error(prefix + "vertex buffer " + std::to_string(i) + " is out of range");
+    }
+  }
+
+  for (uint32_t i = 0; i < num_index_buffers_; ++i) {
+    const IndexBufferDesc& desc = index_buffers_[i];
+
+    if (desc.index_type != sdkmesh::kIndexType16Bit &&
+        desc.index_type != sdkmesh::kIndexType32Bit) {
+      throw std::runtime_error(prefix + "index buffer " + std::to_string(i) + " has a bad type");
+    }
+    if (desc.size_bytes !=
+            static_cast<uint64_t>(desc.num_indices) * sdkmesh::IndexSizeInBytes(desc.index_type) ||
+        !RangeInFile(desc.data_offset, desc.size_bytes, 1, size_) || desc.data_offset % 4 != 0) {
+      throw std::runtime_error(prefix + "index buffer " + std::to_string(i) + " is out of range");
+    }
+  }
+
+  auto check_ranges = [&](const char* what, uint32_t i, uint32_t vertex_buffer,
+                          uint32_t index_buffer, uint32_t material_index, uint32_t start_index,
+                          uint32_t index_count, int64_t vertex_offset, uint32_t vertex_count) {
+    const std::string item = prefix + what + " " + std::to_string(i);
+
+    if (vertex_buffer >= num_vertex_buffers_ || index_buffer >= num_index_buffers_ ||
+        material_index >= num_materials_) {
+      throw std::runtime_error(item + " references a missing buffer or material");
+    }
+
+    const uint64_t num_indices = index_buffers_[index_buffer].num_indices;
+    const uint64_t num_vertices = vertex_buffers_[vertex_buffer].num_vertices;
+
+    if (static_cast<uint64_t>(start_index) + index_count > num_indices || vertex_offset < 0 ||
+        static_cast<uint64_t>(vertex_offset) + vertex_count > num_vertices) {
+      throw std::runtime_error(item + " lies outside its buffers");
+    }
+  };
+
+  for (uint32_t i = 0; i < num_draw_ranges_; ++i) {
+    const DrawRange& range = draw_ranges_[i];
+
+    check_ranges("draw range", i, range.vertex_buffer, range.index_buffer, range.material_index,
+                 range.start_index, range.index_count, range.vertex_offset, range.vertex_count);
+    if (sdkmesh::ToD3DPrimitiveTopology(range.primitive_type) == 0)
+      throw std::runtime_error(prefix + "draw range " + std::to_string(i) + " has a bad topology");
+  }
+
+  for (uint32_t i = 0; i < num_geometries_; ++i) {
+    const GeometryDesc& geometry = geometries_[i];
+
+    check_ranges("geometry", i, geometry.vertex_buffer, geometry.index_buffer,
+                 geometry.material_index, geometry.start_index, geometry.index_count,
+                 geometry.vertex_offset, geometry.vertex_count);
+  }
+}
+
+std::unique_ptr<Scene> LoadOrBake(const char* scene_path, const char* sdkmesh_path) {
+  FileHeader header{};
+  {
+    std::ifstream file(scene_path, std::ios::in | std::ios::binary);
+    file.read(reinterpret_cast<char*>(&header), sizeof(header));
+  }
+
+  if (std::memcmp(header.magic, kMagic, sizeof(kMagic)) == 0 && header.version == kFileVersion)
+    return std::make_unique<Scene>(scene_path);
+
+  sdkmesh::Mesh mesh(sdkmesh_path);
+  return std::make_unique<Scene>(Bake(mesh, BakeOptions()));
+}
+
+}  // namespace scene_cache
\ No newline at end of file
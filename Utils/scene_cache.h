@@ -0,0 +1,215 @@
+#ifndef SCENE_CACHE_H_
+#define SCENE_CACHE_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "mapped_file.h"
+#include "sdkmesh.h"
+
+// Baked scene format. A .scene file holds everything the apps derive from an .sdkmesh at startup -
+// draw ranges, resolved materials, the vertex and index blobs and optionally the per-geometry
+// inputs for a raytracing BLAS - already laid out the way they are consumed. Loading one is a
+// single map plus a few pointer fixups.
+//
+// Layout: a FileHeader, a table of SectionHeaders, then the sections. All values are
+// little-endian, every section starts on a kSectionAlignment boundary and all offsets are from the
+// start of the file.
+namespace scene_cache {
+
+constexpr char kMagic[4] = {'D', 'X', 'S', 'C'};
+constexpr uint32_t kFileVersion = 1;
+
+constexpr uint64_t kSectionAlignment = 16;
+
+enum SectionType : uint32_t {
+  kSectionVertexBuffers = 1,
+  kSectionIndexBuffers,
+  kSectionDrawRanges,
+  kSectionMaterials,
+  kSectionGeometries,
+  kSectionBufferData,
+};
+
+enum VertexFormat : uint32_t {
+  // float3 position, float3 normal. Same layout as the source .sdkmesh, uploadable as is.
+  kVertexFormatFloat = 0,
+  // unorm16x4 position inside the buffer's bounds, snorm16x4 normal. The apps decode it to
+  // kVertexFormatFloat at load time.
+  kVertexFormatQuantized = 1,
+};
+
+enum DrawRangeFlags : uint32_t {
+  kDrawRangeAlpha = 1 << 0,
+};
+
+struct FileHeader {
+  char magic[4];
+  uint32_t version;
+  uint32_t num_sections;
+  uint32_t reserved;
+  uint64_t file_size;
+};
+
+struct SectionHeader {
+  uint32_t type;
+  uint32_t count;
+  uint64_t offset;
+  uint64_t size;
+};
+
+struct VertexBufferDesc {
+  uint32_t format;
+  uint32_t stride;
+  uint32_t num_vertices;
+  uint32_t reserved;
+  uint64_t data_offset;
+  uint64_t size_bytes;
+  sdkmesh::Float3 bounds_min;
+  sdkmesh::Float3 bounds_max;
+};
+
+struct IndexBufferDesc {
+  uint32_t index_type;
+  uint32_t num_indices;
+  uint64_t data_offset;
+  uint64_t size_bytes;
+};
+
+// One draw call. Mirrors sdkmesh::MeshPart.
+struct DrawRange {
+  uint32_t vertex_buffer;
+  uint32_t index_buffer;
+  uint32_t material_index;
+  uint32_t primitive_type;
+  uint32_t start_index;
+  uint32_t index_count;
+  int32_t vertex_offset;
+  uint32_t vertex_count;
+  uint32_t flags;
+  uint32_t reserved;
+};
+
+// Material colors as resolved by sdkmesh::Mesh::material_info(). The w component of each color is
+// 0, except for diffuse_color.w, which holds the alpha.
+struct MaterialDesc {
+  sdkmesh::Float4 ambient_color;
+  sdkmesh::Float4 diffuse_color;
+  sdkmesh::Float4 emissive_color;
+};
+
+// One triangle geometry of a bottom-level acceleration structure. Only opaque triangle lists are
+// baked. Indices are relative to vertex_offset and vertex_count is one past the highest index the
+// range references, so the BLAS build does not have to scan the indices.
+struct GeometryDesc {
+  uint32_t vertex_buffer;
+  uint32_t index_buffer;
+  uint32_t start_index;
+  uint32_t index_count;
+  uint32_t vertex_offset;
+  uint32_t vertex_count;
+  uint32_t material_index;
+  uint32_t reserved;
+};
+
+static_assert(sizeof(FileHeader) == 24, "FileHeader size mismatch");
+static_assert(sizeof(SectionHeader) == 24, "SectionHeader size mismatch");
+static_assert(sizeof(VertexBufferDesc) == 56, "VertexBufferDesc size mismatch");
+static_assert(sizeof(IndexBufferDesc) == 24, "IndexBufferDesc size mismatch");
+static_assert(sizeof(DrawRange) == 40, "DrawRange size mismatch");
+static_assert(sizeof(MaterialDesc) == 48, "MaterialDesc size mismatch");
+static_assert(sizeof(GeometryDesc) == 32, "GeometryDesc size mismatch");
+
+// Decoded kVertexFormatFloat vertex.
+struct Vertex {
+  sdkmesh::Float3 position;
+  sdkmesh::Float3 normal;
+};
+
+static_assert(sizeof(Vertex) == 24, "Vertex size mismatch");
+
+struct BakeOptions {
+  // Store vertices as kVertexFormatQuantized instead of kVertexFormatFloat.
+  bool quantize_vertices = false;
+  // Store 32-bit index buffers as 16-bit when every index fits.
+  bool narrow_indices = true;
+  // Include the kSectionGeometries section.
+  bool include_geometries = true;
+};
+
+// Converts a validated .sdkmesh into the baked format.
+std::vector<uint8_t> Bake(const sdkmesh::Mesh& mesh, const BakeOptions& options);
+
+void WriteFile(const char* path, const std::vector<uint8_t>& data);
+
+// Expands |desc.num_vertices| vertices of any format to kVertexFormatFloat.
+void DecodeVertices(const VertexBufferDesc& desc, const uint8_t* data, Vertex* out);
+
+class Scene {
+public:
+  // Maps and validates a baked file. Throws std::runtime_error if the file is not a baked scene,
+  // has a different version, or any section points outside the file.
+  explicit Scene(const char* path);
+
+  // Validates and takes ownership of an in-memory bake.
+  explicit Scene(std::vector<uint8_t> data);
+
+  Scene(const Scene&) = delete;
+  Scene& operator=(const Scene&) = delete;
+
+  uint32_t num_vertex_buffers() const { return num_vertex_buffers_; }
+  const VertexBufferDesc& vertex_buffer(uint32_t index) const { return vertex_buffers_[index]; }
+  const uint8_t* vertex_data(uint32_t index) const {
+    return base_ + vertex_buffers_[index].data_offset;
+  }
+
+  uint32_t num_index_buffers() const { return num_index_buffers_; }
+  const IndexBufferDesc& index_buffer(uint32_t index) const { return index_buffers_[index]; }
+  const uint8_t* index_data(uint32_t index) const {
+    return base_ + index_buffers_[index].data_offset;
+  }
+
+  uint32_t num_draw_ranges() const { return num_draw_ranges_; }
+  const DrawRange& draw_range(uint32_t index) const { return draw_ranges_[index]; }
+
+  uint32_t num_materials() const { return num_materials_; }
+  const MaterialDesc& material(uint32_t index) const { return materials_[index]; }
+
+  // Zero if the file was baked without kSectionGeometries.
+  uint32_t num_geometries() const { return num_geometries_; }
+  const GeometryDesc& geometry(uint32_t index) const { return geometries_[index]; }
+
+  size_t size() const { return size_; }
+
+private:
+  void Validate(const char* name);
+
+  std::unique_ptr<MappedFile> file_;
+  std::vector<uint8_t> owned_data_;
+
+  const uint8_t* base_ = nullptr;
+  size_t size_ = 0;
+
+  const VertexBufferDesc* vertex_buffers_ = nullptr;
+  const IndexBufferDesc* index_buffers_ = nullptr;
+  const DrawRange* draw_ranges_ = nullptr;
+  const MaterialDesc* materials_ = nullptr;
+  const GeometryDesc* geometries_ = nullptr;
+
+  uint32_t num_vertex_buffers_ = 0;
+  uint32_t num_index_buffers_ = 0;
+  uint32_t num_draw_ranges_ = 0;
+  uint32_t num_materials_ = 0;
+  uint32_t num_geometries_ = 0;
+};
+
+// Maps |scene_path| if it exists and was baked with the current kFileVersion. Otherwise bakes
+// |sdkmesh_path| in memory with the default options, so a missing or outdated cache only costs
+// startup time.
+std::unique_ptr<Scene> LoadOrBake(const char* scene_path, const char* sdkmesh_path);
+
+}  // namespace scene_cache
+
+#endif  // SCENE_CACHE_H_
\ No newline at end of file
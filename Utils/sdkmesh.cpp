@@ -0,0 +1,262 @@
+#include "sdkmesh.h"
+
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+namespace sdkmesh {
+
+namespace {
+
+// Values of D3D_PRIMITIVE_TOPOLOGY and DXGI_FORMAT, duplicated so this file builds without the
+// Windows SDK.
+constexpr uint32_t kD3DTopologyUndefined = 0;
+constexpr uint32_t kD3DTopologyPointList = 1;
+constexpr uint32_t kD3DTopologyLineList = 2;
+constexpr uint32_t kD3DTopologyLineStrip = 3;
+constexpr uint32_t kD3DTopologyTriangleList = 4;
+constexpr uint32_t kD3DTopologyTriangleStrip = 5;
+constexpr uint32_t kD3DTopologyLineListAdj = 10;
+constexpr uint32_t kD3DTopologyLineStripAdj = 11;
+constexpr uint32_t kD3DTopologyTriangleListAdj = 12;
+constexpr uint32_t kD3DTopologyTriangleStripAdj = 13;
+constexpr uint32_t kD3DTopology3ControlPointPatchList = 35;
+constexpr uint32_t kD3DTopology4ControlPointPatchList = 36;
+
+constexpr uint32_t kDxgiFormatR32Uint = 42;
+constexpr uint32_t kDxgiFormatR16Uint = 57;
+
+// True if [offset, offset + count * stride) lies inside a file of |file_size| bytes. Written so
+// that none of the intermediate values can overflow.
+bool RangeInFile(uint64_t offset, uint64_t count, uint64_t stride, uint64_t file_size) {
+  if (offset > file_size)
+    return false;
+  if (stride != 0 && count > (file_size - offset) / stride)
+    return false;
+  return true;
+}
+
+template <typename T>
+bool IsAligned(uint64_t offset) {
+  return offset % alignof(T) == 0;
+}
+
+}  // namespace
+
+uint32_t ToD3DPrimitiveTopology(uint32_t primitive_type) {
+  switch (primitive_type) {
+  case kTriangleList: return kD3DTopologyTriangleList;
+  case kTriangleStrip: return kD3DTopologyTriangleStrip;
+  case kLineList: return kD3DTopologyLineList;
+  case kLineStrip: return kD3DTopologyLineStrip;
+  case kPointList: return kD3DTopologyPointList;
+  case kTriangleListAdj: return kD3DTopologyTriangleListAdj;
+  case kTriangleStripAdj: return kD3DTopologyTriangleStripAdj;
+  case kLineListAdj: return kD3DTopologyLineListAdj;
+  case kLineStripAdj: return kD3DTopologyLineStripAdj;
+  case kQuadPatchList: return kD3DTopology4ControlPointPatchList;
+  case kTrianglePatchList: return kD3DTopology3ControlPointPatchList;
+  }
+  return kD3DTopologyUndefined;
+}
+
+uint32_t ToDxgiIndexFormat(uint32_t index_type) {
+  return index_type == kIndexType32Bit ? kDxgiFormatR32Uint : kDxgiFormatR16Uint;
+}
+
+uint32_t IndexSizeInBytes(uint32_t index_type) {
+  return index_type == kIndexType32Bit ? 4 : 2;
+}
+
+Mesh::Mesh(const char* path) : file_(path) {
+  Validate(path);
+  BuildParts();
+}
+
+void Mesh::Validate(const char* path) {
+  const std::string prefix = std::string("sdkmesh: ") + path + ": ";
+
+  const uint64_t file_size = file_.size();
+  const uint8_t* base = file_.data();
+
+  if (file_size < sizeof(Header))
+    throw std::runtime_error(prefix + "file is smaller than the header");
+
+  header_ = reinterpret_cast<const Header*>(base);
+
+  if (header_->version != kFileVersion)
+    throw std::runtime_error(prefix + "unsupported version " + std::to_string(header_->version));
+  if (header_->is_big_endian)
+    throw std::runtime_error(prefix + "big-endian files are not supported");
+
+  const uint64_t header_and_metadata = header_->header_size + header_->non_buffer_data_size;
+  if (header_and_metadata < header_->header_size ||
+      !RangeInFile(header_and_metadata, header_->buffer_data_size, 1, file_size)) {
+    throw std::runtime_error(prefix + "section sizes exceed the file size");
+  }
+
+  struct Section {
+    const char* name;
+    uint64_t offset;
+    uint64_t count;
+    uint64_t stride;
+    bool aligned;
+  };
+
+  const Section sections[] = {
+    {"vertex buffer headers", header_->vertex_stream_headers_offset,
+     header_->num_vertex_buffers, sizeof(VertexBufferHeader),
+     IsAligned<VertexBufferHeader>(header_->vertex_stream_headers_offset)},
+    {"index buffer headers", header_->index_stream_headers_offset, header_->num_index_buffers,
+     sizeof(IndexBufferHeader), IsAligned<IndexBufferHeader>(header_->index_stream_headers_offset)},
+    {"meshes", header_->mesh_data_offset, header_->num_meshes, sizeof(MeshHeader),
+     IsAligned<MeshHeader>(header_->mesh_data_offset)},
+    {"subsets", header_->subset_data_offset, header_->num_total_subsets, sizeof(Subset),
+     IsAligned<Subset>(header_->subset_data_offset)},
+    {"frames", header_->frame_data_offset, header_->num_frames, sizeof(Frame),
+     IsAligned<Frame>(header_->frame_data_offset)},
+    {"materials", header_->material_data_offset, header_->num_materials, sizeof(Material),
+     IsAligned<Material>(header_->material_data_offset)},
+  };
+
+  for (const Section& section : sections) {
+    if (section.count == 0)
+      continue;
+    if (!RangeInFile(section.offset, section.count, section.stride, file_size))
+      throw std::runtime_error(prefix + section.name + " lie outside the file");
+    if (!section.aligned)
+      throw std::runtime_error(prefix + section.name + " are misaligned");
+  }
+
+  vertex_buffers_ = reinterpret_cast<const VertexBufferHeader*>(
+      base + header_->vertex_stream_headers_offset);
+  index_buffers_ = reinterpret_cast<const IndexBufferHeader*>(
+      base + header_->index_stream_headers_offset);
+  meshes_ = reinterpret_cast<const MeshHeader*>(base + header_->mesh_data_offset);
+  subsets_ = reinterpret_cast<const Subset*>(base + header_->subset_data_offset);
+  frames_ = reinterpret_cast<const Frame*>(base + header_->frame_data_offset);
+  materials_ = reinterpret_cast<const Material*>(base + header_->material_data_offset);
+
+  for (uint32_t i = 0; i < header_->num_vertex_buffers; ++i) {
+    const VertexBufferHeader& vb = vertex_buffers_[i];
+
+    if (!RangeInFile(vb.data_offset, vb.size_bytes, 1, file_size))
+      throw std::runtime_error(prefix + "vertex buffer " + std::to_string(i) + " is truncated");
+    if (vb.stride_bytes == 0 || vb.num_vertices > vb.size_bytes / vb.stride_bytes)
+      throw std::runtime_error(prefix + "vertex buffer " + std::to_string(i) + " has a bad size");
+  }
+
+  for (uint32_t i = 0; i < header_->num_index_buffers; ++i) {
+    const IndexBufferHeader& ib = index_buffers_[i];
+
+    if (ib.index_type != kIndexType16Bit && ib.index_type != kIndexType32Bit)
+      throw std::runtime_error(prefix + "index buffer " + std::to_string(i) + " has a bad type");
+    if (!RangeInFile(ib.data_offset, ib.size_bytes, 1, file_size))
+      throw std::runtime_error(prefix + "index buffer " + std::to_string(i) + " is truncated");
+    if (ib.num_indices > ib.size_bytes / IndexSizeInBytes(ib.index_type))
+      throw std::runtime_error(prefix + "index buffer " + std::to_string(i) + " has a bad size");
+  }
+
+  for (uint32_t i = 0; i < header_->num_meshes; ++i) {
+    const MeshHeader& mesh = meshes_[i];
+    const std::string mesh_prefix = prefix + "mesh " + std::to_string(i) + " ";
+
+    if (mesh.num_vertex_buffers == 0 || mesh.num_vertex_buffers > kMaxVertexStreams)
+      throw std::runtime_error(mesh_prefix + "has a bad vertex stream count");
+    for (uint32_t j = 0; j < mesh.num_vertex_buffers; ++j) {
+      if (mesh.vertex_buffers[j] >= header_->num_vertex_buffers)
+        throw std::runtime_error(mesh_prefix + "references a missing vertex buffer");
+    }
+    if (mesh.index_buffer >= header_->num_index_buffers)
+      throw std::runtime_error(mesh_prefix + "references a missing index buffer");
+    if (!RangeInFile(mesh.subset_offset, mesh.num_subsets, sizeof(uint32_t), file_size) ||
+        !IsAligned<uint32_t>(mesh.subset_offset)) {
+      throw std::runtime_error(mesh_prefix + "has a bad subset table");
+    }
+
+    const VertexBufferHeader& vb = vertex_buffers_[mesh.vertex_buffers[0]];
+    const IndexBufferHeader& ib = index_buffers_[mesh.index_buffer];
+
+    const uint32_t* subset_indices =
+        reinterpret_cast<const uint32_t*>(base + mesh.subset_offset);
+
+    for (uint32_t j = 0; j < mesh.num_subsets; ++j) {
+      if (subset_indices[j] >= header_->num_total_subsets)
+        throw std::runtime_error(mesh_prefix + "references a missing subset");
+
+      const Subset& subset = subsets_[subset_indices[j]];
+
+      if (subset.index_start > ib.num_indices ||
+          subset.index_count > ib.num_indices - subset.index_start) {
+        throw std::runtime_error(mesh_prefix + "has a subset outside its index buffer");
+      }
+      if (subset.vertex_start > vb.num_vertices ||
+          subset.vertex_count > vb.num_vertices - subset.vertex_start) {
+        throw std::runtime_error(mesh_prefix + "has a subset outside its vertex buffer");
+      }
+      if (subset.index_start + subset.index_count > UINT32_MAX ||
+          subset.vertex_start + subset.vertex_count > INT32_MAX) {
+        throw std::runtime_error(mesh_prefix + "has a subset too large for a single draw");
+      }
+      if (subset.material_id >= header_->num_materials)
+        throw std::runtime_error(mesh_prefix + "references a missing material");
+      if (ToD3DPrimitiveTopology(subset.primitive_type) == kD3DTopologyUndefined)
+        throw std::runtime_error(mesh_prefix + "has an unknown primitive type");
+    }
+  }
+}
+
+void Mesh::BuildParts() {
+  parts_.reserve(header_->num_total_subsets);
+
+  for (uint32_t i = 0; i < header_->num_meshes; ++i) {
+    const MeshHeader& mesh = meshes_[i];
+    const uint32_t* subset_indices = mesh_subsets(i);
+
+    for (uint32_t j = 0; j < mesh.num_subsets; ++j) {
+      const Subset& subset = subsets_[subset_indices[j]];
+
+      MeshPart part{};
+      part.mesh_index = i;
+      part.vertex_buffer = mesh.vertex_buffers[0];
+      part.index_buffer = mesh.index_buffer;
+      part.material_index = subset.material_id;
+      part.primitive_type = subset.primitive_type;
+      part.start_index = static_cast<uint32_t>(subset.index_start);
+      part.index_count = static_cast<uint32_t>(subset.index_count);
+      part.vertex_offset = static_cast<int32_t>(subset.vertex_start);
+      part.vertex_count = static_cast<uint32_t>(subset.vertex_count);
+      part.is_alpha = material_info(subset.material_id).alpha < 1.f;
+
+      parts_.push_back(part);
+    }
+  }
+}
+
+MaterialInfo Mesh::material_info(uint32_t index) const {
+  const Material& material = materials_[index];
+
+  MaterialInfo info{};
+  info.alpha = 1.f;
+
+  const Float4& ambient = material.ambient;
+  const Float4& diffuse = material.diffuse;
+
+  if (ambient.x == 0.f && ambient.y == 0.f && ambient.z == 0.f && ambient.w == 0.f &&
+      diffuse.x == 0.f && diffuse.y == 0.f && diffuse.z == 0.f && diffuse.w == 0.f) {
+    // The color block was never initialized.
+    info.diffuse_color = {1.f, 1.f, 1.f};
+    return info;
+  }
+
+  info.ambient_color = {ambient.x, ambient.y, ambient.z};
+  info.diffuse_color = {diffuse.x, diffuse.y, diffuse.z};
+  info.emissive_color = {material.emissive.x, material.emissive.y, material.emissive.z};
+
+  if (diffuse.w != 1.f && diffuse.w != 0.f)
+    info.alpha = diffuse.w;
+
+  return info;
+}
+
+}  // namespace sdkmesh
\ No newline at end of file
@@ -0,0 +1,267 @@
+#ifndef SDKMESH_H_
+#define SDKMESH_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "mapped_file.h"
+
+// Zero-copy reader for DXUT .sdkmesh files (version 101). The file is memory-mapped and every
+// accessor returns a pointer into the mapping, so vertex and index data can be handed straight to
+// an upload buffer without an intermediate copy. Does not depend on any Windows or D3D headers.
+namespace sdkmesh {
+
+constexpr uint32_t kFileVersion = 101;
+
+constexpr int kMaxVertexElements = 32;
+constexpr int kMaxVertexStreams = 16;
+constexpr int kMaxNameLength = 100;
+constexpr int kMaxPathLength = 260;
+
+constexpr uint32_t kInvalidIndex = 0xffffffff;
+
+enum IndexType : uint32_t {
+  kIndexType16Bit = 0,
+  kIndexType32Bit = 1,
+};
+
+enum PrimitiveType : uint32_t {
+  kTriangleList = 0,
+  kTriangleStrip,
+  kLineList,
+  kLineStrip,
+  kPointList,
+  kTriangleListAdj,
+  kTriangleStripAdj,
+  kLineListAdj,
+  kLineStripAdj,
+  kQuadPatchList,
+  kTrianglePatchList,
+};
+
+struct Float3 {
+  float x;
+  float y;
+  float z;
+};
+
+struct Float4 {
+  float x;
+  float y;
+  float z;
+  float w;
+};
+
+// The structs below mirror the on-disk layout byte for byte.
+#pragma pack(push, 8)
+
+struct Header {
+  uint32_t version;
+  uint8_t is_big_endian;
+  uint64_t header_size;
+  uint64_t non_buffer_data_size;
+  uint64_t buffer_data_size;
+
+  uint32_t num_vertex_buffers;
+  uint32_t num_index_buffers;
+  uint32_t num_meshes;
+  uint32_t num_total_subsets;
+  uint32_t num_frames;
+  uint32_t num_materials;
+
+  uint64_t vertex_stream_headers_offset;
+  uint64_t index_stream_headers_offset;
+  uint64_t mesh_data_offset;
+  uint64_t subset_data_offset;
+  uint64_t frame_data_offset;
+  uint64_t material_data_offset;
+};
+
+// Same layout as D3DVERTEXELEMENT9. A stream of 0xff terminates the declaration.
+struct VertexElement {
+  uint16_t stream;
+  uint16_t offset;
+  uint8_t type;
+  uint8_t method;
+  uint8_t usage;
+  uint8_t usage_index;
+};
+
+struct VertexBufferHeader {
+  uint64_t num_vertices;
+  uint64_t size_bytes;
+  uint64_t stride_bytes;
+  VertexElement decl[kMaxVertexElements];
+  uint64_t data_offset;
+};
+
+struct IndexBufferHeader {
+  uint64_t num_indices;
+  uint64_t size_bytes;
+  uint32_t index_type;
+  uint64_t data_offset;
+};
+
+struct MeshHeader {
+  char name[kMaxNameLength];
+  uint8_t num_vertex_buffers;
+  uint32_t vertex_buffers[kMaxVertexStreams];
+  uint32_t index_buffer;
+  uint32_t num_subsets;
+  uint32_t num_frame_influences;
+
+  Float3 bounding_box_center;
+  Float3 bounding_box_extents;
+
+  uint64_t subset_offset;
+  uint64_t frame_influence_offset;
+};
+
+struct Subset {
+  char name[kMaxNameLength];
+  uint32_t material_id;
+  uint32_t primitive_type;
+  uint64_t index_start;
+  uint64_t index_count;
+  uint64_t vertex_start;
+  uint64_t vertex_count;
+};
+
+struct Frame {
+  char name[kMaxNameLength];
+  uint32_t mesh;
+  uint32_t parent_frame;
+  uint32_t child_frame;
+  uint32_t sibling_frame;
+  float matrix[16];
+  uint32_t animation_data_index;
+};
+
+struct Material {
+  char name[kMaxNameLength];
+  char material_instance_path[kMaxPathLength];
+  char diffuse_texture[kMaxPathLength];
+  char normal_texture[kMaxPathLength];
+  char specular_texture[kMaxPathLength];
+
+  Float4 diffuse;
+  Float4 ambient;
+  Float4 specular;
+  Float4 emissive;
+  float power;
+
+  // Runtime pointer slots in the original format. Always zero on disk.
+  uint64_t reserved[6];
+};
+
+#pragma pack(pop)
+
+static_assert(sizeof(Header) == 104, "SDKMESH header size mismatch");
+static_assert(sizeof(VertexElement) == 8, "SDKMESH vertex element size mismatch");
+static_assert(sizeof(VertexBufferHeader) == 288, "SDKMESH vertex buffer header size mismatch");
+static_assert(sizeof(IndexBufferHeader) == 32, "SDKMESH index buffer header size mismatch");
+static_assert(sizeof(MeshHeader) == 224, "SDKMESH mesh size mismatch");
+static_assert(sizeof(Subset) == 144, "SDKMESH subset size mismatch");
+static_assert(sizeof(Frame) == 184, "SDKMESH frame size mismatch");
+static_assert(sizeof(Material) == 1256, "SDKMESH material size mismatch");
+
+// Material colors resolved the same way DirectX::Model::CreateFromSDKMESH does it, including the
+// fallback for files whose color block was never written.
+struct MaterialInfo {
+  Float3 ambient_color;
+  Float3 diffuse_color;
+  Float3 emissive_color;
+  float alpha;
+};
+
+// One drawable range, equivalent to a DirectX::ModelMeshPart. Only describes the range; the data
+// itself stays in the mapping.
+struct MeshPart {
+  uint32_t mesh_index;
+  uint32_t vertex_buffer;
+  uint32_t index_buffer;
+  uint32_t material_index;
+  uint32_t primitive_type;
+
+  uint32_t start_index;
+  uint32_t index_count;
+  int32_t vertex_offset;
+  uint32_t vertex_count;
+
+  bool is_alpha;
+};
+
+// D3D_PRIMITIVE_TOPOLOGY value for a PrimitiveType. Returned as an integer so this header stays
+// free of D3D includes.
+uint32_t ToD3DPrimitiveTopology(uint32_t primitive_type);
+
+// DXGI_FORMAT value (R16_UINT or R32_UINT) for an IndexType.
+uint32_t ToDxgiIndexFormat(uint32_t index_type);
+
+uint32_t IndexSizeInBytes(uint32_t index_type);
+
+class Mesh {
+public:
+  // Maps and validates |path|. Throws std::runtime_error if the file is truncated, has an
+  // unsupported version, or any offset or range points outside the file.
+  explicit Mesh(const char* path);
+
+  const Header& header() const { return *header_; }
+
+  uint32_t num_vertex_buffers() const { return header_->num_vertex_buffers; }
+  const VertexBufferHeader& vertex_buffer(uint32_t index) const {
+    return vertex_buffers_[index];
+  }
+  const uint8_t* vertex_data(uint32_t index) const {
+    return file_.data() + vertex_buffers_[index].data_offset;
+  }
+
+  uint32_t num_index_buffers() const { return header_->num_index_buffers; }
+  const IndexBufferHeader& index_buffer(uint32_t index) const { return index_buffers_[index]; }
+  const uint8_t* index_data(uint32_t index) const {
+    return file_.data() + index_buffers_[index].data_offset;
+  }
+
+  uint32_t num_meshes() const { return header_->num_meshes; }
+  const MeshHeader& mesh(uint32_t index) const { return meshes_[index]; }
+  const uint32_t* mesh_subsets(uint32_t index) const {
+    return reinterpret_cast<const uint32_t*>(file_.data() + meshes_[index].subset_offset);
+  }
+
+  uint32_t num_subsets() const { return header_->num_total_subsets; }
+  const Subset& subset(uint32_t index) const { return subsets_[index]; }
+
+  uint32_t num_frames() const { return header_->num_frames; }
+  const Frame& frame(uint32_t index) const { return frames_[index]; }
+
+  uint32_t num_materials() const { return header_->num_materials; }
+  const Material& material(uint32_t index) const { return materials_[index]; }
+  MaterialInfo material_info(uint32_t index) const;
+
+  // Mesh parts in mesh order, then subset order - the order DirectXTK fills
+  // ModelMesh::opaqueMeshParts/alphaMeshParts in.
+  const std::vector<MeshPart>& parts() const { return parts_; }
+
+  size_t file_size() const { return file_.size(); }
+
+private:
+  void Validate(const char* path);
+  void BuildParts();
+
+  MappedFile file_;
+
+  const Header* header_ = nullptr;
+  const VertexBufferHeader* vertex_buffers_ = nullptr;
+  const IndexBufferHeader* index_buffers_ = nullptr;
+  const MeshHeader* meshes_ = nullptr;
+  const Subset* subsets_ = nullptr;
+  const Frame* frames_ = nullptr;
+  const Material* materials_ = nullptr;
+
+  std::vector<MeshPart> parts_;
+};
+
+}  // namespace sdkmesh
+
+#endif  // SDKMESH_H_
\ No newline at end of file
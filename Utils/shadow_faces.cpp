@@ -0,0 +1,30 @@
+#include "shadow_faces.h"
+
+uint32_t ClipOutcode(float x, float y, float z, float w) {
+  return (x < -w ? 1u : 0u) | (x > w ? 2u : 0u) | (y < -w ? 4u : 0u) | (y > w ? 8u : 0u) |
+         (z < 0.f ? 16u : 0u) | (z > w ? 32u : 0u);
+}
+
+bool BoxInFrustum(const float corners[8][4]) {
+  uint32_t outside = ~0u;
+  for (int i = 0; i < 8; ++i)
+    outside &= ClipOutcode(corners[i][0], corners[i][1], corners[i][2], corners[i][3]);
+  return outside == 0;
+}
+
+uint32_t PackShadowFaces(uint32_t face_mask) {
+  uint32_t faces = 0;
+  int count = 0;
+  for (int face = 0; face < kNumShadowFaces; ++face) {
+    if (face_mask & (1u << face))
+      faces |= static_cast<uint32_t>(face) << (3 * count++);
+  }
+  return faces;
+}
+
+int CountShadowFaces(uint32_t face_mask) {
+  int count = 0;
+  for (int face = 0; face < kNumShadowFaces; ++face)
+    count += (face_mask >> face) & 1;
+  return count;
+}
\ No newline at end of file
@@ -0,0 +1,31 @@
+#ifndef SHADOW_FACES_H_
+#define SHADOW_FACES_H_
+
+#include <cstdint>
+
+// Single-pass cubemap shadows: the shadow pass draws each draw once, instanced once per cubemap
+// face its bounds reach, and shadow_pass_single_vs.hlsl sends instance i to the face in bits
+// [3i, 3i + 3) of the draw's face list, a root constant, through SV_RenderTargetArrayIndex. The
+// app and the CPU reference cull the draws against the faces with the functions below.
+
+constexpr int kNumShadowFaces = 6;
+
+// Outside bits of the clip-space point (x, y, z, w) against the frustum planes -w <= x <= w,
+// -w <= y <= w and 0 <= z <= w.
+uint32_t ClipOutcode(float x, float y, float z, float w);
+
+// Whether a box with the clip-space corners |corners| may reach the frustum. It is culled only
+// when every corner is outside the same plane, so boxes that straddle a frustum corner are kept.
+bool BoxInFrustum(const float corners[8][4]);
+
+// The faces set in |face_mask|, bit f for face f, in ascending order, 3 bits each.
+uint32_t PackShadowFaces(uint32_t face_mask);
+
+// The face instance |instance| of a draw with the face list |faces| goes to.
+inline int UnpackShadowFace(uint32_t faces, int instance) {
+  return static_cast<int>((faces >> (3 * instance)) & 7);
+}
+
+int CountShadowFaces(uint32_t face_mask);
+
+#endif  // SHADOW_FACES_H_
\ No newline at end of file
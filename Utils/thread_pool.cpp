@@ -0,0 +1,80 @@
+#include "thread_pool.h"
+
+ThreadPool::ThreadPool(int num_threads) {
+  if (num_threads <= 0)
+    num_threads = static_cast<int>(std::thread::hardware_concurrency());
+  if (num_threads <= 0)
+    num_threads = 1;
+
+  for (int i = 1; i < num_threads; ++i)
+    workers_.emplace_back(&ThreadPool::WorkerMain, this, i);
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    exiting_ = true;
+  }
+  work_available_.notify_all();
+
+  for (std::thread& worker : workers_)
+    worker.join();
+}
+
+void ThreadPool::ParallelFor(int count, const std::function<void(int, int)>& fn) {
+  if (count <= 0)
+    return;
+
+  if (workers_.empty() || count == 1) {
+    for (int i = 0; i < count; ++i)
+      fn(i, 0);
+    return;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    job_ = &fn;
+    job_count_ = count;
+    next_index_.store(0, std::memory_order_relaxed);
+    busy_workers_ = static_cast<int>(workers_.size());
+    ++generation_;
+  }
+  work_available_.notify_all();
+
+  RunIndices(0);
+
+  std::unique_lock<std::mutex> lock(mutex_);
+  work_done_.wait(lock, [this] { return busy_workers_ == 0; });
+  job_ = nullptr;
+}
+
+void ThreadPool::WorkerMain(int thread_index) {
+  uint64_t seen_generation = 0;
+
+  for (;;) {
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      work_available_.wait(lock, [&] { return exiting_ || generation_ != seen_generation; });
+      if (exiting_)
+        return;
+      seen_generation = generation_;
+    }
+
+    RunIndices(thread_index);
+
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      --busy_workers_;
+    }
+    work_done_.notify_one();
+  }
+}
+
+void ThreadPool::RunIndices(int thread_index) {
+  for (;;) {
+    int index = next_index_.fetch_add(1, std::memory_order_relaxed);
+    if (index >= job_count_)
+      return;
+    (*job_)(index, thread_index);
+  }
+}
\ No newline at end of file
@@ -0,0 +1,49 @@
+#ifndef THREAD_POOL_H_
+#define THREAD_POOL_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed set of worker threads that run one data-parallel loop at a time. Indices are handed out
+// through a shared counter, so uneven work items (image tiles, BVH subtrees) balance themselves.
+class ThreadPool {
+public:
+  // |num_threads| counts the calling thread, which also runs work in ParallelFor. 0 uses one
+  // thread per hardware thread.
+  explicit ThreadPool(int num_threads = 0);
+  ~ThreadPool();
+
+  ThreadPool(const ThreadPool&) = delete;
+  ThreadPool& operator=(const ThreadPool&) = delete;
+
+  int num_threads() const { return static_cast<int>(workers_.size()) + 1; }
+
+  // Calls |fn(index, thread_index)| for every index in [0, count) and returns once all calls have
+  // finished. thread_index is in [0, num_threads()) and is unique among concurrent calls, for
+  // per-thread scratch data. Must not be called from inside |fn|.
+  void ParallelFor(int count, const std::function<void(int index, int thread_index)>& fn);
+
+private:
+  void WorkerMain(int thread_index);
+  void RunIndices(int thread_index);
+
+  std::vector<std::thread> workers_;
+
+  std::mutex mutex_;
+  std::condition_variable work_available_;
+  std::condition_variable work_done_;
+
+  const std::function<void(int, int)>* job_ = nullptr;
+  int job_count_ = 0;
+  std::atomic<int> next_index_{0};
+  int busy_workers_ = 0;
+  uint64_t generation_ = 0;
+  bool exiting_ = false;
+};
+
+#endif  // THREAD_POOL_H_
\ No newline at end of file
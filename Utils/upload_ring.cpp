@@ -0,0 +1,67 @@
+#include "upload_ring.h"
+
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+
+UploadRing::UploadRing(uint64_t capacity) : capacity_(capacity) {
+  if (capacity == 0)
+    throw std::runtime_error("upload_ring: capacity must not be 0");
+}
+
+uint64_t UploadRing::Allocate(uint64_t size, uint64_t alignment) {
+  if (size > capacity_ || alignment > capacity_) {
+    throw std::runtime_error("upload_ring: " + std::to_string(size) +
+                             " bytes do not fit in a ring of " + std::to_string(capacity_));
+  }
+
+  // An empty ring starts over at offset 0, so that nothing is skipped.
+  if (head_ == tail_) {
+    head_ = (head_ + capacity_ - 1) / capacity_ * capacity_;
+    tail_ = head_;
+    open_start_ = head_;
+  }
+
+  const uint64_t ring_start = head_ - head_ % capacity_;
+  uint64_t offset = (head_ % capacity_ + alignment - 1) & ~(alignment - 1);
+  uint64_t start = ring_start + offset;
+  if (offset + size > capacity_) {
+    start = ring_start + capacity_;
+    offset = 0;
+  }
+
+  const uint64_t end = start + size;
+  if (end - tail_ > capacity_) {
+    ++stats_.failed_allocations;
+    return kFull;
+  }
+
+  stats_.bytes_allocated += size;
+  stats_.bytes_skipped += start - head_;
+  open_allocated_ += size;
+  head_ = end;
+  stats_.peak_bytes_in_use = std::max(stats_.peak_bytes_in_use, head_ - tail_);
+  return offset;
+}
+
+void UploadRing::Submit(uint64_t fence_value) {
+  if (!submissions_.empty() && fence_value < submissions_.back().fence_value)
+    throw std::runtime_error("upload_ring: fence values must not decrease");
+
+  ++stats_.submissions;
+  stats_.last_submission_bytes = open_allocated_;
+  stats_.peak_submission_bytes = std::max(stats_.peak_submission_bytes, open_allocated_);
+  open_allocated_ = 0;
+
+  if (head_ == open_start_)
+    return;
+  submissions_.push_back({fence_value, head_});
+  open_start_ = head_;
+}
+
+void UploadRing::Retire(uint64_t completed_fence_value) {
+  while (!submissions_.empty() && submissions_.front().fence_value <= completed_fence_value) {
+    tail_ = submissions_.front().end;
+    submissions_.pop_front();
+  }
+}
\ No newline at end of file
@@ -0,0 +1,75 @@
+#ifndef UPLOAD_RING_H_
+#define UPLOAD_RING_H_
+
+#include <cstdint>
+#include <deque>
+
+// Hands out ranges of a fixed-size ring, such as a persistently mapped upload buffer, and takes
+// them back once the GPU work that read them has completed. Ranges are allocated and retired in
+// order, and a range never wraps around the end of the ring.
+//
+// Allocations made since the last Submit() are open: the ring cannot retire them until they are
+// submitted with the fence value their GPU work signals.
+class UploadRing {
+public:
+  static constexpr uint64_t kFull = UINT64_MAX;
+
+  struct Stats {
+    uint64_t bytes_allocated = 0;
+    // Alignment padding and the unused ends of the ring skipped when wrapping.
+    uint64_t bytes_skipped = 0;
+    uint64_t peak_bytes_in_use = 0;
+    // Allocate() calls that failed because the ring was full.
+    uint64_t failed_allocations = 0;
+    uint64_t submissions = 0;
+    // Bytes allocated for the last and the largest submission.
+    uint64_t last_submission_bytes = 0;
+    uint64_t peak_submission_bytes = 0;
+  };
+
+  explicit UploadRing(uint64_t capacity);
+
+  // Offset of |size| bytes aligned to |alignment|, a power of two, or kFull if that memory is still
+  // in use. Throws if |size| can never fit.
+  uint64_t Allocate(uint64_t size, uint64_t alignment);
+
+  // Closes the open allocations. They are retired once |fence_value| has completed. Fence values
+  // must not decrease.
+  void Submit(uint64_t fence_value);
+
+  // Retires the submissions whose fence values are at most |completed_fence_value|.
+  void Retire(uint64_t completed_fence_value);
+
+  // Whether some submission is still in use. When Allocate() fails, waiting for the oldest one is
+  // the way to make room, unless the ring is full of open allocations.
+  bool has_submissions() const { return !submissions_.empty(); }
+  uint64_t oldest_fence_value() const { return submissions_.front().fence_value; }
+
+  uint64_t capacity() const { return capacity_; }
+  uint64_t bytes_in_use() const { return head_ - tail_; }
+  uint64_t open_bytes() const { return head_ - open_start_; }
+
+  const Stats& stats() const { return stats_; }
+
+private:
+  struct Submission {
+    uint64_t fence_value;
+    // Where the submission ends, as a position in head_'s count.
+    uint64_t end;
+  };
+
+  uint64_t capacity_;
+
+  // Bytes allocated and retired since the start, counting skipped bytes. The ring offset of a
+  // position is its remainder by capacity_.
+  uint64_t head_ = 0;
+  uint64_t tail_ = 0;
+  uint64_t open_start_ = 0;
+  uint64_t open_allocated_ = 0;
+
+  std::deque<Submission> submissions_;
+
+  Stats stats_;
+};
+
+#endif  // UPLOAD_RING_H_
\ No newline at end of file